@@ -19,6 +19,9 @@
 #include <QGraphicsSceneMouseEvent>
 #include <QMouseEvent>
 #include <QPushButton>
+#include <QHash>
+
+#include <cmath>
 
 #include "Global.h"
 #include "MainWindow.h"
@@ -31,10 +34,51 @@
 namespace
 {
 const double ARROW_LENGTH = 30;
+
+// Animation stops once no item moves more than this in one step
+const double LAYOUT_EPSILON = 0.05;
+
+// Nodes reachable from first, in an order only depending on the structure
+// of the cycle, so that two copies of the same cycle are visited in the same
+// order
+QList<AnimatedCycleNode*> orderedNodes(AnimatedCycleNode * first)
+{
+    QList<AnimatedCycleNode*> res;
+    QSet<AnimatedCycleNode*> visited;
+    if(first)
+    {
+        res << first;
+        visited << first;
+    }
+    for(int i=0; i<res.size(); ++i)
+    {
+        AnimatedCycleNode * node = res[i];
+        AnimatedCycleNode * pointedNodes[4] = { node->next(),
+                                                node->after(),
+                                                node->previous(),
+                                                node->before() };
+        for(int j=0; j<4; ++j)
+        {
+            if(pointedNodes[j] && !visited.contains(pointedNodes[j]))
+            {
+                res << pointedNodes[j];
+                visited << pointedNodes[j];
+            }
+        }
+    }
+    return res;
+}
+
+// Whether an arrow between the two items may intersect rect
+bool mayBeVisible(GraphicsNodeItem * item1, GraphicsNodeItem * item2, const QRectF & rect)
+{
+    return rect.intersects(item1->sceneBoundingRect().united(item2->sceneBoundingRect()));
+}
 }
 
 GraphicsNodeItem::GraphicsNodeItem(AnimatedCycleNode * node, AnimatedCycleWidget * widget) :
     node_(node),
+    cell_(node->cell()),
     widget_(widget),
     isMoved_(false)
 {
@@ -74,13 +118,13 @@ GraphicsNodeItem::GraphicsNodeItem(AnimatedCycleNode * node, AnimatedCycleWidget
     setFlag(ItemIsMovable, true);
 
     // Observe cell
-    observe(node_->cell());
+    observe(cell_);
 }
 
 GraphicsNodeItem::~GraphicsNodeItem()
 {
-    // Unobserve cell
-    unobserve(node_->cell());
+    // Unobserve cell. Note: node_ may already be deleted
+    unobserve(cell_);
 }
 
 void GraphicsNodeItem::observedCellDeleted(Cell *)
@@ -159,6 +203,7 @@ void GraphicsNodeItem::mousePressEvent(QGraphicsSceneMouseEvent * event)
     if(event->button() == Qt::LeftButton)
     {
         isMoved_ = true;
+        widget_->wakeUp();
         QGraphicsPathItem::mousePressEvent(event);
     }
     else if(event->button() == Qt::RightButton)
@@ -208,6 +253,12 @@ AnimatedCycleNode * GraphicsNodeItem::node() const
     return node_;
 }
 
+void GraphicsNodeItem::setNode(AnimatedCycleNode * node)
+{
+    node_ = node;
+    updateText();
+}
+
 GraphicsNodeItem * GraphicsNodeItem::next()
 {
     return widget_->next(this);
@@ -278,6 +329,20 @@ void AnimatedCycleGraphicsView::wheelEvent(QWheelEvent *event)
     setTransformationAnchor(AnchorUnderMouse);
     double ratio = 1.0 / pow( 0.8f, (double) event->delta() / (double) 120.0f);
     scale(ratio, ratio);
+    animatedCycleWidget_->wakeUp();
+}
+
+// Arrows are only updated while visible, so those coming into view must be
+void AnimatedCycleGraphicsView::scrollContentsBy(int dx, int dy)
+{
+    QGraphicsView::scrollContentsBy(dx, dy);
+    animatedCycleWidget_->wakeUp();
+}
+
+void AnimatedCycleGraphicsView::resizeEvent(QResizeEvent * event)
+{
+    QGraphicsView::resizeEvent(event);
+    animatedCycleWidget_->wakeUp();
 }
 
 GraphicsNodeItem * AnimatedCycleGraphicsView::nodeItemAt(const QPoint & pos)
@@ -508,6 +573,7 @@ void AnimatedCycleWidget::createItem(AnimatedCycleNode * node)
     GraphicsNodeItem * item = new GraphicsNodeItem(node, this);
     scene_->addItem(item);
     nodeToItem_[node] = item;
+    wakeUp();
 }
 
 void AnimatedCycleWidget::addSelectedCells()
@@ -533,6 +599,12 @@ void AnimatedCycleWidget::stop()
     timer_.stop();
 }
 
+void AnimatedCycleWidget::wakeUp()
+{
+    if(isVisible())
+        timer_.start();
+}
+
 AnimatedCycleWidget::~AnimatedCycleWidget()
 {
     clearAnimatedCycle(); // important: cells must be unobserved
@@ -578,14 +650,28 @@ void AnimatedCycleWidget::observedCellDeleted(Cell *)
     clearAnimatedCycle();
 }
 
+void AnimatedCycleWidget::observedCellsChanged(VAC *, const CellChanges & changes)
+{
+    // Update the graph if the cycle was changed by something else than this
+    // editor (e.g., an operator replacing some of its cells)
+    if(inbetweenFace_ && changes.modified.contains(inbetweenFace_->id()) &&
+       indexCycle_ >= 0 && indexCycle_ < inbetweenFace_->numAnimatedCycles() &&
+       inbetweenFace_->animatedCycle(indexCycle_).toString() != savedCycle_)
+    {
+        load();
+    }
+}
+
 void AnimatedCycleWidget::clearAnimatedCycle()
 {
     // Break connection between widget and vac
     if(inbetweenFace_)
     {
         unobserve(inbetweenFace_);
+        unobserve(inbetweenFace_->vac());
         inbetweenFace_ = 0;
     }
+    savedCycle_.clear();
 
     // Clear scene
     clearScene();
@@ -593,6 +679,13 @@ void AnimatedCycleWidget::clearAnimatedCycle()
 
 void AnimatedCycleWidget::setAnimatedCycle(InbetweenFace * inbetweenFace, int indexCycle)
 {
+    // Same cycle: only update what changed
+    if(inbetweenFace && inbetweenFace == inbetweenFace_ && indexCycle == indexCycle_)
+    {
+        load();
+        return;
+    }
+
     // Clear
     clearAnimatedCycle();
 
@@ -603,6 +696,7 @@ void AnimatedCycleWidget::setAnimatedCycle(InbetweenFace * inbetweenFace, int in
         indexCycle_ = indexCycle;
 
         observe(inbetweenFace_);
+        observe(inbetweenFace_->vac());
 
         load();
     }
@@ -622,14 +716,20 @@ void AnimatedCycleWidget::setAnimatedCycle(const AnimatedCycle & animatedCycle)
 
 void AnimatedCycleWidget::load()
 {
-    clearScene();
-
     if(inbetweenFace_ && indexCycle_ >= 0 && indexCycle_ < inbetweenFace_->numAnimatedCycles())
     {
+        // Note: copying the cycle deletes the nodes of the current one, which
+        // items keep pointing to until updated
+        QMap<NodeKey, GraphicsNodeItem*> oldItems = itemsByKey_();
         animatedCycle_ = inbetweenFace_->animatedCycle(indexCycle_);
-        computeSceneFromAnimatedCycle();
+        savedCycle_ = animatedCycle_.toString();
+        updateSceneFromAnimatedCycle_(oldItems);
         start();
     }
+    else
+    {
+        clearScene();
+    }
 }
 
 void AnimatedCycleWidget::save()
@@ -637,12 +737,14 @@ void AnimatedCycleWidget::save()
     if(inbetweenFace_ && indexCycle_ >= 0 && indexCycle_ < inbetweenFace_->numAnimatedCycles())
     {
         inbetweenFace_->setCycle(indexCycle_,animatedCycle_);
+        savedCycle_ = inbetweenFace_->animatedCycle(indexCycle_).toString();
 
         VectorAnimationComplex::VAC * vac = inbetweenFace_->vac();
         emit vac->needUpdatePicking();
         emit vac->changed();
         emit vac->checkpoint();
     }
+    wakeUp();
 }
 
 AnimatedCycle AnimatedCycleWidget::getAnimatedCycle() const
@@ -853,13 +955,40 @@ void AnimatedCycleWidget::deleteItem(GraphicsNodeItem * item)
             animatedCycle_.setFirst(first);
         }
     }
+
+    wakeUp();
 }
 
 void AnimatedCycleWidget::computeSceneFromAnimatedCycle()
 {
-    // Clear scene
     clearScene();
+    updateSceneFromAnimatedCycle_(QMap<NodeKey, GraphicsNodeItem*>());
+}
+
+QMap<AnimatedCycleWidget::NodeKey, GraphicsNodeItem*> AnimatedCycleWidget::itemsByKey_() const
+{
+    // Nodes connected to first, then the others, which the editor may have
+    // but not the saved cycle
+    QList<AnimatedCycleNode*> nodes = orderedNodes(animatedCycle_.first());
+    QSet<AnimatedCycleNode*> connectedNodes = nodes.toSet();
+    for(auto it = nodeToItem_.begin(); it != nodeToItem_.end(); ++it)
+    {
+        if(it.key() && !connectedNodes.contains(it.key()))
+            nodes << it.key();
+    }
 
+    QMap<NodeKey, GraphicsNodeItem*> res;
+    QHash<Cell*, int> numVisits;
+    foreach(AnimatedCycleNode * node, nodes)
+    {
+        Cell * cell = node->cell();
+        res[NodeKey(cell, numVisits[cell]++)] = nodeToItem_.value(node);
+    }
+    return res;
+}
+
+void AnimatedCycleWidget::updateSceneFromAnimatedCycle_(QMap<NodeKey, GraphicsNodeItem*> oldItems)
+{
     // Get start nodes
     QSet<AnimatedCycleNode*> startNodes;
     AnimatedCycleNode * startNode = animatedCycle_.first();
@@ -869,56 +998,96 @@ void AnimatedCycleWidget::computeSceneFromAnimatedCycle()
         startNode = startNode->after();
     }
 
-    // Create items
-    foreach(AnimatedCycleNode * node, animatedCycle_.nodes())
+    // Reuse the items of nodes which already existed, keeping their position,
+    // and create the others
+    QList<AnimatedCycleNode*> nodes = orderedNodes(animatedCycle_.first());
+    QList<GraphicsNodeItem*> newItems;
+    QHash<Cell*, int> numVisits;
+    nodeToItem_.clear();
+    nodeToItem_[0] = 0;
+    foreach(AnimatedCycleNode * node, nodes)
     {
-        GraphicsNodeItem * item = new GraphicsNodeItem(node, this);
-        scene_->addItem(item);
+        Cell * cell = node->cell();
+        GraphicsNodeItem * item = oldItems.take(NodeKey(cell, numVisits[cell]++));
+        if(item)
+        {
+            item->setNode(node);
+        }
+        else
+        {
+            item = new GraphicsNodeItem(node, this);
+            scene_->addItem(item);
+            newItems << item;
+        }
         nodeToItem_[node] = item;
     }
 
+    // Place new items right of their previous item, if any, so that they
+    // don't have to travel across the whole graph
+    QSet<GraphicsNodeItem*> unplacedItems = newItems.toSet();
+    foreach(GraphicsNodeItem * item, newItems)
+    {
+        GraphicsNodeItem * previousItem = nodeToItem_.value(item->node()->previous());
+        if(previousItem && !unplacedItems.contains(previousItem))
+            item->setX(previousItem->x() + 0.5 * (previousItem->width() + item->width()) + ARROW_LENGTH);
+        unplacedItems.remove(item);
+    }
+
     // Set item height and Y
     computeItemHeightAndY();
 
-    // Create arrows
-    foreach(AnimatedCycleNode * node, animatedCycle_.nodes())
+    // Create or reuse arrows
+    typedef QMap<GraphicsNodeItem*, GraphicsArrowItem*> Map;
+    const int NUM_MAPS = 6;
+    Map * maps[NUM_MAPS] = { &itemToNextArrow_ ,
+                             &itemToPreviousArrow_ ,
+                             &itemToNextArrowBorder_ ,
+                             &itemToPreviousArrowBorder_ ,
+                             &itemToAfterArrow_ ,
+                             &itemToBeforeArrow_ };
+    Map oldMaps[NUM_MAPS];
+    for(int i=0; i<NUM_MAPS; ++i)
+        maps[i]->swap(oldMaps[i]);
+    auto setArrow = [&] (int i, GraphicsNodeItem * item)
     {
-        GraphicsNodeItem * item = nodeToItem_[node];
-
-        if(node->next()) // can be false if cycle is invalid
+        GraphicsArrowItem * arrow = oldMaps[i].take(item);
+        if(!arrow)
         {
-            GraphicsArrowItem * arrow = new GraphicsArrowItem();
+            arrow = new GraphicsArrowItem();
             scene_->addItem(arrow);
-            if(!startNodes.contains(node->next()))
-                itemToNextArrow_[item] = arrow;
-            else
-                itemToNextArrowBorder_[item] = arrow;
         }
+        (*maps[i])[item] = arrow;
+    };
+    foreach(AnimatedCycleNode * node, nodes)
+    {
+        GraphicsNodeItem * item = nodeToItem_[node];
+
+        if(node->next()) // can be false if cycle is invalid
+            setArrow(startNodes.contains(node->next()) ? 2 : 0, item);
 
         if(node->previous()) // can be false if cycle is invalid
-        {
-            GraphicsArrowItem * arrow = new GraphicsArrowItem();
-            scene_->addItem(arrow);
-            if(!startNodes.contains(node))
-                itemToPreviousArrow_[item] = arrow;
-            else
-                itemToPreviousArrowBorder_[item] = arrow;
-        }
+            setArrow(startNodes.contains(node) ? 3 : 1, item);
 
         if(node->after())
-        {
-            GraphicsArrowItem * arrow = new GraphicsArrowItem();
-            scene_->addItem(arrow);
-            itemToAfterArrow_[item] = arrow;
-        }
+            setArrow(4, item);
 
         if(node->before())
-        {
-            GraphicsArrowItem * arrow = new GraphicsArrowItem();
-            scene_->addItem(arrow);
-            itemToBeforeArrow_[item] = arrow;
-        }
+            setArrow(5, item);
+    }
+
+    // Delete arrows and items which are not used anymore
+    for(int i=0; i<NUM_MAPS; ++i)
+    {
+        foreach(GraphicsArrowItem * arrow, oldMaps[i])
+            delete arrow;
     }
+    foreach(GraphicsNodeItem * item, oldItems)
+    {
+        if(item)
+            delete item;
+    }
+
+    wakeUp();
 }
 
 void AnimatedCycleWidget::computeItemHeightAndY()
@@ -952,6 +1121,9 @@ void AnimatedCycleWidget::computeItemHeightAndY()
     // Sort key times and compute height and Y of items
     QList<int> keyTimesSorted = keyTimes.toList();
     qSort(keyTimesSorted);
+    QHash<int, int> keyTimeIndices;
+    for(int i=0; i<keyTimesSorted.size(); ++i)
+        keyTimeIndices[keyTimesSorted[i]] = i;
     for(Iterator it = nodeToItem_.begin(); it != nodeToItem_.end(); ++it)
     {
         AnimatedCycleNode * node = it.key();
@@ -967,16 +1139,8 @@ void AnimatedCycleWidget::computeItemHeightAndY()
             int tBefore = inbetweenCell->beforeTime().frame();
             int tAfter = inbetweenCell->afterTime().frame();
 
-            int idBefore = 0;
-            int idAfter = 0;
-            for(int i=0; i<keyTimesSorted.size(); ++i)
-            {
-                if(keyTimesSorted[i]==tBefore)
-                    idBefore = i;
-
-                if(keyTimesSorted[i]==tAfter)
-                    idAfter = i;
-            }
+            int idBefore = keyTimeIndices.value(tBefore);
+            int idAfter = keyTimeIndices.value(tAfter);
 
             item->setHeight(idAfter-idBefore);
 
@@ -989,12 +1153,7 @@ void AnimatedCycleWidget::computeItemHeightAndY()
         {
             int t = cell->toKeyCell()->time().frame();
 
-            int id = 0;
-            for(int i=0; i<keyTimesSorted.size(); ++i)
-            {
-                if(keyTimesSorted[i]==t)
-                    id = i;
-            }
+            int id = keyTimeIndices.value(t);
 
             item->setFixedY(id * (80 + 2*ARROW_LENGTH));
         }
@@ -1032,13 +1191,13 @@ void AnimatedCycleWidget::animate()
     QMap<GraphicsNodeItem*, double> deltaMaxX;
 
     // Get all items
-    QSet<GraphicsNodeItem*> items;
-    foreach(QGraphicsItem * i, scene_->items())
+    QList<GraphicsNodeItem*> items;
+    foreach(GraphicsNodeItem * item, nodeToItem_)
     {
-        GraphicsNodeItem * item = qgraphicsitem_cast<GraphicsNodeItem *>(i);
         if(item)
             items << item;
     }
+    bool hasChanged = false;
 
     // Initialize values
     foreach(GraphicsNodeItem * item, items)
@@ -1154,9 +1313,11 @@ void AnimatedCycleWidget::animate()
 
             // grow inbetween edge
             double widthBeforeAfter = std::max(widthBeforeItems,widthAfterItems);
-            if(60 /*item->width()*/ < widthBeforeAfter)
+            if(60 /*item->width()*/ < widthBeforeAfter &&
+               std::abs(item->width() - widthBeforeAfter) > LAYOUT_EPSILON)
             {
                 item->setWidth(/*0.999 **/ widthBeforeAfter);
+                hasChanged = true;
             }
         }
     }
@@ -1236,12 +1397,29 @@ void AnimatedCycleWidget::animate()
         GraphicsNodeItem * item = it3.key();
         double delta = it3.value();
         double ratio = 0.8;//Random::random(0.8,0.95);
-        if(!item->isMoved())
+        if(item->isMoved())
+        {
+            hasChanged = true;
+        }
+        else if(std::abs(ratio*delta) > LAYOUT_EPSILON)
+        {
             item->moveBy(ratio*delta, 0);
+            hasChanged = true;
+        }
     }
 
-    // update arrows
-    it = QMapIterator<GraphicsNodeItem*, GraphicsArrowItem*>(itemToNextArrow_);
+    // Update arrows, then rest until something changes
+    updateArrows_();
+    if(!hasChanged)
+        stop();
+}
+
+void AnimatedCycleWidget::updateArrows_()
+{
+    QRectF visibleRect = view_->mapToScene(view_->viewport()->rect()).boundingRect()
+            .adjusted(-ARROW_LENGTH, -ARROW_LENGTH, ARROW_LENGTH, ARROW_LENGTH);
+
+    QMapIterator<GraphicsNodeItem*, GraphicsArrowItem*> it(itemToNextArrow_);
     while(it.hasNext())
     {
         it.next();
@@ -1249,6 +1427,8 @@ void AnimatedCycleWidget::animate()
         GraphicsNodeItem * item = it.key();
         GraphicsNodeItem * nextItem = item->next();
         GraphicsArrowItem * nextArrow = it.value();
+        if(!mayBeVisible(item, nextItem, visibleRect))
+            continue;
 
         double y1 = item->pos().y();
         if(!nextItem->node()->cell()->toInbetweenEdge())
@@ -1280,6 +1460,8 @@ void AnimatedCycleWidget::animate()
         GraphicsNodeItem * item = it.key();
         GraphicsNodeItem * previousItem = item->previous();
         GraphicsArrowItem * previousArrow = it.value();
+        if(!mayBeVisible(item, previousItem, visibleRect))
+            continue;
 
         double y1 = item->pos().y();
         if(!previousItem->node()->cell()->toInbetweenEdge())
@@ -1311,6 +1493,8 @@ void AnimatedCycleWidget::animate()
         GraphicsNodeItem * item = it.key();
         GraphicsNodeItem * nextItem = item->next();
         GraphicsArrowItem * nextArrow = it.value();
+        if(!mayBeVisible(item, nextItem, visibleRect))
+            continue;
 
         double y1 = item->pos().y();
         if(!nextItem->node()->cell()->toInbetweenEdge())
@@ -1342,6 +1526,8 @@ void AnimatedCycleWidget::animate()
         GraphicsNodeItem * item = it.key();
         GraphicsNodeItem * previousItem = item->previous();
         GraphicsArrowItem * previousArrow = it.value();
+        if(!mayBeVisible(item, previousItem, visibleRect))
+            continue;
 
         double y1 = item->pos().y();
         if(!previousItem->node()->cell()->toInbetweenEdge())
@@ -1373,6 +1559,8 @@ void AnimatedCycleWidget::animate()
         GraphicsNodeItem * item = it.key();
         GraphicsNodeItem * afterItem = item->after();
         GraphicsArrowItem * afterArrow = it.value();
+        if(!mayBeVisible(item, afterItem, visibleRect))
+            continue;
 
         double x1 = item->pos().x();
         if(!afterItem->node()->cell()->toInbetweenEdge())
@@ -1404,6 +1592,8 @@ void AnimatedCycleWidget::animate()
         GraphicsNodeItem * item = it.key();
         GraphicsNodeItem * beforeItem = item->before();
         GraphicsArrowItem * beforeArrow = it.value();
+        if(!mayBeVisible(item, beforeItem, visibleRect))
+            continue;
 
         double x1 = item->pos().x();
         if(!beforeItem->node()->cell()->toInbetweenEdge())
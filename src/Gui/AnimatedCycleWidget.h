@@ -19,6 +19,7 @@
 #include <QGraphicsPolygonItem>
 #include <QTimer>
 #include <QHBoxLayout>
+#include <QPair>
 
 using namespace VectorAnimationComplex;
 
@@ -35,6 +36,7 @@ public:
     void observedCellDeleted(Cell *);
 
     AnimatedCycleNode * node() const;
+    void setNode(AnimatedCycleNode * node); // must refer to the same cell
 
     GraphicsNodeItem * next();
     GraphicsNodeItem * previous();
@@ -61,6 +63,7 @@ private:
     void setPath_();
 
     AnimatedCycleNode * node_;
+    Cell * cell_; // observed
     QGraphicsTextItem * text_;
     AnimatedCycleWidget * widget_;
 
@@ -96,6 +99,8 @@ protected:
     virtual void mouseReleaseEvent(QMouseEvent * event);
     virtual void wheelEvent(QWheelEvent *event);
     virtual void paintEvent(QPaintEvent * event);
+    virtual void scrollContentsBy(int dx, int dy);
+    virtual void resizeEvent(QResizeEvent * event);
 
 private:
     AnimatedCycleWidget * animatedCycleWidget_;
@@ -118,6 +123,7 @@ public:
     void clearScene();
 
     void observedCellDeleted(Cell *);
+    void observedCellsChanged(VAC *, const CellChanges & changes);
 
     // Get current animated cycle
     // Notes: * The returned animated cycle is only aware of the nodes connected to first.
@@ -134,6 +140,10 @@ public:
     void start();
     void stop();
 
+    // Resumes animation, if visible, after the layout or the view changed.
+    // Animation stops by itself once the layout is stable
+    void wakeUp();
+
     void setReadOnly(bool b);
     bool isReadOnly() const;
 
@@ -166,6 +176,17 @@ private:
 
     void computeSceneFromAnimatedCycle();
 
+    // Items are matched between successive versions of the animated cycle
+    // by their cell and the number of nodes of this cell visited before
+    // them, so that the editor doesn't rebuild nor lay out again unchanged
+    // parts of the graph
+    typedef QPair<Cell*, int> NodeKey;
+    QMap<NodeKey, GraphicsNodeItem*> itemsByKey_() const;
+    void updateSceneFromAnimatedCycle_(QMap<NodeKey, GraphicsNodeItem*> oldItems);
+
+    // Only updates arrows which may be visible
+    void updateArrows_();
+
     QGraphicsScene * scene_;
     AnimatedCycleGraphicsView * view_;
 
@@ -185,6 +206,7 @@ private:
     // Connection with ST-VGC
     InbetweenFace * inbetweenFace_;
     int indexCycle_;
+    QString savedCycle_; // last loaded or saved, to ignore our own changes
 
     QHBoxLayout * editorButtons_;
 
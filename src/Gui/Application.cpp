@@ -7,12 +7,36 @@
 // directory of this distribution and at http://opensource.org/licenses/MIT
 
 #include <QFileOpenEvent>
+#include <QCommandLineParser>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QtDebug>
 
 #include "Application.h"
 #include "Global.h"
+#include "GLRenderer.h"
+#include "MemoryStats.h"
+
+#include <cstdlib>
+
+BatchRenderOptions::BatchRenderOptions() :
+    width(0),
+    height(0),
+    isSequence(false),
+    firstFrame(0),
+    lastFrame(0),
+    numThreads(0),
+    numProcesses(1),
+    printProgress(false)
+{
+}
 
 Application::Application(int& argc, char** argv) :
-    QApplication(argc, argv)
+    QApplication(argc, argv),
+    isBatchMode_(false),
+    isBenchmarkMode_(false),
+    isInfoMode_(false),
+    logsStartupTimes_(false)
 {
     // Set organization and application name
     setOrganizationName("VPaint");
@@ -22,6 +46,368 @@ Application::Application(int& argc, char** argv) :
 
     // Set application version
     setApplicationVersion(APP_VERSION);
+
+    // Batch mode options
+    parseCommandLine_();
+}
+
+bool Application::isBatchMode() const
+{
+    return isBatchMode_;
+}
+
+const BatchRenderOptions & Application::batchRenderOptions() const
+{
+    return batchRenderOptions_;
+}
+
+bool Application::isBenchmarkMode() const
+{
+    return isBenchmarkMode_;
+}
+
+const BenchmarkOptions & Application::benchmarkOptions() const
+{
+    return benchmarkOptions_;
+}
+
+bool Application::isInfoMode() const
+{
+    return isInfoMode_;
+}
+
+const QStringList & Application::infoPaths() const
+{
+    return infoPaths_;
+}
+
+bool Application::logsStartupTimes() const
+{
+    return logsStartupTimes_;
+}
+
+// Batch mode usage, e.g., to split the frames of an animation across the nodes
+// of a render farm:
+//
+//     VPaint --render out.png --size 1920x1080 --frames 1-100 --threads 4 in.vec
+//
+// With "--processes 4", the frames are rendered by 4 child processes instead,
+// each rendering a quarter of them (see RenderShards).
+//
+// Run it with "-platform offscreen", or within a virtual X server, on
+// machines without display. Other arguments are ignored when --render is not
+// given, so that those passed by the system to GUI applications, if any,
+// don't prevent VPaint from starting.
+//
+// Benchmark usage, e.g., to compare the performance of two revisions:
+//
+//     VPaint --benchmark out.json --strokes 1000 --frames 100
+//
+// Or, to measure the latency of a recorded session (see SessionRecorder):
+//
+//     VPaint --benchmark out.json --replay session.txt
+//
+// Or, to check how the main operations scale with the size of the scene, up
+// to 1M cells and 1000 frames by default (see Benchmark.h):
+//
+//     VPaint --benchmark out.json --scaling --max-cells 100000
+//
+// Or, to check that memory stops growing over a long session, here a
+// generated one of two hours, or a recorded one with --replay:
+//
+//     VPaint --benchmark out.json --soak 120 --budget total=2048 --budget "undo history=512"
+//
+// Info usage, e.g., to list the frame range and cell counts of many
+// documents without reading them fully, one JSON object per line:
+//
+//     VPaint --info shots/*.vec
+//
+// In all modes, including the normal GUI mode, "--renderer shader" draws
+// cells with the shader backend instead of fixed-function (see GLRenderer).
+// In the normal GUI mode, "--startup-times" writes the time taken by each
+// step of the startup to the debug output.
+void Application::parseCommandLine_()
+{
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Renders a VEC file, runs the benchmarks, or prints the info of VEC files, without showing any window, then exits.");
+    parser.addHelpOption();
+    QCommandLineOption renderOption("render",
+        "Renders the document to <file>, either a PNG or an SVG file.", "file");
+    QCommandLineOption sizeOption("size",
+        "Size of PNG images, in pixels. Defaults to the canvas size.", "WxH");
+    QCommandLineOption framesOption("frames",
+        "Renders the given frames, e.g., 10 or 10-20, as <file basename>_<frame>.<suffix>. "
+        "With --benchmark, number of frames of the animation scene instead.", "range");
+    QCommandLineOption threadsOption("threads",
+        "Number of threads used for loading and encoding. Defaults to the number of cores.", "count");
+    parser.addOption(renderOption);
+    parser.addOption(sizeOption);
+    parser.addOption(framesOption);
+    QCommandLineOption benchmarkOption("benchmark",
+        "Runs the benchmarks on synthetic scenes, and writes the results to <file>, a JSON file.", "file");
+    QCommandLineOption strokesOption("strokes",
+        "Number of strokes of the benchmark scenes. Defaults to 500.", "count");
+    QCommandLineOption seedOption("seed",
+        "Seed of the random strokes of the benchmark scenes. Defaults to 0.", "seed");
+    QCommandLineOption replayOption("replay",
+        "With --benchmark, replays the recorded session <file> instead of running the benchmarks.", "file");
+    QCommandLineOption processesOption("processes",
+        "Number of processes rendering a range of frames, each rendering a part of it. Defaults to 1.", "count");
+    QCommandLineOption progressOption("progress",
+        "Prints \"frame <frame>\" on the standard output for each rendered frame.");
+    parser.addOption(threadsOption);
+    parser.addOption(processesOption);
+    parser.addOption(progressOption);
+    parser.addOption(benchmarkOption);
+    parser.addOption(strokesOption);
+    parser.addOption(seedOption);
+    parser.addOption(replayOption);
+    QCommandLineOption scalingOption("scaling",
+        "With --benchmark, runs the scalability sweep instead of the benchmarks.");
+    QCommandLineOption maxCellsOption("max-cells",
+        "Number of cells of the largest scene of the scalability sweep. Defaults to 1000000.", "count");
+    QCommandLineOption maxFramesOption("max-frames",
+        "Number of frames of the longest animation of the scalability sweep. Defaults to 1000.", "count");
+    parser.addOption(scalingOption);
+    parser.addOption(maxCellsOption);
+    parser.addOption(maxFramesOption);
+    QCommandLineOption soakOption("soak",
+        "With --benchmark, runs the soak test for the given number of minutes instead of the benchmarks.", "minutes");
+    QCommandLineOption budgetOption("budget",
+        "With --soak, fails if the memory of the given category, or the total, exceeds the given budget "
+        "in steady state, e.g., \"undo history=512\" or total=2048. Can be given several times.", "category=MB");
+    parser.addOption(soakOption);
+    parser.addOption(budgetOption);
+    QCommandLineOption rendererOption("renderer",
+        "Draws cells with the given OpenGL backend: fixed (default) or shader.", "backend");
+    parser.addOption(rendererOption);
+    QCommandLineOption startupTimesOption("startup-times",
+        "Writes the time taken by each step of the startup to the debug output.");
+    parser.addOption(startupTimesOption);
+    QCommandLineOption infoOption("info",
+        "Prints the info of the given VEC files, read from their header, one JSON object per line.");
+    parser.addOption(infoOption);
+    parser.addPositionalArgument("document", "The VEC file to render, or with --info, the VEC files.");
+
+    if(!parser.parse(arguments()))
+        return;
+
+    if(parser.isSet(rendererOption))
+    {
+        const QString backend = parser.value(rendererOption);
+        if(backend == "shader")
+            GLRenderer::setBackend(GLRenderer::Shader);
+        else if(backend == "fixed")
+            GLRenderer::setBackend(GLRenderer::FixedFunction);
+        else
+            qWarning() << "Unknown renderer:" << backend << "(expected fixed or shader)";
+    }
+
+    logsStartupTimes_ = parser.isSet(startupTimesOption);
+
+    if(parser.isSet(infoOption))
+    {
+        isInfoMode_ = true;
+        infoPaths_ = parser.positionalArguments();
+        return;
+    }
+
+    if(parser.isSet(benchmarkOption))
+    {
+        parseBenchmarkOptions_(parser, benchmarkOption, strokesOption, framesOption, seedOption, replayOption,
+                               scalingOption, maxCellsOption, maxFramesOption, soakOption, budgetOption);
+        return;
+    }
+
+    if(!parser.isSet(renderOption))
+        return;
+
+    isBatchMode_ = true;
+    BatchRenderOptions & options = batchRenderOptions_;
+    QStringList errors;
+    if(parser.isSet("help"))
+        parser.showHelp(); // exits
+
+    options.outputPath = parser.value(renderOption);
+    if(!options.outputPath.endsWith(".png") && !options.outputPath.endsWith(".svg"))
+        errors << "the rendered file must be a PNG or an SVG file";
+
+    const QStringList positionalArguments = parser.positionalArguments();
+    if(positionalArguments.size() == 1)
+        options.inputPath = positionalArguments[0];
+    else
+        errors << "exactly one document must be given";
+
+    if(parser.isSet(sizeOption))
+    {
+        QStringList size = parser.value(sizeOption).split('x');
+        bool okWidth = false, okHeight = false;
+        if(size.size() == 2)
+        {
+            options.width = size[0].toInt(&okWidth);
+            options.height = size[1].toInt(&okHeight);
+        }
+        if(!okWidth || !okHeight || options.width <= 0 || options.height <= 0)
+            errors << "invalid size: " + parser.value(sizeOption);
+    }
+
+    if(parser.isSet(framesOption))
+    {
+        QStringList range = parser.value(framesOption).split('-');
+        bool okFirst = false, okLast = false;
+        if(range.size() == 1)
+        {
+            options.firstFrame = options.lastFrame = range[0].toInt(&okFirst);
+            okLast = okFirst;
+        }
+        else if(range.size() == 2)
+        {
+            options.firstFrame = range[0].toInt(&okFirst);
+            options.lastFrame = range[1].toInt(&okLast);
+        }
+        if(!okFirst || !okLast || options.firstFrame > options.lastFrame)
+            errors << "invalid frame range: " + parser.value(framesOption);
+        options.isSequence = true;
+    }
+
+    if(parser.isSet(threadsOption))
+    {
+        bool ok = false;
+        options.numThreads = parser.value(threadsOption).toInt(&ok);
+        if(!ok || options.numThreads <= 0)
+            errors << "invalid number of threads: " + parser.value(threadsOption);
+    }
+
+    if(parser.isSet(processesOption))
+    {
+        bool ok = false;
+        options.numProcesses = parser.value(processesOption).toInt(&ok);
+        if(!ok || options.numProcesses <= 0)
+            errors << "invalid number of processes: " + parser.value(processesOption);
+    }
+
+    options.printProgress = parser.isSet(progressOption);
+
+    if(!errors.isEmpty())
+    {
+        QTextStream err(stderr);
+        foreach(const QString & error, errors)
+            err << "Error: " << error << "\n";
+        err << "\n" << parser.helpText();
+        err.flush();
+        ::exit(1);
+    }
+}
+
+void Application::parseBenchmarkOptions_(QCommandLineParser & parser,
+                                         const QCommandLineOption & benchmarkOption,
+                                         const QCommandLineOption & strokesOption,
+                                         const QCommandLineOption & framesOption,
+                                         const QCommandLineOption & seedOption,
+                                         const QCommandLineOption & replayOption,
+                                         const QCommandLineOption & scalingOption,
+                                         const QCommandLineOption & maxCellsOption,
+                                         const QCommandLineOption & maxFramesOption,
+                                         const QCommandLineOption & soakOption,
+                                         const QCommandLineOption & budgetOption)
+{
+    isBenchmarkMode_ = true;
+    BenchmarkOptions & options = benchmarkOptions_;
+    QStringList errors;
+
+    options.outputPath = parser.value(benchmarkOption);
+    if(!options.outputPath.endsWith(".json"))
+        errors << "the benchmark results must be written to a JSON file";
+
+    if(parser.isSet(strokesOption))
+    {
+        bool ok = false;
+        options.numStrokes = parser.value(strokesOption).toInt(&ok);
+        if(!ok || options.numStrokes <= 0)
+            errors << "invalid number of strokes: " + parser.value(strokesOption);
+    }
+
+    if(parser.isSet(framesOption))
+    {
+        bool ok = false;
+        options.numFrames = parser.value(framesOption).toInt(&ok);
+        if(!ok || options.numFrames <= 0)
+            errors << "invalid number of frames: " + parser.value(framesOption);
+    }
+
+    if(parser.isSet(seedOption))
+    {
+        bool ok = false;
+        options.seed = parser.value(seedOption).toInt(&ok);
+        if(!ok)
+            errors << "invalid seed: " + parser.value(seedOption);
+    }
+
+    if(parser.isSet(replayOption))
+    {
+        options.replayPath = parser.value(replayOption);
+        if(!QFileInfo(options.replayPath).isFile())
+            errors << "session not found: " + options.replayPath;
+        else if(!QFileInfo(options.replayPath + ".vec").isFile())
+            errors << "document of the session not found: " + options.replayPath + ".vec";
+    }
+
+    options.isScaling = parser.isSet(scalingOption);
+
+    if(parser.isSet(maxCellsOption))
+    {
+        bool ok = false;
+        options.maxCells = parser.value(maxCellsOption).toInt(&ok);
+        if(!ok || options.maxCells <= 0)
+            errors << "invalid number of cells: " + parser.value(maxCellsOption);
+    }
+
+    if(parser.isSet(maxFramesOption))
+    {
+        bool ok = false;
+        options.maxFrames = parser.value(maxFramesOption).toInt(&ok);
+        if(!ok || options.maxFrames <= 0)
+            errors << "invalid number of frames: " + parser.value(maxFramesOption);
+    }
+
+    if(parser.isSet(soakOption))
+    {
+        bool ok = false;
+        options.soakMinutes = parser.value(soakOption).toInt(&ok);
+        if(!ok || options.soakMinutes <= 0)
+            errors << "invalid duration: " + parser.value(soakOption);
+    }
+
+    // Categories are matched case-insensitively, and stored by their name
+    foreach(const QString & value, parser.values(budgetOption))
+    {
+        const QString name = value.section('=', 0, 0).trimmed();
+        bool ok = false;
+        const double megabytes = value.section('=', 1).toDouble(&ok);
+        QString category;
+        if(name.compare("total", Qt::CaseInsensitive) == 0)
+            category = "Total";
+        for(int i=0; i<MemoryStats::NumCategories; ++i)
+        {
+            const QString categoryName = MemoryStats::categoryName(static_cast<MemoryStats::Category>(i));
+            if(name.compare(categoryName, Qt::CaseInsensitive) == 0)
+                category = categoryName;
+        }
+        if(category.isEmpty() || !ok || megabytes <= 0)
+            errors << "invalid budget: " + value;
+        else
+            options.memoryBudgets[category] = megabytes;
+    }
+
+    if(!errors.isEmpty())
+    {
+        QTextStream err(stderr);
+        foreach(const QString & error, errors)
+            err << "Error: " << error << "\n";
+        err << "\n" << parser.helpText();
+        err.flush();
+        ::exit(1);
+    }
 }
 
 bool Application::event(QEvent* event)
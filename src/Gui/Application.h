@@ -10,6 +10,30 @@
 #define APPLICATION_H
 
 #include <QApplication>
+#include <QStringList>
+
+#include "Benchmark.h"
+
+class QCommandLineParser;
+class QCommandLineOption;
+
+// Options of the batch mode, where a document is rendered to files without
+// showing any window, then the application exits (see Application.cpp)
+struct BatchRenderOptions
+{
+    BatchRenderOptions();
+
+    QString inputPath;
+    QString outputPath;  // *.png or *.svg
+    int width;           // PNG only. If 0, uses the canvas size.
+    int height;
+    bool isSequence;     // If true, renders frames [firstFrame, lastFrame]
+    int firstFrame;      // as <outputPath basename>_<frame>.<suffix>
+    int lastFrame;
+    int numThreads;      // If 0, uses the number of cores
+    int numProcesses;    // If more than 1, splits the frames across child processes (see RenderShards)
+    bool printProgress;  // If true, prints "frame <frame>" for each rendered frame
+};
 
 class Application : public QApplication
 {
@@ -21,11 +45,52 @@ public:
     bool event(QEvent* event);
     void emitOpenFileRequest();
 
+    // Whether the application was started in batch mode
+    bool isBatchMode() const;
+    const BatchRenderOptions & batchRenderOptions() const;
+
+    // Whether the application was started to run the benchmarks
+    bool isBenchmarkMode() const;
+    const BenchmarkOptions & benchmarkOptions() const;
+
+    // Whether the application was started to print the info of documents
+    // (see DocumentInfo), and which ones
+    bool isInfoMode() const;
+    const QStringList & infoPaths() const;
+
+    // Whether the time taken by each step of the startup is written to the
+    // debug output (--startup-times)
+    bool logsStartupTimes() const;
+
 signals:
     void openFileRequested(const QString & filename);
 
 private:
     QString startPath_;
+
+    bool isBatchMode_;
+    BatchRenderOptions batchRenderOptions_;
+
+    bool isBenchmarkMode_;
+    BenchmarkOptions benchmarkOptions_;
+
+    bool isInfoMode_;
+    QStringList infoPaths_;
+
+    bool logsStartupTimes_;
+
+    void parseCommandLine_();
+    void parseBenchmarkOptions_(QCommandLineParser & parser,
+                                const QCommandLineOption & benchmarkOption,
+                                const QCommandLineOption & strokesOption,
+                                const QCommandLineOption & framesOption,
+                                const QCommandLineOption & seedOption,
+                                const QCommandLineOption & replayOption,
+                                const QCommandLineOption & scalingOption,
+                                const QCommandLineOption & maxCellsOption,
+                                const QCommandLineOption & maxFramesOption,
+                                const QCommandLineOption & soakOption,
+                                const QCommandLineOption & budgetOption);
 };
 
 #endif // APPLICATION_H
@@ -9,10 +9,12 @@
 #include "Background.h"
 
 #include "BackgroundUrlValidator.h"
+#include "BackgroundFileIndex.h"
 
 #include "XmlStreamReader.h"
 #include "XmlStreamWriter.h"
 #include "CssColor.h"
+#include "IO/SvgStreamWriter.h"
 
 #include "Global.h"
 
@@ -20,21 +22,54 @@
 #include <QFileInfo>
 #include <QVector>
 #include <QTextStream>
+#include <QImageReader>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+#include <QDateTime>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace
+{
+// Returns the file path where the proxy of the given source image and level
+// is cached. The source path, size, and modification time are hashed, such
+// that an edited or replaced source doesn't reuse an outdated proxy.
+QString proxyFilePath_(const QFileInfo & sourceInfo, int level)
+{
+    QString key = sourceInfo.absoluteFilePath() + '|' +
+                  QString::number(sourceInfo.size()) + '|' +
+                  QString::number(sourceInfo.lastModified().toMSecsSinceEpoch()) + '|' +
+                  QString::number(level);
+    QString hash = QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Md5).toHex();
+
+    QString cachePath = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    return cachePath + "/background-proxies/" + hash + ".png";
+}
+}
 
 // Constructor
 Background::Background(QObject * parent) :
     QObject(parent),
     data_(),
-    cached_(false)
+    cached_(false),
+    isIndexPending_(false)
 {
+    connect(BackgroundFileIndex::instance(), SIGNAL(listed(QString)),
+            this, SLOT(fileIndexListed_(QString)));
 }
 
 // Copy constructor
 Background::Background(const Background & other, QObject * parent) :
     QObject(parent),
     data_(other.data_),
-    cached_(false)
+    cached_(false),
+    isIndexPending_(false)
 {
+    connect(BackgroundFileIndex::instance(), SIGNAL(listed(QString)),
+            this, SLOT(fileIndexListed_(QString)));
 }
 
 // Assignment operator
@@ -113,8 +148,10 @@ void Background::clearCache_()
 {
     filePathsPrefix_.clear();
     filePathsSuffix_.clear();
-    filePathsWildcards_.clear();
-    referenceFrames_.clear();
+    frames_.clear();
+    wildcards_.clear();
+    indexedDirPath_.clear();
+    isIndexPending_ = false;
     cached_ = false;
     emit cacheCleared();
 }
@@ -137,10 +174,12 @@ void Background::updateCache_() const
 void Background::computeCache_() const
 {
     // Default values, such that image(f) returns "" for all frames
-    filePathsWildcards_.clear();
-    referenceFrames_.clear();
+    frames_.clear();
+    wildcards_.clear();
     filePathsPrefix_.clear();
     filePathsSuffix_.clear();
+    indexedDirPath_.clear();
+    isIndexPending_ = false;
 
     // Get url relative to working dir
     QDir dir = global()->documentDir();
@@ -166,157 +205,106 @@ void Background::computeCache_() const
         // Store path of parent dir in cached prefix
         filePathsPrefix_ = parentDir.path() + "/";
 
-        // Get matching files
-        QStringList nameFilters(url);
-        QDir::Filters filters = QDir::Files | QDir::Readable;
-        QFileInfoList files = parentDir.entryInfoList(nameFilters, filters);
+        // Get files of parent dir. If they are being listed, there is no
+        // image until they are (see fileIndexListed_())
+        QStringList fileNames;
+        indexedDirPath_ = parentDir.absolutePath();
+        isIndexPending_ = !BackgroundFileIndex::instance()->fileNames(indexedDirPath_, fileNames);
 
         // Get wildcard index
         int wildcardIndex = url.indexOf('*');
 
         // Cache prefix and suffix
-        filePathsPrefix_ += url.left(wildcardIndex);
-        filePathsSuffix_ = url.right(url.length() - wildcardIndex - 1);
+        QString prefix = url.left(wildcardIndex);
+        QString suffix = url.right(url.length() - wildcardIndex - 1);
+        filePathsPrefix_ += prefix;
+        filePathsSuffix_ = suffix;
 
-        // Get wildcard values as string and int.
+        // Get wildcard values of matching files as int and string.
         // Example:
-        //   files[i].fileName() = "image015.png"
-        //   stringWildcards[i]  = "015"
-        //   intWildcards[i]     = 15
-        QStringList stringWildcards;
-        QList<int> intWildcards;
-        foreach(QFileInfo i, files)
+        //   fileName       = "image015.png"
+        //   stringWildcard = "015"
+        //   intWildcard    = 15
+        std::vector< std::pair<int, QString> > wildcards;
+        foreach(const QString & fileName, fileNames)
         {
+            if (fileName.length() < url.length() - 1 ||
+                !fileName.startsWith(prefix) || !fileName.endsWith(suffix))
+            {
+                continue;
+            }
+
             // Get wildcard as string
-            QString fileName = i.fileName();
             QString stringWildcard = fileName.mid(
                         wildcardIndex, fileName.length() - url.length() + 1);
 
-            // Append to lists, if can convert to an int
+            // Append to list, if can convert to an int
             bool ok;
             int intWildcard = stringWildcard.toInt(&ok);
             if (ok)
-            {
-                stringWildcards << stringWildcard;
-                intWildcards << intWildcard;
-            }
+                wildcards.push_back(std::make_pair(intWildcard, stringWildcard));
         }
-        int nWildcards = stringWildcards.size(); // == intWildcards.size();
 
-        // If there is zero match, then it's trivial
-        if (nWildcards > 0) // Nothing to do if there's zero match:
-                            // image(f) will return prefix + suffix for all frames
+        // Sort by frame, so that the image of a frame is found by binary
+        // search (see frameIndex_()). If several files have the same frame,
+        // e.g., "background01.png" and "background1.png", the last one in
+        // name order is used.
+        std::stable_sort(wildcards.begin(), wildcards.end(),
+                         [](const std::pair<int, QString> & a, const std::pair<int, QString> & b) {
+                             return a.first < b.first; });
+        for (const std::pair<int, QString> & wildcard: wildcards)
         {
-            // Find minimum, maximum, and their indices
-            // Note: it's possible that min = max (e.g., only one entry)
-            //       it's also possible that min or max are not unique (e.g., "background01.png" and "background1.png")
-            minFrame_ = intWildcards[0];
-            int maxFrame = intWildcards[0];
-            for (int i=1; i<nWildcards; ++i)
+            if (!frames_.isEmpty() && frames_.last() == wildcard.first)
             {
-                if (intWildcards[i] > maxFrame) {
-                    maxFrame = intWildcards[i];
-                }
-                if (intWildcards[i] < minFrame_) {
-                    minFrame_ = intWildcards[i];
-                }
+                wildcards_.last() = wildcard.second;
             }
-
-            // The remaining step is to create an array 'filePathsWildcards_' s.t.
-            // for each f in [min, max], the value filePathsWildcards_[f-min]
-            // represents the stringWildcard to use for frame f.
-            //
-            // example:
-            //    stringWildcards = [ "03", "8", "005" ]
-            //    intWildcards =    [ 3, 8, 5 ]
-            //    min = 3 ; indexMin = 0
-            //    max = 8 ; indexMax = 1
-            //
-            //    If hold == true:
-            //    frameToString = [ "03", "03", "005", "005", "005", "8" ]
-            //                f =    3     4       5     6      7     8
-            //
-            //    If hold == false:
-            //    frameToString = [ "03", "",   "005",   "",    "",   "8" ]
-            //                f =    3     4       5     6      7     8
-            //
-
-            // Initialization (non-empty vector of empty strings)
-            filePathsWildcards_ = QVector<QString>(maxFrame-minFrame_+1);
-            referenceFrames_ = QVector<int>(maxFrame-minFrame_+1, 0);
-
-            // Fill with values of existing files
-            for (int i=0; i<nWildcards; ++i) {
-                filePathsWildcards_[intWildcards[i] - minFrame_] = stringWildcards[i];
-                referenceFrames_[intWildcards[i] - minFrame_] = intWildcards[i];
-            }
-
-            // Fill the blanks between existing files if hold == true
-            if (hold())
-            {
-                QString lastValidWildcard = filePathsWildcards_.first();
-                int lastValidIntWildcard = referenceFrames_.first();
-                for (int i=1; i<filePathsWildcards_.size()-1; ++i)
-                {
-                    if (filePathsWildcards_[i].isEmpty()) {
-                        filePathsWildcards_[i] = lastValidWildcard;
-                        referenceFrames_[i] = lastValidIntWildcard;
-                    }
-                    else {
-                        lastValidWildcard = filePathsWildcards_[i];
-                        lastValidIntWildcard = referenceFrames_[i];
-                    }
-                }
-            }
-            // Fill the blanks between existing files if hold == false
-            // Nothing to do for filePathsWildcards_. The blank are
-            // already an empty string, which is the correct result.
-            // However, for now the blanks in referenceFrames_ are 0,
-            // which is not good, 0 might be a provided frame. We want
-            // to make sure each blank point to an unprovided frame, so
-            // we choose minFrame - 1.
             else
             {
-                for (int i=1; i<filePathsWildcards_.size()-1; ++i)
-                {
-                    if (filePathsWildcards_[i].isEmpty()) {
-                        referenceFrames_[i] = minFrame_ - 1;
-                    }
-                }
+                frames_ << wildcard.first;
+                wildcards_ << wildcard.second;
             }
         }
     }
 }
 
+// Index in frames_ of the image to draw at the given frame, or -1 if none.
+// Frames between or beyond those with an image on disk use the previous or
+// closest one if hold() is true, and no image otherwise.
+int Background::frameIndex_(int frame) const
+{
+    QVector<int>::const_iterator it = std::upper_bound(frames_.begin(), frames_.end(), frame);
+    if (it == frames_.begin())
+        return hold() ? 0 : -1;
+
+    int i = int(it - frames_.begin()) - 1;
+    if (frames_[i] == frame || hold())
+        return i;
+    else
+        return -1;
+}
+
+void Background::fileIndexListed_(const QString & dirPath)
+{
+    if (cached_ && isIndexPending_ && dirPath == indexedDirPath_)
+        clearCache();
+}
+
 int Background::referenceFrame(int frame) const
 {
     updateCache_();
 
-    if (referenceFrames_.isEmpty())
+    if (frames_.isEmpty())
     {
         // All frames share the same background image
         return 0;
     }
     else
     {
-        if (frame < minFrame_)
-        {
-            if (hold())
-                return referenceFrames_.first();
-            else
-                return minFrame_ - 1;
-        }
-        else if (frame < minFrame_ + filePathsWildcards_.size())
-        {
-            return referenceFrames_[frame - minFrame_];
-        }
+        int i = frameIndex_(frame);
+        if (i < 0)
+            return frames_.first() - 1;
         else
-        {
-            if (hold())
-                return referenceFrames_.last();
-            else
-                return minFrame_ - 1;
-        }
+            return frames_[i];
     }
 }
 
@@ -328,22 +316,11 @@ QString Background::resolvedImageFilePath(int frame) const
     QString filePath(filePathsPrefix_);
 
     // Wildcard
-    if (!filePathsWildcards_.isEmpty())
+    if (!frames_.isEmpty())
     {
-        if (frame < minFrame_)
-        {
-            if (hold())
-                filePath += filePathsWildcards_.first();
-        }
-        else if (frame < minFrame_ + filePathsWildcards_.size())
-        {
-            filePath += filePathsWildcards_[frame - minFrame_];
-        }
-        else
-        {
-            if (hold())
-                filePath += filePathsWildcards_.last();
-        }
+        int i = frameIndex_(frame);
+        if (i >= 0)
+            filePath += wildcards_[i];
     }
 
     // Suffix
@@ -370,6 +347,46 @@ QImage Background::image(int frame) const
     }
 }
 
+QSize Background::imageSize(const QString & filePath)
+{
+    QImageReader reader(filePath);
+    return reader.size();
+}
+
+QImage Background::proxyImage(const QString & filePath, int level)
+{
+    QFileInfo sourceInfo(filePath);
+    if (!sourceInfo.exists() || !sourceInfo.isFile())
+        return QImage();
+
+    if (level <= 0)
+        return QImage(filePath);
+
+    // Read cached proxy if any
+    QString proxyPath = proxyFilePath_(sourceInfo, level);
+    QImage proxy(proxyPath);
+    if (!proxy.isNull())
+        return proxy;
+
+    // Otherwise, generate it from the source image
+    QImage img(filePath);
+    if (img.isNull())
+        return img;
+    const int width = std::max(1, img.width() >> level);
+    const int height = std::max(1, img.height() >> level);
+    proxy = img.scaled(width, height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+
+    // Cache it. QSaveFile writes to a temporary file first, so that other
+    // threads or instances never read a partially written proxy. Failing to
+    // cache is not an error: the proxy is simply generated again next time.
+    QDir().mkpath(QFileInfo(proxyPath).absolutePath());
+    QSaveFile file(proxyPath);
+    if (file.open(QIODevice::WriteOnly) && proxy.save(&file, "PNG", 90))
+        file.commit();
+
+    return proxy;
+}
+
 // Position
 Eigen::Vector2d Background::position() const
 {
@@ -652,7 +669,7 @@ void Background::read(XmlStreamReader & xml)
     setData(data);
 }
 
-void Background::exportSVG(int frame, QTextStream & out,
+void Background::exportSVG(int frame, SvgStreamWriter & out,
                            double canvasLeft, double canvasTop,
                            double canvasWidth, double canvasHeight)
 {
@@ -24,6 +24,7 @@ class XmlStreamReader;
 
 class QDir;
 class QTextStream;
+class SvgStreamWriter;
 
 class Background: public QObject
 {
@@ -76,6 +77,19 @@ public:
     QImage image(int frame) const;
     int referenceFrame(int frame) const;
 
+    // Size of the image at filePath, read from its header only. Returns an
+    // invalid size if the file can't be read.
+    static QSize imageSize(const QString & filePath);
+
+    // Image at filePath, downscaled by a factor 2^level, e.g., level = 2 for
+    // a quarter-resolution proxy. Proxies are generated the first time they
+    // are requested, and cached on disk so that later sessions (and frames
+    // scrubbed again after being evicted from memory) decode a file 4^level
+    // times smaller. Cached proxies are regenerated when the source changes.
+    //
+    // Unlike the other methods, these static methods are thread-safe.
+    static QImage proxyImage(const QString & filePath, int level);
+
     // Position
     Eigen::Vector2d position() const;
     void setPosition(const Eigen::Vector2d & newPosition);
@@ -116,7 +130,7 @@ public:
     void read(XmlStreamReader & xml);
 
     // SVG export
-    void exportSVG(int frame, QTextStream & out,
+    void exportSVG(int frame, SvgStreamWriter & out,
                    double canvasLeft, double canvasTop,
                    double canvasWidth, double canvasHeight);
 
@@ -161,16 +175,23 @@ private:
     // Data
     Data data_;
 
-    // Cache
+    // Cache. For wildcard urls, frames_ are the frames with an image on
+    // disk, sorted, and wildcards_ the corresponding wildcard values.
     void clearCache_();
     void updateCache_() const;
     void computeCache_() const;
+    int frameIndex_(int frame) const;
     mutable bool cached_;
-    mutable int minFrame_;
     mutable QString filePathsPrefix_;
     mutable QString filePathsSuffix_;
-    mutable QVector<QString> filePathsWildcards_;
-    mutable QVector<int> referenceFrames_;
+    mutable QVector<int> frames_;
+    mutable QVector<QString> wildcards_;
+    mutable QString indexedDirPath_; // parent dir of wildcard urls
+    mutable bool isIndexPending_;    // whether it is being listed
+
+private slots:
+    // Recomputes the cache once the files of its wildcard url are listed
+    void fileIndexListed_(const QString & dirPath);
 };
 
 #endif // BACKGROUND_H
@@ -0,0 +1,91 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#include "BackgroundFileIndex.h"
+
+#include "DevSettings.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QtConcurrentRun>
+
+BackgroundFileIndex::BackgroundFileIndex() :
+    QObject(),
+    isAsync_(true)
+{
+}
+
+BackgroundFileIndex * BackgroundFileIndex::instance()
+{
+    // Only emits signals, so it may be created by any thread
+    static BackgroundFileIndex * index = new BackgroundFileIndex();
+    return index;
+}
+
+void BackgroundFileIndex::setAsync(bool isAsync)
+{
+    QMutexLocker locker(&mutex_);
+    isAsync_ = isAsync;
+}
+
+bool BackgroundFileIndex::isAsync() const
+{
+    QMutexLocker locker(&mutex_);
+    return isAsync_ && DevSettings::getBool("async background index");
+}
+
+bool BackgroundFileIndex::fileNames(const QString & dirPath, QStringList & names)
+{
+    bool isAsync = this->isAsync();
+
+    // Getting the modification time of the directory is much faster than
+    // listing it
+    QDateTime lastModified = QFileInfo(dirPath).lastModified();
+
+    {
+        QMutexLocker locker(&mutex_);
+        Entry & entry = entries_[dirPath];
+        if (entry.isListed && entry.lastModified == lastModified)
+        {
+            names = entry.names;
+            return true;
+        }
+        if (isAsync)
+        {
+            if (!entry.isListing)
+            {
+                entry.isListing = true;
+                QtConcurrent::run([this, dirPath, lastModified]() {
+                    list_(dirPath, lastModified);
+                    emit listed(dirPath);
+                });
+            }
+            return false;
+        }
+    }
+
+    list_(dirPath, lastModified);
+    QMutexLocker locker(&mutex_);
+    names = entries_[dirPath].names;
+    return true;
+}
+
+void BackgroundFileIndex::list_(const QString & dirPath, const QDateTime & lastModified)
+{
+    // The modification time is the one before listing: if files are added
+    // meanwhile, the directory is listed again next time
+    QStringList names = QDir(dirPath).entryList(QDir::Files | QDir::Readable, QDir::Name);
+
+    QMutexLocker locker(&mutex_);
+    Entry & entry = entries_[dirPath];
+    entry.lastModified = lastModified;
+    entry.names = names;
+    entry.isListed = true;
+    entry.isListing = false;
+}
@@ -0,0 +1,70 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#ifndef BACKGROUND_FILE_INDEX_H
+#define BACKGROUND_FILE_INDEX_H
+
+// BackgroundFileIndex: names of the files of the directories containing
+// image sequences, shared by all backgrounds. Listing a directory of
+// thousands of frames on a network share takes seconds, so each directory
+// is listed once, in a worker thread, and its list kept until the
+// modification time of the directory changes, i.e. until files are added,
+// removed or renamed.
+//
+// Thread-safe. listed() is emitted by worker threads: receivers get it
+// through queued connections.
+
+#include <QObject>
+#include <QDateTime>
+#include <QHash>
+#include <QMutex>
+#include <QStringList>
+
+class BackgroundFileIndex: public QObject
+{
+    Q_OBJECT
+
+public:
+    static BackgroundFileIndex * instance();
+
+    // Gets the names of the readable files of the directory, sorted, and
+    // returns true if they are listed and up to date. Otherwise, returns
+    // false and lists them in a worker thread, then emits listed(), unless
+    // asynchronous listing is off, in which case they are listed right away
+    // and true is returned.
+    bool fileNames(const QString & dirPath, QStringList & names);
+
+    // Whether directories are listed in a worker thread. True by default,
+    // false in batch mode where frames are rendered right after opening.
+    // Can also be turned off with the "async background index" dev setting.
+    void setAsync(bool isAsync);
+    bool isAsync() const;
+
+signals:
+    // The directory was listed by a worker thread
+    void listed(const QString & dirPath);
+
+private:
+    BackgroundFileIndex();
+
+    struct Entry
+    {
+        Entry() : isListed(false), isListing(false) {}
+        QDateTime lastModified; // of the directory, when it was listed
+        QStringList names;
+        bool isListed;
+        bool isListing;
+    };
+    mutable QMutex mutex_;
+    QHash<QString, Entry> entries_;
+    bool isAsync_;
+
+    void list_(const QString & dirPath, const QDateTime & lastModified);
+};
+
+#endif // BACKGROUND_FILE_INDEX_H
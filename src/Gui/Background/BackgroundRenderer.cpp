@@ -10,7 +10,54 @@
 
 #include "Background.h"
 
+#include "DevSettings.h"
+
 #include <QGLContext>
+#include <QGLWidget>
+#include <QtConcurrentRun>
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+// Number of frames decoded ahead of the drawn frame, and behind it
+const int NUM_PREFETCHED_FRAMES_AHEAD = 8;
+const int NUM_PREFETCHED_FRAMES_BEHIND = 1;
+}
+
+BackgroundRenderer::DecodedImage BackgroundRenderer::readImage_(
+        const QString & filePath, int targetWidth, int targetHeight)
+{
+    DecodedImage res;
+    res.isProxy = false;
+
+    // Get the largest power of two by which the image can be downscaled
+    // while keeping it at least as large as the target size, if any
+    int level = 0;
+    if (targetWidth > 0 && targetHeight > 0)
+    {
+        QSize size = Background::imageSize(filePath);
+        int width = size.width();
+        int height = size.height();
+        while (width / 2 >= targetWidth && height / 2 >= targetHeight)
+        {
+            width /= 2;
+            height /= 2;
+            ++level;
+        }
+    }
+
+    // Read image, or its proxy cached on disk
+    QImage img = Background::proxyImage(filePath, level);
+    if (img.isNull())
+        return res;
+    res.isProxy = level > 0;
+
+    res.glImage = QGLWidget::convertToGLFormat(img);
+    return res;
+}
 
 BackgroundRenderer::BackgroundRenderer(
         Background * background,
@@ -18,24 +65,155 @@ BackgroundRenderer::BackgroundRenderer(
         QObject * parent) :
     QObject(parent),
     background_(background),
-    context_(context)
+    context_(context),
+    textures_(),
+    lruFrames_(),
+    numBytes_(0),
+    numHits_(0),
+    numMisses_(0),
+    numEvictions_(0),
+    version_(0),
+    loaderThreadPool_(),
+    pendingImages_(),
+    lastDrawnFrame_(0),
+    playDirection_(1),
+    targetWidth_(0),
+    targetHeight_(0)
 {
+    // Decoding is mostly I/O bound. A single thread keeps up with playback
+    // while leaving the other cores to the rest of the drawing.
+    loaderThreadPool_.setMaxThreadCount(1);
+
     connect(background_, SIGNAL(cacheCleared()), this, SLOT(clearCache_()));
 }
 
+BackgroundRenderer * BackgroundRenderer::shared(Background * background, QGLContext * context)
+{
+    BackgroundRenderer * res = background->findChild<BackgroundRenderer *>(
+                QString(), Qt::FindDirectChildrenOnly);
+    if (!res)
+        res = new BackgroundRenderer(background, context, background);
+    return res;
+}
+
 void BackgroundRenderer::clearCache_()
 {
     // Set OpenGL context (we are likely outside paintGL())
     context_->makeCurrent();
 
     // Delete all textures allocated in GPU
-    foreach (GLuint texId, texIds_)
+    foreach (const Texture & texture, textures_)
     {
-        context_->deleteTexture(texId);
+        if (texture.texId)
+            context_->deleteTexture(texture.texId);
     }
 
     // Clear map
-    texIds_.clear();
+    textures_.clear();
+    lruFrames_.clear();
+    numBytes_ = 0;
+
+    // Forget images being decoded, which may be outdated. Loader threads
+    // finish decoding them, but the result is discarded.
+    pendingImages_.clear();
+}
+
+std::size_t BackgroundRenderer::numBytes() const
+{
+    return numBytes_;
+}
+
+void BackgroundRenderer::reportMemory(MemoryStats::Report & report) const
+{
+    report.add(MemoryStats::BackgroundImages, numBytes_);
+}
+
+int BackgroundRenderer::numTextures() const
+{
+    return textures_.size();
+}
+
+unsigned long long BackgroundRenderer::numHits() const
+{
+    return numHits_;
+}
+
+unsigned long long BackgroundRenderer::numMisses() const
+{
+    return numMisses_;
+}
+
+unsigned long long BackgroundRenderer::numEvictions() const
+{
+    return numEvictions_;
+}
+
+unsigned int BackgroundRenderer::version() const
+{
+    return version_;
+}
+
+void BackgroundRenderer::resetCounters()
+{
+    numHits_ = 0;
+    numMisses_ = 0;
+    numEvictions_ = 0;
+}
+
+void BackgroundRenderer::trim_()
+{
+    const std::size_t maxBytes = std::size_t(DevSettings::getInt("background cache (MB)")) * 1024 * 1024;
+    while (numBytes_ > maxBytes && !lruFrames_.empty())
+    {
+        int frame = lruFrames_.back();
+        removeTexture_(frame);
+        ++numEvictions_;
+    }
+}
+
+void BackgroundRenderer::insertTexture_(int frame, const DecodedImage & image)
+{
+    if (textures_.contains(frame))
+        removeTexture_(frame);
+
+    const QImage & glImage = image.glImage;
+    Texture texture;
+    texture.texId = glImage.isNull() ? 0 : uploadTexture_(glImage);
+    texture.width = glImage.width();
+    texture.height = glImage.height();
+    texture.isProxy = image.isProxy;
+    texture.numBytes = std::size_t(glImage.byteCount()) * 4 / 3; // including mipmaps
+    lruFrames_.push_front(frame);
+    texture.lruIterator = lruFrames_.begin();
+    textures_.insert(frame, texture);
+    numBytes_ += texture.numBytes;
+    ++version_;
+}
+
+void BackgroundRenderer::removeTexture_(int frame)
+{
+    QHash<int, Texture>::iterator it = textures_.find(frame);
+    if (it != textures_.end())
+    {
+        if (it->texId)
+            context_->deleteTexture(it->texId);
+        numBytes_ -= it->numBytes;
+        lruFrames_.erase(it->lruIterator);
+        textures_.erase(it);
+        ++version_;
+    }
+}
+
+bool BackgroundRenderer::isTooCoarse_(const Texture & texture) const
+{
+    // Full-resolution textures are never too coarse. Proxies are too coarse
+    // if they are smaller than the background on screen.
+    if (!texture.isProxy)
+        return false;
+    else if (targetWidth_ == 0 || targetHeight_ == 0)
+        return true;
+    else
+        return texture.width < targetWidth_ || texture.height < targetHeight_;
 }
 
 GLuint BackgroundRenderer::texId_(int frame)
@@ -43,26 +221,134 @@ GLuint BackgroundRenderer::texId_(int frame)
     // Avoid allocating several textures for frames sharing the same image
     frame = background_->referenceFrame(frame);
 
-    // Load texture to GPU if not done already
-    if (!texIds_.contains(frame))
+    // Use cached texture if any
+    QHash<int, Texture>::iterator it = textures_.find(frame);
+    if (it != textures_.end())
     {
-        // Get QImage
-        QImage img = background_->image(frame);
+        ++numHits_;
+        lruFrames_.splice(lruFrames_.begin(), lruFrames_, it->lruIterator);
 
-        if (img.isNull())
-        {
-            // Set 0 as cached value, so we won't try to re-read the file later.
-            texIds_[frame] = (GLuint) 0;
-        }
-        else
+        // Replace proxies that are too coarse for the current zoom. Full
+        // resolution is decoded now, e.g., when exporting. Otherwise the
+        // coarse proxy is drawn until a finer one is decoded.
+        if (isTooCoarse_(*it))
         {
-            // Load texture to GPU.
-            texIds_[frame] = context_->bindTexture(img);
+            QMap<int, QFuture<DecodedImage> >::iterator pending = pendingImages_.find(frame);
+            if (targetWidth_ == 0)
+            {
+                if (pending != pendingImages_.end())
+                    pendingImages_.erase(pending);
+                insertTexture_(frame, readImage_(background_->resolvedImageFilePath(frame), 0, 0));
+            }
+            else if (pending == pendingImages_.end())
+            {
+                requestImage_(frame);
+            }
+            else if (pending->isFinished())
+            {
+                // Discard the result if the zoom changed in the meantime
+                // and it isn't finer than the current proxy
+                DecodedImage image = pending->result();
+                pendingImages_.erase(pending);
+                if (!image.isProxy || image.glImage.width() > it->width)
+                    insertTexture_(frame, image);
+            }
         }
+
+        return textures_[frame].texId;
+    }
+
+    // Get image decoded by the loader thread, or decode it now, waiting
+    // for the loader thread if it is already decoding it
+    ++numMisses_;
+    DecodedImage image;
+    bool isDecoded = false;
+    if (pendingImages_.contains(frame))
+    {
+        image = pendingImages_.take(frame).result();
+        isDecoded = !(image.isProxy && targetWidth_ == 0);
+    }
+    if (!isDecoded)
+        image = readImage_(background_->resolvedImageFilePath(frame), targetWidth_, targetHeight_);
+
+    // Load texture to GPU. A null image is cached as a 0 texture id, so
+    // that we won't try to re-read the file later.
+    insertTexture_(frame, image);
+    return textures_[frame].texId;
+}
+
+void BackgroundRenderer::requestImage_(int frame)
+{
+    // File paths are resolved in this thread, since the Background is not thread-safe
+    QString filePath = background_->resolvedImageFilePath(frame);
+    pendingImages_[frame] = QtConcurrent::run(&loaderThreadPool_, &BackgroundRenderer::readImage_,
+                                              filePath, targetWidth_, targetHeight_);
+}
+
+void BackgroundRenderer::prefetch_(int frame)
+{
+    // Guess the direction of playback from the previously drawn frame
+    if (frame > lastDrawnFrame_)
+        playDirection_ = 1;
+    else if (frame < lastDrawnFrame_)
+        playDirection_ = -1;
+    lastDrawnFrame_ = frame;
+
+    // Get reference frames to prefetch, in order of priority
+    QList<int> frames;
+    frames << background_->referenceFrame(frame);
+    for (int i=1; i<=NUM_PREFETCHED_FRAMES_AHEAD; ++i)
+        frames << background_->referenceFrame(frame + i * playDirection_);
+    for (int i=1; i<=NUM_PREFETCHED_FRAMES_BEHIND; ++i)
+        frames << background_->referenceFrame(frame - i * playDirection_);
+
+    // Forget images that are no longer needed, e.g., after seeking
+    foreach (int f, pendingImages_.keys())
+    {
+        if (!frames.contains(f))
+            pendingImages_.remove(f);
+    }
+
+    // Queue images not decoded yet
+    foreach (int f, frames)
+    {
+        if (!textures_.contains(f) && !pendingImages_.contains(f))
+            requestImage_(f);
+    }
+}
+
+GLuint BackgroundRenderer::uploadTexture_(const QImage & glImage)
+{
+    GLuint texId;
+    glGenTextures(1, &texId);
+    glBindTexture(GL_TEXTURE_2D, texId);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_GENERATE_MIPMAP, GL_TRUE);
+
+    const int width = glImage.width();
+    const int height = glImage.height();
+    const int numBytes = glImage.byteCount();
+
+    if (GLEW_VERSION_2_1 || GLEW_ARB_pixel_buffer_object)
+    {
+        // Copy to a PBO, from which the driver transfers to the texture
+        // without stalling the draw calls that follow
+        GLuint pboId;
+        glGenBuffers(1, &pboId);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pboId);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, numBytes, glImage.constBits(), GL_STREAM_DRAW);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glDeleteBuffers(1, &pboId); // actually freed once the transfer is done
+    }
+    else
+    {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, glImage.constBits());
     }
 
-    // Returned cached texture
-    return texIds_[frame];
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return texId;
 }
 
 namespace
@@ -204,8 +490,27 @@ void BackgroundRenderer::draw(int frame, bool showCanvas,
                               double canvasWidth, double canvasHeight,
 
                               double xSceneMin, double xSceneMax,
-                              double ySceneMin, double ySceneMax)
+                              double ySceneMin, double ySceneMax,
+
+                              double zoom)
 {
+    // Evict least recently used textures exceeding the budget. This is done
+    // before drawing, so that no texture in use is deleted.
+    trim_();
+
+    // Get size, in pixels, of the background image on screen
+    if (zoom > 0 && DevSettings::getBool("background proxy textures"))
+    {
+        Eigen::Vector2d size = background_->computedSize(Eigen::Vector2d(canvasWidth, canvasHeight));
+        targetWidth_ = std::max(1, (int) std::ceil(std::abs(size[0]) * zoom));
+        targetHeight_ = std::max(1, (int) std::ceil(std::abs(size[1]) * zoom));
+    }
+    else
+    {
+        targetWidth_ = 0;
+        targetHeight_ = 0;
+    }
+
     // Get canvas boundary
     const double & wc = canvasWidth;
     const double & hc = canvasHeight;
@@ -266,8 +571,9 @@ void BackgroundRenderer::draw(int frame, bool showCanvas,
 
     // ----- Draw background image -----
 
-    // Get texture id
+    // Get texture id, and decode upcoming images
     GLuint texId = texId_(frame);
+    prefetch_(frame);
 
     // Draw image if non-zero
     if (texId)
@@ -12,13 +12,21 @@
 #include <QObject>
 
 #include "OpenGL.h"
+#include "MemoryStats.h"
 
 #include <QMap>
+#include <QHash>
+#include <QImage>
+#include <QFuture>
+#include <QThreadPool>
+
+#include <cstddef>
+#include <list>
 
 class Background;
 class QGLContext;
 
-class BackgroundRenderer: public QObject
+class BackgroundRenderer: public QObject, public MemoryStats::Source
 {
     Q_OBJECT
 
@@ -27,6 +35,13 @@ public:
                        QGLContext * context,
                        QObject * parent = 0);
 
+    // Returns the renderer of background shared by all views, creating it
+    // with the given context if it doesn't exist yet. It is a child of the
+    // background, so its textures are only uploaded once for all views, as
+    // long as their contexts share resources with this context (see
+    // GLWidget::sharedContext()).
+    static BackgroundRenderer * shared(Background * background, QGLContext * context);
+
     // Draw the background for specified frame.
     //
     // If showCanvas = true, then draw an area covering the canvas only, and
@@ -44,23 +59,93 @@ public:
     // constructor, so we don't have to pass that many parameters. (but the
     // 'Canvas' class is not even implemented yet)
     //
+    // If zoom > 0 and the "background proxy textures" setting is on, images
+    // may be drawn from downscaled textures, as long as they are not smaller
+    // than the background on screen. Use zoom = 0 to draw full-resolution
+    // textures, e.g., when exporting.
+    //
     void draw(int frame,bool showCanvas,
 
               double canvasLeft, double canvasTop,
               double canvasWidth, double canvasHeight,
 
               double xSceneMin, double xSceneMax,
-              double ySceneMin, double ySceneMax);
+              double ySceneMin, double ySceneMax,
+
+              double zoom = 0);
+
+    // Statistics of the texture cache
+    std::size_t numBytes() const;
+    int numTextures() const;
+    unsigned long long numHits() const;
+    unsigned long long numMisses() const;
+    unsigned long long numEvictions() const;
+    void resetCounters();
+    void reportMemory(MemoryStats::Report & report) const;
+
+    // Incremented whenever a texture is inserted or removed, so that views
+    // caching what they drew know when it may have changed
+    unsigned int version() const;
 
 private slots:
     void clearCache_();
 
 private:
+    // Decodes an image, or its proxy downscaled by a power of two if larger
+    // than twice the target size, and converts it to OpenGL format. Called
+    // by loader threads.
+    struct DecodedImage
+    {
+        QImage glImage;
+        bool isProxy;
+    };
+    static DecodedImage readImage_(const QString & filePath, int targetWidth, int targetHeight);
+
     Background * background_;
     QGLContext * context_;
 
+    // Textures are cached per reference frame, within the budget given by
+    // the "background cache (MB)" setting. Least recently used textures are
+    // evicted first.
+    struct Texture
+    {
+        GLuint texId; // 0 if the image is missing
+        int width;
+        int height;
+        bool isProxy;
+        std::size_t numBytes;
+        std::list<int>::iterator lruIterator;
+    };
     GLuint texId_(int frame);
-    QMap<int, GLuint> texIds_;
+    void insertTexture_(int frame, const DecodedImage & image);
+    void removeTexture_(int frame);
+    bool isTooCoarse_(const Texture & texture) const;
+    void trim_();
+    QHash<int, Texture> textures_;
+    std::list<int> lruFrames_; // most recently used first
+    std::size_t numBytes_;
+    unsigned long long numHits_;
+    unsigned long long numMisses_;
+    unsigned long long numEvictions_;
+    unsigned int version_;
+
+    // Images are decoded ahead of time by a loader thread, for the frames
+    // following the last drawn frame in the direction of playback, so that
+    // drawing each frame only has to upload an already decoded image
+    void prefetch_(int frame);
+    void requestImage_(int frame);
+    QThreadPool loaderThreadPool_;
+    QMap<int, QFuture<DecodedImage> > pendingImages_;
+    int lastDrawnFrame_;
+    int playDirection_; // 1 or -1
+
+    // Size, in pixels, of the background on screen, or 0 to decode
+    // images at full resolution
+    int targetWidth_;
+    int targetHeight_;
+
+    // Uploads an image in OpenGL format, through a PBO if supported
+    GLuint uploadTexture_(const QImage & glImage);
 };
 
 #endif // BACKGROUND_RENDERER_H
@@ -0,0 +1,934 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+
+#include "Benchmark.h"
+#include "Global.h"
+#include "OpenGL.h"
+#include "Random.h"
+#include "View.h"
+#include "ViewSettings.h"
+#include "XmlStreamWriter.h"
+#include "XmlStreamReader.h"
+#include "VectorAnimationComplex/VAC.h"
+#include "VectorAnimationComplex/CellBuilder.h"
+#include "VectorAnimationComplex/KeyEdge.h"
+#include "VectorAnimationComplex/KeyVertex.h"
+#include "VectorAnimationComplex/KeyFace.h"
+#include "VectorAnimationComplex/KeyHalfedge.h"
+#include "VectorAnimationComplex/Cycle.h"
+#include "VectorAnimationComplex/InbetweenEdge.h"
+#include "VectorAnimationComplex/EdgeGeometry.h"
+#include "VectorAnimationComplex/EdgeSample.h"
+#include "VectorAnimationComplex/SculptCurve.h"
+
+#include <QBuffer>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMap>
+#include <QOpenGLFramebufferObject>
+#include <QPointF>
+#include <QTextStream>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace VectorAnimationComplex;
+
+BenchmarkOptions::BenchmarkOptions() :
+    numStrokes(500),
+    numFrames(48),
+    seed(0),
+    isScaling(false),
+    maxCells(1000000),
+    maxFrames(1000),
+    soakMinutes(0)
+{
+}
+
+namespace
+{
+
+// Size of the canvas where strokes are sketched
+const double CANVAS_SIZE = 1000;
+
+// Number of batches of four pairs of segments tested for intersection per
+// stroke, and size of the square where they are drawn
+const int SEGMENT_PAIRS_PER_STROKE = 250;
+const double SEGMENT_CANVAS_SIZE = 100;
+
+// Number of samples of the edge of the dense curve scene
+const int DENSE_CURVE_NUM_SAMPLES = 1000000;
+
+// Resident memory of the process, and its peak, in kilobytes. Returns -1 if
+// unknown, i.e., on other platforms than Linux
+qint64 residentMemory_(const char * field)
+{
+#ifdef Q_OS_LINUX
+    QFile file("/proc/self/status");
+    if(file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        QTextStream in(&file);
+        QString line;
+        while(!(line = in.readLine()).isNull())
+        {
+            if(line.startsWith(field))
+                return line.section(':', 1).trimmed().section(' ', 0, 0).toLongLong();
+        }
+    }
+#else
+    Q_UNUSED(field);
+#endif
+    return -1;
+}
+
+// Measures one operation, performed count times
+class Measure
+{
+public:
+    Measure(const QString & scene, const QString & operation) :
+        scene_(scene),
+        operation_(operation),
+        memoryBefore_(residentMemory_("VmRSS"))
+    {
+        timer_.start();
+    }
+
+    QJsonObject result(int count) const
+    {
+        const qint64 nsecs = std::max<qint64>(1, timer_.nsecsElapsed());
+        const qint64 memory = residentMemory_("VmRSS");
+
+        QJsonObject res;
+        res["scene"] = scene_;
+        res["operation"] = operation_;
+        res["count"] = count;
+        res["milliseconds"] = nsecs * 1e-6;
+        res["throughput"] = count * 1e9 / nsecs; // per second
+        res["residentMemoryKB"] = (double) memory;
+        res["residentMemoryDeltaKB"] = (memory < 0 || memoryBefore_ < 0) ? 0.0 : (double) (memory - memoryBefore_);
+        return res;
+    }
+
+private:
+    QString scene_;
+    QString operation_;
+    qint64 memoryBefore_;
+    QElapsedTimer timer_;
+};
+
+// Sketches a polyline through the VAC, as the sketch tool does
+void sketch_(VAC & vac, const QList<Eigen::Vector2d> & points, double width, Time time)
+{
+    vac.beginSketchEdge(points[0][0], points[0][1], width, time);
+    for(int i=1; i<points.size(); ++i)
+        vac.continueSketchEdge(points[i][0], points[i][1], width);
+    vac.endSketchEdge();
+}
+
+// A random walk of n points inside the canvas
+QList<Eigen::Vector2d> randomStroke_(int n)
+{
+    QList<Eigen::Vector2d> res;
+    Eigen::Vector2d p(Random::random(0, CANVAS_SIZE), Random::random(0, CANVAS_SIZE));
+    double angle = Random::random(0, 2 * M_PI);
+    for(int i=0; i<n; ++i)
+    {
+        res << p;
+        angle += Random::random(-0.3, 0.3);
+        p += 10 * Eigen::Vector2d(std::cos(angle), std::sin(angle));
+        p[0] = std::min(CANVAS_SIZE, std::max(0.0, p[0]));
+        p[1] = std::min(CANVAS_SIZE, std::max(0.0, p[1]));
+    }
+    return res;
+}
+
+// A straight stroke from a to b, sampled every 10 units
+QList<Eigen::Vector2d> straightStroke_(const Eigen::Vector2d & a, const Eigen::Vector2d & b)
+{
+    QList<Eigen::Vector2d> res;
+    int n = std::max(2, (int) std::ceil((b-a).norm() / 10) + 1);
+    for(int i=0; i<n; ++i)
+        res << a + (b-a) * ((double) i / (n-1));
+    return res;
+}
+
+// Triangulates all cells of a copy of the VAC, whose caches are empty. Only
+// faces are triangulated if onlyFaces is true
+QJsonObject triangulate_(VAC & vac, const QString & scene, const QString & operation,
+                         const QList<Time> & times, bool onlyFaces)
+{
+    VAC * copy = vac.clone();
+    CellSet cells = copy->cells();
+    int count = 0;
+    Measure measure(scene, operation);
+    foreach(Cell * cell, cells)
+    {
+        if(onlyFaces && !cell->toFaceCell())
+            continue;
+        for(const Time & t: times)
+        {
+            if(cell->exists(t))
+            {
+                cell->triangles(t);
+                ++count;
+            }
+        }
+    }
+    QJsonObject res = measure.result(count);
+    delete copy;
+    return res;
+}
+
+// Writes the VAC as when saving a document
+QByteArray writeVac_(VAC & vac)
+{
+    QByteArray bytes;
+    QBuffer buffer(&bytes);
+    buffer.open(QIODevice::WriteOnly);
+    {
+        XmlStreamWriter xml(&buffer);
+        xml.writeStartDocument();
+        xml.writeStartElement("objects");
+        vac.write(xml);
+        xml.writeEndElement();
+        xml.writeEndDocument();
+    }
+    return bytes;
+}
+
+// Reads back a VAC written by writeVac_(), as when opening a document
+void readVac_(const QByteArray & bytes, VAC & vac)
+{
+    QBuffer buffer;
+    buffer.setData(bytes);
+    buffer.open(QIODevice::ReadOnly);
+    XmlStreamReader xml(&buffer);
+    if(xml.readNextStartElement() && xml.name() == "objects")
+        vac.read(xml);
+}
+
+// Writes then reads back the VAC, as when saving and opening a document
+void writeAndRead_(VAC & vac, const QString & scene, QJsonArray & results)
+{
+    const int numCells = vac.cells().size();
+
+    QByteArray bytes;
+    {
+        Measure measure(scene, "VAC::write");
+        bytes = writeVac_(vac);
+        QJsonObject res = measure.result(numCells);
+        res["bytes"] = bytes.size();
+        results << res;
+    }
+
+    {
+        VAC copy;
+        Measure measure(scene, "VAC::read");
+        readVac_(bytes, copy);
+        QJsonObject res = measure.result(copy.cells().size());
+        res["bytes"] = bytes.size();
+        results << res;
+    }
+}
+
+void clone_(VAC & vac, const QString & scene, QJsonArray & results)
+{
+    const int numCopies = 10;
+    QList<VAC*> copies;
+    Measure measure(scene, "VAC::clone");
+    for(int i=0; i<numCopies; ++i)
+        copies << vac.clone();
+    results << measure.result(numCopies * vac.cells().size());
+    qDeleteAll(copies);
+}
+
+// Deletes a random half of the edges of a copy of the VAC
+void smartDelete_(VAC & vac, const QString & scene, QJsonArray & results)
+{
+    VAC * copy = vac.clone();
+    CellSet cellsToDelete;
+    foreach(KeyEdge * e, copy->instantEdges())
+        if(Random::randomInt(0, 1))
+            cellsToDelete << e;
+    copy->setSelectedCells(cellsToDelete, false);
+    Measure measure(scene, "VAC::smartDelete_");
+    copy->smartDelete();
+    results << measure.result(cellsToDelete.size());
+    delete copy;
+}
+
+// Strokes sketched at random, intersecting each other
+void randomStrokes_(const BenchmarkOptions & options, QJsonArray & results)
+{
+    const QString scene = "random strokes";
+    const Time t;
+
+    QList< QList<Eigen::Vector2d> > strokes;
+    for(int i=0; i<options.numStrokes; ++i)
+        strokes << randomStroke_(Random::randomInt(10, 50));
+
+    VAC vac;
+    Measure measure(scene, "VAC::insertSketchedEdgeInVAC");
+    for(const QList<Eigen::Vector2d> & stroke: strokes)
+        sketch_(vac, stroke, Random::random(2, 10), t);
+    QJsonObject res = measure.result(strokes.size());
+    res["numCells"] = vac.cells().size();
+    results << res;
+
+    results << triangulate_(vac, scene, "Cell::triangles", QList<Time>() << t, false);
+    writeAndRead_(vac, scene, results);
+    clone_(vac, scene, results);
+    smartDelete_(vac, scene, results);
+}
+
+// A grid of horizontal and vertical strokes, whose cells are all filled
+void planarMap_(const BenchmarkOptions & options, QJsonArray & results)
+{
+    const QString scene = "planar map";
+    const Time t;
+    const int n = std::max(2, (int) std::sqrt((double) options.numStrokes));
+    const double step = CANVAS_SIZE / (n+1);
+
+    VAC vac;
+    Measure measure(scene, "VAC::insertSketchedEdgeInVAC");
+    for(int i=1; i<=n; ++i)
+    {
+        sketch_(vac, straightStroke_(Eigen::Vector2d(0, i*step), Eigen::Vector2d(CANVAS_SIZE, i*step)), 3, t);
+        sketch_(vac, straightStroke_(Eigen::Vector2d(i*step, 0), Eigen::Vector2d(i*step, CANVAS_SIZE)), 3, t);
+    }
+    QJsonObject res = measure.result(2*n);
+    res["numCells"] = vac.cells().size();
+    results << res;
+
+    {
+        Measure measure(scene, "VAC::fillAllEnclosedRegions");
+        vac.fillAllEnclosedRegions();
+        KeyFaceSet faces = vac.cells();
+        results << measure.result(faces.size());
+    }
+
+    results << triangulate_(vac, scene, "computeTrianglesFromCycles", QList<Time>() << t, true);
+    writeAndRead_(vac, scene, results);
+    clone_(vac, scene, results);
+    smartDelete_(vac, scene, results);
+}
+
+// Strokes sketched at the first and last frames, then inbetweened
+void animation_(const BenchmarkOptions & options, QJsonArray & results)
+{
+    const QString scene = "animation";
+    const int n = std::max(1, options.numStrokes / 5);
+    const int numFrames = std::max(1, options.numFrames);
+    const double step = CANVAS_SIZE / (n+1);
+
+    // Key edges, which don't intersect each other within a frame
+    VAC vac;
+    for(int i=1; i<=n; ++i)
+    {
+        double x = Random::random(0, CANVAS_SIZE / 2);
+        sketch_(vac, straightStroke_(Eigen::Vector2d(x, i*step), Eigen::Vector2d(x + 100, i*step)), 3, Time(0));
+        x = Random::random(0, CANVAS_SIZE / 2);
+        sketch_(vac, straightStroke_(Eigen::Vector2d(x, i*step), Eigen::Vector2d(x + 200, i*step)), 3, Time(numFrames));
+    }
+
+    // Inbetween edges, pairing them in order of creation
+    KeyEdgeList edges1 = vac.instantEdges(Time(0));
+    KeyEdgeList edges2 = vac.instantEdges(Time(numFrames));
+    auto byId = [](KeyEdge * e1, KeyEdge * e2) { return e1->id() < e2->id(); };
+    std::sort(edges1.begin(), edges1.end(), byId);
+    std::sort(edges2.begin(), edges2.end(), byId);
+    for(int i=0; i<std::min(edges1.size(), edges2.size()); ++i)
+    {
+        vac.setSelectedCells(CellSet() << edges1[i] << edges2[i], false);
+        vac.inbetweenSelection();
+    }
+    vac.deselectAll();
+
+    // Every frame, and half frames
+    QList<Time> times;
+    for(int i=1; i<2*numFrames; ++i)
+        times << Time(0.5 * i);
+
+    {
+        InbetweenEdgeSet inbetweenEdges = vac.cells();
+        InbetweenEdge::EdgeSampleVector sampling;
+        int count = 0;
+        Measure measure(scene, "InbetweenEdge::getSampling");
+        for(InbetweenEdge * e: inbetweenEdges)
+        {
+            for(const Time & t: times)
+            {
+                e->getSampling(t, sampling);
+                ++count;
+            }
+        }
+        results << measure.result(count);
+    }
+
+    results << triangulate_(vac, scene, "Cell::triangles", times, false);
+    writeAndRead_(vac, scene, results);
+    clone_(vac, scene, results);
+}
+
+// Chains of straight edges created programmatically, as an importer of
+// traced raster art would, one cell at a time and with a CellBuilder
+void tracedPolylines_(const BenchmarkOptions & options, QJsonArray & results)
+{
+    const QString scene = "traced polylines";
+    const Time t;
+
+    QList< QList<Eigen::Vector2d> > polylines;
+    int numEdges = 0;
+    for(int i=0; i<20*options.numStrokes; ++i)
+    {
+        polylines << randomStroke_(10);
+        numEdges += polylines.last().size() - 1;
+    }
+
+    {
+        VAC vac;
+        Measure measure(scene, "VAC::newKeyEdge");
+        for(const QList<Eigen::Vector2d> & polyline: polylines)
+        {
+            KeyVertex * v1 = vac.newKeyVertex(t, polyline[0]);
+            for(int j=1; j<polyline.size(); ++j)
+            {
+                KeyVertex * v2 = vac.newKeyVertex(t, polyline[j]);
+                vac.newKeyEdge(t, v1, v2, 0, 3);
+                v1 = v2;
+            }
+        }
+        results << measure.result(numEdges);
+    }
+
+    {
+        VAC vac;
+        Measure measure(scene, "CellBuilder");
+        CellBuilder builder(&vac);
+        builder.reserve(numEdges + polylines.size(), numEdges);
+        for(const QList<Eigen::Vector2d> & polyline: polylines)
+        {
+            KeyVertex * v1 = builder.newKeyVertex(t, polyline[0]);
+            for(int j=1; j<polyline.size(); ++j)
+            {
+                KeyVertex * v2 = builder.newKeyVertex(t, polyline[j]);
+                builder.newKeyEdge(t, v1, v2, 0, 3);
+                v1 = v2;
+            }
+        }
+        builder.commit();
+        results << measure.result(numEdges);
+    }
+}
+
+// Random pairs of segments, tested for intersection one at a time by the
+// scalar SculptCurve::Curve::intersects(), then four at a time by
+// intersects4(), which must give exactly the same results. Returns false if
+// they differ.
+bool segmentIntersections_(const BenchmarkOptions & options, QJsonArray & results)
+{
+    typedef SculptCurve::Curve<EdgeSample> Curve;
+    const QString scene = "segment intersections";
+    const int numPairs = 4 * SEGMENT_PAIRS_PER_STROKE * options.numStrokes;
+
+    // Segments of random length and direction
+    std::vector<double> ax(numPairs), ay(numPairs), bx(numPairs), by(numPairs);
+    std::vector<double> cx(numPairs), cy(numPairs), dx(numPairs), dy(numPairs);
+    for(int i=0; i<numPairs; ++i)
+    {
+        ax[i] = Random::random(0, SEGMENT_CANVAS_SIZE); ay[i] = Random::random(0, SEGMENT_CANVAS_SIZE);
+        bx[i] = Random::random(0, SEGMENT_CANVAS_SIZE); by[i] = Random::random(0, SEGMENT_CANVAS_SIZE);
+        cx[i] = Random::random(0, SEGMENT_CANVAS_SIZE); cy[i] = Random::random(0, SEGMENT_CANVAS_SIZE);
+        dx[i] = Random::random(0, SEGMENT_CANVAS_SIZE); dy[i] = Random::random(0, SEGMENT_CANVAS_SIZE);
+    }
+
+    std::vector<char> scalarHits(numPairs);
+    std::vector<double> scalarU(numPairs), scalarV(numPairs);
+    int numIntersections = 0;
+    {
+        Measure measure(scene, "Curve::intersects");
+        for(int i=0; i<numPairs; ++i)
+        {
+            scalarHits[i] = Curve::intersects(ax[i], ay[i], bx[i], by[i], cx[i], cy[i], dx[i], dy[i],
+                                              scalarU[i], scalarV[i]);
+            numIntersections += scalarHits[i];
+        }
+        QJsonObject res = measure.result(numPairs);
+        res["intersections"] = numIntersections;
+        results << res;
+    }
+
+    std::vector<int> masks(numPairs / 4);
+    std::vector<double> u(numPairs), v(numPairs);
+    int numMismatches = 0;
+    {
+        Measure measure(scene, "Curve::intersects4");
+        for(int i=0; i<numPairs; i+=4)
+            masks[i/4] = Curve::intersects4(&ax[i], &ay[i], &bx[i], &by[i], &cx[i], &cy[i], &dx[i], &dy[i],
+                                            &u[i], &v[i]);
+        QJsonObject res = measure.result(numPairs);
+
+        // Intersecting pairs must match, with bit-identical parameters
+        for(int i=0; i<numPairs; ++i)
+        {
+            bool hit = masks[i/4] & (1 << (i%4));
+            if(hit != (bool) scalarHits[i] || (hit && (u[i] != scalarU[i] || v[i] != scalarV[i])))
+                ++numMismatches;
+        }
+        res["mismatches"] = numMismatches;
+        results << res;
+    }
+
+    if(numMismatches > 0)
+    {
+        QTextStream err(stderr);
+        err << "Error: intersects4() differs from intersects() for "
+            << numMismatches << " of " << numPairs << " pairs of segments\n";
+        return false;
+    }
+    return true;
+}
+
+// A single edge of DENSE_CURVE_NUM_SAMPLES samples, saved then opened as
+// text, i.e., as an xywdense curve parsed in place (see NumberParser)
+void denseCurve_(QJsonArray & results)
+{
+    const QString scene = "dense curve";
+    const Time t;
+
+    // A random walk, of varying width
+    EdgeSampleVector samples;
+    samples.reserve(DENSE_CURVE_NUM_SAMPLES);
+    Eigen::Vector2d p(CANVAS_SIZE / 2, CANVAS_SIZE / 2);
+    for(int i=0; i<DENSE_CURVE_NUM_SAMPLES; ++i)
+    {
+        samples.push_back(EdgeSample(p[0], p[1], Random::random(2, 10)));
+        p += Eigen::Vector2d(Random::random(-1, 1), Random::random(-1, 1));
+    }
+
+    VAC vac;
+    KeyVertex * v1 = vac.newKeyVertex(t, Eigen::Vector2d(samples.front().x(), samples.front().y()));
+    KeyVertex * v2 = vac.newKeyVertex(t, Eigen::Vector2d(samples.back().x(), samples.back().y()));
+    vac.newKeyEdge(t, v1, v2, new LinearSpline(samples));
+
+    QByteArray bytes;
+    {
+        Measure measure(scene, "VAC::write");
+        bytes = writeVac_(vac);
+        QJsonObject res = measure.result(DENSE_CURVE_NUM_SAMPLES);
+        res["bytes"] = bytes.size();
+        results << res;
+    }
+
+    {
+        VAC copy;
+        Measure measure(scene, "VAC::read");
+        readVac_(bytes, copy);
+        QJsonObject res = measure.result(DENSE_CURVE_NUM_SAMPLES);
+        res["bytes"] = bytes.size();
+        KeyEdgeList edges = copy.instantEdges();
+        LinearSpline * spline = edges.isEmpty() ? 0 : edges[0]->geometry()->toLinearSpline();
+        res["numSamplesRead"] = spline ? spline->size() : 0;
+        results << res;
+    }
+}
+
+// -- Scalability sweep --
+
+// Number of cells of the smallest scene of the sweep in number of cells, and
+// of all scenes of the sweep in number of frames
+const int SCALING_MIN_CELLS = 1000;
+const int SCALING_NUM_CELLS_PER_ANIMATION = 100000;
+
+// Each size of a sweep is about this factor larger than the previous one
+const double SCALING_STEP = 3.16227766; // sqrt(10)
+
+// Size of the offscreen image where scenes are drawn, in pixels
+const int SCALING_IMAGE_SIZE = 1024;
+
+// Number of calls of each operation per scene
+const int SCALING_NUM_DRAWS = 5;
+const int SCALING_NUM_INSTANT_EDGES = 100;
+const int SCALING_NUM_SCULPT_UPDATES = 1000;
+const int SCALING_NUM_SKETCHES = 20;
+
+// Sizes from first to last, each about SCALING_STEP times the previous one
+QList<int> scalingSizes_(int first, int last)
+{
+    QList<int> res;
+    first = std::min(first, last);
+    for(double size = first; size <= 1.01 * last; size *= SCALING_STEP)
+        res << (int) std::round(size);
+    return res;
+}
+
+// A scene of about numCells cells, split between frames 0 to numFrames-1,
+// where each frame is a jittered grid of filled squares. Cells are created
+// with a CellBuilder, since sketching large scenes would take longer than
+// measuring them.
+VAC * gridScene_(int numCells, int numFrames)
+{
+    // A k*k grid has (k+1)^2 vertices, 2k(k+1) edges and k^2 faces
+    const int numCellsPerFrame = std::max(1, numCells / numFrames);
+    const int k = std::max(1, (int) std::round(std::sqrt(numCellsPerFrame / 4.0)));
+    const double step = CANVAS_SIZE / k;
+
+    VAC * vac = new VAC();
+    CellBuilder builder(vac);
+    builder.reserve(numFrames * (k+1) * (k+1), numFrames * 2 * k * (k+1), numFrames * k * k);
+    std::vector<KeyVertex*> vertices((k+1) * (k+1));  // (i,j) at j*(k+1)+i
+    std::vector<KeyEdge*> horizontalEdges(k * (k+1)); // (i,j) at j*k+i, from vertex (i,j) to (i+1,j)
+    std::vector<KeyEdge*> verticalEdges(k * (k+1));   // (i,j) at i*k+j, from vertex (i,j) to (i,j+1)
+    for(int f=0; f<numFrames; ++f)
+    {
+        const Time t(f);
+        for(int j=0; j<=k; ++j)
+        {
+            for(int i=0; i<=k; ++i)
+            {
+                Eigen::Vector2d pos((i + Random::random(-0.2, 0.2)) * step,
+                                    (j + Random::random(-0.2, 0.2)) * step);
+                vertices[j*(k+1)+i] = builder.newKeyVertex(t, pos);
+            }
+        }
+        for(int j=0; j<=k; ++j)
+            for(int i=0; i<k; ++i)
+                horizontalEdges[j*k+i] = builder.newKeyEdge(t, vertices[j*(k+1)+i], vertices[j*(k+1)+i+1], 0, 3);
+        for(int i=0; i<=k; ++i)
+            for(int j=0; j<k; ++j)
+                verticalEdges[i*k+j] = builder.newKeyEdge(t, vertices[j*(k+1)+i], vertices[(j+1)*(k+1)+i], 0, 3);
+        for(int j=0; j<k; ++j)
+        {
+            for(int i=0; i<k; ++i)
+            {
+                QList<KeyHalfedge> halfedges;
+                halfedges << KeyHalfedge(horizontalEdges[j*k+i], true)
+                          << KeyHalfedge(verticalEdges[(i+1)*k+j], true)
+                          << KeyHalfedge(horizontalEdges[(j+1)*k+i], false)
+                          << KeyHalfedge(verticalEdges[i*k+j], false);
+                builder.newKeyFace(QList<Cycle>() << Cycle(halfedges));
+            }
+        }
+    }
+    builder.commit();
+    return vac;
+}
+
+// Offscreen image where scenes are drawn, with the OpenGL context of the
+// active view, as when exporting PNG files
+class OffscreenImage
+{
+public:
+    OffscreenImage() :
+        fbo_(0)
+    {
+        View * view = global()->activeView();
+        if(view)
+        {
+            view->makeCurrent();
+            fbo_ = new QOpenGLFramebufferObject(SCALING_IMAGE_SIZE, SCALING_IMAGE_SIZE,
+                                                QOpenGLFramebufferObject::CombinedDepthStencil);
+        }
+    }
+
+    ~OffscreenImage()
+    {
+        delete fbo_;
+    }
+
+    bool isValid() const
+    {
+        return fbo_ && fbo_->isValid();
+    }
+
+    // Binds the image, cleared, with the canvas filling it
+    void bind()
+    {
+        fbo_->bind();
+        glViewport(0, 0, SCALING_IMAGE_SIZE, SCALING_IMAGE_SIZE);
+        glClearColor(1.0, 1.0, 1.0, 1.0);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+        glMatrixMode(GL_PROJECTION);
+        glLoadIdentity();
+        glOrtho(0, CANVAS_SIZE, CANVAS_SIZE, 0, 0, 1);
+        glMatrixMode(GL_MODELVIEW);
+        glLoadIdentity();
+    }
+
+    // Waits for the GPU, so that measures include drawing, and unbinds the image
+    void release()
+    {
+        glFinish();
+        fbo_->release();
+    }
+
+private:
+    QOpenGLFramebufferObject * fbo_;
+};
+
+// One scene of a sweep
+struct ScalingScene
+{
+    QString sweep; // "cells" or "frames"
+    int numCells;
+    int numFrames;
+};
+
+QJsonObject scalingResult_(const Measure & measure, int numCalls, const ScalingScene & scene)
+{
+    QJsonObject res = measure.result(numCalls);
+    res["sweep"] = scene.sweep;
+    res["numCells"] = scene.numCells;
+    res["numFrames"] = scene.numFrames;
+    res["millisecondsPerCall"] = res["milliseconds"].toDouble() / numCalls;
+    return res;
+}
+
+// Draws, or draws the picking image of, frames evenly spread in the scene.
+// Each frame is first drawn once unmeasured, so that its triangulation is
+// cached, as when redrawing the same frame on screen.
+QJsonObject measureDraw_(VAC & vac, const ScalingScene & scene, OffscreenImage & image, bool isPicking)
+{
+    ViewSettings viewSettings;
+    viewSettings.setVisibleRect(0, CANVAS_SIZE, 0, CANVAS_SIZE);
+    viewSettings.setMainDrawing(false);
+    viewSettings.setDrawCursor(false);
+    QList<Time> times;
+    for(int i=0; i<SCALING_NUM_DRAWS; ++i)
+        times << Time((i * scene.numFrames) / SCALING_NUM_DRAWS);
+
+    auto drawTimes = [&]()
+    {
+        image.bind();
+        for(const Time & t: times)
+        {
+            if(isPicking)
+                vac.drawPick(t, viewSettings);
+            else
+                vac.draw(t, viewSettings);
+        }
+        image.release();
+    };
+
+    drawTimes();
+    Measure measure("scaling " + scene.sweep, isPicking ? "VAC::drawPick" : "VAC::draw");
+    drawTimes();
+    return scalingResult_(measure, times.size(), scene);
+}
+
+// Measures all operations of the sweep on the given scene, which is modified
+void measureScalingScene_(VAC & vac, const ScalingScene & scene, OffscreenImage & image, QJsonArray & results)
+{
+    const QString sceneName = "scaling " + scene.sweep;
+
+    // Drawing, where VAC::drawPick() is what View::updatePicking() draws
+    if(image.isValid())
+    {
+        results << measureDraw_(vac, scene, image, false);
+        results << measureDraw_(vac, scene, image, true);
+    }
+
+    {
+        int numEdges = 0;
+        Measure measure(sceneName, "VAC::instantEdges(Time)");
+        for(int i=0; i<SCALING_NUM_INSTANT_EDGES; ++i)
+            numEdges += vac.instantEdges(Time(i % scene.numFrames)).size();
+        QJsonObject res = scalingResult_(measure, SCALING_NUM_INSTANT_EDGES, scene);
+        res["numEdges"] = numEdges;
+        results << res;
+    }
+
+    {
+        Measure measure(sceneName, "VAC::updateSculpt");
+        for(int i=0; i<SCALING_NUM_SCULPT_UPDATES; ++i)
+        {
+            vac.updateSculpt(Random::random(0, CANVAS_SIZE), Random::random(0, CANVAS_SIZE),
+                             Time(Random::randomInt(0, scene.numFrames - 1)));
+        }
+        results << scalingResult_(measure, SCALING_NUM_SCULPT_UPDATES, scene);
+    }
+
+    {
+        Measure measure(sceneName, "VAC::clone");
+        VAC * copy = vac.clone();
+        QJsonObject res = scalingResult_(measure, 1, scene);
+        delete copy;
+        results << res;
+    }
+
+    QByteArray bytes;
+    {
+        Measure measure(sceneName, "VAC::write");
+        bytes = writeVac_(vac);
+        QJsonObject res = scalingResult_(measure, 1, scene);
+        res["bytes"] = bytes.size();
+        results << res;
+    }
+
+    {
+        VAC * copy = new VAC();
+        Measure measure(sceneName, "VAC::read");
+        readVac_(bytes, *copy);
+        QJsonObject res = scalingResult_(measure, 1, scene);
+        delete copy;
+        results << res;
+    }
+
+    // Last, since it modifies the scene
+    {
+        QList< QList<Eigen::Vector2d> > strokes;
+        for(int i=0; i<SCALING_NUM_SKETCHES; ++i)
+            strokes << randomStroke_(20);
+        Measure measure(sceneName, "VAC::insertSketchedEdgeInVAC");
+        for(const QList<Eigen::Vector2d> & stroke: strokes)
+            sketch_(vac, stroke, 3, Time(Random::randomInt(0, scene.numFrames - 1)));
+        results << scalingResult_(measure, strokes.size(), scene);
+    }
+}
+
+// Least-squares slope of log(duration) against log(size), i.e., the exponent
+// k of duration ~ size^k. Returns false if there are less than two sizes.
+bool fitExponent_(const QList<QPointF> & samples, double & exponent)
+{
+    const int n = samples.size();
+    if(n < 2)
+        return false;
+
+    double sumX = 0, sumY = 0, sumXX = 0, sumXY = 0;
+    for(const QPointF & sample: samples)
+    {
+        const double x = std::log(sample.x());
+        const double y = std::log(std::max(1e-9, sample.y()));
+        sumX += x;
+        sumY += y;
+        sumXX += x * x;
+        sumXY += x * y;
+    }
+    const double denominator = n * sumXX - sumX * sumX;
+    if(denominator <= 0)
+        return false;
+    exponent = (n * sumXY - sumX * sumY) / denominator;
+    return true;
+}
+
+// Fits the exponent of each operation of the given sweep, from its results
+void fitExponents_(const QString & sweep, const QJsonArray & results, QJsonArray & exponents)
+{
+    const QString sizeKey = (sweep == "cells") ? "numCells" : "numFrames";
+    QMap<QString, QList<QPointF> > samples;
+    for(const QJsonValue & value: results)
+    {
+        const QJsonObject res = value.toObject();
+        if(res["sweep"].toString() == sweep)
+        {
+            samples[res["operation"].toString()] << QPointF(res[sizeKey].toDouble(),
+                                                           res["millisecondsPerCall"].toDouble());
+        }
+    }
+
+    QTextStream out(stdout);
+    QMapIterator<QString, QList<QPointF> > it(samples);
+    while(it.hasNext())
+    {
+        it.next();
+        double exponent;
+        if(fitExponent_(it.value(), exponent))
+        {
+            QJsonObject res;
+            res["sweep"] = sweep;
+            res["operation"] = it.key();
+            res["exponent"] = exponent;
+            exponents << res;
+            out << sweep << "\t" << it.key() << "\t" << QString::number(exponent, 'f', 2) << "\n";
+        }
+    }
+}
+
+// Scenes of one frame and an increasing number of cells, then scenes of a
+// fixed number of cells split between an increasing number of frames
+void scalingSweep_(const BenchmarkOptions & options, QJsonArray & results, QJsonArray & exponents)
+{
+    OffscreenImage image;
+    if(!image.isValid())
+    {
+        QTextStream err(stderr);
+        err << "Warning: couldn't create an OpenGL framebuffer, drawing isn't measured\n";
+    }
+
+    for(int numCells: scalingSizes_(SCALING_MIN_CELLS, options.maxCells))
+    {
+        VAC * vac = gridScene_(numCells, 1);
+        ScalingScene scene = {"cells", vac->cells().size(), 1};
+        measureScalingScene_(*vac, scene, image, results);
+        delete vac;
+    }
+    fitExponents_("cells", results, exponents);
+
+    const int numCells = std::min(SCALING_NUM_CELLS_PER_ANIMATION, options.maxCells);
+    for(int numFrames: scalingSizes_(1, options.maxFrames))
+    {
+        VAC * vac = gridScene_(numCells, numFrames);
+        ScalingScene scene = {"frames", vac->cells().size(), numFrames};
+        measureScalingScene_(*vac, scene, image, results);
+        delete vac;
+    }
+    fitExponents_("frames", results, exponents);
+}
+
+}
+
+namespace Benchmark
+{
+
+bool run(const BenchmarkOptions & options)
+{
+    QTextStream err(stderr);
+
+    QFile file(options.outputPath);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Text))
+    {
+        err << "Error: couldn't write file " << options.outputPath << "\n";
+        return false;
+    }
+
+    Random::setSeed(options.seed);
+    bool success = true;
+    QJsonObject json;
+    QJsonArray results;
+    if(options.isScaling)
+    {
+        QJsonArray exponents;
+        scalingSweep_(options, results, exponents);
+        json["maxCells"] = options.maxCells;
+        json["maxFrames"] = options.maxFrames;
+        json["exponents"] = exponents;
+    }
+    else
+    {
+        randomStrokes_(options, results);
+        planarMap_(options, results);
+        animation_(options, results);
+        tracedPolylines_(options, results);
+        success = segmentIntersections_(options, results) && success;
+        denseCurve_(results);
+        json["numStrokes"] = options.numStrokes;
+        json["numFrames"] = options.numFrames;
+    }
+
+    json["seed"] = options.seed;
+    json["peakResidentMemoryKB"] = (double) residentMemory_("VmHWM");
+    json["results"] = results;
+    file.write(QJsonDocument(json).toJson());
+    return success;
+}
+
+}
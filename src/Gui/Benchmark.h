@@ -0,0 +1,70 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+// Micro-benchmarks of the hot paths of the VAC, run on synthetic scenes
+// without showing any window (see Application.cpp for the command line):
+//
+//   - random strokes:    strokes sketched at random, intersecting each other
+//   - planar map:        a grid of strokes, whose cells are then all filled
+//   - animation:         strokes inbetweened across a range of frames
+//   - traced polylines:  chains of edges created programmatically
+//   - segment intersections: random pairs of segments, tested one at a time
+//                        and four at a time, which must give the same results
+//   - dense curve:       an edge of a million samples, saved and opened
+//
+// The results are written as JSON, one entry per measured operation, with its
+// duration, throughput, and the resident memory of the process, so that
+// runs from different revisions can be compared to catch regressions.
+//
+// Alternatively, a session recorded from real interactions can be replayed,
+// in which case the latency percentiles of each type of event are written.
+//
+// Or, the scalability sweep generates scenes of increasing size, first in
+// number of cells then in number of frames, measures the main operations on
+// each of them, and fits the exponent k of their duration ~ size^k, so that
+// an operation which became accidentally quadratic stands out.
+//
+// Or, the soak test replays a recorded session in a loop, or generates one,
+// for a long time (see MainWindow::soakTest()), and fails if the memory of a
+// category of MemoryStats, or their total, exceeds its budget once in steady
+// state, so that caches growing without bounds over long sessions stand out.
+
+#include <QMap>
+#include <QString>
+
+struct BenchmarkOptions
+{
+    BenchmarkOptions();
+
+    QString outputPath; // *.json
+    int numStrokes;     // Size of the scenes (see Benchmark.cpp)
+    int numFrames;      // Length of the animation
+    int seed;           // Seed of the random strokes
+    QString replayPath; // If set, replays this recorded session instead
+                        // (see SessionRecorder and MainWindow::replaySession())
+    bool isScaling;     // If true, runs the scalability sweep instead
+    int maxCells;       // Size of the largest scene of the sweep
+    int maxFrames;      // Length of the longest animation of the sweep
+    int soakMinutes;    // If positive, runs the soak test for this long instead
+    QMap<QString, double> memoryBudgets; // Budgets of the soak test, in MB, by
+                                         // MemoryStats::categoryName(), or "Total"
+};
+
+namespace Benchmark
+{
+// Runs all benchmarks, writes the results, and returns whether it succeeded,
+// i.e., the results could be written and no check failed.
+// This requires the Global object, i.e., a MainWindow, to exist.
+bool run(const BenchmarkOptions & options);
+}
+
+#endif // BENCHMARK_H
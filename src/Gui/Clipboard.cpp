@@ -0,0 +1,122 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#include "Clipboard.h"
+#include "TimeDef.h"
+#include "XmlStreamWriter.h"
+#include "XmlStreamReader.h"
+#include "IO/BinaryContainer.h"
+#include "VectorAnimationComplex/VAC.h"
+
+#include <QBuffer>
+#include <QClipboard>
+#include <QCoreApplication>
+#include <QGuiApplication>
+#include <QMimeData>
+#include <QTextStream>
+
+using VectorAnimationComplex::VAC;
+
+namespace
+{
+
+// The cells, and "<pid> <serial>" of the write, which tells whether they
+// were written by this process without reading the cells
+const char * CELLS_MIME_TYPE = "application/x-vpaint-cells";
+const char * ORIGIN_MIME_TYPE = "application/x-vpaint-cells-origin";
+
+// Origin of the cells last written or read by this process
+QByteArray & lastOrigin()
+{
+    static QByteArray res;
+    return res;
+}
+
+QByteArray newOrigin()
+{
+    static int serial = 0;
+    return QByteArray::number(QCoreApplication::applicationPid()) + " " + QByteArray::number(++serial);
+}
+
+}
+
+namespace Clipboard
+{
+
+void write(VAC * cells, Time copyTime)
+{
+    // Dense IDs, in z-order
+    VAC denseCells;
+    denseCells.import(cells);
+
+    QByteArray xmlData;
+    QByteArray blocks;
+    {
+        QBuffer buffer(&xmlData);
+        buffer.open(QIODevice::WriteOnly);
+        XmlStreamWriter xml(&buffer);
+        xml.setBinaryBlocks(&blocks);
+        xml.writeStartDocument();
+        xml.writeStartElement("clipboard");
+        QString time;
+        QTextStream(&time) << copyTime;
+        xml.writeAttribute("copytime", time);
+        denseCells.write(xml);
+        xml.writeEndElement();
+        xml.writeEndDocument();
+    }
+
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    if(!BinaryContainer::write(&buffer, xmlData, blocks))
+        return;
+
+    lastOrigin() = newOrigin();
+    QMimeData * mimeData = new QMimeData();
+    mimeData->setData(CELLS_MIME_TYPE, data);
+    mimeData->setData(ORIGIN_MIME_TYPE, lastOrigin());
+    QGuiApplication::clipboard()->setMimeData(mimeData);
+}
+
+VAC * read(Time & copyTime)
+{
+    const QMimeData * mimeData = QGuiApplication::clipboard()->mimeData();
+    if(!mimeData || !mimeData->hasFormat(ORIGIN_MIME_TYPE) || !mimeData->hasFormat(CELLS_MIME_TYPE))
+        return 0;
+
+    // Cells written or already read by this process are pasted from its own
+    // copy instead
+    QByteArray origin = mimeData->data(ORIGIN_MIME_TYPE);
+    if(origin == lastOrigin())
+        return 0;
+    lastOrigin() = origin;
+
+    QByteArray data = mimeData->data(CELLS_MIME_TYPE);
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::ReadOnly);
+    QByteArray xmlData;
+    QByteArray blocks;
+    if(!BinaryContainer::read(&buffer, xmlData, blocks))
+        return 0;
+
+    QBuffer xmlBuffer(&xmlData);
+    xmlBuffer.open(QIODevice::ReadOnly);
+    XmlStreamReader xml(&xmlBuffer);
+    xml.setBinaryBlocks(&blocks);
+    if(!xml.readNextStartElement() || xml.name() != "clipboard")
+        return 0;
+
+    QString time = xml.attributes().value("copytime").toString();
+    QTextStream(&time) >> copyTime;
+    VAC * res = new VAC();
+    res->read(xml);
+    return res;
+}
+
+}
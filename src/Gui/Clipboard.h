@@ -0,0 +1,42 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#ifndef CLIPBOARD_H
+#define CLIPBOARD_H
+
+// Transport of copied cells through the system clipboard, so that they can be
+// pasted by another VPaint process. The copied cells are written as the XML
+// document of a binary VEC file, i.e., with their samples in raw binary blocks
+// (see IO/BinaryContainer.h), after renumbering them with dense IDs, so that
+// the process pasting them doesn't allocate IDs up to those of the document
+// they were copied from.
+//
+// Within a process, the copied VAC is still pasted as is, without any
+// serialization: the system clipboard is only read if another process wrote
+// to it since this one last did (see the "system clipboard" dev setting).
+
+class Time;
+
+namespace VectorAnimationComplex
+{
+class VAC;
+}
+
+namespace Clipboard
+{
+// Writes the given copied cells, copied at the given time, to the system
+// clipboard
+void write(VectorAnimationComplex::VAC * cells, Time copyTime);
+
+// Returns the cells written to the system clipboard by another process, as a
+// new VAC, and sets the time they were copied at. Returns 0 if there are none,
+// if they were already returned, or if they can't be read.
+VectorAnimationComplex::VAC * read(Time & copyTime);
+}
+
+#endif // CLIPBOARD_H
@@ -7,10 +7,34 @@
 // directory of this distribution and at http://opensource.org/licenses/MIT
 
 #include "DevSettings.h"
+#include "Trace.h"
 
 #include <QLabel>
+#include <QPushButton>
+#include <QFileDialog>
+#include <QMessageBox>
+#include <QMutex>
 #include <QtDebug>
 
+namespace
+{
+
+// Handles can be created from worker threads, and as statics
+QMutex & cachedValuesMutex()
+{
+    static QMutex mutex;
+    return mutex;
+}
+
+template <typename T>
+QHash<QString, std::atomic<T>*> & cachedValues()
+{
+    static QHash<QString, std::atomic<T>*> values;
+    return values;
+}
+
+}
+
 DevSettings * DevSettings::s = 0;
 DevSettings::DevSettings()
 {
@@ -30,13 +54,124 @@ DevSettings::DevSettings()
     addSection("Rendering");
 
     createCheckBox("draw edge orientation", false);
+    createCheckBox("batch drawing", true);
+    createCheckBox("level of detail", true);
+    createCheckBox("gpu stroke expansion", false);
+    createCheckBox("async picking", true);
+    createCheckBox("region picking", true);
+    createCheckBox("picking reuse", true);
+    createCheckBox("integer picking", true);
+    createCheckBox("cpu picking", false);
+    createCheckBox("motion compression", true);
+    createCheckBox("native triangulation", true);
+    createCheckBox("parallel triangulation", true);
+    createCheckBox("coherent triangulation", true);
+    createCheckBox("stencil faces", false);
+    createCheckBox("parallel loading", true);
+    createCheckBox("async open", true);
+    createCheckBox("async save", true);
+    createCheckBox("memory-mapped loading", true);
+    createCheckBox("document preview", true);
+    createCheckBox("async background index", true);
+    createCheckBox("parallel sketch insertion", true);
+    createCheckBox("deferred sketch insertion", true);
+    createCheckBox("lazy loading", false);
+    createCheckBox("streaming file conversion", true);
+    createCheckBox("write converted files", true);
+    createCheckBox("adaptive edge samples", false);
+    createCheckBox("bezier edges", false);
+    createCheckBox("sketch buffer", true);
+    createCheckBox("bulk selection", true);
+    createCheckBox("inbetween level of detail", true);
+    createCheckBox("background proxy textures", true);
+    createCheckBox("playback cache", true);
+    createCheckBox("onion skin cache", true);
+    createCheckBox("partial redraw", true);
+    createCheckBox("frozen layer cache", true);
+    createCheckBox("render thread", false);
+    createCheckBox("tile cache", true);
+    createCheckBox("render stats", false);
+    createCheckBox("gpu timer queries", true);
+    createCheckBox("cached paint bucket", true);
+    createCheckBox("deferred transform", true);
+    createCheckBox("rigid drag and drop", true);
+    createCheckBox("subframe interpolation", true);
+    createCheckBox("geometry prefetch", true);
+    createCheckBox("export geometry prefetch", true);
+    createCheckBox("frame pacing", true);
+    createCheckBox("splice uncut", true);
+    createCheckBox("parallel check", true);
+    createCheckBox("check on load", true);
+#ifdef QT_DEBUG
+    createCheckBox("check after operations", true);
+#else
+    createCheckBox("check after operations", false);
+#endif
+    createCheckBox("cut face preview", true);
+    createCheckBox("system clipboard", true);
+    createCheckBox("batched triangle tests", true);
+    createCheckBox("tablet sample queue", true);
 
     createSpinBox("num sub", 0, 10, 2);
+    createSpinBox("geometry cache (MB)", 1, 65536, 512);
+    createSpinBox("subframe time quantum", 1, 60, 12);
+    createSpinBox("prefetched frames", 0, 100, 4);
+    createSpinBox("background cache (MB)", 1, 65536, 1024);
+    createSpinBox("playback cache (MB)", 1, 65536, 1024);
+    createSpinBox("playback cache resolution (%)", 10, 100, 100);
+    createSpinBox("tile cache (MB)", 1, 65536, 256);
+    createSpinBox("undo memory (MB)", 1, 65536, 512);
+    createSpinBox("export processes", 1, 64, 1);
     createDoubleSpinBox("ds", 0, 10, 2);
+    createDoubleSpinBox("adaptive samples tolerance", 0, 10, 0.1);
+    createDoubleSpinBox("bezier tolerance", 0.01, 10, 0.5);
+
+#ifdef VPAINT_TRACING
+    addSection("Tracing");
+
+    QCheckBox * tracing = createCheckBox("tracing", false);
+    connect(tracing, SIGNAL(toggled(bool)), this, SLOT(setTracingEnabled(bool)));
+
+    QPushButton * exportTrace = new QPushButton(tr("Export..."));
+    connect(exportTrace, SIGNAL(clicked()), this, SLOT(exportTrace()));
+    addWidget(exportTrace, "Chrome trace");
+#endif
 
     setLayout(layout_);
 }
 
+void DevSettings::setTracingEnabled(bool enabled)
+{
+    Trace::setEnabled(enabled);
+}
+
+void DevSettings::exportTrace()
+{
+    QString filename = QFileDialog::getSaveFileName(this, tr("Export Chrome Trace"));
+    if (filename.isEmpty())
+        return;
+
+    if(!filename.endsWith(".json"))
+        filename.append(".json");
+
+    if(!Trace::exportChromeTrace(filename))
+        QMessageBox::warning(this, tr("Error"), tr("File %1 not saved: couldn't write file").arg(filename));
+}
+
+template <typename T>
+std::atomic<T> * DevSettings::cachedValue_(const QString & name)
+{
+    QMutexLocker lock(&cachedValuesMutex());
+    std::atomic<T> *& value = cachedValues<T>()[name];
+    if(!value)
+        value = new std::atomic<T>(T());
+    return value;
+}
+
+template std::atomic<bool> * DevSettings::cachedValue_<bool>(const QString & name);
+template std::atomic<int> * DevSettings::cachedValue_<int>(const QString & name);
+template std::atomic<double> * DevSettings::cachedValue_<double>(const QString & name);
+
 bool DevSettings::getBool(const QString & name)
 {
     if(!s || !s->checkBoxes_.contains(name))
@@ -45,7 +180,7 @@ bool DevSettings::getBool(const QString & name)
         return false;
     }
     else
-        return s->checkBoxes_[name]->isChecked();
+        return cachedValue_<bool>(name)->load(std::memory_order_relaxed);
 }
 
 int DevSettings::getInt(const QString & name)
@@ -56,7 +191,7 @@ int DevSettings::getInt(const QString & name)
         return 0;
     }
     else
-        return s->spinBoxes_[name]->value();
+        return cachedValue_<int>(name)->load(std::memory_order_relaxed);
 }
 
 double DevSettings::getDouble(const QString & name)
@@ -67,7 +202,7 @@ double DevSettings::getDouble(const QString & name)
         return 0;
     }
     else
-        return s->doubleSpinBoxes_[name]->value();
+        return cachedValue_<double>(name)->load(std::memory_order_relaxed);
 }
 
 QSpinBox * DevSettings::createSpinBox(const QString & string, int min, int max, int value)
@@ -76,6 +211,10 @@ QSpinBox * DevSettings::createSpinBox(const QString & string, int min, int max,
     spinBox->setMinimum(min);
     spinBox->setMaximum(max);
     spinBox->setValue(value);
+    std::atomic<int> * cachedValue = cachedValue_<int>(string);
+    cachedValue->store(spinBox->value());
+    connect(spinBox, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged),
+            [cachedValue] (int v) { cachedValue->store(v); });
     connect(spinBox, SIGNAL(valueChanged(int)),
           this, SIGNAL(changed()));
 
@@ -92,6 +231,10 @@ QDoubleSpinBox * DevSettings::createDoubleSpinBox(const QString & string, double
     spinBox->setMaximum(max);
     spinBox->setValue(value);
     spinBox->setSingleStep(0.1);
+    std::atomic<double> * cachedValue = cachedValue_<double>(string);
+    cachedValue->store(spinBox->value());
+    connect(spinBox, static_cast<void (QDoubleSpinBox::*)(double)>(&QDoubleSpinBox::valueChanged),
+            [cachedValue] (double v) { cachedValue->store(v); });
     connect(spinBox, SIGNAL(valueChanged(double)),
           this, SIGNAL(changed()));
 
@@ -106,6 +249,10 @@ QCheckBox * DevSettings::createCheckBox(const QString & string, bool checked)
 {
     QCheckBox * checkBox = new QCheckBox();
     checkBox->setChecked(checked);
+    std::atomic<bool> * cachedValue = cachedValue_<bool>(string);
+    cachedValue->store(checked);
+    connect(checkBox, &QCheckBox::toggled,
+            [cachedValue] (bool b) { cachedValue->store(b); });
     connect(checkBox, SIGNAL(toggled(bool)),
           this, SIGNAL(changed()));
     
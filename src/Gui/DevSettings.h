@@ -22,7 +22,9 @@
 #include <QDoubleSpinBox>
 #include <QGridLayout>
 #include <QString>
-#include <QMap>
+#include <QHash>
+
+#include <atomic>
 
 
 class DevSettings : public QWidget
@@ -37,22 +39,56 @@ public:
     static DevSettings * instance()
         {return s;}
 
+    // Typed handles to settings, for hot paths and worker threads. Their
+    // values are cached, and updated whenever the widget changes, so reading
+    // a handle is a single atomic load instead of a string lookup followed
+    // by a widget call. They are typically function-local statics:
+    //
+    //     static const DevSettings::Bool drawEdgeOrientation("draw edge orientation");
+    //     if(drawEdgeOrientation) { ... }
+    //
+    // Handles may be created before the DevSettings widget, in which case
+    // they read false or 0 until it is.
+    template <typename T>
+    class Handle
+    {
+    public:
+        explicit Handle(const QString & name) : value_(cachedValue_<T>(name)) {}
+        T get() const { return value_->load(std::memory_order_relaxed); }
+        operator T() const { return get(); }
+
+    private:
+        const std::atomic<T> * value_;
+    };
+    typedef Handle<bool> Bool;
+    typedef Handle<int> Int;
+    typedef Handle<double> Double;
+
 signals:
     void changed();
 
+private slots:
+    // Tracing (see Trace.h)
+    void setTracingEnabled(bool enabled);
+    void exportTrace();
+
 private:
     static DevSettings *s;
 
+    // Cached values, never deallocated so that handles stay valid
+    template <typename T>
+    static std::atomic<T> * cachedValue_(const QString & name);
+
     // bool values
-    QMap<QString,QCheckBox*> checkBoxes_;
+    QHash<QString,QCheckBox*> checkBoxes_;
     QCheckBox * createCheckBox(const QString & string, bool checked);
 
     // int values
-    QMap<QString,QSpinBox*> spinBoxes_;
+    QHash<QString,QSpinBox*> spinBoxes_;
     QSpinBox * createSpinBox(const QString & string, int min, int max, int value);
 
     // double values
-    QMap<QString,QDoubleSpinBox*> doubleSpinBoxes_;
+    QHash<QString,QDoubleSpinBox*> doubleSpinBoxes_;
     QDoubleSpinBox * createDoubleSpinBox(const QString & string, double min, double max, double value);
 
     // layout
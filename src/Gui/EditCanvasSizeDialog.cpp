@@ -96,10 +96,13 @@ void EditCanvasSizeDialog::accept()
 
 void EditCanvasSizeDialog::reject()
 {
-    scene_->setTop(oldTop_);
-    scene_->setLeft(oldLeft_);
-    scene_->setWidth(oldWidth_);
-    scene_->setHeight(oldHeight_);
+    {
+        Scene::Transaction transaction(scene_);
+        scene_->setTop(oldTop_);
+        scene_->setLeft(oldLeft_);
+        scene_->setWidth(oldWidth_);
+        scene_->setHeight(oldHeight_);
+    }
 
     QDialog::reject();
 }
@@ -125,10 +128,13 @@ void EditCanvasSizeDialog::updateSceneFromDialog()
     {
         ignoreSceneChanged_ = true;
 
-        scene()->setTop(topSpinBox_->value());
-        scene()->setLeft(leftSpinBox_->value());
-        scene()->setWidth(widthSpinBox_->value());
-        scene()->setHeight(heightSpinBox_->value());
+        {
+            Scene::Transaction transaction(scene());
+            scene()->setTop(topSpinBox_->value());
+            scene()->setLeft(leftSpinBox_->value());
+            scene()->setWidth(widthSpinBox_->value());
+            scene()->setHeight(heightSpinBox_->value());
+        }
 
         ignoreSceneChanged_ = false;
     }
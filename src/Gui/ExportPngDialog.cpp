@@ -17,10 +17,12 @@
 #include <QDialogButtonBox>
 #include <QFormLayout>
 #include <QCheckBox>
+#include <QLineEdit>
 #include <QLabel>
 
 ExportPngDialog::ExportPngDialog(Scene * scene) :
     scene_(scene),
+    isVideoMode_(false),
     ignoreSceneChanged_(false),
     ignoreWidthHeightChanged_(false)
 {
@@ -71,6 +73,20 @@ ExportPngDialog::ExportPngDialog(Scene * scene) :
     useViewSettings_->setChecked(false);
     formLayoutPng->addRow(tr("Use View Settings"), useViewSettings_);
 
+    // Video Export options
+    QFormLayout * formLayoutVideo = new QFormLayout();
+    formLayoutVideo->setContentsMargins(0, 0, 0, 0);
+
+    videoEncoderLineEdit_ = new QLineEdit("ffmpeg");
+    formLayoutVideo->addRow(tr("Encoder"), videoEncoderLineEdit_);
+
+    videoEncoderOptionsLineEdit_ = new QLineEdit("-c:v libx264 -pix_fmt yuv420p -crf 18");
+    formLayoutVideo->addRow(tr("Encoder Options"), videoEncoderOptionsLineEdit_);
+
+    videoOptions_ = new QWidget();
+    videoOptions_->setLayout(formLayoutVideo);
+    videoOptions_->hide();
+
     // Export/Cancel dialog buttons
     QDialogButtonBox * buttonBox = new QDialogButtonBox(QDialogButtonBox::Cancel);
     buttonBox->addButton(tr("Export"), QDialogButtonBox::AcceptRole);
@@ -81,6 +97,7 @@ ExportPngDialog::ExportPngDialog(Scene * scene) :
     //layout->addLayout(formLayoutCanvas);
     //layout->addWidget(new QLabel(tr("<b>PNG Export Options</b>")));
     layout->addLayout(formLayoutPng);
+    layout->addWidget(videoOptions_);
     layout->addStretch();
     layout->addWidget(buttonBox);
     setLayout(layout);
@@ -144,7 +161,7 @@ bool ExportPngDialog::preserveAspectRatio() const
 
 bool ExportPngDialog::exportSequence() const
 {
-    return exportSequenceCheckBox_->isChecked();
+    return isVideoMode_ || exportSequenceCheckBox_->isChecked();
 }
 
 bool ExportPngDialog::useViewSettings() const
@@ -152,6 +169,29 @@ bool ExportPngDialog::useViewSettings() const
     return useViewSettings_->isChecked();
 }
 
+void ExportPngDialog::setVideoMode(bool isVideoMode)
+{
+    isVideoMode_ = isVideoMode;
+    setWindowTitle(isVideoMode ? tr("Export as Video") : tr("Export as PNG"));
+    exportSequenceCheckBox_->setEnabled(!isVideoMode);
+    videoOptions_->setVisible(isVideoMode);
+}
+
+bool ExportPngDialog::isVideoMode() const
+{
+    return isVideoMode_;
+}
+
+QString ExportPngDialog::videoEncoder() const
+{
+    return videoEncoderLineEdit_->text();
+}
+
+QString ExportPngDialog::videoEncoderOptions() const
+{
+    return videoEncoderOptionsLineEdit_->text();
+}
+
 void ExportPngDialog::setPngWidthForHeight_()
 {
     ignoreWidthHeightChanged_ = true; // prevent infinite recursion with pngWidthChanged()
@@ -12,6 +12,7 @@
 #include <QDialog>
 
 class QCheckBox;
+class QLineEdit;
 class QSpinBox;
 class QDoubleSpinBox;
 class Scene;
@@ -42,6 +43,13 @@ public:
     bool exportSequence() const;
     bool useViewSettings() const;
 
+    // In video mode, the frames are streamed to a video encoder instead of
+    // being written as PNG files (see VideoEncoder)
+    void setVideoMode(bool isVideoMode);
+    bool isVideoMode() const;
+    QString videoEncoder() const;
+    QString videoEncoderOptions() const;
+
 public slots:
     // Reimplements from QDialog
     void accept();
@@ -71,6 +79,11 @@ private:
     QCheckBox * exportSequenceCheckBox_;
     QCheckBox * useViewSettings_;
 
+    bool isVideoMode_;
+    QWidget * videoOptions_;
+    QLineEdit * videoEncoderLineEdit_;
+    QLineEdit * videoEncoderOptionsLineEdit_;
+
     double oldTop_;
     double oldLeft_;
     double oldWidth_;
@@ -0,0 +1,280 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#include "GLRenderer.h"
+
+#include <QOpenGLContext>
+#include <QMap>
+#include <QtDebug>
+
+#include <Eigen/Core>
+
+namespace
+{
+
+GLRenderer::Backend backend_ = GLRenderer::FixedFunction;
+bool isPicking_ = false;
+
+const char * VERTEX_SHADER =
+    "#version 130\n"
+    "in vec2 position;\n"
+    "uniform mat4 matrix;\n"
+    "void main()\n"
+    "{\n"
+    "    gl_Position = matrix * vec4(position, 0.0, 1.0);\n"
+    "}\n";
+
+const char * FRAGMENT_SHADER =
+    "#version 130\n"
+    "uniform vec4 color;\n"
+    "out vec4 fragColor;\n"
+    "void main()\n"
+    "{\n"
+    "    fragColor = color;\n"
+    "}\n";
+
+// Picking program: vertices and color are given with fixed-function calls,
+// and the color, whose bytes are exactly representable, is converted back to
+// the bytes given to glColor4ub() and packed as one unsigned integer
+const char * PICKING_VERTEX_SHADER =
+    "#version 130\n"
+    "flat out vec4 color;\n"
+    "void main()\n"
+    "{\n"
+    "    color = gl_Color;\n"
+    "    gl_Position = ftransform();\n"
+    "}\n";
+
+const char * PICKING_FRAGMENT_SHADER =
+    "#version 130\n"
+    "flat in vec4 color;\n"
+    "out uint value;\n"
+    "void main()\n"
+    "{\n"
+    "    uvec4 c = uvec4(color * 255.0 + 0.5);\n"
+    "    value = (c.r << 24u) | (c.g << 16u) | (c.b << 8u) | c.a;\n"
+    "}\n";
+
+GLuint compileShader(GLenum type, const char * source)
+{
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, 0);
+    glCompileShader(shader);
+    GLint isCompiled = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &isCompiled);
+    if (!isCompiled)
+    {
+        char log[1024];
+        glGetShaderInfoLog(shader, sizeof(log), 0, log);
+        qDebug() << "GLRenderer: failed to compile shader:" << log;
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+GLuint linkProgram(const char * vertexSource, const char * fragmentSource,
+                   const char * fragmentOutput)
+{
+    GLuint vertexShader = compileShader(GL_VERTEX_SHADER, vertexSource);
+    GLuint fragmentShader = compileShader(GL_FRAGMENT_SHADER, fragmentSource);
+    if (!vertexShader || !fragmentShader)
+    {
+        glDeleteShader(vertexShader);
+        glDeleteShader(fragmentShader);
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+    glBindAttribLocation(program, GLRenderer::POSITION_LOCATION, "position");
+    glBindFragDataLocation(program, 0, fragmentOutput);
+    glLinkProgram(program);
+    glDeleteShader(vertexShader); // flagged for deletion with the program
+    glDeleteShader(fragmentShader);
+    GLint isLinked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &isLinked);
+    if (!isLinked)
+    {
+        char log[1024];
+        glGetProgramInfoLog(program, sizeof(log), 0, log);
+        qDebug() << "GLRenderer: failed to link program:" << log;
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+GLuint linkFlatProgram()
+{
+    return linkProgram(VERTEX_SHADER, FRAGMENT_SHADER, "fragColor");
+}
+
+// Objects of a share group, created on first use
+struct Resources
+{
+    GLuint program;   // zero if it failed to link
+    GLint matrixLocation;
+    GLint colorLocation;
+    GLuint streamBuffers[2]; // vertices and indices
+    GLuint pickingProgram; // linked on first use, zero if it failed to link
+    bool isPickingProgramLinked;
+};
+
+Resources * currentResources()
+{
+    static QMap<QOpenGLContextGroup *, Resources> resources;
+    QOpenGLContextGroup * group = QOpenGLContextGroup::currentContextGroup();
+    if (!group)
+        return 0;
+
+    auto it = resources.find(group);
+    if (it == resources.end())
+    {
+        Resources r;
+        r.program = linkFlatProgram();
+        r.matrixLocation = r.program ? glGetUniformLocation(r.program, "matrix") : -1;
+        r.colorLocation = r.program ? glGetUniformLocation(r.program, "color") : -1;
+        glGenBuffers(2, r.streamBuffers);
+        r.pickingProgram = 0;
+        r.isPickingProgramLinked = false;
+        it = resources.insert(group, r);
+        QObject::connect(group, &QObject::destroyed, [group] ()
+        {
+            resources.remove(group);
+        });
+    }
+    return it->program ? &it.value() : 0;
+}
+
+// Vertex array objects are not shared: one per context. It is fully
+// respecified by each draw, so it doesn't matter what it was used for before
+GLuint currentVertexArray()
+{
+    static QMap<QOpenGLContext *, GLuint> vertexArrays;
+    QOpenGLContext * context = QOpenGLContext::currentContext();
+    auto it = vertexArrays.find(context);
+    if (it == vertexArrays.end())
+    {
+        GLuint vertexArray = 0;
+        glGenVertexArrays(1, &vertexArray);
+        it = vertexArrays.insert(context, vertexArray);
+        QObject::connect(context, &QObject::destroyed, [context] ()
+        {
+            vertexArrays.remove(context);
+        });
+    }
+    return it.value();
+}
+
+}
+
+void GLRenderer::setBackend(Backend backend)
+{
+    backend_ = backend;
+}
+
+GLRenderer::Backend GLRenderer::backend()
+{
+    return backend_;
+}
+
+bool GLRenderer::isShaderBackend()
+{
+    return backend_ == Shader && GLEW_VERSION_3_0;
+}
+
+bool GLRenderer::beginFlat()
+{
+    if (!isShaderBackend() || isPicking_)
+        return false;
+
+    Resources * r = currentResources();
+    if (!r)
+        return false;
+
+    Eigen::Matrix4f modelview, projection;
+    GLfloat color[4];
+    glGetFloatv(GL_MODELVIEW_MATRIX, modelview.data());
+    glGetFloatv(GL_PROJECTION_MATRIX, projection.data());
+    glGetFloatv(GL_CURRENT_COLOR, color);
+    Eigen::Matrix4f matrix = projection * modelview;
+
+    glUseProgram(r->program);
+    glUniformMatrix4fv(r->matrixLocation, 1, GL_FALSE, matrix.data());
+    glUniform4fv(r->colorLocation, 1, color);
+    glBindVertexArray(currentVertexArray());
+    glEnableVertexAttribArray(POSITION_LOCATION);
+    return true;
+}
+
+void GLRenderer::endFlat()
+{
+    glDisableVertexAttribArray(POSITION_LOCATION);
+    glBindVertexArray(0);
+    glUseProgram(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void GLRenderer::streamBuffer(GLenum target, const void * data, GLsizeiptr size)
+{
+    Resources * r = currentResources();
+    if (!r)
+        return;
+
+    // Respecifying the whole storage orphans the previous one, so that the
+    // driver doesn't wait until the draws using it are done
+    GLuint buffer = r->streamBuffers[target == GL_ELEMENT_ARRAY_BUFFER ? 1 : 0];
+    glBindBuffer(target, buffer);
+    glBufferData(target, size, data, GL_STREAM_DRAW);
+}
+
+GLuint GLRenderer::createFlatProgram()
+{
+    return linkFlatProgram();
+}
+
+bool GLRenderer::isPickingSupported()
+{
+    if (!GLEW_VERSION_3_0)
+        return false;
+
+    Resources * r = currentResources();
+    if (!r)
+        return false;
+
+    if (!r->isPickingProgramLinked)
+    {
+        r->pickingProgram = linkProgram(PICKING_VERTEX_SHADER, PICKING_FRAGMENT_SHADER, "value");
+        r->isPickingProgramLinked = true;
+    }
+    return r->pickingProgram != 0;
+}
+
+bool GLRenderer::beginPicking()
+{
+    if (!isPickingSupported())
+        return false;
+
+    glUseProgram(currentResources()->pickingProgram);
+    isPicking_ = true;
+    return true;
+}
+
+void GLRenderer::endPicking()
+{
+    glUseProgram(0);
+    isPicking_ = false;
+}
+
+bool GLRenderer::isPicking()
+{
+    return isPicking_;
+}
@@ -0,0 +1,82 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#ifndef GLRENDERER_H
+#define GLRENDERER_H
+
+// GLRenderer: selects, at startup, how the triangles of cells (fills, strokes,
+// topology and picking) are drawn.
+//
+// The fixed-function backend draws them with client-side vertex arrays and
+// the built-in matrices and color. The shader backend draws them with a GLSL
+// program which only uses what a core profile context supports: generic
+// vertex attributes, uniforms, buffer objects and a vertex array object, and
+// never client memory (non retained triangles are streamed through a buffer).
+//
+// Views are still QGLWidgets with a compatibility context, and everything
+// else (canvas, tools, 3D view) is still drawn with fixed-function calls. So
+// that both backends draw exactly the same frames and can be compared, the
+// shader backend reads the current matrices and color from the fixed-function
+// state when a draw begins, and passes them as uniforms.
+//
+// The backend is given on the command line (--renderer shader), and falls
+// back to fixed-function if OpenGL 3.0 is not supported. Must be used by the
+// GUI thread, with a context current, except createFlatProgram().
+// Integer picking (beginPicking()) is independent of the backend.
+
+#include "OpenGL.h"
+
+class GLRenderer
+{
+public:
+    enum Backend
+    {
+        FixedFunction,
+        Shader
+    };
+
+    // Set before any view is created
+    static void setBackend(Backend backend);
+    static Backend backend();
+
+    // Whether the shader backend is selected and supported by the current
+    // context
+    static bool isShaderBackend();
+
+    // Binds the flat color program, with the current fixed-function matrices
+    // and color, and its vertex array object. Returns false, binding nothing,
+    // if the shader backend is not used. Vertex buffers must be bound after
+    // this call, since the element array binding is part of the vertex array
+    // object. Vertices are 2D positions at attribute POSITION_LOCATION.
+    static bool beginFlat();
+    static void endFlat();
+    static const GLuint POSITION_LOCATION = 0;
+
+    // Uploads size bytes of data into a buffer reused by subsequent calls,
+    // and binds it to target (GL_ARRAY_BUFFER or GL_ELEMENT_ARRAY_BUFFER).
+    // Only valid between beginFlat() and endFlat()
+    static void streamBuffer(GLenum target, const void * data, GLsizeiptr size);
+
+    // Links a new flat color program in the current context, whatever the
+    // backend, e.g. for a context of another thread (see RenderThread).
+    // Its uniforms are "matrix" and "color". Returns zero on failure.
+    static GLuint createFlatProgram();
+
+    // Binds a program writing the current fixed-function color, as four
+    // bytes packed into one unsigned integer, to a GL_R32UI color buffer
+    // (integer picking, see Picking). Whatever the backend, vertices are
+    // then given with fixed-function calls: beginFlat() returns false until
+    // endPicking(). Returns false, binding nothing, if not supported, i.e.
+    // if OpenGL 3.0 is not supported or the program failed to link.
+    static bool isPickingSupported();
+    static bool beginPicking();
+    static void endPicking();
+    static bool isPicking();
+};
+
+#endif // GLRENDERER_H
@@ -10,8 +10,66 @@
 
 #include <QTransform>
 #include <QtDebug>
+#include <QOpenGLContext>
+#include <QMap>
+#include <QList>
+#include <QSet>
 #include "GLWidget.h"
 
+namespace
+{
+
+QMap<QOpenGLContextGroup *, QList<GLuint> > & orphanedBuffers()
+{
+    static QMap<QOpenGLContextGroup *, QList<GLuint> > res;
+    return res;
+}
+
+void watchGroupDestruction(QOpenGLContextGroup * group)
+{
+    static QSet<QOpenGLContextGroup *> watchedGroups;
+    if (!watchedGroups.contains(group))
+    {
+        watchedGroups << group;
+        QObject::connect(group, &QObject::destroyed, [group] ()
+        {
+            orphanedBuffers().remove(group);
+            watchedGroups.remove(group);
+        });
+    }
+}
+
+}
+
+void GLUtils::deleteBuffer(GLuint buffer, QOpenGLContextGroup * group)
+{
+    if (!buffer || !group)
+        return;
+
+    if (QOpenGLContextGroup::currentContextGroup() == group)
+    {
+        glDeleteBuffers(1, &buffer);
+    }
+    else
+    {
+        watchGroupDestruction(group);
+        orphanedBuffers()[group] << buffer;
+    }
+}
+
+void GLUtils::deleteOrphanedBuffers()
+{
+    QOpenGLContextGroup * group = QOpenGLContextGroup::currentContextGroup();
+    QMap<QOpenGLContextGroup *, QList<GLuint> > & orphans = orphanedBuffers();
+    auto it = orphans.find(group);
+    if (it != orphans.end())
+    {
+        for (GLuint buffer: it.value())
+            glDeleteBuffers(1, &buffer);
+        orphans.erase(it);
+    }
+}
+
 /*
 void GLUtils::UnitCircleZ()
 {
@@ -202,6 +260,18 @@ void GLUtils::multMatrix_QuadToQuad(const QPolygonF & quad1,
     glMultMatrixd(reinterpret_cast<GLdouble*>(mat));
 }
 
+void GLUtils::multMatrix(const Eigen::Affine2d & xf)
+{
+    // the OpenGL matrix, in column-major order
+    const Eigen::Matrix3d & m = xf.matrix();
+    GLdouble mat[16] = { m(0,0), m(1,0), 0, 0,
+                         m(0,1), m(1,1), 0, 0,
+                         0,      0,      1, 0,
+                         m(0,2), m(1,2), 0, 1 };
+
+    glMultMatrixd(mat);
+}
+
 void GLUtils::drawArrow(const Eigen::Vector2d & p, const Eigen::Vector2d & u)
 {
     Eigen::Vector2d v(-u[1],u[0]);
@@ -14,6 +14,9 @@
 #include <QRectF>
 
 #include <Eigen/Core>
+#include <Eigen/Geometry>
+
+class QOpenGLContextGroup;
 
 class GLUtils
 {
@@ -27,6 +30,7 @@ public:
                             const QRectF & rect2);
     static void multMatrix_QuadToQuad(const QPolygonF & quad1,
                             const QPolygonF & quad2);
+    static void multMatrix(const Eigen::Affine2d & xf);
 
     static void drawX(double x1, double y1, double z1, 
                 double x2, double y2, double z2, 
@@ -42,6 +46,16 @@ public:
                    double x4, double y4, double z4);
 
     static void drawArrow(const Eigen::Vector2d & p, const Eigen::Vector2d & u);
+
+    // Buffer objects can only be deleted while a context of their share group
+    // is current (all GLWidgets share the same group, see
+    // GLWidget::sharedContext()). deleteBuffer() deletes the buffer right away
+    // if this is the case, otherwise the deletion is deferred until
+    // deleteOrphanedBuffers() is called with such a context current. Buffers
+    // of destroyed share groups are simply forgotten, since they are gone
+    // with the group.
+    static void deleteBuffer(GLuint buffer, QOpenGLContextGroup * group);
+    static void deleteOrphanedBuffers();
     
 private:
     // drawing text
@@ -17,6 +17,7 @@
 #include <limits>
 #include <QApplication>
 #include "Global.h"
+#include "DevSettings.h"
 
 #define MIN_SIZE_DRAWING 5
 #define GLWIDGET_PI 3.1415926535897932
@@ -28,6 +29,7 @@ QGLFormat format_()
     // Enable multisampling (for antialiasing)
     QGLFormat res(QGL::SampleBuffers);
     res.setSamples(16);
+    res.setStencil(true); // see FaceCell::drawRaw()
     return res;
 
     // Note: the Qt doc says that by default, it uses the maximum
@@ -43,11 +45,22 @@ QGLFormat format_()
     // has to be called before the OpenGL context is created, I'm not sure
     // how I can achieve this, so the manual method is fine for now.
 }
+
+// Hidden widget whose context is shared by the contexts of all GLWidgets. It
+// is never destroyed, so that the share group, and all the resources it
+// holds, outlive any view, e.g. when splitting and unsplitting views.
+QGLWidget * shareWidget_()
+{
+    static QGLWidget * res = 0;
+    if (!res)
+        res = new QGLWidget(format_());
+    return res;
+}
 }
 
 GLWidget::GLWidget(QWidget *parent, bool isOnly2D) :
 
-    QGLWidget(format_(), parent),
+    QGLWidget(format_(), parent, shareWidget_()),
 
     isOnly2D_(isOnly2D),
     
@@ -90,7 +103,8 @@ GLWidget::GLWidget(QWidget *parent, bool isOnly2D) :
     fpstimer_(),
     fpstimerCount_(0),
 
-    mouse_tabletEventToMouseEvent_(QEvent::MouseButtonPress, QPoint(), Qt::LeftButton, Qt::NoButton, Qt::NoModifier)
+    mouse_tabletEventToMouseEvent_(QEvent::MouseButtonPress, QPoint(), Qt::LeftButton, Qt::NoButton, Qt::NoModifier),
+    isPMRActionPerformed_(false)
 {
     // To grab keyboard focus when user clicks
     setFocusPolicy(Qt::ClickFocus);
@@ -121,6 +135,7 @@ GLWidget::GLWidget(QWidget *parent, bool isOnly2D) :
 
 GLWidget::~GLWidget()
 {
+    setPMRActionPerformed_(false);
     delete settings_;
 }
 
@@ -177,6 +192,27 @@ bool GLWidget::isBusy()
     return mouse_ClicAction_ || mouse_PMRAction_;
 }
 
+QGLContext * GLWidget::sharedContext()
+{
+    return shareWidget_()->context();
+}
+
+int GLWidget::numPMRActionsPerformed_ = 0;
+
+bool GLWidget::isAnyPMRActionPerformed()
+{
+    return numPMRActionsPerformed_ > 0;
+}
+
+void GLWidget::setPMRActionPerformed_(bool b)
+{
+    if(isPMRActionPerformed_ != b)
+    {
+        isPMRActionPerformed_ = b;
+        numPMRActionsPerformed_ += b ? 1 : -1;
+    }
+}
+
 /*********************************************************
  *                     Actions 
  */
@@ -552,8 +588,11 @@ void GLWidget::delegateMousePress(QMouseEvent * event)
 
     // if we know it's a PMR action, generate the press event now
     if(!mouse_ClicAction_ && mouse_PMRAction_)
+    {
+        setPMRActionPerformed_(true);
         PMRPressEvent(mouse_PMRAction_,
                       mouse_PressEvent_XScene_, mouse_PressEvent_YScene_);
+    }
 }
 
 void GLWidget::mouseMoveEvent(QMouseEvent *event)
@@ -601,21 +640,19 @@ void GLWidget::delegateMouseMove(QMouseEvent *event)
         if(abs(mouse_PressEvent_X_ - mouse_Event_X_) > MIN_SIZE_DRAWING ||
            abs(mouse_PressEvent_Y_ - mouse_Event_Y_) > MIN_SIZE_DRAWING)
         {
+            setPMRActionPerformed_(true);
             PMRPressEvent(mouse_PMRAction_,
                       mouse_PressEvent_XScene_, mouse_PressEvent_YScene_);
             mouse_ClicAction_ = GLAction::None;
         }
     }
 
-    // calls the move event
+    // calls the move event. All samples are processed, even when they come
+    // faster than the widget can be drawn, since repaints requested meanwhile
+    // can be postponed (see isAnyPMRActionPerformed())
     if(!mouse_ClicAction_)
     {
-        qint64 idleTime = mouse_timerIdleTime_.elapsed();
-        if(idleTime>1)
-        {
-            PMRMoveEvent(mouse_PMRAction_, mouse_Event_XScene_, mouse_Event_YScene_);
-        }
-        mouse_timerIdleTime_.start();
+        PMRMoveEvent(mouse_PMRAction_, mouse_Event_XScene_, mouse_Event_YScene_);
     }
 }
 
@@ -671,6 +708,9 @@ void GLWidget::delegateMouseRelease(QMouseEvent *event)
         return;
 
       // Perform the corresponding actions
+    // Note: the PMR action is not considered performed anymore during the
+    // release event, so that its final result is drawn immediately
+    setPMRActionPerformed_(false);
     if(mouse_ClicAction_)
         ClicEvent(mouse_ClicAction_, mouse_Event_XScene_, mouse_Event_YScene_);
     else
@@ -683,6 +723,8 @@ void GLWidget::delegateMouseRelease(QMouseEvent *event)
 
 void GLWidget::tabletEvent(QTabletEvent * event)
 {
+    static const DevSettings::Bool tabletSampleQueue("tablet sample queue");
+
     // Set pressure
     mouse_tabletPressure_ = event->pressure();
 
@@ -690,9 +732,24 @@ void GLWidget::tabletEvent(QTabletEvent * event)
     if(event->type() == QEvent::TabletPress)
     {
         mouse_isTablet_ = true;
+        tabletSamples_.clear();
+
+        // Moves are queued, and all consumed, so Qt mustn't merge those
+        // received while a frame is drawn
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+        QCoreApplication::setAttribute(Qt::AA_CompressTabletEvents, !tabletSampleQueue);
+#endif
     }
     else if(event->type() == QEvent::TabletMove)
     {
+        // Queued as soon as received, with sub-pixel precision, see
+        // TabletSampleQueue
+        if(mouse_isTablet_ && tabletSampleQueue)
+        {
+            TabletSampleQueue::Sample sample = { event->posF().x(), event->posF().y(),
+                                                 event->pressure(), TabletSampleQueue::now() };
+            tabletSamples_.push(sample);
+        }
     }
     else if(event->type() == QEvent::TabletRelease)
     {
@@ -760,6 +817,11 @@ void GLWidget::leaveEvent(QEvent * /*event*/)
  *          Setting up of rendering and viewing options 
  */
 
+void GLWidget::initializeOffscreen()
+{
+    glInit();
+}
+
 void GLWidget::initializeGL()
 {
     // Initialize GLEW
@@ -1062,7 +1124,7 @@ void GLWidget::paintGL()
                  settings_->backgroundColor_g(),
                  settings_->backgroundColor_b(),
                  1);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 
     // Initialize the view and lighting
     setCameraPositionAndOrientation();
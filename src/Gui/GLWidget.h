@@ -38,6 +38,7 @@
 #include "GLWidget_Light.h"
 #include "GLWidget_Material.h"
 #include "GLWidget_Settings.h"
+#include "TabletSampleQueue.h"
 #include <QMouseEvent>
 #include <QElapsedTimer>
 
@@ -65,6 +66,17 @@ public:
 
     // Return if a mouse action is being performed
     bool isBusy();
+
+    // All GLWidgets share their OpenGL resources (textures, buffers, etc.),
+    // so that they are allocated and uploaded once, no matter how many views
+    // display them. Resources not specific to a view, e.g. background textures,
+    // should be managed with this context, which outlives all GLWidgets.
+    static QGLContext * sharedContext();
+
+    // Return if a press-move-release action is being performed in any
+    // GLWidget, e.g. sketching or sculpting. Derived classes may then
+    // postpone their repaints, see View::update()
+    static bool isAnyPMRActionPerformed();
     
     // Get or set the current camera
     GLWidget_Camera camera() const;
@@ -174,6 +186,10 @@ public:
     void zoomIn();
     void zoomOut();
 
+    // Initializes OpenGL without the widget being shown, e.g., to draw to
+    // offscreen images in batch mode
+    void initializeOffscreen();
+
 protected slots:
     // OpenGL drawing
     void initializeGL();
@@ -214,6 +230,9 @@ protected:
     double mouse_tabletPressure_;
     bool mouse_tabletPressJustReceived_;
     bool mouse_tabletReleaseJustReceived_;
+    // Tablet moves received during the PMR action in progress, and not yet
+    // consumed by it (see TabletSampleQueue)
+    TabletSampleQueue tabletSamples_;
     // The position when the mousePressEvent occured (in scene coords, only in 2D mode)
     double mouse_Event_XScene_;
     double mouse_Event_YScene_;
@@ -266,6 +285,11 @@ protected:
 private:
     friend class GLUtils;
     static GLWidget * currentGLWidget_;
+
+    // See isAnyPMRActionPerformed()
+    void setPMRActionPerformed_(bool b);
+    bool isPMRActionPerformed_;
+    static int numPMRActionsPerformed_;
     QMouseEvent mouse_tabletEventToMouseEvent_;
 public:
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
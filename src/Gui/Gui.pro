@@ -17,13 +17,19 @@
 TEMPLATE = app
 TARGET = VPaint
 CONFIG += qt c++11
-QT += opengl network
+QT += opengl network concurrent
 
 # App version
 MYVAR = 1.6
 VERSION = $$MYVAR
 DEFINES += APP_VERSION=\\\"$$VERSION\\\"
 
+# Store cached triangles in single precision (see Triangles.h)
+float_triangles: DEFINES += VPAINT_FLOAT_TRIANGLES
+
+# Record scoped zones, exported as Chrome traces (see Trace.h)
+tracing: DEFINES += VPAINT_TRACING
+
 # App resources
 RESOURCES += resources.qrc
 
@@ -62,6 +68,9 @@ win32: CONFIG += embed_manifest_exe
 # GLU
 unix:!macx: LIBS += -lGLU
 
+# zlib (on Windows, the one shipped with Qt is used)
+unix: LIBS += -lz
+
 
 ###############################################################################
 #                      SHIPPED EXTERNAL LIBRARIES
@@ -93,8 +102,11 @@ else:unix {
 HEADERS += MainWindow.h \
     SaveAndLoad.h \
     Picking.h \
+    PickingBuffer.h \
     Random.h \
     GLUtils.h \
+    GLRenderer.h \
+    RenderThread.h \
     GLWidget.h \
     GLWidget_Settings.h \
     GLWidget_Camera.h \
@@ -128,6 +140,7 @@ HEADERS += MainWindow.h \
     VectorAnimationComplex/VertexCell.h \
     VectorAnimationComplex/KeyVertex.h \
     VectorAnimationComplex/EdgeGeometry.h \
+    VectorAnimationComplex/BezierSpline.h \
     VectorAnimationComplex/CellList.h \
     VectorAnimationComplex/CellVisitor.h \
     VectorAnimationComplex/Operators.h \
@@ -137,14 +150,36 @@ HEADERS += MainWindow.h \
     VectorAnimationComplex/ProperPath.h \
     VectorAnimationComplex/CycleHelper.h \
     VectorAnimationComplex/ZOrderedCells.h \
+    VectorAnimationComplex/DrawList.h \
+    VectorAnimationComplex/Symbols.h \
+    VectorAnimationComplex/CellBuilder.h \
+    VectorAnimationComplex/BoundingBoxTree.h \
+    VectorAnimationComplex/SpatialIndex.h \
+    VectorAnimationComplex/TimeIndex.h \
+    VectorAnimationComplex/KeyTimeIndex.h \
+    VectorAnimationComplex/EvaluationContext.h \
+    VectorAnimationComplex/SelectionClosure.h \
+    VectorAnimationComplex/SelectionSummary.h \
+    VectorAnimationComplex/PlanarArrangement.h \
+    VectorAnimationComplex/CellTable.h \
+    VectorAnimationComplex/MemoryPool.h \
+    VectorAnimationComplex/ScratchArena.h \
+    VectorAnimationComplex/FlatCellSet.h \
+    VectorAnimationComplex/IncidenceList.h \
+    VectorAnimationComplex/GeometryCache.h \
+    VectorAnimationComplex/Triangulation.h \
+    VectorAnimationComplex/History.h \
     VectorAnimationComplex/EdgeSample.h \
     VectorAnimationComplex/Algorithms.h \
     VectorAnimationComplex/SmartKeyEdgeSet.h \
     OpenGL.h \
     VectorAnimationComplex/Triangles.h \
+    VectorAnimationComplex/StrokeBuffer.h \
+    VectorAnimationComplex/SketchBuffer.h \
     SelectionInfoWidget.h \
     VectorAnimationComplex/Cycle.h \
     VectorAnimationComplex/Path.h \
+    VectorAnimationComplex/PathSamplingCache.h \
     VectorAnimationComplex/AnimatedVertex.h \
     VectorAnimationComplex/AnimatedCycle.h \
     VectorAnimationComplex/CellLinkedList.h \
@@ -157,6 +192,12 @@ HEADERS += MainWindow.h \
     VectorAnimationComplex/CellObserver.h \
     Color.h \
     DevSettings.h \
+    RenderStats.h \
+    MemoryStats.h \
+    OperatorStats.h \
+    OperatorStatsWidget.h \
+    Clipboard.h \
+    TabletSampleQueue.h \
     Settings.h \
     SettingsDialog.h \
     VectorAnimationComplex/InbetweenCell.h \
@@ -167,6 +208,7 @@ HEADERS += MainWindow.h \
     VectorAnimationComplex/VAC.h \
     XmlStreamWriter.h \
     XmlStreamReader.h \
+    NumberParser.h \
     CssColor.h \
     TimeDef.h \
     EditCanvasSizeDialog.h \
@@ -174,15 +216,28 @@ HEADERS += MainWindow.h \
     AboutDialog.h \
     ViewMacOsX.h \
     Application.h \
+    Benchmark.h \
+    SessionRecorder.h \
+    RenderShards.h \
+    Trace.h \
     Background/Background.h \
     Background/BackgroundData.h \
     Background/BackgroundRenderer.h \
     Background/BackgroundWidget.h \
     Background/BackgroundUrlValidator.h \
+    Background/BackgroundFileIndex.h \
     IO/FileVersionConverter.h \
     IO/XmlStreamTraverser.h \
     IO/XmlStreamConverter.h \
+    IO/XmlStreamConverterDevice.h \
     IO/XmlStreamConverters/XmlStreamConverter_1_0_to_1_6.h \
+    IO/XmlStreamConverters/XmlStreamConverter_Binary.h \
+    IO/AutosaveJournal.h \
+    IO/PngStreamWriter.h \
+    IO/VideoEncoder.h \
+    IO/SvgStreamWriter.h \
+    IO/BinaryContainer.h \
+    IO/DocumentInfo.h \
     IO/FileVersionConverterDialog.h \
     UpdateCheckDialog.h \
     Version.h \
@@ -193,8 +248,11 @@ HEADERS += MainWindow.h \
 SOURCES += main.cpp \
     SaveAndLoad.cpp \
     Picking.cpp \
+    PickingBuffer.cpp \
     Random.cpp \
     GLUtils.cpp  \
+    GLRenderer.cpp \
+    RenderThread.cpp \
     GLWidget.cpp  \
     GLWidget_Settings.cpp \
     MainWindow.cpp \
@@ -221,6 +279,7 @@ SOURCES += main.cpp \
     VectorAnimationComplex/VertexCell.cpp \
     VectorAnimationComplex/KeyVertex.cpp \
     VectorAnimationComplex/EdgeGeometry.cpp \
+    VectorAnimationComplex/BezierSpline.cpp \
     VectorAnimationComplex/CellVisitor.cpp \
     VectorAnimationComplex/Operators.cpp \
     VectorAnimationComplex/Operator.cpp \
@@ -228,13 +287,33 @@ SOURCES += main.cpp \
     VectorAnimationComplex/ProperPath.cpp \
     VectorAnimationComplex/CycleHelper.cpp \
     VectorAnimationComplex/ZOrderedCells.cpp \
+    VectorAnimationComplex/DrawList.cpp \
+    VectorAnimationComplex/Symbols.cpp \
+    VectorAnimationComplex/CellBuilder.cpp \
+    VectorAnimationComplex/BoundingBoxTree.cpp \
+    VectorAnimationComplex/SpatialIndex.cpp \
+    VectorAnimationComplex/TimeIndex.cpp \
+    VectorAnimationComplex/KeyTimeIndex.cpp \
+    VectorAnimationComplex/EvaluationContext.cpp \
+    VectorAnimationComplex/SelectionClosure.cpp \
+    VectorAnimationComplex/SelectionSummary.cpp \
+    VectorAnimationComplex/PlanarArrangement.cpp \
+    VectorAnimationComplex/CellTable.cpp \
+    VectorAnimationComplex/MemoryPool.cpp \
+    VectorAnimationComplex/ScratchArena.cpp \
+    VectorAnimationComplex/GeometryCache.cpp \
+    VectorAnimationComplex/Triangulation.cpp \
+    VectorAnimationComplex/History.cpp \
     VectorAnimationComplex/EdgeSample.cpp \
     VectorAnimationComplex/Cycle.cpp \
     VectorAnimationComplex/Algorithms.cpp \
     VectorAnimationComplex/SmartKeyEdgeSet.cpp \
     VectorAnimationComplex/Triangles.cpp \
+    VectorAnimationComplex/StrokeBuffer.cpp \
+    VectorAnimationComplex/SketchBuffer.cpp \
     SelectionInfoWidget.cpp \
     VectorAnimationComplex/Path.cpp \
+    VectorAnimationComplex/PathSamplingCache.cpp \
     VectorAnimationComplex/AnimatedVertex.cpp \
     VectorAnimationComplex/AnimatedCycle.cpp \
     VectorAnimationComplex/CellLinkedList.cpp \
@@ -247,6 +326,12 @@ SOURCES += main.cpp \
     VectorAnimationComplex/CellObserver.cpp \
     Color.cpp \
     DevSettings.cpp \
+    RenderStats.cpp \
+    MemoryStats.cpp \
+    OperatorStats.cpp \
+    OperatorStatsWidget.cpp \
+    Clipboard.cpp \
+    TabletSampleQueue.cpp \
     Settings.cpp \
     SettingsDialog.cpp \
     VectorAnimationComplex/InbetweenCell.cpp \
@@ -257,6 +342,7 @@ SOURCES += main.cpp \
     VectorAnimationComplex/VAC.cpp \
     XmlStreamWriter.cpp \
     XmlStreamReader.cpp \
+    NumberParser.cpp \
     CssColor.cpp \
     TimeDef.cpp \
     EditCanvasSizeDialog.cpp \
@@ -264,15 +350,28 @@ SOURCES += main.cpp \
     AboutDialog.cpp \
     ViewMacOsX.cpp \
     Application.cpp \
+    Benchmark.cpp \
+    SessionRecorder.cpp \
+    RenderShards.cpp \
+    Trace.cpp \
     Background/Background.cpp \
     Background/BackgroundData.cpp \
     Background/BackgroundRenderer.cpp \
     Background/BackgroundWidget.cpp \
     Background/BackgroundUrlValidator.cpp \
+    Background/BackgroundFileIndex.cpp \
     IO/FileVersionConverter.cpp \
     IO/XmlStreamTraverser.cpp \
     IO/XmlStreamConverter.cpp \
+    IO/XmlStreamConverterDevice.cpp \
     IO/XmlStreamConverters/XmlStreamConverter_1_0_to_1_6.cpp \
+    IO/XmlStreamConverters/XmlStreamConverter_Binary.cpp \
+    IO/AutosaveJournal.cpp \
+    IO/PngStreamWriter.cpp \
+    IO/VideoEncoder.cpp \
+    IO/SvgStreamWriter.cpp \
+    IO/BinaryContainer.cpp \
+    IO/DocumentInfo.cpp \
     IO/FileVersionConverterDialog.cpp \
     UpdateCheckDialog.cpp \
     Version.cpp \
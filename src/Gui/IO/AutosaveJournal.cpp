@@ -0,0 +1,428 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#include "AutosaveJournal.h"
+
+#include "XmlStreamReader.h"
+#include "XmlStreamWriter.h"
+#include "Scene.h"
+#include "Timeline.h"
+#include "Background/Background.h"
+#include "VectorAnimationComplex/VAC.h"
+#include "VectorAnimationComplex/Cell.h"
+
+#include <QBuffer>
+#include <QFile>
+#include <QSaveFile>
+#include <QStringList>
+#include <QXmlStreamAttributes>
+
+namespace
+{
+
+// An XML element without children, e.g., a cell
+struct Element
+{
+    QString name;
+    QXmlStreamAttributes attributes;
+};
+
+Element readElement(XmlStreamReader & xml)
+{
+    Element res;
+    res.name = xml.name().toString();
+    res.attributes = xml.attributes();
+    xml.skipCurrentElement();
+    return res;
+}
+
+void writeElement(XmlStreamWriter & xml, const Element & element)
+{
+    xml.writeStartElement(element.name);
+    xml.writeAttributes(element.attributes);
+    xml.writeEndElement();
+}
+
+QList<int> readIds(const QStringRef & str)
+{
+    QList<int> res;
+    foreach(const QString & id, str.toString().split(' ', QString::SkipEmptyParts))
+        res << id.toInt();
+    return res;
+}
+
+QString idsToString(const QList<int> & ids)
+{
+    QString res;
+    for(int i=0; i<ids.size(); ++i)
+    {
+        if(i > 0)
+            res += " ";
+        res += QString().setNum(ids[i]);
+    }
+    return res;
+}
+
+// A symbol element and its instance elements
+struct SymbolElement
+{
+    Element symbol;
+    QList<Element> instances;
+};
+
+SymbolElement readSymbolElement(XmlStreamReader & xml)
+{
+    SymbolElement res;
+    res.symbol.name = xml.name().toString();
+    res.symbol.attributes = xml.attributes();
+    while(xml.readNextStartElement())
+        res.instances << readElement(xml);
+    return res;
+}
+
+void writeSymbolElement(XmlStreamWriter & xml, const SymbolElement & element)
+{
+    xml.writeStartElement(element.symbol.name);
+    xml.writeAttributes(element.symbol.attributes);
+    foreach(const Element & instance, element.instances)
+        writeElement(xml, instance);
+    xml.writeEndElement();
+}
+
+// Writes the playback, canvas, and background elements, as in VEC files
+void writeHeader(XmlStreamWriter & xml, const PlaybackSettings & playback, Scene * scene)
+{
+    xml.writeStartElement("playback");
+    playback.write(xml);
+    xml.writeEndElement();
+
+    xml.writeStartElement("canvas");
+    scene->writeCanvas(xml);
+    xml.writeEndElement();
+
+    xml.writeStartElement("background");
+    scene->background()->write(xml);
+    xml.writeEndElement();
+}
+
+// Document as a flat list of elements, which is all a delta modifies
+struct Document
+{
+    QXmlStreamAttributes vecAttributes;
+    Element playback;
+    Element canvas;
+    Element background;
+    QMap<int, Element> cells;
+    QList<int> zOrdering;
+    QList<SymbolElement> symbols; // written after the cells
+
+    bool read(QIODevice * device)
+    {
+        XmlStreamReader xml(device);
+        if(!xml.readNextStartElement() || xml.name() != "vec")
+            return false;
+
+        vecAttributes = xml.attributes();
+        bool hasLayer = false;
+        while(xml.readNextStartElement())
+        {
+            if(xml.name() == "playback")
+            {
+                playback = readElement(xml);
+            }
+            else if(xml.name() == "canvas")
+            {
+                canvas = readElement(xml);
+            }
+            else if(xml.name() == "layer" && !hasLayer)
+            {
+                // Only one layer is supported, see MainWindow::read()
+                hasLayer = true;
+                while(xml.readNextStartElement())
+                {
+                    if(xml.name() == "background")
+                    {
+                        background = readElement(xml);
+                    }
+                    else if(xml.name() == "objects")
+                    {
+                        while(xml.readNextStartElement())
+                        {
+                            if(xml.name() == "symbol")
+                            {
+                                symbols << readSymbolElement(xml);
+                                continue;
+                            }
+                            Element cell = readElement(xml);
+                            int id = cell.attributes.value("id").toInt();
+                            cells[id] = cell;
+                            zOrdering << id;
+                        }
+                    }
+                    else
+                    {
+                        xml.skipCurrentElement();
+                    }
+                }
+            }
+            else
+            {
+                xml.skipCurrentElement();
+            }
+        }
+        return !xml.hasError();
+    }
+
+    // Reads and applies one delta. Returns false, without modifying the
+    // document, if it is invalid or incomplete.
+    bool readDelta(XmlStreamReader & xml)
+    {
+        Document res = *this;
+        while(xml.readNextStartElement())
+        {
+            if(xml.name() == "playback")
+            {
+                res.playback = readElement(xml);
+            }
+            else if(xml.name() == "canvas")
+            {
+                res.canvas = readElement(xml);
+            }
+            else if(xml.name() == "background")
+            {
+                res.background = readElement(xml);
+            }
+            else if(xml.name() == "objects")
+            {
+                QXmlStreamAttributes attrs = xml.attributes();
+                foreach(int id, readIds(attrs.value("deleted")))
+                {
+                    res.cells.remove(id);
+                    res.zOrdering.removeAll(id);
+                }
+                while(xml.readNextStartElement())
+                {
+                    Element cell = readElement(xml);
+                    int id = cell.attributes.value("id").toInt();
+                    if(!res.cells.contains(id))
+                        res.zOrdering << id;
+                    res.cells[id] = cell;
+                }
+                if(attrs.hasAttribute("zordering"))
+                    res.zOrdering = readIds(attrs.value("zordering"));
+            }
+            else if(xml.name() == "symbols")
+            {
+                res.symbols.clear();
+                while(xml.readNextStartElement())
+                {
+                    if(xml.name() == "symbol")
+                        res.symbols << readSymbolElement(xml);
+                    else
+                        xml.skipCurrentElement();
+                }
+            }
+            else
+            {
+                xml.skipCurrentElement();
+            }
+        }
+        if(xml.hasError())
+            return false;
+
+        *this = res;
+        return true;
+    }
+
+    void write(XmlStreamWriter & xml) const
+    {
+        xml.writeStartDocument();
+        xml.writeComment(" Created with VPaint (http://www.vpaint.org) ");
+        xml.writeCharacters("\n\n");
+        xml.writeStartElement("vec");
+        xml.writeAttributes(vecAttributes);
+        writeElement(xml, playback);
+        writeElement(xml, canvas);
+        xml.writeStartElement("layer");
+        writeElement(xml, background);
+        xml.writeStartElement("objects");
+        foreach(int id, zOrdering)
+            if(cells.contains(id))
+                writeElement(xml, cells[id]);
+        foreach(const SymbolElement & symbol, symbols)
+            writeSymbolElement(xml, symbol);
+        xml.writeEndElement();
+        xml.writeEndElement();
+        xml.writeEndElement();
+        xml.writeEndDocument();
+    }
+};
+
+}
+
+AutosaveJournal::AutosaveJournal() :
+    stateVersions_(),
+    zOrderingVersion_(0),
+    symbolsVersion_(0),
+    header_(),
+    numDeltas_(0)
+{
+}
+
+void AutosaveJournal::reset(VectorAnimationComplex::VAC * vac)
+{
+    stateVersions_.clear();
+    foreach(VectorAnimationComplex::Cell * cell, vac->cells())
+        stateVersions_[cell->id()] = cell->stateVersion();
+    zOrderingVersion_ = vac->zOrdering().version();
+    symbolsVersion_ = vac->symbols().version();
+    header_.clear();
+    numDeltas_ = 0;
+}
+
+int AutosaveJournal::numDeltas() const
+{
+    return numDeltas_;
+}
+
+bool AutosaveJournal::append(const QString & journalPath, const PlaybackSettings & playback, Scene * scene)
+{
+    VectorAnimationComplex::VAC * vac = scene->vectorAnimationComplex();
+
+    // Find cells created, modified, or deleted since the last delta
+    QList<VectorAnimationComplex::Cell *> modifiedCells;
+    QMap<int, unsigned int> stateVersions;
+    const VectorAnimationComplex::ZOrderedCells & cells = vac->zOrdering();
+    for(auto it = cells.cbegin(); it != cells.cend(); ++it)
+    {
+        VectorAnimationComplex::Cell * cell = *it;
+        auto version = stateVersions_.find(cell->id());
+        if(version == stateVersions_.end() || version.value() != cell->stateVersion())
+            modifiedCells << cell;
+        stateVersions[cell->id()] = cell->stateVersion();
+    }
+    QList<int> deletedIds;
+    for(auto it = stateVersions_.cbegin(); it != stateVersions_.cend(); ++it)
+        if(!stateVersions.contains(it.key()))
+            deletedIds << it.key();
+    bool isZOrderingModified = (cells.version() != zOrderingVersion_);
+
+    // Symbols are small: they are written as a whole when modified, e.g.
+    // when an instance is added, which modifies no cell
+    const VectorAnimationComplex::Symbols & symbols = vac->symbols();
+    bool areSymbolsModified = (symbols.version() != symbolsVersion_);
+
+    // Other data is small: compare it as a whole
+    QByteArray header;
+    QBuffer headerBuffer(&header);
+    headerBuffer.open(QIODevice::WriteOnly);
+    {
+        XmlStreamWriter xml(&headerBuffer);
+        writeHeader(xml, playback, scene);
+    }
+    headerBuffer.close();
+
+    if(modifiedCells.isEmpty() && deletedIds.isEmpty() && !isZOrderingModified &&
+       !areSymbolsModified && header == header_)
+        return true;
+
+    // Write delta
+    QFile file(journalPath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append | QFile::Text))
+    {
+        qWarning("Couldn't write autosave journal.");
+        return false;
+    }
+    {
+        XmlStreamWriter xml(&file);
+        xml.writeStartElement("delta");
+        writeHeader(xml, playback, scene);
+        xml.writeStartElement("objects");
+        if(isZOrderingModified)
+        {
+            QList<int> zOrdering;
+            for(auto it = cells.cbegin(); it != cells.cend(); ++it)
+                zOrdering << (*it)->id();
+            xml.writeAttribute("zordering", idsToString(zOrdering));
+        }
+        if(!deletedIds.isEmpty())
+            xml.writeAttribute("deleted", idsToString(deletedIds));
+        foreach(VectorAnimationComplex::Cell * cell, modifiedCells)
+            cell->write(xml);
+        xml.writeEndElement();
+        if(areSymbolsModified)
+        {
+            xml.writeStartElement("symbols");
+            symbols.write(xml);
+            xml.writeEndElement();
+        }
+        xml.writeEndElement();
+        xml.writeCharacters("\n");
+    }
+    bool success = file.flush();
+    file.close();
+    if(!success)
+        return false;
+
+    stateVersions_ = stateVersions;
+    zOrderingVersion_ = cells.version();
+    symbolsVersion_ = symbols.version();
+    header_ = header;
+    ++numDeltas_;
+    return true;
+}
+
+bool AutosaveJournal::replay(const QString & documentPath, const QString & journalPath)
+{
+    // Read document
+    Document document;
+    QFile documentFile(documentPath);
+    if (!documentFile.open(QIODevice::ReadOnly | QIODevice::Text))
+        return false;
+    bool success = document.read(&documentFile);
+    documentFile.close();
+    if(!success)
+        return false;
+
+    // Read journal. Deltas are not enclosed in a root element.
+    QFile journalFile(journalPath);
+    if (!journalFile.open(QIODevice::ReadOnly | QIODevice::Text))
+        return false;
+    QByteArray journal = "<journal>" + journalFile.readAll() + "</journal>";
+    journalFile.close();
+
+    // Apply deltas, up to the first incomplete one
+    QBuffer journalBuffer(&journal);
+    journalBuffer.open(QIODevice::ReadOnly);
+    XmlStreamReader xml(&journalBuffer);
+    if(xml.readNextStartElement())
+    {
+        while(xml.readNextStartElement())
+        {
+            if(xml.name() == "delta")
+            {
+                if(!document.readDelta(xml))
+                    break;
+            }
+            else
+            {
+                xml.skipCurrentElement();
+            }
+        }
+    }
+
+    // Write document
+    QSaveFile file(documentPath);
+    if (!file.open(QIODevice::WriteOnly | QFile::Text))
+        return false;
+    {
+        XmlStreamWriter xmlOut(&file);
+        document.write(xmlOut);
+    }
+    return file.commit();
+}
@@ -0,0 +1,77 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#ifndef AUTOSAVEJOURNAL_H
+#define AUTOSAVEJOURNAL_H
+
+/// \class AutosaveJournal
+/// Append-only journal of the changes made to a document since its last full
+/// autosave, so that autosaving takes time proportional to the edits rather
+/// than to the document size.
+///
+/// The journal file is a sequence of deltas, each one written when append()
+/// is called:
+///
+///     <delta>
+///       <playback .../>
+///       <canvas .../>
+///       <background .../>
+///       <objects zordering="3 1 2" deleted="4 5">
+///         <edge id="2" .../>
+///       </objects>
+///       <symbols>
+///         <symbol cells="1 2 3">
+///           <instance .../>
+///         </symbol>
+///       </symbols>
+///     </delta>
+///
+/// where objects contains the cells created or modified since the previous
+/// delta, in the same format as in VEC files. The zordering and deleted
+/// attributes are omitted if unchanged or empty. The symbols element, which
+/// replaces all symbols and their instances, is omitted if they are
+/// unchanged. A delta interrupted by a crash is ignored by replay().
+
+#include <QMap>
+#include <QString>
+#include <QByteArray>
+
+class Scene;
+class PlaybackSettings;
+namespace VectorAnimationComplex { class VAC; }
+
+class AutosaveJournal
+{
+public:
+    AutosaveJournal();
+
+    // Forgets all changes: the next delta is relative to the current state
+    // of vac, which is the one written by a full autosave
+    void reset(VectorAnimationComplex::VAC * vac);
+
+    // Appends the changes made to the document since the last call to
+    // reset() or append() to the journal file, if any. Returns false if
+    // the file couldn't be written.
+    bool append(const QString & journalPath, const PlaybackSettings & playback, Scene * scene);
+
+    // Number of deltas appended since the last call to reset()
+    int numDeltas() const;
+
+    // Applies the deltas of the journal to the document, which is
+    // overwritten. Returns false if either file couldn't be read or written.
+    static bool replay(const QString & documentPath, const QString & journalPath);
+
+private:
+    QMap<int, unsigned int> stateVersions_;
+    unsigned int zOrderingVersion_;
+    unsigned int symbolsVersion_;
+    QByteArray header_;
+    int numDeltas_;
+};
+
+#endif // AUTOSAVEJOURNAL_H
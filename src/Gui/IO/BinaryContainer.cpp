@@ -0,0 +1,367 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#include "BinaryContainer.h"
+
+#include <QFile>
+#include <QtEndian>
+#include <QtConcurrentMap>
+
+#include <cstring>
+#include <vector>
+
+namespace
+{
+
+const char MAGIC[4] = {'V', 'E', 'C', 'B'};
+const quint32 FORMAT_VERSION = 1;
+const quint32 COMPRESSED_FORMAT_VERSION = 2;
+
+// Uncompressed size of chunks, and zlib compression level: compression is
+// fast, and the ratio barely improves with higher levels on sample data
+const int CHUNK_SIZE = 1 << 20;
+const int COMPRESSION_LEVEL = 1;
+
+enum Stream
+{
+    XmlStream = 0,
+    BlocksStream = 1,
+    NumStreams
+};
+
+struct Chunk
+{
+    quint32 stream;
+    quint64 size;
+    QByteArray data;       // uncompressed
+    QByteArray compressed; // as returned by qCompress()
+};
+
+bool readUInt32(QIODevice * device, quint32 & x)
+{
+    uchar data[4];
+    if (device->read(reinterpret_cast<char*>(data), 4) != 4)
+        return false;
+    x = qFromLittleEndian<quint32>(data);
+    return true;
+}
+
+bool readUInt64(QIODevice * device, quint64 & x)
+{
+    uchar data[8];
+    if (device->read(reinterpret_cast<char*>(data), 8) != 8)
+        return false;
+    x = qFromLittleEndian<quint64>(data);
+    return true;
+}
+
+bool writeUInt32(QIODevice * device, quint32 x)
+{
+    uchar data[4];
+    qToLittleEndian<quint32>(x, data);
+    return device->write(reinterpret_cast<char*>(data), 4) == 4;
+}
+
+bool writeUInt64(QIODevice * device, quint64 x)
+{
+    uchar data[8];
+    qToLittleEndian<quint64>(x, data);
+    return device->write(reinterpret_cast<char*>(data), 8) == 8;
+}
+
+bool readBytes(QIODevice * device, quint64 size, QByteArray & bytes)
+{
+    if (size > quint64(device->bytesAvailable()))
+        return false;
+    bytes = device->read(qint64(size));
+    return quint64(bytes.size()) == size;
+}
+
+// Reads the chunks of a compressed container, after its version
+bool readCompressed(QIODevice * device, QByteArray & xml, QByteArray & blocks)
+{
+    if (device->isSequential())
+        return false;
+
+    // Index
+    quint32 numChunks;
+    quint64 indexOffset;
+    qint64 end = device->size();
+    if (end < 20 ||
+        !device->seek(end - 12) ||
+        !readUInt32(device, numChunks) ||
+        !readUInt64(device, indexOffset) ||
+        indexOffset < 8 || indexOffset > quint64(end - 12) ||
+        quint64(numChunks) * 20 != quint64(end - 12) - indexOffset ||
+        !device->seek(qint64(indexOffset)))
+    {
+        return false;
+    }
+    std::vector<Chunk> chunks(numChunks);
+    quint64 compressedSizes = 0;
+    quint64 sizes[NumStreams] = {0, 0};
+    for (Chunk & chunk: chunks)
+    {
+        quint64 compressedSize;
+        if (!readUInt32(device, chunk.stream) ||
+            chunk.stream >= NumStreams ||
+            !readUInt64(device, chunk.size) ||
+            !readUInt64(device, compressedSize) ||
+            compressedSize > indexOffset)
+        {
+            return false;
+        }
+        compressedSizes += compressedSize;
+        sizes[chunk.stream] += chunk.size;
+        chunk.compressed.resize(int(compressedSize));
+    }
+
+    // Compressed chunks, right after the version
+    if (compressedSizes != indexOffset - 8 || !device->seek(8))
+        return false;
+    for (Chunk & chunk: chunks)
+    {
+        qint64 size = chunk.compressed.size();
+        if (device->read(chunk.compressed.data(), size) != size)
+            return false;
+    }
+
+    // Decompress in parallel, then concatenate each stream
+    QtConcurrent::blockingMap(chunks, [](Chunk & chunk) {
+        chunk.data = qUncompress(chunk.compressed);
+        chunk.compressed.clear();
+    });
+    QByteArray * streams[NumStreams] = {&xml, &blocks};
+    for (int i=0; i<NumStreams; ++i)
+    {
+        streams[i]->clear();
+        streams[i]->reserve(int(sizes[i]));
+    }
+    for (const Chunk & chunk: chunks)
+    {
+        if (quint64(chunk.data.size()) != chunk.size)
+            return false;
+        streams[chunk.stream]->append(chunk.data);
+    }
+    return true;
+}
+
+bool writeCompressed(QIODevice * device, const QByteArray & xml, const QByteArray & blocks)
+{
+    // Split each stream into chunks, and compress them in parallel
+    std::vector<Chunk> chunks;
+    const QByteArray * streams[NumStreams] = {&xml, &blocks};
+    for (int i=0; i<NumStreams; ++i)
+    {
+        const QByteArray & stream = *streams[i];
+        for (int begin=0; begin<stream.size(); begin+=CHUNK_SIZE)
+        {
+            Chunk chunk;
+            chunk.stream = quint32(i);
+            chunk.data = QByteArray::fromRawData(stream.constData() + begin,
+                                                 qMin(CHUNK_SIZE, stream.size() - begin));
+            chunk.size = quint64(chunk.data.size());
+            chunks.push_back(chunk);
+        }
+    }
+    QtConcurrent::blockingMap(chunks, [](Chunk & chunk) {
+        chunk.compressed = qCompress(chunk.data, COMPRESSION_LEVEL);
+    });
+
+    // Write chunks, then their index
+    quint64 indexOffset = 8;
+    for (const Chunk & chunk: chunks)
+    {
+        if (device->write(chunk.compressed) != chunk.compressed.size())
+            return false;
+        indexOffset += quint64(chunk.compressed.size());
+    }
+    for (const Chunk & chunk: chunks)
+    {
+        if (!writeUInt32(device, chunk.stream) ||
+            !writeUInt64(device, chunk.size) ||
+            !writeUInt64(device, quint64(chunk.compressed.size())))
+        {
+            return false;
+        }
+    }
+    return writeUInt32(device, quint32(chunks.size())) &&
+           writeUInt64(device, indexOffset);
+}
+
+}
+
+namespace BinaryContainer
+{
+
+bool isBinary(const QString & filePath)
+{
+    QFile file(filePath);
+    if (!file.open(QFile::ReadOnly))
+        return false;
+    QByteArray magic = file.read(4);
+    file.close();
+    return magic == QByteArray(MAGIC, 4);
+}
+
+bool isBinaryFileName(const QString & filePath)
+{
+    return filePath.endsWith(".vecb") || isCompressedFileName(filePath);
+}
+
+bool isCompressedFileName(const QString & filePath)
+{
+    return filePath.endsWith(".vecz");
+}
+
+bool read(QIODevice * device, QByteArray & xml, QByteArray & blocks)
+{
+    quint32 version;
+    quint64 xmlSize, blocksSize;
+    if (device->read(4) != QByteArray(MAGIC, 4) ||
+        !readUInt32(device, version))
+    {
+        return false;
+    }
+    if (version == COMPRESSED_FORMAT_VERSION)
+        return readCompressed(device, xml, blocks);
+    return version <= FORMAT_VERSION &&
+           readUInt64(device, xmlSize) &&
+           readBytes(device, xmlSize, xml) &&
+           readUInt64(device, blocksSize) &&
+           readBytes(device, blocksSize, blocks);
+}
+
+bool readXmlBeginning(QIODevice * device, QByteArray & xml)
+{
+    quint32 version;
+    if (device->read(4) != QByteArray(MAGIC, 4) ||
+        !readUInt32(device, version))
+    {
+        return false;
+    }
+
+    // Uncompressed: the XML document is right after its size
+    if (version != COMPRESSED_FORMAT_VERSION)
+    {
+        quint64 xmlSize;
+        return version <= FORMAT_VERSION &&
+               readUInt64(device, xmlSize) &&
+               readBytes(device, qMin(xmlSize, quint64(CHUNK_SIZE)), xml);
+    }
+
+    // Compressed: the first chunk, right after the version, is the first
+    // chunk of the XML document since it is written first
+    quint32 numChunks, stream;
+    quint64 indexOffset, size, compressedSize;
+    qint64 end = device->size();
+    if (device->isSequential() ||
+        end < 20 ||
+        !device->seek(end - 12) ||
+        !readUInt32(device, numChunks) ||
+        !readUInt64(device, indexOffset) ||
+        numChunks == 0 ||
+        indexOffset < 8 || indexOffset > quint64(end - 12) ||
+        !device->seek(qint64(indexOffset)) ||
+        !readUInt32(device, stream) ||
+        stream != XmlStream ||
+        !readUInt64(device, size) ||
+        !readUInt64(device, compressedSize) ||
+        compressedSize > indexOffset - 8 ||
+        !device->seek(8))
+    {
+        return false;
+    }
+    QByteArray compressed;
+    if (!readBytes(device, compressedSize, compressed))
+        return false;
+    xml = qUncompress(compressed);
+    return quint64(xml.size()) == size;
+}
+
+bool write(QIODevice * device, const QByteArray & xml, const QByteArray & blocks, bool isCompressed)
+{
+    if (isCompressed)
+    {
+        return device->write(MAGIC, 4) == 4 &&
+               writeUInt32(device, COMPRESSED_FORMAT_VERSION) &&
+               writeCompressed(device, xml, blocks);
+    }
+
+    return device->write(MAGIC, 4) == 4 &&
+           writeUInt32(device, FORMAT_VERSION) &&
+           writeUInt64(device, xml.size()) &&
+           device->write(xml) == xml.size() &&
+           writeUInt64(device, blocks.size()) &&
+           device->write(blocks) == blocks.size();
+}
+
+bool map(QFile * file, QByteArray & xml, QByteArray & blocks)
+{
+    // Compressed data must be decompressed anyway
+    qint64 size = file->size();
+    uchar * data = size >= 16 ? file->map(0, size) : 0;
+    if (!data || qFromLittleEndian<quint32>(data + 4) == COMPRESSED_FORMAT_VERSION)
+    {
+        if (data)
+            file->unmap(data);
+        return file->seek(0) && read(file, xml, blocks);
+    }
+
+    // Same checks as read()
+    if (std::memcmp(data, MAGIC, 4) != 0 ||
+        qFromLittleEndian<quint32>(data + 4) > FORMAT_VERSION)
+    {
+        return false;
+    }
+    quint64 xmlSize = qFromLittleEndian<quint64>(data + 8);
+    if (xmlSize > quint64(size - 16) || quint64(size - 16) - xmlSize < 8)
+        return false;
+    quint64 blocksOffset = 16 + xmlSize + 8;
+    quint64 blocksSize = qFromLittleEndian<quint64>(data + 16 + xmlSize);
+    if (blocksSize > quint64(size) - blocksOffset)
+        return false;
+
+    const char * bytes = reinterpret_cast<const char*>(data);
+    xml = QByteArray::fromRawData(bytes + 16, int(xmlSize));
+    blocks = QByteArray::fromRawData(bytes + blocksOffset, int(blocksSize));
+    return true;
+}
+
+qint64 appendDoubles(QByteArray & blocks, const QVector<double> & data)
+{
+    qint64 offset = blocks.size() / 8;
+    int begin = blocks.size();
+    blocks.resize(begin + 8 * data.size());
+    uchar * out = reinterpret_cast<uchar*>(blocks.data()) + begin;
+    for (int i=0; i<data.size(); ++i)
+    {
+        quint64 bits;
+        std::memcpy(&bits, &data[i], 8);
+        qToLittleEndian<quint64>(bits, out + 8*i);
+    }
+    return offset;
+}
+
+bool readDoubles(const QByteArray & blocks, qint64 offset, qint64 count, QVector<double> & data)
+{
+    const qint64 numDoubles = blocks.size() / 8;
+    if (offset < 0 || count < 0 || offset > numDoubles || count > numDoubles - offset)
+        return false;
+
+    data.resize(count);
+    const uchar * in = reinterpret_cast<const uchar*>(blocks.constData()) + 8*offset;
+    for (int i=0; i<count; ++i)
+    {
+        quint64 bits = qFromLittleEndian<quint64>(in + 8*i);
+        std::memcpy(&data[i], &bits, 8);
+    }
+    return true;
+}
+
+}
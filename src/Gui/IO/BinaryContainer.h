@@ -0,0 +1,96 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#ifndef BINARYCONTAINER_H
+#define BINARYCONTAINER_H
+
+/// Binary VEC files (*.vecb) store the same XML document as VEC files, except
+/// that large numeric data, such as edge samples, is stored in binary blocks
+/// referenced from the XML, instead of as text. Layout:
+///
+///     "VECB"                       4 bytes (magic)
+///     format version               uint32
+///     XML size                     uint64
+///     XML document                 UTF-8
+///     blocks size                  uint64
+///     blocks                       float64 arrays
+///
+/// Compressed binary VEC files (*.vecz) store the same XML document and
+/// blocks, split into chunks compressed independently, so that they can be
+/// decompressed in parallel. The index of the chunks is at the end, so that
+/// they can be written as they are compressed. Layout:
+///
+///     "VECB"                       4 bytes (magic)
+///     format version               uint32 (2)
+///     chunks                       zlib streams, see qCompress()
+///     index, for each chunk:
+///         stream                   uint32 (0: XML document, 1: blocks)
+///         uncompressed size        uint64
+///         compressed size          uint64
+///     number of chunks             uint32
+///     index offset                 uint64
+///
+/// The chunks of each stream are in order. Uncompressed files are still
+/// written in format version 1, so that older versions can read them.
+///
+/// All integers and floats are little-endian. In the XML, edge curves are
+///
+///     curve="xywblock(offset count)"
+///
+/// where offset is the index of the first float64 in blocks, and count is the
+/// number of float64, in the same order as in curve="xywdense(...)".
+///
+/// See XmlStreamWriter::setBinaryBlocks() and XmlStreamReader::setBinaryBlocks()
+/// to write or read such an XML document.
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+class QIODevice;
+class QFile;
+
+namespace BinaryContainer
+{
+
+// Returns whether the file is a binary VEC file, compressed or not
+bool isBinary(const QString & filePath);
+
+// Returns whether a file of the given name is to be written as a binary
+// VEC file (*.vecb or *.vecz), and if so whether compressed (*.vecz)
+bool isBinaryFileName(const QString & filePath);
+bool isCompressedFileName(const QString & filePath);
+
+// Read or write a whole container. Returns false on failure. Compressed
+// containers can only be read from random-access devices.
+bool read(QIODevice * device, QByteArray & xml, QByteArray & blocks);
+bool write(QIODevice * device, const QByteArray & xml, const QByteArray & blocks,
+           bool isCompressed = false);
+
+// Reads only the beginning of the XML document of a container: its first
+// chunk if compressed, or its first megabyte otherwise, e.g., to read the
+// info of a document (see DocumentInfo). Returns false on failure.
+bool readXmlBeginning(QIODevice * device, QByteArray & xml);
+
+// Same as read(), except that for uncompressed containers, the file is
+// mapped in memory, and xml and blocks point to the mapped data instead of
+// a copy of it (see QByteArray::fromRawData(), modifying them copies them
+// first). Nothing is read until used, and pages are shared with other
+// processes mapping the same file. They are only valid until the file is
+// closed. The file must be open for reading.
+bool map(QFile * file, QByteArray & xml, QByteArray & blocks);
+
+// Append data to blocks. Returns its offset.
+qint64 appendDoubles(QByteArray & blocks, const QVector<double> & data);
+
+// Read count float64 at offset. Returns false if out of bounds.
+bool readDoubles(const QByteArray & blocks, qint64 offset, qint64 count, QVector<double> & data);
+
+}
+
+#endif // BINARYCONTAINER_H
@@ -0,0 +1,221 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#include "DocumentInfo.h"
+
+#include "BinaryContainer.h"
+#include "XmlStreamReader.h"
+#include "XmlStreamWriter.h"
+#include "Scene.h"
+#include "Timeline.h"
+#include "VectorAnimationComplex/VAC.h"
+#include "VectorAnimationComplex/Cell.h"
+
+#include <QBuffer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+
+namespace
+{
+
+// Order of the cell counts in the cells attribute
+const int KINDS[] = {
+    VectorAnimationComplex::KeyVertexKind,
+    VectorAnimationComplex::KeyEdgeKind,
+    VectorAnimationComplex::KeyFaceKind,
+    VectorAnimationComplex::InbetweenVertexKind,
+    VectorAnimationComplex::InbetweenEdgeKind,
+    VectorAnimationComplex::InbetweenFaceKind
+};
+
+}
+
+DocumentInfo::DocumentInfo() :
+    isValid_(false),
+    firstFrame_(0),
+    lastFrame_(0),
+    fps_(0),
+    canvasLeft_(0),
+    canvasTop_(0),
+    canvasWidth_(0),
+    canvasHeight_(0)
+{
+    for (int i=0; i<NUM_KINDS; ++i)
+        numCells_[i] = 0;
+}
+
+DocumentInfo::DocumentInfo(const PlaybackSettings & playback, Scene * scene,
+                           const QImage & preview) :
+    isValid_(true),
+    firstFrame_(playback.firstFrame()),
+    lastFrame_(playback.lastFrame()),
+    fps_(playback.fps()),
+    canvasLeft_(scene->left()),
+    canvasTop_(scene->top()),
+    canvasWidth_(scene->width()),
+    canvasHeight_(scene->height()),
+    preview_(preview)
+{
+    VectorAnimationComplex::VAC * vac = scene->vectorAnimationComplex();
+    for (int i=0; i<NUM_KINDS; ++i)
+        numCells_[i] = vac ? vac->numCells(KINDS[i]) : 0;
+}
+
+int DocumentInfo::numCells(int kind) const
+{
+    for (int i=0; i<NUM_KINDS; ++i)
+        if (KINDS[i] == kind)
+            return numCells_[i];
+    return 0;
+}
+
+void DocumentInfo::write(XmlStreamWriter & xml) const
+{
+    QStringList cells;
+    for (int i=0; i<NUM_KINDS; ++i)
+        cells << QString().setNum(numCells_[i]);
+
+    xml.writeAttribute("framerange", QString().setNum(firstFrame_) + " " + QString().setNum(lastFrame_));
+    xml.writeAttribute("fps", QString().setNum(fps_));
+    xml.writeAttribute("canvas", QString().setNum(canvasLeft_) + " " + QString().setNum(canvasTop_) + " " +
+                                 QString().setNum(canvasWidth_) + " " + QString().setNum(canvasHeight_));
+    xml.writeAttribute("cells", cells.join(" "));
+
+    if (!preview_.isNull())
+    {
+        QByteArray png;
+        QBuffer buffer(&png);
+        buffer.open(QIODevice::WriteOnly);
+        preview_.save(&buffer, "PNG");
+        xml.writeTextElement("preview", QString::fromLatin1(png.toBase64()));
+    }
+}
+
+void DocumentInfo::read(XmlStreamReader & xml)
+{
+    *this = DocumentInfo();
+
+    if (xml.attributes().hasAttribute("framerange"))
+    {
+        QStringList list = xml.attributes().value("framerange").toString().split(" ");
+        if (list.size() == 2)
+        {
+            firstFrame_ = list[0].toInt();
+            lastFrame_ = list[1].toInt();
+        }
+    }
+    if (xml.attributes().hasAttribute("fps"))
+        fps_ = xml.attributes().value("fps").toInt();
+    if (xml.attributes().hasAttribute("canvas"))
+    {
+        QStringList list = xml.attributes().value("canvas").toString().split(" ");
+        if (list.size() == 4)
+        {
+            canvasLeft_ = list[0].toDouble();
+            canvasTop_ = list[1].toDouble();
+            canvasWidth_ = list[2].toDouble();
+            canvasHeight_ = list[3].toDouble();
+        }
+    }
+    if (xml.attributes().hasAttribute("cells"))
+    {
+        QStringList list = xml.attributes().value("cells").toString().split(" ");
+        for (int i=0; i<NUM_KINDS && i<list.size(); ++i)
+            numCells_[i] = list[i].toInt();
+    }
+
+    while (xml.readNextStartElement())
+    {
+        if (xml.name() == "preview")
+        {
+            QByteArray png = QByteArray::fromBase64(xml.readElementText().toLatin1());
+            preview_ = QImage::fromData(png, "PNG");
+        }
+        else
+        {
+            xml.skipCurrentElement();
+        }
+    }
+
+    isValid_ = !xml.hasError();
+}
+
+bool DocumentInfo::readFile(const QString & filePath)
+{
+    *this = DocumentInfo();
+
+    // Text files are read by the XML reader as it needs, binary files are
+    // only partially decompressed
+    bool isBinary = BinaryContainer::isBinary(filePath);
+    QFile file(filePath);
+    if (!file.open(isBinary ? QIODevice::ReadOnly : QIODevice::ReadOnly | QIODevice::Text))
+        return false;
+    QByteArray xmlData;
+    QBuffer buffer(&xmlData);
+    QIODevice * device = &file;
+    if (isBinary)
+    {
+        if (!BinaryContainer::readXmlBeginning(&file, xmlData))
+            return false;
+        buffer.open(QIODevice::ReadOnly);
+        device = &buffer;
+    }
+
+    // The info is the first child of the root element, and nothing is read
+    // after it
+    XmlStreamReader xml(device);
+    if (!xml.readNextStartElement() || xml.name() != "vec" ||
+        !xml.readNextStartElement() || xml.name() != "info")
+    {
+        return false;
+    }
+    read(xml);
+
+    return isValid_;
+}
+
+bool DocumentInfo::print(const QStringList & filePaths)
+{
+    const char * cellNames[NUM_KINDS] = {
+        "keyvertices", "keyedges", "keyfaces",
+        "inbetweenvertices", "inbetweenedges", "inbetweenfaces"
+    };
+
+    bool success = true;
+    QTextStream out(stdout);
+    for (const QString & filePath: filePaths)
+    {
+        QJsonObject json;
+        json["path"] = filePath;
+        DocumentInfo info;
+        if (info.readFile(filePath))
+        {
+            json["framerange"] = QJsonArray({info.firstFrame_, info.lastFrame_});
+            json["fps"] = info.fps_;
+            json["canvas"] = QJsonArray({info.canvasLeft_, info.canvasTop_,
+                                         info.canvasWidth_, info.canvasHeight_});
+            QJsonObject cells;
+            for (int i=0; i<NUM_KINDS; ++i)
+                cells[cellNames[i]] = info.numCells_[i];
+            json["cells"] = cells;
+            json["preview"] = !info.preview_.isNull();
+        }
+        else
+        {
+            json["error"] = QString("no info");
+            success = false;
+        }
+        out << QJsonDocument(json).toJson(QJsonDocument::Compact) << "\n";
+    }
+    out.flush();
+
+    return success;
+}
@@ -0,0 +1,99 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#ifndef DOCUMENTINFO_H
+#define DOCUMENTINFO_H
+
+/// \class DocumentInfo
+/// Summary of a VEC document, written as the first child of its root
+/// element, so that it can be read without parsing the rest of the file,
+/// e.g., to list a directory of documents:
+///
+///     <vec version="1.6">
+///       <info framerange="0 47" fps="24" canvas="0 0 1280 720"
+///             cells="12 10 3 4 5 1">
+///         <preview>iVBORw0KGgo...</preview>
+///       </info>
+///       <playback .../>
+///       ...
+///
+/// where cells are the numbers of key vertices, key edges, key faces,
+/// inbetween vertices, inbetween edges and inbetween faces, and preview is
+/// a small PNG image of the canvas, encoded in base64. The preview is
+/// omitted if the document was written without one, e.g., by autosave.
+///
+/// Older documents have no info: readFile() then fails, and the caller may
+/// fall back to reading the whole document.
+
+#include <QImage>
+#include <QString>
+#include <QStringList>
+
+class Scene;
+class PlaybackSettings;
+class XmlStreamReader;
+class XmlStreamWriter;
+
+class DocumentInfo
+{
+public:
+    // Invalid info
+    DocumentInfo();
+
+    // Info of the given document. The preview is given separately since
+    // it must be drawn with an OpenGL context.
+    DocumentInfo(const PlaybackSettings & playback, Scene * scene,
+                 const QImage & preview = QImage());
+
+    // Whether read() or readFile() succeeded, or constructed from a document
+    bool isValid() const { return isValid_; }
+
+    int firstFrame() const { return firstFrame_; }
+    int lastFrame() const { return lastFrame_; }
+    int fps() const { return fps_; }
+    double canvasLeft() const { return canvasLeft_; }
+    double canvasTop() const { return canvasTop_; }
+    double canvasWidth() const { return canvasWidth_; }
+    double canvasHeight() const { return canvasHeight_; }
+    const QImage & preview() const { return preview_; }
+
+    // Number of cells of the given concrete kind, e.g. KeyEdgeKind
+    int numCells(int kind) const;
+
+    // Write or read the info element. The reader must be at its start
+    // element, and is left at its end element.
+    void write(XmlStreamWriter & xml) const;
+    void read(XmlStreamReader & xml);
+
+    // Reads the info of a VEC file, text or binary, reading as little of
+    // it as possible. Returns false if it cannot be read or has no info.
+    bool readFile(const QString & filePath);
+
+    // Prints the info of each file to the standard output, as one JSON
+    // object per line (see "VPaint --info"). Returns false if any file has
+    // no info.
+    static bool print(const QStringList & filePaths);
+
+    // Maximum width and height of previews, in pixels
+    static const int PREVIEW_SIZE = 256;
+
+private:
+    bool isValid_;
+    int firstFrame_;
+    int lastFrame_;
+    int fps_;
+    double canvasLeft_;
+    double canvasTop_;
+    double canvasWidth_;
+    double canvasHeight_;
+    static const int NUM_KINDS = 6;
+    int numCells_[NUM_KINDS];
+    QImage preview_;
+};
+
+#endif // DOCUMENTINFO_H
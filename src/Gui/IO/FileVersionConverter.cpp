@@ -14,12 +14,29 @@
 #include "Global.h"
 
 #include "XmlStreamConverters/XmlStreamConverter_1_0_to_1_6.h"
+#include "XmlStreamConverters/XmlStreamConverter_Binary.h"
+#include "XmlStreamConverterDevice.h"
+#include "BinaryContainer.h"
 
 #include <QPair>
+#include <QBuffer>
 #include <QDir>
 #include <QFile>
 #include <QFileInfo>
 #include <QMessageBox>
+#include <QSaveFile>
+#include <QtConcurrentRun>
+
+namespace
+{
+
+// Name of the backup of an old version of a file, e.g., "foo.old.vec"
+QString backupFileNameOf(const QFileInfo & fileInfo)
+{
+    return fileInfo.completeBaseName() + ".old." + fileInfo.suffix();
+}
+
+}
 
 FileVersionConverter::FileVersionConverter(const QString & filePath) :
     filePath_(filePath),
@@ -48,12 +65,23 @@ int FileVersionConverter::fileMinor() const
 void FileVersionConverter::readVersion_()
 {
     // Open file
+    bool isBinary = BinaryContainer::isBinary(filePath_);
     QFile file(filePath_);
-    if (!file.open(QFile::ReadOnly | QFile::Text))
+    if (!file.open(isBinary ? QFile::ReadOnly : QFile::ReadOnly | QFile::Text))
         return;
 
+    // Get XML from binary container
+    QByteArray xmlData, blocks;
+    QBuffer buffer(&xmlData);
+    if (isBinary)
+    {
+        if (!BinaryContainer::read(&file, xmlData, blocks))
+            return;
+        buffer.open(QIODevice::ReadOnly);
+    }
+
     // Parse XML to get version
-    XmlStreamReader xml(&file);
+    XmlStreamReader xml(isBinary ? static_cast<QIODevice*>(&buffer) : &file);
     if (xml.readNextStartElement() &&
         xml.name() == "vec" &&
         xml.attributes().hasAttribute("version"))
@@ -76,38 +104,52 @@ void FileVersionConverter::readVersion_()
     file.close();
 }
 
-bool FileVersionConverter::convertToVersion(
-        const QString & targetVersion,
-        QWidget * popupParent)
+bool FileVersionConverter::parseVersion_(const QString & version, int & major, int & minor)
 {
-    // Get target minor and major
-    int targetMajor = 0;
-    int targetMinor = 0;
-    QStringList list = targetVersion.split(QRegExp("\\.| "));
+    QStringList list = version.split(QRegExp("\\.| "));
     if (list.size() >= 2)
     {
-        targetMajor = list[0].toInt();
-        targetMinor = list[1].toInt();
+        major = list[0].toInt();
+        minor = list[1].toInt();
+        return true;
     }
     else
     {
         return false;
     }
+}
 
-    // Store as pair for easy comparison
+bool FileVersionConverter::requiresConversion(const QString & targetVersion) const
+{
+    int targetMajor = 0;
+    int targetMinor = 0;
+    if (!parseVersion_(targetVersion, targetMajor, targetMinor))
+        return false;
+
+    // Only conversion from 1.0 is required for now
     QPair<int,int> fromVersion = qMakePair(fileMajor(), fileMinor());
     QPair<int,int> toVersion = qMakePair(targetMajor, targetMinor);
+    return fromVersion == qMakePair(1,0) && fromVersion < toVersion;
+}
 
-    // Nothing to do if the versions match
-    if (fromVersion == toVersion)
-    {
-        return true;
-    }
+bool FileVersionConverter::checkVersion(
+        const QString & targetVersion,
+        QWidget * popupParent)
+{
+    // Get target minor and major
+    int targetMajor = 0;
+    int targetMinor = 0;
+    if (!parseVersion_(targetVersion, targetMajor, targetMinor))
+        return false;
+
+    // Store as pair for easy comparison
+    QPair<int,int> fromVersion = qMakePair(fileMajor(), fileMinor());
+    QPair<int,int> toVersion = qMakePair(targetMajor, targetMinor);
 
     // Fail if trying to convert from a newer version
     // For now, we only support opening of old files with new versions of VPaint, not
     // the other way around
-    else if (fromVersion > toVersion)
+    if (fromVersion > toVersion)
     {
         QMessageBox msgBox(popupParent);
         msgBox.setWindowTitle(QObject::tr("Upgrade required"));
@@ -120,31 +162,51 @@ bool FileVersionConverter::convertToVersion(
         return false;
     }
 
-    // Convert to new format if fromVersion == 1.0
-    else if (fromVersion == qMakePair(1,0))
+    // Show popup to notify user that a conversion will happen
+    else if (requiresConversion(targetVersion))
     {
-        // Get backup path
         QFileInfo fileInfo(filePath_);
-        QString fileName = fileInfo.fileName();
-        QString backupFileName =
-                fileInfo.completeBaseName() +
-                ".old." +
-                fileInfo.suffix();
-        QString backupPath =
-                fileInfo.path() +
-                "/" +
-                backupFileName;
-
-        // Show popup to notify user that a conversion will happen
         bool notifyUser = !global()->settings().dontNotifyConversion();
         if (notifyUser)
         {
-            FileVersionConverterDialog dialog(popupParent, fileName, backupFileName);
+            FileVersionConverterDialog dialog(popupParent, fileInfo.fileName(), backupFileNameOf(fileInfo));
             if (!dialog.exec())
             {
                 return false;
             }
         }
+        return true;
+    }
+
+    // Nothing to do otherwise (e.g., fromVersion = 1.6 and toVersion == 1.7
+    // without a breaking change between 1.6 and 1.7)
+    else
+    {
+        return true;
+    }
+}
+
+bool FileVersionConverter::convertToVersion(
+        const QString & targetVersion,
+        QWidget * popupParent)
+{
+    // Check version, and ask user for confirmation
+    if (!checkVersion(targetVersion, popupParent))
+    {
+        return false;
+    }
+
+    // Convert to new format if fromVersion == 1.0
+    else if (requiresConversion(targetVersion))
+    {
+        // Get backup path
+        QFileInfo fileInfo(filePath_);
+        QString fileName = fileInfo.fileName();
+        QString backupFileName = backupFileNameOf(fileInfo);
+        QString backupPath =
+                fileInfo.path() +
+                "/" +
+                backupFileName;
 
         // Create backup
         QDir dir = fileInfo.dir();
@@ -197,10 +259,109 @@ bool FileVersionConverter::convertToVersion(
         return true;
     }
 
-    // Nothing to do otherwise (e.g., fromVersion = 1.6 and toVersion == 1.7
-    // without a breaking change between 1.6 and 1.7)
+    // Nothing to convert otherwise
     else
     {
         return true;
     }
 }
+
+XmlStreamConverterDevice * FileVersionConverter::createConverterDevice(QIODevice * in) const
+{
+    if (qMakePair(fileMajor(), fileMinor()) == qMakePair(1,0))
+    {
+        return XmlStreamConverterDevice::create<XmlStreamConverter_1_0_to_1_6>(in);
+    }
+    else
+    {
+        return 0;
+    }
+}
+
+QFuture<bool> FileVersionConverter::writeConvertedFile(
+        const QString & filePath,
+        const QByteArray & convertedData)
+{
+    // Settings are read in the GUI thread
+    bool keepOldVersion = global()->settings().keepOldVersion();
+
+    // The old version is replaced only once the new one is fully written
+    return QtConcurrent::run([filePath, convertedData, keepOldVersion]() -> bool {
+        QSaveFile outFile(filePath);
+        if (!outFile.open(QFile::WriteOnly | QFile::Text))
+            return false;
+        if (outFile.write(convertedData) != convertedData.size())
+            return false;
+        if (keepOldVersion)
+        {
+            QFileInfo fileInfo(filePath);
+            QString backupPath = fileInfo.path() + "/" + backupFileNameOf(fileInfo);
+            QFile::remove(backupPath);
+            if (!QFile::copy(filePath, backupPath))
+                return false;
+        }
+        return outFile.commit();
+    });
+}
+
+bool FileVersionConverter::convertToBinary(const QString & inFilePath, const QString & outFilePath)
+{
+    return convertFormat_(inFilePath, outFilePath, true);
+}
+
+bool FileVersionConverter::convertToXml(const QString & inFilePath, const QString & outFilePath)
+{
+    return convertFormat_(inFilePath, outFilePath, false);
+}
+
+bool FileVersionConverter::convertFormat_(const QString & inFilePath, const QString & outFilePath, bool binary)
+{
+    // Read input, and get XML from binary container if necessary
+    bool isBinary = BinaryContainer::isBinary(inFilePath);
+    QFile inFile(inFilePath);
+    if (!inFile.open(isBinary ? QFile::ReadOnly : QFile::ReadOnly | QFile::Text))
+        return false;
+    QByteArray inXmlData, inBlocks;
+    QBuffer inBuffer(&inXmlData);
+    if (isBinary)
+    {
+        if (!BinaryContainer::read(&inFile, inXmlData, inBlocks))
+            return false;
+        inBuffer.open(QIODevice::ReadOnly);
+    }
+
+    // Open file for writing
+    QFile outFile(outFilePath);
+    if (!outFile.open(binary ? QFile::WriteOnly : QFile::WriteOnly | QFile::Text))
+        return false;
+
+    // Perform the conversion
+    XmlStreamReader inXml(isBinary ? static_cast<QIODevice*>(&inBuffer) : &inFile);
+    if (isBinary)
+        inXml.setBinaryBlocks(&inBlocks);
+    bool success = true;
+    if (binary)
+    {
+        QByteArray outXmlData, outBlocks;
+        QBuffer outBuffer(&outXmlData);
+        outBuffer.open(QIODevice::WriteOnly);
+        XmlStreamWriter outXml(&outBuffer);
+        outXml.setBinaryBlocks(&outBlocks);
+        XmlStreamConverter_Binary(inXml, outXml).traverse();
+        outBuffer.close();
+        success = BinaryContainer::write(&outFile, outXmlData, outBlocks,
+                                         BinaryContainer::isCompressedFileName(outFilePath));
+    }
+    else
+    {
+        XmlStreamWriter outXml(&outFile);
+        XmlStreamConverter_Binary(inXml, outXml).traverse();
+    }
+    success = success && !inXml.hasError();
+
+    // Close files
+    inFile.close();
+    outFile.close();
+
+    return success;
+}
@@ -10,10 +10,14 @@
 #define FILE_VERSION_CONVERTER_H
 
 #include <QString>
+#include <QByteArray>
+#include <QFuture>
 
 class QWidget;
+class QIODevice;
 class XmlStreamReader;
 class XmlStreamWriter;
+class XmlStreamConverterDevice;
 
 class FileVersionConverter
 {
@@ -35,6 +39,31 @@ public:
             const QString & targetVersion,
             QWidget * popupParent = 0);
 
+    // Streaming alternative to convertToVersion(), which leaves the file on
+    // disk untouched before it is loaded.
+    //
+    // checkVersion() does the same checks and asks the same questions to the
+    // user as convertToVersion(), and returns false if the file can't be
+    // converted or if the user aborted. Then, if requiresConversion(), the
+    // file must be read through createConverterDevice(), which converts it on
+    // the fly. Its output can optionally be written back to the file
+    // afterwards, in a background thread, via writeConvertedFile().
+    bool checkVersion(
+            const QString & targetVersion,
+            QWidget * popupParent = 0);
+    bool requiresConversion(const QString & targetVersion) const;
+    XmlStreamConverterDevice * createConverterDevice(QIODevice * in) const;
+    static QFuture<bool> writeConvertedFile(const QString & filePath, const QByteArray & convertedData);
+
+    // Converts between XML files (*.vec) and binary files (*.vecb, or
+    // compressed, *.vecz, depending on outFilePath), see
+    // IO/BinaryContainer.h. Input files may be in any format, and the
+    // conversions are lossless: xml->binary->xml yields the same numbers.
+    //
+    // Returns true if successfully converted.
+    static bool convertToBinary(const QString & inFilePath, const QString & outFilePath);
+    static bool convertToXml(const QString & inFilePath, const QString & outFilePath);
+
 private:
     QString filePath_;
     QString fileVersion_;
@@ -42,6 +71,8 @@ private:
     int fileMinor_;
 
     void readVersion_();
+    static bool parseVersion_(const QString & version, int & major, int & minor);
+    static bool convertFormat_(const QString & inFilePath, const QString & outFilePath, bool binary);
 };
 
 #endif
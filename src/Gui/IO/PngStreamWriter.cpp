@@ -0,0 +1,233 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#include "PngStreamWriter.h"
+
+#include <QIODevice>
+#include <QtEndian>
+#include <QtDebug>
+
+#include <cstdlib>
+#include <cstring>
+
+#ifdef Q_OS_WIN
+#include <QtZlib/zlib.h>
+#else
+#include <zlib.h>
+#endif
+
+namespace
+{
+
+const unsigned char SIGNATURE[8] = {137, 'P', 'N', 'G', '\r', '\n', 26, '\n'};
+
+// Size of the IDAT chunks. Compressed data is written as soon as a chunk is full.
+const int IDAT_SIZE = 1 << 16;
+
+// Size of the zlib output buffer
+const int DEFLATE_BUFFER_SIZE = 1 << 14;
+
+int paethPredictor(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = std::abs(p - a);
+    int pb = std::abs(p - b);
+    int pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc)
+        return a;
+    else if (pb <= pc)
+        return b;
+    else
+        return c;
+}
+
+// Filters row into out (filter type byte followed by filtered bytes), using
+// the filter that minimizes the sum of absolute differences, as libpng does.
+// The buffer must have room for 4*size bytes.
+void filterRow(const unsigned char * row, const unsigned char * prev, int size,
+               unsigned char * buffer, unsigned char * out)
+{
+    const int bpp = 4;
+    unsigned char * candidates[5];
+    candidates[0] = const_cast<unsigned char*>(row);
+    for (int f=1; f<5; ++f)
+        candidates[f] = buffer + (f-1)*size;
+
+    for (int i=0; i<size; ++i)
+    {
+        int a = i >= bpp ? row[i-bpp] : 0;
+        int b = prev[i];
+        int c = i >= bpp ? prev[i-bpp] : 0;
+        candidates[1][i] = (unsigned char) (row[i] - a);
+        candidates[2][i] = (unsigned char) (row[i] - b);
+        candidates[3][i] = (unsigned char) (row[i] - ((a + b) >> 1));
+        candidates[4][i] = (unsigned char) (row[i] - paethPredictor(a, b, c));
+    }
+
+    int bestFilter = 0;
+    long bestSum = -1;
+    for (int f=0; f<5; ++f)
+    {
+        long sum = 0;
+        for (int i=0; i<size; ++i)
+        {
+            signed char d = (signed char) candidates[f][i];
+            sum += std::abs((int) d);
+        }
+        if (bestSum < 0 || sum < bestSum)
+        {
+            bestSum = sum;
+            bestFilter = f;
+        }
+    }
+
+    out[0] = (unsigned char) bestFilter;
+    std::memcpy(out + 1, candidates[bestFilter], size);
+}
+
+QByteArray uint32ToBigEndian(quint32 x)
+{
+    QByteArray res(4, Qt::Uninitialized);
+    qToBigEndian<quint32>(x, reinterpret_cast<uchar*>(res.data()));
+    return res;
+}
+
+}
+
+struct PngStreamWriter::Deflater
+{
+    z_stream stream;
+    unsigned char buffer[DEFLATE_BUFFER_SIZE];
+};
+
+PngStreamWriter::PngStreamWriter(QIODevice * device) :
+    device_(device),
+    width_(0),
+    height_(0),
+    numRows_(0),
+    deflater_(0)
+{
+}
+
+PngStreamWriter::~PngStreamWriter()
+{
+    if (deflater_)
+    {
+        deflateEnd(&deflater_->stream);
+        delete deflater_;
+    }
+}
+
+bool PngStreamWriter::begin(int width, int height)
+{
+    if (deflater_ || width <= 0 || height <= 0)
+        return false;
+
+    width_ = width;
+    height_ = height;
+    numRows_ = 0;
+    previousRow_ = QByteArray(4 * width, 0);
+    filteredRow_ = QByteArray(4 * width + 1, Qt::Uninitialized);
+    filterBuffer_ = QByteArray(16 * width, Qt::Uninitialized);
+
+    deflater_ = new Deflater;
+    std::memset(&deflater_->stream, 0, sizeof(z_stream));
+    if (deflateInit(&deflater_->stream, Z_DEFAULT_COMPRESSION) != Z_OK)
+    {
+        delete deflater_;
+        deflater_ = 0;
+        return false;
+    }
+
+    // Header
+    QByteArray ihdr;
+    ihdr.append(uint32ToBigEndian(width));
+    ihdr.append(uint32ToBigEndian(height));
+    ihdr.append((char) 8); // bit depth
+    ihdr.append((char) 6); // color type: RGBA
+    ihdr.append((char) 0); // compression method: deflate
+    ihdr.append((char) 0); // filter method: adaptive
+    ihdr.append((char) 0); // interlace method: none
+
+    return device_->write(reinterpret_cast<const char*>(SIGNATURE), 8) == 8 &&
+           writeChunk_("IHDR", ihdr);
+}
+
+bool PngStreamWriter::writeRow(const unsigned char * rgba)
+{
+    if (!deflater_ || numRows_ >= height_)
+        return false;
+
+    const int size = 4 * width_;
+    unsigned char * prev = reinterpret_cast<unsigned char*>(previousRow_.data());
+    unsigned char * filtered = reinterpret_cast<unsigned char*>(filteredRow_.data());
+    unsigned char * buffer = reinterpret_cast<unsigned char*>(filterBuffer_.data());
+    filterRow(rgba, prev, size, buffer, filtered);
+    std::memcpy(prev, rgba, size);
+    ++numRows_;
+
+    return deflate_(filtered, size + 1, false);
+}
+
+bool PngStreamWriter::end()
+{
+    if (!deflater_ || numRows_ != height_)
+    {
+        qDebug() << "Error: PNG image ended before all its rows were written";
+        return false;
+    }
+
+    bool ok = deflate_(0, 0, true);
+    deflateEnd(&deflater_->stream);
+    delete deflater_;
+    deflater_ = 0;
+
+    return ok &&
+           (idat_.isEmpty() || writeChunk_("IDAT", idat_)) &&
+           writeChunk_("IEND", QByteArray());
+}
+
+bool PngStreamWriter::deflate_(const unsigned char * data, int size, bool finish)
+{
+    z_stream & stream = deflater_->stream;
+    stream.next_in = const_cast<unsigned char*>(data);
+    stream.avail_in = size;
+
+    int res;
+    do
+    {
+        stream.next_out = deflater_->buffer;
+        stream.avail_out = DEFLATE_BUFFER_SIZE;
+        res = deflate(&stream, finish ? Z_FINISH : Z_NO_FLUSH);
+        if (res == Z_STREAM_ERROR)
+            return false;
+        idat_.append(reinterpret_cast<const char*>(deflater_->buffer),
+                     DEFLATE_BUFFER_SIZE - stream.avail_out);
+
+        if (idat_.size() >= IDAT_SIZE)
+        {
+            if (!writeChunk_("IDAT", idat_))
+                return false;
+            idat_.clear();
+        }
+    }
+    while (stream.avail_out == 0 || (finish && res != Z_STREAM_END));
+
+    return true;
+}
+
+bool PngStreamWriter::writeChunk_(const char * type, const QByteArray & data)
+{
+    uLong crc = crc32(0, reinterpret_cast<const Bytef*>(type), 4);
+    crc = crc32(crc, reinterpret_cast<const Bytef*>(data.constData()), data.size());
+
+    return device_->write(uint32ToBigEndian(data.size())) == 4 &&
+           device_->write(type, 4) == 4 &&
+           device_->write(data) == data.size() &&
+           device_->write(uint32ToBigEndian(crc)) == 4;
+}
@@ -0,0 +1,59 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#ifndef PNGSTREAMWRITER_H
+#define PNGSTREAMWRITER_H
+
+/// \class PngStreamWriter
+/// Writes an 8-bit RGBA PNG image row by row, so that images too large to
+/// fit in memory, such as tiled exports, can be written while only keeping
+/// one row at a time. Usage:
+///
+///     PngStreamWriter png(&file);
+///     png.begin(width, height);
+///     for (int i=0; i<height; ++i)
+///         png.writeRow(row(i)); // top to bottom, 4*width bytes
+///     png.end();
+
+#include <QByteArray>
+
+class QIODevice;
+
+class PngStreamWriter
+{
+public:
+    PngStreamWriter(QIODevice * device);
+    ~PngStreamWriter();
+
+    // All return false if the image couldn't be written to the device
+    bool begin(int width, int height);
+    bool writeRow(const unsigned char * rgba); // non-premultiplied alpha
+    bool end();
+
+private:
+    bool writeChunk_(const char * type, const QByteArray & data);
+    bool deflate_(const unsigned char * data, int size, bool finish);
+
+    QIODevice * device_;
+    int width_;
+    int height_;
+    int numRows_;
+
+    // Previous row, needed by PNG filters, current filtered row, and
+    // candidate filtered rows
+    QByteArray previousRow_;
+    QByteArray filteredRow_;
+    QByteArray filterBuffer_;
+
+    // zlib stream, and its output not yet written as an IDAT chunk
+    struct Deflater;
+    Deflater * deflater_;
+    QByteArray idat_;
+};
+
+#endif // PNGSTREAMWRITER_H
@@ -0,0 +1,157 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#include "SvgStreamWriter.h"
+
+#include <QIODevice>
+#include <QString>
+
+#include <cmath>
+#include <cstdio>
+
+namespace
+{
+
+// Size above which the buffer is written to the device
+const int BUFFER_SIZE = 1 << 16;
+
+// Numbers are rounded to 1/DECIMALS_SCALE
+const int NUM_DECIMALS = 4;
+const long long DECIMALS_SCALE = 10000;
+
+// Numbers larger than this are written with printf
+const double MAX_FAST_VALUE = 1e12;
+
+// Writes the digits of x to out, in reverse order. Returns the number of digits.
+int reverseDigits(unsigned long long x, char * out)
+{
+    int n = 0;
+    do
+    {
+        out[n++] = (char) ('0' + x % 10);
+        x /= 10;
+    }
+    while (x > 0);
+    return n;
+}
+
+}
+
+SvgStreamWriter::SvgStreamWriter(QIODevice * device) :
+    device_(device),
+    buffer_(),
+    hasError_(false)
+{
+    buffer_.reserve(BUFFER_SIZE + 256);
+}
+
+SvgStreamWriter::~SvgStreamWriter()
+{
+    flush();
+}
+
+SvgStreamWriter & SvgStreamWriter::operator<<(const char * s)
+{
+    buffer_.append(s);
+    flushIfFull_();
+    return *this;
+}
+
+SvgStreamWriter & SvgStreamWriter::operator<<(const QString & s)
+{
+    buffer_.append(s.toUtf8());
+    flushIfFull_();
+    return *this;
+}
+
+SvgStreamWriter & SvgStreamWriter::operator<<(char c)
+{
+    buffer_.append(c);
+    flushIfFull_();
+    return *this;
+}
+
+SvgStreamWriter & SvgStreamWriter::operator<<(int x)
+{
+    char digits[16];
+    unsigned long long absX = x < 0 ? - (long long) x : x;
+    int n = reverseDigits(absX, digits);
+    if (x < 0)
+        buffer_.append('-');
+    while (n > 0)
+        buffer_.append(digits[--n]);
+    flushIfFull_();
+    return *this;
+}
+
+SvgStreamWriter & SvgStreamWriter::operator<<(double x)
+{
+    // Slow path for huge values and NaN
+    if (!(std::abs(x) < MAX_FAST_VALUE))
+    {
+        char s[32];
+        std::snprintf(s, sizeof(s), "%g", x);
+        buffer_.append(s);
+        flushIfFull_();
+        return *this;
+    }
+
+    // Round to fixed point
+    unsigned long long scaled = (unsigned long long) std::floor(std::abs(x) * DECIMALS_SCALE + 0.5);
+    unsigned long long integerPart = scaled / DECIMALS_SCALE;
+    unsigned long long fractionalPart = scaled % DECIMALS_SCALE;
+
+    // Sign, omitted for values that round to zero
+    if (x < 0 && scaled > 0)
+        buffer_.append('-');
+
+    // Integer part
+    char digits[24];
+    int n = reverseDigits(integerPart, digits);
+    while (n > 0)
+        buffer_.append(digits[--n]);
+
+    // Fractional part, without trailing zeros
+    if (fractionalPart > 0)
+    {
+        n = NUM_DECIMALS;
+        while (fractionalPart % 10 == 0)
+        {
+            fractionalPart /= 10;
+            --n;
+        }
+        char decimals[NUM_DECIMALS];
+        for (int i=n-1; i>=0; --i)
+        {
+            decimals[i] = (char) ('0' + fractionalPart % 10);
+            fractionalPart /= 10;
+        }
+        buffer_.append('.');
+        buffer_.append(decimals, n);
+    }
+
+    flushIfFull_();
+    return *this;
+}
+
+bool SvgStreamWriter::flush()
+{
+    if (!buffer_.isEmpty())
+    {
+        if (device_->write(buffer_) != buffer_.size())
+            hasError_ = true;
+        buffer_.resize(0); // keeps capacity
+    }
+    return !hasError_;
+}
+
+void SvgStreamWriter::flushIfFull_()
+{
+    if (buffer_.size() >= BUFFER_SIZE)
+        flush();
+}
@@ -0,0 +1,49 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#ifndef SVGSTREAMWRITER_H
+#define SVGSTREAMWRITER_H
+
+/// \class SvgStreamWriter
+/// Buffered UTF-8 text stream used to export SVG files. Unlike QTextStream,
+/// numbers are formatted without going through QString, and the text is
+/// written to the device in large chunks. Numbers are written with at most
+/// four decimals, which is more than enough for SVG coordinates and colors.
+///
+/// An SvgStreamWriter is not thread-safe, but several ones writing to
+/// different devices can be used concurrently.
+
+#include <QByteArray>
+
+class QIODevice;
+class QString;
+
+class SvgStreamWriter
+{
+public:
+    SvgStreamWriter(QIODevice * device);
+    ~SvgStreamWriter(); // flushes
+
+    SvgStreamWriter & operator<<(const char * s);
+    SvgStreamWriter & operator<<(const QString & s);
+    SvgStreamWriter & operator<<(char c);
+    SvgStreamWriter & operator<<(int x);
+    SvgStreamWriter & operator<<(double x);
+
+    // Writes buffered text to the device. Returns false if any write failed.
+    bool flush();
+
+private:
+    QIODevice * device_;
+    QByteArray buffer_;
+    bool hasError_;
+
+    void flushIfFull_();
+};
+
+#endif // SVGSTREAMWRITER_H
@@ -0,0 +1,131 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#include "VideoEncoder.h"
+
+#include <QImage>
+#include <QStringList>
+
+namespace
+{
+
+// Number of frames that can be written to the encoder before waiting for it
+const int MAX_PENDING_FRAMES = 4;
+
+// Maximum time, in milliseconds, to wait for the encoder to start, to accept
+// a frame, or to finish
+const int START_TIMEOUT = 10000;
+const int WRITE_TIMEOUT = 60000;
+const int FINISH_TIMEOUT = -1; // encoders may take long to flush their buffers
+
+}
+
+VideoEncoder::VideoEncoder() :
+    process_(),
+    width_(0),
+    height_(0),
+    errorString_()
+{
+    // The encoder's own output is not needed, and could fill up the pipe
+    process_.setStandardOutputFile(QProcess::nullDevice());
+    process_.setStandardErrorFile(QProcess::nullDevice());
+}
+
+VideoEncoder::~VideoEncoder()
+{
+    if (process_.state() != QProcess::NotRunning)
+    {
+        process_.kill();
+        process_.waitForFinished();
+    }
+}
+
+bool VideoEncoder::start(const QString & program, const QString & options, const QString & filePath,
+                         int width, int height, int fps)
+{
+    width_ = width;
+    height_ = height;
+
+    QStringList arguments;
+    arguments << "-y"
+              << "-f" << "rawvideo"
+              << "-pix_fmt" << "rgba"
+              << "-s" << QString("%1x%2").arg(width).arg(height)
+              << "-r" << QString::number(fps)
+              << "-i" << "-"
+              << options.split(' ', QString::SkipEmptyParts)
+              << filePath;
+
+    process_.start(program, arguments);
+    if (!process_.waitForStarted(START_TIMEOUT))
+        return fail_(QObject::tr("couldn't start %1: %2").arg(program, process_.errorString()));
+
+    return true;
+}
+
+bool VideoEncoder::writeFrame(const QImage & image)
+{
+    if (process_.state() != QProcess::Running)
+        return fail_(QObject::tr("the encoder stopped unexpectedly"));
+
+    if (image.width() != width_ || image.height() != height_)
+        return fail_(QObject::tr("invalid frame size"));
+
+    // Write rows, which are contiguous unless the image is padded
+    QImage rgba = image.convertToFormat(QImage::Format_RGBA8888);
+    const int rowSize = 4 * width_;
+    if (rgba.bytesPerLine() == rowSize)
+    {
+        process_.write(reinterpret_cast<const char*>(rgba.constBits()), rowSize * height_);
+    }
+    else
+    {
+        for (int i=0; i<height_; ++i)
+            process_.write(reinterpret_cast<const char*>(rgba.constScanLine(i)), rowSize);
+    }
+
+    // Bound the data buffered for the encoder
+    const qint64 maxBytesToWrite = qint64(MAX_PENDING_FRAMES) * rowSize * height_;
+    while (process_.bytesToWrite() > maxBytesToWrite)
+    {
+        if (!process_.waitForBytesWritten(WRITE_TIMEOUT))
+            return fail_(QObject::tr("the encoder doesn't accept frames: %1").arg(process_.errorString()));
+    }
+
+    return true;
+}
+
+bool VideoEncoder::finish()
+{
+    // Flush remaining frames, then signal the end of the video
+    while (process_.bytesToWrite() > 0)
+    {
+        if (!process_.waitForBytesWritten(WRITE_TIMEOUT))
+            return fail_(QObject::tr("the encoder doesn't accept frames: %1").arg(process_.errorString()));
+    }
+    process_.closeWriteChannel();
+
+    if (!process_.waitForFinished(FINISH_TIMEOUT))
+        return fail_(QObject::tr("the encoder didn't finish: %1").arg(process_.errorString()));
+
+    if (process_.exitStatus() != QProcess::NormalExit || process_.exitCode() != 0)
+        return fail_(QObject::tr("the encoder failed with exit code %1").arg(process_.exitCode()));
+
+    return true;
+}
+
+QString VideoEncoder::errorString() const
+{
+    return errorString_;
+}
+
+bool VideoEncoder::fail_(const QString & errorString)
+{
+    errorString_ = errorString;
+    return false;
+}
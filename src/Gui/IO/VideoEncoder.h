@@ -0,0 +1,52 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#ifndef VIDEOENCODER_H
+#define VIDEOENCODER_H
+
+/// \class VideoEncoder
+/// Streams frames to an external video encoder process, without writing any
+/// intermediate file. Frames are written as raw RGBA to the standard input of
+/// the encoder, which must accept FFmpeg-compatible arguments:
+///
+///     <program> -y -f rawvideo -pix_fmt rgba -s <width>x<height> -r <fps> -i -
+///               <options> <filePath>
+///
+/// Writing a frame only blocks when the encoder is more than a few frames
+/// behind, so that the next frame can be drawn while the encoder processes
+/// the previous ones.
+
+#include <QProcess>
+#include <QString>
+
+class QImage;
+
+class VideoEncoder
+{
+public:
+    VideoEncoder();
+    ~VideoEncoder();
+
+    // All return false if the encoder failed, see errorString()
+    bool start(const QString & program, const QString & options, const QString & filePath,
+               int width, int height, int fps);
+    bool writeFrame(const QImage & image); // of size width x height
+    bool finish();
+
+    QString errorString() const;
+
+private:
+    QProcess process_;
+    int width_;
+    int height_;
+    QString errorString_;
+
+    bool fail_(const QString & errorString);
+};
+
+#endif // VIDEOENCODER_H
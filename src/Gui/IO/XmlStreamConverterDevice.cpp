@@ -0,0 +1,106 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#include "XmlStreamConverterDevice.h"
+
+#include <cstring>
+
+XmlStreamConverterDevice::XmlStreamConverterDevice(QIODevice * in) :
+    QIODevice(),
+    inXml_(in),
+    outData_(),
+    outBuffer_(&outData_),
+    outXml_(&outBuffer_),
+    converter_(),
+    readPos_(0),
+    keepsConvertedData_(false)
+{
+    outBuffer_.open(QIODevice::WriteOnly);
+    open(QIODevice::ReadOnly);
+}
+
+XmlStreamConverterDevice::~XmlStreamConverterDevice()
+{
+    // Delete converter before the reader and writer it refers to
+    converter_.reset();
+}
+
+void XmlStreamConverterDevice::setConverter_(XmlStreamConverter * converter)
+{
+    converter_.reset(converter);
+    converter_->startTraversal();
+}
+
+void XmlStreamConverterDevice::setKeepsConvertedData(bool b)
+{
+    keepsConvertedData_ = b;
+}
+
+bool XmlStreamConverterDevice::keepsConvertedData() const
+{
+    return keepsConvertedData_;
+}
+
+QByteArray XmlStreamConverterDevice::convertedData() const
+{
+    return outData_;
+}
+
+bool XmlStreamConverterDevice::isConversionFinished() const
+{
+    return !converter_ || !converter_->isTraversing();
+}
+
+bool XmlStreamConverterDevice::hasConversionError() const
+{
+    return inXml_.hasError();
+}
+
+bool XmlStreamConverterDevice::isSequential() const
+{
+    return true;
+}
+
+qint64 XmlStreamConverterDevice::bytesAvailable() const
+{
+    return (outData_.size() - readPos_) + QIODevice::bytesAvailable();
+}
+
+bool XmlStreamConverterDevice::atEnd() const
+{
+    return isConversionFinished() && bytesAvailable() == 0;
+}
+
+qint64 XmlStreamConverterDevice::readData(char * data, qint64 maxSize)
+{
+    // Convert until enough data is available, or nothing is left to convert
+    while (outData_.size() - readPos_ < maxSize && converter_ && converter_->continueTraversal()) {}
+
+    // Copy available data
+    qint64 n = qMin(maxSize, outData_.size() - readPos_);
+    if (n > 0)
+    {
+        std::memcpy(data, outData_.constData() + readPos_, n);
+        readPos_ += n;
+    }
+
+    // Discard data fully read, unless we keep it
+    if (!keepsConvertedData_ && readPos_ == outData_.size())
+    {
+        outData_.clear();
+        outBuffer_.seek(0);
+        readPos_ = 0;
+    }
+
+    return n;
+}
+
+qint64 XmlStreamConverterDevice::writeData(const char * /*data*/, qint64 /*maxSize*/)
+{
+    return -1;
+}
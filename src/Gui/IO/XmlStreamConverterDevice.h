@@ -0,0 +1,91 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#ifndef XMLSTREAMCONVERTERDEVICE_H
+#define XMLSTREAMCONVERTERDEVICE_H
+
+#include "XmlStreamReader.h"
+#include "XmlStreamWriter.h"
+#include "IO/XmlStreamConverter.h"
+
+#include <QIODevice>
+#include <QBuffer>
+#include <QByteArray>
+#include <QScopedPointer>
+
+/// \class XmlStreamConverterDevice
+/// A read-only sequential device streaming the output of an XmlStreamConverter.
+///
+/// The XML read from the input device is converted on demand, as the output
+/// is read, so that a file in an old format can be loaded by an
+/// XmlStreamReader in a single pass, without first writing the converted
+/// version to a temporary file:
+///
+///     QFile file(filePath);
+///     file.open(QFile::ReadOnly | QFile::Text);
+///     QScopedPointer<XmlStreamConverterDevice> device(
+///         XmlStreamConverterDevice::create<XmlStreamConverter_1_0_to_1_6>(&file));
+///     XmlStreamReader xml(device.data());
+///
+/// Only the converted data not read yet is kept in memory, unless
+/// setKeepsConvertedData(true) is called before reading, in which case
+/// convertedData() gives the whole converted document once read, e.g. to
+/// write it to disk.
+
+class XmlStreamConverterDevice: public QIODevice
+{
+public:
+    // Creates an open device converting from the given input device, which
+    // must be open, and must outlive the returned device.
+    template <class Converter>
+    static XmlStreamConverterDevice * create(QIODevice * in)
+    {
+        XmlStreamConverterDevice * device = new XmlStreamConverterDevice(in);
+        device->setConverter_(new Converter(device->inXml_, device->outXml_));
+        return device;
+    }
+
+    ~XmlStreamConverterDevice();
+
+    // Whether to keep all the converted data in memory. False by default.
+    void setKeepsConvertedData(bool b);
+    bool keepsConvertedData() const;
+
+    // All the data converted so far. Only meaningful if keepsConvertedData()
+    // was set before reading.
+    QByteArray convertedData() const;
+
+    // Whether the conversion is over, and whether the input XML was invalid
+    bool isConversionFinished() const;
+    bool hasConversionError() const;
+
+    // Reimplemented from QIODevice
+    bool isSequential() const;
+    qint64 bytesAvailable() const;
+    bool atEnd() const;
+
+protected:
+    qint64 readData(char * data, qint64 maxSize);
+    qint64 writeData(const char * data, qint64 maxSize);
+
+private:
+    XmlStreamConverterDevice(QIODevice * in);
+    void setConverter_(XmlStreamConverter * converter);
+
+    // Converted data is appended to outData_ by outXml_, and read from
+    // readPos_. When not kept, it is discarded as soon as fully read.
+    XmlStreamReader inXml_;
+    QByteArray outData_;
+    QBuffer outBuffer_;
+    XmlStreamWriter outXml_;
+    QScopedPointer<XmlStreamConverter> converter_;
+    qint64 readPos_;
+    bool keepsConvertedData_;
+};
+
+#endif // XMLSTREAMCONVERTERDEVICE_H
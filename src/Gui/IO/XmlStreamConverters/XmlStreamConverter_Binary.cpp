@@ -0,0 +1,122 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#include "XmlStreamConverter_Binary.h"
+
+#include "XmlStreamReader.h"
+#include "XmlStreamWriter.h"
+#include "IO/BinaryContainer.h"
+
+#include <QString>
+#include <QStringList>
+#include <QRegExp>
+
+namespace
+{
+
+// Get the numbers of a curve attribute, either as text or in binary blocks.
+// Returns false if the curve type is unknown.
+bool readCurveData(const QString & curve, const QByteArray * blocks, QVector<double> & d)
+{
+    int i = curve.indexOf('(');
+    QString curveType = curve.left(i);
+    QString curveData = curve.mid(i+1, curve.length()-i-2);
+
+    if (curveType == "xywdense")
+    {
+        QStringList strList = curveData.split(QRegExp("[\\,\\s]"), QString::SkipEmptyParts);
+        d.clear();
+        for (int j=0; j<strList.size(); ++j)
+            d << strList[j].toDouble();
+        return true;
+    }
+    else if (curveType == "xywblock" && blocks)
+    {
+        QStringList strList = curveData.split(' ', QString::SkipEmptyParts);
+        return strList.size() == 2 &&
+               BinaryContainer::readDoubles(*blocks, strList[0].toLongLong(), strList[1].toLongLong(), d);
+    }
+    else
+    {
+        return false;
+    }
+}
+
+void writeCurveData(XmlStreamWriter & out, const QVector<double> & d)
+{
+    QByteArray * blocks = out.binaryBlocks();
+    if (blocks)
+    {
+        qint64 offset = BinaryContainer::appendDoubles(*blocks, d);
+        out.writeAttribute("curve", QString("xywblock(%1 %2)").arg(offset).arg(d.size()));
+    }
+    else
+    {
+        // Shortest representation that reads back to the same double
+        out.writeStartAttribute("curve");
+        out.writeAttributeChars("xywdense(");
+        for (int i=0; i<d.size(); ++i)
+        {
+            if (i > 0)
+                out.writeAttributeChars((i%3 == 1) ? " " : ",");
+            out.writeAttributeDouble(d[i]);
+        }
+        out.writeAttributeChars(")");
+        out.writeEndAttribute();
+    }
+}
+
+}
+
+XmlStreamConverter_Binary::XmlStreamConverter_Binary(XmlStreamReader & in, XmlStreamWriter & out) :
+    XmlStreamConverter(in, out)
+{
+}
+
+void XmlStreamConverter_Binary::begin()
+{
+    // Start XML Document
+    out().writeStartDocument();
+
+    // Header
+    out().writeComment(" Created with VPaint (http://www.vpaint.org) ");
+    out().writeCharacters("\n\n");
+}
+
+void XmlStreamConverter_Binary::end()
+{
+    // End XML Document
+    out().writeEndDocument();
+}
+
+void XmlStreamConverter_Binary::pre()
+{
+    QString name = in().name().toString();
+    QXmlStreamAttributes attrs = in().attributes();
+
+    out().writeStartElement(name);
+    for (int i=0; i<attrs.size(); ++i)
+    {
+        QVector<double> d;
+        if (name == "edge" &&
+            attrs[i].qualifiedName() == "curve" &&
+            readCurveData(attrs[i].value().toString(), in().binaryBlocks(), d))
+        {
+            writeCurveData(out(), d);
+        }
+        else
+        {
+            out().writeAttribute(attrs[i]);
+        }
+    }
+}
+
+void XmlStreamConverter_Binary::post()
+{
+    out().writeEndElement();
+}
@@ -0,0 +1,29 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#ifndef XMLSTREAMCONVERTER_BINARY_H
+#define XMLSTREAMCONVERTER_BINARY_H
+
+#include "IO/XmlStreamConverter.h"
+
+// Converts edge curves between text (xywdense) and binary blocks (xywblock),
+// see IO/BinaryContainer.h. Curves are written as binary blocks if out has
+// binary blocks, and as text otherwise, with enough digits to be read back
+// exactly. All other XML data is copied as is.
+class XmlStreamConverter_Binary: public XmlStreamConverter
+{
+public:
+    XmlStreamConverter_Binary(XmlStreamReader & in, XmlStreamWriter & out);
+
+    void begin();
+    void end();
+    void pre();
+    void post();
+};
+
+#endif // XMLSTREAMCONVERTER_BINARY_H
@@ -12,7 +12,8 @@
 
 XmlStreamTraverser::XmlStreamTraverser(XmlStreamReader & xml) :
     xml_(xml),
-    currentDepth_(0)
+    currentDepth_(0),
+    isTraversing_(false)
 {
 }
 
@@ -28,22 +29,43 @@ int XmlStreamTraverser::currentDepth()
 
 void XmlStreamTraverser::traverse()
 {
+    startTraversal();
+    while (continueTraversal()) {}
+}
+
+void XmlStreamTraverser::startTraversal()
+{
+    currentDepth_ = 0;
+    isTraversing_ = true;
     begin();
+}
+
+bool XmlStreamTraverser::continueTraversal()
+{
+    if (!isTraversing_)
+        return false;
+
+    if (xml().readNextStartElement())
+    {
+        pre();
+        ++currentDepth_;
+    }
+    else
+    {
+        --currentDepth_;
+        post();
+    }
 
-    do
+    if (currentDepth_ <= 0)
     {
-        if (xml().readNextStartElement())
-        {
-            pre();
-            ++currentDepth_;
-        }
-        else
-        {
-            --currentDepth_;
-            post();
-        }
+        isTraversing_ = false;
+        end();
     }
-    while (currentDepth_ > 0);
 
-    end();
+    return isTraversing_;
+}
+
+bool XmlStreamTraverser::isTraversing() const
+{
+    return isTraversing_;
 }
@@ -62,6 +62,15 @@
 ///   * In the end() method, currentDepth == 0
 ///   * In the first call of pre(), currentDepth == 0, this corresponds to the XML root element
 ///   * In the last call of post(), currentDepth == 0, this corresponds to the XML root element
+///
+/// Instead of traverse(), the traversal can also be performed incrementally,
+/// e.g. to convert a file on demand while it is being read:
+///
+/// t.startTraversal();
+/// while (t.continueTraversal())
+/// {
+///     // do something else between pre() and post() calls
+/// }
 
 class XmlStreamReader;
 
@@ -81,6 +90,14 @@ public:
     // Perform traversal of XML
     void traverse();
 
+    // Perform traversal of XML incrementally. startTraversal() calls begin(),
+    // then each call of continueTraversal() reads the next XML tag, calling
+    // either pre() or post(), and calls end() after the last post(). It
+    // returns whether there is anything left to traverse.
+    void startTraversal();
+    bool continueTraversal();
+    bool isTraversing() const;
+
 protected:
     // Actual work to be implemented in derived classes
     virtual void pre()  {}
@@ -91,6 +108,7 @@ protected:
 private:
     XmlStreamReader & xml_;
     int currentDepth_;
+    bool isTraversing_;
 };
 
 #endif // XMLSTREAMTRAVERSER_H
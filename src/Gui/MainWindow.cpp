@@ -13,9 +13,14 @@
 #include "Scene.h"
 #include "View3D.h"
 #include "View.h"
+#include "Application.h"
 #include "MultiView.h"
 #include "Timeline.h"
 #include "DevSettings.h"
+#include "RenderStats.h"
+#include "OperatorStats.h"
+#include "OperatorStatsWidget.h"
+#include "Trace.h"
 #include "ObjectPropertiesWidget.h"
 #include "AnimatedCycleWidget.h"
 #include "EditCanvasSizeDialog.h"
@@ -23,18 +28,32 @@
 #include "AboutDialog.h"
 #include "SelectionInfoWidget.h"
 #include "Background/BackgroundWidget.h"
+#include "Background/Background.h"
+#include "Background/BackgroundFileIndex.h"
 #include "VectorAnimationComplex/VAC.h"
+#include "VectorAnimationComplex/History.h"
 #include "VectorAnimationComplex/InbetweenFace.h"
 
 #include "IO/FileVersionConverter.h"
+#include "IO/BinaryContainer.h"
+#include "IO/DocumentInfo.h"
+#include "IO/XmlStreamConverterDevice.h"
+#include "IO/VideoEncoder.h"
+#include "IO/SvgStreamWriter.h"
 #include "XmlStreamWriter.h"
 #include "XmlStreamReader.h"
 #include "SaveAndLoad.h"
+#include "SessionRecorder.h"
+#include "Benchmark.h"
+#include "RenderShards.h"
+#include "Random.h"
+#include "Clipboard.h"
 
 #include <QCoreApplication>
 #include <QApplication>
 #include <QtDebug>
 #include <QStatusBar>
+#include <QLabel>
 #include <QFileDialog>
 #include <QMessageBox>
 #include <QMenu>
@@ -47,6 +66,38 @@
 #include <QProgressDialog>
 #include <QDesktopServices>
 #include <QShortcut>
+#include <QBuffer>
+#include <QSaveFile>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QtConcurrentRun>
+#include <QtConcurrentMap>
+#include <QThread>
+#include <QThreadPool>
+#include <QtMath>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <algorithm>
+#include <atomic>
+
+namespace
+{
+
+// Maximum number of autosaves appended to the journal between two full
+// autosaves (see AutosaveJournal)
+const int MAX_AUTOSAVE_JOURNAL_DELTAS = 10;
+
+// Maximum width or height, in pixels, of PNG exports drawn at once. Larger
+// exports are drawn in tiles (see View::drawToPng())
+const int MAX_UNTILED_EXPORT_SIZE = 4096;
+
+// Number of key edges whose deferred geometry is read at once after an
+// asynchronous open, before processing other events
+const int DEFERRED_GEOMETRY_BATCH_SIZE = 256;
+
+}
 
 
 /*********************************************************************
@@ -54,7 +105,9 @@
  */
 
 
-MainWindow::MainWindow() :
+MainWindow::MainWindow(bool isBatchMode, bool logsStartupTimes) :
+    isBatchMode_(isBatchMode),
+
     scene_(0),
     multiView_(0),
 
@@ -64,8 +117,10 @@ MainWindow::MainWindow() :
     userManual_(0),
 
     undoStack_(),
+    undoHistory_(new VectorAnimationComplex::History()),
     undoIndex_(-1),
     savedUndoIndex_(-1),
+    undoMemoryLabel_(0),
 
     fileHeader_("---------- Vec File ----------"),
     documentFilePath_(),
@@ -74,22 +129,47 @@ MainWindow::MainWindow() :
     autosaveIndex_(0),
     autosaveOn_(true),
     autosaveDir_(),
+    autosaveWatcher_(),
+    autosaveSnapshot_(0),
+    autosaveElapsedTimer_(),
+    autosaveLabel_(0),
+    autosaveJournal_(),
+    isAutosaveJournalValid_(false),
+    convertedFileWrite_(),
+    saveWatcher_(),
+    saveSnapshot_(0),
+    saveFilePath_(),
+    saveUndoIndex_(-1),
+    openedDocument_(0),
+    openWatcher_(),
+    openProgressDialog_(0),
+    openProgressTimer_(),
+    deferredGeometryTimer_(),
 
     clipboard_(0),
+    isClipboardForeign_(false),
 
     view3D_(0),
     timeline_(0),
+    playbackLabel_(0),
     selectionInfo_(0),
     exportPngDialog_(0),
     editCanvasSizeDialog_(0),
     exportingPng_(false)
 {
+    // Startup time of each step, logged at the end if requested (see the
+    // --startup-times command line option)
+    QElapsedTimer startupTimer;
+    startupTimer.start();
+    QStringList startupSteps;
+
     // Global object
     Global::initialize(this);
 
     // Preferences
     global()->readSettings();
     new DevSettings();
+    startupSteps << QString("settings %1 ms").arg(startupTimer.restart());
 
     // Scene
     scene_ = new Scene();
@@ -103,31 +183,26 @@ MainWindow::MainWindow() :
     connect(scene(), SIGNAL(changed()),
             timeline_, SLOT(update()));
     connect(scene(),SIGNAL(selectionChanged()),timeline_,SLOT(update()));
+    connect(timeline_, SIGNAL(playbackStatsChanged()),
+            this, SLOT(updatePlaybackLabel_()));
 
     // 2D Views
     multiView_ = new MultiView(scene_, this);
     connect(multiView_, SIGNAL(allViewsNeedToUpdate()), timeline_,SLOT(update()));
     connect(multiView_, SIGNAL(allViewsNeedToUpdate()), this, SLOT(update()));
     connect(multiView_, SIGNAL(allViewsNeedToUpdatePicking()), this, SLOT(updatePicking()));
+    connect(multiView_, SIGNAL(allViewsNeedToUpdateHighlight()), timeline_,SLOT(update()));
+    connect(multiView_, SIGNAL(allViewsNeedToUpdateHighlight()), this, SLOT(updateHighlight()));
     setCentralWidget(multiView_); // views are drawn
     connect(multiView_, SIGNAL(activeViewChanged()), this, SLOT(updateViewMenu()));
     connect(multiView_, SIGNAL(activeViewChanged()), timeline_, SLOT(update()));
 
     connect(multiView_, SIGNAL(settingsChanged()), this, SLOT(updateViewMenu()));
 
-    // 3D View
-    view3D_ = new View3D(scene_, 0);
-    view3D_->setParent(this, Qt::Window);
-    //view3D_->show();
-    connect(view3D_, SIGNAL(allViewsNeedToUpdate()), this, SLOT(update()));
-    connect(view3D_, SIGNAL(allViewsNeedToUpdatePicking()), this, SLOT(updatePicking()));
-    connect(multiView_, SIGNAL(activeViewChanged()), view3D_, SLOT(update()));
-    connect(multiView_, SIGNAL(cameraChanged()), view3D_, SLOT(update()));
+    startupSteps << QString("views %1 ms").arg(startupTimer.restart());
 
-    // Selection Info
-    selectionInfo_ = new SelectionInfoWidget(0);
-    connect(scene(),SIGNAL(selectionChanged()),selectionInfo_,SLOT(updateInfo()));
-    //selectionInfo_->show();
+    // The 3D View, which has its own GL context, and the selection info are
+    // created when first used (see createView3D_() and showSelectionInfo())
 
     // redraw when the scene changes
     connect(scene_, SIGNAL(needUpdatePicking()),
@@ -147,6 +222,7 @@ MainWindow::MainWindow() :
     createStatusBar();
     createToolbars();
     createMenus();
+    startupSteps << QString("actions, docks and menus %1 ms").arg(startupTimer.restart());
 
     // handle undo/redo
     resetUndoStack_();
@@ -171,13 +247,32 @@ MainWindow::MainWindow() :
     // Remove context menu on rightclick
     setContextMenuPolicy(Qt::NoContextMenu);
 
-    // Autosave
-    autosaveBegin();
+    // In batch mode, frames are rendered right after the document is
+    // opened: directories of background image sequences are listed right away
+    if(isBatchMode_)
+        BackgroundFileIndex::instance()->setAsync(false);
+
+    // Asynchronous save
+    connect(&saveWatcher_, SIGNAL(finished()), this, SLOT(saveFinished_()));
+
+    // Asynchronous open
+    connect(&openWatcher_, SIGNAL(finished()), this, SLOT(openFinished_()));
+    connect(&openProgressTimer_, SIGNAL(timeout()), this, SLOT(updateOpenProgress_()));
+    connect(&deferredGeometryTimer_, SIGNAL(timeout()), this, SLOT(readDeferredGeometry_()));
+
+    // Autosave, except in batch mode, where the document is never modified
+    if(!isBatchMode_)
+        autosaveBegin();
+    startupSteps << QString("help and autosave %1 ms").arg(startupTimer.restart());
+
+    if(logsStartupTimes)
+        qDebug().noquote() << "Startup:" << startupSteps.join(", ");
 }
 
 void MainWindow::updateObjectProperties()
 {
-    inspector->setObjects(scene()->getVAC_()->selectedCells());
+    if(inspector)
+        inspector->setObjects(scene()->getVAC_()->selectedCells());
 }
 
 View * MainWindow::activeView() const
@@ -195,6 +290,11 @@ Timeline * MainWindow::timeline() const
     return timeline_;
 }
 
+void MainWindow::reportMemory(MemoryStats::Report & report) const
+{
+    report.add(MemoryStats::UndoHistory, undoHistory_->numBytes());
+}
+
 bool MainWindow::isShowCanvasChecked() const
 {
     return actionShowCanvas->isChecked();
@@ -202,7 +302,95 @@ bool MainWindow::isShowCanvasChecked() const
 }
 void MainWindow::autosave()
 {
-    save_(autosaveDir_.absoluteFilePath(autosaveFilename_));
+    // Skip if the previous autosave is not done yet
+    if(autosaveSnapshot_)
+        return;
+
+    // Only append the changes since the last full autosave to its journal,
+    // unless the journal is getting too long compared to a full autosave
+    QString filePath = autosaveDir_.absoluteFilePath(autosaveFilename_);
+    QString journalPath = autosaveJournalFilePath_();
+    if(isAutosaveJournalValid_ &&
+       autosaveJournal_.numDeltas() < MAX_AUTOSAVE_JOURNAL_DELTAS &&
+       QFileInfo(journalPath).size() < QFileInfo(filePath).size() / 2)
+    {
+        QElapsedTimer elapsedTimer;
+        elapsedTimer.start();
+        isAutosaveJournalValid_ = autosaveJournal_.append(journalPath, timeline_->playbackSettings(), scene_);
+        if(autosaveLabel_)
+        {
+            double seconds = elapsedTimer.elapsed() / 1000.0;
+            autosaveLabel_->setText(isAutosaveJournalValid_ ?
+                                    tr("Autosave: %1 s (journal)").arg(seconds, 0, 'f', 1) :
+                                    tr("Autosave failed"));
+        }
+        return;
+    }
+
+    // Copy the document
+    autosaveElapsedTimer_.start();
+    autosaveSnapshot_ = snapshot_();
+    autosaveJournal_.reset(scene_->vectorAnimationComplex());
+    isAutosaveJournalValid_ = false;
+
+    // Write the copy in a worker thread, so that the GUI is never blocked.
+    // The file is replaced only once fully written. The old journal is
+    // removed just before: a crash in between loses recent changes, but
+    // never replays the old journal onto the new file.
+    Scene * snapshot = autosaveSnapshot_;
+    PlaybackSettings playback = timeline_->playbackSettings();
+    autosaveWatcher_.setFuture(QtConcurrent::run([snapshot, playback, filePath, journalPath]() -> bool {
+        QSaveFile file(filePath);
+        if (!file.open(QIODevice::WriteOnly | QFile::Text))
+            return false;
+        {
+            XmlStreamWriter xmlStream(&file);
+            writeDocument_(xmlStream, playback, snapshot);
+        }
+        QFile::remove(journalPath);
+        return file.commit();
+    }));
+}
+
+Scene * MainWindow::snapshot_()
+{
+    // Copying the document is much faster than writing it, since edge
+    // geometries are shared with the copy rather than copied (see
+    // KeyEdge::geometry()), and never modified while shared.
+    Scene * snapshot = new Scene();
+    snapshot->setLeft(scene_->left());
+    snapshot->setTop(scene_->top());
+    snapshot->setWidth(scene_->width());
+    snapshot->setHeight(scene_->height());
+    snapshot->setContent(scene_->vectorAnimationComplex()->clone(), scene_->background());
+    return snapshot;
+}
+
+void MainWindow::autosaveFinished_()
+{
+    // Deleted in the GUI thread, since cells clear shared caches
+    delete autosaveSnapshot_;
+    autosaveSnapshot_ = 0;
+
+    isAutosaveJournalValid_ = autosaveWatcher_.result();
+
+    if(autosaveLabel_)
+    {
+        if(autosaveWatcher_.result())
+        {
+            double seconds = autosaveElapsedTimer_.elapsed() / 1000.0;
+            autosaveLabel_->setText(tr("Autosave: %1 s").arg(seconds, 0, 'f', 1));
+        }
+        else
+        {
+            autosaveLabel_->setText(tr("Autosave failed"));
+        }
+    }
+}
+
+QString MainWindow::autosaveJournalFilePath_() const
+{
+    return autosaveDir_.absoluteFilePath(QString("%1.journal").arg(autosaveIndex_));
 }
 
 void MainWindow::autosaveBegin()
@@ -229,6 +417,18 @@ void MainWindow::autosaveBegin()
         }
         else
         {
+            // Recover autosaves of previous sessions which have not ended
+            // properly, by applying their journal
+            QFileInfoList journals = autosaveDir_.entryInfoList(QStringList("*.journal"), QDir::Files, QDir::Name);
+            foreach(const QFileInfo & journal, journals)
+            {
+                QString document = autosaveDir_.absoluteFilePath(journal.completeBaseName() + ".vec");
+                if(QFile::exists(document) && !AutosaveJournal::replay(document, journal.absoluteFilePath()))
+                    qDebug() << "Warning: failed to recover autosaved file" << document;
+                else
+                    QFile::remove(journal.absoluteFilePath());
+            }
+
             QStringList nameFilters;
             nameFilters << "*.vec";
             autosaveDir_.setNameFilters(nameFilters);
@@ -266,8 +466,10 @@ void MainWindow::autosaveBegin()
     if(success)
     {
         autosaveOn_ = true;
+        undoHistory_->setSpillPath(autosaveDir_.absoluteFilePath(QString("%1.undo").arg(autosaveIndex_)));
         autosaveTimer_.setInterval(60000); // every minute
         connect(&autosaveTimer_,SIGNAL(timeout()), this, SLOT(autosave()));
+        connect(&autosaveWatcher_, SIGNAL(finished()), this, SLOT(autosaveFinished_()));
         autosaveTimer_.start();
     }
     else
@@ -303,16 +505,34 @@ void MainWindow::autosaveBegin()
 
 void MainWindow::autosaveEnd()
 {
+    // Wait for the autosave in progress, if any
+    autosaveWatcher_.waitForFinished();
+    delete autosaveSnapshot_;
+    autosaveSnapshot_ = 0;
+
     if(autosaveOn_)
     {
+        QFile::remove(autosaveJournalFilePath_());
         autosaveDir_.remove(autosaveFilename_);
     }
 }
 
 MainWindow::~MainWindow()
 {
+    SessionRecorder::stop();
+    if(openedDocument_)
+    {
+        openedDocument_->isCanceled = true;
+        openWatcher_.waitForFinished();
+        delete openedDocument_->scene;
+        delete openedDocument_;
+    }
     clearUndoStack_();
+    delete undoHistory_;
     autosaveEnd();
+    saveWatcher_.waitForFinished();
+    delete saveSnapshot_;
+    convertedFileWrite_.waitForFinished();
 }
 
 Scene * MainWindow::scene() const
@@ -323,17 +543,38 @@ Scene * MainWindow::scene() const
 
 void MainWindow::addToUndoStack()
 {
+    OperatorStats::ScopedTimer timer(OperatorStats::AddToUndoStack);
+
     undoIndex_++;
     for(int j=undoStack_.size()-1; j>=undoIndex_; j--)
     {
         delete undoStack_[j].second;
         undoStack_.removeLast();
     }
-    undoStack_ << qMakePair(global()->documentDir(), new Scene());
-    undoStack_[undoIndex_].second->copyFrom(scene_);
+    undoStack_ << qMakePair(global()->documentDir(), new Background(*scene_->background()));
+    undoHistory_->setMaxBytes(std::size_t(DevSettings::getInt("undo memory (MB)")) * 1024 * 1024);
+    undoHistory_->addCheckpoint(scene_->vectorAnimationComplex());
+
+    // The state being saved, if any, is not in the undo stack anymore
+    if(saveUndoIndex_ >= undoIndex_)
+        saveUndoIndex_ = -1;
 
     // Update window title
     updateWindowTitle_();
+    updateUndoMemoryLabel_();
+}
+
+void MainWindow::updateUndoMemoryLabel_()
+{
+    if(!undoMemoryLabel_)
+        return;
+
+    double megabytes = double(undoHistory_->numBytes()) / (1024 * 1024);
+    QString text = tr("Undo: %1 MB").arg(megabytes, 0, 'f', 1);
+    int numSpilled = undoHistory_->numSpilledCheckpoints();
+    if(numSpilled > 0)
+        text += tr(" (%1 on disk)").arg(numSpilled);
+    undoMemoryLabel_->setText(text);
 }
 
 void MainWindow::clearUndoStack_()
@@ -342,7 +583,9 @@ void MainWindow::clearUndoStack_()
         delete p.second;
 
     undoStack_.clear();
+    undoHistory_->clear();
     undoIndex_ = -1;
+    updateUndoMemoryLabel_();
 }
 
 void MainWindow::resetUndoStack_()
@@ -367,14 +610,27 @@ void MainWindow::goToUndoIndex_(int undoIndex)
     }
 
     // Set scene data from undo history
-    scene_->copyFrom(undoStack_[undoIndex].second);
+    scene_->setContent(undoHistory_->goToCheckpoint(undoIndex),
+                       undoStack_[undoIndex].second);
 
     // Update window title
     updateWindowTitle_();
+    updateUndoMemoryLabel_();
+}
+
+void MainWindow::finishSketchedEdge_()
+{
+    // Makes sure that the last sketched edge is inserted and checkpointed
+    // before the undo stack or the file are accessed
+    VectorAnimationComplex::VAC * vac = scene_->vectorAnimationComplex();
+    if(vac)
+        vac->finishSketchEdge();
 }
 
 void MainWindow::undo()
 {
+    SessionRecorder::record(SessionRecorder::Undo);
+    finishSketchedEdge_();
     if(undoIndex_>0)
     {
         goToUndoIndex_(undoIndex_ - 1);
@@ -387,6 +643,8 @@ void MainWindow::undo()
 
 void MainWindow::redo()
 {
+    SessionRecorder::record(SessionRecorder::Redo);
+    finishSketchedEdge_();
     if(undoIndex_<undoStack_.size()-1)
     {
         goToUndoIndex_(undoIndex_ + 1);
@@ -399,27 +657,66 @@ void MainWindow::redo()
 
 void MainWindow::cut()
 {
+    VectorAnimationComplex::VAC * oldClipboard = clipboard_;
     scene_->cut(clipboard_);
+    if(clipboard_ != oldClipboard)
+        clipboardChanged_();
 }
 
 void MainWindow::copy()
 {
+    VectorAnimationComplex::VAC * oldClipboard = clipboard_;
     scene_->copy(clipboard_);
+    if(clipboard_ != oldClipboard)
+        clipboardChanged_();
 }
 
 void MainWindow::paste()
 {
+    readSystemClipboard_();
     scene_->paste(clipboard_);
 }
 
 void MainWindow::motionPaste()
 {
+    // Motion paste matches the pasted cells with those they were copied
+    // from by ID, which is meaningless for cells of another document
+    readSystemClipboard_();
+    if(isClipboardForeign_)
+    {
+        statusBar()->showMessage(tr("Cannot motion paste cells copied from another window"));
+        return;
+    }
     scene_->motionPaste(clipboard_);
 }
 
+void MainWindow::clipboardChanged_()
+{
+    isClipboardForeign_ = false;
+    if(clipboard_ && DevSettings::getBool("system clipboard"))
+        Clipboard::write(clipboard_, scene()->getVAC_()->copyTime());
+}
+
+void MainWindow::readSystemClipboard_()
+{
+    if(!DevSettings::getBool("system clipboard"))
+        return;
+
+    Time copyTime;
+    VectorAnimationComplex::VAC * cells = Clipboard::read(copyTime);
+    if(cells)
+    {
+        delete clipboard_;
+        clipboard_ = cells;
+        scene()->getVAC_()->setCopyTime(copyTime);
+        isClipboardForeign_ = true;
+    }
+}
+
 void MainWindow::editAnimatedCycle(VectorAnimationComplex::InbetweenFace * inbetweenFace, int indexCycle)
 {
     // Make this animated cycle the one edited in the editor
+    createAnimatedCycleEditor_();
     animatedCycleEditor->setAnimatedCycle(inbetweenFace,indexCycle);
 
     // Show editor
@@ -537,6 +834,15 @@ void MainWindow::update()
     }
 }
 
+void MainWindow::updateHighlight()
+{
+    multiView_->updateHighlight();
+    if(view3D_ && view3D_->isVisible())
+    {
+        view3D_->update();
+    }
+}
+
 void MainWindow::updatePicking()
 {
     multiView_->updatePicking();
@@ -565,7 +871,8 @@ void MainWindow::closeEvent(QCloseEvent *event)
     {
         global()->writeSettings();
         event->accept();
-        selectionInfo_->close();
+        if(selectionInfo_)
+            selectionInfo_->close();
     }
     else
     {
@@ -575,6 +882,9 @@ void MainWindow::closeEvent(QCloseEvent *event)
 
 bool MainWindow::maybeSave_()
 {
+    // The document is modified unless its save in progress succeeds
+    finishSave_();
+
     if (isModified_())
     {
         QMessageBox::StandardButton ret;
@@ -583,7 +893,7 @@ bool MainWindow::maybeSave_()
                                       "Do you want to save your changes?"),
                                    QMessageBox::Save | QMessageBox::Discard | QMessageBox::Cancel);
         if (ret == QMessageBox::Save)
-            return save();
+            return save() && finishSave_();
         else if (ret == QMessageBox::Cancel)
             return false;
     }
@@ -612,11 +922,16 @@ void MainWindow::open()
     if (maybeSave_())
     {
         // Browse for a file to open
-        QString filePath = QFileDialog::getOpenFileName(this, tr("Open"), global()->documentDir().path(), tr("Vec files (*.vec)"));
+        QString filePath = QFileDialog::getOpenFileName(this, tr("Open"), global()->documentDir().path(), tr("Vec files (*.vec *.vecb *.vecz)"));
 
         // Open file
         if (!filePath.isEmpty())
-            open_(filePath);
+        {
+            if (DevSettings::getBool("async open"))
+                openAsync_(filePath);
+            else
+                open_(filePath);
+        }
     }
 }
 
@@ -626,6 +941,10 @@ bool MainWindow::save()
     {
         return saveAs();
     }
+    else if(DevSettings::getBool("async save"))
+    {
+        return saveAsync_();
+    }
     else
     {
         bool success = save_(documentFilePath_);
@@ -644,15 +963,85 @@ bool MainWindow::save()
     }
 }
 
+bool MainWindow::saveAsync_()
+{
+    VPAINT_TRACE_ZONE("MainWindow::saveAsync_");
+
+    // Wait for the previous save, if still in progress
+    if(!finishSave_())
+        return false;
+
+    // Copy the document, then write the copy in a worker thread, so that the
+    // document can be edited meanwhile. It is marked as saved only once the
+    // file is replaced by the fully written one.
+    convertedFileWrite_.waitForFinished();
+    finishSketchedEdge_();
+    saveSnapshot_ = snapshot_();
+    saveFilePath_ = documentFilePath_;
+    saveUndoIndex_ = undoIndex_;
+    Scene * snapshot = saveSnapshot_;
+    PlaybackSettings playback = timeline_->playbackSettings();
+    QString filePath = saveFilePath_;
+    QImage preview = drawPreview_();
+    saveWatcher_.setFuture(QtConcurrent::run([snapshot, playback, filePath, preview]() -> bool {
+        return writeDocumentFile_(filePath, playback, snapshot, preview);
+    }));
+    statusBar()->showMessage(tr("Saving %1...").arg(filePath));
+
+    return true;
+}
+
+void MainWindow::saveFinished_()
+{
+    // Already handled by finishSave_()
+    if(!saveSnapshot_)
+        return;
+
+    // Deleted in the GUI thread, since cells clear shared caches
+    delete saveSnapshot_;
+    saveSnapshot_ = 0;
+
+    if(saveWatcher_.result())
+    {
+        statusBar()->showMessage(tr("File %1 successfully saved.").arg(saveFilePath_));
+        if(saveUndoIndex_ >= 0)
+        {
+            savedUndoIndex_ = saveUndoIndex_;
+            updateWindowTitle_();
+        }
+    }
+    else
+    {
+        QMessageBox::warning(this, tr("Error"), tr("File %1 not saved: couldn't write file").arg(saveFilePath_));
+    }
+}
+
+bool MainWindow::finishSave_()
+{
+    if(!saveSnapshot_)
+        return true;
+
+    saveWatcher_.waitForFinished();
+    bool success = saveWatcher_.result();
+    saveFinished_();
+    return success;
+}
+
 bool MainWindow::saveAs()
 {
-    QString filename = QFileDialog::getSaveFileName(this, tr("Save As"), global()->documentDir().path());
+    QString binaryFilter = tr("Binary vec files (*.vecb)");
+    QString compressedFilter = tr("Compressed binary vec files (*.vecz)");
+    QString selectedFilter;
+    QString filename = QFileDialog::getSaveFileName(this, tr("Save As"), global()->documentDir().path(),
+                                                    tr("Vec files (*.vec)") + ";;" + binaryFilter + ";;" + compressedFilter,
+                                                    &selectedFilter);
 
     if (filename.isEmpty())
         return false;
 
-    if(!filename.endsWith(".vec"))
-        filename.append(".vec");
+    if(!filename.endsWith(".vec") && !BinaryContainer::isBinaryFileName(filename))
+        filename.append(selectedFilter == binaryFilter ? ".vecb" :
+                        selectedFilter == compressedFilter ? ".vecz" : ".vec");
 
     bool relativeRemap = true;
     bool success = save_(filename, relativeRemap);
@@ -671,6 +1060,36 @@ bool MainWindow::saveAs()
     }
 }
 
+bool MainWindow::exportSVGSequence()
+{
+    QString filename = QFileDialog::getSaveFileName(this, tr("Export as SVG sequence"), global()->documentDir().path());
+    if (filename.isEmpty())
+        return false;
+
+    if(!filename.endsWith(".svg"))
+        filename.append(".svg");
+
+    QDir dir;
+    QString baseName, suffix;
+    decomposeSequenceFilename_(filename, dir, baseName, suffix);
+
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    bool success = exportSvgSequence_(dir, baseName, suffix, timeline()->firstFrame(), timeline()->lastFrame());
+    QApplication::restoreOverrideCursor();
+
+    if(success)
+    {
+        statusBar()->showMessage(tr("SVG sequence %1 successfully saved.").arg(
+                                     sequenceFilePath_(dir, baseName, suffix, timeline()->firstFrame())));
+        return true;
+    }
+    else
+    {
+        QMessageBox::warning(this, tr("Error"), tr("Files %1 not saved: couldn't write files").arg(filename));
+        return false;
+    }
+}
+
 bool MainWindow::exportSVG()
 {
     QString filename = QFileDialog::getSaveFileName(this, tr("Export as SVG"), global()->documentDir().path());
@@ -680,7 +1099,7 @@ bool MainWindow::exportSVG()
     if(!filename.endsWith(".svg"))
         filename.append(".svg");
 
-    bool success = doExportSVG(filename);
+    bool success = doExportSVG(filename, activeView()->activeTime());
 
     if(success)
     {
@@ -693,6 +1112,76 @@ bool MainWindow::exportSVG()
     }
 }
 
+bool MainWindow::exportRenderStats()
+{
+    QString filename = QFileDialog::getSaveFileName(this, tr("Export Render Statistics"), global()->documentDir().path());
+    if (filename.isEmpty())
+        return false;
+
+    if(!filename.endsWith(".csv"))
+        filename.append(".csv");
+
+    if(RenderStats::exportLog(filename))
+    {
+        return true;
+    }
+    else
+    {
+        QMessageBox::warning(this, tr("Error"), tr("File %1 not saved: couldn't write file").arg(filename));
+        return false;
+    }
+}
+
+void MainWindow::showMemoryStats()
+{
+    MemoryStats::Report report = MemoryStats::log();
+    QMessageBox::information(this, tr("Memory Statistics"), MemoryStats::text(report));
+}
+
+void MainWindow::showSelectionInfo()
+{
+    if(!selectionInfo_)
+    {
+        selectionInfo_ = new SelectionInfoWidget(0);
+        connect(scene(),SIGNAL(selectionChanged()),selectionInfo_,SLOT(updateInfo()));
+    }
+    selectionInfo_->show();
+    selectionInfo_->raise();
+}
+
+void MainWindow::recordSession(bool checked)
+{
+    if(!checked)
+    {
+        SessionRecorder::stop();
+        statusBar()->showMessage(tr("Session recording stopped"));
+        return;
+    }
+
+    QString filename = QFileDialog::getSaveFileName(this, tr("Record Session"), global()->documentDir().path());
+    if (filename.isEmpty())
+    {
+        actionRecordSession->setChecked(false);
+        return;
+    }
+
+    if(!filename.endsWith(".txt"))
+        filename.append(".txt");
+
+    // The document at the beginning of the recording, from which the session
+    // is replayed
+    if(save_(filename + ".vec") && SessionRecorder::start(filename))
+    {
+        statusBar()->showMessage(tr("Recording session to %1").arg(filename));
+    }
+    else
+    {
+        SessionRecorder::stop();
+        actionRecordSession->setChecked(false);
+        QMessageBox::warning(this, tr("Error"), tr("Session not recorded: couldn't write file %1").arg(filename));
+    }
+}
+
 bool MainWindow::exportPNG()
 {
     exportPngFilename_ = QFileDialog::getSaveFileName(this, tr("Export as PNG"), global()->documentDir().path());
@@ -702,6 +1191,29 @@ bool MainWindow::exportPNG()
     if(!exportPngFilename_.endsWith(".png"))
         exportPngFilename_.append(".png");
 
+    showExportPngDialog_(false);
+
+    // The return value doesn't actually make sense here. Maybe this function
+    // shouldn't return anything instead.
+    return true;
+}
+
+bool MainWindow::exportVideo()
+{
+    exportPngFilename_ = QFileDialog::getSaveFileName(this, tr("Export as Video"), global()->documentDir().path());
+    if (exportPngFilename_.isEmpty())
+        return false;
+
+    if(QFileInfo(exportPngFilename_).suffix().isEmpty())
+        exportPngFilename_.append(".mp4");
+
+    showExportPngDialog_(true);
+
+    return true;
+}
+
+void MainWindow::showExportPngDialog_(bool isVideoMode)
+{
     if(!exportPngDialog_)
     {
         exportPngDialog_ = new ExportPngDialog(scene());
@@ -715,15 +1227,12 @@ bool MainWindow::exportPNG()
     if(!exportPngCanvasWasVisible_)
         actionShowCanvas->setChecked(true);
 
+    exportPngDialog_->setVideoMode(isVideoMode);
     exportPngDialog_->show();
 
     // Note: the dialog is modeless to allow user to pan/zoom the image while changing
     //       canvas size and resolution.
     //       But this mean that we can't return here whether or not the export was done
-
-    // The return value doesn't actually make sense here. Maybe this function
-    // shouldn't return anything instead.
-    return true;
 }
 
 bool MainWindow::acceptExportPNG()
@@ -731,7 +1240,9 @@ bool MainWindow::acceptExportPNG()
     exportingPng_ = true; // This is necessary so that isEditCanvasSizeVisible() returns true
                           // so that global()->toolMode() returns EDIT_CANVAS_SIZE so that
                           // selection is not rendered as selected
-    bool success = doExportPNG(exportPngFilename_);
+    bool success = exportPngDialog_->isVideoMode() ?
+                doExportVideo(exportPngFilename_) :
+                doExportPNG(exportPngFilename_);
     exportingPng_ = false;
 
 
@@ -799,20 +1310,77 @@ void MainWindow::updateWindowTitle_()
     setWindowModified(isModified_());
 }
 
-void MainWindow::open_(const QString & filePath)
+bool MainWindow::open_(const QString & filePath)
 {
-    // Convert to newest version if necessary
-    bool conversionSuccessful = FileVersionConverter(filePath).convertToVersion(qApp->applicationVersion(), this);
+    VPAINT_TRACE_ZONE("MainWindow::open_");
+
+    // Cancel the asynchronous open in progress, if any
+    if (openedDocument_)
+    {
+        cancelOpen_();
+        openWatcher_.waitForFinished();
+        openFinished_();
+    }
+
+    // Wait for the previously opened file to be written, if it was converted
+    convertedFileWrite_.waitForFinished();
+
+    // Documents older than the XML format have their own reader
+    if (isLegacyFile_(filePath))
+        return openLegacy_(filePath);
+
+    // Convert to newest version if necessary. With streaming conversion, the
+    // file is converted on the fly while read below, instead of before.
+    bool isConversionStreamed = DevSettings::getBool("streaming file conversion");
+    FileVersionConverter converter(filePath);
+    bool conversionSuccessful = isConversionStreamed ?
+                converter.checkVersion(qApp->applicationVersion(), this) :
+                converter.convertToVersion(qApp->applicationVersion(), this);
 
     // Open (possibly converted) file
     if (conversionSuccessful)
     {
+        bool isBinary = BinaryContainer::isBinary(filePath);
         QFile file(filePath);
-        if (!file.open(QFile::ReadOnly | QFile::Text))
+        if (!file.open(isBinary ? QFile::ReadOnly : QFile::ReadOnly | QFile::Text))
         {
             qDebug() << "Error: cannot open file";
-            QMessageBox::warning(this, tr("Error"), tr("Error: couldn't open file %1").arg(filePath));
-            return;
+            if (!isBatchMode_)
+                QMessageBox::warning(this, tr("Error"), tr("Error: couldn't open file %1").arg(filePath));
+            return false;
+        }
+
+        // Get XML from binary container, mapped in memory until the file is
+        // closed, unless compressed
+        QByteArray xmlData, blocks;
+        QBuffer buffer(&xmlData);
+        if (isBinary)
+        {
+            bool isRead = DevSettings::getBool("memory-mapped loading") ?
+                        BinaryContainer::map(&file, xmlData, blocks) :
+                        BinaryContainer::read(&file, xmlData, blocks);
+            if (!isRead)
+            {
+                qDebug() << "Error: cannot read binary file";
+                if (!isBatchMode_)
+                    QMessageBox::warning(this, tr("Error"), tr("Error: couldn't open file %1").arg(filePath));
+                return false;
+            }
+            buffer.open(QIODevice::ReadOnly);
+        }
+        QIODevice * device = isBinary ? static_cast<QIODevice*>(&buffer) : &file;
+
+        // Convert XML on the fly if necessary. Converted data is kept only if
+        // we write it back to disk afterwards.
+        QScopedPointer<XmlStreamConverterDevice> converterDevice;
+        if (isConversionStreamed && converter.requiresConversion(qApp->applicationVersion()))
+        {
+            converterDevice.reset(converter.createConverterDevice(device));
+            if (converterDevice)
+            {
+                converterDevice->setKeepsConvertedData(DevSettings::getBool("write converted files"));
+                device = converterDevice.data();
+            }
         }
 
         // Set document file path. This must be done before read(xml) because
@@ -821,54 +1389,357 @@ void MainWindow::open_(const QString & filePath)
         setDocumentFilePath_(filePath);
 
         // Create XML stream reader and proceed
-        XmlStreamReader xml(&file);
+        XmlStreamReader xml(device);
+        if (isBinary)
+            xml.setBinaryBlocks(&blocks);
         read(xml);
 
         // Close file
         file.close();
 
+        // Write converted file in a worker thread, so that the document
+        // can be edited right away
+        if (converterDevice && converterDevice->keepsConvertedData() &&
+            converterDevice->isConversionFinished() && !converterDevice->hasConversionError())
+        {
+            convertedFileWrite_ = FileVersionConverter::writeConvertedFile(
+                        filePath, converterDevice->convertedData());
+        }
+
         // Add to undo stack
         resetUndoStack_();
     }
+
+    return conversionSuccessful;
 }
 
-bool MainWindow::save_(const QString & filePath, bool relativeRemap)
+bool MainWindow::isLegacyFile_(const QString & filePath) const
 {
-    // Open file to save to
     QFile file(filePath);
-    if (!file.open(QIODevice::WriteOnly | QFile::Truncate | QFile::Text))
-    {
-        qWarning("Couldn't write file.");
+    if (!file.open(QFile::ReadOnly | QFile::Text))
         return false;
-    }
+    return QString::fromUtf8(file.readLine()).trimmed() == fileHeader_;
+}
 
-    // Remap relative paths if need be
-    if (relativeRemap)
+bool MainWindow::openLegacy_(const QString & filePath)
+{
+    VPAINT_TRACE_ZONE("MainWindow::openLegacy_");
+
+    QFile file(filePath);
+    if (!file.open(QFile::ReadOnly | QFile::Text))
     {
-        QFileInfo fileInfo(file);
-        QDir oldDocumentDir = global()->documentDir();
-        QDir newDocumentDir = fileInfo.dir();
-        if (oldDocumentDir != newDocumentDir)
-        {
-            global()->setDocumentDir(newDocumentDir);
-            scene()->relativeRemap(oldDocumentDir, newDocumentDir);
-        }
+        qDebug() << "Error: cannot open file";
+        if (!isBatchMode_)
+            QMessageBox::warning(this, tr("Error"), tr("Error: couldn't open file %1").arg(filePath));
+        return false;
     }
 
-    // Write to file
-    XmlStreamWriter xmlStream(&file);
-    write(xmlStream);
-
-    // Close file
+    // The legacy reader reads the document token by token: read it from
+    // memory, decoded once, rather than from the file
+    QString data = QString::fromUtf8(file.readAll());
     file.close();
+    QTextStream in(&data);
+
+    // Opened as a new document, so that saving it writes it in the current
+    // format to a file chosen by the user, rather than over the legacy one
+    setDocumentFilePath_("");
+    {
+        Scene::Transaction transaction(scene_);
+        read_DEPRECATED(in);
+    }
+    resetUndoStack_();
+    statusBar()->showMessage(tr("File %1 was opened from a legacy format. Save it to convert it.").arg(filePath));
 
-    // Success
     return true;
 }
 
-void MainWindow::read_DEPRECATED(QTextStream & in)
+struct MainWindow::OpenedDocument
 {
-    // Buffer variables
+    QString filePath;
+    Scene * scene; // read by the worker thread
+    PlaybackSettings playback;
+    bool hasPlayback;
+    QByteArray convertedData; // to write back, if converted on the fly
+    std::atomic<int> progress; // in thousandths
+    std::atomic<bool> isCanceled;
+};
+
+bool MainWindow::openAsync_(const QString & filePath)
+{
+    VPAINT_TRACE_ZONE("MainWindow::openAsync_");
+
+    // Only one document is opened at a time
+    if (openedDocument_)
+        return false;
+
+    // Legacy documents are read synchronously
+    if (isLegacyFile_(filePath))
+        return open_(filePath);
+
+    // Wait for the previously opened file to be written, if it was converted
+    convertedFileWrite_.waitForFinished();
+
+    // Ask the user the same questions as open_()
+    bool isConversionStreamed = DevSettings::getBool("streaming file conversion");
+    FileVersionConverter converter(filePath);
+    bool conversionSuccessful = isConversionStreamed ?
+                converter.checkVersion(qApp->applicationVersion(), this) :
+                converter.convertToVersion(qApp->applicationVersion(), this);
+    if (!conversionSuccessful)
+        return false;
+    bool requiresConversion = isConversionStreamed && converter.requiresConversion(qApp->applicationVersion());
+    bool keepsConvertedData = DevSettings::getBool("write converted files");
+    bool isMapped = DevSettings::getBool("memory-mapped loading");
+
+    // Read the document in a worker thread, into a scene of its own. Only the
+    // geometry at the current frame is read there, so that the document can
+    // be shown as soon as possible: the rest is read by the GUI thread
+    // afterwards (see readDeferredGeometry_()), or in lazy loading mode,
+    // when first needed. Binary geometry can't be deferred and is all read.
+    OpenedDocument * document = new OpenedDocument();
+    document->filePath = filePath;
+    document->scene = 0;
+    document->hasPlayback = false;
+    document->progress = 0;
+    document->isCanceled = false;
+    openedDocument_ = document;
+    int frame = global()->activeTime().frame();
+    QThread * guiThread = thread();
+    openWatcher_.setFuture(QtConcurrent::run([document, converter, requiresConversion,
+                                              keepsConvertedData, isMapped, frame, guiThread]() -> bool {
+        bool isBinary = BinaryContainer::isBinary(document->filePath);
+        QFile file(document->filePath);
+        if (!file.open(isBinary ? QFile::ReadOnly : QFile::ReadOnly | QFile::Text))
+            return false;
+
+        // Get XML from binary container
+        QByteArray xmlData, blocks;
+        QBuffer buffer(&xmlData);
+        if (isBinary)
+        {
+            bool isRead = isMapped ?
+                        BinaryContainer::map(&file, xmlData, blocks) :
+                        BinaryContainer::read(&file, xmlData, blocks);
+            if (!isRead)
+                return false;
+            buffer.open(QIODevice::ReadOnly);
+        }
+        QIODevice * device = isBinary ? static_cast<QIODevice*>(&buffer) : &file;
+
+        // Convert XML on the fly if necessary
+        QScopedPointer<XmlStreamConverterDevice> converterDevice;
+        if (requiresConversion)
+        {
+            converterDevice.reset(converter.createConverterDevice(device));
+            if (converterDevice)
+            {
+                converterDevice->setKeepsConvertedData(keepsConvertedData);
+                device = converterDevice.data();
+            }
+        }
+
+        // Read
+        document->scene = new Scene();
+        XmlStreamReader xml(device);
+        if (isBinary)
+            xml.setBinaryBlocks(&blocks);
+        xml.setProgress(&document->progress, &document->isCanceled);
+        xml.setEagerFrames(frame, frame);
+        bool success = readDocument_(xml, document->playback, document->hasPlayback, document->scene);
+
+        // Objects created by this thread are then used by the GUI thread
+        document->scene->moveToThread(guiThread);
+        if (document->scene->vectorAnimationComplex())
+            document->scene->vectorAnimationComplex()->moveToThread(guiThread);
+
+        if (success && converterDevice && converterDevice->keepsConvertedData() &&
+            converterDevice->isConversionFinished() && !converterDevice->hasConversionError())
+        {
+            document->convertedData = converterDevice->convertedData();
+        }
+        return success;
+    }));
+
+    // Show progress, once it takes long enough to be noticed
+    openProgressDialog_ = new QProgressDialog(
+                tr("Opening %1...").arg(QFileInfo(filePath).fileName()),
+                tr("Cancel"), 0, 1000, this);
+    openProgressDialog_->setWindowModality(Qt::WindowModal);
+    openProgressDialog_->setMinimumDuration(500);
+    openProgressDialog_->setAutoReset(false);
+    connect(openProgressDialog_, SIGNAL(canceled()), this, SLOT(cancelOpen_()));
+    openProgressTimer_.start(100);
+
+    return true;
+}
+
+void MainWindow::updateOpenProgress_()
+{
+    if (openedDocument_ && openProgressDialog_)
+        openProgressDialog_->setValue(openedDocument_->progress);
+}
+
+void MainWindow::cancelOpen_()
+{
+    if (openedDocument_)
+        openedDocument_->isCanceled = true;
+}
+
+void MainWindow::openFinished_()
+{
+    // Already handled by open_()
+    if (!openedDocument_)
+        return;
+
+    OpenedDocument * document = openedDocument_;
+    openedDocument_ = 0;
+    openProgressTimer_.stop();
+    delete openProgressDialog_;
+    openProgressDialog_ = 0;
+
+    if (document->isCanceled)
+    {
+        statusBar()->showMessage(tr("Opening %1 canceled.").arg(document->filePath));
+    }
+    else if (!openWatcher_.result())
+    {
+        qDebug() << "Error: cannot open file";
+        QMessageBox::warning(this, tr("Error"), tr("Error: couldn't open file %1").arg(document->filePath));
+    }
+    else
+    {
+        // As in open_(), the document file path must be set first
+        setDocumentFilePath_(document->filePath);
+        if (document->hasPlayback)
+            timeline_->setPlaybackSettings(document->playback);
+        scene_->takeContent(document->scene);
+
+        // Write converted file in a worker thread
+        if (!document->convertedData.isEmpty())
+        {
+            convertedFileWrite_ = FileVersionConverter::writeConvertedFile(
+                        document->filePath, document->convertedData);
+        }
+
+        // Add to undo stack
+        resetUndoStack_();
+
+        // Read the rest of the geometry
+        if (!DevSettings::getBool("lazy loading"))
+            deferredGeometryTimer_.start(0);
+    }
+
+    // Deleted in the GUI thread, since cells clear shared caches
+    delete document->scene;
+    delete document;
+}
+
+void MainWindow::readDeferredGeometry_()
+{
+    VectorAnimationComplex::VAC * vac = scene_->vectorAnimationComplex();
+    int numRemaining = vac ? vac->readDeferredGeometry(global()->activeTime(), DEFERRED_GEOMETRY_BATCH_SIZE) : 0;
+    if (numRemaining == 0)
+        deferredGeometryTimer_.stop();
+}
+
+bool MainWindow::readDocument_(XmlStreamReader & xml, PlaybackSettings & playback,
+                               bool & hasPlayback, Scene * scene)
+{
+    // Same as read(), into the given scene and playback settings
+    if (!xml.readNextStartElement() || xml.name() != "vec")
+        return false;
+
+    int numLayer = 0;
+    while (xml.readNextStartElement())
+    {
+        if (xml.name() == "playback")
+        {
+            playback.read(xml);
+            hasPlayback = true;
+        }
+        else if (xml.name() == "canvas")
+        {
+            scene->readCanvas(xml);
+        }
+        else if (xml.name() == "layer")
+        {
+            ++numLayer;
+            if (numLayer == 1)
+                scene->read(xml);
+            else
+                xml.skipCurrentElement();
+        }
+        else
+        {
+            xml.skipCurrentElement();
+        }
+    }
+
+    return !xml.isCanceled();
+}
+
+bool MainWindow::save_(const QString & filePath, bool relativeRemap)
+{
+    VPAINT_TRACE_ZONE("MainWindow::save_");
+
+    // Wait for the opened file to be written, if it was converted, and for
+    // the asynchronous save in progress, if any
+    convertedFileWrite_.waitForFinished();
+    finishSave_();
+    finishSketchedEdge_();
+
+    // Open file to save to
+    bool isBinary = BinaryContainer::isBinaryFileName(filePath);
+    QFile file(filePath);
+    if (!file.open(isBinary ? QIODevice::WriteOnly | QFile::Truncate :
+                              QIODevice::WriteOnly | QFile::Truncate | QFile::Text))
+    {
+        qWarning("Couldn't write file.");
+        return false;
+    }
+
+    // Remap relative paths if need be
+    if (relativeRemap)
+    {
+        QFileInfo fileInfo(file);
+        QDir oldDocumentDir = global()->documentDir();
+        QDir newDocumentDir = fileInfo.dir();
+        if (oldDocumentDir != newDocumentDir)
+        {
+            global()->setDocumentDir(newDocumentDir);
+            scene()->relativeRemap(oldDocumentDir, newDocumentDir);
+        }
+    }
+
+    // Write to file
+    bool success = true;
+    if (isBinary)
+    {
+        QByteArray xmlData, blocks;
+        QBuffer buffer(&xmlData);
+        buffer.open(QIODevice::WriteOnly);
+        XmlStreamWriter xmlStream(&buffer);
+        xmlStream.setBinaryBlocks(&blocks);
+        write(xmlStream);
+        buffer.close();
+        success = BinaryContainer::write(&file, xmlData, blocks,
+                                         BinaryContainer::isCompressedFileName(filePath));
+    }
+    else
+    {
+        XmlStreamWriter xmlStream(&file);
+        write(xmlStream);
+    }
+
+    // Close file
+    file.close();
+
+    return success;
+}
+
+void MainWindow::read_DEPRECATED(QTextStream & in)
+{
+    // Buffer variables
     QChar cskip;
     QString field;
 
@@ -910,6 +1781,75 @@ void MainWindow::write_DEPRECATED(QTextStream & out)
 }
 
 void MainWindow::write(XmlStreamWriter &xml)
+{
+    writeDocument_(xml, timeline()->playbackSettings(), scene(), drawPreview_());
+}
+
+// Preview of the document, written in its info (see DocumentInfo): the
+// canvas at the current time, as exported to PNG, scaled to fit in
+// DocumentInfo::PREVIEW_SIZE pixels. Null if not drawn.
+QImage MainWindow::drawPreview_()
+{
+    double w = scene()->width();
+    double h = scene()->height();
+    if(!DevSettings::getBool("document preview") || !isVisible() || w <= 0 || h <= 0)
+        return QImage();
+
+    double scale = DocumentInfo::PREVIEW_SIZE / qMax(w, h);
+    int imgW = qMax(1, qRound(w * scale));
+    int imgH = qMax(1, qRound(h * scale));
+
+    // Selected cells, if any, are not drawn as selected
+    exportingPng_ = true;
+    QImage res = activeView()->drawToImage(
+                activeView()->activeTime(),
+                scene()->left(), scene()->top(), w, h,
+                imgW, imgH, false);
+    exportingPng_ = false;
+
+    return res;
+}
+
+// Static, and only reads its arguments, so that it can be called from a
+// worker thread (see saveAsync_()). The file is replaced only once fully
+// written.
+bool MainWindow::writeDocumentFile_(const QString & filePath, const PlaybackSettings & playback, Scene * scene,
+                                    const QImage & preview)
+{
+    bool isBinary = BinaryContainer::isBinaryFileName(filePath);
+    QSaveFile file(filePath);
+    if (!file.open(isBinary ? QIODevice::WriteOnly : QIODevice::WriteOnly | QFile::Text))
+    {
+        qWarning("Couldn't write file.");
+        return false;
+    }
+
+    bool success = true;
+    if (isBinary)
+    {
+        QByteArray xmlData, blocks;
+        QBuffer buffer(&xmlData);
+        buffer.open(QIODevice::WriteOnly);
+        XmlStreamWriter xmlStream(&buffer);
+        xmlStream.setBinaryBlocks(&blocks);
+        writeDocument_(xmlStream, playback, scene, preview);
+        buffer.close();
+        success = BinaryContainer::write(&file, xmlData, blocks,
+                                         BinaryContainer::isCompressedFileName(filePath));
+    }
+    else
+    {
+        XmlStreamWriter xmlStream(&file);
+        writeDocument_(xmlStream, playback, scene, preview);
+    }
+
+    return success && file.commit();
+}
+
+// Static, and only reads its arguments, so that it can be called from a
+// worker thread (see autosave())
+void MainWindow::writeDocument_(XmlStreamWriter & xml, const PlaybackSettings & playback, Scene * scene,
+                               const QImage & preview)
 {
     // Start XML Document
     xml.writeStartDocument();
@@ -925,6 +1865,12 @@ void MainWindow::write(XmlStreamWriter &xml)
         bool ignorePatch = true;
         xml.writeAttribute("version", version.toString(ignorePatch));
 
+        // Info, first so that it can be read without reading the rest of
+        // the document (see DocumentInfo::readFile())
+        xml.writeStartElement("info");
+        DocumentInfo(playback, scene, preview).write(xml);
+        xml.writeEndElement();
+
         // Metadata such as author and license? Different options:
         //   1) as comments in header (issue: not part of document or XML spec, cross-editor compatibility issues)
         //   2) as attributes of vec
@@ -941,189 +1887,893 @@ void MainWindow::write(XmlStreamWriter &xml)
 
         // Playback
         xml.writeStartElement("playback");
-        timeline()->write(xml);
+        playback.write(xml);
+        xml.writeEndElement();
+
+        // Canvas
+        xml.writeStartElement("canvas");
+        scene->writeCanvas(xml);
+        xml.writeEndElement();
+
+        // Layer
+        xml.writeStartElement("layer");
+        scene->write(xml);
         xml.writeEndElement();
+    }
+    xml.writeEndElement();
+
+    // End XML Document
+    xml.writeEndDocument();
+}
+
+void MainWindow::read(XmlStreamReader & xml)
+{
+    if (xml.readNextStartElement())
+    {
+        if (xml.name() != "vec")
+        {
+            QMessageBox::warning(this,
+                "Cannot open file",
+                "Sorry, the file you are trying to open is an invalid VEC file.");
+            return;
+        }
+
+        // Canvas and layer are read separately, but notify them as one change
+        Scene::Transaction transaction(scene_);
+
+        int numLayer = 0;
+        while (xml.readNextStartElement())
+        {
+            // Playback
+            if (xml.name() == "playback")
+            {
+                timeline_->read(xml);
+            }
+
+            // Canvas
+            else if (xml.name() == "canvas")
+            {
+                scene_->readCanvas(xml);
+            }
+
+            // Layer
+            else if (xml.name() == "layer")
+            {
+                // For now, only supports one layer, i.e., it reads the first one and
+                // ignore all the others
+                ++numLayer;
+                if(numLayer == 1)
+                {
+                    scene_->read(xml);
+                }
+                else
+                {
+                    xml.skipCurrentElement();
+                }
+            }
+
+            // Unknown
+            else
+            {
+                xml.skipCurrentElement();
+            }
+        }
+    }
+}
+
+bool MainWindow::doExportSVG(const QString & filename, Time t)
+{
+    if(writeSVG_(filename, scene_, t))
+    {
+        if(!isBatchMode_)
+            statusBar()->showMessage(tr("File %1 successfully saved.").arg(filename));
+        return true;
+    }
+    else
+    {
+        return false;
+    }
+}
+
+bool MainWindow::writeSVG_(const QString & filename, Scene * scene, Time t)
+{
+    QFile data(filename);
+    if (data.open(QFile::WriteOnly | QFile::Truncate)) {
+
+        SvgStreamWriter out(&data);
+
+        out << "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"no\"?>\n"
+               "<!-- Created with VPaint (http://www.vpaint.org/) -->\n\n"
+
+               "<!DOCTYPE svg PUBLIC \"-//W3C//DTD SVG 1.1//EN\"\n"
+               "  \"http://www.w3.org/Graphics/SVG/1.1/DTD/svg11.dtd\">\n"
+               "<svg \n"
+               "  viewBox=\""
+            << scene->left() << " "
+            << scene->top() << " "
+            << scene->width() << " "
+            << scene->height() << "\"\n"
+               "  xmlns=\"http://www.w3.org/2000/svg\"\n"
+               "  xmlns:xlink=\"http://www.w3.org/1999/xlink\">\n";
+
+        scene->exportSVG(t, out);
+
+        out << "</svg>";
+
+        return out.flush();
+    }
+    else
+    {
+        qDebug() << "Error: cannot open file";
+        return false;
+    }
+}
+
+bool MainWindow::exportSvgSequence_(const QDir & dir, const QString & baseName, const QString & suffix,
+                                    int firstFrame, int lastFrame)
+{
+    // Frames are exported concurrently, each one by a worker thread
+    // writing to its own file
+    struct Task
+    {
+        int frame;
+        QString filePath;
+        bool success;
+    };
+    std::vector<Task> tasks;
+    for(int i=firstFrame; i<=lastFrame; ++i)
+    {
+        Task task;
+        task.frame = i;
+        task.filePath = sequenceFilePath_(dir, baseName, suffix, i);
+        task.success = false;
+        tasks.push_back(task);
+    }
+
+    Scene * scene = scene_;
+    scene->prepareExportSVG();
+    QtConcurrent::blockingMap(tasks, [scene](Task & task) {
+        task.success = writeSVG_(task.filePath, scene, Time(task.frame));
+    });
+
+    bool success = true;
+    for(const Task & task: tasks)
+        success = success && task.success;
+    return success;
+}
+
+bool MainWindow::doExportPNG(const QString & filename)
+{
+    const int width = exportPngDialog_->pngWidth();
+    const int height = exportPngDialog_->pngHeight();
+    const bool useViewSettings = exportPngDialog_->useViewSettings();
+
+    if(!exportPngDialog_->exportSequence())
+    {
+        // Export single frame
+        return exportPngFrame_(activeView()->activeTime(), filename, width, height, useViewSettings);
+    }
+    else
+    {
+        // Export sequence of frames
+
+        // Decompose filename into dir + basename + suffix
+        QDir dir;
+        QString baseName, suffix;
+        decomposeSequenceFilename_(filename, dir, baseName, suffix);
+
+        // Get and delete files from previous export
+        QString nameFilter = baseName + QString("_*.") +  suffix;
+        QStringList nameFilters = QStringList() << nameFilter;
+        QStringList prevFiles = dir.entryList(nameFilters, QDir::Files);
+        foreach(QString prevFile, prevFiles)
+            dir.remove(prevFile);
+
+        // Get frame numbers to export
+        int firstFrame = timeline()->firstFrame();
+        int lastFrame = timeline()->lastFrame();
+
+        // Create Progress dialog for feedback
+        QProgressDialog progress("Export sequence as PNGs...", "Abort", 0, lastFrame-firstFrame+1, this);
+        progress.setWindowModality(Qt::WindowModal);
+
+        // Export all frames in the sequence, in several processes if the
+        // document can be read by them as is, i.e. if it is saved
+        static const DevSettings::Int exportProcesses("export processes");
+        bool success = false;
+        if(exportProcesses > 1 && !useViewSettings && !isNewDocument_() && !isModified_() &&
+           filename.endsWith(".png"))
+        {
+            BatchRenderOptions options;
+            options.inputPath = documentFilePath_;
+            options.outputPath = filename;
+            options.width = width;
+            options.height = height;
+            options.isSequence = true;
+            options.firstFrame = firstFrame;
+            options.lastFrame = lastFrame;
+            success = RenderShards::render(options, exportProcesses, &progress);
+        }
+        else
+        {
+            success = exportPngSequence_(dir, baseName, suffix, firstFrame, lastFrame,
+                                         width, height, useViewSettings, &progress);
+        }
+        progress.setValue(lastFrame-firstFrame+1);
+
+        return success;
+    }
+}
+
+bool MainWindow::doExportVideo(const QString & filename)
+{
+    const int width = exportPngDialog_->pngWidth();
+    const int height = exportPngDialog_->pngHeight();
+    const bool useViewSettings = exportPngDialog_->useViewSettings();
+
+    // Get frame numbers to export
+    int firstFrame = timeline()->firstFrame();
+    int lastFrame = timeline()->lastFrame();
+
+    // Start encoder
+    VideoEncoder encoder;
+    if(!encoder.start(exportPngDialog_->videoEncoder(), exportPngDialog_->videoEncoderOptions(),
+                      filename, width, height, timeline()->fps()))
+    {
+        qDebug() << "Error:" << encoder.errorString();
+        return false;
+    }
+
+    // Create Progress dialog for feedback
+    QProgressDialog progress("Export sequence as video...", "Abort", 0, lastFrame-firstFrame+1, this);
+    progress.setWindowModality(Qt::WindowModal);
+
+    // Frames are rendered in this thread, which owns the OpenGL context,
+    // while the encoder processes previous frames
+    bool success = true;
+    for(int i=firstFrame; success && i<=lastFrame; ++i)
+    {
+        progress.setValue(i-firstFrame);
+        if (progress.wasCanceled())
+            break;
+
+        prefetchExportGeometry_(i);
+        QImage img = activeView()->drawToImage(
+                    Time(i),
+                    scene()->left(), scene()->top(), scene()->width(), scene()->height(),
+                    width, height, useViewSettings);
+
+        success = encoder.writeFrame(img);
+    }
+    success = success && encoder.finish();
+    progress.setValue(lastFrame-firstFrame+1);
+
+    if(!success)
+        qDebug() << "Error:" << encoder.errorString();
+
+    return success;
+}
+
+void MainWindow::decomposeSequenceFilename_(const QString & filename, QDir & dir, QString & baseName, QString & suffix)
+{
+    // Decompose filename into basename + suffix. Example:
+    //     abc_1234_5678.de.png  ->   abc_1234  +  de.png
+    QFileInfo info(filename);
+    baseName = info.baseName();
+    suffix = info.suffix();
+    // Decompose basename into cleanedbasename + numbering. Examples:
+    //     abc_1234_5678  ->     abc_1234 + 5678
+    int iNumbering = baseName.indexOf(QRegExp("_[0-9]*$"));
+    if(iNumbering != -1)
+    {
+        baseName.chop(baseName.length() - iNumbering);
+    }
+
+    // Get dir
+    dir = info.absoluteDir();
+}
+
+QString MainWindow::sequenceFilePath_(const QDir & dir, const QString & baseName, const QString & suffix, int frame)
+{
+    QString number = QString("%1").arg(frame, 4, 10, QChar('0'));
+    return dir.absoluteFilePath(baseName + QString("_") + number + QString(".") + suffix);
+}
+
+// Triangulates the cells of the given frame in parallel before it is drawn,
+// instead of one by one while drawing it. This blocks until done: the next
+// frames are not triangulated while this one is drawn, since the geometry
+// caches of inbetween cells are not thread-safe
+void MainWindow::prefetchExportGeometry_(int frame)
+{
+    static const DevSettings::Bool exportPrefetch("export geometry prefetch");
+    if(exportPrefetch)
+        scene()->getVAC_()->prefetchGeometry(Time(frame));
+}
+
+bool MainWindow::exportPngFrame_(Time t, const QString & filePath, int width, int height, bool useViewSettings)
+{
+    // Large images are drawn tile by tile and streamed to the file, instead
+    // of being drawn and held in memory at once
+    if(width > MAX_UNTILED_EXPORT_SIZE || height > MAX_UNTILED_EXPORT_SIZE)
+    {
+        return activeView()->drawToPng(
+                    t,
+                    scene()->left(), scene()->top(), scene()->width(), scene()->height(),
+                    width, height, useViewSettings, filePath);
+    }
+    else
+    {
+        QImage img = activeView()->drawToImage(
+                    t,
+                    scene()->left(), scene()->top(), scene()->width(), scene()->height(),
+                    width, height, useViewSettings);
+
+        return img.save(filePath);
+    }
+}
+
+bool MainWindow::exportPngSequence_(const QDir & dir, const QString & baseName, const QString & suffix,
+                                    int firstFrame, int lastFrame, int width, int height, bool useViewSettings,
+                                    QProgressDialog * progress, bool printProgress)
+{
+    // Frames are rendered in this thread, which owns the OpenGL context,
+    // while previous frames are encoded and written by worker threads. The
+    // number of frames in flight is bounded, to bound memory usage.
+    const int maxPendingFrames = QThreadPool::globalInstance()->maxThreadCount() + 1;
+    const bool isTiledExport = width > MAX_UNTILED_EXPORT_SIZE || height > MAX_UNTILED_EXPORT_SIZE;
+    QList< QFuture<bool> > pendingFrames;
+    bool success = true;
+    for(int i=firstFrame; i<=lastFrame; ++i)
+    {
+        if(progress)
+        {
+            progress->setValue(i-firstFrame);
+            if (progress->wasCanceled())
+                break;
+        }
+
+        QString filePath = sequenceFilePath_(dir, baseName, suffix, i);
+
+        prefetchExportGeometry_(i);
+
+        // Tiled frames are already streamed to the file while being drawn
+        if(isTiledExport)
+        {
+            success = exportPngFrame_(Time(i), filePath, width, height, useViewSettings) && success;
+            if(printProgress)
+            {
+                QTextStream out(stdout);
+                out << "frame " << i << "\n";
+                out.flush();
+            }
+            continue;
+        }
+
+        QImage img = activeView()->drawToImage(
+                    Time(i),
+                    scene()->left(), scene()->top(), scene()->width(), scene()->height(),
+                    width, height, useViewSettings);
+
+        while(pendingFrames.size() >= maxPendingFrames)
+            success = pendingFrames.takeFirst().result() && success;
+        pendingFrames << QtConcurrent::run([img, filePath]() -> bool {
+            return img.save(filePath);
+        });
+
+        // Read by the parent process, see RenderShards
+        if(printProgress)
+        {
+            QTextStream out(stdout);
+            out << "frame " << i << "\n";
+            out.flush();
+        }
+    }
+
+    // Wait for the frames being written, even if aborted, so that no
+    // file is written after returning
+    while(!pendingFrames.isEmpty())
+        success = pendingFrames.takeFirst().result() && success;
+
+    return success;
+}
+
+bool MainWindow::renderBatch(const BatchRenderOptions & options)
+{
+    QTextStream err(stderr);
+
+    // Frames split across child processes, which open the document instead
+    // of this one
+    if(options.isSequence && options.numProcesses > 1 && options.outputPath.endsWith(".png"))
+        return RenderShards::render(options, options.numProcesses);
+
+    // Threads used for loading, triangulating, and encoding
+    if(options.numThreads > 0)
+        QThreadPool::globalInstance()->setMaxThreadCount(options.numThreads);
+
+    // Open document
+    if(!QFileInfo(options.inputPath).isFile() || !open_(options.inputPath))
+    {
+        err << "Error: couldn't open file " << options.inputPath << "\n";
+        return false;
+    }
+
+    // Frame rendered if no frame range is given
+    Time t = activeView()->activeTime();
+
+    // Selected cells, if any, are not drawn as selected
+    exportingPng_ = true;
+
+    bool success = true;
+    if(options.outputPath.endsWith(".svg"))
+    {
+        if(!options.isSequence)
+        {
+            success = doExportSVG(options.outputPath, t);
+        }
+        else
+        {
+            QDir dir;
+            QString baseName, suffix;
+            decomposeSequenceFilename_(options.outputPath, dir, baseName, suffix);
+            success = exportSvgSequence_(dir, baseName, suffix, options.firstFrame, options.lastFrame);
+        }
+    }
+    else
+    {
+        // Draw offscreen using the OpenGL context of the active view, which
+        // is never shown
+        activeView()->initializeOffscreen();
+
+        int width = options.width;
+        int height = options.height;
+        if(width == 0 || height == 0)
+        {
+            width = qMax(1, qRound(scene()->width()));
+            height = qMax(1, qRound(scene()->height()));
+        }
+
+        if(!options.isSequence)
+        {
+            success = exportPngFrame_(t, options.outputPath, width, height, false);
+        }
+        else
+        {
+            QDir dir;
+            QString baseName, suffix;
+            decomposeSequenceFilename_(options.outputPath, dir, baseName, suffix);
+            success = exportPngSequence_(dir, baseName, suffix, options.firstFrame, options.lastFrame,
+                                         width, height, false, 0, options.printProgress);
+        }
+    }
+
+    exportingPng_ = false;
+
+    if(!success)
+        err << "Error: couldn't render file " << options.outputPath << "\n";
+
+    return success;
+}
+
+namespace
+{
+
+// Performs the VAC calls that the view performed when the event was recorded
+void replayEvent_(Scene * scene, const SessionRecorder::Event & event)
+{
+    VectorAnimationComplex::VAC * vac = scene->vectorAnimationComplex();
+    const Time time(event.time);
+    const double x = event.x;
+    const double y = event.y;
 
-        // Canvas
-        xml.writeStartElement("canvas");
-        scene()->writeCanvas(xml);
-        xml.writeEndElement();
+    switch(event.type)
+    {
+    case SessionRecorder::BeginSketch: vac->beginSketchEdge(x, y, event.width, time); break;
+    case SessionRecorder::ContinueSketch: vac->continueSketchEdge(x, y, event.width); break;
+    case SessionRecorder::EndSketch: vac->endSketchEdge(); break;
+    case SessionRecorder::UpdateSculpt: vac->updateSculpt(x, y, time); break;
+    case SessionRecorder::BeginSculptDeform: vac->beginSculptDeform(x, y); break;
+    case SessionRecorder::ContinueSculptDeform: vac->continueSculptDeform(x, y); break;
+    case SessionRecorder::EndSculptDeform: vac->endSculptDeform(); vac->updateSculpt(x, y, time); break;
+    case SessionRecorder::BeginSculptWidth: vac->beginSculptEdgeWidth(x, y); break;
+    case SessionRecorder::ContinueSculptWidth: vac->continueSculptEdgeWidth(x, y); break;
+    case SessionRecorder::EndSculptWidth: vac->endSculptEdgeWidth(); vac->updateSculpt(x, y, time); break;
+    case SessionRecorder::BeginSculptSmooth: vac->beginSculptSmooth(x, y); break;
+    case SessionRecorder::ContinueSculptSmooth: vac->continueSculptSmooth(x, y); break;
+    case SessionRecorder::EndSculptSmooth: vac->endSculptSmooth(); vac->updateSculpt(x, y, time); break;
+    case SessionRecorder::Select: scene->select(time, 0, event.id); break;
+    case SessionRecorder::Deselect: scene->deselect(time, 0, event.id); break;
+    case SessionRecorder::Toggle: scene->toggle(time, 0, event.id); break;
+    case SessionRecorder::DeselectAll: scene->deselectAll(); break;
+    case SessionRecorder::Split: vac->split(x, y, time, true); break;
+    case SessionRecorder::Paint: vac->paint(x, y, time); break;
+    case SessionRecorder::BeginDragAndDrop: vac->prepareDragAndDrop(x, y, time); break;
+    case SessionRecorder::ContinueDragAndDrop: vac->performDragAndDrop(x, y); break;
+    case SessionRecorder::EndDragAndDrop: vac->completeDragAndDrop(); break;
+    case SessionRecorder::BeginTransform: vac->beginTransformSelection(x, y, time); break;
+    case SessionRecorder::ContinueTransform: vac->continueTransformSelection(x, y); break;
+    case SessionRecorder::EndTransform: vac->endTransformSelection(); break;
+    case SessionRecorder::BeginRectangleOfSelection: vac->beginRectangleOfSelection(x, y, time); break;
+    case SessionRecorder::ContinueRectangleOfSelection: vac->continueRectangleOfSelection(x, y); break;
+    case SessionRecorder::EndRectangleOfSelection: vac->endRectangleOfSelection(); break;
+    default: break;
+    }
+}
 
-        // Layer
-        xml.writeStartElement("layer");
-        scene()->write(xml);
-        xml.writeEndElement();
+// Sets the hovered cell and sculpt radius as they were when the event was
+// recorded, which the view determined by picking before the event
+void prepareReplayEvent_(Scene * scene, const SessionRecorder::Event & event)
+{
+    VectorAnimationComplex::VAC * vac = scene->vectorAnimationComplex();
+    if(event.id >= 0)
+        vac->setHoveredObject(Time(event.time), event.id);
+    else
+        vac->setNoHoveredObject();
+    if(event.width > 0 && event.type >= SessionRecorder::UpdateSculpt &&
+                          event.type <= SessionRecorder::EndSculptSmooth)
+    {
+        global()->setSculptRadius(event.width);
     }
-    xml.writeEndElement();
+}
 
-    // End XML Document
-    xml.writeEndDocument();
+// Nearest-rank percentile of sorted latencies
+double percentile_(const QVector<double> & sortedLatencies, double p)
+{
+    int i = qCeil(p * sortedLatencies.size()) - 1;
+    return sortedLatencies[qBound(0, i, sortedLatencies.size() - 1)];
 }
 
-void MainWindow::read(XmlStreamReader & xml)
+QJsonObject latencies_(const QString & scene, const QString & operation, QVector<double> latencies)
 {
-    if (xml.readNextStartElement())
+    std::sort(latencies.begin(), latencies.end());
+    double total = 0;
+    for(double latency: latencies)
+        total += latency;
+
+    QJsonObject res;
+    res["scene"] = scene;
+    res["operation"] = operation;
+    res["count"] = latencies.size();
+    res["milliseconds"] = total;
+    res["p50"] = percentile_(latencies, 0.5);
+    res["p90"] = percentile_(latencies, 0.9);
+    res["p99"] = percentile_(latencies, 0.99);
+    res["max"] = latencies.last();
+    return res;
+}
+
+}
+
+bool MainWindow::replaySession(const BenchmarkOptions & options)
+{
+    QTextStream err(stderr);
+
+    QList<SessionRecorder::Event> events;
+    if(!SessionRecorder::read(options.replayPath, events))
     {
-        if (xml.name() != "vec")
-        {
-            QMessageBox::warning(this,
-                "Cannot open file",
-                "Sorry, the file you are trying to open is an invalid VEC file.");
-            return;
-        }
+        err << "Error: couldn't read session " << options.replayPath << "\n";
+        return false;
+    }
 
-        int numLayer = 0;
-        while (xml.readNextStartElement())
-        {
-            // Playback
-            if (xml.name() == "playback")
-            {
-                timeline_->read(xml);
-            }
+    if(!open_(options.replayPath + ".vec"))
+    {
+        err << "Error: couldn't open file " << options.replayPath << ".vec\n";
+        return false;
+    }
 
-            // Canvas
-            else if (xml.name() == "canvas")
-            {
-                scene_->readCanvas(xml);
-            }
+    QFile file(options.outputPath);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Text))
+    {
+        err << "Error: couldn't write file " << options.outputPath << "\n";
+        return false;
+    }
 
-            // Layer
-            else if (xml.name() == "layer")
-            {
-                // For now, only supports one layer, i.e., it reads the first one and
-                // ignore all the others
-                ++numLayer;
-                if(numLayer == 1)
-                {
-                    scene_->read(xml);
-                }
-                else
-                {
-                    xml.skipCurrentElement();
-                }
-            }
+    // Replay events, timing only the calls made by the view, not the picking
+    // that determined the hovered object
+    QVector< QVector<double> > latencies(SessionRecorder::NumEventTypes);
+    QVector<double> allLatencies;
+    QElapsedTimer timer;
+    timer.start();
+    foreach(const SessionRecorder::Event & event, events)
+    {
+        prepareReplayEvent_(scene(), event);
 
-            // Unknown
-            else
-            {
-                xml.skipCurrentElement();
-            }
+        const qint64 start = timer.nsecsElapsed();
+        if(event.type == SessionRecorder::Undo)
+            undo();
+        else if(event.type == SessionRecorder::Redo)
+            redo();
+        else
+            replayEvent_(scene(), event);
+        const double latency = (timer.nsecsElapsed() - start) * 1e-6;
+
+        latencies[event.type] << latency;
+        allLatencies << latency;
+    }
+
+    const QString sessionName = QFileInfo(options.replayPath).fileName();
+    QJsonArray results;
+    for(int i=0; i<SessionRecorder::NumEventTypes; ++i)
+    {
+        if(!latencies[i].isEmpty())
+        {
+            SessionRecorder::EventType type = static_cast<SessionRecorder::EventType>(i);
+            results << latencies_(sessionName, SessionRecorder::eventName(type), latencies[i]);
         }
     }
+    if(!allLatencies.isEmpty())
+        results << latencies_(sessionName, "all", allLatencies);
+
+    QJsonObject json;
+    json["session"] = options.replayPath;
+    json["numEvents"] = events.size();
+    json["results"] = results;
+    file.write(QJsonDocument(json).toJson());
+    return true;
 }
 
-bool MainWindow::doExportSVG(const QString & filename)
+namespace
 {
-    QFile data(filename);
-    if (data.open(QFile::WriteOnly | QFile::Truncate | QFile::Text)) {
 
-        QTextStream out(&data);
+// Period of the memory samples of the soak test, in milliseconds
+const int SOAK_SAMPLE_INTERVAL = 10000;
 
-        QString header = QString(
-                "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"no\"?>\n"
-                "<!-- Created with VPaint (http://www.vpaint.org/) -->\n\n"
+// Period of the autosaves of the soak test, in milliseconds
+const int SOAK_AUTOSAVE_INTERVAL = 30000;
 
-                "<!DOCTYPE svg PUBLIC \"-//W3C//DTD SVG 1.1//EN\"\n"
-                "  \"http://www.w3.org/Graphics/SVG/1.1/DTD/svg11.dtd\">\n"
-                "<svg \n"
-                "  viewBox=\"%1 %2 %3 %4\"\n"
-                "  xmlns=\"http://www.w3.org/2000/svg\"\n"
-                "  xmlns:xlink=\"http://www.w3.org/1999/xlink\">\n")
+// Fraction of the soak test after which memory is expected to have reached
+// its steady state, i.e., samples checked against the budgets
+const double SOAK_WARMUP_FRACTION = 0.25;
 
-                .arg(scene_->left())
-                .arg(scene_->top())
-                .arg(scene_->width())
-                .arg(scene_->height());
+// Generated session: strokes sketched per round, and maximum number of cells
+// before they are all deleted, so that the document itself stays bounded
+const int SOAK_STROKES_PER_ROUND = 4;
+const int SOAK_MAX_CELLS = 2000;
 
-        QString footer = "</svg>";
+// Maximum number of frames drawn per round, spread over the frame range
+const int SOAK_SCRUB_FRAMES = 24;
 
-        out << header;
-        scene_->exportSVG(multiView_->activeView()->activeTime(), out);
-        out << footer;
+// Size of the frames drawn while scrubbing, in pixels
+const int SOAK_FRAME_SIZE = 256;
 
-        statusBar()->showMessage(tr("File %1 successfully saved.").arg(filename));
-        return true;
-    }
-    else
+// Size of the canvas where strokes of the generated session are sketched
+const double SOAK_CANVAS_SIZE = 1000;
+
+const double MB = 1024.0 * 1024.0;
+
+// A random walk of n points inside the canvas
+QList<Eigen::Vector2d> soakStroke_(int n)
+{
+    QList<Eigen::Vector2d> res;
+    Eigen::Vector2d p(Random::random(0, SOAK_CANVAS_SIZE), Random::random(0, SOAK_CANVAS_SIZE));
+    double angle = Random::random(0, 2 * M_PI);
+    for(int i=0; i<n; ++i)
     {
-        qDebug() << "Error: cannot open file";
-        return false;
+        res << p;
+        angle += Random::random(-0.3, 0.3);
+        p += 10 * Eigen::Vector2d(std::cos(angle), std::sin(angle));
+        p[0] = qBound(0.0, p[0], SOAK_CANVAS_SIZE);
+        p[1] = qBound(0.0, p[1], SOAK_CANVAS_SIZE);
     }
+    return res;
 }
 
-bool MainWindow::doExportPNG(const QString & filename)
+// Memory of the given budget, "Total" or a category, in MB
+double soakMemory_(const MemoryStats::Report & report, const QString & budget)
 {
-    if(!exportPngDialog_->exportSequence())
+    if(budget == "Total")
+        return report.total() / MB;
+    for(int i=0; i<MemoryStats::NumCategories; ++i)
     {
-        // Export single frame
+        MemoryStats::Category category = static_cast<MemoryStats::Category>(i);
+        if(MemoryStats::categoryName(category) == budget)
+            return report.bytes[i] / MB;
+    }
+    return 0;
+}
 
-        QImage img = multiView_->activeView()->drawToImage(
-                    scene()->left(), scene()->top(), scene()->width(), scene()->height(),
-                    exportPngDialog_->pngWidth(), exportPngDialog_->pngHeight(),
-                    exportPngDialog_->useViewSettings());
+}
+
+bool MainWindow::soakTest(const BenchmarkOptions & options)
+{
+    QTextStream err(stderr);
 
-        img.save(filename);
+    // Recorded session replayed in a loop, if any, otherwise a generated one
+    const bool isReplay = !options.replayPath.isEmpty();
+    QList<SessionRecorder::Event> events;
+    if(isReplay && !SessionRecorder::read(options.replayPath, events))
+    {
+        err << "Error: couldn't read session " << options.replayPath << "\n";
+        return false;
     }
-    else
+    if(isReplay && !open_(options.replayPath + ".vec"))
     {
-        // Export sequence of frames
+        err << "Error: couldn't open file " << options.replayPath << ".vec\n";
+        return false;
+    }
+
+    QFile file(options.outputPath);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Text))
+    {
+        err << "Error: couldn't write file " << options.outputPath << "\n";
+        return false;
+    }
 
-        // Decompose filename into basename + suffix. Example:
-        //     abc_1234_5678.de.png  ->   abc_1234  +  de.png
-        QFileInfo info(filename);
-        QString baseName = info.baseName();
-        QString suffix = info.suffix();
-        // Decompose basename into cleanedbasename + numbering. Examples:
-        //     abc_1234_5678  ->     abc_1234 + 5678
-        int iNumbering = baseName.indexOf(QRegExp("_[0-9]*$"));
-        if(iNumbering != -1)
+    // Autosaves are written to a temporary directory, not to the user's
+    QTemporaryDir autosaveDir;
+    if(!autosaveDir.isValid())
+    {
+        err << "Error: couldn't create a temporary directory\n";
+        return false;
+    }
+    autosaveDir_ = QDir(autosaveDir.path());
+    autosaveIndex_ = 0;
+    autosaveFilename_ = "0.vec";
+    isAutosaveJournalValid_ = false;
+
+    Random::setSeed(options.seed);
+    const qint64 duration = qint64(options.soakMinutes) * 60000;
+    const qint64 warmup = qint64(SOAK_WARMUP_FRACTION * duration);
+    QJsonArray samples;
+    QList<MemoryStats::Report> steadyReports;
+    QList<double> steadyTimes; // in hours
+    int numRounds = 0;
+    qint64 nextSample = 0;
+    qint64 nextAutosave = SOAK_AUTOSAVE_INTERVAL;
+    QElapsedTimer timer;
+    timer.start();
+    while(true)
+    {
+        // Sample memory, including once at the very end
+        const qint64 elapsed = timer.elapsed();
+        const bool isDone = elapsed >= duration;
+        if(elapsed >= nextSample || isDone)
         {
-            baseName.chop(baseName.length() - iNumbering);
+            MemoryStats::Report report = MemoryStats::collect();
+            QJsonObject sample;
+            sample["seconds"] = elapsed * 1e-3;
+            for(int i=0; i<MemoryStats::NumCategories; ++i)
+                sample[MemoryStats::categoryName(static_cast<MemoryStats::Category>(i))] = report.bytes[i] / MB;
+            sample["Total"] = report.total() / MB;
+            samples << sample;
+            if(elapsed >= warmup)
+            {
+                steadyReports << report;
+                steadyTimes << elapsed / 3600000.0;
+            }
+            nextSample = elapsed + SOAK_SAMPLE_INTERVAL;
         }
-
-        // Get dir
-        QDir dir = info.absoluteDir();
-
-        // Get and delete files from previous export
-        QString nameFilter = baseName + QString("_*.") +  suffix;
-        QStringList nameFilters = QStringList() << nameFilter;
-        QStringList prevFiles = dir.entryList(nameFilters, QDir::Files);
-        foreach(QString prevFile, prevFiles)
-            dir.remove(prevFile);
-
-        // Get frame numbers to export
-        int firstFrame = timeline()->firstFrame();
-        int lastFrame = timeline()->lastFrame();
-
-        // Create Progress dialog for feedback
-        QProgressDialog progress("Export sequence as PNGs...", "Abort", 0, lastFrame-firstFrame+1, this);
-        progress.setWindowModality(Qt::WindowModal);
-
-        // Export all frames in the sequence
-        for(int i=firstFrame; i<=lastFrame; ++i)
+        if(isDone)
+            break;
+
+        // Edit
+        VectorAnimationComplex::VAC * vac = scene()->vectorAnimationComplex();
+        const int firstFrame = timeline_->firstFrame();
+        const int lastFrame = timeline_->lastFrame();
+        if(isReplay)
         {
-            progress.setValue(i-firstFrame);
-
-            if (progress.wasCanceled())
-                break;
-
-            QString number = QString("%1").arg(i, 4, 10, QChar('0'));
-            QString filePath = dir.absoluteFilePath(
-                        baseName + QString("_") + number + QString(".") + suffix);
+            // Events refer to cells by ID, so each pass starts from the
+            // recorded document
+            foreach(const SessionRecorder::Event & event, events)
+            {
+                prepareReplayEvent_(scene(), event);
+                if(event.type == SessionRecorder::Undo)
+                    undo();
+                else if(event.type == SessionRecorder::Redo)
+                    redo();
+                else
+                    replayEvent_(scene(), event);
+            }
+            open_(options.replayPath + ".vec");
+        }
+        else
+        {
+            const Time time(Random::randomInt(firstFrame, lastFrame));
+            for(int i=0; i<SOAK_STROKES_PER_ROUND; ++i)
+            {
+                QList<Eigen::Vector2d> stroke = soakStroke_(Random::randomInt(10, 50));
+                const double width = Random::random(2, 10);
+                vac->beginSketchEdge(stroke[0][0], stroke[0][1], width, time);
+                for(int j=1; j<stroke.size(); ++j)
+                    vac->continueSketchEdge(stroke[j][0], stroke[j][1], width);
+                vac->endSketchEdge();
+            }
+            if(Random::randomInt(0, 3) == 0)
+            {
+                undo();
+                undo();
+                redo();
+            }
+            if(vac->cells().size() > SOAK_MAX_CELLS)
+            {
+                scene()->selectAll();
+                scene()->smartDelete();
+            }
+        }
 
-            QImage img = multiView_->activeView()->drawToImage(
-                        Time(i),
+        // Scrub
+        const int step = std::max(1, (lastFrame - firstFrame + 1) / SOAK_SCRUB_FRAMES);
+        const int height = std::max(1, (int) (SOAK_FRAME_SIZE * scene()->height() / scene()->width()));
+        for(int frame=firstFrame; frame<=lastFrame; frame+=step)
+        {
+            activeView()->drawToImage(
+                        Time(frame),
                         scene()->left(), scene()->top(), scene()->width(), scene()->height(),
-                        exportPngDialog_->pngWidth(), exportPngDialog_->pngHeight(),
-                        exportPngDialog_->useViewSettings());
+                        SOAK_FRAME_SIZE, height, false);
+        }
 
-            img.save(filePath);
+        // Autosave, waiting for it to be written
+        if(timer.elapsed() >= nextAutosave)
+        {
+            autosave();
+            autosaveWatcher_.waitForFinished();
+            nextAutosave = timer.elapsed() + SOAK_AUTOSAVE_INTERVAL;
         }
-        progress.setValue(lastFrame-firstFrame+1);
 
+        // Deferred deletions, finished autosaves, etc.
+        QCoreApplication::processEvents();
+        ++numRounds;
+    }
+    autosaveWatcher_.waitForFinished();
+    QCoreApplication::processEvents();
+
+    // Check the peak of each budget in steady state
+    bool passed = true;
+    QJsonArray budgets;
+    QMapIterator<QString, double> it(options.memoryBudgets);
+    while(it.hasNext())
+    {
+        it.next();
+        double peak = 0;
+        foreach(const MemoryStats::Report & report, steadyReports)
+            peak = std::max(peak, soakMemory_(report, it.key()));
+        const bool isWithinBudget = peak <= it.value();
+        if(!isWithinBudget)
+        {
+            err << "Error: " << it.key() << " reached " << peak << " MB in steady state, "
+                << "over its budget of " << it.value() << " MB\n";
+            passed = false;
+        }
+        QJsonObject budget;
+        budget["category"] = it.key();
+        budget["budgetMB"] = it.value();
+        budget["steadyStatePeakMB"] = peak;
+        budget["passed"] = isWithinBudget;
+        budgets << budget;
+    }
+
+    // Growth of the total in steady state, by least squares, which is the
+    // first thing to look at when a budget is exceeded
+    double growth = 0;
+    const int n = steadyReports.size();
+    if(n >= 2)
+    {
+        double meanT = 0, meanM = 0;
+        for(int i=0; i<n; ++i)
+        {
+            meanT += steadyTimes[i] / n;
+            meanM += steadyReports[i].total() / MB / n;
+        }
+        double stt = 0, stm = 0;
+        for(int i=0; i<n; ++i)
+        {
+            stt += (steadyTimes[i] - meanT) * (steadyTimes[i] - meanT);
+            stm += (steadyTimes[i] - meanT) * (steadyReports[i].total() / MB - meanM);
+        }
+        if(stt > 0)
+            growth = stm / stt;
     }
 
-    return true;
+    QJsonObject json;
+    json["session"] = isReplay ? options.replayPath : QString("generated");
+    json["seed"] = options.seed;
+    json["minutes"] = options.soakMinutes;
+    json["numRounds"] = numRounds;
+    json["steadyStateGrowthMBPerHour"] = growth;
+    json["budgets"] = budgets;
+    json["passed"] = passed;
+    json["samples"] = samples;
+    file.write(QJsonDocument(json).toJson());
+    return passed;
 }
 
 void MainWindow::onlineDocumentation()
@@ -1159,8 +2809,24 @@ void MainWindow::about()
     }
 }
 
+void MainWindow::createView3D_()
+{
+    if(view3D_)
+        return;
+
+    view3D_ = new View3D(scene_, 0);
+    view3D_->setParent(this, Qt::Window);
+    connect(view3D_, SIGNAL(allViewsNeedToUpdate()), this, SLOT(update()));
+    connect(view3D_, SIGNAL(allViewsNeedToUpdatePicking()), this, SLOT(updatePicking()));
+    connect(multiView_, SIGNAL(activeViewChanged()), view3D_, SLOT(update()));
+    connect(multiView_, SIGNAL(cameraChanged()), view3D_, SLOT(update()));
+    connect(view3D_->view3DSettingsWidget(), SIGNAL(closed()), this, SLOT(view3DSettingsActionSetUnchecked()));
+    connect(view3D_, SIGNAL(closed()), this, SLOT(view3DActionSetUnchecked()));
+}
+
 void MainWindow::openClose3D()
 {
+    createView3D_();
     if(view3D_)
     {
         if(view3D_->isVisible())
@@ -1201,8 +2867,15 @@ void MainWindow::view3DActionSetChecked()
     actionOpenClose3D->setChecked(true);
 }
 
+void MainWindow::openView3DSettings_()
+{
+    createView3D_();
+    view3D_->openViewSettings();
+}
+
 void MainWindow::openClose3DSettings()
 {
+    createView3D_();
     if(view3D_)
     {
         if(view3D_->view3DSettingsWidget()->isVisible())
@@ -1304,12 +2977,22 @@ void MainWindow::createActions()
     //actionExportSVG->setShortcut(QKeySequence(Qt::CTRL + Qt::Key_E));
     connect(actionExportSVG, SIGNAL(triggered()), this, SLOT(exportSVG()));
 
+    // Export SVG sequence
+    actionExportSVGSequence = new QAction(/*QIcon(":/iconSave"),*/ tr("SVG (sequence) [Beta]"), this);
+    actionExportSVGSequence->setStatusTip(tr("Save all frames of the animation as numbered SVG files."));
+    connect(actionExportSVGSequence, SIGNAL(triggered()), this, SLOT(exportSVGSequence()));
+
     // Export PNG
     actionExportPNG = new QAction(/*QIcon(":/iconSave"),*/ tr("PNG (frame or sequence)"), this);
     actionExportPNG->setStatusTip(tr("Save the current illustration in the PNG file format."));
     //actionExportPNG->setShortcut(QKeySequence(Qt::CTRL + Qt::Key_E));
     connect(actionExportPNG, SIGNAL(triggered()), this, SLOT(exportPNG()));
 
+    // Export Video
+    actionExportVideo = new QAction(/*QIcon(":/iconSave"),*/ tr("Video (sequence, with FFmpeg)"), this);
+    actionExportVideo->setStatusTip(tr("Save the animation as a video, encoded by an external program such as FFmpeg."));
+    connect(actionExportVideo, SIGNAL(triggered()), this, SLOT(exportVideo()));
+
     // Preferences
     /*
     actionPreferences = new QAction(tr("&Preferences..."), this);
@@ -1376,6 +3059,34 @@ void MainWindow::createActions()
     actionHardDelete->setShortcutContext(Qt::ApplicationShortcut);
     connect(actionHardDelete, SIGNAL(triggered()), scene_, SLOT(deleteSelectedCells()));
 
+    // Create Faces
+    actionCreateFaces = new QAction(tr("Create One Face per Cycle"), this);
+    actionCreateFaces->setStatusTip(tr("Create one face for each cycle of the selected edges, instead of a single face with all of them."));
+    actionCreateFaces->setShortcutContext(Qt::ApplicationShortcut);
+    connect(actionCreateFaces, SIGNAL(triggered()), scene_, SLOT(createFaces()));
+
+    // Fill All Enclosed Regions
+    actionFillAllEnclosedRegions = new QAction(tr("Fill All Enclosed Regions"), this);
+    actionFillAllEnclosedRegions->setStatusTip(tr("Create a face in each region enclosed by curves at the current time, unless already filled."));
+    actionFillAllEnclosedRegions->setShortcutContext(Qt::ApplicationShortcut);
+    connect(actionFillAllEnclosedRegions, SIGNAL(triggered()), scene_, SLOT(fillAllEnclosedRegions()));
+
+    // Symbols
+    actionCreateSymbol = new QAction(tr("Create Symbol"), this);
+    actionCreateSymbol->setStatusTip(tr("Make the selected cells the master of a symbol, which can then be instanced without copying its cells."));
+    actionCreateSymbol->setShortcutContext(Qt::ApplicationShortcut);
+    connect(actionCreateSymbol, SIGNAL(triggered()), scene_, SLOT(createSymbol()));
+
+    actionAddSymbolInstance = new QAction(tr("Add Symbol Instance"), this);
+    actionAddSymbolInstance->setStatusTip(tr("Add an instance of the symbol of the selected cells. Editing the master updates all its instances."));
+    actionAddSymbolInstance->setShortcutContext(Qt::ApplicationShortcut);
+    connect(actionAddSymbolInstance, SIGNAL(triggered()), scene_, SLOT(addSymbolInstance()));
+
+    actionRemoveSymbolInstances = new QAction(tr("Remove Symbol Instances"), this);
+    actionRemoveSymbolInstances->setStatusTip(tr("Remove all instances of the symbol of the selected cells."));
+    actionRemoveSymbolInstances->setShortcutContext(Qt::ApplicationShortcut);
+    connect(actionRemoveSymbolInstances, SIGNAL(triggered()), scene_, SLOT(removeSymbolInstances()));
+
     // Hard Delete
     actionTest = new QAction(tr("Test"), this);
     actionTest->setStatusTip(tr("For development tests: quick and dirty function."));
@@ -1479,14 +3190,29 @@ void MainWindow::createActions()
     actionOpenView3DSettings->setStatusTip(tr("Open the settings dialog for the 3D view"));
     //actionOpenView3DSettings->setShortcut(QKeySequence(Qt::CTRL + Qt::Key_5));
     actionOpenView3DSettings->setShortcutContext(Qt::ApplicationShortcut);
-    connect(actionOpenView3DSettings, SIGNAL(triggered()), view3D_, SLOT(openViewSettings()));
-    connect(view3D_->view3DSettingsWidget(), SIGNAL(closed()), this, SLOT(view3DSettingsActionSetUnchecked()));
+    connect(actionOpenView3DSettings, SIGNAL(triggered()), this, SLOT(openView3DSettings_()));
+
+    actionExportRenderStats = new QAction(tr("Export Render Statistics [Beta]"), this);
+    actionExportRenderStats->setStatusTip(tr("Save the statistics of the last rendered frames as a CSV file (see the \"render stats\" advanced setting)"));
+    connect(actionExportRenderStats, SIGNAL(triggered()), this, SLOT(exportRenderStats()));
+
+    actionShowMemoryStats = new QAction(tr("Memory Statistics [Beta]"), this);
+    actionShowMemoryStats->setStatusTip(tr("Show the memory used by the document, its caches, the undo history, and the views, and write it to the debug output"));
+    connect(actionShowMemoryStats, SIGNAL(triggered()), this, SLOT(showMemoryStats()));
+
+    actionShowSelectionInfo = new QAction(tr("Selection Info [Beta]"), this);
+    actionShowSelectionInfo->setStatusTip(tr("Show the IDs and the number of selected cells of each type"));
+    connect(actionShowSelectionInfo, SIGNAL(triggered()), this, SLOT(showSelectionInfo()));
+
+    actionRecordSession = new QAction(tr("Record Session [Beta]"), this);
+    actionRecordSession->setCheckable(true);
+    actionRecordSession->setStatusTip(tr("Record the tool events into a file, to measure their latency by replaying them (see the --replay command line option)"));
+    connect(actionRecordSession, SIGNAL(triggered(bool)), this, SLOT(recordSession(bool)));
 
     actionOpenClose3D = new QAction(tr("3D View [Beta]"), this);
     actionOpenClose3D->setCheckable(true);
     actionOpenClose3D->setStatusTip(tr("Open or Close the 3D inbetween View"));
     connect(actionOpenClose3D, SIGNAL(triggered()), this, SLOT(openClose3D()));
-    connect(view3D_, SIGNAL(closed()), this, SLOT(view3DActionSetUnchecked()));
 
 
     // Splitting
@@ -1667,6 +3393,13 @@ void MainWindow::createActions()
     actionKeyframeSelection->setShortcutContext(Qt::ApplicationShortcut);
     connect(actionKeyframeSelection, SIGNAL(triggered()), scene_, SLOT(keyframeSelection()));
 
+    // Keyframe over playback range
+    actionKeyframeSelectionOverPlaybackRange = new QAction(tr("Keyframe selection over playback range"), this);
+    actionKeyframeSelectionOverPlaybackRange->setStatusTip(tr("Insert a key to all selected objects at every frame of the playback range."));
+    actionKeyframeSelectionOverPlaybackRange->setShortcut(QKeySequence(Qt::SHIFT + Qt::Key_K));
+    actionKeyframeSelectionOverPlaybackRange->setShortcutContext(Qt::ApplicationShortcut);
+    connect(actionKeyframeSelectionOverPlaybackRange, SIGNAL(triggered()), scene_, SLOT(keyframeSelectionOverPlaybackRange()));
+
     // Motion Paste
     actionMotionPaste = new QAction(tr("Motion paste"), this);
     actionMotionPaste->setStatusTip(tr("Paste the cells in the clipboard, and inbetween them with the copied cells."));
@@ -1731,7 +3464,9 @@ void MainWindow::createMenus()
     menuFile->addSeparator();
     QMenu * exportMenu = menuFile->addMenu(tr("Export")); {
         exportMenu->addAction(actionExportPNG);
+        exportMenu->addAction(actionExportVideo);
         exportMenu->addAction(actionExportSVG);
+        exportMenu->addAction(actionExportSVGSequence);
     }
     //menuFile->addSeparator();
     //menuFile->addAction(actionPreferences);
@@ -1751,6 +3486,13 @@ void MainWindow::createMenus()
     menuEdit->addSeparator();
     menuEdit->addAction(actionSmartDelete);
     menuEdit->addAction(actionHardDelete);
+    menuEdit->addSeparator();
+    menuEdit->addAction(actionCreateFaces);
+    menuEdit->addAction(actionFillAllEnclosedRegions);
+    menuEdit->addSeparator();
+    menuEdit->addAction(actionCreateSymbol);
+    menuEdit->addAction(actionAddSymbolInstance);
+    menuEdit->addAction(actionRemoveSymbolInstances);
     //menuEdit->addAction(actionTest);
     menuBar()->addMenu(menuEdit);
 
@@ -1787,8 +3529,13 @@ void MainWindow::createMenus()
         advancedViewMenu->addAction(dockInspector->toggleViewAction());
         advancedViewMenu->addAction(dockAdvancedSettings->toggleViewAction());
         advancedViewMenu->addAction(dockAnimatedCycleEditor->toggleViewAction());
+        advancedViewMenu->addAction(dockOperatorStats->toggleViewAction());
         advancedViewMenu->addAction(actionOpenClose3D);
         advancedViewMenu->addAction(actionOpenView3DSettings);
+        advancedViewMenu->addAction(actionExportRenderStats);
+        advancedViewMenu->addAction(actionShowMemoryStats);
+        advancedViewMenu->addAction(actionShowSelectionInfo);
+        advancedViewMenu->addAction(actionRecordSession);
     }
 
     menuBar()->addMenu(menuView);
@@ -1827,6 +3574,7 @@ void MainWindow::createMenus()
     menuAnimation = new QMenu(tr("&Animation"));
     menuAnimation->addAction(actionMotionPaste);
     menuAnimation->addAction(actionKeyframeSelection);
+    menuAnimation->addAction(actionKeyframeSelectionOverPlaybackRange);
     menuAnimation->addAction(actionInbetweenSelection);
     menuAnimation->addAction(actionCreateInbetweenFace);
     menuBar()->addMenu(menuAnimation);
@@ -1880,50 +3628,49 @@ void MainWindow::createDocks()
     addDockWidget(Qt::RightDockWidgetArea, dockAdvancedSettings);
     dockAdvancedSettings->hide();
 
-    // ----- Object Properties ---------
-
-    // Widget
-    inspector = new ObjectPropertiesWidget();
+    // The widgets of the following docks are created when the dock is first
+    // shown (see createDockWidgets_())
 
-    // Scroll area
-    QScrollArea * dockObjectProperties_scrollArea = new QScrollArea();
-    dockObjectProperties_scrollArea->setWidget(inspector);
-    dockObjectProperties_scrollArea->setWidgetResizable(true);
+    // ----- Object Properties ---------
 
-    // Dock
+    inspector = 0;
     dockInspector = new QDockWidget(tr("Inspector [Beta]"));
     dockInspector->setAllowedAreas(Qt::LeftDockWidgetArea | Qt::RightDockWidgetArea);
-    dockInspector->setWidget(dockObjectProperties_scrollArea);
     addDockWidget(Qt::RightDockWidgetArea, dockInspector);
     dockInspector->hide();
+    connect(dockInspector, SIGNAL(visibilityChanged(bool)), this, SLOT(createDockWidgets_()));
 
     // Signal/Slot connection
     connect(scene(),SIGNAL(selectionChanged()),this,SLOT(updateObjectProperties()));
 
     // ----- Animated cycle editor ---------
 
-    // Widget
-    animatedCycleEditor = new AnimatedCycleWidget();
-
-    // Dock
+    animatedCycleEditor = 0;
     dockAnimatedCycleEditor = new QDockWidget(tr("Animated Cycle Editor [Beta]"));
     dockAnimatedCycleEditor->setAllowedAreas(Qt::LeftDockWidgetArea | Qt::RightDockWidgetArea);
-    dockAnimatedCycleEditor->setWidget(animatedCycleEditor);
     addDockWidget(Qt::RightDockWidgetArea, dockAnimatedCycleEditor);
     dockAnimatedCycleEditor->hide();
+    connect(dockAnimatedCycleEditor, SIGNAL(visibilityChanged(bool)), this, SLOT(createDockWidgets_()));
 
-    // ----- Background ---------
+    // ----- Operator latencies ---------
 
-    // Widget
-    backgroundWidget = new BackgroundWidget();
-    backgroundWidget->setBackground(scene()->background());
+    operatorStatsWidget = 0;
+    dockOperatorStats = new QDockWidget(tr("Operator Latencies [Beta]"));
+    dockOperatorStats->setAllowedAreas(Qt::LeftDockWidgetArea | Qt::RightDockWidgetArea);
+    addDockWidget(Qt::RightDockWidgetArea, dockOperatorStats);
+    dockOperatorStats->hide();
+    connect(dockOperatorStats, SIGNAL(visibilityChanged(bool)), this, SLOT(createDockWidgets_()));
 
-    // Dock
+    // ----- Background ---------
+
+    backgroundWidget = 0;
     dockBackgroundWidget = new QDockWidget(tr("Background"));
     dockBackgroundWidget->setAllowedAreas(Qt::LeftDockWidgetArea | Qt::RightDockWidgetArea);
-    dockBackgroundWidget->setWidget(backgroundWidget);
     addDockWidget(Qt::RightDockWidgetArea, dockBackgroundWidget);
     //dockBackgroundWidget->hide(); todo: uncomment (commented for convenience while developing)
+    connect(dockBackgroundWidget, SIGNAL(visibilityChanged(bool)), this, SLOT(createDockWidgets_()));
+    if(!isBatchMode_)
+        createBackgroundWidget_(); // visible at startup
 
 
     // ----- TimeLine -------------
@@ -1936,6 +3683,59 @@ void MainWindow::createDocks()
     addDockWidget(Qt::BottomDockWidgetArea, dockTimeLine);
 }
 
+void MainWindow::createInspector_()
+{
+    if(inspector)
+        return;
+
+    inspector = new ObjectPropertiesWidget();
+    QScrollArea * dockObjectProperties_scrollArea = new QScrollArea();
+    dockObjectProperties_scrollArea->setWidget(inspector);
+    dockObjectProperties_scrollArea->setWidgetResizable(true);
+    dockInspector->setWidget(dockObjectProperties_scrollArea);
+    updateObjectProperties();
+}
+
+void MainWindow::createAnimatedCycleEditor_()
+{
+    if(animatedCycleEditor)
+        return;
+
+    animatedCycleEditor = new AnimatedCycleWidget();
+    dockAnimatedCycleEditor->setWidget(animatedCycleEditor);
+}
+
+void MainWindow::createBackgroundWidget_()
+{
+    if(backgroundWidget)
+        return;
+
+    backgroundWidget = new BackgroundWidget();
+    backgroundWidget->setBackground(scene()->background());
+    dockBackgroundWidget->setWidget(backgroundWidget);
+}
+
+void MainWindow::createOperatorStatsWidget_()
+{
+    if(operatorStatsWidget)
+        return;
+
+    operatorStatsWidget = new OperatorStatsWidget();
+    dockOperatorStats->setWidget(operatorStatsWidget);
+}
+
+void MainWindow::createDockWidgets_()
+{
+    if(dockInspector->isVisible())
+        createInspector_();
+    if(dockAnimatedCycleEditor->isVisible())
+        createAnimatedCycleEditor_();
+    if(dockBackgroundWidget->isVisible())
+        createBackgroundWidget_();
+    if(dockOperatorStats->isVisible())
+        createOperatorStatsWidget_();
+}
+
 
 
 
@@ -1946,6 +3746,29 @@ void MainWindow::createDocks()
 void MainWindow::createStatusBar()
 {
       //statusBar()->showMessage(tr("Hello! How are you doing today?"),2000);
+
+    // Memory used by undo history
+    undoMemoryLabel_ = new QLabel();
+    statusBar()->addPermanentWidget(undoMemoryLabel_);
+
+    autosaveLabel_ = new QLabel();
+    statusBar()->addPermanentWidget(autosaveLabel_);
+
+    // Frame rate achieved by the last playback
+    playbackLabel_ = new QLabel();
+    statusBar()->addPermanentWidget(playbackLabel_);
+}
+
+void MainWindow::updatePlaybackLabel_()
+{
+    if(!playbackLabel_)
+        return;
+
+    Timeline::PlaybackStats stats = timeline_->playbackStats();
+    QString text = tr("Playback: %1/%2 fps").arg(stats.achievedFps, 0, 'f', 1).arg(timeline_->fps());
+    if(stats.numDroppedFrames > 0)
+        text += tr(" (%1 dropped)").arg(stats.numDroppedFrames);
+    playbackLabel_->setText(text);
 }
 
 
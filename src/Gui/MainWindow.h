@@ -15,14 +15,22 @@
 #include <QTextBrowser>
 #include <QTimer>
 #include <QDir>
+#include <QFutureWatcher>
+#include <QElapsedTimer>
+#include <QImage>
+
+#include "IO/AutosaveJournal.h"
+#include "MemoryStats.h"
 
 class QScrollArea;
+class QLabel;
 class Scene;
 class GLWidget;
 class MultiView;
 class View;
 class View3D;
 class Timeline;
+class PlaybackSettings;
 class DevSettings;
 class SettingsDialog;
 class XmlStreamWriter;
@@ -31,30 +39,58 @@ class QTextStream;
 class EditCanvasSizeDialog;
 class ExportPngDialog;
 class AboutDialog;
+class QProgressDialog;
+class Time;
+struct BatchRenderOptions;
+struct BenchmarkOptions;
 class BackgroundWidget;
+class Background;
 
 namespace VectorAnimationComplex
 {
 class VAC;
 class InbetweenFace;
+class History;
 }
 class SelectionInfoWidget;
 class ObjectPropertiesWidget;
 class AnimatedCycleWidget;
+class OperatorStatsWidget;
 
-class MainWindow : public QMainWindow
+class MainWindow : public QMainWindow, public MemoryStats::Source
 {
     Q_OBJECT
 
 public:
-    MainWindow();
+    // If logsStartupTimes is true, the time taken by each step of the
+    // construction is written to the debug output
+    MainWindow(bool isBatchMode = false, bool logsStartupTimes = false);
     ~MainWindow();
 
+    // Renders a document without showing this window (see Application).
+    // Returns false on failure, after printing an error.
+    bool renderBatch(const BatchRenderOptions & options);
+
+    // Replays a recorded session without showing this window, and writes the
+    // latency percentiles of each type of event (see SessionRecorder).
+    // Returns false on failure, after printing an error.
+    bool replaySession(const BenchmarkOptions & options);
+
+    // Replays a recorded session in a loop, or a generated one, for the
+    // given number of minutes, scrubbing and autosaving, and samples the
+    // memory accounting (see MemoryStats). Returns false if the memory used
+    // in steady state exceeded a budget, or on failure, after printing an
+    // error.
+    bool soakTest(const BenchmarkOptions & options);
+
     Scene * scene() const;
     View * activeView() const;
     View * hoveredView() const;
     Timeline * timeline() const;
 
+    // Memory used by the undo history
+    void reportMemory(MemoryStats::Report & report) const;
+
     bool isShowCanvasChecked() const;
     bool isEditCanvasSizeVisible() const;
 
@@ -68,12 +104,13 @@ public slots:
     // ---- update what is displayed on screen ----
     void update();
     void updatePicking();
+    void updateHighlight();
 
     void updateObjectProperties();
     void editAnimatedCycle(VectorAnimationComplex::InbetweenFace * inbetweenFace, int indexCycle);
 
     void about();
-    void open_(const QString & filePath); // XXX public because used in main.cpp. Should probably be refactored.
+    bool open_(const QString & filePath); // XXX public because used in main.cpp. Should probably be refactored.
 
 private slots:
     // ---- File ----
@@ -81,9 +118,21 @@ private slots:
     void open();
     bool save();
     void autosave();
+    void autosaveFinished_();
+    void saveFinished_();
+    void openFinished_();
+    void updateOpenProgress_();
+    void cancelOpen_();
+    void readDeferredGeometry_();
     bool saveAs();
     bool exportSVG();
+    bool exportSVGSequence();
     bool exportPNG();
+    bool exportRenderStats();
+    void showMemoryStats();
+    void showSelectionInfo();
+    void recordSession(bool checked);
+    bool exportVideo();
     bool acceptExportPNG();
     bool rejectExportPNG();
 
@@ -111,11 +160,14 @@ private slots:
     void view3DActionSetUnchecked();
 
     void openClose3DSettings();
+    void openView3DSettings_();
     void updateView3DSettingsActionCheckState();
     void view3DSettingsActionSetChecked();
     void view3DSettingsActionSetUnchecked();
 
     void updateViewMenu();
+    void updatePlaybackLabel_();
+    void createDockWidgets_(); // of the docks being shown
 
     // ---- Selection ----
     // -> deferred to Scene
@@ -140,7 +192,16 @@ private:
     void createDocks();
     void createMenus();
 
+    // Components created on first use rather than at startup
+    void createView3D_();
+    void createInspector_();
+    void createAnimatedCycleEditor_();
+    void createBackgroundWidget_();
+    void createOperatorStatsWidget_();
+
     // --------- Other properties and widgets --------
+    // Whether the window is only used to render documents (see renderBatch())
+    bool isBatchMode_;
     // Scene and View
     Scene * scene_;
     MultiView * multiView_;
@@ -153,10 +214,14 @@ private:
     void clearUndoStack_();
     void resetUndoStack_();
     void goToUndoIndex_(int undoIndex);
-    typedef QPair<QDir,Scene*> UndoItem;
-    QList<UndoItem> undoStack_;
+    void finishSketchedEdge_();
+    typedef QPair<QDir,Background*> UndoItem;
+    QList<UndoItem> undoStack_; // document dir and background of each checkpoint
+    VectorAnimationComplex::History * undoHistory_; // cells of each checkpoint
     int undoIndex_;
     int savedUndoIndex_;
+    QLabel * undoMemoryLabel_;
+    void updateUndoMemoryLabel_();
     // I/O
     QString fileHeader_;
     QString documentFilePath_;
@@ -165,6 +230,35 @@ private:
     int autosaveIndex_;
     bool autosaveOn_;
     QDir autosaveDir_;
+    QFutureWatcher<bool> autosaveWatcher_; // autosave in progress, if any
+    Scene * autosaveSnapshot_;             // copy of the scene it writes
+    QElapsedTimer autosaveElapsedTimer_;
+    QLabel * autosaveLabel_;
+    AutosaveJournal autosaveJournal_;      // changes since the last full autosave
+    bool isAutosaveJournalValid_;          // whether the last full autosave succeeded
+    QFuture<bool> convertedFileWrite_;     // write of a file converted on open, if any
+    QFutureWatcher<bool> saveWatcher_;     // asynchronous save in progress, if any
+    Scene * saveSnapshot_;                 // copy of the scene it writes
+    QString saveFilePath_;                 // file it writes
+    int saveUndoIndex_;                    // undo index of the copy, -1 if undone since
+    Scene * snapshot_();
+    bool saveAsync_();
+    bool finishSave_();
+    // Asynchronous open (see openAsync_()): the document is read into
+    // openedDocument_ by a worker thread, then moved into the scene, and the
+    // geometry it deferred is read a few edges at a time between events
+    struct OpenedDocument;
+    OpenedDocument * openedDocument_;      // open in progress, if any
+    QFutureWatcher<bool> openWatcher_;
+    QProgressDialog * openProgressDialog_;
+    QTimer openProgressTimer_;
+    QTimer deferredGeometryTimer_;
+    bool openAsync_(const QString & filePath);
+    bool isLegacyFile_(const QString & filePath) const;
+    bool openLegacy_(const QString & filePath);
+    static bool readDocument_(XmlStreamReader & xml, PlaybackSettings & playback,
+                              bool & hasPlayback, Scene * scene);
+    QString autosaveJournalFilePath_() const;
     bool isNewDocument_() const;
     bool isModified_() const;
     void setUnmodified_();
@@ -172,21 +266,42 @@ private:
     void setDocumentFilePath_(const QString & filePath);
     bool maybeSave_();
     bool save_(const QString & filePath, bool relativeRemap = false);
-    bool doExportSVG(const QString & filename);
+    bool doExportSVG(const QString & filename, Time t);
+    static bool writeSVG_(const QString & filename, Scene * scene, Time t);
+    bool exportSvgSequence_(const QDir & dir, const QString & baseName, const QString & suffix,
+                            int firstFrame, int lastFrame);
     bool doExportPNG(const QString & filename);
+    bool doExportVideo(const QString & filename);
+    void showExportPngDialog_(bool isVideoMode);
+    bool exportPngFrame_(Time t, const QString & filePath, int width, int height, bool useViewSettings);
+    bool exportPngSequence_(const QDir & dir, const QString & baseName, const QString & suffix,
+                            int firstFrame, int lastFrame, int width, int height, bool useViewSettings,
+                            QProgressDialog * progress, bool printProgress = false);
+    void prefetchExportGeometry_(int frame);
+    static void decomposeSequenceFilename_(const QString & filename, QDir & dir, QString & baseName, QString & suffix);
+    static QString sequenceFilePath_(const QDir & dir, const QString & baseName, const QString & suffix, int frame);
     void read_DEPRECATED(QTextStream & in);
     void write_DEPRECATED(QTextStream & out);
     void read(XmlStreamReader & xml);
     void write(XmlStreamWriter & xml);
+    static void writeDocument_(XmlStreamWriter & xml, const PlaybackSettings & playback, Scene * scene,
+                               const QImage & preview = QImage());
+    static bool writeDocumentFile_(const QString & filePath, const PlaybackSettings & playback, Scene * scene,
+                                   const QImage & preview = QImage());
+    QImage drawPreview_();
     void autosaveBegin();
     void autosaveEnd();
     // Copy-pasting
     VectorAnimationComplex::VAC * clipboard_;
-    // 3D view
+    bool isClipboardForeign_; // clipboard_ read from another process (see Clipboard)
+    void clipboardChanged_();
+    void readSystemClipboard_();
+    // 3D view, created when first opened
     View3D * view3D_;
     // timeline
     Timeline * timeline_;
-    // Selection info
+    QLabel * playbackLabel_; // achieved fps and dropped frames
+    // Selection info, created when first shown
     SelectionInfoWidget * selectionInfo_;
     // Edit Canvas Size
     ExportPngDialog * exportPngDialog_;
@@ -204,7 +319,9 @@ private:
       QAction * actionSaveAs;
       QAction * actionPreferences;
       QAction * actionExportSVG;
+      QAction * actionExportSVGSequence;
       QAction * actionExportPNG;
+      QAction * actionExportVideo;
       QAction * actionQuit;
     // EDIT
     QMenu * menuEdit;
@@ -215,6 +332,11 @@ private:
       QAction * actionPaste;
       QAction * actionSmartDelete;
       QAction * actionHardDelete;
+      QAction * actionCreateFaces;
+      QAction * actionFillAllEnclosedRegions;
+      QAction * actionCreateSymbol;
+      QAction * actionAddSymbolInstance;
+      QAction * actionRemoveSymbolInstances;
       QAction * actionTest;
     // VIEW
     QMenu * menuView;
@@ -231,6 +353,10 @@ private:
       QAction * actionToggleOutline;
       QAction * actionToggleOutlineOnly;
       QAction * actionOpenView3DSettings;
+      QAction * actionExportRenderStats;
+      QAction * actionShowMemoryStats;
+      QAction * actionShowSelectionInfo;
+      QAction * actionRecordSession;
       QAction * actionOpenClose3D;
       QAction * actionSplitVertical;
       QAction * actionSplitHorizontal;
@@ -264,6 +390,7 @@ private:
     QMenu * menuAnimation;
       QAction * actionInbetweenSelection;
       QAction * actionKeyframeSelection;
+      QAction * actionKeyframeSelectionOverPlaybackRange;
       QAction * actionMotionPaste;
       QAction * actionCreateInbetweenFace;
     // PLAYBACK
@@ -284,6 +411,8 @@ private:
     AnimatedCycleWidget * animatedCycleEditor;
     BackgroundWidget * backgroundWidget;
     QDockWidget * dockBackgroundWidget;
+    QDockWidget * dockOperatorStats;
+    OperatorStatsWidget * operatorStatsWidget;
 };
 
 #endif
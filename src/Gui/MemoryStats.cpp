@@ -0,0 +1,101 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#include "MemoryStats.h"
+#include "VectorAnimationComplex/GeometryCache.h"
+#include "VectorAnimationComplex/MemoryPool.h"
+
+#include <QtDebug>
+
+MemoryStats::Report::Report()
+{
+    for(int i=0; i<NumCategories; ++i)
+        bytes[i] = 0;
+}
+
+std::size_t MemoryStats::Report::total() const
+{
+    std::size_t res = 0;
+    for(int i=0; i<NumCategories; ++i)
+        res += bytes[i];
+    return res;
+}
+
+MemoryStats::Source::Source()
+{
+    sources_() << this;
+}
+
+MemoryStats::Source::Source(const Source &)
+{
+    sources_() << this;
+}
+
+MemoryStats::Source & MemoryStats::Source::operator=(const Source &)
+{
+    return *this;
+}
+
+MemoryStats::Source::~Source()
+{
+    sources_().removeOne(this);
+}
+
+QList<const MemoryStats::Source *> & MemoryStats::sources_()
+{
+    static QList<const Source *> sources;
+    return sources;
+}
+
+MemoryStats::Report MemoryStats::collect()
+{
+    Report report;
+    report.add(Cells, VectorAnimationComplex::MemoryPool::numBytesReserved());
+    report.add(TriangulationCache, VectorAnimationComplex::GeometryCache::numBytes());
+    foreach(const Source * source, sources_())
+        source->reportMemory(report);
+    return report;
+}
+
+QString MemoryStats::text(const Report & report)
+{
+    const double MB = 1024 * 1024;
+    QString res;
+    for(int i=0; i<NumCategories; ++i)
+    {
+        res += QString("%1: %2 MB\n")
+                .arg(categoryName(static_cast<Category>(i)))
+                .arg(report.bytes[i] / MB, 0, 'f', 1);
+    }
+    res += QString("Total: %1 MB").arg(report.total() / MB, 0, 'f', 1);
+    return res;
+}
+
+MemoryStats::Report MemoryStats::log()
+{
+    Report report = collect();
+    foreach(const QString & line, text(report).split('\n'))
+        qDebug().noquote() << "Memory:" << line;
+    return report;
+}
+
+QString MemoryStats::categoryName(Category category)
+{
+    switch(category)
+    {
+    case Cells: return "Cells";
+    case Geometry: return "Geometry";
+    case TriangulationCache: return "Triangulation cache";
+    case BoundingBoxCache: return "Bounding box cache";
+    case UndoHistory: return "Undo history";
+    case BackgroundImages: return "Background images";
+    case ViewCaches: return "View caches";
+    case PickingBuffers: return "Picking buffers";
+    default: return "";
+    }
+}
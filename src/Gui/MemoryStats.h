@@ -0,0 +1,78 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#ifndef MEMORY_STATS_H
+#define MEMORY_STATS_H
+
+// MemoryStats: memory used by the document, its caches, the undo history and
+// GPU resources, to find out where memory goes. Objects owning memory derive
+// from MemoryStats::Source, which registers them for their lifetime, and add
+// their bytes to a report when asked by MemoryStats::collect(). Global caches
+// (GeometryCache, MemoryPool) are added by collect() itself.
+//
+// Sizes are estimates: they count the main arrays of each object, not the
+// overhead of allocators and containers. GPU sizes assume 4 bytes per pixel.
+//
+// Sources must be created, destroyed and asked by the GUI thread.
+
+#include <QString>
+#include <QList>
+#include <cstddef>
+
+class MemoryStats
+{
+public:
+    enum Category
+    {
+        Cells,              // cell objects and their topology
+        Geometry,           // edge samples and samplings
+        TriangulationCache, // see GeometryCache
+        BoundingBoxCache,   // see SpatialIndex
+        UndoHistory,        // see History
+        BackgroundImages,   // background textures, see BackgroundRenderer
+        ViewCaches,         // playback, onion skin, frame and offscreen render targets
+        PickingBuffers,
+        NumCategories
+    };
+
+    struct Report
+    {
+        Report();
+        void add(Category category, std::size_t numBytes) { bytes[category] += numBytes; }
+        std::size_t total() const;
+
+        std::size_t bytes[NumCategories];
+    };
+
+    class Source
+    {
+    public:
+        Source();
+        Source(const Source & other);
+        Source & operator=(const Source & other);
+        virtual ~Source();
+
+        virtual void reportMemory(Report & report) const = 0;
+    };
+
+    // Asks all sources
+    static Report collect();
+
+    // Human readable multiline string, in MB
+    static QString text(const Report & report);
+
+    // Collects a report, writes it to the debug output, and returns it
+    static Report log();
+
+    static QString categoryName(Category category);
+
+private:
+    static QList<const Source *> & sources_();
+};
+
+#endif // MEMORY_STATS_H
@@ -106,6 +106,7 @@ View * MultiView::createView_()
 
     connect(view, SIGNAL(allViewsNeedToUpdate()), this, SIGNAL(allViewsNeedToUpdate()));
     connect(view, SIGNAL(allViewsNeedToUpdatePicking()), this, SIGNAL(allViewsNeedToUpdatePicking()));
+    connect(view, SIGNAL(allViewsNeedToUpdateHighlight()), this, SIGNAL(allViewsNeedToUpdateHighlight()));
     connect(view, SIGNAL(mousePressed(GLWidget*)), this, SLOT(setActive(GLWidget*)));
     connect(view, SIGNAL(mouseEntered(GLWidget*)), this, SLOT(setHovered(GLWidget*)));
     connect(view, SIGNAL(mouseLeft(GLWidget*)), this, SLOT(unsetHovered(GLWidget*)));
@@ -394,13 +395,27 @@ void MultiView::update()
     }
 }
 
-void MultiView::updatePicking()
+void MultiView::updateHighlight()
 {
     foreach(ViewWidget * viewWidget, views_)
     {
         View * view = viewFromViewWidget_(viewWidget);
         if(view->isVisible())
+            view->updateHighlight();
+    }
+}
+
+void MultiView::updatePicking()
+{
+    // Views which are not hovered don't need their picking image until the
+    // mouse enters them: postpone it until then
+    foreach(ViewWidget * viewWidget, views_)
+    {
+        View * view = viewFromViewWidget_(viewWidget);
+        if(view == hoveredView_ && view->isVisible())
             view->updatePicking();
+        else
+            view->invalidatePicking();
     }
 }
 
@@ -49,6 +49,7 @@ public:
 public slots:
     void update();        // update only the views in MultiView (not the 3D view)
     void updatePicking(); // update only the views in MultiView (not the 3D view)
+    void updateHighlight(); // update only the views in MultiView (not the 3D view)
 
     void zoomIn();
     void zoomOut();
@@ -71,6 +72,7 @@ public slots:
 signals:
     void allViewsNeedToUpdate();        // update all views (including these and the 3D view)
     void allViewsNeedToUpdatePicking(); // update all views (including these and the 3D view)
+    void allViewsNeedToUpdateHighlight(); // update all views (including these and the 3D view)
     void activeViewChanged();
     void hoveredViewChanged();
     void cameraChanged();
@@ -0,0 +1,167 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#include "NumberParser.h"
+
+#include <QString>
+
+namespace
+{
+
+inline bool isSeparator(ushort c)
+{
+    return c == ',' || c == ' ' || c == '\n' || c == '\t' || c == '\r';
+}
+
+inline bool isDigit(ushort c)
+{
+    return c >= '0' && c <= '9';
+}
+
+// Powers of ten that are exactly representable as doubles
+const double POW10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Largest integer such that all smaller integers are exactly representable
+const quint64 MAX_EXACT_INTEGER = quint64(1) << 53;
+
+// Converts [begin, end) if its significand has at most 19 digits. Returns
+// false if it doesn't, if the result may be inexact, or if it is not a
+// number in the simple form [+-]digits[.digits][(e|E)[+-]digits].
+bool fastToDouble(const QChar * begin, const QChar * end, double & x)
+{
+    const QChar * it = begin;
+
+    // Sign
+    bool negative = false;
+    if (it != end && (it->unicode() == '-' || it->unicode() == '+'))
+    {
+        negative = (it->unicode() == '-');
+        ++it;
+    }
+
+    // Significand
+    quint64 significand = 0;
+    int numDigits = 0;
+    int exponent = 0;
+    bool hasDigits = false;
+    while (it != end && isDigit(it->unicode()))
+    {
+        hasDigits = true;
+        if (numDigits > 0 || it->unicode() != '0')
+        {
+            if (++numDigits > 19)
+                return false;
+            significand = 10 * significand + (it->unicode() - '0');
+        }
+        ++it;
+    }
+    if (it != end && it->unicode() == '.')
+    {
+        ++it;
+        while (it != end && isDigit(it->unicode()))
+        {
+            hasDigits = true;
+            if (numDigits > 0 || it->unicode() != '0')
+            {
+                if (++numDigits > 19)
+                    return false;
+                significand = 10 * significand + (it->unicode() - '0');
+            }
+            --exponent;
+            ++it;
+        }
+    }
+    if (!hasDigits)
+        return false;
+
+    // Exponent
+    if (it != end && (it->unicode() == 'e' || it->unicode() == 'E'))
+    {
+        ++it;
+        bool negativeExponent = false;
+        if (it != end && (it->unicode() == '-' || it->unicode() == '+'))
+        {
+            negativeExponent = (it->unicode() == '-');
+            ++it;
+        }
+        if (it == end)
+            return false;
+        int e = 0;
+        while (it != end && isDigit(it->unicode()))
+        {
+            if (e < 100000)
+                e = 10 * e + (it->unicode() - '0');
+            ++it;
+        }
+        exponent += negativeExponent ? -e : e;
+    }
+    if (it != end)
+        return false;
+
+    // Both the significand and the power of ten are exact doubles, so a
+    // single multiplication or division is correctly rounded
+    if (significand > MAX_EXACT_INTEGER)
+        return false;
+    double res = static_cast<double>(significand);
+    if (significand == 0)
+        res = 0;
+    else if (exponent >= 0 && exponent <= 22)
+        res *= POW10[exponent];
+    else if (exponent < 0 && exponent >= -22)
+        res /= POW10[-exponent];
+    else
+        return false;
+
+    x = negative ? -res : res;
+    return true;
+}
+
+}
+
+NumberParser::NumberParser(const QStringRef & str) :
+    data_(str.constData()),
+    pos_(0),
+    size_(str.size())
+{
+}
+
+void NumberParser::skipSeparators_()
+{
+    while (pos_ < size_ && isSeparator(data_[pos_].unicode()))
+        ++pos_;
+}
+
+bool NumberParser::atEnd()
+{
+    skipSeparators_();
+    return pos_ == size_;
+}
+
+bool NumberParser::readDouble(double & x)
+{
+    skipSeparators_();
+    if (pos_ == size_)
+        return false;
+
+    const int begin = pos_;
+    while (pos_ < size_ && !isSeparator(data_[pos_].unicode()))
+        ++pos_;
+
+    if (fastToDouble(data_ + begin, data_ + pos_, x))
+        return true;
+
+    // Slow path, e.g. for more than 15 significant digits, or "inf"
+    bool ok;
+    double res = QString::fromRawData(data_ + begin, pos_ - begin).toDouble(&ok);
+    if (ok)
+        x = res;
+    return ok;
+}
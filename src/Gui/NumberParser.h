@@ -0,0 +1,53 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#ifndef NUMBERPARSER_H
+#define NUMBERPARSER_H
+
+#include <QStringRef>
+
+/// \class NumberParser
+/// Reads a sequence of numbers separated by commas and/or whitespaces, such
+/// as XML attribute values, directly from a QStringRef.
+///
+/// Unlike splitting the string into a QStringList then calling toDouble() on
+/// each item, this does not allocate memory (except in the slow path below):
+/// it is meant for large numeric data, such as edge samples. Usage:
+///
+///     NumberParser parser(xml.attributes().value("curve"));
+///     double x;
+///     while (parser.readDouble(x))
+///         ...
+///
+/// Numbers are read in the C locale, like QString::toDouble(). Most of them,
+/// e.g. "12.5" or "-0.25e-3", are converted by a fast exact path, the others
+/// falling back to QString::toDouble().
+///
+/// The characters of str are not copied: they must outlive the parser.
+
+class NumberParser
+{
+public:
+    NumberParser(const QStringRef & str);
+
+    // Reads the next number. Returns false, leaving x unchanged, if there
+    // are no more numbers or if the next one is invalid.
+    bool readDouble(double & x);
+
+    // Returns whether there are no more numbers to read
+    bool atEnd();
+
+private:
+    const QChar * data_;
+    int pos_;
+    int size_;
+
+    void skipSeparators_();
+};
+
+#endif // NUMBERPARSER_H
@@ -0,0 +1,109 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#include "OperatorStats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+
+// Number of buckets per doubling of the latency
+const int BUCKETS_PER_OCTAVE = 4;
+
+int bucket(qint64 nsecs)
+{
+    const double usecs = nsecs * 1e-3;
+    if(usecs <= 1)
+        return 0;
+    const int res = (int) std::floor(BUCKETS_PER_OCTAVE * std::log2(usecs));
+    return std::min(res, (int) OperatorStats::NumBuckets - 1);
+}
+
+}
+
+OperatorStats::Histogram OperatorStats::histograms_[OperatorStats::NumOperators] = {};
+int OperatorStats::depths_[OperatorStats::NumOperators] = {};
+
+OperatorStats::ScopedTimer::ScopedTimer(Operator op) :
+    op_(op)
+{
+    if(depths_[op_]++ == 0)
+        timer_.start();
+}
+
+OperatorStats::ScopedTimer::~ScopedTimer()
+{
+    --depths_[op_];
+    if(timer_.isValid())
+        addTime(op_, timer_.nsecsElapsed());
+}
+
+void OperatorStats::addTime(Operator op, qint64 nsecs)
+{
+    Histogram & h = histograms_[op];
+    const double msecs = nsecs * 1e-6;
+    ++h.count;
+    h.totalTime += msecs;
+    h.maxTime = std::max(h.maxTime, msecs);
+    ++h.buckets[bucket(nsecs)];
+}
+
+const OperatorStats::Histogram & OperatorStats::histogram(Operator op)
+{
+    return histograms_[op];
+}
+
+double OperatorStats::percentile(Operator op, double p)
+{
+    // Nearest rank, as for the latencies of replayed sessions
+    const Histogram & h = histograms_[op];
+    if(h.count == 0)
+        return 0;
+    const unsigned long long rank = std::max(1ULL, (unsigned long long) std::ceil(p * h.count));
+    unsigned long long n = 0;
+    for(int i=0; i<NumBuckets; ++i)
+    {
+        n += h.buckets[i];
+        if(n >= rank)
+            return std::min(bucketTime(i+1), h.maxTime);
+    }
+    return h.maxTime;
+}
+
+double OperatorStats::bucketTime(int bucket)
+{
+    return bucket == 0 ? 0.0 : 1e-3 * std::pow(2.0, (double) bucket / BUCKETS_PER_OCTAVE);
+}
+
+void OperatorStats::reset()
+{
+    std::memset(histograms_, 0, sizeof(histograms_));
+}
+
+QString OperatorStats::operatorName(Operator op)
+{
+    switch(op)
+    {
+    case InsertSketchedEdge: return "insert sketched edge";
+    case SmartDelete: return "smart delete";
+    case Glue: return "glue";
+    case Uncut: return "uncut";
+    case CutFace: return "cut face";
+    case InbetweenSelection: return "inbetween selection";
+    case Keyframe: return "keyframe";
+    case CreateFace: return "create face";
+    case Paste: return "paste";
+    case MotionPaste: return "motion paste";
+    case AddToUndoStack: return "add to undo stack";
+    case SketchInput: return "sketch input";
+    default: return "unknown";
+    }
+}
@@ -0,0 +1,94 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#ifndef OPERATOR_STATS_H
+#define OPERATOR_STATS_H
+
+// OperatorStats: latency histograms of the heavy operations of the VAC, i.e.,
+// those a user waits on after releasing the mouse or pressing a shortcut, as
+// opposed to per-frame rendering (see RenderStats). The operations being
+// measured create a ScopedTimer, and the histograms accumulate since the
+// start of the session, or since the last reset. They can be viewed in the
+// "Operator Latencies" dock (see OperatorStatsWidget).
+//
+// Operations may call each other (e.g., sketching an edge glues and cuts
+// faces), in which case the latency of each is recorded. Recursive calls of
+// the same operation (e.g., glue_() of halfedges calling glue_() of
+// vertices) are only recorded once, by the outermost call.
+//
+// Latencies are bucketed in quarter powers of two of microseconds, so
+// percentiles are within 19% of their exact values. Counts and maxima are
+// exact. Operations must be measured by the GUI thread.
+
+#include <QElapsedTimer>
+#include <QString>
+
+class OperatorStats
+{
+public:
+    enum Operator
+    {
+        InsertSketchedEdge,
+        SmartDelete,
+        Glue,
+        Uncut,
+        CutFace,
+        InbetweenSelection,
+        Keyframe,
+        CreateFace,
+        Paste,
+        MotionPaste,
+        AddToUndoStack,
+        SketchInput, // from receiving a tablet sample to drawing it, see View
+        NumOperators
+    };
+
+    enum { NumBuckets = 96 }; // up to 2^24 microseconds, about 17 seconds
+
+    struct Histogram
+    {
+        unsigned long long count;
+        double totalTime; // in milliseconds
+        double maxTime;   // in milliseconds
+        unsigned long long buckets[NumBuckets];
+    };
+
+    // Adds the time elapsed between its construction and destruction
+    class ScopedTimer
+    {
+    public:
+        explicit ScopedTimer(Operator op);
+        ~ScopedTimer();
+
+    private:
+        Operator op_;
+        QElapsedTimer timer_; // invalid for recursive calls
+    };
+
+    static void addTime(Operator op, qint64 nsecs);
+
+    static const Histogram & histogram(Operator op);
+
+    // Upper bound of the bucket of the given percentile (e.g., 0.95), in
+    // milliseconds, or 0 if the operator hasn't been called
+    static double percentile(Operator op, double p);
+
+    // Lower bound of the given bucket, in milliseconds
+    static double bucketTime(int bucket);
+
+    // Clears all histograms, e.g., at the beginning of a session
+    static void reset();
+
+    static QString operatorName(Operator op);
+
+private:
+    static Histogram histograms_[NumOperators];
+    static int depths_[NumOperators]; // number of calls in progress
+};
+
+#endif // OPERATOR_STATS_H
@@ -0,0 +1,201 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#include "OperatorStatsWidget.h"
+#include "OperatorStats.h"
+
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QPainter>
+#include <QPushButton>
+#include <QTableWidget>
+#include <QTimer>
+#include <QVBoxLayout>
+
+#include <algorithm>
+
+namespace
+{
+
+// Period of the refresh of the table while visible, in milliseconds
+const int REFRESH_INTERVAL = 500;
+
+enum Column
+{
+    OperatorColumn,
+    CountColumn,
+    P50Column,
+    P95Column,
+    MaxColumn,
+    TotalColumn,
+    NumColumns
+};
+
+QString milliseconds(double msecs)
+{
+    return QString::number(msecs, 'f', msecs < 10 ? 2 : 0);
+}
+
+}
+
+// Bars of the buckets of the histogram of one operator, from its fastest to
+// its slowest call, with its median and 95th percentile
+class OperatorStatsHistogramView: public QWidget
+{
+public:
+    OperatorStatsHistogramView(QWidget * parent = 0) :
+        QWidget(parent),
+        op_(-1)
+    {
+        setMinimumHeight(100);
+    }
+
+    void setOperator(int op)
+    {
+        op_ = op;
+        update();
+    }
+
+protected:
+    void paintEvent(QPaintEvent * /*event*/)
+    {
+        QPainter painter(this);
+        painter.fillRect(rect(), palette().base());
+        if(op_ < 0)
+            return;
+
+        const OperatorStats::Operator op = static_cast<OperatorStats::Operator>(op_);
+        const OperatorStats::Histogram & h = OperatorStats::histogram(op);
+        if(h.count == 0)
+        {
+            painter.drawText(rect(), Qt::AlignCenter, tr("No calls"));
+            return;
+        }
+
+        int first = 0;
+        int last = OperatorStats::NumBuckets - 1;
+        while(h.buckets[first] == 0)
+            ++first;
+        while(h.buckets[last] == 0)
+            --last;
+        const unsigned long long maxCount = *std::max_element(h.buckets + first, h.buckets + last + 1);
+
+        // Bars, above a line of text for the range of latencies
+        const int textHeight = fontMetrics().height();
+        const QRectF bars = QRectF(rect()).adjusted(4, 4, -4, -4 - textHeight);
+        const double barWidth = bars.width() / (last - first + 1);
+        for(int i=first; i<=last; ++i)
+        {
+            const double height = bars.height() * h.buckets[i] / maxCount;
+            painter.fillRect(QRectF(bars.left() + (i - first) * barWidth, bars.bottom() - height,
+                                    std::max(1.0, barWidth - 1), height),
+                             palette().highlight());
+        }
+
+        painter.drawText(QRectF(bars.left(), bars.bottom(), bars.width(), textHeight),
+                         Qt::AlignLeft | Qt::AlignVCenter,
+                         milliseconds(OperatorStats::bucketTime(first)) + " ms");
+        painter.drawText(QRectF(bars.left(), bars.bottom(), bars.width(), textHeight),
+                         Qt::AlignRight | Qt::AlignVCenter,
+                         milliseconds(OperatorStats::bucketTime(last + 1)) + " ms");
+        painter.drawText(QRectF(bars.left(), bars.bottom(), bars.width(), textHeight),
+                         Qt::AlignHCenter | Qt::AlignVCenter,
+                         tr("p50 %1 ms, p95 %2 ms")
+                         .arg(milliseconds(OperatorStats::percentile(op, 0.5)))
+                         .arg(milliseconds(OperatorStats::percentile(op, 0.95))));
+    }
+
+private:
+    int op_; // -1 if none
+};
+
+OperatorStatsWidget::OperatorStatsWidget(QWidget * parent) :
+    QWidget(parent)
+{
+    table_ = new QTableWidget(OperatorStats::NumOperators, NumColumns);
+    table_->setHorizontalHeaderLabels(QStringList()
+                                      << tr("Operator") << tr("Count") << tr("p50 (ms)")
+                                      << tr("p95 (ms)") << tr("Max (ms)") << tr("Total (ms)"));
+    table_->verticalHeader()->hide();
+    table_->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    table_->setSelectionBehavior(QAbstractItemView::SelectRows);
+    table_->setSelectionMode(QAbstractItemView::SingleSelection);
+    for(int i=0; i<OperatorStats::NumOperators; ++i)
+    {
+        table_->setItem(i, OperatorColumn, new QTableWidgetItem(
+                            OperatorStats::operatorName(static_cast<OperatorStats::Operator>(i))));
+        for(int j=CountColumn; j<NumColumns; ++j)
+        {
+            QTableWidgetItem * item = new QTableWidgetItem();
+            item->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+            table_->setItem(i, j, item);
+        }
+    }
+    connect(table_, SIGNAL(itemSelectionChanged()), this, SLOT(updateHistogram_()));
+
+    histogramView_ = new OperatorStatsHistogramView();
+
+    QPushButton * resetButton = new QPushButton(tr("Reset"));
+    resetButton->setToolTip(tr("Clear the latencies recorded so far"));
+    connect(resetButton, SIGNAL(clicked()), this, SLOT(reset_()));
+    QHBoxLayout * buttonsLayout = new QHBoxLayout();
+    buttonsLayout->addStretch();
+    buttonsLayout->addWidget(resetButton);
+
+    QVBoxLayout * layout = new QVBoxLayout();
+    layout->addWidget(table_);
+    layout->addWidget(histogramView_);
+    layout->addLayout(buttonsLayout);
+    setLayout(layout);
+
+    refreshTimer_ = new QTimer(this);
+    refreshTimer_->setInterval(REFRESH_INTERVAL);
+    connect(refreshTimer_, SIGNAL(timeout()), this, SLOT(refresh_()));
+
+    refresh_();
+}
+
+void OperatorStatsWidget::showEvent(QShowEvent * event)
+{
+    refresh_();
+    refreshTimer_->start();
+    QWidget::showEvent(event);
+}
+
+void OperatorStatsWidget::hideEvent(QHideEvent * event)
+{
+    refreshTimer_->stop();
+    QWidget::hideEvent(event);
+}
+
+void OperatorStatsWidget::refresh_()
+{
+    for(int i=0; i<OperatorStats::NumOperators; ++i)
+    {
+        const OperatorStats::Operator op = static_cast<OperatorStats::Operator>(i);
+        const OperatorStats::Histogram & h = OperatorStats::histogram(op);
+        table_->item(i, CountColumn)->setText(QString::number(h.count));
+        table_->item(i, P50Column)->setText(h.count ? milliseconds(OperatorStats::percentile(op, 0.5)) : QString());
+        table_->item(i, P95Column)->setText(h.count ? milliseconds(OperatorStats::percentile(op, 0.95)) : QString());
+        table_->item(i, MaxColumn)->setText(h.count ? milliseconds(h.maxTime) : QString());
+        table_->item(i, TotalColumn)->setText(h.count ? milliseconds(h.totalTime) : QString());
+    }
+    histogramView_->update();
+}
+
+void OperatorStatsWidget::reset_()
+{
+    OperatorStats::reset();
+    refresh_();
+}
+
+void OperatorStatsWidget::updateHistogram_()
+{
+    QList<QTableWidgetItem*> items = table_->selectedItems();
+    histogramView_->setOperator(items.isEmpty() ? -1 : items.first()->row());
+}
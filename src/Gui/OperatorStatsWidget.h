@@ -0,0 +1,43 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#ifndef OPERATOR_STATS_WIDGET_H
+#define OPERATOR_STATS_WIDGET_H
+
+#include <QWidget>
+
+class QTableWidget;
+class QTimer;
+class OperatorStatsHistogramView;
+
+// Table of the latencies of each operator (see OperatorStats), and the
+// histogram of the selected one. Refreshed periodically while visible.
+
+class OperatorStatsWidget: public QWidget
+{
+    Q_OBJECT
+
+public:
+    OperatorStatsWidget(QWidget * parent = 0);
+
+protected:
+    void showEvent(QShowEvent * event);
+    void hideEvent(QHideEvent * event);
+
+private slots:
+    void refresh_();
+    void reset_();
+    void updateHistogram_();
+
+private:
+    QTableWidget * table_;
+    OperatorStatsHistogramView * histogramView_;
+    QTimer * refreshTimer_;
+};
+
+#endif // OPERATOR_STATS_WIDGET_H
@@ -11,6 +11,7 @@
 #include <QtDebug>
 
 uint Picking::rgba_ = 0x000000FF;
+bool Picking::isInteger_ = false;
 
 /*********************************************************************
  *                      OBJECT -> RGBA
@@ -40,13 +41,29 @@ void Picking::setIndex(uint index)
     rgba_ += (index & 0x1FF) << 22;
 }
 
+void Picking::setInteger(bool isInteger)
+{
+    isInteger_ = isInteger;
+}
+
 void Picking::glColor(uint id)
 {
-    // clear the existing value
-    rgba_ &= 0xFFC000FF;
+    if(isInteger_)
+    {
+        // clear the existing value, id and alpha
+        rgba_ &= 0xFFC00000;
 
-    // clamp time, set it
-    rgba_ += (id & 0x3FFF) << 8;    
+        // clamp id, set it
+        rgba_ += id & 0x3FFFFF;
+    }
+    else
+    {
+        // clear the existing value
+        rgba_ &= 0xFFC000FF;
+
+        // clamp time, set it
+        rgba_ += (id & 0x3FFF) << 8;
+    }
     
     // call OpenGL
     // -> fails because of endianness
@@ -56,7 +73,7 @@ void Picking::glColor(uint id)
     color[0] = (rgba_ & 0xFF000000) >> 24;
     color[1] = (rgba_ & 0x00FF0000) >> 16;
     color[2] = (rgba_ & 0x0000FF00) >> 8;
-    color[3] = 255;
+    color[3] = isInteger_ ? (rgba_ & 0x000000FF) : 255;
     glColor4ubv(color);
 }
 
@@ -80,6 +97,15 @@ Picking::Object Picking::objectFromRGB(uchar r, uchar g, uchar b)
     return Object(time, index, id);
 }
 
+Picking::Object Picking::objectFromValue(uint value)
+{
+    uint time = value >> 31;
+    uint index = (value >> 22) & 0x1FF;
+    uint id = value & 0x3FFFFF;
+
+    return Object(time, index, id);
+}
+
 bool Picking::Object::operator==(const Picking::Object & other) const
 {
     return 
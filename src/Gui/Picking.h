@@ -43,6 +43,7 @@ public:
     // set
     static void setTime(uint time); // for view
     static void setIndex(uint index);// for scene
+    static void setInteger(bool isInteger); // for view, see below
     
     // get
     class Object 
@@ -66,6 +67,7 @@ public:
         uint id_;
     };
     static Object objectFromRGB(uchar r, uchar g, uchar b);
+    static Object objectFromValue(uint value); // integer picking
 
     
 private:
@@ -77,8 +79,20 @@ private:
     //         | index (9)      id (14)       255 (8) 
     //         |
     //      time (1)
-    //    
+    //
+    // With integer picking, the picking image is a GL_R32UI texture, and
+    // the four bytes of the color are written as one unsigned integer
+    // (see GLRenderer::beginPicking()). Nothing is blended or antialiased,
+    // so the id can also use the alpha byte:
+    //
+    // value = RRRR RRRR GGGG GGGG BBBB BBBB AAAA AAAA
+    //         ^\_________/\__________________________/
+    //         | index (9)           id (22)
+    //         |
+    //      time (1)
+    //
     static uint rgba_;
+    static bool isInteger_;
 };
 
 #endif
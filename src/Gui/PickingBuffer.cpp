@@ -0,0 +1,427 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#include "PickingBuffer.h"
+
+#include "GLRenderer.h"
+#include "RenderStats.h"
+
+#include <QtDebug>
+#include <algorithm>
+#include <cstring>
+
+PickingBuffer::PickingBuffer() :
+    width_(0),
+    height_(0),
+    isAllocated_(false),
+    isAsync_(false),
+    isInteger_(false),
+    format_(GL_RGBA),
+    type_(GL_UNSIGNED_BYTE),
+    isDrawingRect_(false),
+    textureId_(0),
+    rboId_(0),
+    fboId_(0),
+    image_(0),
+    imageData_(0),
+    mappedPbo_(-1),
+    pendingPbo_(-1)
+{
+    pbos_[0] = pbos_[1] = 0;
+    fences_[0] = fences_[1] = 0;
+}
+
+PickingBuffer::~PickingBuffer()
+{
+    delete[] imageData_;
+}
+
+void PickingBuffer::allocate(int width, int height, bool isAsync, bool isInteger)
+{
+    release();
+    width_ = width;
+    height_ = height;
+
+    // Integer picking: one unsigned integer per pixel, written by a shader,
+    // instead of a color. Same size, so the copy is read the same way.
+    isInteger_ = isInteger && GLRenderer::isPickingSupported();
+    format_ = isInteger_ ? GL_RED_INTEGER : GL_RGBA;
+    type_ = isInteger_ ? GL_UNSIGNED_INT : GL_UNSIGNED_BYTE;
+
+    //  code adapted from http://www.songho.ca/opengl/gl_fbo.html
+
+    // create a texture object
+    glGenTextures(1, &textureId_);
+    glBindTexture(GL_TEXTURE_2D, textureId_);
+    // Note: no mipmaps, since the picking image is only ever read at level 0
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, isInteger_ ? GL_R32UI : GL_RGBA8,
+                 width_, height_, 0, format_, type_, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // create a renderbuffer object to store depth and stencil info (see
+    // FaceCell::drawRaw())
+    glGenRenderbuffers(1, &rboId_);
+    glBindRenderbuffer(GL_RENDERBUFFER, rboId_);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width_, height_);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    // create a framebuffer object
+    glGenFramebuffers(1, &fboId_);
+    glBindFramebuffer(GL_FRAMEBUFFER, fboId_);
+
+    // attach the texture to FBO color attachment point
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                           GL_TEXTURE_2D, textureId_, 0);
+
+    // attach the renderbuffer to depth and stencil attachment points
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
+                              GL_RENDERBUFFER, rboId_);
+
+    // check FBO status
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if(status != GL_FRAMEBUFFER_COMPLETE)
+    {
+        qDebug() << "ERROR void PickingBuffer::allocate()"
+                 << "FBO status != GL_FRAMEBUFFER_COMPLETE";
+    }
+
+    // switch back to window-system-provided framebuffer
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // allocate memory for readback
+    isAsync_ = isAsync && (GLEW_VERSION_2_1 || GLEW_ARB_pixel_buffer_object);
+    if(isAsync_)
+    {
+        glGenBuffers(2, pbos_);
+        for(int i=0; i<2; ++i)
+        {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos_[i]);
+            glBufferData(GL_PIXEL_PACK_BUFFER, 4 * width_ * height_, 0, GL_STREAM_READ);
+            fences_[i] = 0;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        mappedPbo_ = -1;
+        pendingPbo_ = -1;
+    }
+    else
+    {
+        imageData_ = new uchar[4 * width_ * height_];
+        image_ = imageData_;
+    }
+    isAllocated_ = true;
+}
+
+void PickingBuffer::release()
+{
+    if(!isAllocated_)
+        return;
+
+    glDeleteFramebuffers(1, &fboId_);
+    glDeleteRenderbuffers(1, &rboId_);
+    glDeleteTextures(1, &textureId_);
+    if(isAsync_)
+    {
+        unmap_();
+        for(int i=0; i<2; ++i)
+        {
+            if(fences_[i])
+                glDeleteSync(fences_[i]);
+            fences_[i] = 0;
+        }
+        glDeleteBuffers(2, pbos_);
+        pendingPbo_ = -1;
+        isAsync_ = false;
+    }
+    delete[] imageData_;
+    imageData_ = 0;
+    image_ = 0;
+    isAllocated_ = false;
+    width_ = 0;
+    height_ = 0;
+}
+
+// Clears the framebuffer object, or its scissor rectangle, to "no object"
+void PickingBuffer::clear_()
+{
+    if(isInteger_)
+    {
+        const GLuint noObject[4] = {0xFFFFFFFF, 0, 0, 0};
+        glClearBufferuiv(GL_COLOR, 0, noObject);
+        glClear(GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    }
+    else
+    {
+        glClearColor(1.0, 1.0, 1.0, 1.0);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    }
+}
+
+void PickingBuffer::beginDraw()
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, fboId_);
+    clear_();
+    if(isInteger_)
+        GLRenderer::beginPicking();
+    Picking::setInteger(isInteger_);
+}
+
+void PickingBuffer::beginDraw(int xMin, int yMin, int xMax, int yMax)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, fboId_);
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(xMin, height_ - 1 - yMax, xMax - xMin + 1, yMax - yMin + 1);
+    isDrawingRect_ = true;
+    clear_();
+    if(isInteger_)
+        GLRenderer::beginPicking();
+    Picking::setInteger(isInteger_);
+}
+
+void PickingBuffer::endDraw()
+{
+    if(isInteger_)
+        GLRenderer::endPicking();
+    Picking::setInteger(false);
+    if(isDrawingRect_)
+        glDisable(GL_SCISSOR_TEST);
+    isDrawingRect_ = false;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void PickingBuffer::read()
+{
+    RenderStats::ScopedTimer timer(RenderStats::PickingReadback);
+    if(!isAsync_)
+    {
+        // extract the texture info from GPU to RAM: EXPENSIVE + MAY CAUSE OPENGL STALL
+        glBindTexture(GL_TEXTURE_2D, textureId_);
+        glGetTexImage(GL_TEXTURE_2D, 0, format_, type_, imageData_);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        image_ = imageData_;
+        return;
+    }
+
+    // Start transfer into the PBO which is not mapped. If a previous transfer
+    // into this PBO has not been resolved yet, it is simply superseded.
+    int i = (mappedPbo_ == 0) ? 1 : 0;
+    if(fences_[i])
+    {
+        glDeleteSync(fences_[i]);
+        fences_[i] = 0;
+    }
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fboId_);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos_[i]);
+    glReadPixels(0, 0, width_, height_, format_, type_, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    if(GLEW_VERSION_3_2 || GLEW_ARB_sync)
+        fences_[i] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    pendingPbo_ = i;
+}
+
+void PickingBuffer::read(int xMin, int yMin, int xMax, int yMax)
+{
+    if(!imageData_)
+        return;
+
+    RenderStats::ScopedTimer timer(RenderStats::PickingReadback);
+    int glYMin = height_ - 1 - yMax; // OpenGL window coordinates are bottom-up
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fboId_);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glPixelStorei(GL_PACK_ROW_LENGTH, width_);
+    glReadPixels(xMin, glYMin, xMax - xMin + 1, yMax - yMin + 1, format_, type_,
+                 imageData_ + 4 * (glYMin * width_ + xMin));
+    glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+}
+
+void PickingBuffer::resolve()
+{
+    if(!isAsync_ || pendingPbo_ < 0)
+        return;
+
+    RenderStats::ScopedTimer timer(RenderStats::PickingReadback);
+
+    // Keep using the previous image if the transfer is not done yet
+    int i = pendingPbo_;
+    if(image_ && fences_[i])
+    {
+        GLenum status = glClientWaitSync(fences_[i], 0, 0);
+        if(status == GL_TIMEOUT_EXPIRED)
+            return;
+    }
+    if(fences_[i])
+    {
+        glDeleteSync(fences_[i]);
+        fences_[i] = 0;
+    }
+
+    // Unmap previous image
+    unmap_();
+
+    // Map new image
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos_[i]);
+    image_ = reinterpret_cast<uchar*>(glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY));
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    mappedPbo_ = image_ ? i : -1;
+    pendingPbo_ = -1;
+}
+
+void PickingBuffer::unmap_()
+{
+    if(mappedPbo_ >= 0)
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos_[mappedPbo_]);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        mappedPbo_ = -1;
+    }
+}
+
+bool PickingBuffer::shift(int dx, int dy)
+{
+    const int w = width_;
+    const int h = height_;
+
+    // With asynchronous readback, the image to shift is the mapped one, and
+    // only if no newer image is being transferred. It is copied to RAM, and
+    // used by queries until the next full readback.
+    if(isAsync_)
+    {
+        if(pendingPbo_ >= 0 || !image_)
+            return false;
+        if(mappedPbo_ >= 0)
+        {
+            if(!imageData_)
+                imageData_ = new uchar[4 * w * h];
+            std::memcpy(imageData_, image_, 4 * w * h);
+            unmap_();
+            image_ = imageData_;
+        }
+    }
+    if(!imageData_ || image_ != imageData_)
+        return false;
+
+    // Shift rows, which are stored bottom-up. Rows are visited in an order
+    // which never overwrites a row before it is copied.
+    const int rowBytes = 4 * w;
+    const int xBegin = std::max(0, dx);
+    const int xEnd = std::min(w, w + dx);
+    for(int k=0; k<h; ++k)
+    {
+        int row = (dy > 0) ? k : h - 1 - k;
+        int src = row + dy;
+        if(src < 0 || src >= h)
+            continue;
+        std::memmove(imageData_ + row * rowBytes + 4 * xBegin,
+                     imageData_ + src * rowBytes + 4 * (xBegin - dx),
+                     4 * (xEnd - xBegin));
+    }
+    return true;
+}
+
+const uchar * PickingBuffer::pixel_(int x, int y) const
+{
+    int k = 4*( (height_ - y - 1)*width_ + x);
+    return &image_[k];
+}
+
+// Object drawn at the given pixel of the image, or the null object
+Picking::Object PickingBuffer::object_(const uchar * p) const
+{
+    if(isInteger_)
+    {
+        uint value;
+        std::memcpy(&value, p, 4);
+        if(value != 0xFFFFFFFF)
+            return Picking::objectFromValue(value);
+    }
+    else
+    {
+        uchar r=p[0], g=p[1], b=p[2];
+        if(r!=255 || g!=255 || b!=255)
+            return Picking::objectFromRGB(r,g,b);
+    }
+    return Picking::Object();
+}
+
+Picking::Object PickingBuffer::objectAt(int x, int y) const
+{
+    if(!image_ || x<0 || x>=width_ || y<0 || y>=height_)
+        return Picking::Object();
+
+    return object_(pixel_(x,y));
+}
+
+// This method must be very fast
+Picking::Object PickingBuffer::closestObject(int x, int y, int radius) const
+{
+    // First look directly whether there's an object right at mouse position
+    Picking::Object object = objectAt(x,y);
+    if(!object.isNull() || !image_ || x<0 || x>=width_ || y<0 || y>=height_)
+        return object;
+
+    // If not, look around in a radius of D pixels, clipped by the borders
+    int D = radius;
+    D = std::min(D, x);
+    D = std::min(D, y);
+    D = std::min(D, width_-1-x);
+    D = std::min(D, height_-1-y);
+
+    for(int d=1; d<=D; d++)
+    {
+        // top row
+        for(int varX=x-d; varX<=x+d; varX++)
+        {
+            object = object_(pixel_(varX,y-d));
+            if(!object.isNull())
+                return object;
+        }
+        // bottom row
+        for(int varX=x-d; varX<=x+d; varX++)
+        {
+            object = object_(pixel_(varX,y+d));
+            if(!object.isNull())
+                return object;
+        }
+        // left column
+        for(int varY=y-d; varY<=y+d; varY++)
+        {
+            object = object_(pixel_(x-d,varY));
+            if(!object.isNull())
+                return object;
+        }
+        // right column
+        for(int varY=y-d; varY<=y+d; varY++)
+        {
+            object = object_(pixel_(x+d,varY));
+            if(!object.isNull())
+                return object;
+        }
+    }
+
+    // If still no object found, return a null object
+    return Picking::Object();
+}
+
+std::size_t PickingBuffer::numBytes() const
+{
+    // Render target (color and depth), then pixel buffers and copy in RAM
+    if(!isAllocated_)
+        return 0;
+    std::size_t imageBytes = std::size_t(4) * width_ * height_;
+    return 2 * imageBytes + (isAsync_ ? 2 * imageBytes : 0) +
+           (imageData_ ? imageBytes : 0);
+}
@@ -0,0 +1,112 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#ifndef PICKING_BUFFER_H
+#define PICKING_BUFFER_H
+
+// PickingBuffer: the picking image of a view, i.e. which object is drawn at
+// each pixel (see Picking), with the framebuffer object it is drawn into and
+// its copy in RAM queried on mouse moves. Used by both View and View3D, which
+// decide when and what to draw into it.
+//
+// Backends and readback modes are chosen when it is allocated:
+//   - color: an RGBA8 target, the object being encoded in the RGB color
+//   - integer: a GL_R32UI target, written by GLRenderer::beginPicking()
+//   - sync: the whole image, or a rectangle of it, is read back when drawn
+//   - async: the whole image is read back into one of two pixel buffer
+//     objects, and hover queries keep using the previous image, mapped from
+//     the other one, until the transfer is done (see resolve())
+//
+// Must be used with the context of the view current, except for queries.
+
+#include "OpenGL.h"
+#include "Picking.h"
+
+#include <cstddef>
+
+class PickingBuffer
+{
+public:
+    PickingBuffer();
+    ~PickingBuffer(); // release() must have been called before
+
+    // Allocates the buffers, for the given size in pixels. The integer
+    // backend is only used if supported (see GLRenderer::beginPicking()).
+    void allocate(int width, int height, bool isAsync, bool isInteger);
+    void release();
+    bool isAllocated() const { return isAllocated_; }
+    int width() const { return width_; }
+    int height() const { return height_; }
+    bool isAsync() const { return isAsync_; }
+    bool isInteger() const { return isInteger_; }
+
+    // Binds the framebuffer object and clears it, or only the given rectangle
+    // in window coordinates (inclusive), to "no object". Objects are then
+    // drawn with Picking::glColor() until endDraw()
+    void beginDraw();
+    void beginDraw(int xMin, int yMin, int xMax, int yMax);
+    void endDraw();
+
+    // Reads back the whole image, synchronously or asynchronously, or
+    // synchronously the given rectangle, directly at its place in the copy
+    void read();
+    void read(int xMin, int yMin, int xMax, int yMax);
+
+    // Makes the latest completed asynchronous image available to queries.
+    // Only blocks if there is no image at all yet.
+    bool hasPendingRead() const { return pendingPbo_ >= 0; }
+    void resolve();
+
+    // Shifts the copy in RAM so that the new pixel at (x, y), in window
+    // coordinates, is the old one at (x-dx, y-dy). Exposed pixels are left
+    // as they are, to be drawn and read back by the caller. Returns false,
+    // doing nothing, if there is no image or a newer one is being
+    // transferred.
+    bool shift(int dx, int dy);
+
+    // Whether there is an image to query
+    bool hasImage() const { return image_ != 0; }
+
+    // Object at the given pixel, in window coordinates, or if none, the
+    // closest object within radius pixels. Returns the null object if no
+    // object is found, if there is no image, or if x or y is out of range.
+    Picking::Object objectAt(int x, int y) const;
+    Picking::Object closestObject(int x, int y, int radius) const;
+
+    // Bytes of GPU and CPU memory, for MemoryStats
+    std::size_t numBytes() const;
+
+private:
+    int width_;
+    int height_;
+    bool isAllocated_;
+    bool isAsync_;
+    bool isInteger_;
+    GLenum format_; // for readback
+    GLenum type_;
+    bool isDrawingRect_;
+
+    GLuint textureId_;
+    GLuint rboId_;
+    GLuint fboId_;
+
+    uchar * image_;     // image used by queries
+    uchar * imageData_; // copy in RAM (synchronous readback or shifted image)
+
+    GLuint pbos_[2];
+    GLsync fences_[2];
+    int mappedPbo_;  // -1 if none
+    int pendingPbo_; // -1 if none
+
+    void clear_();
+    void unmap_();
+    const uchar * pixel_(int x, int y) const;
+    Picking::Object object_(const uchar * p) const;
+};
+
+#endif // PICKING_BUFFER_H
@@ -0,0 +1,150 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#include "RenderShards.h"
+#include "Application.h"
+#include "GLRenderer.h"
+
+#include <QGuiApplication>
+#include <QProcess>
+#include <QProgressDialog>
+#include <QTextStream>
+#include <QThread>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+namespace
+{
+
+// Time waiting for the output of each child before checking the others
+const int POLL_INTERVAL_MS = 10;
+
+struct Shard
+{
+    int firstFrame;
+    int lastFrame;
+    std::unique_ptr<QProcess> process;
+    QByteArray output; // not yet parsed
+    QByteArray errors;
+};
+
+QStringList shardArguments(const BatchRenderOptions & options, const Shard & shard, int numThreads)
+{
+    QStringList args;
+    args << "--render" << options.outputPath
+         << "--frames" << QString("%1-%2").arg(shard.firstFrame).arg(shard.lastFrame)
+         << "--threads" << QString::number(numThreads)
+         << "--progress";
+    if(options.width > 0 && options.height > 0)
+        args << "--size" << QString("%1x%2").arg(options.width).arg(options.height);
+    if(GLRenderer::backend() == GLRenderer::Shader)
+        args << "--renderer" << "shader";
+    args << options.inputPath;
+    return args;
+}
+
+// Reads the output of the child, and returns the number of frames it
+// reported as rendered since the last call
+int readRenderedFrames(Shard & shard)
+{
+    shard.output += shard.process->readAllStandardOutput();
+    shard.errors += shard.process->readAllStandardError();
+    int numFrames = 0;
+    int i;
+    while((i = shard.output.indexOf('\n')) >= 0)
+    {
+        if(shard.output.startsWith("frame "))
+            ++numFrames;
+        shard.output.remove(0, i+1);
+    }
+    return numFrames;
+}
+
+}
+
+bool RenderShards::render(const BatchRenderOptions & options, int numProcesses, QProgressDialog * progress)
+{
+    QTextStream err(stderr);
+
+    // Split frames in contiguous ranges of nearly equal sizes, and threads
+    // equally between processes
+    const int numFrames = options.lastFrame - options.firstFrame + 1;
+    numProcesses = std::max(1, std::min(numProcesses, numFrames));
+    int numThreads = options.numThreads > 0 ? options.numThreads : QThread::idealThreadCount();
+    numThreads = std::max(1, numThreads / numProcesses);
+    std::vector<Shard> shards(numProcesses);
+    for(int i=0; i<numProcesses; ++i)
+    {
+        shards[i].firstFrame = options.firstFrame + (i * numFrames) / numProcesses;
+        shards[i].lastFrame = options.firstFrame + ((i+1) * numFrames) / numProcesses - 1;
+    }
+
+    // Start children, on the same platform as this process (e.g. "offscreen")
+    QProcessEnvironment environment = QProcessEnvironment::systemEnvironment();
+    environment.insert("QT_QPA_PLATFORM", QGuiApplication::platformName());
+    bool success = true;
+    for(Shard & shard: shards)
+    {
+        shard.process.reset(new QProcess());
+        shard.process->setProcessEnvironment(environment);
+        shard.process->start(QCoreApplication::applicationFilePath(), shardArguments(options, shard, numThreads));
+        if(!shard.process->waitForStarted())
+        {
+            err << "Error: couldn't start the process rendering frames "
+                << shard.firstFrame << "-" << shard.lastFrame << "\n";
+            success = false;
+        }
+    }
+
+    // Aggregate progress until all children exit
+    int numRenderedFrames = 0;
+    bool isCanceled = false;
+    while(true)
+    {
+        bool isRunning = false;
+        for(Shard & shard: shards)
+        {
+            if(shard.process->state() != QProcess::NotRunning)
+            {
+                isRunning = true;
+                shard.process->waitForReadyRead(POLL_INTERVAL_MS);
+            }
+            numRenderedFrames += readRenderedFrames(shard);
+        }
+        if(progress)
+        {
+            progress->setValue(std::min(numRenderedFrames, numFrames));
+            if(progress->wasCanceled() && !isCanceled)
+            {
+                isCanceled = true;
+                for(Shard & shard: shards)
+                    shard.process->kill();
+            }
+        }
+        if(!isRunning)
+            break;
+    }
+    if(isCanceled)
+        return false;
+
+    // Report failures
+    for(Shard & shard: shards)
+    {
+        readRenderedFrames(shard);
+        if(shard.process->exitStatus() != QProcess::NormalExit || shard.process->exitCode() != 0)
+        {
+            err << "Error: the process rendering frames "
+                << shard.firstFrame << "-" << shard.lastFrame << " failed\n"
+                << QString::fromLocal8Bit(shard.errors);
+            success = false;
+        }
+    }
+    return success;
+}
@@ -0,0 +1,35 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#ifndef RENDERSHARDS_H
+#define RENDERSHARDS_H
+
+// Rendering of a PNG sequence split across several child processes, each
+// running VPaint in batch mode (see Application.cpp) on a contiguous range of
+// the frames, for long shots that a single process couldn't render within
+// its memory or OpenGL limits. Each child reads the document once, and
+// writes the same files as a single process would, i.e.
+// <basename>_<frame>.png.
+//
+// Children print each frame they render on their standard output
+// (--progress), which is aggregated into the given progress dialog, if any.
+// Canceling it kills all children.
+
+class QProgressDialog;
+struct BatchRenderOptions;
+
+namespace RenderShards
+{
+// Renders frames [options.firstFrame, options.lastFrame] of the document
+// options.inputPath in numProcesses processes, splitting options.numThreads
+// between them. Blocks until all children exit, and returns whether all
+// succeeded, printing the errors of those which failed.
+bool render(const BatchRenderOptions & options, int numProcesses, QProgressDialog * progress = 0);
+}
+
+#endif // RENDERSHARDS_H
@@ -0,0 +1,397 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#include "RenderStats.h"
+#include "OpenGL.h"
+#include "DevSettings.h"
+#include "Trace.h"
+#include "VectorAnimationComplex/GeometryCache.h"
+
+#include <QFile>
+#include <QMap>
+#include <QOpenGLContext>
+#include <QTextStream>
+#include <QVector>
+
+namespace
+{
+// Number of frames kept in the log
+const int MAX_LOG_SIZE = 10000;
+
+// Number of unresolved GPU timings kept per OpenGL context, in case it
+// doesn't begin frames (e.g., offscreen export)
+const int MAX_PENDING_GPU_QUERIES = 1024;
+
+// Increase of a counter which may have been reset since
+unsigned long long delta(unsigned long long current, unsigned long long previous)
+{
+    return current >= previous ? current - previous : current;
+}
+
+// A GPU timing, measured by two timestamp queries
+struct GpuQuery
+{
+    RenderStats::Timing timing;
+    GLuint begin;
+    GLuint end;
+    qint64 frame;
+};
+
+// Query objects aren't shared between OpenGL contexts, so each context has
+// its own, recycled once resolved
+struct GpuQueries
+{
+    QVector<GLuint> free;
+    QList<GpuQuery> pending; // in the order they end
+    qint64 traceOffset;      // from GPU to trace time, in nanoseconds
+};
+
+QMap<QOpenGLContext *, GpuQueries> & gpuQueries()
+{
+    static QMap<QOpenGLContext *, GpuQueries> res;
+    return res;
+}
+
+// Maps GPU timestamps of upcoming queries of the current context to the
+// clock of Trace
+void calibrate(GpuQueries & queries)
+{
+    queries.traceOffset = 0;
+    if(Trace::isEnabled())
+    {
+        GLint64 gpuNow = 0;
+        glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+        queries.traceOffset = Trace::now() - gpuNow;
+    }
+}
+
+// Queries of the current context, forgotten when it is destroyed (which
+// deletes them)
+GpuQueries & currentGpuQueries()
+{
+    QOpenGLContext * context = QOpenGLContext::currentContext();
+    QMap<QOpenGLContext *, GpuQueries> & queries = gpuQueries();
+    auto it = queries.find(context);
+    if(it == queries.end())
+    {
+        QObject::connect(context, &QObject::destroyed, [context] ()
+        {
+            gpuQueries().remove(context);
+        });
+        it = queries.insert(context, GpuQueries());
+        calibrate(*it);
+    }
+    return *it;
+}
+
+GLuint takeQuery(GpuQueries & queries)
+{
+    GLuint id = 0;
+    if(queries.free.isEmpty())
+    {
+        glGenQueries(1, &id);
+    }
+    else
+    {
+        id = queries.free.back();
+        queries.free.pop_back();
+    }
+    return id;
+}
+
+// Also used as name of zones of Trace, which must outlive it
+const char * timingLiteral(RenderStats::Timing timing)
+{
+    switch(timing)
+    {
+    case RenderStats::VACDraw: return "vac draw";
+    case RenderStats::DrawPick: return "draw pick";
+    case RenderStats::Background: return "background";
+    case RenderStats::OnionSkins: return "onion skins";
+    case RenderStats::PickingReadback: return "picking readback";
+    case RenderStats::DrawCells: return "draw cells";
+    case RenderStats::DrawTopology: return "draw topology";
+    case RenderStats::Overlays: return "overlays";
+    default: return "unknown";
+    }
+}
+}
+
+std::atomic<bool> RenderStats::isEnabled_(false);
+std::atomic<unsigned long long> RenderStats::counters_[RenderStats::NumCounters];
+qint64 RenderStats::timings_[RenderStats::NumTimings] = {};
+QElapsedTimer RenderStats::frameTimer_;
+unsigned long long RenderStats::geometryCacheHits_ = 0;
+unsigned long long RenderStats::geometryCacheMisses_ = 0;
+RenderStats::Frame RenderStats::lastFrame_ = {};
+QList<RenderStats::Frame> RenderStats::log_;
+qint64 RenderStats::numFrames_ = 0;
+qint64 RenderStats::lastGpuFrameNumber_ = -1;
+bool RenderStats::isGpuTimingEnabled_ = false;
+
+void RenderStats::addTime(Timing timing, qint64 nsecs)
+{
+    if(isEnabled())
+        timings_[timing] += nsecs;
+}
+
+RenderStats::ScopedTimer::ScopedTimer(Timing timing) :
+    timing_(timing),
+    gpuBegin_(0)
+{
+    if(isEnabled())
+    {
+        timer_.start();
+        gpuBegin_ = beginGpuQuery_();
+    }
+}
+
+RenderStats::ScopedTimer::~ScopedTimer()
+{
+    if(timer_.isValid())
+        addTime(timing_, timer_.nsecsElapsed());
+    if(gpuBegin_)
+        endGpuQuery_(timing_, gpuBegin_);
+}
+
+unsigned int RenderStats::beginGpuQuery_()
+{
+    if(!isGpuTimingEnabled_ || !QOpenGLContext::currentContext())
+        return 0;
+
+    GLuint id = takeQuery(currentGpuQueries());
+    glQueryCounter(id, GL_TIMESTAMP);
+    return id;
+}
+
+void RenderStats::endGpuQuery_(Timing timing, unsigned int begin)
+{
+    if(!QOpenGLContext::currentContext())
+        return;
+
+    GpuQueries & queries = currentGpuQueries();
+    GpuQuery query = { timing, begin, takeQuery(queries), numFrames_ };
+    glQueryCounter(query.end, GL_TIMESTAMP);
+    queries.pending << query;
+
+    // Recycle the oldest queries if never resolved. Their results are
+    // simply superseded
+    while(queries.pending.size() > MAX_PENDING_GPU_QUERIES)
+    {
+        GpuQuery oldest = queries.pending.takeFirst();
+        queries.free << oldest.begin << oldest.end;
+    }
+}
+
+// Collects the results of the queries of the current context which are
+// available, in the order they end, which is the order the GPU executes them
+void RenderStats::resolveGpuQueries_()
+{
+    if(!QOpenGLContext::currentContext())
+        return;
+
+    GpuQueries & queries = currentGpuQueries();
+    while(!queries.pending.isEmpty())
+    {
+        const GpuQuery & query = queries.pending.first();
+        GLint isAvailable = 0;
+        glGetQueryObjectiv(query.end, GL_QUERY_RESULT_AVAILABLE, &isAvailable);
+        if(!isAvailable)
+            break;
+
+        GLuint64 begin = 0;
+        GLuint64 end = 0;
+        glGetQueryObjectui64v(query.begin, GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(query.end, GL_QUERY_RESULT, &end);
+        qint64 duration = end > begin ? end - begin : 0;
+        if(Frame * frame = loggedFrame_(query.frame))
+            frame->gpuTimings[query.timing] += duration * 1e-6;
+        Trace::addGpuZone(timingLiteral(query.timing), qint64(begin) + queries.traceOffset, duration);
+
+        queries.free << query.begin << query.end;
+        queries.pending.removeFirst();
+    }
+
+    // Frames before the oldest pending query are complete
+    qint64 lastCompleteFrame = (queries.pending.isEmpty() ? numFrames_ : queries.pending.first().frame) - 1;
+    if(loggedFrame_(lastCompleteFrame))
+        lastGpuFrameNumber_ = lastCompleteFrame;
+
+    calibrate(queries);
+}
+
+RenderStats::Frame * RenderStats::loggedFrame_(qint64 number)
+{
+    qint64 i = log_.size() - (numFrames_ - number);
+    return (number >= 0 && i >= 0 && i < log_.size()) ? &log_[i] : 0;
+}
+
+void RenderStats::beginFrame()
+{
+    bool wasEnabled = isEnabled();
+    bool enabled = DevSettings::getBool("render stats");
+    if(enabled && !wasEnabled)
+    {
+        // Don't record what was done while disabled
+        for(int i=0; i<NumCounters; ++i)
+            counters_[i].store(0, std::memory_order_relaxed);
+        for(int i=0; i<NumTimings; ++i)
+            timings_[i] = 0;
+        using VectorAnimationComplex::GeometryCache;
+        geometryCacheHits_ = GeometryCache::numHits();
+        geometryCacheMisses_ = GeometryCache::numMisses();
+    }
+    isEnabled_.store(enabled, std::memory_order_relaxed);
+    if(enabled)
+        frameTimer_.start();
+
+    isGpuTimingEnabled_ = enabled && DevSettings::getBool("gpu timer queries") &&
+                          (GLEW_VERSION_3_3 || GLEW_ARB_timer_query);
+    if(isGpuTimingEnabled_)
+        resolveGpuQueries_();
+}
+
+void RenderStats::endFrame()
+{
+    if(!isEnabled() || !frameTimer_.isValid())
+        return;
+
+    Frame frame;
+    frame.wallTime = frameTimer_.nsecsElapsed() * 1e-6;
+    frameTimer_.invalidate();
+    for(int i=0; i<NumTimings; ++i)
+    {
+        frame.timings[i] = timings_[i] * 1e-6;
+        frame.gpuTimings[i] = 0;
+        timings_[i] = 0;
+    }
+    frame.hasGpuTimings = isGpuTimingEnabled_;
+    for(int i=0; i<NumCounters; ++i)
+        frame.counters[i] = counters_[i].exchange(0, std::memory_order_relaxed);
+
+    using VectorAnimationComplex::GeometryCache;
+    unsigned long long hits = GeometryCache::numHits();
+    unsigned long long misses = GeometryCache::numMisses();
+    frame.counters[TrianglesCacheHits] = delta(hits, geometryCacheHits_);
+    frame.counters[TrianglesCacheMisses] = delta(misses, geometryCacheMisses_);
+    geometryCacheHits_ = hits;
+    geometryCacheMisses_ = misses;
+
+    lastFrame_ = frame;
+    log_ << frame;
+    ++numFrames_;
+    while(log_.size() > MAX_LOG_SIZE)
+        log_.removeFirst();
+}
+
+const RenderStats::Frame & RenderStats::lastFrame()
+{
+    return lastFrame_;
+}
+
+QString RenderStats::lastFrameText()
+{
+    QString res = QString("frame: %1 ms").arg(lastFrame_.wallTime, 0, 'f', 2);
+    for(int i=0; i<NumTimings; ++i)
+    {
+        res += QString("\n%1: %2 ms").arg(timingName(static_cast<Timing>(i)))
+                                     .arg(lastFrame_.timings[i], 0, 'f', 2);
+    }
+    if(const Frame * gpuFrame = lastGpuFrame())
+    {
+        for(int i=0; i<NumTimings; ++i)
+        {
+            res += QString("\ngpu %1: %2 ms").arg(timingName(static_cast<Timing>(i)))
+                                             .arg(gpuFrame->gpuTimings[i], 0, 'f', 2);
+        }
+    }
+    for(int i=0; i<NumCounters; ++i)
+    {
+        res += QString("\n%1: %2").arg(counterName(static_cast<Counter>(i)))
+                                  .arg(lastFrame_.counters[i]);
+    }
+    return res;
+}
+
+const RenderStats::Frame * RenderStats::lastGpuFrame()
+{
+    const Frame * frame = loggedFrame_(lastGpuFrameNumber_);
+    return (frame && frame->hasGpuTimings) ? frame : 0;
+}
+
+const QList<RenderStats::Frame> & RenderStats::log()
+{
+    return log_;
+}
+
+void RenderStats::clearLog()
+{
+    log_.clear();
+    lastGpuFrameNumber_ = -1;
+}
+
+bool RenderStats::exportLog(const QString & filePath)
+{
+    QFile file(filePath);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Text))
+        return false;
+
+    QTextStream out(&file);
+    out << "frame,wall time (ms)";
+    for(int i=0; i<NumTimings; ++i)
+        out << "," << timingName(static_cast<Timing>(i)) << " (ms)";
+    for(int i=0; i<NumTimings; ++i)
+        out << ",gpu " << timingName(static_cast<Timing>(i)) << " (ms)";
+    for(int i=0; i<NumCounters; ++i)
+        out << "," << counterName(static_cast<Counter>(i));
+    out << "\n";
+
+    for(int j=0; j<log_.size(); ++j)
+    {
+        const Frame & frame = log_[j];
+        out << j << "," << frame.wallTime;
+        for(int i=0; i<NumTimings; ++i)
+            out << "," << frame.timings[i];
+        for(int i=0; i<NumTimings; ++i)
+        {
+            // Left empty if not measured
+            out << ",";
+            if(frame.hasGpuTimings)
+                out << frame.gpuTimings[i];
+        }
+        for(int i=0; i<NumCounters; ++i)
+            out << "," << frame.counters[i];
+        out << "\n";
+    }
+
+    out.flush();
+    return out.status() == QTextStream::Ok;
+}
+
+QString RenderStats::timingName(Timing timing)
+{
+    return QString::fromLatin1(timingLiteral(timing));
+}
+
+QString RenderStats::counterName(Counter counter)
+{
+    switch(counter)
+    {
+    case CellsDrawn: return "cells drawn";
+    case TrianglesSubmitted: return "triangles submitted";
+    case TrianglesCacheHits: return "triangles cache hits";
+    case TrianglesCacheMisses: return "triangles cache misses";
+    case Triangulations: return "triangulations";
+    case InterpolatedTriangulations: return "interpolated triangulations";
+    case RunsRebuilt: return "runs rebuilt";
+    case RunsRecolored: return "runs recolored";
+    case RunsReordered: return "runs reordered";
+    case DroppedFrames: return "dropped frames";
+    default: return "unknown";
+    }
+}
@@ -0,0 +1,145 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#ifndef RENDER_STATS_H
+#define RENDER_STATS_H
+
+// RenderStats: per-frame rendering statistics, for profiling. The code being
+// measured adds timings and counts, and View::drawScene() collects them at the
+// end of each frame into a log of recent frames. The last frame can be shown
+// as an overlay, and the log exported as CSV (see the "render stats" dev
+// setting, and MainWindow::exportRenderStats()).
+//
+// Since the picking image is rendered and read back outside of paint events,
+// a frame records everything done since the end of the previous frame, by all
+// views. Timings may overlap: onion skins include the VAC draws they perform.
+//
+// Timings must be measured by the GUI thread. Counters can be incremented by
+// any thread (e.g., during parallel triangulation).
+//
+// When OpenGL timer queries are supported (see the "gpu timer queries" dev
+// setting), timings are also measured on the GPU, by timestamp queries issued
+// at the beginning and end of each ScopedTimer, which tell whether a slow
+// frame is spent submitting or executing OpenGL commands. Their results are
+// collected without stalling, typically a few frames later, when the same
+// OpenGL context begins a frame again, and are also recorded as zones of
+// the "GPU" track of Trace.
+
+#include <QElapsedTimer>
+#include <QString>
+#include <QList>
+#include <atomic>
+
+class RenderStats
+{
+public:
+    enum Timing
+    {
+        VACDraw,
+        DrawPick,
+        Background,
+        OnionSkins,
+        PickingReadback,
+        DrawCells,
+        DrawTopology,
+        Overlays,
+        NumTimings
+    };
+
+    // Cache hits and misses are those of Cell::triangles(Time), as
+    // recorded by GeometryCache, and don't need to be added
+    enum Counter
+    {
+        CellsDrawn,
+        TrianglesSubmitted,
+        TrianglesCacheHits,
+        TrianglesCacheMisses,
+        Triangulations,
+        InterpolatedTriangulations, // see GeometryCache
+        RunsRebuilt,   // see DrawList
+        RunsRecolored,
+        RunsReordered,
+        DroppedFrames, // see Timeline
+        NumCounters
+    };
+
+    struct Frame
+    {
+        double wallTime;            // in milliseconds
+        double timings[NumTimings]; // in milliseconds
+        double gpuTimings[NumTimings]; // in milliseconds, see lastGpuFrame()
+        bool hasGpuTimings;
+        unsigned long long counters[NumCounters];
+    };
+
+    // Whether statistics are collected. Since this is cheap, the code being
+    // measured doesn't need to test it before adding anything
+    static bool isEnabled() { return isEnabled_.load(std::memory_order_relaxed); }
+
+    static void add(Counter counter, unsigned long long n = 1)
+    {
+        if(isEnabled())
+            counters_[counter].fetch_add(n, std::memory_order_relaxed);
+    }
+    static void addTime(Timing timing, qint64 nsecs);
+
+    // Adds the time elapsed between its construction and destruction. The
+    // same OpenGL context, if any, must be current at both
+    class ScopedTimer
+    {
+    public:
+        explicit ScopedTimer(Timing timing);
+        ~ScopedTimer();
+
+    private:
+        Timing timing_;
+        QElapsedTimer timer_;
+        unsigned int gpuBegin_; // timestamp query, 0 if none
+    };
+
+    // Called at the beginning and end of each frame
+    static void beginFrame();
+    static void endFrame();
+
+    // Statistics of the last frame, as a human readable multiline string
+    static const Frame & lastFrame();
+    static QString lastFrameText();
+
+    // Most recent frame whose GPU timings are all known to the current
+    // OpenGL context, or 0 if none. GPU timings of other contexts (e.g.,
+    // picking in another view) are added when these contexts begin a frame
+    static const Frame * lastGpuFrame();
+
+    // Log of the most recent frames
+    static const QList<Frame> & log();
+    static void clearLog();
+    static bool exportLog(const QString & filePath);
+
+    static QString timingName(Timing timing);
+    static QString counterName(Counter counter);
+
+private:
+    static std::atomic<bool> isEnabled_;
+    static std::atomic<unsigned long long> counters_[NumCounters];
+    static qint64 timings_[NumTimings];
+    static QElapsedTimer frameTimer_;
+    static unsigned long long geometryCacheHits_;
+    static unsigned long long geometryCacheMisses_;
+    static Frame lastFrame_;
+    static QList<Frame> log_;
+    static qint64 numFrames_; // ended since the start, numbering frames
+    static qint64 lastGpuFrameNumber_; // -1 if none
+    static bool isGpuTimingEnabled_;
+
+    static unsigned int beginGpuQuery_();
+    static void endGpuQuery_(Timing timing, unsigned int begin);
+    static void resolveGpuQueries_();
+    static Frame * loggedFrame_(qint64 number);
+};
+
+#endif // RENDER_STATS_H
@@ -0,0 +1,392 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#include "RenderThread.h"
+#include "GLRenderer.h"
+
+#include <QCoreApplication>
+#include <QOpenGLContext>
+#include <QOffscreenSurface>
+#include <QMutexLocker>
+
+#include <algorithm>
+
+namespace
+{
+
+// How long the render thread waits for the GUI thread to be done with a
+// texture, in nanoseconds. Only reached if the GUI thread hangs.
+const GLuint64 READ_FENCE_TIMEOUT = 1000000000;
+
+}
+
+RenderPacket::RenderPacket() :
+    width(0),
+    height(0),
+    matrix(Eigen::Matrix4f::Identity())
+{
+}
+
+bool RenderPacket::isSameAs(const RenderPacket & other) const
+{
+    if (width != other.width || height != other.height ||
+        matrix != other.matrix || items.size() != other.items.size())
+    {
+        return false;
+    }
+    for (std::size_t i = 0; i < items.size(); ++i)
+    {
+        const Item & a = items[i];
+        const Item & b = other.items[i];
+        if (a.mesh != b.mesh ||
+            a.color[0] != b.color[0] || a.color[1] != b.color[1] ||
+            a.color[2] != b.color[2] || a.color[3] != b.color[3])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+RenderThread::RenderThread(QOpenGLContext * shareContext, QObject * parent) :
+    QThread(parent),
+    latestSlot_(-1),
+    acquiredSlot_(-1),
+    isStopping_(false),
+    program_(0),
+    matrixLocation_(-1),
+    colorLocation_(-1),
+    vertexArray_(0)
+{
+    for (int i = 0; i < NUM_SLOTS; ++i)
+    {
+        Slot & slot = slots_[i];
+        slot.textureId = 0;
+        slot.width = 0;
+        slot.height = 0;
+        slot.drawFence = 0;
+        slot.readFence = 0;
+    }
+    target_.width = 0;
+    target_.height = 0;
+    target_.samples = 0;
+    target_.msFboId = 0;
+    target_.msColorBufferId = 0;
+    target_.fboId = 0;
+    targetBytes_ = 0;
+    buffers_[0] = buffers_[1] = 0;
+
+    // Surfaces must be created by the GUI thread. The context is then moved
+    // to the render thread, where it is made current.
+    surface_ = new QOffscreenSurface();
+    surface_->setFormat(shareContext->format());
+    surface_->create();
+    context_ = new QOpenGLContext();
+    context_->setFormat(shareContext->format());
+    context_->setShareContext(shareContext);
+    context_->create();
+    context_->moveToThread(this);
+
+    start();
+}
+
+RenderThread::~RenderThread()
+{
+    {
+        QMutexLocker locker(&mutex_);
+        isStopping_ = true;
+        condition_.wakeAll();
+    }
+    wait();
+    delete context_;
+    delete surface_;
+}
+
+void RenderThread::submit(const std::shared_ptr<const RenderPacket> & packet)
+{
+    QMutexLocker locker(&mutex_);
+    pending_ = packet;
+    condition_.wakeAll();
+}
+
+bool RenderThread::acquireFrame(Frame & frame)
+{
+    GLsync drawFence = 0;
+    {
+        QMutexLocker locker(&mutex_);
+        if (latestSlot_ < 0)
+            return false;
+
+        acquiredSlot_ = latestSlot_;
+        const Slot & slot = slots_[acquiredSlot_];
+        frame.textureId = slot.textureId;
+        frame.packet = slot.packet;
+        drawFence = slot.drawFence;
+    }
+
+    // Make the GPU, not the CPU, wait until the frame is drawn. The fence
+    // can't be deleted by the render thread while the slot is acquired.
+    if (drawFence)
+        glWaitSync(drawFence, 0, GL_TIMEOUT_IGNORED);
+    return true;
+}
+
+void RenderThread::releaseFrame()
+{
+    QMutexLocker locker(&mutex_);
+    if (acquiredSlot_ < 0)
+        return;
+
+    Slot & slot = slots_[acquiredSlot_];
+    if (slot.readFence)
+        glDeleteSync(slot.readFence);
+    slot.readFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush(); // so that the render thread doesn't wait forever on the fence
+    acquiredSlot_ = -1;
+}
+
+std::size_t RenderThread::numBytes() const
+{
+    QMutexLocker locker(&mutex_);
+    std::size_t res = targetBytes_;
+    for (int i = 0; i < NUM_SLOTS; ++i)
+        res += 4 * std::size_t(slots_[i].width) * slots_[i].height;
+    return res;
+}
+
+void RenderThread::run()
+{
+    context_->makeCurrent(surface_);
+    initialize_();
+
+    while (true)
+    {
+        // Wait for a new packet, and for a slot which is neither displayed
+        // nor about to be displayed by the GUI thread
+        std::shared_ptr<const RenderPacket> packet;
+        Slot * slot = 0;
+        GLsync readFence = 0;
+        {
+            QMutexLocker locker(&mutex_);
+            while (!isStopping_ && !pending_)
+                condition_.wait(&mutex_);
+            if (isStopping_)
+                break;
+
+            packet.swap(pending_);
+            for (int i = 0; i < NUM_SLOTS; ++i)
+            {
+                if (i != latestSlot_ && i != acquiredSlot_)
+                {
+                    slot = &slots_[i];
+                    break;
+                }
+            }
+            readFence = slot->readFence;
+            slot->readFence = 0;
+        }
+
+        // Wait until the GUI thread is done with the texture of the slot
+        if (readFence)
+        {
+            glClientWaitSync(readFence, 0, READ_FENCE_TIMEOUT);
+            glDeleteSync(readFence);
+        }
+
+        draw_(*packet, *slot);
+        GLsync drawFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+
+        // Publish it
+        {
+            QMutexLocker locker(&mutex_);
+            if (slot->drawFence)
+                glDeleteSync(slot->drawFence);
+            slot->drawFence = drawFence;
+            slot->packet = packet;
+            latestSlot_ = slot - slots_;
+        }
+        emit frameReady();
+    }
+
+    cleanup_();
+    context_->doneCurrent();
+    context_->moveToThread(QCoreApplication::instance()->thread());
+}
+
+void RenderThread::initialize_()
+{
+    program_ = GLRenderer::createFlatProgram();
+    if (program_)
+    {
+        matrixLocation_ = glGetUniformLocation(program_, "matrix");
+        colorLocation_ = glGetUniformLocation(program_, "color");
+    }
+    glGenVertexArrays(1, &vertexArray_);
+    glGenBuffers(2, buffers_);
+}
+
+void RenderThread::cleanup_()
+{
+    {
+        QMutexLocker locker(&mutex_);
+        for (int i = 0; i < NUM_SLOTS; ++i)
+        {
+            Slot & slot = slots_[i];
+            glDeleteTextures(1, &slot.textureId);
+            if (slot.drawFence)
+                glDeleteSync(slot.drawFence);
+            if (slot.readFence)
+                glDeleteSync(slot.readFence);
+            slot.textureId = 0;
+            slot.width = slot.height = 0;
+            slot.drawFence = slot.readFence = 0;
+            slot.packet.reset();
+        }
+        latestSlot_ = -1;
+    }
+    resizeTarget_(0, 0);
+    glDeleteProgram(program_);
+    glDeleteVertexArrays(1, &vertexArray_);
+    glDeleteBuffers(2, buffers_);
+}
+
+void RenderThread::resizeTarget_(int width, int height)
+{
+    if (target_.width == width && target_.height == height)
+        return;
+
+    if (target_.msFboId)
+    {
+        glDeleteFramebuffers(1, &target_.msFboId);
+        glDeleteRenderbuffers(1, &target_.msColorBufferId);
+        glDeleteFramebuffers(1, &target_.fboId);
+        target_.msFboId = target_.msColorBufferId = target_.fboId = 0;
+    }
+    target_.width = width;
+    target_.height = height;
+    target_.samples = 0;
+    if (width > 0 && height > 0)
+    {
+        // Same number of samples as onion skins, see View::renderOnionSkin_()
+        glGetIntegerv(GL_MAX_SAMPLES, &target_.samples);
+        glGenRenderbuffers(1, &target_.msColorBufferId);
+        glBindRenderbuffer(GL_RENDERBUFFER, target_.msColorBufferId);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, target_.samples, GL_RGBA8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        glGenFramebuffers(1, &target_.msFboId);
+        glBindFramebuffer(GL_FRAMEBUFFER, target_.msFboId);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, target_.msColorBufferId);
+        glGenFramebuffers(1, &target_.fboId);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    QMutexLocker locker(&mutex_);
+    targetBytes_ = 4 * std::size_t(width) * height * std::max(1, target_.samples);
+}
+
+void RenderThread::draw_(const RenderPacket & packet, Slot & slot)
+{
+    const int w = packet.width;
+    const int h = packet.height;
+    resizeTarget_(w, h);
+
+    // (Re)create the texture of the slot
+    if (slot.width != w || slot.height != h)
+    {
+        if (!slot.textureId)
+            glGenTextures(1, &slot.textureId);
+        glBindTexture(GL_TEXTURE_2D, slot.textureId);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        slot.width = w;
+        slot.height = h;
+    }
+    if (w <= 0 || h <= 0)
+        return;
+
+    // Concatenate all meshes into one vertex and one index buffer, merging
+    // consecutive items of the same color into a single draw call
+    struct Range
+    {
+        GLsizei first, count;
+        const GLfloat * color;
+    };
+    std::vector<GLfloat> vertices;
+    std::vector<GLuint> indices;
+    std::vector<Range> ranges;
+    for (const RenderPacket::Item & item: packet.items)
+    {
+        const RenderMesh & mesh = *item.mesh;
+        const GLuint base = vertices.size() / 2;
+        const GLsizei first = indices.size();
+        vertices.insert(vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+        if (mesh.indices.empty())
+        {
+            const GLuint n = mesh.vertices.size() / 2;
+            for (GLuint i = 0; i < n; ++i)
+                indices.push_back(base + i);
+        }
+        else
+        {
+            for (GLuint i: mesh.indices)
+                indices.push_back(base + i);
+        }
+        const GLsizei count = indices.size() - first;
+        if (!ranges.empty() && std::equal(item.color, item.color + 4, ranges.back().color))
+        {
+            ranges.back().count += count;
+        }
+        else
+        {
+            Range range = {first, count, item.color};
+            ranges.push_back(range);
+        }
+    }
+
+    // Draw over transparent, with the blending of views, which gives
+    // premultiplied alpha (see View::drawToBuffer_())
+    glBindFramebuffer(GL_FRAMEBUFFER, target_.msFboId);
+    glViewport(0, 0, w, h);
+    glClearColor(0.0, 0.0, 0.0, 0.0);
+    glClear(GL_COLOR_BUFFER_BIT);
+    if (program_ && !ranges.empty())
+    {
+        glEnable(GL_BLEND);
+        glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA,
+                            GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+        glUseProgram(program_);
+        glUniformMatrix4fv(matrixLocation_, 1, GL_FALSE, packet.matrix.data());
+        glBindVertexArray(vertexArray_);
+        glBindBuffer(GL_ARRAY_BUFFER, buffers_[0]);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), vertices.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers_[1]);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STREAM_DRAW);
+        glEnableVertexAttribArray(GLRenderer::POSITION_LOCATION);
+        glVertexAttribPointer(GLRenderer::POSITION_LOCATION, 2, GL_FLOAT, GL_FALSE, 0, 0);
+        for (const Range & range: ranges)
+        {
+            glUniform4fv(colorLocation_, 1, range.color);
+            glDrawElements(GL_TRIANGLES, range.count, GL_UNSIGNED_INT,
+                           reinterpret_cast<const GLvoid *>(range.first * sizeof(GLuint)));
+        }
+        glDisableVertexAttribArray(GLRenderer::POSITION_LOCATION);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glUseProgram(0);
+    }
+
+    // Resolve to the texture of the slot
+    glBindFramebuffer(GL_FRAMEBUFFER, target_.fboId);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, slot.textureId, 0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, target_.msFboId);
+    glBlitFramebuffer(0, 0, w, h, 0, 0, w, h, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
@@ -0,0 +1,160 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#ifndef RENDER_THREAD_H
+#define RENDER_THREAD_H
+
+// RenderThread: draws the cells of a view in a thread of its own, so that
+// the GUI thread does not wait for OpenGL while handling events.
+//
+// The GUI thread builds a RenderPacket per frame: an immutable description of
+// what to draw, i.e. the triangles and color of each visible cell in z-order,
+// and the matrix mapping scene coordinates to the viewport. Triangles are
+// copied once per cell geometry (see VAC::buildRenderPacket()), and shared
+// by all subsequent packets, so building a packet is cheap.
+//
+// The render thread has its own context, shared with the contexts of all
+// GLWidgets. It only ever draws the latest packet submitted, skipping the
+// ones superseded while it was busy, into one of three textures. The GUI
+// thread composites the latest finished texture, placed where the scene was
+// at the time of its packet, then draws tools and cursors over it. This way,
+// when the scene is panned or zoomed faster than it can be drawn, the view
+// is still redrawn at the rate of input events, possibly showing a frame
+// which is slightly behind.
+//
+// Textures are exchanged with fences: the render thread fences each frame it
+// finishes, and the GUI thread waits on this fence before sampling the
+// texture; conversely, the GUI thread fences its use of a texture when it
+// releases it, and the render thread waits on it before drawing to it again.
+//
+// Requires OpenGL 3.2. Created and used by the GUI thread only.
+
+#include "OpenGL.h"
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+
+#include <Eigen/Core>
+#include <memory>
+#include <vector>
+
+class QOpenGLContext;
+class QOffscreenSurface;
+
+// Triangles of a cell, as 2D positions. Indices are empty if not indexed.
+struct RenderMesh
+{
+    std::vector<GLfloat> vertices;
+    std::vector<GLuint> indices;
+};
+
+struct RenderPacket
+{
+    struct Item
+    {
+        std::shared_ptr<const RenderMesh> mesh;
+        GLfloat color[4];
+    };
+
+    // Has a fixed-size Eigen member: use std::allocate_shared() with an
+    // Eigen::aligned_allocator rather than std::make_shared()
+    RenderPacket();
+
+    // Whether drawing other would give exactly the same image
+    bool isSameAs(const RenderPacket & other) const;
+
+    int width, height; // size of the viewport, in pixels
+    Eigen::Matrix4f matrix; // scene coordinates to normalized device coordinates
+    std::vector<Item> items; // in drawing order
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+class RenderThread: public QThread
+{
+    Q_OBJECT
+
+public:
+    // Creates the context of the thread, sharing resources with
+    // shareContext, and starts the thread
+    RenderThread(QOpenGLContext * shareContext, QObject * parent = 0);
+
+    // Waits until the frame being drawn, if any, is finished
+    ~RenderThread();
+
+    // Replaces the packet to draw next
+    void submit(const std::shared_ptr<const RenderPacket> & packet);
+
+    // Latest finished frame. Its texture has premultiplied alpha, and the
+    // size of the viewport of its packet.
+    struct Frame
+    {
+        GLuint textureId;
+        std::shared_ptr<const RenderPacket> packet;
+    };
+
+    // Gets the latest finished frame, and keeps its texture from being
+    // drawn to until releaseFrame(). Returns false if no frame is finished
+    // yet. Must be called with a context of the share group current, and
+    // followed by releaseFrame() before the next call.
+    bool acquireFrame(Frame & frame);
+    void releaseFrame();
+
+    // Bytes of textures and render buffers, for MemoryStats
+    std::size_t numBytes() const;
+
+signals:
+    // A new frame is finished, emitted from the render thread
+    void frameReady();
+
+protected:
+    void run();
+
+private:
+    // Guarded by mutex_, except the slot being drawn by the render thread
+    struct Slot
+    {
+        GLuint textureId;
+        int width, height;
+        GLsync drawFence; // signaled when the render thread is done with it
+        GLsync readFence; // signaled when the GUI thread is done with it
+        std::shared_ptr<const RenderPacket> packet;
+    };
+    static const int NUM_SLOTS = 3;
+    Slot slots_[NUM_SLOTS];
+    int latestSlot_;   // -1 if none
+    int acquiredSlot_; // -1 if none
+    std::shared_ptr<const RenderPacket> pending_;
+    std::size_t targetBytes_;
+    bool isStopping_;
+    mutable QMutex mutex_;
+    QWaitCondition condition_;
+
+    // Only used by the render thread
+    QOpenGLContext * context_;
+    QOffscreenSurface * surface_;
+    struct Target
+    {
+        int width, height, samples;
+        GLuint msFboId, msColorBufferId;
+        GLuint fboId;
+    };
+    Target target_;
+    GLuint program_;
+    GLint matrixLocation_;
+    GLint colorLocation_;
+    GLuint vertexArray_;
+    GLuint buffers_[2]; // vertices and indices
+    void initialize_();
+    void cleanup_();
+    void draw_(const RenderPacket & packet, Slot & slot);
+    void resizeTarget_(int width, int height);
+};
+
+#endif // RENDER_THREAD_H
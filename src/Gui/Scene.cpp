@@ -16,24 +16,33 @@
 #include "Background/Background.h"
 
 #include <QtDebug>
+#include <limits>
 
 #include "XmlStreamReader.h"
 #include "XmlStreamWriter.h"
 
 #include "OpenGL.h"
 #include "Global.h"
+#include "Trace.h"
 
 Scene::Scene() :
     left_(0),
     top_(0),
     width_(1280),
     height_(720),
-    background_(new Background(this))
+    background_(new Background(this)),
+    transactionCounter_(0),
+    shouldEmitChanged_(false),
+    shouldEmitNeedUpdatePicking_(false),
+    shouldEmitCheckpoint_(false),
+    numSuppressedChanged_(0),
+    numSuppressedNeedUpdatePicking_(0),
+    numSuppressedCheckpoints_(0)
 {
     VectorAnimationComplex::VAC * vac = new VectorAnimationComplex::VAC();
     connect(vac,SIGNAL(selectionChanged()),this,SIGNAL(selectionChanged()));
-    connect(background_, SIGNAL(changed()), this, SIGNAL(changed()));
-    connect(background_, SIGNAL(checkpoint()), this, SIGNAL(checkpoint()));
+    connect(background_, SIGNAL(changed()), this, SLOT(emitChanged()));
+    connect(background_, SIGNAL(checkpoint()), this, SLOT(emitCheckpoint()));
     addSceneObject(vac);
     indexHovered_ = -1;
 }
@@ -97,8 +106,90 @@ void Scene::setCanvasDefaultValues()
     // Don't emit changed on purpose
 }
 
+// ----------------------- Signals and Transactions -------------------------
+
+void Scene::emitChanged()
+{
+    // Like a blocked emit, discard the signal instead of delaying it
+    if(signalsBlocked())
+        return;
+
+    if(isInTransaction())
+    {
+        if(shouldEmitChanged_)
+            ++numSuppressedChanged_;
+        shouldEmitChanged_ = true;
+    }
+    else
+    {
+        emit changed();
+    }
+}
+
+void Scene::emitNeedUpdatePicking()
+{
+    if(signalsBlocked())
+        return;
+
+    if(isInTransaction())
+    {
+        if(shouldEmitNeedUpdatePicking_)
+            ++numSuppressedNeedUpdatePicking_;
+        shouldEmitNeedUpdatePicking_ = true;
+    }
+    else
+    {
+        emit needUpdatePicking();
+    }
+}
+
+void Scene::emitCheckpoint()
+{
+    if(signalsBlocked())
+        return;
+
+    if(isInTransaction())
+    {
+        if(shouldEmitCheckpoint_)
+            ++numSuppressedCheckpoints_;
+        shouldEmitCheckpoint_ = true;
+    }
+    else
+    {
+        emit checkpoint();
+    }
+}
+
+void Scene::beginTransaction()
+{
+    ++transactionCounter_;
+}
+
+void Scene::endTransaction()
+{
+    if(--transactionCounter_ > 0)
+        return;
+
+    // Reset the flags before emitting, since slots may open transactions too
+    const bool shouldEmitNeedUpdatePicking = shouldEmitNeedUpdatePicking_;
+    const bool shouldEmitChanged = shouldEmitChanged_;
+    const bool shouldEmitCheckpoint = shouldEmitCheckpoint_;
+    shouldEmitNeedUpdatePicking_ = false;
+    shouldEmitChanged_ = false;
+    shouldEmitCheckpoint_ = false;
+
+    if(shouldEmitNeedUpdatePicking)
+        emitNeedUpdatePicking();
+    if(shouldEmitChanged)
+        emitChanged();
+    if(shouldEmitCheckpoint)
+        emitCheckpoint();
+}
+
 void Scene::copyFrom(Scene * other)
 {
+    VPAINT_TRACE_ZONE("Scene::copyFrom");
+
     // XXX
     // In this method, here's is what's wrong:
     //  - canvas is not copied
@@ -124,7 +215,7 @@ void Scene::copyFrom(Scene * other)
     blockSignals(false);
 
     // Emit signals
-    emit needUpdatePicking();
+    emitNeedUpdatePicking();
     emitChanged();
 
     // Create new connections
@@ -136,6 +227,56 @@ void Scene::copyFrom(Scene * other)
     }
 }
 
+void Scene::setContent(VectorAnimationComplex::VAC * vac, const Background * background)
+{
+    // Block signals
+    blockSignals(true);
+
+    // Reset to default
+    clear(true);
+
+    // Set VAC
+    addSceneObject(vac, true);
+
+    // Reset hovered
+    indexHovered_ = -1;
+
+    // Copy background
+    background_->setData(background);
+
+    // Unblock signals
+    blockSignals(false);
+
+    // Emit signals
+    emitNeedUpdatePicking();
+    emitChanged();
+
+    // Create new connections
+    connect(vac,SIGNAL(selectionChanged()),this,SIGNAL(selectionChanged()));
+    emit selectionChanged();
+}
+
+void Scene::takeContent(Scene * other)
+{
+    VectorAnimationComplex::VAC * vac = other->getVAC_();
+    if(vac)
+    {
+        disconnect(vac, 0, other, 0);
+        other->sceneObjects_.removeAll(vac);
+    }
+    else
+    {
+        vac = new VectorAnimationComplex::VAC();
+    }
+
+    Transaction transaction(this);
+    setLeft(other->left());
+    setTop(other->top());
+    setWidth(other->width());
+    setHeight(other->height());
+    setContent(vac, other->background());
+}
+
 void Scene::clear(bool silent)
 {
     VectorAnimationComplex::VAC * vac = getVAC_();
@@ -155,7 +296,7 @@ void Scene::clear(bool silent)
     if(!silent)
     {
         emitChanged();
-        emit needUpdatePicking();
+        emitNeedUpdatePicking();
         emit selectionChanged();
     }
 }
@@ -165,6 +306,15 @@ Scene::~Scene()
     clear(true);
 }
 
+void Scene::reportMemory(MemoryStats::Report & report) const
+{
+    foreach(SceneObject * sceneObject, sceneObjects_)
+    {
+        if(VectorAnimationComplex::VAC * vac = dynamic_cast<VectorAnimationComplex::VAC*>(sceneObject))
+            vac->reportMemory(report);
+    }
+}
+
 // ----------------------- Save and Load -------------------------
 #include "SaveAndLoad.h"
 
@@ -184,7 +334,15 @@ void Scene::save(QTextStream & out)
 }
 
 
-void Scene::exportSVG(Time t, QTextStream & out)
+void Scene::prepareExportSVG()
+{
+    foreach(SceneObject *sceneObject, sceneObjects_)
+    {
+        sceneObject->prepareExportSVG();
+    }
+}
+
+void Scene::exportSVG(Time t, SvgStreamWriter & out)
 {
     // Export background
     background_->exportSVG(t.frame(), out,
@@ -220,8 +378,8 @@ void Scene::read(QTextStream & in)
         connect(vac,SIGNAL(selectionChanged()),this,SIGNAL(selectionChanged()));
     }
 
-    emit changed();
-    emit needUpdatePicking();
+    emitChanged();
+    emitNeedUpdatePicking();
     emit selectionChanged();
 }
 
@@ -265,13 +423,15 @@ void Scene::read(XmlStreamReader & xml)
 
     blockSignals(false);
 
-    emit needUpdatePicking();
-    emit changed();
+    emitNeedUpdatePicking();
+    emitChanged();
     emit selectionChanged();
 }
 
 void Scene::readCanvas(XmlStreamReader & xml)
 {
+    Transaction transaction(this);
+
     setCanvasDefaultValues();
 
     // Canvas
@@ -375,6 +535,26 @@ void Scene::drawPick(Time time, ViewSettings & viewSettings)
     }
 }
 
+Picking::Object Scene::pick(Time time, double x, double y, double tolerance,
+                            ViewSettings & viewSettings, double & distance)
+{
+    // Objects are drawn in order, so the last ones are on top
+    Picking::Object res;
+    distance = std::numeric_limits<double>::infinity();
+    for(int i=sceneObjects_.size()-1; i>=0; --i)
+    {
+        double d;
+        int id = sceneObjects_[i]->pick(time, x, y, tolerance, viewSettings, d);
+        if(id != -1 && d < distance)
+        {
+            res = Picking::Object(0, i, id);
+            distance = d;
+            if(d == 0)
+                break;
+        }
+    }
+    return res;
+}
 
 // ---------------- Highlighting and Selecting -----------------------
     
@@ -568,15 +748,15 @@ void Scene::addSceneObject(SceneObject * sceneObject, bool silent)
 {
     sceneObjects_ << sceneObject;
     connect(sceneObject, SIGNAL(changed()),
-          this, SIGNAL(changed()));
+          this, SLOT(emitChanged()));
     connect(sceneObject, SIGNAL(checkpoint()),
-          this, SIGNAL(checkpoint()));
+          this, SLOT(emitCheckpoint()));
     connect(sceneObject, SIGNAL(needUpdatePicking()),
-          this, SIGNAL(needUpdatePicking()));
+          this, SLOT(emitNeedUpdatePicking()));
     if(!silent)
     {
         emitChanged();
-        emit needUpdatePicking();
+        emitNeedUpdatePicking();
     }
 }
 
@@ -731,6 +911,59 @@ void Scene::createFace()
 
 }
 
+void Scene::createFaces()
+{
+    if(!sceneObjects_.isEmpty())
+    {
+        // todo:  get  the  selected  one  instead  of  the  first
+        VectorAnimationComplex::VAC * vac =
+            dynamic_cast<VectorAnimationComplex::VAC *>
+            (sceneObjects_[0]);
+
+        if(vac)
+        {
+            vac->createFaces();
+        }
+    }
+}
+
+void Scene::fillAllEnclosedRegions()
+{
+    if(!sceneObjects_.isEmpty())
+    {
+        // todo:  get  the  selected  one  instead  of  the  first
+        VectorAnimationComplex::VAC * vac =
+            dynamic_cast<VectorAnimationComplex::VAC *>
+            (sceneObjects_[0]);
+
+        if(vac)
+        {
+            vac->fillAllEnclosedRegions();
+        }
+    }
+}
+
+void Scene::createSymbol()
+{
+    VectorAnimationComplex::VAC * vac = vectorAnimationComplex();
+    if(vac)
+        vac->createSymbol();
+}
+
+void Scene::addSymbolInstance()
+{
+    VectorAnimationComplex::VAC * vac = vectorAnimationComplex();
+    if(vac)
+        vac->addSymbolInstance();
+}
+
+void Scene::removeSymbolInstances()
+{
+    VectorAnimationComplex::VAC * vac = vectorAnimationComplex();
+    if(vac)
+        vac->removeSymbolInstances();
+}
+
 void Scene::addCyclesToFace()
 {
     if(!sceneObjects_.isEmpty())
@@ -1049,6 +1282,23 @@ void Scene::keyframeSelection()
     }
 }
 
+void Scene::keyframeSelectionOverPlaybackRange()
+{
+    if(!sceneObjects_.isEmpty())
+    {
+        // todo:  get  the  selected  one  instead  of  the  first
+        VectorAnimationComplex::VAC * vac =
+            dynamic_cast<VectorAnimationComplex::VAC *>
+            (sceneObjects_[0]);
+
+        if(vac)
+        {
+            Timeline * timeline = global()->timeline();
+            vac->keyframeSelection(timeline->firstFrame(), timeline->lastFrame());
+        }
+    }
+}
+
 
 void Scene::resetCellsToConsiderForCutting()
 {
@@ -15,6 +15,7 @@
 #include "TimeDef.h"
 #include "Picking.h"
 #include "ViewSettings.h"
+#include "MemoryStats.h"
 
 class Background;
 class View;
@@ -22,6 +23,7 @@ struct MouseEvent;
 class QKeyEvent;
 class SceneObject;
 class QTextStream;
+class SvgStreamWriter;
 class XmlStreamWriter;
 class XmlStreamReader;
 class QToolBar;
@@ -32,18 +34,29 @@ class InbetweenFace;
 }
 class QDir;
 
-class Scene: public QObject
+class Scene: public QObject, public MemoryStats::Source
 {
     Q_OBJECT
     
 public:
     Scene();
     void copyFrom(Scene * other);
+
+    // Replace the VAC by vac, taking ownership of it, and the background by
+    // a copy of background (e.g., to restore data from the undo history)
+    void setContent(VectorAnimationComplex::VAC * vac, const Background * background);
+
+    // Moves the VAC, background and canvas of other into this scene, leaving
+    // other empty (e.g., to install a document read by a worker thread)
+    void takeContent(Scene * other);
     void clear(bool silent = false);
     ~Scene();
 
     QList<SceneObject*> sceneObjects() {return sceneObjects_;}
 
+    // Memory used by the VAC
+    void reportMemory(MemoryStats::Report & report) const;
+
     // Keyboard events
       void keyPressEvent(QKeyEvent *event);
       void keyReleaseEvent(QKeyEvent *event);
@@ -53,6 +66,10 @@ public:
     void draw(Time time, ViewSettings & viewSettings);
     void drawPick(Time time, ViewSettings & viewSettings);
 
+    // Picking on CPU (see SceneObject::pick())
+    Picking::Object pick(Time time, double x, double y, double tolerance,
+                         ViewSettings & viewSettings, double & distance);
+
     // XXX todo: there should be draw3D here too (not only in VAC),
     //           responsible for instance to draw the canvas
 
@@ -64,12 +81,36 @@ public:
     void toggle(Time time, int index, int id);
     void deselectAll(Time time);
 
-    // Emit signals
-    void emitChanged() {emit changed();}
-    void emitCheckpoint() {emit checkpoint();}
+    // Transactions. While a transaction is open, changed(), needUpdatePicking()
+    // and checkpoint() are held back, whether emitted by the scene or by one
+    // of its scene objects. Each of them is then emitted at most once, when
+    // the outermost transaction ends. Transactions can be nested. Prefer
+    // opening a Scene::Transaction for the duration of a scope over calling
+    // beginTransaction() and endTransaction() directly.
+    void beginTransaction();
+    void endTransaction();
+    bool isInTransaction() const { return transactionCounter_ > 0; }
+
+    class Transaction
+    {
+    public:
+        explicit Transaction(Scene * scene) : scene_(scene) { scene_->beginTransaction(); }
+        ~Transaction() { scene_->endTransaction(); }
+
+    private:
+        Q_DISABLE_COPY(Transaction)
+        Scene * scene_;
+    };
+
+    // Number of signals which have been held back by transactions and never
+    // emitted, since the scene was created
+    int numSuppressedChanged() const { return numSuppressedChanged_; }
+    int numSuppressedNeedUpdatePicking() const { return numSuppressedNeedUpdatePicking_; }
+    int numSuppressedCheckpoints() const { return numSuppressedCheckpoints_; }
 
     // Save and load
-    void exportSVG(Time t, QTextStream & out);
+    void exportSVG(Time t, SvgStreamWriter & out);
+    void prepareExportSVG(); // Must be called before calling exportSVG() concurrently
     void save(QTextStream & out);
     void read(QTextStream & in);
     void write(XmlStreamWriter & xml);
@@ -106,6 +147,12 @@ public:
     Background * background() const;
     
 public slots:
+    // --------- Signals --------
+    // Emit signals now, or at the end of the current transaction if any
+    void emitChanged();
+    void emitCheckpoint();
+    void emitNeedUpdatePicking();
+
     // --------- Tools ----------
     void test();
     void deleteSelectedCells();
@@ -114,6 +161,8 @@ public slots:
     void copy(VectorAnimationComplex::VAC* & clipboard);
     void paste(VectorAnimationComplex::VAC* & clipboard);
     void createFace();
+    void createFaces();
+    void fillAllEnclosedRegions();
     void addCyclesToFace();
     void removeCyclesFromFace();
     void changeColor();
@@ -129,10 +178,14 @@ public slots:
     void glue();
     void unglue();
     void uncut();
+    void createSymbol();
+    void addSymbolInstance();
+    void removeSymbolInstances();
 
     // ----- animation -----
     void inbetweenSelection();
     void keyframeSelection();
+    void keyframeSelectionOverPlaybackRange();
     void motionPaste(VectorAnimationComplex::VAC* & clipboard);
 
     // ----- others -----
@@ -178,6 +231,15 @@ private:
     double height_;
 
     Background * background_;
+
+    // Transactions
+    int transactionCounter_;
+    bool shouldEmitChanged_;
+    bool shouldEmitNeedUpdatePicking_;
+    bool shouldEmitCheckpoint_;
+    int numSuppressedChanged_;
+    int numSuppressedNeedUpdatePicking_;
+    int numSuppressedCheckpoints_;
 };
     
 #endif
@@ -21,7 +21,7 @@ void SceneObject::save(QTextStream & out)
     save_(out);
 }
 
-void SceneObject::exportSVG(Time t, QTextStream & out)
+void SceneObject::exportSVG(Time t, SvgStreamWriter & out)
 {
     // Save Derived members
     exportSVG_(t, out);
@@ -31,7 +31,7 @@ void SceneObject::save_(QTextStream & /*out*/)
 {
 }
 
-void SceneObject::exportSVG_(Time /*t*/, QTextStream & /*out*/)
+void SceneObject::exportSVG_(Time /*t*/, SvgStreamWriter & /*out*/)
 {
 }
 
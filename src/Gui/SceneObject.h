@@ -16,6 +16,7 @@
 #include "ViewSettings.h"
 
 class QTextStream;
+class SvgStreamWriter;
 class QToolBar;
 
 class SceneObject: public QObject
@@ -34,6 +35,11 @@ public:
     virtual void draw(Time /*time*/, ViewSettings & /*viewSettings*/) {}
     virtual void drawPick(Time /*time*/, ViewSettings & /*viewSettings*/) {}
 
+    // Picking on CPU: returns the ID of the object closest to (x,y), within
+    // tolerance, and its distance to (x,y). Returns -1 if none.
+    virtual int pick(Time /*time*/, double /*x*/, double /*y*/, double /*tolerance*/,
+                     ViewSettings & /*viewSettings*/, double & /*distance*/) { return -1; }
+
     // Selecting and Highlighting
     virtual void setHoveredObject(Time /*time*/, int /*id*/) {}
     virtual void setNoHoveredObject() {}
@@ -49,7 +55,8 @@ public:
     bool shouldBeSaved() { return shouldBeSaved_; }
     void setShouldBeSaved(bool b) { shouldBeSaved_ = b; }
     void save(QTextStream & out);
-    void exportSVG(Time t, QTextStream & out);
+    void exportSVG(Time t, SvgStreamWriter & out);
+    virtual void prepareExportSVG() {} // computes what exportSVG() computes lazily
     static SceneObject * read(QTextStream & in);
 
 
@@ -69,7 +76,7 @@ signals:
     
 protected:
     virtual void save_(QTextStream & out);
-    virtual void exportSVG_(Time t, QTextStream & out);
+    virtual void exportSVG_(Time t, SvgStreamWriter & out);
     bool canBeSaved_;
 
 private:
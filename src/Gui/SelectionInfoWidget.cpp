@@ -30,18 +30,46 @@ SelectionInfoWidget::SelectionInfoWidget(QWidget *parent) :
 
 void SelectionInfoWidget::updateInfo()
 {
+    // Updated when shown instead
+    if(!isVisible())
+        return;
+
     QString text;
 
     using namespace VectorAnimationComplex;
     VAC * vac = global()->mainWindow()->scene()->vectorAnimationComplex();
     if(vac)
     {
-        foreach(Cell * c, vac->selectedCells())
+        // Per-type counts are maintained by the VAC as the selection changes,
+        // but listing IDs is linear in the size of the selection, so it is
+        // only done for small selections
+        const int maxListedIds = 100;
+        if(vac->numSelectedCells() <= maxListedIds)
+        {
+            foreach(Cell * c, vac->selectedCells())
+            {
+                text += QString::number(c->id());
+                text += " ";
+            }
+            text += "\n";
+        }
+
+        const char * typeNames[SelectionSummary::NumCellTypes] = {
+            "key vertices", "key edges", "key faces",
+            "inbetween vertices", "inbetween edges", "inbetween faces" };
+        for(int i=0; i<SelectionSummary::NumCellTypes; ++i)
         {
-            text += QString::number(c->id());
-            text += " ";
+            int n = vac->numSelectedCells(static_cast<SelectionSummary::CellType>(i));
+            if(n > 0)
+                text += QString("%1 %2\n").arg(n).arg(typeNames[i]);
         }
     }
 
-    labelSelected_->setText(text);
+    labelSelected_->setText(text.trimmed());
+}
+
+void SelectionInfoWidget::showEvent(QShowEvent * event)
+{
+    QWidget::showEvent(event);
+    updateInfo();
 }
@@ -26,6 +26,9 @@ signals:
 public slots:
     void updateInfo();
 
+protected:
+    void showEvent(QShowEvent * event);
+
 private:
     QLabel * labelSelected_;
     QGridLayout * mainLayout_;
@@ -0,0 +1,151 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+
+#include "SessionRecorder.h"
+
+#include <QStringList>
+
+namespace
+{
+// First line of session files
+const char * SESSION_HEADER = "VPaint session 1";
+
+const char * EVENT_NAMES[SessionRecorder::NumEventTypes] =
+{
+    "beginsketch",
+    "continuesketch",
+    "endsketch",
+    "updatesculpt",
+    "beginsculptdeform",
+    "continuesculptdeform",
+    "endsculptdeform",
+    "beginsculptwidth",
+    "continuesculptwidth",
+    "endsculptwidth",
+    "beginsculptsmooth",
+    "continuesculptsmooth",
+    "endsculptsmooth",
+    "select",
+    "deselect",
+    "toggle",
+    "deselectall",
+    "split",
+    "paint",
+    "begindraganddrop",
+    "continuedraganddrop",
+    "enddraganddrop",
+    "begintransform",
+    "continuetransform",
+    "endtransform",
+    "beginrectangleofselection",
+    "continuerectangleofselection",
+    "endrectangleofselection",
+    "undo",
+    "redo"
+};
+}
+
+QFile SessionRecorder::file_;
+QTextStream SessionRecorder::out_;
+QElapsedTimer SessionRecorder::timer_;
+
+SessionRecorder::Event::Event() :
+    type(BeginSketch),
+    timestamp(0),
+    x(0),
+    y(0),
+    time(0),
+    width(0),
+    pressure(1),
+    id(-1)
+{
+}
+
+bool SessionRecorder::start(const QString & filePath)
+{
+    stop();
+
+    file_.setFileName(filePath);
+    if(!file_.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+        return false;
+
+    out_.setDevice(&file_);
+    out_.setRealNumberPrecision(17);
+    out_ << SESSION_HEADER << "\n";
+    timer_.start();
+    return true;
+}
+
+void SessionRecorder::stop()
+{
+    if(isRecording())
+    {
+        out_.flush();
+        out_.setDevice(0);
+        file_.close();
+    }
+}
+
+void SessionRecorder::record(EventType type, double x, double y, Time time,
+                             double width, double pressure, int id)
+{
+    if(!isRecording())
+        return;
+
+    out_ << timer_.nsecsElapsed() * 1e-6 << " "
+         << EVENT_NAMES[type] << " "
+         << x << " " << y << " "
+         << time.floatTime() << " "
+         << width << " " << pressure << " "
+         << id << "\n";
+}
+
+bool SessionRecorder::read(const QString & filePath, QList<Event> & events)
+{
+    events.clear();
+
+    QFile file(filePath);
+    if(!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        return false;
+
+    QTextStream in(&file);
+    if(in.readLine() != SESSION_HEADER)
+        return false;
+
+    while(!in.atEnd())
+    {
+        QStringList fields = in.readLine().split(' ', QString::SkipEmptyParts);
+        if(fields.size() != 8)
+            continue;
+
+        Event event;
+        int type = 0;
+        while(type < NumEventTypes && fields[1] != EVENT_NAMES[type])
+            ++type;
+        if(type == NumEventTypes)
+            continue;
+
+        event.type = static_cast<EventType>(type);
+        event.timestamp = fields[0].toDouble();
+        event.x = fields[2].toDouble();
+        event.y = fields[3].toDouble();
+        event.time = fields[4].toDouble();
+        event.width = fields[5].toDouble();
+        event.pressure = fields[6].toDouble();
+        event.id = fields[7].toInt();
+        events << event;
+    }
+
+    return true;
+}
+
+QString SessionRecorder::eventName(EventType type)
+{
+    return EVENT_NAMES[type];
+}
@@ -0,0 +1,113 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+
+#ifndef SESSION_RECORDER_H
+#define SESSION_RECORDER_H
+
+// SessionRecorder: records the tool events of an interactive session, i.e.,
+// the calls made by the views to the VAC while sketching, sculpting,
+// selecting, painting, or transforming, as well as undo and redo, so that
+// they can be replayed later without showing any window, to measure the
+// latency of each event on real interaction patterns (see
+// MainWindow::replaySession()).
+//
+// A session is a text file, with one event per line:
+//
+//     <timestamp> <event> <x> <y> <time> <width> <pressure> <id>
+//
+// where the timestamp is in milliseconds since the beginning of the
+// recording. The document at the beginning of the recording is saved next
+// to it, as <session file>.vec.
+
+#include "TimeDef.h"
+
+#include <QFile>
+#include <QList>
+#include <QString>
+#include <QTextStream>
+#include <QElapsedTimer>
+
+class SessionRecorder
+{
+public:
+    enum EventType
+    {
+        BeginSketch,
+        ContinueSketch,
+        EndSketch,
+        UpdateSculpt,
+        BeginSculptDeform,
+        ContinueSculptDeform,
+        EndSculptDeform,
+        BeginSculptWidth,
+        ContinueSculptWidth,
+        EndSculptWidth,
+        BeginSculptSmooth,
+        ContinueSculptSmooth,
+        EndSculptSmooth,
+        Select,
+        Deselect,
+        Toggle,
+        DeselectAll,
+        Split,
+        Paint,
+        BeginDragAndDrop,
+        ContinueDragAndDrop,
+        EndDragAndDrop,
+        BeginTransform,
+        ContinueTransform,
+        EndTransform,
+        BeginRectangleOfSelection,
+        ContinueRectangleOfSelection,
+        EndRectangleOfSelection,
+        Undo,
+        Redo,
+        NumEventTypes
+    };
+
+    struct Event
+    {
+        Event();
+
+        EventType type;
+        double timestamp; // in milliseconds
+        double x;
+        double y;
+        double time;      // float time, see Time::floatTime()
+        double width;     // pen width, tablet pressure included
+        double pressure;  // 1 if not using a tablet
+        int id;           // selected cell, if any
+    };
+
+    // Whether a session is being recorded. Since this is cheap, the code
+    // being recorded doesn't need to test it before recording anything
+    static bool isRecording() { return file_.isOpen(); }
+
+    // Starts or stops recording into the given file. Starting returns false
+    // if the file couldn't be written
+    static bool start(const QString & filePath);
+    static void stop();
+
+    // Records an event, if recording
+    static void record(EventType type, double x = 0, double y = 0, Time time = Time(),
+                       double width = 0, double pressure = 1, int id = -1);
+
+    // Reads all events of a recorded session. Returns false if the file
+    // couldn't be read or is not a session
+    static bool read(const QString & filePath, QList<Event> & events);
+
+    static QString eventName(EventType type);
+
+private:
+    static QFile file_;
+    static QTextStream out_;
+    static QElapsedTimer timer_;
+};
+
+#endif // SESSION_RECORDER_H
@@ -0,0 +1,77 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#include "TabletSampleQueue.h"
+
+#include <QElapsedTimer>
+
+namespace
+{
+
+QElapsedTimer startedTimer()
+{
+    QElapsedTimer res;
+    res.start();
+    return res;
+}
+
+}
+
+TabletSampleQueue::TabletSampleQueue() :
+    head_(0),
+    tail_(0),
+    numDropped_(0)
+{
+}
+
+// Indices grow without bounds (modulo 2^32), and the number of samples in
+// the queue is tail - head, which is correct across wrap-arounds since
+// Capacity divides 2^32
+bool TabletSampleQueue::push(const Sample & sample)
+{
+    const unsigned int tail = tail_.load(std::memory_order_relaxed);
+    if(tail - head_.load(std::memory_order_acquire) >= Capacity)
+    {
+        numDropped_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    samples_[tail % Capacity] = sample;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+bool TabletSampleQueue::pop(Sample & sample)
+{
+    const unsigned int head = head_.load(std::memory_order_relaxed);
+    if(head == tail_.load(std::memory_order_acquire))
+        return false;
+    sample = samples_[head % Capacity];
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+void TabletSampleQueue::clear()
+{
+    head_.store(tail_.load(std::memory_order_acquire), std::memory_order_release);
+}
+
+bool TabletSampleQueue::isEmpty() const
+{
+    return head_.load(std::memory_order_relaxed) == tail_.load(std::memory_order_acquire);
+}
+
+int TabletSampleQueue::numDropped() const
+{
+    return numDropped_.load(std::memory_order_relaxed);
+}
+
+qint64 TabletSampleQueue::now()
+{
+    static const QElapsedTimer timer = startedTimer();
+    return timer.nsecsElapsed();
+}
@@ -0,0 +1,64 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#ifndef TABLET_SAMPLE_QUEUE_H
+#define TABLET_SAMPLE_QUEUE_H
+
+// TabletSampleQueue: the tablet samples received by a view since the tool in
+// progress last consumed them, in order, with their sub-pixel position, their
+// own pressure, and the time they were received. They are pushed as soon as
+// the view receives them (see GLWidget::tabletEvent()), and the sketch tool
+// consumes all of them at once (see View::PMRMoveEvent()), so that none is
+// lost when drawing is slower than the tablet rate.
+//
+// This is a single-producer single-consumer ring buffer, without locks, so
+// the producer and the consumer may run in different threads.
+
+#include <QtGlobal>
+#include <atomic>
+
+class TabletSampleQueue
+{
+public:
+    struct Sample
+    {
+        double x;         // in widget coordinates
+        double y;
+        double pressure;
+        qint64 timestamp; // when received, see now()
+    };
+
+    enum { Capacity = 1024 };
+
+    TabletSampleQueue();
+
+    // Producer: appends a sample. Returns false, dropping it, if full
+    bool push(const Sample & sample);
+
+    // Consumer: removes the oldest sample into sample. Returns false if empty
+    bool pop(Sample & sample);
+
+    // Consumer: removes all samples, e.g., when a new stroke begins
+    void clear();
+
+    bool isEmpty() const;
+
+    // Number of samples dropped since the queue was created
+    int numDropped() const;
+
+    // Monotonic time, in nanoseconds, of samples and their consumers
+    static qint64 now();
+
+private:
+    Sample samples_[Capacity];
+    std::atomic<unsigned int> head_; // next sample to pop, written by the consumer
+    std::atomic<unsigned int> tail_; // next sample to push, written by the producer
+    std::atomic<int> numDropped_;
+};
+
+#endif // TABLET_SAMPLE_QUEUE_H
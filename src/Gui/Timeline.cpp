@@ -7,6 +7,8 @@
 // directory of this distribution and at http://opensource.org/licenses/MIT
 
 #include "Timeline.h"
+#include "Trace.h"
+#include "RenderStats.h"
 
 #include <QSpinBox>
 #include <QFormLayout>
@@ -20,18 +22,24 @@
 #include <QTimer>
 #include <QElapsedTimer>
 #include <QDialogButtonBox>
+#include <QGuiApplication>
+#include <QScreen>
 
 #include <QMouseEvent>
 #include <QtDebug>
+#include <cmath>
+#include <algorithm>
 
 #include "Scene.h"
 #include "View.h"
 #include "Global.h"
+#include "DevSettings.h"
 
 #include "VectorAnimationComplex/VAC.h"
 #include "VectorAnimationComplex/Cell.h"
 #include "VectorAnimationComplex/KeyCell.h"
 #include "VectorAnimationComplex/InbetweenCell.h"
+#include "VectorAnimationComplex/GeometryCache.h"
 
 #include "XmlStreamReader.h"
 #include "XmlStreamWriter.h"
@@ -40,6 +48,7 @@ using VectorAnimationComplex::VAC;
 using VectorAnimationComplex::Cell;
 using VectorAnimationComplex::KeyCell;
 using VectorAnimationComplex::InbetweenCell;
+using VectorAnimationComplex::GeometryCache;
 using VectorAnimationComplex::CellSet;
 using VectorAnimationComplex::KeyCellSet;
 using VectorAnimationComplex::InbetweenCellSet;
@@ -134,32 +143,30 @@ void Timeline_HBar::paintEvent (QPaintEvent * /*event*/)
     painter.drawLine(0, 1, 0, height()-2);
     painter.drawLine(width()-1, 1, width()-1, height()-2);
 
-    // Get cells
+    // Get key times and inbetween lifespans in the visible frames (with a
+    // margin of one frame, for markers overlapping the border)
     VAC * vac = w_->scene_->getVAC_();
-    CellSet cells = vac->cells();
-    KeyCellSet keyCells = cells;
-    InbetweenCellSet inbetweenCells = cells;
-    CellSet selectedCells = vac->selectedCells();
-    KeyCellSet selectedKeyCells = selectedCells;
-    InbetweenCellSet selectedInbetweenCells = selectedCells;
+    const double t1Visible = w_->firstVisibleFrame_ - 1;
+    const double t2Visible = w_->lastVisibleFrame_ + 1;
 
     // Draw inbetween cells
     painter.setPen(QColor(0,0,0));
     painter.setBrush(QColor(0,0,0));
-    foreach(InbetweenCell * inbetweenCell, inbetweenCells)
+    typedef QPair<double, double> Lifespan;
+    foreach(const Lifespan & lifespan, vac->inbetweenLifespans(t1Visible, t2Visible))
     {
-        double t1 = inbetweenCell->beforeTime().floatTime();
-        double t2 = inbetweenCell->afterTime().floatTime();
+        double t1 = lifespan.first;
+        double t2 = lifespan.second;
         painter.drawRect(10*t1 - w_->totalPixelOffset_ + 5, 4,
                          10*(t2-t1), 2);
         //painter.drawLine(10*t1 - w_->totalPixelOffset_ + 5, 5,
         //                 10*t2 - w_->totalPixelOffset_ + 5, 5);
     }
     painter.setBrush(QColor(255,0,0));
-    foreach(InbetweenCell * inbetweenCell, selectedInbetweenCells)
+    foreach(const Lifespan & lifespan, vac->selectedInbetweenLifespans())
     {
-        double t1 = inbetweenCell->beforeTime().floatTime();
-        double t2 = inbetweenCell->afterTime().floatTime();
+        double t1 = lifespan.first;
+        double t2 = lifespan.second;
         painter.drawRect(10*t1 - w_->totalPixelOffset_ + 5, 4,
                          10*(t2-t1), 2);
         //painter.drawLine(10*t1 - w_->totalPixelOffset_ + 5, 5,
@@ -169,15 +176,13 @@ void Timeline_HBar::paintEvent (QPaintEvent * /*event*/)
     // Draw key cells
     painter.setPen(QColor(0,0,0));
     painter.setBrush(QColor(0,0,0));
-    foreach(KeyCell * keyCell, keyCells)
+    foreach(double t, vac->keyTimes(t1Visible, t2Visible))
     {
-        double t = keyCell->time().floatTime();
         painter.drawEllipse(10*t - w_->totalPixelOffset_ + 2, 2, 6, 6);
     }
     painter.setBrush(QColor(255,0,0));
-    foreach(KeyCell * keyCell, selectedKeyCells)
+    foreach(double t, vac->selectedKeyTimes())
     {
-        double t = keyCell->time().floatTime();
         painter.drawEllipse(10*t - w_->totalPixelOffset_ + 2, 2, 6, 6);
     }
 
@@ -333,6 +338,7 @@ void PlaybackSettings::setDefaultValues()
     setFps(24) ;
     setPlayMode(NORMAL);
     setSubframeInbetweening(false);
+    setRealTime(true);
 }
 
 QString PlaybackSettings::playModeToString(PlayMode mode)
@@ -367,12 +373,14 @@ int PlaybackSettings::lastFrame() const { return lastFrame_; }
 int PlaybackSettings::fps() const { return fps_; }
 PlaybackSettings::PlayMode PlaybackSettings::playMode() const { return playMode_; }
 bool PlaybackSettings::subframeInbetweening() const { return subframeInbetweening_; }
+bool PlaybackSettings::realTime() const { return realTime_; }
 
 void PlaybackSettings::setFirstFrame(int f) { firstFrame_ = f; }
 void PlaybackSettings::setLastFrame(int f) { lastFrame_ = f; }
 void PlaybackSettings::setFps(int n)  { fps_ = n; }
 void PlaybackSettings::setPlayMode(PlayMode mode) { playMode_ = mode; }
 void PlaybackSettings::setSubframeInbetweening(bool b) { subframeInbetweening_ = b; }
+void PlaybackSettings::setRealTime(bool b) { realTime_ = b; }
 
 void PlaybackSettings::read(XmlStreamReader & xml)
 {
@@ -391,6 +399,8 @@ void PlaybackSettings::read(XmlStreamReader & xml)
         setPlayMode(stringToPlayMode(xml.attributes().value("playmode").toString()));
     if(xml.attributes().hasAttribute("subframeinbetweening"))
         setSubframeInbetweening((xml.attributes().value("subframeinbetweening") == "on") ? true : false);
+    if(xml.attributes().hasAttribute("realtime"))
+        setRealTime((xml.attributes().value("realtime") == "on") ? true : false);
 
     xml.skipCurrentElement();
 }
@@ -400,6 +410,7 @@ void PlaybackSettings::write(XmlStreamWriter & xml) const
     xml.writeAttribute("framerange", QString().setNum(firstFrame()) + " " + QString().setNum(lastFrame()));
     xml.writeAttribute("fps", QString().setNum(fps()));
     xml.writeAttribute("subframeinbetweening", subframeInbetweening() ? "on" : "off");
+    xml.writeAttribute("realtime", realTime() ? "on" : "off");
     xml.writeAttribute("playmode", playModeToString(playMode()));
 }
 
@@ -422,6 +433,10 @@ PlaybackSettingsDialog::PlaybackSettingsDialog(const PlaybackSettings & settings
     playModeSpinBox_->addItem("Bounce");
     //   Subframe Inbetweening
     subframeCheckBox_ = new QCheckBox();
+    //   Real-time Playback
+    realTimeCheckBox_ = new QCheckBox();
+    realTimeCheckBox_->setToolTip(tr("Skip frames that cannot be drawn in time, "
+                                     "rather than slowing down playback"));
 
     // Init values of widgets
     setPlaybackSettings(settings);
@@ -431,6 +446,7 @@ PlaybackSettingsDialog::PlaybackSettingsDialog(const PlaybackSettings & settings
     formLayout->addRow(tr("FPS"), fpsSpinBox_);
     formLayout->addRow(tr("Play Mode"), playModeSpinBox_);
     formLayout->addRow(tr("Subrame Inbetweening"), subframeCheckBox_);
+    formLayout->addRow(tr("Real-time Playback"), realTimeCheckBox_);
 
     // Create OK/Cancel buttons
     QDialogButtonBox * buttonBox = new QDialogButtonBox(
@@ -451,6 +467,7 @@ PlaybackSettings PlaybackSettingsDialog::playbackSettings() const
 {
     settings_.setFps(fpsSpinBox_->value());
     settings_.setSubframeInbetweening(subframeCheckBox_->isChecked());
+    settings_.setRealTime(realTimeCheckBox_->isChecked());
     settings_.setPlayMode(static_cast<PlaybackSettings::PlayMode>(playModeSpinBox_->currentIndex()));
 
     return settings_;
@@ -462,12 +479,20 @@ void PlaybackSettingsDialog::setPlaybackSettings(const PlaybackSettings & settin
 
     fpsSpinBox_->setValue(settings_.fps());
     subframeCheckBox_->setChecked(settings_.subframeInbetweening());
+    realTimeCheckBox_->setChecked(settings_.realTime());
     playModeSpinBox_->setCurrentIndex(static_cast<int>(settings_.playMode()));
 }
 
 void Timeline::read(XmlStreamReader & xml)
 {
-    settings_.read(xml);
+    PlaybackSettings settings;
+    settings.read(xml);
+    setPlaybackSettings(settings);
+}
+
+void Timeline::setPlaybackSettings(const PlaybackSettings & settings)
+{
+    settings_ = settings;
 
     setFirstFrame(settings_.firstFrame());
     setLastFrame(settings_.lastFrame());
@@ -482,6 +507,28 @@ void Timeline::write(XmlStreamWriter & xml) const
 namespace
 {
 
+// Delay of inactivity after which frames are pre-rendered for playback,
+// and maximum time spent pre-rendering before processing other events
+const int PLAYBACK_CACHE_DELAY_MSEC = 500;
+const int PLAYBACK_CACHE_BUDGET_MSEC = 20;
+
+// Maximum time spent prefetching geometry before processing other events,
+// e.g. the next frame of playback
+const int PREFETCH_BUDGET_MSEC = 10;
+
+// Minimum delay between two updates of playback statistics
+const int PLAYBACK_STATS_DELAY_MSEC = 500;
+
+// Interval between two refreshes of the display, in milliseconds
+int refreshIntervalMsec_()
+{
+    qreal refreshRate = QGuiApplication::primaryScreen() ?
+                        QGuiApplication::primaryScreen()->refreshRate() : 60;
+    if(refreshRate < 1)
+        refreshRate = 60;
+    return qMax(1, qRound(1000 / refreshRate));
+}
+
 QPushButton * makeButton_(const QString & iconPath, QAction * action)
 {
     QPushButton * button = new QPushButton(QIcon(iconPath), "");
@@ -501,6 +548,13 @@ Timeline::Timeline(Scene *scene, QWidget *parent) :
     // initialisations
     totalPixelOffset_ = 0;
     selectionType_ = 0;
+    playingDirection_ = true;
+    playbackOrigin_ = 0;
+    playbackPosition_ = 0;
+    playbackStats_.numShownFrames = 0;
+    playbackStats_.numDroppedFrames = 0;
+    playbackStats_.achievedFps = 0;
+    lastPlaybackStatsMsec_ = 0;
 
     // Horizontal bar (must be first cause some setValue() call hbar_->update())
     hbar_ = new Timeline_HBar(this);
@@ -583,9 +637,23 @@ Timeline::Timeline(Scene *scene, QWidget *parent) :
 
     // Set FPS
     timer_ = new QTimer();
+    timer_->setTimerType(Qt::PreciseTimer);
     setFps(24);
     connect(timer_, SIGNAL(timeout()), this, SLOT(timerTimeout()));
 
+    // Pre-render frames for playback while idle
+    playbackCacheTimer_ = new QTimer(this);
+    playbackCacheTimer_->setSingleShot(true);
+    nextPlaybackCacheFrame_ = firstFrame();
+    connect(playbackCacheTimer_, SIGNAL(timeout()), this, SLOT(renderPlaybackCache_()));
+    connect(scene_, SIGNAL(changed()), this, SLOT(schedulePlaybackCache_()));
+    connect(this, SIGNAL(playingWindowChanged()), this, SLOT(schedulePlaybackCache_()));
+
+    // Compute the geometry of upcoming frames ahead of time
+    prefetchTimer_ = new QTimer(this);
+    prefetchTimer_->setSingleShot(true);
+    connect(prefetchTimer_, SIGNAL(timeout()), this, SLOT(prefetchGeometry_()));
+
     // Layout of control buttons
     controlButtons_ = new QHBoxLayout();
     controlButtons_->addWidget(firstFrameButton_);
@@ -667,6 +735,11 @@ void Timeline::paintEvent(QPaintEvent * event)
 }
 
 
+PlaybackSettings Timeline::playbackSettings() const
+{
+    return settings_;
+}
+
 int Timeline::firstFrame() const
 {
     return settings_.firstFrame();
@@ -714,7 +787,10 @@ void Timeline::play()
         playedViews_ << global()->activeView();
         foreach(View * view, playedViews())
             view->disablePicking();
+        setFps(fps());
         elapsedTimer_.start();
+        if(isFramePacing_())
+            startFramePacing_();
         timer_->start();
         playPauseButton_->setIcon(QIcon(":/images/go-pause.png"));
     }
@@ -723,10 +799,13 @@ void Timeline::play()
 void Timeline::pause()
 {
     timer_->stop();
+    if(isFramePacing_())
+        emit playbackStatsChanged();
     foreach(View * view, playedViews())
         view->enablePicking();
     roundPlayedViews();
     playPauseButton_->setIcon(QIcon(":/images/go-play.png"));
+    schedulePlaybackCache_();
 }
 
 void Timeline::playPause()
@@ -814,7 +893,12 @@ void Timeline::setLastFrame(int lastFrame)
 
 void Timeline::setFps(int fps)
 {
-    if(subframeInbetweening())
+    if(isFramePacing_())
+    {
+        // The frame due is chosen at each refresh of the display
+        timer_->setInterval(refreshIntervalMsec_());
+    }
+    else if(subframeInbetweening())
     {
         timer_->setInterval(0);
     }
@@ -831,6 +915,154 @@ void Timeline::realTimePlayingChanged()
 }
 
 void Timeline::timerTimeout()
+{
+    VPAINT_TRACE_ZONE("Timeline::timerTimeout");
+
+    if(isFramePacing_())
+        paceFrame_();
+    else
+        stepFrame_();
+}
+
+bool Timeline::isFramePacing_() const
+{
+    static const DevSettings::Bool framePacing("frame pacing");
+    return framePacing;
+}
+
+double Timeline::playbackFrame_(double position) const
+{
+    int first = firstFrame();
+    int length = lastFrame() - firstFrame();
+    switch(playMode())
+    {
+    case PlaybackSettings::NORMAL:
+        return first + position;
+
+    case PlaybackSettings::LOOP:
+        // The last frame lasts one frame, like the others
+        return std::min(first + std::fmod(position, length + 1.0), double(lastFrame()));
+
+    case PlaybackSettings::BOUNCE:
+    {
+        if(length == 0)
+            return first;
+        double q = std::fmod(position, 2.0 * length);
+        return q <= length ? first + q : first + 2 * length - q;
+    }
+    }
+
+    return first + position;
+}
+
+void Timeline::startFramePacing_()
+{
+    // Start from the current time of the active view, within the playing window
+    View * view = global()->activeView();
+    double frame = view->activeTime().floatTime();
+    frame = std::max(double(firstFrame()), std::min(frame, double(lastFrame())));
+    if(!subframeInbetweening())
+        frame = std::floor(frame);
+    double position = frame - firstFrame();
+    if(playMode() == PlaybackSettings::BOUNCE && !playingDirection_)
+        position = 2 * (lastFrame() - firstFrame()) - position;
+
+    playbackOrigin_ = position;
+    playbackPosition_ = position;
+    playbackStats_.numShownFrames = 0;
+    playbackStats_.numDroppedFrames = 0;
+    playbackStats_.achievedFps = 0;
+    lastPlaybackStatsMsec_ = 0;
+    playbackClock_.start();
+
+    if(frame != view->activeTime().floatTime())
+    {
+        foreach(View * playedView, playedViews())
+        {
+            if(subframeInbetweening())
+                goToFrame(playedView, frame);
+            else
+                goToFrame(playedView, static_cast<int>(frame));
+        }
+    }
+    emit playbackStatsChanged();
+}
+
+void Timeline::paceFrame_()
+{
+    // Position due at the current real time
+    double elapsedFrames = 1e-9 * playbackClock_.nsecsElapsed() * fps();
+    double position = playbackOrigin_ + elapsedFrames;
+
+    // In every-frame mode, never go further than the frame after the one
+    // shown, and delay all subsequent frames accordingly
+    double shownFrame = std::floor(playbackPosition_);
+    if(!settings_.realTime())
+    {
+        double maxPosition = subframeInbetweening() ? playbackPosition_ + 1 : shownFrame + 1;
+        double lateness = subframeInbetweening() ? position - maxPosition : std::floor(position) - maxPosition;
+        if(lateness > 0)
+        {
+            playbackOrigin_ -= position - maxPosition;
+            position = maxPosition;
+        }
+    }
+
+    // Nothing to draw if no new frame is due
+    double dueFrame = std::floor(position);
+    if(!subframeInbetweening())
+    {
+        if(dueFrame == shownFrame)
+            return;
+        position = dueFrame;
+    }
+    else if(position == playbackPosition_)
+    {
+        return;
+    }
+
+    // Stop at the end of the playing window
+    int length = lastFrame() - firstFrame();
+    if(playMode() == PlaybackSettings::NORMAL && position > length)
+    {
+        pause();
+        return;
+    }
+
+    // Frames between the one shown and the one due are dropped
+    int numDroppedFrames = static_cast<int>(dueFrame - shownFrame) - 1;
+    if(numDroppedFrames > 0)
+    {
+        playbackStats_.numDroppedFrames += numDroppedFrames;
+        RenderStats::add(RenderStats::DroppedFrames, numDroppedFrames);
+    }
+
+    // Show the frame due
+    playbackPosition_ = position;
+    if(playMode() == PlaybackSettings::BOUNCE && length > 0)
+        playingDirection_ = std::fmod(position, 2.0 * length) < length;
+    double frame = playbackFrame_(position);
+    foreach(View * view, playedViews())
+    {
+        if(subframeInbetweening())
+            goToFrame(view, frame);
+        else
+            goToFrame(view, static_cast<int>(frame));
+    }
+
+    // Update statistics
+    ++playbackStats_.numShownFrames;
+    qint64 elapsedMsec = playbackClock_.elapsed();
+    if(elapsedMsec > 0)
+        playbackStats_.achievedFps = 1000.0 * playbackStats_.numShownFrames / elapsedMsec;
+    if(elapsedMsec - lastPlaybackStatsMsec_ >= PLAYBACK_STATS_DELAY_MSEC)
+    {
+        lastPlaybackStatsMsec_ = elapsedMsec;
+        emit playbackStatsChanged();
+    }
+}
+
+void Timeline::stepFrame_()
 {
     int elapsedMsec = elapsedTimer_.elapsed();
     if(elapsedMsec == 0)
@@ -1105,22 +1337,96 @@ void Timeline::goToPreviousFrame(View * view)
 
 void Timeline::goToFrame(View * view, double frame)
 {
+    Time previousTime = view->activeTime();
     view->setActiveTime(Time(frame)); // float time
     hbar_->repaint();
     emit timeChanged();
+    schedulePrefetch_(previousTime, view->activeTime());
 }
 
 void Timeline::goToFrame(View * view, int frame)
 {
+    Time previousTime = view->activeTime();
     view->setActiveTime(Time(frame)); // exact frame
     hbar_->repaint();
     emit timeChanged();
+    schedulePrefetch_(previousTime, view->activeTime());
+}
+
+void Timeline::schedulePrefetch_(Time previousTime, Time time)
+{
+    static const DevSettings::Bool geometryPrefetch("geometry prefetch");
+    static const DevSettings::Int prefetchedFrames("prefetched frames");
+
+    // Discard times prefetched for the previous time
+    prefetchTimes_.clear();
+    double dt = time.floatTime() - previousTime.floatTime();
+    if(!geometryPrefetch || dt == 0)
+        return;
+
+    // Get the next times in the direction of the change, within the playing
+    // window: the next frames, or when playing subframes, the next times
+    // at which their geometry is cached (see GeometryCache)
+    int direction = dt > 0 ? 1 : -1;
+    if(isPlaying() && subframeInbetweening())
+    {
+        int quantum = GeometryCache::timeQuantum();
+        int step = GeometryCache::MAX_TIME_QUANTUM / quantum;
+        int key = GeometryCache::timeKey(time);
+        key = GeometryCache::previousQuantumKey(key);
+        for(int i=1; i<=prefetchedFrames*quantum; ++i)
+        {
+            Time t = GeometryCache::keyTime(key + i*direction*step);
+            if(t.floatTime() < firstFrame() || t.floatTime() > lastFrame())
+                break;
+            prefetchTimes_ << t;
+        }
+    }
+    else
+    {
+        int frame = std::floor(time.floatTime() + 0.5);
+        for(int i=1; i<=prefetchedFrames; ++i)
+        {
+            int f = frame + i*direction;
+            if(f < firstFrame() || f > lastFrame())
+                break;
+            prefetchTimes_ << Time(f);
+        }
+    }
+
+    if(!prefetchTimes_.isEmpty())
+        prefetchTimer_->start(0);
+}
+
+void Timeline::prefetchGeometry_()
+{
+    VAC * vac = scene_->vectorAnimationComplex();
+    if(!vac)
+    {
+        prefetchTimes_.clear();
+        return;
+    }
+
+    // Prefetch a few times, then let other events be processed
+    QElapsedTimer elapsedTimer;
+    elapsedTimer.start();
+    while(!prefetchTimes_.isEmpty())
+    {
+        vac->prefetchGeometry(prefetchTimes_.takeFirst());
+        if(elapsedTimer.elapsed() > PREFETCH_BUDGET_MSEC)
+        {
+            prefetchTimer_->start(0);
+            return;
+        }
+    }
 }
 
 void Timeline::addView(View * view)
 {
     views_ << view;
     connect(view, SIGNAL(settingsChanged()), this, SLOT(update()));
+    connect(view, SIGNAL(settingsChanged()), this, SLOT(schedulePlaybackCache_()));
+    connect(view, SIGNAL(viewChanged(int, int)), this, SLOT(schedulePlaybackCache_()));
     hbar_->update();
 }
 
@@ -1130,6 +1436,39 @@ void Timeline::removeView(View * view)
     hbar_->update();
 }
 
+void Timeline::schedulePlaybackCache_()
+{
+    // Restart from the first frame, since changes may have invalidated any
+    // frame. Checking frames which are still up to date is cheap.
+    nextPlaybackCacheFrame_ = firstFrame();
+    playbackCacheTimer_->start(PLAYBACK_CACHE_DELAY_MSEC);
+}
+
+void Timeline::renderPlaybackCache_()
+{
+    // Only pre-render while idle, for the view that would be played
+    View * view = global()->activeView();
+    if(isPlaying() || !view || !views_.contains(view))
+        return;
+
+    if(nextPlaybackCacheFrame_ == firstFrame())
+        view->trimPlaybackCache(firstFrame(), lastFrame());
+
+    // Render a few frames, then let other events be processed
+    QElapsedTimer elapsedTimer;
+    elapsedTimer.start();
+    while(nextPlaybackCacheFrame_ <= lastFrame())
+    {
+        view->renderPlaybackFrame(nextPlaybackCacheFrame_);
+        ++nextPlaybackCacheFrame_;
+        if(elapsedTimer.elapsed() > PLAYBACK_CACHE_BUDGET_MSEC)
+        {
+            playbackCacheTimer_->start(0);
+            return;
+        }
+    }
+}
+
 bool Timeline::isPlaying() const
 {
     return timer_->isActive();
@@ -1139,3 +1478,8 @@ QSet<View*> Timeline::playedViews() const
 {
     return playedViews_;
 }
+
+Timeline::PlaybackStats Timeline::playbackStats() const
+{
+    return playbackStats_;
+}
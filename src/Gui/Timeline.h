@@ -76,12 +76,14 @@ public:
     int fps() const;
     PlayMode playMode() const;
     bool subframeInbetweening() const;
+    bool realTime() const; // whether frames are dropped to keep up with fps
 
     void setFirstFrame(int f);
     void setLastFrame(int f);
     void setFps(int n) ;
     void setPlayMode(PlayMode mode);
     void setSubframeInbetweening(bool b);
+    void setRealTime(bool b);
 
     void read(XmlStreamReader & xml);
     void write(XmlStreamWriter & xml) const;
@@ -92,6 +94,7 @@ private:
     int fps_;
     PlayMode playMode_;
     bool subframeInbetweening_;
+    bool realTime_;
 };
 
 class PlaybackSettingsDialog: public QDialog
@@ -107,6 +110,7 @@ private:
 
     QSpinBox * fpsSpinBox_;
     QCheckBox * subframeCheckBox_;
+    QCheckBox * realTimeCheckBox_;
     QComboBox * playModeSpinBox_;
 };
 
@@ -132,7 +136,9 @@ public:
     void addView(View * view);
     void removeView(View * view);
 
-    // Get playback settings
+    // Get and set playback settings
+    PlaybackSettings playbackSettings() const;
+    void setPlaybackSettings(const PlaybackSettings & settings);
     int firstFrame() const;
     int lastFrame() const;
     int fps() const;
@@ -143,6 +149,15 @@ public:
     bool isPlaying() const;
     QSet<View*> playedViews() const;
 
+    // Statistics of the current playback, or of the last one if paused
+    struct PlaybackStats
+    {
+        int numShownFrames;   // times shown, including subframes
+        int numDroppedFrames; // frames skipped to keep up with real time
+        double achievedFps;   // times shown per second
+    };
+    PlaybackStats playbackStats() const;
+
     // Visualization
     int firstVisibleFrame() const;
     int lastVisibleFrame() const;
@@ -181,9 +196,14 @@ private slots:
     void timerTimeout();
     void roundPlayedViews();
 
+    void schedulePlaybackCache_();
+    void renderPlaybackCache_();
+    void prefetchGeometry_();
+
 signals:
     void timeChanged();
     void playingWindowChanged();
+    void playbackStatsChanged();
 
 protected:
     void paintEvent(QPaintEvent * event);
@@ -210,6 +230,39 @@ private:
     QTimer * timer_;
     QElapsedTimer elapsedTimer_;
 
+    // Frame pacing: while playing, the timer ticks at the refresh rate of the
+    // display, and each tick shows the time due since playback started, as
+    // measured by playbackClock_. Ticks where no new frame is due draw
+    // nothing, and in real-time mode, frames already past are dropped rather
+    // than drawn late. In every-frame mode, the clock is held back instead,
+    // so that playback slows down but no frame is skipped.
+    //
+    // Times are tracked as positions along the play cycle, in frames since
+    // the first frame, which keep increasing when looping or bouncing.
+    QElapsedTimer playbackClock_;
+    double playbackOrigin_;   // position at which playbackClock_ started
+    double playbackPosition_; // position shown
+    PlaybackStats playbackStats_;
+    qint64 lastPlaybackStatsMsec_;
+    bool isFramePacing_() const;
+    void startFramePacing_();
+    void paceFrame_();
+    void stepFrame_();
+    double playbackFrame_(double position) const;
+
+    // Playback cache: frames are pre-rendered by the active view after
+    // some inactivity, a few at a time, see View::renderPlaybackFrame()
+    QTimer * playbackCacheTimer_;
+    int nextPlaybackCacheFrame_;
+
+    // Geometry prefetch: each time the time of a view changes, the geometry
+    // of the next frames in the same direction is computed between frames,
+    // a few at a time, see VAC::prefetchGeometry(). Pending times are
+    // discarded when the time changes again, e.g. when the play head jumps.
+    QTimer * prefetchTimer_;
+    QList<Time> prefetchTimes_; // in order of priority
+    void schedulePrefetch_(Time previousTime, Time time);
+
     // Actions
     QAction * actionGoToFirstFrame_;
     QAction * actionGoToPreviousFrame_;
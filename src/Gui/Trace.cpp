@@ -0,0 +1,222 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#include "Trace.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QList>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QTextStream>
+#include <QVector>
+
+namespace
+{
+// Number of zones kept per thread
+const int RING_BUFFER_SIZE = 1 << 16;
+
+struct ZoneEvent
+{
+    const char * name;
+    qint64 begin;    // in nanoseconds
+    qint64 duration;
+};
+
+// Zones recorded by one thread. Only the owning thread adds zones, but the
+// buffer can be read or cleared by another thread while exporting, hence the
+// mutex, which is otherwise uncontended
+struct ThreadBuffer
+{
+    ThreadBuffer(int threadIndex, const char * name = 0) :
+        threadIndex(threadIndex),
+        name(name),
+        events(RING_BUFFER_SIZE),
+        next(0),
+        isFull(false)
+    {
+    }
+
+    QMutex mutex;
+    int threadIndex;
+    const char * name; // 0 for threads
+    QVector<ZoneEvent> events;
+    int next;
+    bool isFull;
+};
+
+// All buffers, never deleted, so that zones recorded by threads that have
+// since finished can still be exported
+QMutex registryMutex;
+QList<ThreadBuffer*> registry;
+
+ThreadBuffer * threadBuffer_()
+{
+    thread_local ThreadBuffer * buffer = 0;
+    if(!buffer)
+    {
+        QMutexLocker lock(&registryMutex);
+        buffer = new ThreadBuffer(registry.size());
+        registry << buffer;
+    }
+    return buffer;
+}
+
+// Zones measured on the GPU, whichever thread collects them
+ThreadBuffer * gpuBuffer_()
+{
+    static ThreadBuffer * buffer = 0;
+    QMutexLocker lock(&registryMutex);
+    if(!buffer)
+    {
+        buffer = new ThreadBuffer(registry.size(), "GPU");
+        registry << buffer;
+    }
+    return buffer;
+}
+
+void addEvent_(ThreadBuffer * buffer, const ZoneEvent & event)
+{
+    QMutexLocker lock(&buffer->mutex);
+    buffer->events[buffer->next] = event;
+    if(++buffer->next == RING_BUFFER_SIZE)
+    {
+        buffer->next = 0;
+        buffer->isFull = true;
+    }
+}
+
+QElapsedTimer startedTimer_()
+{
+    QElapsedTimer timer;
+    timer.start();
+    return timer;
+}
+
+// Time since the first zone, in nanoseconds
+qint64 now_()
+{
+    static const QElapsedTimer timer = startedTimer_();
+    return timer.nsecsElapsed();
+}
+
+// Escapes a zone name for JSON
+QString escaped_(const char * name)
+{
+    QString res = QString::fromUtf8(name);
+    res.replace('\\', "\\\\");
+    res.replace('"', "\\\"");
+    return res;
+}
+}
+
+std::atomic<bool> Trace::isEnabled_(false);
+
+void Trace::setEnabled(bool enabled)
+{
+    isEnabled_.store(enabled, std::memory_order_relaxed);
+}
+
+bool Trace::isCompiledIn()
+{
+#ifdef VPAINT_TRACING
+    return true;
+#else
+    return false;
+#endif
+}
+
+Trace::Zone::Zone(const char * name) :
+    name_(name),
+    begin_(isEnabled() ? now_() : -1)
+{
+}
+
+Trace::Zone::~Zone()
+{
+    if(begin_ < 0)
+        return;
+
+    ZoneEvent event = { name_, begin_, now_() - begin_ };
+    addEvent_(threadBuffer_(), event);
+}
+
+qint64 Trace::now()
+{
+    return now_();
+}
+
+void Trace::addGpuZone(const char * name, qint64 begin, qint64 duration)
+{
+    if(!isEnabled())
+        return;
+
+    ZoneEvent event = { name, begin, duration };
+    addEvent_(gpuBuffer_(), event);
+}
+
+bool Trace::exportChromeTrace(const QString & filePath)
+{
+    QFile file(filePath);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+        return false;
+
+    QTextStream out(&file);
+    out.setRealNumberNotation(QTextStream::FixedNotation);
+    out.setRealNumberPrecision(3);
+    out << "{\"traceEvents\":[\n";
+
+    bool isFirst = true;
+    QMutexLocker registryLock(&registryMutex);
+    foreach(ThreadBuffer * buffer, registry)
+    {
+        QMutexLocker lock(&buffer->mutex);
+
+        // Name of the track, if not a thread
+        if(buffer->name)
+        {
+            if(!isFirst)
+                out << ",\n";
+            isFirst = false;
+            out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->threadIndex
+                << ",\"args\":{\"name\":\"" << escaped_(buffer->name) << "\"}}";
+        }
+
+        // Oldest zone first
+        const int size = buffer->isFull ? RING_BUFFER_SIZE : buffer->next;
+        const int first = buffer->isFull ? buffer->next : 0;
+        for(int i=0; i<size; ++i)
+        {
+            const ZoneEvent & event = buffer->events[(first + i) % RING_BUFFER_SIZE];
+            if(!isFirst)
+                out << ",\n";
+            isFirst = false;
+
+            // Complete events, with times in microseconds
+            out << "{\"name\":\"" << escaped_(event.name) << "\",\"ph\":\"X\""
+                << ",\"ts\":" << event.begin * 1e-3
+                << ",\"dur\":" << event.duration * 1e-3
+                << ",\"pid\":1,\"tid\":" << buffer->threadIndex << "}";
+        }
+    }
+
+    out << "\n]}\n";
+    out.flush();
+    return file.error() == QFile::NoError;
+}
+
+void Trace::clear()
+{
+    QMutexLocker registryLock(&registryMutex);
+    foreach(ThreadBuffer * buffer, registry)
+    {
+        QMutexLocker lock(&buffer->mutex);
+        buffer->next = 0;
+        buffer->isFull = false;
+    }
+}
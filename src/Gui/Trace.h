@@ -0,0 +1,82 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#ifndef TRACE_H
+#define TRACE_H
+
+// Trace: scoped zones, for profiling where the time of a hitch goes without
+// attaching an external profiler. A zone is declared at the beginning of a
+// scope, and records its begin time and duration when the scope ends:
+//
+//     void VAC::draw(Time time, ViewSettings & viewSettings)
+//     {
+//         VPAINT_TRACE_ZONE("VAC::draw");
+//         ...
+//     }
+//
+// Zones are compiled out unless VPaint is built with CONFIG+=tracing (which
+// defines VPAINT_TRACING), and are only recorded while the "tracing" dev
+// setting is checked. Each thread records into its own ring buffer, keeping
+// its most recent zones, and all buffers can be exported in the Chrome trace
+// format (see DevSettings), to be opened in chrome://tracing or Perfetto.
+//
+// The name of a zone must be a string literal, or outlive the trace.
+
+#include <QString>
+#include <atomic>
+
+#ifdef VPAINT_TRACING
+#   define VPAINT_TRACE_CONCAT_(a, b) a##b
+#   define VPAINT_TRACE_CONCAT(a, b) VPAINT_TRACE_CONCAT_(a, b)
+#   define VPAINT_TRACE_ZONE(name) Trace::Zone VPAINT_TRACE_CONCAT(traceZone_, __LINE__)(name)
+#else
+#   define VPAINT_TRACE_ZONE(name)
+#endif
+
+class Trace
+{
+public:
+    // Whether zones are recorded. Since this is cheap, zones test it
+    // themselves
+    static bool isEnabled() { return isEnabled_.load(std::memory_order_relaxed); }
+    static void setEnabled(bool enabled);
+
+    // Records the time elapsed between its construction and destruction
+    class Zone
+    {
+    public:
+        explicit Zone(const char * name);
+        ~Zone();
+
+    private:
+        const char * name_;
+        qint64 begin_; // -1 if not recorded
+    };
+
+    // Whether zones are compiled in
+    static bool isCompiledIn();
+
+    // Time on the clock of zones, in nanoseconds
+    static qint64 now();
+
+    // Records a zone measured by other means, on a separate "GPU" track,
+    // with times on the clock of now(). Does nothing if not enabled
+    static void addGpuZone(const char * name, qint64 begin, qint64 duration);
+
+    // Writes the zones recorded by all threads in the Chrome trace format.
+    // Returns false if the file couldn't be written
+    static bool exportChromeTrace(const QString & filePath);
+
+    // Forgets all recorded zones
+    static void clear();
+
+private:
+    static std::atomic<bool> isEnabled_;
+};
+
+#endif // TRACE_H
@@ -9,9 +9,10 @@
 #include "Algorithms.h"
 #include "Cell.h"
 #include "KeyEdge.h"
+#include "FlatCellSet.h"
 
-#include <QStack>
-#include <QMap>
+#include <vector>
+#include <algorithm>
 
 namespace VectorAnimationComplex
 {
@@ -21,29 +22,29 @@ namespace Algorithms
 
 CellSet connected(const CellSet & cells)
 {
-    CellSet res = cells;
-    CellSet addedCells = cells;
+    FlatCellSet res = cells;
+    std::vector<Cell*> addedCells(cells.begin(), cells.end());
 
     // while some cells have been added
     while(addedCells.size() != 0)
     {
-        CellSet newAddedCells;
-        foreach(Cell * c, addedCells)
+        std::vector<Cell*> newAddedCells;
+        for(Cell * c: addedCells)
         {
             CellSet neighbourhood = c->neighbourhood();
-            foreach(Cell * d, neighbourhood)
+            for(Cell * d: neighbourhood)
             {
                 if(!res.contains(d))
                 {
                     res << d;
-                    newAddedCells << d;
+                    newAddedCells.push_back(d);
                 }
             }
         }
-        addedCells = newAddedCells;
+        addedCells.swap(newAddedCells);
     }
 
-    return res;
+    return res.toSet();
 }
 
 
@@ -68,12 +69,24 @@ CellSet closure(const CellSet & cells)
     return res;
 }
 
-CellSet fullstar(Cell * c)
+namespace
+{
+void insertFullStar(CellSet & res, Cell * c)
 {
-    CellSet res;
     res << c;
-    foreach(Cell * b, c->star())
+    for(Cell * b: c->spatialStarList())
         res << b;
+    for(Cell * b: c->temporalStarBeforeList())
+        res << b;
+    for(Cell * b: c->temporalStarAfterList())
+        res << b;
+}
+}
+
+CellSet fullstar(Cell * c)
+{
+    CellSet res;
+    insertFullStar(res, c);
     return res;
 }
 
@@ -81,90 +94,73 @@ CellSet fullstar(const CellSet & cells)
 {
     CellSet res;
     foreach(Cell * c, cells)
-    {
-        res << c;
-        foreach(Cell * b, c->star())
-            res << b;
-    }
+        insertFullStar(res, c);
     return res;
 }
 
 // decompose `cells` in a list of connected, mutually disconnected, cells
 QList<KeyEdgeSet> connectedComponents(const KeyEdgeSet & cells)
 {
-    // ---- Detect connected components ----
-
-    // Initialize data structure for algorithm
-
-    QMap<KeyEdge *, bool> isMarked;
-    foreach(KeyEdge * edge, cells)
-        isMarked[edge] = false;
-
-    QMap<KeyEdge *, int> component;
-    foreach(KeyEdge * edge, cells)
-        component[edge] = -1;
-
-    int numComponents = 0;
-
-
-    // Execute algorithm
-
-    foreach(KeyEdge * edge, cells)
+    // Number the edges
+    std::vector<KeyEdge*> edges(cells.begin(), cells.end());
+    int n = edges.size();
+
+    // Union-find over edge numbers, with path halving. Two open edges
+    // are united if they share a vertex, which is found by remembering
+    // the first edge seen at each vertex
+    std::vector<int> parent(n);
+    for(int i=0; i<n; ++i)
+        parent[i] = i;
+    auto find = [&parent](int i)
     {
-        // if has already been assigned a connected component, do nothing
-        if(!isMarked[edge])
+        while(parent[i] != i)
         {
-            // create a new connected component
-            numComponents++;
-
-            // create the stack of unvisited but marked edges to visit
-            QStack<KeyEdge *> stack;
+            parent[i] = parent[parent[i]];
+            i = parent[i];
+        }
+        return i;
+    };
 
-            // add the first edge of connected component as marked
-            isMarked[edge] = true;
-            stack.push(edge);
+    QHash<KeyVertex*, int> firstEdgeAtVertex;
+    firstEdgeAtVertex.reserve(2*n);
+    for(int i=0; i<n; ++i)
+    {
+        KeyEdge * edge = edges[i];
+        if(edge->isClosed())
+            continue;
 
-            // While there are edges to visit
-            while(!stack.isEmpty())
+        KeyVertex * vertices[2] = { edge->startVertex(), edge->endVertex() };
+        for(KeyVertex * v: vertices)
+        {
+            auto it = firstEdgeAtVertex.find(v);
+            if(it == firstEdgeAtVertex.end())
             {
-                // get unvisited edge
-                KeyEdge * edgeToVisit = stack.pop();
-
-                // Note: edgeToVisit is already marked.
-
-                // visit edge:
-                //  1) assign it a connected component
-                //  2) find other edges to visit
-
-                // Assign connected component
-                component[edgeToVisit] = numComponents-1;
-
-                //  Find other edges to visit
-                foreach(KeyEdge * other, cells)
-                {
-                    if(!isMarked[other]) // note: this exlude other == edgeToVisit
-                    {
-                        if(areIncident(edgeToVisit,other))
-                        {
-                            // mark other, insert it in stack
-                            isMarked[other] = true;
-                            stack.push(other);
-                        }
-                    }
-                }
+                firstEdgeAtVertex.insert(v, i);
+            }
+            else
+            {
+                int ri = find(i);
+                int rj = find(it.value());
+                if(ri != rj)
+                    parent[std::max(ri,rj)] = std::min(ri,rj);
             }
         }
     }
 
-
-    // ---- Convert to output ----
-
+    // Gather components. Roots are the smallest number of their
+    // component, so components are created in order of first edge
     QList<KeyEdgeSet> res;
-    for(int i=0; i<numComponents; ++i)
-        res << KeyEdgeSet();
-
-    foreach(KeyEdge * edge, cells)
-        res[component[edge]] << edge;
+    std::vector<int> componentIndices(n, -1);
+    for(int i=0; i<n; ++i)
+    {
+        int r = find(i);
+        if(componentIndices[r] == -1)
+        {
+            componentIndices[r] = res.size();
+            res << KeyEdgeSet();
+        }
+        res[componentIndices[r]] << edges[i];
+    }
 
     return res;
 }
@@ -193,6 +189,79 @@ bool areIncident(const KeyEdge * e1, const KeyEdge * e2)
     }
 }
 
+IncidentEdges::IncidentEdges(const KeyEdgeSet & edges) :
+    edges_(edges.begin(), edges.end()),
+    removed_(edges.size(), false),
+    numRemaining_(edges.size())
+{
+    // Number vertices, and count their incident edges
+    int n = edges_.size();
+    std::vector<int> counts;
+    vertexIndices_.reserve(2*n);
+    auto vertexIndex = [this, &counts](KeyVertex * v)
+    {
+        auto it = vertexIndices_.find(v);
+        if(it != vertexIndices_.end())
+            return it.value();
+        int k = counts.size();
+        vertexIndices_.insert(v, k);
+        counts.push_back(0);
+        return k;
+    };
+    for(KeyEdge * edge: edges_)
+    {
+        if(edge->isClosed())
+            continue;
+        ++counts[vertexIndex(edge->startVertex())];
+        if(edge->endVertex() != edge->startVertex())
+            ++counts[vertexIndex(edge->endVertex())];
+    }
+
+    // Fill flat arrays, in order of edge numbers
+    int numVertices = counts.size();
+    offsets_.resize(numVertices+1);
+    offsets_[0] = 0;
+    for(int k=0; k<numVertices; ++k)
+        offsets_[k+1] = offsets_[k] + counts[k];
+    cursors_.assign(offsets_.begin(), offsets_.end()-1);
+    incident_.resize(offsets_[numVertices]);
+    for(int i=0; i<n; ++i)
+    {
+        KeyEdge * edge = edges_[i];
+        if(edge->isClosed())
+            continue;
+        int k = vertexIndices_.value(edge->startVertex());
+        incident_[cursors_[k]++] = i;
+        if(edge->endVertex() != edge->startVertex())
+        {
+            k = vertexIndices_.value(edge->endVertex());
+            incident_[cursors_[k]++] = i;
+        }
+    }
+    cursors_.assign(offsets_.begin(), offsets_.end()-1);
+}
+
+int IncidentEdges::firstIncidentEdge(KeyVertex * v)
+{
+    auto it = vertexIndices_.find(v);
+    if(it == vertexIndices_.end())
+        return -1;
+
+    int k = it.value();
+    int & cursor = cursors_[k];
+    while(cursor < offsets_[k+1] && removed_[incident_[cursor]])
+        ++cursor;
+    return (cursor < offsets_[k+1]) ? incident_[cursor] : -1;
+}
+
+void IncidentEdges::remove(int i)
+{
+    if(!removed_[i])
+    {
+        removed_[i] = true;
+        --numRemaining_;
+    }
+}
 
 }
 
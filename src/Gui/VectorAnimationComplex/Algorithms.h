@@ -11,6 +11,9 @@
 
 #include "CellList.h"
 
+#include <QHash>
+#include <vector>
+
 namespace VectorAnimationComplex
 {
 
@@ -22,7 +25,8 @@ CellSet connected(const CellSet & cells);
 
 // decompose the set of edges in a list of connected components
 // here, "connected" is in the sense that two edges are said "connected" if
-// they share a common vertex.
+// they share a common vertex. Closed edges are their own component.
+// Components are listed in the order their first edge appears in `edges`.
 QList<KeyEdgeSet> connectedComponents(const KeyEdgeSet & edges);
 
 // returns the closure of a cell
@@ -43,6 +47,36 @@ CellSet fullstar(const CellSet & cells);
 //   returns true if they are equals, even if it is a closed edge
 bool areIncident(const KeyEdge * e1, const KeyEdge *e2);
 
+// The edges of a set, indexed by their end vertices, for the algorithms
+// chaining them one after the other (see ProperPath, ProperCycle, Cycle).
+// Edges are numbered from 0 in the iteration order of the set, and the
+// incident edges of each vertex are stored in flat arrays sorted by number.
+// firstIncidentEdge(v) returns the smallest number of the edges incident to
+// v that are not removed yet, or -1 if none, in amortized constant time.
+// Closed edges are not incident to any vertex.
+class IncidentEdges
+{
+public:
+    IncidentEdges(const KeyEdgeSet & edges);
+
+    int size() const { return edges_.size(); }
+    int numRemaining() const { return numRemaining_; }
+    KeyEdge * operator[](int i) const { return edges_[i]; }
+
+    int firstIncidentEdge(KeyVertex * v);
+    void remove(int i);
+
+private:
+    std::vector<KeyEdge*> edges_;
+    std::vector<bool> removed_;
+    int numRemaining_;
+
+    QHash<KeyVertex*, int> vertexIndices_;
+    std::vector<int> offsets_;  // edges incident to vertex k are
+    std::vector<int> incident_; // incident_[offsets_[k]..offsets_[k+1]-1]
+    std::vector<int> cursors_;  // first possibly not removed, per vertex
+};
+
 
 } // namespace Algorithms
 
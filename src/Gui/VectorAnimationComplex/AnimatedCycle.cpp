@@ -16,10 +16,21 @@
 #include "VAC.h"
 
 #include <QStack>
+#include <QMutex>
+#include <QMutexLocker>
+#include <algorithm>
 #include <QMap>
 #include <assert.h>
 #include <QtDebug>
 
+namespace
+{
+
+// Protects the traversal plans of all cycles
+QMutex plansMutex;
+
+}
+
 namespace VectorAnimationComplex
 {
 
@@ -213,17 +224,20 @@ void AnimatedCycleNode::setSide(bool side)
 }
 
 AnimatedCycle::AnimatedCycle() :
-    first_(0)
+    first_(0),
+    plansVersion_(0)
 {
 }
 
 AnimatedCycle::AnimatedCycle(AnimatedCycleNode * first) :
-    first_(first)
+    first_(first),
+    plansVersion_(0)
 {
 }
 
 AnimatedCycle::AnimatedCycle(const AnimatedCycle & other) :
-    first_(0)
+    first_(0),
+    plansVersion_(0)
 {
     copyFrom(other);
 }
@@ -247,6 +261,7 @@ void AnimatedCycle::clear()
         delete node;
 
     first_ = 0;
+    clearPlans_();
 }
 
 void AnimatedCycle::copyFrom(const AnimatedCycle & other)
@@ -280,9 +295,10 @@ AnimatedCycleNode  * AnimatedCycle::first() const
 void AnimatedCycle::setFirst(AnimatedCycleNode  * node)
 {
     first_ = node;
+    clearPlans_();
 }
 
-AnimatedCycleNode  * AnimatedCycle::getNode(Time time)
+AnimatedCycleNode  * AnimatedCycle::getNode(Time time) const
 {
     AnimatedCycleNode  * res = first_;
     if(!res)
@@ -366,6 +382,7 @@ KeyCellSet AnimatedCycle::afterCells() const
 // Replace pointed vertex
 void AnimatedCycle::replaceVertex(KeyVertex * oldVertex, KeyVertex * newVertex)
 {
+    clearPlans_();
     foreach(AnimatedCycleNode * node, nodes())
     {
         if(node->cell()->toKeyVertex() == oldVertex)
@@ -374,6 +391,7 @@ void AnimatedCycle::replaceVertex(KeyVertex * oldVertex, KeyVertex * newVertex)
 }
 void AnimatedCycle::replaceHalfedge(const KeyHalfedge & oldHalfedge, const KeyHalfedge & newHalfedge)
 {
+    clearPlans_();
     foreach(AnimatedCycleNode * node, nodes())
     {
         if(node->cell()->toKeyEdge() == oldHalfedge.edge)
@@ -385,6 +403,7 @@ void AnimatedCycle::replaceHalfedge(const KeyHalfedge & oldHalfedge, const KeyHa
 }
 void AnimatedCycle::replaceEdges(KeyEdge * oldEdge, const KeyEdgeList & newEdges)
 {
+    clearPlans_();
     if(oldEdge->isClosed())
     {
         // Get the old key closed edge nodes, sorted
@@ -584,6 +603,7 @@ QSet<AnimatedCycleNode*>  AnimatedCycle::getNodes(Cell * cell)
 void AnimatedCycle::replaceInbetweenVertex(InbetweenVertex * sv,
                             InbetweenVertex * sv1, KeyVertex * kv, InbetweenVertex * sv2)
 {
+    clearPlans_();
     foreach(AnimatedCycleNode * nsv, getNodes(sv))
     {
         // Create three new nodes
@@ -673,6 +693,7 @@ void AnimatedCycle::replaceInbetweenVertex(InbetweenVertex * sv,
 void AnimatedCycle::replaceInbetweenEdge(InbetweenEdge * se,
                                          InbetweenEdge * se1, KeyEdge * ke, InbetweenEdge * se2)
 {
+    clearPlans_();
     // Get time
     Time t = ke->time();
 
@@ -870,17 +891,108 @@ void AnimatedCycle::replaceInbetweenEdge(InbetweenEdge * se,
 
 
 // Geometry
-void AnimatedCycle::sample(Time time, QList<Eigen::Vector2d> & out)
+void AnimatedCycle::sample(Time time, Vector2dVector & out) const
+{
+    out.clear();
+    const TraversalPlan plan = traversalPlan_(time);
+    foreach(AnimatedCycleNode * node, plan.nodes)
+    {
+        switch(node->nodeType())
+        {
+        case AnimatedCycleNode::KeyVertexNode:
+            out << node->cell()->toKeyVertex()->pos();
+            break;
+        case AnimatedCycleNode::InbetweenVertexNode:
+            out << node->cell()->toInbetweenVertex()->pos(time);
+            break;
+        case AnimatedCycleNode::KeyOpenEdgeNode:
+        case AnimatedCycleNode::KeyClosedEdgeNode:
+        case AnimatedCycleNode::InbetweenOpenEdgeNode:
+        case AnimatedCycleNode::InbetweenClosedEdgeNode:
+        {
+            KeyEdge * keyEdge = node->cell()->toKeyEdge();
+            Vector2dVector sampling = keyEdge ?
+                        keyEdge->geometry()->sampling() :
+                        node->cell()->toInbetweenEdge()->getGeometry(time);
+            int n = sampling.size();
+            if(node->side())
+                for(int i=0; i<n-1; ++i) // -1 because we don't want to duplicate last sample
+                    out << sampling[i];
+            else
+                for(int i=n-1; i>0; --i) // -1 because we don't want to duplicate last sample
+                    out << sampling[i];
+            break;
+        }
+        case AnimatedCycleNode::InvalidNode:
+            break;
+        }
+    }
+
+    if(plan.warning)
+        qWarning("%s", plan.warning);
+}
+
+void AnimatedCycle::clearPlans_()
 {
-    // A robust sampling scheme. Do not assume that the cycle is valid.
-    // More specifically, the
+    planTimes_.clear();
+    plans_.clear();
+    plansVersion_ = 0;
+}
 
+AnimatedCycle::TraversalPlan AnimatedCycle::traversalPlan_(Time time) const
+{
+    // Cycles may be sampled concurrently, e.g., when exporting frames
+    QMutexLocker locker(&plansMutex);
 
-    out.clear();
+    // Get the key times of the cells, if they may have changed
+    if(plansVersion_ != Cell::topologyVersion())
+    {
+        planTimes_.clear();
+        plans_.clear();
+        foreach(Cell * cell, cells())
+        {
+            KeyCell * keyCell = cell->toKeyCell();
+            InbetweenCell * inbetweenCell = cell->toInbetweenCell();
+            if(keyCell)
+            {
+                planTimes_.push_back(keyCell->time());
+            }
+            else if(inbetweenCell)
+            {
+                planTimes_.push_back(inbetweenCell->beforeTime());
+                planTimes_.push_back(inbetweenCell->afterTime());
+            }
+        }
+        std::sort(planTimes_.begin(), planTimes_.end());
+        planTimes_.erase(std::unique(planTimes_.begin(), planTimes_.end()), planTimes_.end());
+        plansVersion_ = Cell::topologyVersion();
+    }
+
+    // Get the interval containing time
+    int k = std::lower_bound(planTimes_.begin(), planTimes_.end(), time) - planTimes_.begin();
+    bool isKeyTime = k < (int)planTimes_.size() && planTimes_[k] == time;
+    int interval = isKeyTime ? 2*k+1 : 2*k;
+
+    // Compute the plan of this interval, if not done yet
+    QMap<int, TraversalPlan>::iterator it = plans_.find(interval);
+    if(it == plans_.end())
+    {
+        it = plans_.insert(interval, TraversalPlan());
+        computeTraversalPlan_(time, it.value());
+    }
+    return it.value();
+}
+
+void AnimatedCycle::computeTraversalPlan_(Time time, TraversalPlan & plan) const
+{
+    // A robust traversal. Do not assume that the cycle is valid.
+
+    plan.nodes.clear();
+    plan.warning = 0;
     AnimatedCycleNode * node = getNode(time);
     if(!node)
     {
-        qWarning("Warning: sampling failed: no node found");
+        plan.warning = "Warning: sampling failed: no node found";
         return;
     }
 
@@ -895,7 +1007,7 @@ void AnimatedCycle::sample(Time time, QList<Eigen::Vector2d> & out)
             firstOpenHalfedge = firstOpenHalfedge->next(time);
             if(!firstOpenHalfedge)
             {
-                qWarning("Warning: sampling (partially) failed: no next node found");
+                plan.warning = "Warning: sampling (partially) failed: no next node found";
                 return;
             }
         }
@@ -904,7 +1016,7 @@ void AnimatedCycle::sample(Time time, QList<Eigen::Vector2d> & out)
         if( !(firstOpenHalfedge->nodeType() == AnimatedCycleNode::KeyOpenEdgeNode ||
                firstOpenHalfedge->nodeType() == AnimatedCycleNode::InbetweenOpenEdgeNode))
         {
-            qWarning("Warning: sampling (partially) failed: wrong node type");
+            plan.warning = "Warning: sampling (partially) failed: wrong node type";
             return;
         }
 
@@ -916,30 +1028,11 @@ void AnimatedCycle::sample(Time time, QList<Eigen::Vector2d> & out)
             if(!(openHalfedge->nodeType() == AnimatedCycleNode::KeyOpenEdgeNode ||
                    openHalfedge->nodeType() == AnimatedCycleNode::InbetweenOpenEdgeNode))
             {
-                qWarning("Warning: sampling (partially) failed: wrong node type");
+                plan.warning = "Warning: sampling (partially) failed: wrong node type";
                 return;
             }
 
-            if(openHalfedge->nodeType() == AnimatedCycleNode::KeyOpenEdgeNode)
-            {
-                QList<Eigen::Vector2d> sampling = openHalfedge->cell()->toKeyEdge()->geometry()->sampling();
-                if(openHalfedge->side())
-                    for(int i=0; i<sampling.size()-1; ++i) // -1 because we don't want to duplicate last sample
-                        out << sampling[i];
-                else
-                    for(int i=sampling.size()-1; i>0; --i) // -1 because we don't want to duplicate last sample
-                        out << sampling[i];
-            }
-            else if(openHalfedge->nodeType() == AnimatedCycleNode::InbetweenOpenEdgeNode)
-            {
-                QList<Eigen::Vector2d> sampling = openHalfedge->cell()->toInbetweenEdge()->getGeometry(time);
-                if(openHalfedge->side())
-                    for(int i=0; i<sampling.size()-1; ++i) // -1 because we don't want to duplicate last sample
-                        out << sampling[i];
-                else
-                    for(int i=sampling.size()-1; i>0; --i) // -1 because we don't want to duplicate last sample
-                        out << sampling[i];
-            }
+            plan.nodes << openHalfedge;
 
             // Go next two times, i.e.:
             //  openHalfedge = openHalfedge->next(time)->next(time);
@@ -947,13 +1040,13 @@ void AnimatedCycle::sample(Time time, QList<Eigen::Vector2d> & out)
             openHalfedge = openHalfedge->next(time);
             if(!openHalfedge)
             {
-                qWarning("Warning: sampling (partially) failed: no next node found");
+                plan.warning = "Warning: sampling (partially) failed: no next node found";
                 return;
             }
             openHalfedge = openHalfedge->next(time);
             if(!openHalfedge)
             {
-                qWarning("Warning: sampling (partially) failed: no next node found");
+                plan.warning = "Warning: sampling (partially) failed: no next node found";
                 return;
             }
         }
@@ -966,7 +1059,7 @@ void AnimatedCycle::sample(Time time, QList<Eigen::Vector2d> & out)
         if(!(node->nodeType() == AnimatedCycleNode::KeyClosedEdgeNode ||
                node->nodeType() == AnimatedCycleNode::InbetweenClosedEdgeNode))
         {
-            qWarning("Warning: sampling (partially) failed: wrong node type");
+            plan.warning = "Warning: sampling (partially) failed: wrong node type";
             return;
         }
 
@@ -980,21 +1073,15 @@ void AnimatedCycle::sample(Time time, QList<Eigen::Vector2d> & out)
                 //assert(closedHalfedge->nodeType() == AnimatedCycleNode::KeyClosedEdgeNode);
                 if(closedHalfedge->nodeType() != AnimatedCycleNode::KeyClosedEdgeNode)
                 {
-                    qWarning("Warning: sampling (partially) failed: wrong node type");
+                    plan.warning = "Warning: sampling (partially) failed: wrong node type";
                     return;
                 }
-                QList<Eigen::Vector2d> sampling = closedHalfedge->cell()->toKeyEdge()->geometry()->sampling();
-                if(closedHalfedge->side())
-                    for(int i=0; i<sampling.size()-1; ++i) // -1 because we don't want to duplicate last sample
-                        out << sampling[i];
-                else
-                    for(int i=sampling.size()-1; i>0; --i) // -1 because we don't want to duplicate last sample
-                        out << sampling[i];
+                plan.nodes << closedHalfedge;
 
                 closedHalfedge = closedHalfedge->next(time);
                 if(!closedHalfedge)
                 {
-                    qWarning("Warning: sampling (partially) failed: no next node found");
+                    plan.warning = "Warning: sampling (partially) failed: no next node found";
                     return;
                 }
             }
@@ -1007,21 +1094,15 @@ void AnimatedCycle::sample(Time time, QList<Eigen::Vector2d> & out)
                 //assert(closedHalfedge->nodeType() == AnimatedCycleNode::InbetweenClosedEdgeNode);
                 if(closedHalfedge->nodeType() != AnimatedCycleNode::InbetweenClosedEdgeNode)
                 {
-                    qWarning("Warning: sampling (partially) failed: wrong node type");
+                    plan.warning = "Warning: sampling (partially) failed: wrong node type";
                     return;
                 }
-                QList<Eigen::Vector2d> sampling = closedHalfedge->cell()->toInbetweenEdge()->getGeometry(time);
-                if(closedHalfedge->side())
-                    for(int i=0; i<sampling.size()-1; ++i) // -1 because we don't want to duplicate last sample
-                        out << sampling[i];
-                else
-                    for(int i=sampling.size()-1; i>0; --i) // -1 because we don't want to duplicate last sample
-                        out << sampling[i];
+                plan.nodes << closedHalfedge;
 
                 closedHalfedge = closedHalfedge->next(time);
                 if(!closedHalfedge)
                 {
-                    qWarning("Warning: sampling (partially) failed: no next node found");
+                    plan.warning = "Warning: sampling (partially) failed: no next node found";
                     return;
                 }
             }
@@ -1035,23 +1116,15 @@ void AnimatedCycle::sample(Time time, QList<Eigen::Vector2d> & out)
         if(!(node->nodeType() == AnimatedCycleNode::KeyVertexNode ||
                node->nodeType() == AnimatedCycleNode::InbetweenVertexNode))
         {
-            qWarning("Warning: sampling (partially) failed: wrong node type");
+            plan.warning = "Warning: sampling (partially) failed: wrong node type";
             return;
         }
 
-        if(node->nodeType() == AnimatedCycleNode::KeyVertexNode)
-        {
-            out << node->cell()->toKeyVertex()->pos();
-        }
-        else
-        {
-            out << node->cell()->toInbetweenVertex()->pos(time);
-        }
+        plan.nodes << node;
     }
     else
     {
-        qWarning("Warning: sampling failed: invalid cycle");
-        return;
+        plan.warning = "Warning: sampling failed: invalid cycle";
         //assert(false && "invalid cycle");
     }
 }
@@ -1059,6 +1132,7 @@ void AnimatedCycle::sample(Time time, QList<Eigen::Vector2d> & out)
 
 void AnimatedCycle::remapPointers(VAC * newVAC)
 {
+    clearPlans_();
     foreach(AnimatedCycleNode * node, nodes())
     {
         node->setCell(newVAC->getCell(node->cell()->id()));
@@ -1067,6 +1141,7 @@ void AnimatedCycle::remapPointers(VAC * newVAC)
 
 void AnimatedCycle::convertTempIdsToPointers(VAC * vac)
 {
+    clearPlans_();
     int n = tempNodes_.size();
     assert(n > 0);
 
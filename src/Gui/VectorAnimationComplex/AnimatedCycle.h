@@ -13,7 +13,10 @@
 #include "CellList.h"
 #include "../TimeDef.h"
 #include "Eigen.h"
+#include "EdgeSample.h"
 #include <QList>
+#include <QMap>
+#include <vector>
 
 ////////////// Forward declare global serialization operators /////////////////
 
@@ -100,7 +103,7 @@ public:
     void setFirst(AnimatedCycleNode  * node);
 
     // Find a node at particular time
-    AnimatedCycleNode  * getNode(Time time);
+    AnimatedCycleNode  * getNode(Time time) const;
 
     // Find all noded refering to particular cell
     QSet<AnimatedCycleNode*> getNodes(Cell * cell);
@@ -114,7 +117,7 @@ public:
     KeyCellSet afterCells() const; // temporal boundary of n->after == NULL
 
     // Geometry
-    void sample(Time time, QList<Eigen::Vector2d> & out);
+    void sample(Time time, Vector2dVector & out) const;
 
     // Replace pointed vertex
     void replaceVertex(KeyVertex * oldVertex, KeyVertex * newVertex);
@@ -142,6 +145,25 @@ private:
 
     AnimatedCycleNode * first_;
 
+    // Traversal plans: the nodes visited by sample(), in order, cached for
+    // each time interval between the key times of the cells of the cycle,
+    // where the cells existing (and therefore the traversal) do not change.
+    // Intervals are indexed by 2*k for the open interval just before the
+    // k-th key time and by 2*k+1 for the key time itself. Plans are cleared
+    // whenever the nodes change, and when Cell::topologyVersion() changes
+    // since the key times of the cells may have changed
+    struct TraversalPlan
+    {
+        QList<AnimatedCycleNode*> nodes;
+        const char * warning; // not null if the traversal (partially) failed
+    };
+    mutable std::vector<Time> planTimes_;
+    mutable QMap<int, TraversalPlan> plans_;
+    mutable unsigned int plansVersion_;
+    void clearPlans_();
+    TraversalPlan traversalPlan_(Time time) const;
+    void computeTraversalPlan_(Time time, TraversalPlan & plan) const;
+
     // for unserialization
     friend class InbetweenFace;
     struct TempNode { int cell, previous, next, before, after; bool side; };
@@ -13,6 +13,7 @@
 #include "VAC.h"
 
 #include <assert.h>
+#include <algorithm>
 
 namespace VectorAnimationComplex
 {
@@ -107,17 +108,34 @@ InbetweenVertex * AnimatedVertex::operator[] (int i) const
 
 Eigen::Vector2d AnimatedVertex::pos(Time time) const
 {
-    VertexCellSet set = vertices();
-    set << beforeVertex() << afterVertex();
-    foreach(VertexCell * v, set)
+    // Inbetween vertices are sorted in time: find the last one starting at
+    // or before the given time, then the vertex of the chain existing at
+    // that time is either its before vertex, itself, or its after vertex
+    int i = std::upper_bound(inbetweenVertices_.begin(), inbetweenVertices_.end(), time,
+                             [](const Time & t, InbetweenVertex * v) { return t < v->beforeTime(); })
+            - inbetweenVertices_.begin() - 1;
+    if(i >= 0)
     {
-        if(v->exists(time))
+        InbetweenVertex * v = inbetweenVertices_[i];
+        if(v->beforeVertex()->exists(time))
+            return v->beforeVertex()->pos(time);
+        else if(v->exists(time))
             return v->pos(time);
+        else if(v->afterVertex()->exists(time))
+            return v->afterVertex()->pos(time);
     }
     assert(false && "no vertices at requested time");
     return Eigen::Vector2d(0,0);
 }
 
+void AnimatedVertex::pos(const std::vector<double> & times,
+                         std::vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d> > & out) const
+{
+    out.resize(times.size());
+    for(size_t i=0; i<times.size(); ++i)
+        out[i] = pos(Time(times[i]));
+}
+
 void AnimatedVertex::remapPointers(VAC * newVAC)
 {
     for(int i=0; i<inbetweenVertices_.size(); ++i)
@@ -46,6 +46,8 @@ public:
 
     // geometry
     Eigen::Vector2d pos(Time time) const;
+    void pos(const std::vector<double> & times,
+             std::vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d> > & out) const;
 
     // serialization and copy
     void remapPointers(VAC * newVAC);
@@ -0,0 +1,727 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#include "BezierSpline.h"
+
+#include "../XmlStreamWriter.h"
+#include "../IO/BinaryContainer.h"
+#include "../NumberParser.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace VectorAnimationComplex
+{
+
+namespace
+{
+
+// Max distance between the segments and their flattening, in scene units.
+// Zoomed out, the flattening is simplified further (see
+// EdgeCell::triangles(time, levelOfDetail)).
+const double FLATTENING_TOLERANCE = 0.05;
+const int MAX_FLATTENING_DEPTH = 16;
+
+// Newton iterations refining the parameters of samples while fitting, and
+// of closest points
+const int MAX_NEWTON_ITERATIONS = 4;
+
+Eigen::Vector2d xy(const EdgeSample & p)
+{
+    return Eigen::Vector2d(p.x(), p.y());
+}
+
+// Point, first and second derivatives of the segment p[0..3] at t
+EdgeSample bezierPoint(const EdgeSample * p, double t)
+{
+    double u = 1 - t;
+    return p[0]*(u*u*u) + p[1]*(3*u*u*t) + p[2]*(3*u*t*t) + p[3]*(t*t*t);
+}
+
+Eigen::Vector2d bezierDer(const EdgeSample * p, double t)
+{
+    double u = 1 - t;
+    return 3 * (u*u*xy(p[1]-p[0]) + 2*u*t*xy(p[2]-p[1]) + t*t*xy(p[3]-p[2]));
+}
+
+Eigen::Vector2d bezierDer2(const EdgeSample * p, double t)
+{
+    return 6 * ((1-t)*xy(p[2]-p[1]*2+p[0]) + t*xy(p[3]-p[2]*2+p[1]));
+}
+
+// One Newton step minimizing the distance between q and the segment at t
+double newtonStep(const EdgeSample * p, double t, const Eigen::Vector2d & q)
+{
+    Eigen::Vector2d d = xy(bezierPoint(p, t)) - q;
+    Eigen::Vector2d d1 = bezierDer(p, t);
+    Eigen::Vector2d d2 = bezierDer2(p, t);
+    double numerator = d.dot(d1);
+    double denominator = d1.dot(d1) + d.dot(d2);
+    if(std::abs(denominator) < 1e-12)
+        return t;
+    return t - numerator / denominator;
+}
+
+// Whether the segment is within tolerance of its chord, in position and
+// half width
+bool isFlat(const EdgeSample * p, double tolerance)
+{
+    Eigen::Vector2d a = xy(p[0]);
+    Eigen::Vector2d chord = xy(p[3]) - a;
+    double chordLength = chord.norm();
+    for(int i=1; i<3; ++i)
+    {
+        Eigen::Vector2d v = xy(p[i]) - a;
+        double d = chordLength > 1e-10 ?
+                    std::abs(chord[0]*v[1] - chord[1]*v[0]) / chordLength :
+                    v.norm();
+        double w = p[0].width() + (p[3].width() - p[0].width()) * i / 3.0;
+        if(d > tolerance || 0.5 * std::abs(p[i].width() - w) > tolerance)
+            return false;
+    }
+    return true;
+}
+
+// Appends the flattening of the segment p[0..3], spanning [t0, t1] of
+// segment i, except its first sample
+void flattenSegment(const EdgeSample * p, int i, double t0, double t1, int depth,
+                    EdgeSampleVector & out, std::vector<double> & params)
+{
+    if(depth < MAX_FLATTENING_DEPTH && !isFlat(p, FLATTENING_TOLERANCE))
+    {
+        // De Casteljau
+        EdgeSample p01 = p[0].lerp(0.5, p[1]);
+        EdgeSample p12 = p[1].lerp(0.5, p[2]);
+        EdgeSample p23 = p[2].lerp(0.5, p[3]);
+        EdgeSample p012 = p01.lerp(0.5, p12);
+        EdgeSample p123 = p12.lerp(0.5, p23);
+        EdgeSample mid = p012.lerp(0.5, p123);
+        EdgeSample left[4] = {p[0], p01, p012, mid};
+        EdgeSample right[4] = {mid, p123, p23, p[3]};
+        double tm = 0.5 * (t0 + t1);
+        flattenSegment(left, i, t0, tm, depth+1, out, params);
+        flattenSegment(right, i, tm, t1, depth+1, out, params);
+    }
+    else
+    {
+        out.push_back(p[3]);
+        params.push_back(i + t1);
+    }
+}
+
+// Least-squares cubic Bezier fitting of samples, as in P. J. Schneider,
+// "An Algorithm for Automatically Fitting Digitized Curves", Graphics Gems,
+// 1990, with widths fitted the same way as positions
+class Fitter
+{
+public:
+    Fitter(const EdgeSampleVector & samples, double tolerance) :
+        d_(samples), tolerance_(tolerance) {}
+
+    // Appends the control points of the segments fitted to samples
+    // [first, last], except the first one, given the unit tangents at both
+    // ends, pointing inwards
+    void fit(int first, int last,
+             const Eigen::Vector2d & tHat1, const Eigen::Vector2d & tHat2,
+             EdgeSampleVector & out)
+    {
+        EdgeSample bezier[4];
+
+        // Two samples: heuristic
+        if(last - first == 1)
+        {
+            double dist = (xy(d_[last]) - xy(d_[first])).norm() / 3.0;
+            straightBezier_(first, last, tHat1, tHat2, dist, bezier);
+            append_(bezier, out);
+            return;
+        }
+
+        // Parameterize samples, and attempt to fit a segment
+        std::vector<double> u = chordLengthParameterize_(first, last);
+        generateBezier_(first, last, u, tHat1, tHat2, bezier);
+        int splitPoint;
+        double maxError = computeMaxError_(first, last, bezier, u, splitPoint);
+        if(maxError < tolerance_)
+        {
+            append_(bezier, out);
+            return;
+        }
+
+        // If the error is not too large, reparameterize and try again
+        if(maxError < 4 * tolerance_)
+        {
+            for(int i=0; i<MAX_NEWTON_ITERATIONS; ++i)
+            {
+                reparameterize_(first, last, bezier, u);
+                generateBezier_(first, last, u, tHat1, tHat2, bezier);
+                maxError = computeMaxError_(first, last, bezier, u, splitPoint);
+                if(maxError < tolerance_)
+                {
+                    append_(bezier, out);
+                    return;
+                }
+            }
+        }
+
+        // Fitting failed: split at the point of max error and fit recursively
+        Eigen::Vector2d tHatCenter = xy(d_[splitPoint-1]) - xy(d_[splitPoint+1]);
+        if(tHatCenter.norm() < 1e-10)
+            tHatCenter = xy(d_[splitPoint-1]) - xy(d_[splitPoint]);
+        tHatCenter.normalize();
+        fit(first, splitPoint, tHat1, tHatCenter, out);
+        fit(splitPoint, last, -tHatCenter, tHat2, out);
+    }
+
+private:
+    const EdgeSampleVector & d_;
+    double tolerance_;
+
+    static void append_(const EdgeSample * bezier, EdgeSampleVector & out)
+    {
+        out.push_back(bezier[1]);
+        out.push_back(bezier[2]);
+        out.push_back(bezier[3]);
+    }
+
+    void straightBezier_(int first, int last,
+                         const Eigen::Vector2d & tHat1, const Eigen::Vector2d & tHat2,
+                         double dist, EdgeSample * bezier) const
+    {
+        const EdgeSample & p0 = d_[first];
+        const EdgeSample & p3 = d_[last];
+        Eigen::Vector2d p1 = xy(p0) + tHat1 * dist;
+        Eigen::Vector2d p2 = xy(p3) + tHat2 * dist;
+        bezier[0] = p0;
+        bezier[1] = EdgeSample(p1[0], p1[1], p0.width() + (p3.width() - p0.width()) / 3.0);
+        bezier[2] = EdgeSample(p2[0], p2[1], p0.width() + (p3.width() - p0.width()) * 2.0 / 3.0);
+        bezier[3] = p3;
+    }
+
+    std::vector<double> chordLengthParameterize_(int first, int last) const
+    {
+        std::vector<double> u(last - first + 1);
+        u[0] = 0;
+        for(int i=first+1; i<=last; ++i)
+            u[i-first] = u[i-first-1] + (xy(d_[i]) - xy(d_[i-1])).norm();
+        double total = u.back();
+        for(double & ui: u)
+            ui = total > 0 ? ui / total : 0;
+        return u;
+    }
+
+    void generateBezier_(int first, int last, const std::vector<double> & u,
+                         const Eigen::Vector2d & tHat1, const Eigen::Vector2d & tHat2,
+                         EdgeSample * bezier) const
+    {
+        const EdgeSample & p0 = d_[first];
+        const EdgeSample & p3 = d_[last];
+        Eigen::Vector2d v0 = xy(p0);
+        Eigen::Vector2d v3 = xy(p3);
+
+        // Positions: find the distances alpha1 and alpha2 of the inner
+        // control points along the tangents
+        double c00 = 0, c01 = 0, c11 = 0, x0 = 0, x1 = 0;
+        // Widths: find the inner widths w1 and w2
+        double b11 = 0, b12 = 0, b22 = 0, y1 = 0, y2 = 0;
+        for(int i=first; i<=last; ++i)
+        {
+            double t = u[i-first];
+            double s = 1 - t;
+            double B0 = s*s*s, B1 = 3*s*s*t, B2 = 3*s*t*t, B3 = t*t*t;
+            Eigen::Vector2d A1 = tHat1 * B1;
+            Eigen::Vector2d A2 = tHat2 * B2;
+            c00 += A1.dot(A1);
+            c01 += A1.dot(A2);
+            c11 += A2.dot(A2);
+            Eigen::Vector2d tmp = xy(d_[i]) - (v0 * (B0 + B1) + v3 * (B2 + B3));
+            x0 += A1.dot(tmp);
+            x1 += A2.dot(tmp);
+
+            double r = d_[i].width() - B0 * p0.width() - B3 * p3.width();
+            b11 += B1*B1;
+            b12 += B1*B2;
+            b22 += B2*B2;
+            y1 += B1*r;
+            y2 += B2*r;
+        }
+
+        double segLength = (v3 - v0).norm();
+        double det = c00*c11 - c01*c01;
+        double alpha1 = std::abs(det) > 1e-12 ? (x0*c11 - x1*c01) / det : 0;
+        double alpha2 = std::abs(det) > 1e-12 ? (c00*x1 - c01*x0) / det : 0;
+
+        // Degenerate or negative distances: fall back on the heuristic
+        double epsilon = 1e-6 * segLength;
+        if(alpha1 < epsilon || alpha2 < epsilon)
+        {
+            straightBezier_(first, last, tHat1, tHat2, segLength / 3.0, bezier);
+        }
+        else
+        {
+            Eigen::Vector2d v1 = v0 + tHat1 * alpha1;
+            Eigen::Vector2d v2 = v3 + tHat2 * alpha2;
+            bezier[0] = p0;
+            bezier[1] = EdgeSample(v1[0], v1[1], 0);
+            bezier[2] = EdgeSample(v2[0], v2[1], 0);
+            bezier[3] = p3;
+        }
+
+        double detW = b11*b22 - b12*b12;
+        if(std::abs(detW) > 1e-12)
+        {
+            bezier[1].setWidth(std::max(0.0, (y1*b22 - y2*b12) / detW));
+            bezier[2].setWidth(std::max(0.0, (b11*y2 - b12*y1) / detW));
+        }
+        else
+        {
+            bezier[1].setWidth(p0.width() + (p3.width() - p0.width()) / 3.0);
+            bezier[2].setWidth(p0.width() + (p3.width() - p0.width()) * 2.0 / 3.0);
+        }
+    }
+
+    double computeMaxError_(int first, int last, const EdgeSample * bezier,
+                            const std::vector<double> & u, int & splitPoint) const
+    {
+        splitPoint = (first + last + 1) / 2;
+        double maxError = 0;
+        for(int i=first+1; i<last; ++i)
+        {
+            EdgeSample p = bezierPoint(bezier, u[i-first]);
+            double error = std::max((xy(p) - xy(d_[i])).norm(),
+                                    0.5 * std::abs(p.width() - d_[i].width()));
+            if(error >= maxError)
+            {
+                maxError = error;
+                splitPoint = i;
+            }
+        }
+        return maxError;
+    }
+
+    void reparameterize_(int first, int last, const EdgeSample * bezier,
+                         std::vector<double> & u) const
+    {
+        for(int i=first; i<=last; ++i)
+            u[i-first] = std::min(1.0, std::max(0.0, newtonStep(bezier, u[i-first], xy(d_[i]))));
+    }
+};
+
+}
+
+BezierSpline::BezierSpline(const EdgeSampleVector & controlPoints, bool loop, double ds) :
+    controlPoints_(controlPoints),
+    denseDs_(ds),
+    isFlattened_(false),
+    sculptS_(-1),
+    dragAndDrop_lastDx_(0),
+    dragAndDrop_lastDy_(0)
+{
+    if(loop)
+        makeLoop();
+}
+
+BezierSpline * BezierSpline::fit(const SculptCurve::Curve<EdgeSample> & curve,
+                                 double tolerance, bool loop)
+{
+    // Samples, without duplicates which would have no parameter of their own
+    EdgeSampleVector samples;
+    samples.reserve(curve.size());
+    for(int i=0; i<curve.size(); ++i)
+    {
+        EdgeSample p = curve[i];
+        if(samples.empty() || (xy(p) - xy(samples.back())).norm() > 1e-10)
+            samples.push_back(p);
+    }
+    if(loop && samples.size() > 1)
+        samples.back() = samples.front();
+    const int n = samples.size();
+    if(n < 2 || (loop && n < 4))
+        return 0;
+
+    // Tangents at both ends. Loops are smooth at their first sample.
+    Eigen::Vector2d tHat1 = xy(samples[1]) - xy(samples[0]);
+    Eigen::Vector2d tHat2 = xy(samples[n-2]) - xy(samples[n-1]);
+    if(loop)
+    {
+        tHat1 = xy(samples[1]) - xy(samples[n-2]);
+        tHat2 = -tHat1;
+    }
+    if(tHat1.norm() < 1e-10 || tHat2.norm() < 1e-10)
+        return 0;
+    tHat1.normalize();
+    tHat2.normalize();
+
+    EdgeSampleVector controlPoints;
+    controlPoints.push_back(samples[0]);
+    Fitter(samples, tolerance).fit(0, n-1, tHat1, tHat2, controlPoints);
+
+    return new BezierSpline(controlPoints, loop, curve.ds());
+}
+
+BezierSpline::BezierSpline(const QStringRef & str) :
+    denseDs_(5.0),
+    isFlattened_(false),
+    sculptS_(-1),
+    dragAndDrop_lastDx_(0),
+    dragAndDrop_lastDy_(0)
+{
+    // Same format as LinearSpline, see LinearSpline(str)
+    NumberParser parser(str);
+    QVector<double> d;
+    double x;
+    while(parser.readDouble(x))
+        d << x;
+    setData_(d);
+}
+
+BezierSpline::BezierSpline(const QVector<double> & d) :
+    denseDs_(5.0),
+    isFlattened_(false),
+    sculptS_(-1),
+    dragAndDrop_lastDx_(0),
+    dragAndDrop_lastDy_(0)
+{
+    setData_(d);
+}
+
+void BezierSpline::setData_(const QVector<double> & d)
+{
+    controlPoints_.clear();
+    if(d.size() < 1)
+        return;
+
+    denseDs_ = d[0];
+    int n = (d.size()-1)/3;
+    controlPoints_.reserve(n);
+    for(int i=0; i<n; i++)
+        controlPoints_.push_back(EdgeSample(d[3*i+1], d[3*i+2], d[3*i+3]));
+
+    // Drop trailing control points of an incomplete segment
+    if(!controlPoints_.empty())
+        controlPoints_.resize(3 * numSegments() + 1);
+    clearFlattening_();
+}
+
+BezierSpline::~BezierSpline()
+{
+}
+
+BezierSpline * BezierSpline::clone()
+{
+    return new BezierSpline(*this);
+}
+
+LinearSpline * BezierSpline::toDenseLinearSpline() const
+{
+    SculptCurve::Curve<EdgeSample> curve(denseDs_);
+    curve.setVertices(flattening().edgeSampling());
+    curve.resample(true);
+    return new LinearSpline(std::move(curve), isClosed());
+}
+
+void BezierSpline::makeLoop_()
+{
+    if(controlPoints_.size() > 1)
+        controlPoints_.back() = controlPoints_.front();
+    clearFlattening_();
+}
+
+// ---------------------- Flattening ------------------------
+
+void BezierSpline::clearFlattening_()
+{
+    isFlattened_ = false;
+    flattening_ = LinearSpline();
+    flatteningParams_.clear();
+    clearSampling();
+}
+
+const LinearSpline & BezierSpline::flattening() const
+{
+    if(!isFlattened_)
+    {
+        EdgeSampleVector samples;
+        std::vector<double> params;
+        if(!controlPoints_.empty())
+        {
+            samples.push_back(controlPoints_[0]);
+            params.push_back(0);
+        }
+        for(int i=0; i<numSegments(); ++i)
+            flattenSegment(&controlPoints_[3*i], i, 0, 1, 0, samples, params);
+
+        flattening_ = LinearSpline(samples);
+        if(isClosed())
+            flattening_.makeLoop();
+        flatteningParams_.swap(params);
+        isFlattened_ = true;
+    }
+    return flattening_;
+}
+
+// ---------------------- Drawing ------------------------
+
+void BezierSpline::draw()
+{
+    flattening();
+    flattening_.draw();
+}
+
+void BezierSpline::draw(double width)
+{
+    flattening();
+    flattening_.draw(width);
+}
+
+void BezierSpline::triangulate(Triangles & triangles)
+{
+    flattening();
+    flattening_.triangulate(triangles);
+}
+
+void BezierSpline::triangulate(double width, Triangles & triangles)
+{
+    flattening();
+    flattening_.triangulate(width, triangles);
+}
+
+EdgeSampleVector BezierSpline::strokeSampling() const
+{
+    return flattening().strokeSampling();
+}
+
+void BezierSpline::exportSVG(SvgStreamWriter & out)
+{
+    flattening();
+    flattening_.exportSVG(out);
+}
+
+// ---------------------- Geometry ------------------------
+
+EdgeSample BezierSpline::leftPos() const
+{
+    return controlPoints_.empty() ? EdgeSample() : controlPoints_.front();
+}
+
+EdgeSample BezierSpline::rightPos() const
+{
+    return controlPoints_.empty() ? EdgeSample() : controlPoints_.back();
+}
+
+EdgeSampleVector BezierSpline::edgeSampling() const
+{
+    return flattening().edgeSampling();
+}
+
+EdgeSample BezierSpline::pos(double s) const
+{
+    if(controlPoints_.empty())
+        return EdgeSample();
+    return flattening().pos(s);
+}
+
+void BezierSpline::pos(const std::vector<double> & ss, EdgeSampleVector & out) const
+{
+    if(controlPoints_.empty())
+    {
+        EdgeGeometry::pos(ss, out);
+        return;
+    }
+    flattening().pos(ss, out);
+}
+
+Eigen::Vector2d BezierSpline::der(double s)
+{
+    if(controlPoints_.empty())
+        return Eigen::Vector2d(1,0);
+    flattening();
+    return flattening_.der(s);
+}
+
+double BezierSpline::length() const
+{
+    if(controlPoints_.empty())
+        return 0;
+    return flattening().length();
+}
+
+EdgeGeometry * BezierSpline::trimmed(double from, double to)
+{
+    flattening();
+    return flattening_.trimmed(from, to);
+}
+
+// --------------------- Manipulating --------------------------
+
+void BezierSpline::setLeftRightPos(const Eigen::Vector2d & left,
+                                   const Eigen::Vector2d & right)
+{
+    if(isClosed() || controlPoints_.size() < 2)
+        return;
+
+    // Move each control point by an interpolation of the displacements of
+    // the end points, so that tangents follow
+    Eigen::Vector2d dLeft = left - xy(controlPoints_.front());
+    Eigen::Vector2d dRight = right - xy(controlPoints_.back());
+    const int n = controlPoints_.size();
+    for(int i=0; i<n; ++i)
+    {
+        double u = (double) i / (n-1);
+        Eigen::Vector2d p = xy(controlPoints_[i]) + (1-u) * dLeft + u * dRight;
+        controlPoints_[i].setX(p[0]);
+        controlPoints_[i].setY(p[1]);
+    }
+    clearFlattening_();
+}
+
+void BezierSpline::setWidth(double newWidth)
+{
+    for(EdgeSample & p: controlPoints_)
+        p.setWidth(newWidth);
+    clearFlattening_();
+}
+
+double BezierSpline::updateSculpt(double x, double y, double radius)
+{
+    ClosestVertexInfo cvi = closestPoint(x, y);
+    if(cvi.d > radius)
+    {
+        sculptS_ = -1;
+        return std::numeric_limits<double>::infinity();
+    }
+    sculptS_ = cvi.s;
+    sculptVertex_ = cvi.p;
+    return cvi.d;
+}
+
+EdgeSample BezierSpline::sculptVertex() const
+{
+    return sculptS_ >= 0 ? sculptVertex_ : EdgeSample();
+}
+
+double BezierSpline::arclengthOfSculptVertex() const
+{
+    return sculptS_ >= 0 ? sculptS_ : 0;
+}
+
+void BezierSpline::prepareDragAndDrop()
+{
+    dragAndDrop_lastDx_ = 0;
+    dragAndDrop_lastDy_ = 0;
+}
+
+void BezierSpline::performDragAndDrop(double dx, double dy)
+{
+    EdgeSample delta(dx-dragAndDrop_lastDx_, dy-dragAndDrop_lastDy_, 0);
+    for(EdgeSample & p: controlPoints_)
+        p = p + delta;
+    dragAndDrop_lastDx_ = dx;
+    dragAndDrop_lastDy_ = dy;
+    clearFlattening_();
+}
+
+void BezierSpline::prepareAffineTransform()
+{
+    controlPointsBeforeTransform_ = controlPoints_;
+}
+
+void BezierSpline::performAffineTransform(const Eigen::Affine2d & xf)
+{
+    // Affine transforms of Bezier segments are the Bezier segments of the
+    // transformed control points: this is exact
+    controlPoints_ = controlPointsBeforeTransform_;
+    for(EdgeSample & p: controlPoints_)
+    {
+        Eigen::Vector2d q = xf * xy(p);
+        p.setX(q[0]);
+        p.setY(q[1]);
+    }
+    clearFlattening_();
+}
+
+EdgeGeometry::ClosestVertexInfo BezierSpline::closestPoint(double x, double y)
+{
+    // Closest sample of the flattening
+    const LinearSpline & flat = flattening();
+    SculptCurve::Curve<EdgeSample>::ClosestVertex cv = flat.curve().findClosestVertex(x,y);
+    if(cv.i == -1 || numSegments() == 0)
+        return EdgeGeometry::closestPoint(x,y);
+
+    // Refined on its segment
+    const Eigen::Vector2d q(x, y);
+    const double param = flatteningParams_[cv.i];
+    const int i = std::min((int) param, numSegments() - 1);
+    const EdgeSample * p = &controlPoints_[3*i];
+    const double t0 = param - i;
+    double t = t0;
+    for(int k=0; k<MAX_NEWTON_ITERATIONS; ++k)
+        t = std::min(1.0, std::max(0.0, newtonStep(p, t, q)));
+
+    ClosestVertexInfo res;
+    res.p = bezierPoint(p, t);
+    res.d = (xy(res.p) - q).norm();
+    if(res.d > cv.d)
+    {
+        // Newton diverged: keep the sample
+        res.p = flat.curve()[cv.i];
+        res.s = flat.curve().arclength(cv.i);
+        res.d = cv.d;
+        return res;
+    }
+
+    // Arclength, from the one of the sample and the speed along the segment
+    double s = flat.curve().arclength(cv.i) + bezierDer(p, 0.5*(t+t0)).norm() * (t-t0);
+    res.s = std::min(flat.length(), std::max(0.0, s));
+    return res;
+}
+
+std::size_t BezierSpline::numBytes() const
+{
+    return EdgeGeometry::numBytes() +
+           controlPoints_.capacity() * sizeof(EdgeSample) +
+           flattening_.numBytes() +
+           flatteningParams_.capacity() * sizeof(double);
+}
+
+// ---------------------- Save and Load ------------------------
+
+void BezierSpline::write(XmlStreamWriter & xml) const
+{
+    // Binary: same data as text, stored in a binary block
+    QByteArray * blocks = xml.binaryBlocks();
+    if(blocks)
+    {
+        QVector<double> d;
+        d.reserve(1 + 3*controlPoints_.size());
+        d << denseDs_;
+        for(const EdgeSample & p: controlPoints_)
+            d << p.x() << p.y() << p.width();
+
+        qint64 offset = BinaryContainer::appendDoubles(*blocks, d);
+        xml.writeAttribute("curve", QString("bezierblock(%1 %2)").arg(offset).arg(d.size()));
+        return;
+    }
+
+    xml.writeStartAttribute("curve");
+    xml.writeAttributeChars("bezier(");
+    xml.writeAttributeDouble(denseDs_);
+    for(const EdgeSample & p: controlPoints_)
+    {
+        xml.writeAttributeChars(" ");
+        xml.writeAttributeDouble(p.x());
+        xml.writeAttributeChars(",");
+        xml.writeAttributeDouble(p.y());
+        xml.writeAttributeChars(",");
+        xml.writeAttributeDouble(p.width());
+    }
+    xml.writeAttributeChars(")");
+    xml.writeEndAttribute();
+}
+
+}
@@ -0,0 +1,138 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#ifndef VAC_BEZIER_SPLINE_H
+#define VAC_BEZIER_SPLINE_H
+
+// BezierSpline: edge geometry made of cubic Bezier segments, whose control
+// points (position and width) are the authoritative data. A sketched stroke
+// of hundreds of samples is typically a handful of segments, which is what
+// is saved, as:
+//
+//     curve="bezier(ds x0,y0,w0 x1,y1,w1 x2,y2,w2 x3,y3,w3 ...)"
+//
+// i.e. 3n+1 control points for n segments, the last one of a segment being
+// the first one of the next. Closed edges end with their first control
+// point. ds is the sampling of the LinearSpline the edge was fitted from.
+//
+// Drawing and arclength queries use a flattening of the segments, computed
+// on demand: adaptive, so that straight parts have few samples whatever
+// their length. Closest point queries are refined on the segments
+// themselves.
+//
+// Affine transforms and drag and drop are applied to the control points,
+// which is exact. Operations editing samples (cutting, gluing, sculpting)
+// require a LinearSpline: see toDenseLinearSpline() and
+// KeyEdge::editLinearSpline().
+
+#include "EdgeGeometry.h"
+
+#include <vector>
+
+namespace VectorAnimationComplex
+{
+
+class BezierSpline final: public EdgeGeometry
+{
+public:
+    // Control points, 3n+1 for n segments
+    BezierSpline(const EdgeSampleVector & controlPoints, bool loop = false, double ds = 5.0);
+
+    // Fits cubic Bezier segments to the samples of the curve, so that the
+    // samples are at most tolerance away from them, and their width at most
+    // twice the tolerance. Returns null if the curve has too few samples.
+    static BezierSpline * fit(const SculptCurve::Curve<EdgeSample> & curve,
+                              double tolerance, bool loop = false);
+
+    // curve data from XML, without the type, or already parsed
+    BezierSpline(const QStringRef & str);
+    BezierSpline(const QVector<double> & d);
+
+    virtual ~BezierSpline();
+
+    BezierSpline * clone();
+
+    // Samples at ds, as the edge would have been without fitting
+    LinearSpline * toDenseLinearSpline() const;
+
+    const EdgeSampleVector & controlPoints() const { return controlPoints_; }
+    int numSegments() const { return (controlPoints_.size() - 1) / 3; }
+
+    virtual void draw();
+    virtual void draw(double width);
+    virtual void triangulate(Triangles & triangles);
+    virtual void triangulate(double width, Triangles & triangles);
+    virtual EdgeSampleVector strokeSampling() const;
+
+    void exportSVG(SvgStreamWriter & out);
+    QString stringType() const {return "BezierSpline";}
+
+    virtual EdgeSample leftPos() const;
+    virtual EdgeSample rightPos() const;
+    virtual EdgeSampleVector edgeSampling() const;
+
+    EdgeSample pos(double s) const;
+    void pos(const std::vector<double> & ss, EdgeSampleVector & out) const;
+    Eigen::Vector2d der(double s);
+    double length() const;
+    EdgeGeometry * trimmed(double from, double to);
+
+    void setLeftRightPos(const Eigen::Vector2d & left,
+                         const Eigen::Vector2d & right);
+    void setWidth(double newWidth);
+
+    // Sculpting: only finds the sculpt vertex, the edge is converted to a
+    // LinearSpline when sculpting starts
+    double updateSculpt(double x, double y, double radius);
+    EdgeSample sculptVertex() const;
+    double arclengthOfSculptVertex() const;
+
+    // loop drag and drop
+    void prepareDragAndDrop();
+    void performDragAndDrop(double dx, double dy);
+    // affine transform
+    void prepareAffineTransform();
+    void performAffineTransform(const Eigen::Affine2d & xf);
+
+    ClosestVertexInfo closestPoint(double x, double y);
+
+    std::size_t numBytes() const;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+protected:
+    void write(XmlStreamWriter & xml) const;
+
+private:
+    EdgeSampleVector controlPoints_;
+    double denseDs_;
+
+    // Flattening, and for each of its samples, i+t for the sample at t in
+    // segment i. Cleared when control points change.
+    mutable LinearSpline flattening_;
+    mutable std::vector<double> flatteningParams_;
+    mutable bool isFlattened_;
+    const LinearSpline & flattening() const;
+    void clearFlattening_();
+
+    void setData_(const QVector<double> & d);
+    void makeLoop_();
+
+    // sculpting
+    double sculptS_;
+    EdgeSample sculptVertex_;
+
+    // affine transform and drag and drop
+    EdgeSampleVector controlPointsBeforeTransform_;
+    double dragAndDrop_lastDx_;
+    double dragAndDrop_lastDy_;
+};
+
+}
+
+#endif // VAC_BEZIER_SPLINE_H
@@ -144,6 +144,17 @@ void BoundingBox::unite(const BoundingBox & other)
     yMax_ = std::max(yMax_, other.yMax_);
 }
 
+void BoundingBox::translate(double dx, double dy)
+{
+    if (isEmpty())
+        return;
+
+    xMin_ += dx;
+    xMax_ += dx;
+    yMin_ += dy;
+    yMax_ += dy;
+}
+
 void BoundingBox::intersect(const BoundingBox & other)
 {
     // Compute intersection
@@ -241,6 +241,9 @@ public:
     void unite     (const BoundingBox & other);
     void intersect (const BoundingBox & other);
 
+    // In-place translation. Empty and infinite boxes are unchanged
+    void translate(double dx, double dy);
+
     // Returns whether the two bounding boxes intersect
     bool intersects(const BoundingBox & other) const;
     
@@ -0,0 +1,183 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#include "BoundingBoxTree.h"
+
+#include <algorithm>
+
+namespace VectorAnimationComplex
+{
+
+namespace
+{
+
+// Maximum number of items in a leaf
+const int MAX_LEAF_SIZE = 4;
+
+}
+
+BoundingBoxTree::BoundingBoxTree()
+{
+}
+
+void BoundingBoxTree::clear()
+{
+    nodes_.clear();
+    items_.clear();
+    boxes_.clear();
+    isIndexed_.clear();
+}
+
+void BoundingBoxTree::build(const std::vector<BoundingBox> & boxes)
+{
+    clear();
+    boxes_ = boxes;
+
+    // Items which can be found by queries
+    isIndexed_.assign(boxes_.size(), false);
+    for (unsigned int i=0; i<boxes_.size(); ++i)
+    {
+        if (!boxes_[i].isEmpty())
+        {
+            items_.push_back(i);
+            isIndexed_[i] = true;
+        }
+    }
+
+    // Build nodes recursively
+    if (!items_.empty())
+    {
+        nodes_.reserve(2 * items_.size() / MAX_LEAF_SIZE + 1);
+        nodes_.push_back(Node());
+        build_(0, 0, items_.size());
+    }
+}
+
+void BoundingBoxTree::build_(int nodeIndex, int first, int count)
+{
+    // Compute bounding box of node, and of the centers of its items
+    BoundingBox boundingBox;
+    BoundingBox centers;
+    for (int i=first; i<first+count; ++i)
+    {
+        const BoundingBox & bb = boxes_[items_[i]];
+        boundingBox.unite(bb);
+        centers.unite(BoundingBox(bb.xMid(), bb.yMid()));
+    }
+    nodes_[nodeIndex].boundingBox = boundingBox;
+
+    // Leaf
+    if (count <= MAX_LEAF_SIZE || centers.width() + centers.height() == 0)
+    {
+        nodes_[nodeIndex].first = first;
+        nodes_[nodeIndex].count = count;
+        return;
+    }
+
+    // Split at the median along the largest dimension
+    const bool splitAlongX = centers.width() > centers.height();
+    const std::vector<BoundingBox> & boxes = boxes_;
+    std::vector<int>::iterator begin = items_.begin() + first;
+    std::vector<int>::iterator end = begin + count;
+    std::vector<int>::iterator middle = begin + count/2;
+    if (splitAlongX)
+    {
+        std::nth_element(begin, middle, end, [&boxes](int i, int j)
+            { return boxes[i].xMid() < boxes[j].xMid(); });
+    }
+    else
+    {
+        std::nth_element(begin, middle, end, [&boxes](int i, int j)
+            { return boxes[i].yMid() < boxes[j].yMid(); });
+    }
+
+    // Recurse. Note: nodes_ may be reallocated, so only indices are kept
+    const int childIndex = nodes_.size();
+    nodes_.push_back(Node());
+    nodes_.push_back(Node());
+    nodes_[nodeIndex].first = childIndex;
+    nodes_[nodeIndex].count = 0;
+    build_(childIndex, first, count/2);
+    build_(childIndex+1, first + count/2, count - count/2);
+}
+
+bool BoundingBoxTree::setBoundingBox(int item, const BoundingBox & box)
+{
+    if (!isIndexed_[item] && !box.isEmpty())
+        return false;
+
+    boxes_[item] = box;
+    return true;
+}
+
+void BoundingBoxTree::refit()
+{
+    // Children are always after their parent
+    for (int k=nodes_.size()-1; k>=0; --k)
+    {
+        Node & node = nodes_[k];
+        BoundingBox boundingBox;
+        if (node.count > 0)
+        {
+            for (int i=node.first; i<node.first+node.count; ++i)
+                boundingBox.unite(boxes_[items_[i]]);
+        }
+        else
+        {
+            boundingBox.unite(nodes_[node.first].boundingBox);
+            boundingBox.unite(nodes_[node.first+1].boundingBox);
+        }
+        node.boundingBox = boundingBox;
+    }
+}
+
+BoundingBox BoundingBoxTree::boundingBox() const
+{
+    return nodes_.empty() ? BoundingBox() : nodes_[0].boundingBox;
+}
+
+std::size_t BoundingBoxTree::numBytes() const
+{
+    return nodes_.capacity() * sizeof(Node) +
+           items_.capacity() * sizeof(int) +
+           boxes_.capacity() * sizeof(BoundingBox) +
+           isIndexed_.capacity() * sizeof(char);
+}
+
+void BoundingBoxTree::query(const BoundingBox & rect, std::vector<int> & out) const
+{
+    if (nodes_.empty() || rect.isEmpty())
+        return;
+
+    std::vector<int> stack;
+    stack.push_back(0);
+    while (!stack.empty())
+    {
+        const Node & node = nodes_[stack.back()];
+        stack.pop_back();
+
+        if (!node.boundingBox.intersects(rect))
+            continue;
+
+        if (node.count > 0)
+        {
+            for (int i=node.first; i<node.first+node.count; ++i)
+            {
+                if (boxes_[items_[i]].intersects(rect))
+                    out.push_back(items_[i]);
+            }
+        }
+        else
+        {
+            stack.push_back(node.first);
+            stack.push_back(node.first+1);
+        }
+    }
+}
+
+}
@@ -0,0 +1,80 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#ifndef VAC_BOUNDING_BOX_TREE_H
+#define VAC_BOUNDING_BOX_TREE_H
+
+// BoundingBoxTree: a bounding volume hierarchy over a static set of bounding
+// boxes, for fast "which boxes intersect this rect" queries. Items are
+// identified by their index in the vector of boxes given to build(). The tree
+// is built once, top-down, by splitting the items at the median of their
+// centers along the largest dimension. When a few boxes change, the tree can
+// be refit instead of rebuilt (see refit()).
+
+#include "BoundingBox.h"
+
+#include <vector>
+
+namespace VectorAnimationComplex
+{
+
+class BoundingBoxTree
+{
+public:
+    // Build an empty tree
+    BoundingBoxTree();
+
+    // Remove all items
+    void clear();
+
+    // Build the tree. Item i has bounding box boxes[i]. Items with an empty
+    // bounding box are never returned by queries.
+    void build(const std::vector<BoundingBox> & boxes);
+
+    // Append to out all items whose bounding box intersects rect, in no
+    // particular order
+    void query(const BoundingBox & rect, std::vector<int> & out) const;
+
+    // Change the bounding box of an item, without updating the nodes: call
+    // refit() once all boxes are changed. Returns false, leaving the tree
+    // unchanged, if the item had an empty bounding box when the tree was
+    // built and box is not empty, since the tree must then be rebuilt
+    bool setBoundingBox(int item, const BoundingBox & box);
+
+    // Recompute the bounding boxes of all nodes from the boxes of their
+    // items. Queries remain exact, but get slower as items move away from
+    // where they were when the tree was built
+    void refit();
+
+    // Bounding box of all items
+    BoundingBox boundingBox() const;
+
+    // Number of items in the tree, including items with an empty bounding box
+    int numItems() const { return boxes_.size(); }
+
+    // Memory used by the tree, in bytes
+    std::size_t numBytes() const;
+
+private:
+    struct Node
+    {
+        BoundingBox boundingBox;
+        int first; // leaf: index of first item in items_.  Inner: index of first child
+        int count; // leaf: number of items.                 Inner: 0
+    };
+    std::vector<Node> nodes_;
+    std::vector<int> items_;
+    std::vector<BoundingBox> boxes_;
+    std::vector<char> isIndexed_; // whether the item is in a leaf
+
+    void build_(int nodeIndex, int first, int count);
+};
+
+}
+
+#endif // VAC_BOUNDING_BOX_TREE_H
@@ -12,6 +12,8 @@
 #include <QTextStream>
 #include "../Picking.h"
 #include "../DevSettings.h"
+#include "../RenderStats.h"
+#include "../Trace.h"
 #include "../Global.h"
 
 #include "Cell.h"
@@ -27,6 +29,8 @@
 #include "InbetweenEdge.h"
 #include "InbetweenFace.h"
 #include "Algorithms.h"
+#include "GeometryCache.h"
+#include "EvaluationContext.h"
 
 #include "../ViewSettings.h"
 #include "../View3DSettings.h"
@@ -37,13 +41,19 @@
 #include "../XmlStreamWriter.h"
 
 #include "../CssColor.h"
+#include <limits>
 
 namespace VectorAnimationComplex
 {
 
 Cell::Cell(VAC * vac) :
     vac_(vac), id_(-1),
-    isHovered_(0), isSelected_(0)
+    kind_(0),
+    isHovered_(0), isSelected_(0),
+    geometryVersion_(newGeometryVersion_()),
+    geometryDependentCellsVersion_(0),
+    starVersion_(++lastStarVersion_),
+    stateVersion_(newStateVersion_())
 {
     colorHighlighted_[0] = 1;
     colorHighlighted_[1] = 0.7;
@@ -62,20 +72,74 @@ Cell::Cell(VAC * vac) :
 }
 
 Cell * Cell::toCell()                       { return this; }
-KeyCell * Cell::toKeyCell()                 { return dynamic_cast<KeyCell*>(this); }
-InbetweenCell * Cell::toInbetweenCell()     { return dynamic_cast<InbetweenCell*>(this); }
-VertexCell * Cell::toVertexCell()           { return dynamic_cast<VertexCell*>(this); }
-EdgeCell * Cell::toEdgeCell()               { return dynamic_cast<EdgeCell*>(this); }
-FaceCell * Cell::toFaceCell()               { return dynamic_cast<FaceCell*>(this); }
-KeyVertex * Cell::toKeyVertex()             { return dynamic_cast<KeyVertex*>(this); }
-KeyEdge * Cell::toKeyEdge()                 { return dynamic_cast<KeyEdge*>(this); }
-KeyFace * Cell::toKeyFace()                 { return dynamic_cast<KeyFace*>(this); }
-InbetweenVertex * Cell::toInbetweenVertex() { return dynamic_cast<InbetweenVertex*>(this); }
-InbetweenEdge * Cell::toInbetweenEdge()     { return dynamic_cast<InbetweenEdge*>(this); }
-InbetweenFace * Cell::toInbetweenFace()     { return dynamic_cast<InbetweenFace*>(this); }
+
+// Casts to intermediate classes go through the concrete class. While a cell
+// is being constructed its kind is incomplete, in which case we fall back to
+// dynamic_cast, which then behaves as expected for partially built objects.
+
+KeyCell * Cell::toKeyCell()
+{
+    switch(kind_)
+    {
+    case KeyVertexKind: return asKeyVertex_();
+    case KeyEdgeKind: return asKeyEdge_();
+    case KeyFaceKind: return asKeyFace_();
+    case InbetweenVertexKind: case InbetweenEdgeKind: case InbetweenFaceKind: return 0;
+    default: return dynamic_cast<KeyCell*>(this);
+    }
+}
+
+InbetweenCell * Cell::toInbetweenCell()
+{
+    switch(kind_)
+    {
+    case InbetweenVertexKind: return asInbetweenVertex_();
+    case InbetweenEdgeKind: return asInbetweenEdge_();
+    case InbetweenFaceKind: return asInbetweenFace_();
+    case KeyVertexKind: case KeyEdgeKind: case KeyFaceKind: return 0;
+    default: return dynamic_cast<InbetweenCell*>(this);
+    }
+}
+
+VertexCell * Cell::toVertexCell()
+{
+    switch(kind_)
+    {
+    case KeyVertexKind: return asKeyVertex_();
+    case InbetweenVertexKind: return asInbetweenVertex_();
+    case KeyEdgeKind: case KeyFaceKind: case InbetweenEdgeKind: case InbetweenFaceKind: return 0;
+    default: return dynamic_cast<VertexCell*>(this);
+    }
+}
+
+EdgeCell * Cell::toEdgeCell()
+{
+    switch(kind_)
+    {
+    case KeyEdgeKind: return asKeyEdge_();
+    case InbetweenEdgeKind: return asInbetweenEdge_();
+    case KeyVertexKind: case KeyFaceKind: case InbetweenVertexKind: case InbetweenFaceKind: return 0;
+    default: return dynamic_cast<EdgeCell*>(this);
+    }
+}
+
+FaceCell * Cell::toFaceCell()
+{
+    switch(kind_)
+    {
+    case KeyFaceKind: return asKeyFace_();
+    case InbetweenFaceKind: return asInbetweenFace_();
+    case KeyVertexKind: case KeyEdgeKind: case InbetweenVertexKind: case InbetweenEdgeKind: return 0;
+    default: return dynamic_cast<FaceCell*>(this);
+    }
+}
 
 Cell::~Cell()
 {
+    foreach(int key, triangles_.keys())
+        GeometryCache::remove(this, key);
+    deferredChangedCells_.remove(this);
+    deferredClearedCells_.remove(this);
 }
 void Cell::destroy()
 {
@@ -83,8 +147,18 @@ void Cell::destroy()
 }
 void Cell::destroyStar()
 {
-    while(!star().isEmpty())
-        (*star().begin())->destroy();
+    // Destroying a star cell removes it, and possibly others, from the lists
+    while(true)
+    {
+        if(!spatialStar_.isEmpty())
+            spatialStar_.first()->destroy();
+        else if(!temporalStarBefore_.isEmpty())
+            temporalStarBefore_.first()->destroy();
+        else if(!temporalStarAfter_.isEmpty())
+            temporalStarAfter_.first()->destroy();
+        else
+            break;
+    }
 }
 void Cell::informBoundaryImGettingDestroyed()
 {
@@ -103,14 +177,13 @@ void Cell::removeObserver(CellObserver * observer)
 
 int Cell::dimension()
 {
-    if (toKeyVertex())
-        return 0;
-    else if (toKeyEdge() || toInbetweenVertex())
-        return 1;
-    else if (toKeyFace() || toInbetweenEdge())
-        return 2;
-    else
-        return 3;
+    switch(kind_)
+    {
+    case KeyVertexKind: return 0;
+    case KeyEdgeKind: case InbetweenVertexKind: return 1;
+    case KeyFaceKind: case InbetweenEdgeKind: return 2;
+    default: return 3;
+    }
 }
 
 // Update cell boundary
@@ -150,7 +223,12 @@ void Cell::updateBoundary_impl(const KeyHalfedge & , const KeyHalfedge & ) {}
 void Cell::updateBoundary_impl(KeyEdge * , const KeyEdgeList & ) {}
 
 
-Cell::Cell(Cell * other)
+Cell::Cell(Cell * other) :
+    kind_(0),
+    geometryVersion_(newGeometryVersion_()),
+    geometryDependentCellsVersion_(0),
+    starVersion_(++lastStarVersion_),
+    stateVersion_(newStateVersion_())
 {
     vac_ = other->vac_;
     id_ = other->id_;
@@ -173,34 +251,29 @@ Cell::Cell(Cell * other)
     temporalStarAfter_ = other->temporalStarAfter_;
 }
 
+// Cells in the star may be missing from newVAC, when it only contains the
+// closure of some cells (see VAC::subcomplex()). They are then ignored.
 void Cell::remapPointers(VAC * newVAC)
 {
     vac_ = newVAC;
+    processTopologyChanged_();
 
-    {
-        CellSet old = spatialStar_;
-        spatialStar_.clear();
-        auto it = old.begin();
-        auto itEnd = old.end();
-        for(; it != itEnd; ++it)
-            spatialStar_ << newVAC->getCell((*it)->id());
-    }
-    {
-        CellSet old = temporalStarBefore_;
-        temporalStarBefore_.clear();
-        auto it = old.begin();
-        auto itEnd = old.end();
-        for(; it != itEnd; ++it)
-            temporalStarBefore_ << newVAC->getCell((*it)->id());
-    }
-    {
-        CellSet old = temporalStarAfter_;
-        temporalStarAfter_.clear();
-        auto it = old.begin();
-        auto itEnd = old.end();
-        for(; it != itEnd; ++it)
-            temporalStarAfter_ << newVAC->getCell((*it)->id());
-    }
+    remapIncidenceList_(spatialStar_, newVAC);
+    remapIncidenceList_(temporalStarBefore_, newVAC);
+    remapIncidenceList_(temporalStarAfter_, newVAC);
+}
+
+void Cell::remapIncidenceList_(CellIncidenceList & cells, VAC * newVAC)
+{
+    if(cells.isEmpty())
+        return;
+
+    CellIncidenceList old = cells;
+    cells.clear();
+    cells.reserve(old.size());
+    for(Cell * c: old)
+        if(Cell * newCell = newVAC->getCell(c->id()))
+            cells << newCell;
 }
 
 Cell * Cell::getCell(int id)
@@ -208,6 +281,10 @@ Cell * Cell::getCell(int id)
     return vac()->getCell(id);
 }
 
+void Cell::reportMemory(MemoryStats::Report & /*report*/) const
+{
+}
+
 QColor Cell::color() const
 {
     QColor res;
@@ -221,6 +298,7 @@ void Cell::setColor(const QColor & c)
     color_[1] = c.greenF();
     color_[2] = c.blueF();
     color_[3] = c.alphaF();
+    processStateChanged_();
 }
 
 bool Cell::isHighlighted() const
@@ -277,40 +355,48 @@ bool Cell::isHighlighted() const
 
 void Cell::glColorTopology_()
 {
+    QColor c = topologyColor();
+    glColor4d(c.redF(), c.greenF(), c.blueF(), c.alphaF());
+}
+
+QColor Cell::topologyColor()
+{
+    QColor res;
     if(isHighlighted())
-        glColor4dv(colorHighlighted_);
+        res.setRgbF(colorHighlighted_[0], colorHighlighted_[1], colorHighlighted_[2], colorHighlighted_[3]);
     else if(isSelected() && global()->toolMode() == Global::SELECT)
-        glColor4dv(colorSelected_);
+        res.setRgbF(colorSelected_[0], colorSelected_[1], colorSelected_[2], colorSelected_[3]);
     else
     {
         bool inbetweenOutlineDifferentColor = true;
         if(inbetweenOutlineDifferentColor)
         {
             if(toKeyVertex())
-                glColor4d(0,0.165,0.514,1);
+                res.setRgbF(0,0.165,0.514,1);
             else if(toKeyEdge())
-                glColor4d(0.18,0.60,0.90,1);
+                res.setRgbF(0.18,0.60,0.90,1);
             else if(toKeyFace())
-                glColor4d(0.75,0.90,1.00,1);
+                res.setRgbF(0.75,0.90,1.00,1);
             else if(toInbetweenVertex())
-                glColor4d(0.12,0.34,0,1);
+                res.setRgbF(0.12,0.34,0,1);
             else if(toInbetweenEdge())
-                glColor4d(0.47,0.72,0.40,1);
+                res.setRgbF(0.47,0.72,0.40,1);
             else if(toInbetweenFace())
-                glColor4d(0.94,1.00,0.91,1);
+                res.setRgbF(0.94,1.00,0.91,1);
             else // shouldn't happen
-                glColor4d(0,0,0,1);
+                res.setRgbF(0,0,0,1);
         }
         else
         {
             if(toVertexCell())
-                glColor4d(0,0.165,0.514,1);
+                res.setRgbF(0,0.165,0.514,1);
             else if(toEdgeCell())
-                glColor4d(0.18,0.60,0.90,1);
+                res.setRgbF(0.18,0.60,0.90,1);
             else // shouldn't happen
-                glColor4d(0,0,0,1);
+                res.setRgbF(0,0,0,1);
         }
     }
+    return res;
 }
 
 QColor Cell::getColor(Time /*time*/, ViewSettings & /*viewSettings*/) const
@@ -341,6 +427,36 @@ void Cell::glColor_(Time time, ViewSettings & viewSettings)
     }
 }
 
+// Must be kept consistent with glColor_()
+QColor Cell::drawColor(Time time, ViewSettings & viewSettings)
+{
+    QColor res;
+    if(global()->displayMode() == Global::ILLUSTRATION_OUTLINE && !toFaceCell())
+        res = getColor(time, viewSettings);
+    else if(isHighlighted())
+        res.setRgbF(colorHighlighted_[0], colorHighlighted_[1], colorHighlighted_[2], colorHighlighted_[3]);
+    else if(isSelected() && global()->toolMode() == Global::SELECT)
+        res.setRgbF(colorSelected_[0], colorSelected_[1], colorSelected_[2], colorSelected_[3]);
+    else
+        res = getColor(time, viewSettings);
+    return res;
+}
+
+bool Cell::isBatchable(Time /*time*/) const
+{
+    return true;
+}
+
+const Triangles & Cell::drawnTriangles(Time time, ViewSettings & /*viewSettings*/) const
+{
+    return triangles(time);
+}
+
+const Triangles & Cell::drawnTopologyTriangles(Time time, ViewSettings & /*viewSettings*/) const
+{
+    return triangles(time);
+}
+
 void Cell::glColor3D_()
 {
     if(global()->displayMode() == Global::ILLUSTRATION_OUTLINE && !toFaceCell())
@@ -366,6 +482,7 @@ void Cell::draw(Time time, ViewSettings & viewSettings)
     if (!exists(time))
         return;
 
+    RenderStats::add(RenderStats::CellsDrawn);
     glColor_(time, viewSettings);
     drawRaw(time, viewSettings);
 }
@@ -402,6 +519,7 @@ void Cell::drawTopology(Time time, ViewSettings & viewSettings)
     if (!exists(time))
         return;
 
+    RenderStats::add(RenderStats::CellsDrawn);
     glColorTopology_();
     drawRawTopology(time, viewSettings);
 }
@@ -431,6 +549,36 @@ void Cell::drawPickTopologyCustom(Time time, ViewSettings & viewSettings)
 
 
 
+/////////////////////////     Picking on CPU   /////////////////////////////
+
+double Cell::pickDistance(double x, double y, Time time, ViewSettings & viewSettings)
+{
+    if (!isPickable(time))
+        return std::numeric_limits<double>::infinity();
+    else
+        return pickDistanceCustom(x, y, time, viewSettings);
+}
+
+double Cell::pickDistanceCustom(double x, double y, Time time, ViewSettings & /*viewSettings*/)
+{
+    return triangles(time).distance(Eigen::Vector2d(x,y));
+}
+
+double Cell::pickTopologyDistance(double x, double y, Time time, ViewSettings & viewSettings)
+{
+    if (!isPickable(time))
+        return std::numeric_limits<double>::infinity();
+    else
+        return pickTopologyDistanceCustom(x, y, time, viewSettings);
+}
+
+double Cell::pickTopologyDistanceCustom(double x, double y, Time time, ViewSettings & /*viewSettings*/)
+{
+    return triangles(time).distance(Eigen::Vector2d(x,y));
+}
+
+
+
 /////////////////////////     Draw 3D   /////////////////////////////
 
 void Cell::draw3D(View3DSettings & viewSettings)
@@ -487,16 +635,32 @@ KeyCellSet Cell::temporalBoundary() const
 KeyCellSet Cell::beforeCells() const { return KeyCellSet(); }
 KeyCellSet Cell::afterCells() const { return KeyCellSet(); }
 // -------------- Star --------------
+namespace
+{
+// The star is stored as incidence lists, which are only converted to sets
+// when requested, allocated once with their final size
+void insertAll(CellSet & res, const CellIncidenceList & cells)
+{
+    for(Cell * c: cells)
+        res.insert(c);
+}
+}
+
 CellSet Cell::star() const
 {
-    CellSet res = this->spatialStar();
-    CellSet other = this->temporalStar();
-    res.unite(other);
+    CellSet res;
+    res.reserve(spatialStar_.size() + temporalStarBefore_.size() + temporalStarAfter_.size());
+    insertAll(res, spatialStar_);
+    insertAll(res, temporalStarBefore_);
+    insertAll(res, temporalStarAfter_);
     return res;
 }
 CellSet Cell::spatialStar() const
 {
-    return spatialStar_;
+    CellSet res;
+    res.reserve(spatialStar_.size());
+    insertAll(res, spatialStar_);
+    return res;
 }
 CellSet Cell::spatialStar(Time t) const
 {
@@ -511,17 +675,25 @@ CellSet Cell::spatialStar(Time t) const
 }
 CellSet Cell::temporalStar() const
 {
-    CellSet res = this->temporalStarBefore();
-    res.unite(this->temporalStarAfter());
+    CellSet res;
+    res.reserve(temporalStarBefore_.size() + temporalStarAfter_.size());
+    insertAll(res, temporalStarBefore_);
+    insertAll(res, temporalStarAfter_);
     return res;
 }
 CellSet Cell::temporalStarBefore() const
 {
-    return temporalStarBefore_;
+    CellSet res;
+    res.reserve(temporalStarBefore_.size());
+    insertAll(res, temporalStarBefore_);
+    return res;
 }
 CellSet Cell::temporalStarAfter() const
 {
-    return temporalStarAfter_;
+    CellSet res;
+    res.reserve(temporalStarAfter_.size());
+    insertAll(res, temporalStarAfter_);
+    return res;
 }
 
 // ---------- Neighbourhood ---------
@@ -599,27 +771,50 @@ void Cell::removeMeFromStarOf_(Cell * c)
 void Cell::addMeToSpatialStarOf_(Cell * c)
 {
     c->spatialStar_ << this;
+    processTopologyChanged_();
+    c->processStarChanged_();
+    processStateChanged_();
+    c->processStateChanged_();
 }
 void Cell::addMeToTemporalStarBeforeOf_(Cell *c)
 {
     c->temporalStarBefore_ << this;
+    processTopologyChanged_();
+    c->processStarChanged_();
+    processStateChanged_();
+    c->processStateChanged_();
 }
 void Cell::addMeToTemporalStarAfterOf_(Cell *c)
 {
     c->temporalStarAfter_ << this;
-
+    processTopologyChanged_();
+    c->processStarChanged_();
+    processStateChanged_();
+    c->processStateChanged_();
 }
 void Cell::removeMeFromSpatialStarOf_(Cell * c)
 {
     c->spatialStar_.remove(this);
+    processTopologyChanged_();
+    c->processStarChanged_();
+    processStateChanged_();
+    c->processStateChanged_();
 }
 void Cell::removeMeFromTemporalStarBeforeOf_(Cell *c)
 {
     c->temporalStarBefore_.remove(this);
+    processTopologyChanged_();
+    c->processStarChanged_();
+    processStateChanged_();
+    c->processStateChanged_();
 }
 void Cell::removeMeFromTemporalStarAfterOf_(Cell * c)
 {
     c->temporalStarAfter_.remove(this);
+    processTopologyChanged_();
+    c->processStarChanged_();
+    processStateChanged_();
+    c->processStateChanged_();
 }
 
 void Cell::save(QTextStream & out)
@@ -642,7 +837,7 @@ void Cell::save_(QTextStream & /*out*/)
 {
 }
 
-void Cell::exportSVG(Time /*t*/, QTextStream & /*out*/)
+void Cell::exportSVG(Time /*t*/, SvgStreamWriter & /*out*/)
 {
 }
 
@@ -689,7 +884,12 @@ void Cell::read2ndPass()
 // to insert it in its list of objects.
 Cell::Cell(VAC * vac, QTextStream & in) :
     vac_(vac), id_(-1),
-    isHovered_(0), isSelected_(0)
+    kind_(0),
+    isHovered_(0), isSelected_(0),
+    geometryVersion_(newGeometryVersion_()),
+    geometryDependentCellsVersion_(0),
+    starVersion_(++lastStarVersion_),
+    stateVersion_(newStateVersion_())
 {
     Field field;
     in >> field >> id_;
@@ -736,7 +936,12 @@ QString Cell::xmlType_() const
 
 Cell::Cell(VAC * vac, XmlStreamReader & xml) :
     vac_(vac), id_(-1),
-    isHovered_(0), isSelected_(0)
+    kind_(0),
+    isHovered_(0), isSelected_(0),
+    geometryVersion_(newGeometryVersion_()),
+    geometryDependentCellsVersion_(0),
+    starVersion_(++lastStarVersion_),
+    stateVersion_(newStateVersion_())
 {
     id_ = xml.attributes().value("id").toInt();
 
@@ -769,12 +974,34 @@ Cell::Cell(VAC * vac, XmlStreamReader & xml) :
 
 bool Cell::check() const
 {
-    // check incident cells share the same VAC
-
     // check that the cell belongs to its VAC
     if(!vac()->checkContains(this))
         return false;
 
+    // check incident cells share the same VAC, and that the boundary and the
+    // star are each other's back-pointers. Note: only reads cells, so that
+    // cells can be checked concurrently
+    Cell * self = const_cast<Cell*>(this);
+    KeyCell * selfKeyCell = self->toKeyCell();
+    foreach(Cell * c, spatialBoundary())
+        if(!vac()->checkContains(c) || !c->spatialStar_.contains(self))
+            return false;
+    foreach(KeyCell * c, beforeCells())
+        if(!vac()->checkContains(c) || !c->temporalStarAfter_.contains(self))
+            return false;
+    foreach(KeyCell * c, afterCells())
+        if(!vac()->checkContains(c) || !c->temporalStarBefore_.contains(self))
+            return false;
+    for(Cell * c: spatialStar_)
+        if(!vac()->checkContains(c) || !c->spatialBoundary().contains(self))
+            return false;
+    for(Cell * c: temporalStarBefore_)
+        if(!vac()->checkContains(c) || !selfKeyCell || !c->afterCells().contains(selfKeyCell))
+            return false;
+    for(Cell * c: temporalStarAfter_)
+        if(!vac()->checkContains(c) || !selfKeyCell || !c->beforeCells().contains(selfKeyCell))
+            return false;
+
     // other type-specific checks
     return check_();
 }
@@ -787,37 +1014,118 @@ bool Cell::check() const
 const Triangles & Cell::triangles(Time t) const
 {
     // Get cache key
-    int key = std::floor(t.floatTime() * 60 + 0.5);
+    int key = GeometryCache::timeKey(t);
 
-    // Compute triangles if not yet cached
+    // Compute triangles if not yet cached, interpolating them if possible
     if(!triangles_.contains(key))
-        triangulate_(t, triangles_[key]);
+    {
+        Triangles & triangles = triangles_[key];
+        if(interpolateTriangles_(key, triangles))
+        {
+            RenderStats::add(RenderStats::InterpolatedTriangulations);
+        }
+        else
+        {
+            VPAINT_TRACE_ZONE("Cell::triangulate");
+            triangulate_(cacheTime_(key, t), EvaluationContext::current(), triangles);
+            RenderStats::add(RenderStats::Triangulations);
+        }
+        insertCachedTriangles_(key);
+    }
+    else
+    {
+        GeometryCache::touch(this, key);
+    }
 
     // Return cached triangles
     return triangles_[key];
 }
 
+bool Cell::hasCachedTriangles(Time t) const
+{
+    int key = GeometryCache::timeKey(t);
+    return triangles_.contains(key);
+}
+
+void Cell::computeTriangles(Time t, const EvaluationContext & context, Triangles & out) const
+{
+    VPAINT_TRACE_ZONE("Cell::triangulate");
+    triangulate_(cacheTime_(GeometryCache::timeKey(t), t), context, out);
+    RenderStats::add(RenderStats::Triangulations);
+}
+
+void Cell::setCachedTriangles(Time t, const Triangles & triangles) const
+{
+    int key = GeometryCache::timeKey(t);
+    triangles_[key] = triangles;
+    insertCachedTriangles_(key);
+}
+
+void Cell::insertCachedTriangles_(int key) const
+{
+    Triangles & triangles = triangles_[key];
+    triangles.setRetained(true);
+    GeometryCache::insert(this, key, sizeof(Triangles) + 2 * sizeof(BoundingBox) +
+                                     triangles.size() * sizeof(Triangle));
+}
+
+Time Cell::cacheTime_(int key, Time t) const
+{
+    // At the finest quantum, keep computing at the exact time requested, as
+    // the first time requested is as good as any other. Otherwise, compute
+    // at the quantum itself, so that the result doesn't depend on which
+    // time was requested first, unless the cell doesn't exist there
+    if(key == std::floor(t.floatTime() * GeometryCache::MAX_TIME_QUANTUM + 0.5))
+        return t;
+    Time keyTime = GeometryCache::keyTime(key);
+    return exists(keyTime) ? keyTime : t;
+}
+
+bool Cell::interpolateTriangles_(int key, Triangles & out) const
+{
+    if(!GeometryCache::isInterpolating() || GeometryCache::isQuantumKey(key))
+        return false;
+
+    // Interpolate the triangles of the two closest quanta, if the cell
+    // exists at both of them
+    int key0 = GeometryCache::previousQuantumKey(key);
+    int key1 = GeometryCache::nextQuantumKey(key);
+    Time t0 = GeometryCache::keyTime(key0);
+    Time t1 = GeometryCache::keyTime(key1);
+    if(!exists(t0) || !exists(t1))
+        return false;
+    const Triangles & triangles0 = triangles(t0);
+    const Triangles & triangles1 = triangles(t1);
+    double u = (double) (key - key0) / (key1 - key0);
+    return out.interpolate(triangles0, triangles1, u);
+}
+
 const BoundingBox & Cell::boundingBox(Time t) const
 {
     // Get cache key
-    int key = std::floor(t.floatTime() * 60 + 0.5);
+    int key = GeometryCache::timeKey(t);
 
     // Compute bounding box if not yet cached
     if(!boundingBoxes_.contains(key))
-        boundingBoxes_[key] = triangles(t).boundingBox();
+        computeBoundingBox_(t, boundingBoxes_[key]);
 
     // Return cached bounding box
     return boundingBoxes_[key];
 }
 
+void Cell::computeBoundingBox_(Time t, BoundingBox & out) const
+{
+    out = triangles(t).boundingBox();
+}
+
 const BoundingBox & Cell::outlineBoundingBox(Time t) const
 {
     // Get cache key
-    int key = std::floor(t.floatTime() * 60 + 0.5);
+    int key = GeometryCache::timeKey(t);
 
     // Compute bounding box if not yet cached
     if(!outlineBoundingBoxes_.contains(key))
-        computeOutlineBoundingBox_(t, outlineBoundingBoxes_[key]);
+        computeOutlineBoundingBox_(cacheTime_(key, t), outlineBoundingBoxes_[key]);
 
     // Return cached bounding box
     return outlineBoundingBoxes_[key];
@@ -825,27 +1133,144 @@ const BoundingBox & Cell::outlineBoundingBox(Time t) const
 
 bool Cell::intersects(Time t, const BoundingBox & bb) const
 {
+    // Trivial cases, using the bounding box of the triangles: no triangle
+    // can intersect bb if it is disjoint from it, and at least one does if
+    // it is inside bb
+    const BoundingBox & cellBB = boundingBox(t);
+    if(!cellBB.intersects(bb))
+        return false;
+    if(!cellBB.isEmpty() &&
+       cellBB.xMin() >= bb.xMin() && cellBB.xMax() <= bb.xMax() &&
+       cellBB.yMin() >= bb.yMin() && cellBB.yMax() <= bb.yMax())
+        return true;
+
+    // General case
     return triangles(t).intersects(bb);
 }
 
 void Cell::processGeometryChanged_()
 {
-    CellSet toClearCells = geometryDependentCells_();
+    if(deferGeometryChangesCounter_ > 0)
+    {
+        deferredChangedCells_ << this;
+        return;
+    }
+
+    const CellSet & toClearCells = geometryDependentCells_();
     foreach(Cell * cell, toClearCells)
         cell->clearCachedGeometry_();
 }
 
+int Cell::deferGeometryChangesCounter_ = 0;
+CellSet Cell::deferredChangedCells_;
+CellSet Cell::deferredClearedCells_;
+
+void Cell::beginDeferGeometryChanges_()
+{
+    ++deferGeometryChangesCounter_;
+}
+
+void Cell::endDeferGeometryChanges_()
+{
+    if(--deferGeometryChangesCounter_ > 0)
+        return;
+
+    foreach(Cell * cell, deferredChangedCells_)
+        deferredClearedCells_.unite(cell->geometryDependentCells_());
+    deferredChangedCells_.clear();
+
+    // Note: clearing caches does not change any geometry, so the sets
+    // are not modified while iterating
+    foreach(Cell * cell, deferredClearedCells_)
+        cell->clearCachedGeometry_();
+    deferredClearedCells_.clear();
+}
+
+void Cell::processDeferredGeometryChange_()
+{
+    if(deferredChangedCells_.remove(this))
+        deferredClearedCells_.unite(geometryDependentCells_());
+}
+
 void Cell::clearCachedGeometry_()
 {
+    foreach(int key, triangles_.keys())
+        GeometryCache::remove(this, key);
     triangles_.clear();
     boundingBoxes_.clear();
     outlineBoundingBoxes_.clear();
+    geometryVersion_ = newGeometryVersion_();
+    processStateChanged_();
+    if(vac_)
+        vac_->processCellGeometryChanged_(this);
 }
 
-// XXX this could be cached, it is called many times during
-// drag and drop and affine transform while not changing
-CellSet Cell::geometryDependentCells_()
+void Cell::translateCachedGeometry_(double dx, double dy)
 {
+    // Note: memory usage doesn't change, hence GeometryCache isn't updated
+    for(auto it = triangles_.begin(); it != triangles_.end(); ++it)
+        it.value().translate(dx, dy);
+    for(auto it = boundingBoxes_.begin(); it != boundingBoxes_.end(); ++it)
+        it.value().translate(dx, dy);
+    for(auto it = outlineBoundingBoxes_.begin(); it != outlineBoundingBoxes_.end(); ++it)
+        it.value().translate(dx, dy);
+    geometryVersion_ = newGeometryVersion_();
+    processStateChanged_();
+    if(vac_)
+        vac_->processCellGeometryChanged_(this);
+}
+
+void Cell::evictCachedGeometry_(int key) const
+{
+    // Note: this does not change the geometry, hence not geometryVersion_
+    triangles_.remove(key);
+    boundingBoxes_.remove(key);
+    outlineBoundingBoxes_.remove(key);
+}
+
+std::atomic<unsigned int> Cell::lastGeometryVersion_(0);
+
+unsigned int Cell::newGeometryVersion_()
+{
+    return ++lastGeometryVersion_;
+}
+
+std::atomic<unsigned int> Cell::lastStateVersion_(0);
+
+unsigned int Cell::newStateVersion_()
+{
+    return ++lastStateVersion_;
+}
+
+void Cell::processStateChanged_()
+{
+    stateVersion_ = newStateVersion_();
+}
+
+std::atomic<unsigned int> Cell::topologyVersion_(1);
+
+void Cell::processTopologyChanged_()
+{
+    ++topologyVersion_;
+}
+
+std::atomic<unsigned int> Cell::lastStarVersion_(0);
+
+void Cell::processStarChanged_()
+{
+    starVersion_ = ++lastStarVersion_;
+    if(vac_)
+        vac_->processCellTopologyChanged_(this);
+}
+
+// Cached, since it is called many times during drag and drop and affine
+// transform while not changing. It only depends on the stars of cells, so
+// it is recomputed whenever the star of any cell changes
+const CellSet & Cell::geometryDependentCells_()
+{
+    if(geometryDependentCellsVersion_ == topologyVersion_)
+        return geometryDependentCellsCache_;
+
     CellSet res;
     res << this;
 
@@ -859,7 +1284,9 @@ CellSet Cell::geometryDependentCells_()
         res.unite(afterVertices);
     }
 
-    return Algorithms::fullstar(res);
+    geometryDependentCellsCache_ = Algorithms::fullstar(res);
+    geometryDependentCellsVersion_ = topologyVersion_;
+    return geometryDependentCellsCache_;
 }
 
 }
@@ -94,12 +94,17 @@
 #include "../ViewSettings.h"
 #include "../View3DSettings.h"
 #include "CellList.h"
+#include "IncidenceList.h"
 #include "Triangles.h"
 #include "BoundingBox.h"
+#include "MemoryPool.h"
+#include "../MemoryStats.h"
 #include <QString>
 #include <QRect>
 #include <QColor>
+#include <atomic>
 class QTextStream;
+class SvgStreamWriter;
 class XmlStreamWriter;
 class XmlStreamReader;
 
@@ -108,6 +113,27 @@ namespace VectorAnimationComplex
 
 class CellObserver;
 class KeyHalfedge;
+struct EvaluationContext;
+
+// Kind of a cell, stored in each cell so that casts and type-filtered
+// iterations don't need RTTI. The intermediate classes (KeyCell, EdgeCell,
+// etc.) each set their own bit on construction, so a fully constructed cell
+// has exactly one of the six concrete kinds.
+enum CellKind
+{
+    KeyCellBit       = 0x01,
+    InbetweenCellBit = 0x02,
+    VertexCellBit    = 0x04,
+    EdgeCellBit      = 0x08,
+    FaceCellBit      = 0x10,
+
+    KeyVertexKind       = KeyCellBit | VertexCellBit,
+    KeyEdgeKind         = KeyCellBit | EdgeCellBit,
+    KeyFaceKind         = KeyCellBit | FaceCellBit,
+    InbetweenVertexKind = InbetweenCellBit | VertexCellBit,
+    InbetweenEdgeKind   = InbetweenCellBit | EdgeCellBit,
+    InbetweenFaceKind   = InbetweenCellBit | FaceCellBit
+};
 
 // The abstract base class Cell
 class Cell
@@ -129,6 +155,15 @@ public:
     void addObserver(CellObserver * observer);
     void removeObserver(CellObserver * observer);
 
+    // Cells are allocated by MemoryPool. Since the destructor is virtual,
+    // the size passed to operator delete is the one of the actual cell type
+    static void * operator new(std::size_t size) { return MemoryPool::allocate(size); }
+    static void operator delete(void * p, std::size_t size) { MemoryPool::deallocate(p, size); }
+
+    // Add to report the memory owned by this cell, not counting the cell
+    // object itself which is counted as part of MemoryPool
+    virtual void reportMemory(MemoryStats::Report & report) const;
+
 protected:
     // Protected constructor, so only VAC and derived classes can call it.
     // It creates a cell with VAC `vac`. `vac` must be non null.
@@ -153,6 +188,9 @@ protected:
     // Get cell from id (syntactic sugar for vac()->getCell(id))
     Cell * getCell(int id);
 
+private:
+    static void remapIncidenceList_(CellIncidenceList & cells, VAC * newVAC);
+
 private:
     // Embedding in VAC
     friend class VAC;
@@ -160,7 +198,7 @@ private:
     int id_;
 
     // Observers
-    QSet<CellObserver*> observers_;
+    IncidenceList<CellObserver> observers_;
 
 
 //###################################################################
@@ -175,12 +213,37 @@ public:
     VertexCell * toVertexCell();
     EdgeCell * toEdgeCell();
     FaceCell * toFaceCell();
-    KeyVertex * toKeyVertex();
-    KeyEdge * toKeyEdge();
-    KeyFace * toKeyFace();
-    InbetweenVertex * toInbetweenVertex();
-    InbetweenEdge * toInbetweenEdge();
-    InbetweenFace * toInbetweenFace();
+    KeyVertex * toKeyVertex() { return kind_ == KeyVertexKind ? asKeyVertex_() : 0; }
+    KeyEdge * toKeyEdge() { return kind_ == KeyEdgeKind ? asKeyEdge_() : 0; }
+    KeyFace * toKeyFace() { return kind_ == KeyFaceKind ? asKeyFace_() : 0; }
+    InbetweenVertex * toInbetweenVertex() { return kind_ == InbetweenVertexKind ? asInbetweenVertex_() : 0; }
+    InbetweenEdge * toInbetweenEdge() { return kind_ == InbetweenEdgeKind ? asInbetweenEdge_() : 0; }
+    InbetweenFace * toInbetweenFace() { return kind_ == InbetweenFaceKind ? asInbetweenFace_() : 0; }
+
+    // Kind of the cell, see CellKind
+    int kind() const { return kind_; }
+    bool isKeyCell() const { return kind_ & KeyCellBit; }
+    bool isInbetweenCell() const { return kind_ & InbetweenCellBit; }
+    bool isVertexCell() const { return kind_ & VertexCellBit; }
+    bool isEdgeCell() const { return kind_ & EdgeCellBit; }
+    bool isFaceCell() const { return kind_ & FaceCellBit; }
+
+protected:
+    // Called by the constructors of the intermediate classes
+    void addKindBit_(CellKind bit) { kind_ |= bit; }
+
+private:
+    int kind_;
+
+    // Implemented by each concrete class, returning this. Only called once
+    // the kind is known, so this is a single virtual call instead of a
+    // dynamic_cast.
+    virtual KeyVertex * asKeyVertex_() { return 0; }
+    virtual KeyEdge * asKeyEdge_() { return 0; }
+    virtual KeyFace * asKeyFace_() { return 0; }
+    virtual InbetweenVertex * asInbetweenVertex_() { return 0; }
+    virtual InbetweenEdge * asInbetweenEdge_() { return 0; }
+    virtual InbetweenFace * asInbetweenFace_() { return 0; }
 
 
 //###################################################################
@@ -218,6 +281,10 @@ public:
     CellSet temporalStar() const;
     CellSet temporalStarBefore() const;
     CellSet temporalStarAfter() const;
+    // Same as above, without copying them to a set
+    const CellIncidenceList & spatialStarList() const { return spatialStar_; }
+    const CellIncidenceList & temporalStarBeforeList() const { return temporalStarBefore_; }
+    const CellIncidenceList & temporalStarAfterList() const { return temporalStarAfter_; }
     // ---------- Neighbourhood ---------
     CellSet neighbourhood() const;
     CellSet spatialNeighbourhood() const;
@@ -264,9 +331,9 @@ private:
     //       (Otherwise, if implemented as a method, it would be necessary
     //        to visit all the cells in the VAC to check those whose boundary
     //        contains this cell)
-    CellSet spatialStar_;
-    CellSet temporalStarBefore_; // We know they are animated cells, but not enforced to be consistent
-    CellSet temporalStarAfter_;  // with spatial star (in which case we know they are either edges of faces)
+    CellIncidenceList spatialStar_;
+    CellIncidenceList temporalStarBefore_; // We know they are animated cells, but not enforced to be consistent
+    CellIncidenceList temporalStarAfter_;  // with spatial star (in which case we know they are either edges of faces)
                                  // This emphasizes the idea that we do not store any semantics for the star,
                                  // only for the boundary, and that the star is only stored to inform all of them
                                  // consistently when a change happened to the boundary
@@ -306,6 +373,28 @@ public:
     virtual void drawRaw3D(View3DSettings & viewSettings);
     virtual void drawPick3D(View3DSettings & viewSettings);
 
+    // CPU picking. Returns the distance between the point (x,y) and what
+    // drawPick() (resp. drawPickTopology()) would draw: zero if the point is
+    // inside, and infinity if nothing would be drawn
+    double pickDistance(double x, double y, Time time, ViewSettings & viewSettings);
+    double pickTopologyDistance(double x, double y, Time time, ViewSettings & viewSettings);
+
+    // Batched drawing (see DrawList). isBatchable() returns whether
+    // draw(time, viewSettings) amounts to drawing drawnTriangles(time,
+    // viewSettings) with the single color drawColor(time, viewSettings).
+    // Cells reimplementing draw() or drawRaw() must reimplement these
+    // methods accordingly.
+    virtual bool isBatchable(Time time) const;
+    virtual const Triangles & drawnTriangles(Time time, ViewSettings & viewSettings) const;
+    QColor drawColor(Time time, ViewSettings & viewSettings);
+
+    // Same for drawTopology(), which always amounts to drawing
+    // drawnTopologyTriangles(time, viewSettings) with the single color
+    // topologyColor(). Cells reimplementing drawRawTopology() must
+    // reimplement drawnTopologyTriangles() accordingly.
+    virtual const Triangles & drawnTopologyTriangles(Time time, ViewSettings & viewSettings) const;
+    QColor topologyColor();
+
     // Highlighting and Selecting
     bool isHovered() const  { return isHovered_; }
     bool isSelected()    const  { return isSelected_;    }
@@ -341,6 +430,8 @@ private:
     virtual bool isPickableCustom(Time time) const;
     virtual void drawPickCustom(Time time, ViewSettings & viewSettings);
     virtual void drawPickTopologyCustom(Time time, ViewSettings & viewSettings);
+    virtual double pickDistanceCustom(double x, double y, Time time, ViewSettings & viewSettings);
+    virtual double pickTopologyDistanceCustom(double x, double y, Time time, ViewSettings & viewSettings);
 
 
 //###################################################################
@@ -365,7 +456,7 @@ protected:
     static Cell * read1stPass(VAC * vac, QTextStream & in);
 
     // Export
-    virtual void exportSVG(Time t, QTextStream & out);
+    virtual void exportSVG(Time t, SvgStreamWriter & out);
 
 
 //###################################################################
@@ -376,6 +467,16 @@ public:
     // Get all the triangles to be rendered at given time
     const Triangles & triangles(Time t) const;
 
+    // Compute triangles and cache them in two separate steps, e.g. to
+    // triangulate several cells in parallel (see VAC::triangulateCells_()).
+    // computeTriangles() does not modify the cell, and is reentrant for faces
+    // and inbetween edges provided that the sampling of all key edges and
+    // inbetween edges is already computed (see InbetweenEdge::prepareSampling()),
+    // with the same context.
+    bool hasCachedTriangles(Time t) const;
+    void computeTriangles(Time t, const EvaluationContext & context, Triangles & out) const;
+    void setCachedTriangles(Time t, const Triangles & triangles) const;
+
     // Get the bounding box of this cell at time t
     const BoundingBox & boundingBox(Time t) const;
     const BoundingBox & outlineBoundingBox(Time t) const;
@@ -389,28 +490,132 @@ public:
     //     boundingBox(t).intersects(bb);
     bool intersects(Time t, const BoundingBox & bb) const;
 
+    // Stamp which changes each time the cached geometry of this cell is
+    // cleared. Stamps are unique across all cells, so that two different
+    // cells never share the same stamp, even if allocated at the same address
+    unsigned int geometryVersion() const { return geometryVersion_; }
+
+    // Latest stamp given to any cell. It changes each time the cached geometry
+    // of any cell is cleared, or a cell is created
+    static unsigned int lastGeometryVersion() { return lastGeometryVersion_; }
+
+    // Stamp which changes each time the star of any cell changes, e.g. when
+    // cells are inserted, removed, glued or cut, or the time of any key cell
+    // changes. Used by caches depending on lifespans or stars of cells
+    static unsigned int topologyVersion() { return topologyVersion_; }
+
+    // Stamp which changes each time the star of this cell changes, or its
+    // time if it is a key cell. Stamps are unique across all cells, like
+    // geometryVersion(). Together, they let caches depending on a few cells
+    // check whether they are up to date, rather than being cleared
+    unsigned int starVersion() const { return starVersion_; }
+
+    // Stamp which changes each time any state of this cell saved in the undo
+    // history changes: its geometry, its boundary, its star, or its color.
+    // Stamps are unique across all cells, like geometryVersion(). It is used
+    // by History to only copy the cells modified since the last checkpoint
+    unsigned int stateVersion() const { return stateVersion_; }
+
+    // Latest stamp given to any cell. It changes each time any state of any
+    // cell changes, or a cell is created. Used by caches depending on the
+    // boundaries of several cells, e.g. KeyVertex::nUses()
+    static unsigned int lastStateVersion() { return lastStateVersion_; }
+
 protected:
     // Method to be called by derived classes when their geometry changes
     void processGeometryChanged_();
 
+    // Method to be called when the star of any cell or the time of
+    // any key cell changes, see topologyVersion()
+    static void processTopologyChanged_();
+
+    // Method to be called when the star or the time of this cell changes,
+    // in addition to processTopologyChanged_(), see starVersion()
+    void processStarChanged_();
+
+    // Operations modifying many cells at once, e.g. VAC::smartDelete_(), can
+    // defer geometry changes until they end, since the same cells would
+    // otherwise have their cached geometry cleared many times, and cells
+    // about to be deleted would be cleared too. In between, calling
+    // processGeometryChanged_() only records the cell, and the cached geometry
+    // of all cells depending on recorded cells is cleared once at the end.
+    // Calls can be nested. A recorded cell must call
+    // processDeferredGeometryChange_() before its star is destroyed
+    static void beginDeferGeometryChanges_();
+    static void endDeferGeometryChanges_();
+    void processDeferredGeometryChange_();
+
     // Clear cached geometry (derived classes caching more data may specialize it)
     virtual void clearCachedGeometry_();
 
+    // Translate cached geometry instead of clearing it, when the whole
+    // geometry of the cell has been translated, e.g. by a drag and drop
+    // (derived classes caching more data may specialize it)
+    virtual void translateCachedGeometry_(double dx, double dy);
+
 private:
-    // Cached triangulations and bounding boxes (the integer represent a 1/60th of frame)
+    // Cached triangulations and bounding boxes (the integer represent a 1/60th of frame,
+    // see GeometryCache::timeKey()).
+    // Their memory usage is bounded by GeometryCache, which may evict them.
     mutable QMap<int,Triangles> triangles_;
     mutable QMap<int,BoundingBox> boundingBoxes_;
     mutable QMap<int,BoundingBox> outlineBoundingBoxes_;
+    friend class GeometryCache;
+    void evictCachedGeometry_(int key) const;
+    void insertCachedTriangles_(int key) const;
+    Time cacheTime_(int key, Time t) const; // time at which to compute the geometry of key
+    bool interpolateTriangles_(int key, Triangles & out) const;
+    unsigned int geometryVersion_;
+    static std::atomic<unsigned int> lastGeometryVersion_;
+    static unsigned int newGeometryVersion_();
 
     // Compute triangulation for time t (must be implemented by derived classes)
-    virtual void triangulate_(Time t, Triangles & out) const=0;
+    virtual void triangulate_(Time t, const EvaluationContext & context, Triangles & out) const=0;
 
     // Compute outline bounding box for time t (must be implemented by derived classes)
     virtual void computeOutlineBoundingBox_(Time t, BoundingBox & out) const=0;
 
-    // Return the list of cells whose geometry depends on this cell's geometry
-    CellSet geometryDependentCells_();
+    // Compute bounding box for time t. By default, the one of triangles(t)
+    virtual void computeBoundingBox_(Time t, BoundingBox & out) const;
+
+    // Return the list of cells whose geometry depends on this cell's geometry.
+    // It is cached until the topology of the VAC changes
+    const CellSet & geometryDependentCells_();
+    CellSet geometryDependentCellsCache_;
+    unsigned int geometryDependentCellsVersion_;
+
+    // See topologyVersion() and starVersion(). Version counters are atomic,
+    // since cells may be created in a worker thread, e.g. when opening a file
+    static std::atomic<unsigned int> topologyVersion_;
+    unsigned int starVersion_;
+    static std::atomic<unsigned int> lastStarVersion_;
+
+    // See beginDeferGeometryChanges_()
+    static int deferGeometryChangesCounter_;
+    static CellSet deferredChangedCells_;  // whose dependent cells are not known yet
+    static CellSet deferredClearedCells_;  // whose cached geometry must be cleared
+
+    // See stateVersion()
+    unsigned int stateVersion_;
+    static std::atomic<unsigned int> lastStateVersion_;
+    static unsigned int newStateVersion_();
+    void processStateChanged_();
+    friend class History;
 };
+
+// Cast used by the conversions between cell containers (see CellList.h)
+template <> inline Cell * Cell::to<Cell>() { return toCell(); }
+template <> inline KeyCell * Cell::to<KeyCell>() { return toKeyCell(); }
+template <> inline InbetweenCell * Cell::to<InbetweenCell>() { return toInbetweenCell(); }
+template <> inline VertexCell * Cell::to<VertexCell>() { return toVertexCell(); }
+template <> inline EdgeCell * Cell::to<EdgeCell>() { return toEdgeCell(); }
+template <> inline FaceCell * Cell::to<FaceCell>() { return toFaceCell(); }
+template <> inline KeyVertex * Cell::to<KeyVertex>() { return toKeyVertex(); }
+template <> inline KeyEdge * Cell::to<KeyEdge>() { return toKeyEdge(); }
+template <> inline KeyFace * Cell::to<KeyFace>() { return toKeyFace(); }
+template <> inline InbetweenVertex * Cell::to<InbetweenVertex>() { return toInbetweenVertex(); }
+template <> inline InbetweenEdge * Cell::to<InbetweenEdge>() { return toInbetweenEdge(); }
+template <> inline InbetweenFace * Cell::to<InbetweenFace>() { return toInbetweenFace(); }
     
 }
 
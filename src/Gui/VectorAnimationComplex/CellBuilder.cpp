@@ -0,0 +1,139 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#include "CellBuilder.h"
+
+#include "VAC.h"
+#include "KeyVertex.h"
+#include "KeyEdge.h"
+#include "KeyFace.h"
+#include "Cycle.h"
+#include "EdgeGeometry.h"
+
+namespace VectorAnimationComplex
+{
+
+CellBuilder::CellBuilder(VAC * vac) :
+    vac_(vac)
+{
+}
+
+CellBuilder::~CellBuilder()
+{
+    commit();
+}
+
+void CellBuilder::reserve(int numVertices, int numEdges, int numFaces)
+{
+    const int numCells = numVertices + numEdges + numFaces;
+    vac_->cells_.reserve(vac_->maxID_ + 1 + numCells);
+    vac_->zOrdering_.reserve(vac_->cells_.size() + numCells);
+    vertices_.reserve(vertices_.size() + numVertices);
+    edges_.reserve(edges_.size() + numEdges);
+    faces_.reserve(faces_.size() + numFaces);
+}
+
+bool CellBuilder::isNew_(Cell * cell) const
+{
+    // Cells of the VAC not in the z-ordering are those created by the
+    // builder since the last commit
+    return !vac_->zOrdering_.contains(cell);
+}
+
+void CellBuilder::add_(Cell * cell, std::vector<Cell*> & onTop, bool isBoundaryNew)
+{
+    vac_->registerCell_(cell);
+    if(isBoundaryNew)
+        onTop.push_back(cell);
+    else
+        belowBoundary_.push_back(cell);
+}
+
+KeyVertex * CellBuilder::newKeyVertex(Time time, const Eigen::Vector2d & pos)
+{
+    KeyVertex * vertex = new KeyVertex(vac_, time, pos);
+    add_(vertex, vertices_, true);
+    return vertex;
+}
+
+KeyEdge * CellBuilder::newKeyEdge(Time time, KeyVertex * startVertex, KeyVertex * endVertex,
+                                  EdgeGeometry * geometry, double width)
+{
+    if(geometry == 0)
+        geometry = VAC::straightGeometry_(startVertex, endVertex, width);
+
+    KeyEdge * edge = new KeyEdge(vac_, time, startVertex, endVertex, geometry);
+    add_(edge, edges_, isNew_(startVertex) && isNew_(endVertex));
+    return edge;
+}
+
+KeyEdge * CellBuilder::newKeyEdge(Time time, EdgeGeometry * geometry)
+{
+    if(geometry == 0)
+        geometry = new EdgeGeometry();
+
+    geometry->makeLoop();
+    KeyEdge * edge = new KeyEdge(vac_, time, geometry);
+    add_(edge, edges_, true);
+    return edge;
+}
+
+KeyFace * CellBuilder::newKeyFace(const QList<Cycle> & cycles)
+{
+    KeyFace * face = new KeyFace(vac_, cycles);
+    bool isBoundaryNew = true;
+    for(const Cycle & cycle: cycles)
+    {
+        for(KeyCell * cell: cycle.cells())
+        {
+            if(!isNew_(cell))
+            {
+                isBoundaryNew = false;
+                break;
+            }
+        }
+    }
+    add_(face, faces_, isBoundaryNew);
+    return face;
+}
+
+int CellBuilder::numCells() const
+{
+    return vertices_.size() + edges_.size() + faces_.size() + belowBoundary_.size();
+}
+
+void CellBuilder::commit()
+{
+    if(numCells() == 0)
+        return;
+
+    // Insert cells on top in one pass, then the few bounded by existing
+    // cells one by one
+    std::vector<Cell*> onTop;
+    onTop.reserve(faces_.size() + edges_.size() + vertices_.size());
+    onTop.insert(onTop.end(), faces_.begin(), faces_.end());
+    onTop.insert(onTop.end(), edges_.begin(), edges_.end());
+    onTop.insert(onTop.end(), vertices_.begin(), vertices_.end());
+    vac_->zOrdering_.insertLast(onTop);
+    for(Cell * cell: belowBoundary_)
+        vac_->zOrdering_.insertCell(cell);
+
+    // The key time index is rebuilt on next query, since it wasn't told
+    // about this change of the z-ordering
+
+    vertices_.clear();
+    edges_.clear();
+    faces_.clear();
+    belowBoundary_.clear();
+
+    emit vac_->needUpdatePicking();
+    emit vac_->changed();
+    emit vac_->checkpoint();
+}
+
+}
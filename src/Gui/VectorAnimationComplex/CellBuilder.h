@@ -0,0 +1,102 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#ifndef VAC_CELL_BUILDER_H
+#define VAC_CELL_BUILDER_H
+
+// CellBuilder: creates many key cells at once, e.g. for importers creating
+// hundreds of thousands of edges, or scripts. Same as calling
+// VAC::newKeyVertex(), VAC::newKeyEdge() and VAC::newKeyFace(), except that:
+//
+//   - storage for cells and their IDs can be reserved upfront
+//
+//   - cells get their ID right away, but are only inserted in the z-ordering
+//     by commit(), in one pass, instead of each looking for its boundary
+//
+//   - indices of the VAC (e.g. key times) are rebuilt once on next query,
+//     instead of being updated for each cell
+//
+//   - needUpdatePicking(), changed() and checkpoint() are emitted once, by
+//     commit()
+//
+// Cells whose boundary only has cells created by the builder are inserted
+// on top of all other cells: faces first, then edges, then vertices, each in
+// order of creation, so that each cell is below its boundary. Cells bounded
+// by existing cells are instead inserted just below their lowest boundary
+// cell, as VAC::newKeyEdge() would.
+//
+// Cells are allocated from the MemoryPool, so cells created together are
+// already close to each other in memory.
+//
+// Until commit(), which the destructor calls if needed, the VAC must be
+// neither drawn nor modified by other means:
+//
+//     CellBuilder builder(vac);
+//     builder.reserve(numVertices, numEdges);
+//     for(...)
+//         builder.newKeyEdge(time, builder.newKeyVertex(time, p), ...);
+//     builder.commit();
+
+#include "../TimeDef.h"
+#include "Eigen.h"
+
+#include <QList>
+#include <vector>
+
+namespace VectorAnimationComplex
+{
+
+class VAC;
+class Cell;
+class KeyVertex;
+class KeyEdge;
+class KeyFace;
+class Cycle;
+class EdgeGeometry;
+
+class CellBuilder
+{
+public:
+    explicit CellBuilder(VAC * vac);
+    ~CellBuilder();
+
+    // Preallocate storage for the given number of cells
+    void reserve(int numVertices, int numEdges, int numFaces = 0);
+
+    // Same as VAC::newKeyVertex(), VAC::newKeyEdge() and VAC::newKeyFace()
+    KeyVertex * newKeyVertex(Time time, const Eigen::Vector2d & pos);
+    KeyEdge * newKeyEdge(Time time, KeyVertex * startVertex, KeyVertex * endVertex,
+                         EdgeGeometry * geometry = 0, double width = 0);
+    KeyEdge * newKeyEdge(Time time, EdgeGeometry * geometry = 0); // closed edge
+    KeyFace * newKeyFace(const QList<Cycle> & cycles);
+
+    // Inserts the cells created since the last commit in the z-ordering,
+    // and notifies that the VAC changed, if any cell was created
+    void commit();
+
+    // Number of cells created since the last commit
+    int numCells() const;
+
+private:
+    Q_DISABLE_COPY(CellBuilder)
+
+    VAC * vac_;
+
+    // Cells to insert on top, and cells to insert below their boundary
+    std::vector<Cell*> vertices_;
+    std::vector<Cell*> edges_;
+    std::vector<Cell*> faces_;
+    std::vector<Cell*> belowBoundary_;
+
+    bool isNew_(Cell * cell) const;
+    void add_(Cell * cell, std::vector<Cell*> & onTop, bool isBoundaryNew);
+};
+
+}
+
+#endif // VAC_CELL_BUILDER_H
@@ -92,9 +92,15 @@ void CellLinkedList::splice( CellLinkedList::Iterator pos, CellLinkedList & othe
 
 CellLinkedList::Iterator CellLinkedList::extractTo(CellLinkedList::Iterator pos, CellLinkedList & other)
 {
-    Cell * c = *pos;
-    other.append(c);
-    return erase(pos);
+    Iterator next = pos;
+    ++next;
+    other.list_.splice(other.list_.end(), list_, pos);
+    return next;
+}
+
+void CellLinkedList::splice(CellLinkedList::Iterator pos, CellLinkedList & other, CellLinkedList::Iterator it)
+{
+    list_.splice(pos, other.list_, it);
 }
 
 // Reverse methods
@@ -119,9 +125,11 @@ void CellLinkedList::splice(CellLinkedList::ReverseIterator pos, CellLinkedList
 
 CellLinkedList::ReverseIterator CellLinkedList::extractTo(CellLinkedList::ReverseIterator pos, CellLinkedList & other)
 {
-    Cell * c = *pos;
-    other.prepend(c);
-    return erase(pos);
+    Iterator it = (++pos).base();
+    Iterator next = it;
+    ++next;
+    other.list_.splice(other.list_.begin(), list_, it);
+    return ReverseIterator(next);
 }
 
 }
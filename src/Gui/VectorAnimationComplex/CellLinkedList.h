@@ -9,6 +9,8 @@
 #ifndef CELLLINKEDLIST_H
 #define CELLLINKEDLIST_H
 
+#include "MemoryPool.h"
+
 #include <list>
 
 namespace VectorAnimationComplex
@@ -20,10 +22,13 @@ class CellLinkedList
 public:
     CellLinkedList();
 
-    typedef std::list<Cell*>::iterator Iterator;
-    typedef std::list<Cell*>::const_iterator ConstIterator;
-    typedef std::list<Cell*>::reverse_iterator ReverseIterator;
-    typedef std::list<Cell*>::const_reverse_iterator ConstReverseIterator;
+    // Nodes are allocated by MemoryPool
+    typedef std::list<Cell*, PoolAllocator<Cell*> > List;
+
+    typedef List::iterator Iterator;
+    typedef List::const_iterator ConstIterator;
+    typedef List::reverse_iterator ReverseIterator;
+    typedef List::const_reverse_iterator ConstReverseIterator;
     Iterator begin();
     Iterator end();
     ReverseIterator rbegin();
@@ -41,8 +46,12 @@ public:
     Iterator insert(Iterator pos, Cell * cell);
     Iterator erase(Iterator pos);
     void splice(Iterator pos, CellLinkedList & other );
+    void splice(Iterator pos, CellLinkedList & other, Iterator it); // move *it from other to just before pos
     Iterator extractTo(Iterator pos, CellLinkedList & other); // append *pos to other, then return erase(pos)
 
+    // Note: splice() and extractTo() move nodes without reallocating them,
+    // that is, iterators to the moved cells remain valid (in their new list)
+
     // Same in reverse
     ReverseIterator insert(ReverseIterator pos, Cell * cell);
     ReverseIterator erase(ReverseIterator pos);
@@ -54,7 +63,7 @@ public:
     ReverseIterator extractTo(ReverseIterator pos, CellLinkedList & other); // prepend *pos to other, then return erase(pos)
 
 private:
-    std::list<Cell*> list_;
+    List list_;
 };
 
 }
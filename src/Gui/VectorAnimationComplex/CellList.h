@@ -47,6 +47,7 @@ template<class U, class UContainer, class T, class TContainer>
 void copyCellContainer(const UContainer & from, TContainer & to)
 {
     to.clear();
+    to.reserve(from.size());
     foreach(U * u, from)
     {
         if(u)
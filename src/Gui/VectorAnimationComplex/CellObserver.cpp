@@ -8,6 +8,7 @@
 
 #include "CellObserver.h"
 #include "Cell.h"
+#include "VAC.h"
 
 namespace VectorAnimationComplex
 {
@@ -26,4 +27,14 @@ void CellObserver::unobserve(Cell * cell)
     cell->removeObserver(this);
 }
 
+void CellObserver::observe(VAC * vac)
+{
+    vac->addObserver(this);
+}
+
+void CellObserver::unobserve(VAC * vac)
+{
+    vac->removeObserver(this);
+}
+
 } // end namespace VectorAnimationComplex
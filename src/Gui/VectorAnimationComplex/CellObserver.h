@@ -11,11 +11,34 @@
 
 // Note: a cell observer can observe several cells
 //       inheriting classes
+//
+// An observer can also observe a whole VAC, in which case it is informed once
+// per transaction of all the cells created, deleted or modified (geometry or
+// star) during it, instead of once per cell. A transaction ends with the
+// outermost aggregation of signals in the VAC, or otherwise when control
+// returns to the event loop. Cells are given by ID, since deleted cells don't
+// exist anymore, and observers needing to be informed before a cell is deleted
+// should observe this cell.
+
+#include <QSet>
 
 namespace VectorAnimationComplex
 {
 
 class Cell;
+class VAC;
+
+// Coalesced changes: a cell created then deleted during the same transaction
+// is in none of the sets, and a cell created or deleted isn't also modified
+struct CellChanges
+{
+    QSet<int> created;
+    QSet<int> deleted;
+    QSet<int> modified;
+
+    bool isEmpty() const { return created.isEmpty() && deleted.isEmpty() && modified.isEmpty(); }
+    void clear() { created.clear(); deleted.clear(); modified.clear(); }
+};
 
 class CellObserver
 {
@@ -25,7 +48,11 @@ public:
     void observe(Cell * cell);
     void unobserve(Cell * cell);
 
+    void observe(VAC * vac);
+    void unobserve(VAC * vac);
+
     virtual void observedCellDeleted(Cell *) {}
+    virtual void observedCellsChanged(VAC *, const CellChanges &) {}
 };
 
 } // end namespace VectorAnimationComplex
@@ -0,0 +1,148 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+
+#include "CellTable.h"
+#include "Cell.h"
+
+#include <algorithm>
+
+namespace VectorAnimationComplex
+{
+
+CellTable::CellTable() :
+    cells_(),
+    size_(0),
+    firstId_(0)
+{
+}
+
+void CellTable::assign(const QMap<int, Cell*> & cells)
+{
+    clear();
+    for (auto it = cells.cbegin(); it != cells.cend(); ++it)
+    {
+        if (it.value())
+            insert(it.key(), it.value());
+    }
+}
+
+void CellTable::clear()
+{
+    cells_.clear();
+    kinds_.clear();
+    for (int i=0; i<NUM_KINDS; ++i)
+        ids_[i].clear();
+    size_ = 0;
+    firstId_ = 0;
+}
+
+void CellTable::reserve(int maxId)
+{
+    cells_.reserve(maxId+1);
+    kinds_.reserve(maxId+1);
+}
+
+std::size_t CellTable::numBytes() const
+{
+    std::size_t res = cells_.capacity() * sizeof(Cell*) + kinds_.capacity();
+    for (int i=0; i<NUM_KINDS; ++i)
+        res += ids_[i].capacity() * sizeof(int);
+    return res;
+}
+
+int CellTable::kindIndex_(int kind)
+{
+    const int dimension = (kind & VertexCellBit) ? 0 : (kind & EdgeCellBit) ? 1 : 2;
+    return (kind & InbetweenCellBit) ? 3 + dimension : dimension;
+}
+
+void CellTable::insertId_(int id, int kind)
+{
+    // IDs are usually given in increasing order: append in constant time
+    std::vector<int> & ids = ids_[kindIndex_(kind)];
+    if (ids.empty() || ids.back() < id)
+        ids.push_back(id);
+    else
+        ids.insert(std::lower_bound(ids.begin(), ids.end(), id), id);
+}
+
+void CellTable::removeId_(int id, int kind)
+{
+    std::vector<int> & ids = ids_[kindIndex_(kind)];
+    std::vector<int>::iterator it = std::lower_bound(ids.begin(), ids.end(), id);
+    if (it != ids.end() && *it == id)
+        ids.erase(it);
+}
+
+Cell * CellTable::value(int id, Cell * defaultValue) const
+{
+    if (0 <= id && id < (int) cells_.size() && cells_[id])
+        return cells_[id];
+    else
+        return defaultValue;
+}
+
+void CellTable::insert(int id, Cell * cell)
+{
+    if (id < 0 || !cell)
+        return;
+
+    if (id >= (int) cells_.size())
+    {
+        cells_.resize(id+1, 0);
+        kinds_.resize(id+1, 0);
+    }
+    if (!cells_[id])
+        ++size_;
+    else
+        removeId_(id, kinds_[id]);
+    cells_[id] = cell;
+    kinds_[id] = cell->kind();
+    insertId_(id, kinds_[id]);
+    if (id < firstId_)
+        firstId_ = id;
+}
+
+void CellTable::remove(int id)
+{
+    if (!contains(id))
+        return;
+
+    removeId_(id, kinds_[id]);
+    cells_[id] = 0;
+    kinds_[id] = 0;
+    --size_;
+    while (!cells_.empty() && !cells_.back())
+    {
+        cells_.pop_back();
+        kinds_.pop_back();
+    }
+}
+
+CellTable::ConstIterator & CellTable::ConstIterator::operator++()
+{
+    const int n = cells_->size();
+    do { ++id_; } while (id_ < n && !(*cells_)[id_]);
+    return *this;
+}
+
+CellTable::ConstIterator CellTable::begin() const
+{
+    const int n = cells_.size();
+    while (firstId_ < n && !cells_[firstId_])
+        ++firstId_;
+    return ConstIterator(&cells_, firstId_ < n ? firstId_ : n);
+}
+
+CellTable::ConstIterator CellTable::end() const
+{
+    return ConstIterator(&cells_, cells_.size());
+}
+
+}
@@ -0,0 +1,101 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+
+#ifndef VAC_CELL_TABLE_H
+#define VAC_CELL_TABLE_H
+
+// CellTable: the cells of a VAC, accessible by ID in constant time.
+//
+// IDs are given in increasing order (see VAC::getAvailableID()), and are never
+// reused since they are saved in files and referred to by the undo history.
+// Therefore, cells are simply stored in a vector indexed by ID, with null
+// pointers for the IDs of deleted cells. Iterating visits the cells in
+// increasing ID order, like the QMap<int, Cell*> this replaces.
+//
+// The IDs of each concrete kind of cell (see CellKind) are also kept in a
+// sorted list, so that iterating over, e.g., all key edges doesn't visit
+// the other cells.
+
+#include <QMap>
+#include <vector>
+
+namespace VectorAnimationComplex
+{
+
+class Cell;
+
+class CellTable
+{
+public:
+    CellTable();
+
+    // Replace all cells by the non-null values of cells
+    void assign(const QMap<int, Cell*> & cells);
+
+    int size() const { return size_; }
+    bool isEmpty() const { return size_ == 0; }
+    void clear();
+    void reserve(int maxId); // preallocate storage for all IDs up to maxId
+    std::size_t numBytes() const;
+
+    bool contains(int id) const { return value(id) != 0; }
+    Cell * value(int id, Cell * defaultValue = 0) const;
+    Cell * operator[](int id) const { return value(id); }
+
+    // Insert or replace the cell with the given ID, or remove it. The cell
+    // must be fully constructed, so that its kind is known
+    void insert(int id, Cell * cell);
+    void remove(int id);
+
+    // IDs of all cells of the given concrete kind, e.g. KeyEdgeKind, in
+    // increasing order
+    const std::vector<int> & ids(int kind) const { return ids_[kindIndex_(kind)]; }
+
+    // Iterating over non-null cells, in increasing ID order
+    class ConstIterator
+    {
+    public:
+        ConstIterator(const std::vector<Cell*> * cells, int id) : cells_(cells), id_(id) {}
+        int key() const { return id_; }
+        Cell * value() const { return (*cells_)[id_]; }
+        Cell * operator*() const { return value(); }
+        ConstIterator & operator++();
+        bool operator==(const ConstIterator & other) const { return id_ == other.id_; }
+        bool operator!=(const ConstIterator & other) const { return id_ != other.id_; }
+
+    private:
+        const std::vector<Cell*> * cells_;
+        int id_;
+    };
+    ConstIterator begin() const;
+    ConstIterator end() const;
+    ConstIterator cbegin() const { return begin(); }
+    ConstIterator cend() const { return end(); }
+
+private:
+    std::vector<Cell*> cells_; // never ends with a null pointer
+    int size_;
+
+    // Kind of each cell, same size as cells_, and IDs of each kind. Kinds
+    // are stored so that removing a cell doesn't need to access it.
+    static const int NUM_KINDS = 6;
+    static int kindIndex_(int kind);
+    std::vector<unsigned char> kinds_;
+    std::vector<int> ids_[NUM_KINDS];
+    void insertId_(int id, int kind);
+    void removeId_(int id, int kind);
+
+    // All IDs below this one are null. It makes begin() constant time in
+    // amortized, e.g., when deleting all cells in order
+    mutable int firstId_;
+};
+
+}
+
+#endif // VAC_CELL_TABLE_H
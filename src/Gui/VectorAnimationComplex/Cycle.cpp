@@ -10,6 +10,7 @@
 #include "KeyVertex.h"
 #include "KeyEdge.h"
 #include "EdgeGeometry.h"
+#include "Algorithms.h"
 #include "VAC.h"
 
 #include "../SaveAndLoad.h"
@@ -109,17 +110,17 @@ Cycle::Cycle(const KeyEdgeSet & edgeSetConst) :
         }
     }
 
-    // copy the set to be able to modify it
-    KeyEdgeSet edgeSet = edgeSetConst;
+    // index the set by vertices, and remove edges as they are chained
+    Algorithms::IncidentEdges edgeSet(edgeSetConst);
 
     // insert first edge
     halfedges_ << KeyHalfedge(first, true);
-    edgeSet.erase(edgeSet.begin());
+    edgeSet.remove(0);
 
     // check case where it's a pure loop
     if(first->isClosed())
     {
-        if(!edgeSet.isEmpty())
+        if(edgeSet.numRemaining() > 0)
         {
             //QMessageBox::information(0, QObject::tr("operation aborted"),
             //                         QObject::tr("more than one edge and one of them is a pure loop"));
@@ -132,34 +133,22 @@ Cycle::Cycle(const KeyEdgeSet & edgeSetConst) :
     else
     {
         // not a pure loop, let's find the chain
-        while(!edgeSet.isEmpty())
+        while(edgeSet.numRemaining() > 0)
         {
             KeyHalfedge lastAddedHalfedge = halfedges_.last(); // we know it's not a loop, otherwise couldn't be here
             KeyVertex * lastVertex = lastAddedHalfedge.endVertex();  // hence this is a valid vertex
 
-            // find next
+            // find next: the first remaining edge of the set incident to lastVertex
             KeyHalfedge nextHalfedge;
-            auto it = edgeSet.begin();
-            auto itEnd = edgeSet.end();
-            for(;it!=itEnd;++it)
-            {
-                if((*it)->startVertex() == lastVertex)
-                {
-                    nextHalfedge = KeyHalfedge(*it, true);
-                    break;
-                }
-                else if((*it)->endVertex() == lastVertex)
-                {
-                    nextHalfedge = KeyHalfedge(*it, false);
-                    break;
-                }
-            }
+            int next = edgeSet.firstIncidentEdge(lastVertex);
+            if(next != -1)
+                nextHalfedge = KeyHalfedge(edgeSet[next], edgeSet[next]->startVertex() == lastVertex);
 
             // if found: great, insert it!
             if(nextHalfedge.isValid())
             {
                 halfedges_ << nextHalfedge;
-                edgeSet.erase(it);
+                edgeSet.remove(next);
             }
             else
             {
@@ -318,10 +307,22 @@ void Cycle::convertTempIdsToPointers(VAC * vac)
 // Replace pointed edges
 void Cycle::replaceEdges(KeyEdge * oldEdge, const KeyEdgeList & newEdges)
 {
+    // Leave cycles not using oldEdge untouched, and copy the halfedges
+    // before its first use as is, in a single pass over the cycle
+    int first = 0;
+    while(first < halfedges_.size() && halfedges_[first].edge != oldEdge)
+        ++first;
+    if(first == halfedges_.size())
+        return;
+
     QList<KeyHalfedge> newHalfedges;
+    newHalfedges.reserve(halfedges_.size() + newEdges.size() - 1);
+    for(int j=0; j<first; ++j)
+        newHalfedges << halfedges_[j];
 
-    foreach(KeyHalfedge he, halfedges_)
+    for(int j=first; j<halfedges_.size(); ++j)
     {
+        const KeyHalfedge & he = halfedges_[j];
         if(he.edge == oldEdge)
         {
             // Replace halfedge
@@ -381,10 +382,13 @@ double Cycle::length() const
     }
 }
 
-void Cycle::sample(int numSamples, QList<EdgeSample> & out) const
+void Cycle::sample(int numSamples, EdgeSampleVector & out) const
 {
     assert(isValid());
+    if(samplingCache_.get(halfedges_, vertex_, numSamples, s0_, out))
+        return;
     out.clear();
+    out.reserve(numSamples);
 
     if(type() == SingleVertex)
     {
@@ -395,7 +399,8 @@ void Cycle::sample(int numSamples, QList<EdgeSample> & out) const
     }
     else
     {
-        QList<EdgeSample> outAux;
+        EdgeSampleVector outAux;
+        outAux.reserve(numSamples);
 
         assert(numSamples >= 2);
         double l = length();
@@ -405,16 +410,20 @@ void Cycle::sample(int numSamples, QList<EdgeSample> & out) const
         double cumulativeLength = 0;
         int indexHe = 0;
         KeyHalfedge he = halfedges_[indexHe];
+        std::vector<double> heSamples; // arclengths of samples along he, in increasing order
         for(int i=0; i<numSamples; ++i)
         {
             double s = i*ds;
             while ( (s > cumulativeLength + he.length()) && (indexHe+1 < halfedges_.size()) )
             {
+                he.sample(heSamples, outAux);
+                heSamples.clear();
                 cumulativeLength += he.length();
                 he = halfedges_[++indexHe];
             }
-            outAux << he.sample(s-cumulativeLength);
+            heSamples.push_back(s-cumulativeLength);
         }
+        he.sample(heSamples, outAux);
 
         // Apply offset
         int i0 = std::floor( numSamples * s0_ + 0.5);
@@ -428,59 +437,29 @@ void Cycle::sample(int numSamples, QList<EdgeSample> & out) const
             out << outAux[i];
     }
 
+    samplingCache_.set(halfedges_, vertex_, numSamples, s0_, out);
 }
 
-void Cycle::sample(QList<Eigen::Vector2d> & out) const
+void Cycle::sample(Vector2dVector & out) const
 {
     double ds = 3.0;
     double numSamples = length()/ds + 4;
     sample(numSamples,out);
 }
 
-void Cycle::sample(int numSamples, QList<Eigen::Vector2d> & out) const
-    {
+void Cycle::sample(int numSamples, Vector2dVector & out) const
+{
     assert(isValid());
-    out.clear();
-
-    if(type() == SingleVertex)
-    {
-        Eigen::Vector2d pos = singleVertex()->pos();
-        for(int i=0; i<numSamples; ++i)
-            out << pos;
-    }
-    else
-    {
-        QList<Eigen::Vector2d> outAux;
-
-        // Computing unoffset cycle
-        assert(numSamples >= 2);
-        double ds = length()/(numSamples-1);
-
-        double cumulativeLength = 0;
-        int indexHe = 0;
-        KeyHalfedge he = halfedges_[indexHe];
-        for(int i=0; i<numSamples; ++i)
-        {
-            double s = i*ds;
-            while ( (s > cumulativeLength + he.length()) && (indexHe+1 < halfedges_.size()) )
-            {
-                cumulativeLength += he.length();
-                he = halfedges_[++indexHe];
-            }
-            outAux << he.pos(s-cumulativeLength);
-        }
+    if(samplingCache_.get(halfedges_, vertex_, numSamples, s0_, out))
+        return;
 
-        // Apply offset
-        int i0 = std::floor( numSamples * s0_ + 0.5);
-        if(i0 < 0)
-            i0 = 0;
-        if(i0 > numSamples - 1)
-            i0 = numSamples - 1;
-        for(int i=i0; i<numSamples; ++i)
-            out << outAux[i];
-        for(int i=0; i<i0; ++i)
-            out << outAux[i];
-    }
+    // Sample widths too, so that both samplings share the cache
+    EdgeSampleVector samples;
+    sample(numSamples, samples);
+    out.clear();
+    out.reserve(samples.size());
+    foreach(const EdgeSample & s, samples)
+        out << Eigen::Vector2d(s.x(), s.y());
 }
 
 double Cycle::totalCurvature() const
@@ -488,42 +467,44 @@ double Cycle::totalCurvature() const
     CycleType t = type();
 
     if(t == Invalid || t == SingleVertex)
-    {
         return 0;
-    }
-    else
-    {
-        // Compute sampling
-        QList<Eigen::Vector2d> samples;
-        sample(samples);
-
-        // Compute total curvature
-        int n = samples.size();
-        if(n <= 4)
-            return 0;
-        double res = 0;
-        for(int i=0; i<n-1; ++i) // note, last sample ignored, since first == last
-        {
-            // Find three points involved
-            int ia = (n-1+i-1) % (n-1);
-            int ib = (n-1+i)   % (n-1);
-            int ic = (n-1+i+1) % (n-1);
-            Eigen::Vector2d a = samples[ia];
-            Eigen::Vector2d b = samples[ib];
-            Eigen::Vector2d c = samples[ic];
 
+    double res = 0;
+    if(samplingCache_.getTotalCurvature(halfedges_, vertex_, s0_, res))
+        return res;
+
+    // Compute sampling, same as sample(Vector2dVector&), but without
+    // converting it
+    double ds = 3.0;
+    int numSamples = length()/ds + 4;
+    EdgeSampleVector samples;
+    sample(numSamples, samples);
+
+    // Compute total curvature. Note: the last sample is ignored, since
+    // first == last
+    int n = samples.size() - 1;
+    if(n >= 4)
+    {
+        Eigen::Vector2d a(samples[n-1].x(), samples[n-1].y());
+        Eigen::Vector2d b(samples[0].x(), samples[0].y());
+        Eigen::Vector2d ab = b-a;
+        for(int i=0; i<n; ++i)
+        {
             // Compute diff of angle between AB and BC
-            Eigen::Vector2d ab = b-a;
+            const EdgeSample & s = samples[(i+1) % n];
+            Eigen::Vector2d c(s.x(), s.y());
             Eigen::Vector2d bc = c-b;
             double dot = ab[0]*bc[0] + ab[1]*bc[1];
             double det = ab[0]*bc[1] - ab[1]*bc[0];
-            double angle = std::atan2(det,dot);
+            res += std::atan2(det,dot);
 
-            // Accumulate curvature
-            res += angle;
+            b = c;
+            ab = bc;
         }
-        return res;
     }
+
+    samplingCache_.setTotalCurvature(halfedges_, vertex_, s0_, res);
+    return res;
 }
 
 int Cycle::turningNumber() const
@@ -13,6 +13,7 @@
 
 #include <QList>
 #include "KeyHalfedge.h"
+#include "PathSamplingCache.h"
 #include "Eigen.h"
 #include "ProperCycle.h"
 #include "EdgeSample.h"
@@ -84,9 +85,9 @@ public:
     // geometry
     double length() const;
 
-    void sample(QList<Eigen::Vector2d> & out) const; // Note: out[0] == out[n-1]
-    void sample(int numSamples, QList<Eigen::Vector2d> & out) const;
-    void sample(int numSamples, QList<EdgeSample> & out) const;
+    void sample(Vector2dVector & out) const; // Note: out[0] == out[n-1]
+    void sample(int numSamples, Vector2dVector & out) const;
+    void sample(int numSamples, EdgeSampleVector & out) const;
 
     // Curvature-related methods
     double totalCurvature() const;
@@ -114,6 +115,9 @@ private:
 
     // sorted list of instant edges
     QList<KeyHalfedge> halfedges_;
+
+    // last uniform sampling
+    PathSamplingCache samplingCache_;
 };
 
 } // end namespace VectorAnimationComplex
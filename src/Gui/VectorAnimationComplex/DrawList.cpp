@@ -0,0 +1,504 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#include "DrawList.h"
+
+#include "Cell.h"
+#include "GeometryCache.h"
+#include "Triangles.h"
+#include "../GLUtils.h"
+#include "../RenderStats.h"
+#include "../ViewSettings.h"
+
+#include <QOpenGLContext>
+#include <algorithm>
+#include <cmath>
+
+namespace VectorAnimationComplex
+{
+
+DrawList::DrawList(int maxNumFrames, Mode mode) :
+    frames_(),
+    counter_(0),
+    maxNumFrames_(maxNumFrames),
+    mode_(mode),
+    transformedCells_(),
+    transform_(Eigen::Affine2d::Identity())
+{
+}
+
+DrawList::~DrawList()
+{
+    clear();
+}
+
+void DrawList::clear()
+{
+    for (auto it = frames_.begin(); it != frames_.end(); ++it)
+        releaseFrame_(it.value(), it.key().first);
+    frames_.clear();
+}
+
+void DrawList::setTransformedCells(const CellSet & cells, const Eigen::Affine2d & xf)
+{
+    transformedCells_ = cells;
+    transform_ = xf;
+}
+
+void DrawList::clearTransformedCells()
+{
+    transformedCells_.clear();
+}
+
+// On average, there is one run boundary every 256 cells. We mix the bits of
+// the ID since consecutive IDs are typically consecutive in z-order too.
+bool DrawList::isRunBoundary_(Cell * cell)
+{
+    unsigned int h = static_cast<unsigned int>(cell->id()) * 2654435761u;
+    return (h >> 24) == 0;
+}
+
+bool DrawList::isBatchable_(Cell * cell, Time time) const
+{
+    return mode_ == Topology || cell->isBatchable(time);
+}
+
+const Triangles & DrawList::drawnTriangles_(Cell * cell, Time time, ViewSettings & viewSettings) const
+{
+    if (mode_ == Topology)
+        return cell->drawnTopologyTriangles(time, viewSettings);
+    else
+        return cell->drawnTriangles(time, viewSettings);
+}
+
+QColor DrawList::drawColor_(Cell * cell, Time time, ViewSettings & viewSettings) const
+{
+    if (mode_ == Topology)
+        return cell->topologyColor();
+    else
+        return cell->drawColor(time, viewSettings);
+}
+
+void DrawList::draw(ZOrderedCells & zOrdering, Time time, ViewSettings & viewSettings)
+{
+    // Without a current context, vertex buffers can't be created
+    QOpenGLContextGroup * group = QOpenGLContextGroup::currentContextGroup();
+    if (!group)
+    {
+        for (Cell * c: zOrdering)
+        {
+            bool isTransformed = transformedCells_.contains(c);
+            if (isTransformed)
+            {
+                glPushMatrix();
+                GLUtils::multMatrix(transform_);
+            }
+            if (mode_ == Topology)
+                c->drawTopology(time, viewSettings);
+            else
+                c->draw(time, viewSettings);
+            if (isTransformed)
+                glPopMatrix();
+        }
+        return;
+    }
+    GLUtils::deleteOrphanedBuffers();
+
+    // Get runs drawn last time for this (group, time) pair
+    int timeKey = GeometryCache::timeKey(time);
+    Frame & frame = frames_[FrameKey(group, timeKey)];
+    frame.lastUsed = ++counter_;
+    for (Run & run: frame.runs)
+        run.isUsed = false;
+
+    // Get visible rect
+    BoundingBox visibleRect(viewSettings.visibleXMin(), viewSettings.visibleXMax(),
+                            viewSettings.visibleYMin(), viewSettings.visibleYMax());
+
+    // Draw cells, in z-order
+    std::vector<Cell*> cells;
+    for (Cell * c: zOrdering)
+    {
+        if (!c->exists(time))
+            continue;
+
+        if (!transformedCells_.isEmpty() && transformedCells_.contains(c))
+        {
+            drawRun_(frame, cells, time, viewSettings, visibleRect);
+            cells.clear();
+            glPushMatrix();
+            GLUtils::multMatrix(transform_);
+            if (mode_ == Topology)
+                c->drawTopology(time, viewSettings);
+            else
+                c->draw(time, viewSettings);
+            glPopMatrix();
+        }
+        else if (isBatchable_(c, time))
+        {
+            cells.push_back(c);
+            if (isRunBoundary_(c))
+            {
+                drawRun_(frame, cells, time, viewSettings, visibleRect);
+                cells.clear();
+            }
+        }
+        else
+        {
+            drawRun_(frame, cells, time, viewSettings, visibleRect);
+            cells.clear();
+            if (c->boundingBox(time).intersects(visibleRect))
+                c->draw(time, viewSettings);
+        }
+    }
+    drawRun_(frame, cells, time, viewSettings, visibleRect);
+
+    // Release runs which do not exist anymore
+    for (auto it = frame.runs.begin(); it != frame.runs.end(); )
+    {
+        if (it.value().isUsed)
+        {
+            ++it;
+        }
+        else
+        {
+            releaseRun_(it.value(), group);
+            it = frame.runs.erase(it);
+        }
+    }
+
+    // Release least recently used frames
+    evictFrames_();
+}
+
+void DrawList::drawRun_(Frame & frame, std::vector<Cell*> & cells,
+                        Time time, ViewSettings & viewSettings,
+                        const BoundingBox & visibleRect)
+{
+    if (cells.empty())
+        return;
+
+    // Compute stamps and colors
+    std::vector<CellStamp> stamps;
+    std::vector<QColor> colors;
+    stamps.reserve(cells.size());
+    colors.reserve(cells.size());
+    for (Cell * c: cells)
+    {
+        CellStamp stamp;
+        stamp.id = c->id();
+        stamp.geometryVersion = c->geometryVersion();
+        const Triangles & triangles = drawnTriangles_(c, time, viewSettings);
+        stamp.triangles = &triangles;
+        stamp.numTriangles = triangles.size();
+        stamps.push_back(stamp);
+        colors.push_back(drawColor_(c, time, viewSettings));
+    }
+
+    // Get run. It is keyed by its boundary cell, if any, rather than by its
+    // first cell, so that reordering its other cells does not change its key
+    int key = isRunBoundary_(cells.back()) ? cells.back()->id() : cells.front()->id();
+    Run & run = frame.runs[key];
+    run.isUsed = true;
+
+    // If the run has the same cells, with the same geometry, possibly in
+    // another order (e.g. after raise() or lower()), only the order in which
+    // their triangles are drawn changes. Otherwise, rebuild the run.
+    std::vector<int> order;
+    if (findOrder_(run, stamps, order))
+    {
+        bool isIdentity = true;
+        for (size_t k=0; k<order.size(); ++k)
+            isIdentity = isIdentity && (order[k] == (int) k);
+        if (isIdentity)
+            order.clear();
+        if (order != run.drawOrder)
+        {
+            run.drawOrder.swap(order);
+            RenderStats::add(RenderStats::RunsReordered);
+        }
+
+        // Colors are stored in the order of the buffers
+        if (!run.drawOrder.empty())
+        {
+            std::vector<QColor> storedColors(colors.size());
+            for (size_t k=0; k<run.drawOrder.size(); ++k)
+                storedColors[run.drawOrder[k]] = colors[k];
+            colors.swap(storedColors);
+        }
+    }
+    else
+    {
+        int numIndices = 0;
+        for (const CellStamp & stamp: stamps)
+            numIndices += 3 * stamp.numTriangles;
+        run.firstVertices.clear();
+        run.firstVertices.reserve(cells.size() + 1);
+        run.firstVertices.push_back(0);
+        for (Cell * c: cells)
+            run.firstVertices.push_back(run.firstVertices.back() +
+                                        drawnTriangles_(c, time, viewSettings).numVertices());
+        run.firstIndices.clear();
+        run.firstIndices.reserve(cells.size() + 1);
+        run.firstIndices.push_back(0);
+        for (const CellStamp & stamp: stamps)
+            run.firstIndices.push_back(run.firstIndices.back() + 3 * stamp.numTriangles);
+        run.drawOrder.clear();
+
+        std::vector<Vertex> vertices;
+        std::vector<GLuint> indices;
+        vertices.reserve(run.firstVertices.back());
+        indices.reserve(numIndices);
+        run.boundingBox = BoundingBox();
+        for (Cell * c: cells)
+        {
+            const Triangles & triangles = drawnTriangles_(c, time, viewSettings);
+            run.boundingBox.unite(triangles.boundingBox());
+            const TriangleScalar * data = triangles.vertexData();
+            const GLuint base = vertices.size();
+            int n = triangles.numVertices();
+            for (int i=0; i<n; ++i)
+            {
+                Vertex v;
+                v.x = data[2*i];
+                v.y = data[2*i+1];
+                vertices.push_back(v);
+            }
+            const unsigned int * cellIndices = triangles.indexData();
+            int m = 3 * triangles.size();
+            for (int i=0; i<m; ++i)
+                indices.push_back(base + (cellIndices ? cellIndices[i] : i));
+        }
+        std::vector<Color> vertexColors;
+        fillColors_(run, colors, 0, cells.size(), vertexColors);
+
+        run.numIndices = numIndices;
+        run.stamps.swap(stamps);
+        run.colors = colors;
+        run.idToIndex.clear();
+        RenderStats::add(RenderStats::RunsRebuilt);
+        if (GLEW_VERSION_1_5)
+        {
+            if (!run.buffer)
+                glGenBuffers(1, &run.buffer);
+            if (!run.colorBuffer)
+                glGenBuffers(1, &run.colorBuffer);
+            if (!run.indexBuffer)
+                glGenBuffers(1, &run.indexBuffer);
+            glBindBuffer(GL_ARRAY_BUFFER, run.buffer);
+            glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex),
+                         vertices.data(), GL_STATIC_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, run.colorBuffer);
+            glBufferData(GL_ARRAY_BUFFER, vertexColors.size() * sizeof(Color),
+                         vertexColors.data(), GL_DYNAMIC_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, run.indexBuffer);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint),
+                         indices.data(), GL_STATIC_DRAW);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+            run.vertices.clear();
+            run.vertexColors.clear();
+            run.indices.clear();
+        }
+        else
+        {
+            run.vertices.swap(vertices);
+            run.vertexColors.swap(vertexColors);
+            run.indices.swap(indices);
+        }
+    }
+
+    // If colors changed, e.g. the highlighting or selection of a few cells,
+    // only rewrite the colors from the first to the last changed cell
+    if (run.colors != colors)
+    {
+        int first = 0;
+        int last = colors.size() - 1;
+        while (run.colors[first] == colors[first])
+            ++first;
+        while (run.colors[last] == colors[last])
+            --last;
+        std::vector<Color> vertexColors;
+        fillColors_(run, colors, first, last + 1, vertexColors);
+        run.colors.swap(colors);
+        if (run.colorBuffer)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, run.colorBuffer);
+            glBufferSubData(GL_ARRAY_BUFFER, run.firstVertices[first] * sizeof(Color),
+                            vertexColors.size() * sizeof(Color), vertexColors.data());
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+        else
+        {
+            std::copy(vertexColors.begin(), vertexColors.end(),
+                      run.vertexColors.begin() + run.firstVertices[first]);
+        }
+        RenderStats::add(RenderStats::RunsRecolored);
+    }
+
+    // Draw run
+    if (run.numIndices == 0 || !run.boundingBox.intersects(visibleRect))
+        return;
+    RenderStats::add(RenderStats::CellsDrawn, cells.size());
+    RenderStats::add(RenderStats::TrianglesSubmitted, run.numIndices / 3);
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    const GLuint * indices = 0; // pointer or offset of the indices
+    if (run.buffer)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, run.buffer);
+        glVertexPointer(2, GL_FLOAT, 0, 0);
+        glBindBuffer(GL_ARRAY_BUFFER, run.colorBuffer);
+        glColorPointer(4, GL_FLOAT, 0, 0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, run.indexBuffer);
+    }
+    else
+    {
+        glVertexPointer(2, GL_FLOAT, 0, run.vertices.data());
+        glColorPointer(4, GL_FLOAT, 0, run.vertexColors.data());
+        indices = run.indices.data();
+    }
+    if (run.drawOrder.empty())
+    {
+        glDrawElements(GL_TRIANGLES, run.numIndices, GL_UNSIGNED_INT, indices);
+    }
+    else
+    {
+        // One range of indices per cell in z-order, merging consecutive ones
+        std::vector<GLsizei> counts;
+        std::vector<const GLvoid *> offsets;
+        int end = -1;
+        for (int k: run.drawOrder)
+        {
+            int first = run.firstIndices[k];
+            int count = run.firstIndices[k+1] - first;
+            if (count == 0)
+                continue;
+            if (first == end)
+            {
+                counts.back() += count;
+            }
+            else
+            {
+                counts.push_back(count);
+                offsets.push_back(indices + first);
+            }
+            end = first + count;
+        }
+        if (GLEW_VERSION_1_4)
+        {
+            glMultiDrawElements(GL_TRIANGLES, counts.data(), GL_UNSIGNED_INT,
+                                offsets.data(), counts.size());
+        }
+        else
+        {
+            for (size_t i=0; i<counts.size(); ++i)
+                glDrawElements(GL_TRIANGLES, counts[i], GL_UNSIGNED_INT, offsets[i]);
+        }
+    }
+    if (run.buffer)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    }
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+// If stamps are the stamps of the cells of the run, in any order, sets order
+// to the index in the run of each of them, and returns true
+bool DrawList::findOrder_(Run & run, const std::vector<CellStamp> & stamps,
+                          std::vector<int> & order)
+{
+    if (run.stamps.size() != stamps.size() || run.stamps.empty())
+        return false;
+
+    order.resize(stamps.size());
+    bool isSameOrder = true;
+    for (size_t k=0; k<stamps.size(); ++k)
+    {
+        isSameOrder = isSameOrder && (run.stamps[k] == stamps[k]);
+        order[k] = k;
+    }
+    if (isSameOrder)
+        return true;
+
+    if (run.idToIndex.isEmpty())
+    {
+        for (size_t k=0; k<run.stamps.size(); ++k)
+            run.idToIndex.insert(run.stamps[k].id, k);
+    }
+    for (size_t k=0; k<stamps.size(); ++k)
+    {
+        auto it = run.idToIndex.constFind(stamps[k].id);
+        if (it == run.idToIndex.constEnd() || !(run.stamps[it.value()] == stamps[k]))
+            return false;
+        order[k] = it.value();
+    }
+    return true;
+}
+
+// Per-vertex colors of the cells of the run from begin to end (excluded)
+void DrawList::fillColors_(const Run & run, const std::vector<QColor> & colors,
+                           int begin, int end, std::vector<Color> & out)
+{
+    out.clear();
+    out.reserve(run.firstVertices[end] - run.firstVertices[begin]);
+    for (int k=begin; k<end; ++k)
+    {
+        const QColor & color = colors[k];
+        Color c;
+        c.r = color.redF();
+        c.g = color.greenF();
+        c.b = color.blueF();
+        c.a = color.alphaF();
+        out.insert(out.end(), run.firstVertices[k+1] - run.firstVertices[k], c);
+    }
+}
+
+void DrawList::releaseRun_(Run & run, QOpenGLContextGroup * group)
+{
+    if (run.buffer)
+    {
+        GLUtils::deleteBuffer(run.buffer, group);
+        run.buffer = 0;
+    }
+    if (run.colorBuffer)
+    {
+        GLUtils::deleteBuffer(run.colorBuffer, group);
+        run.colorBuffer = 0;
+    }
+    if (run.indexBuffer)
+    {
+        GLUtils::deleteBuffer(run.indexBuffer, group);
+        run.indexBuffer = 0;
+    }
+}
+
+void DrawList::releaseFrame_(Frame & frame, QOpenGLContextGroup * group)
+{
+    for (Run & run: frame.runs)
+        releaseRun_(run, group);
+    frame.runs.clear();
+}
+
+void DrawList::evictFrames_()
+{
+    while (frames_.size() > maxNumFrames_)
+    {
+        auto lru = frames_.begin();
+        for (auto it = frames_.begin(); it != frames_.end(); ++it)
+            if (it.value().lastUsed < lru.value().lastUsed)
+                lru = it;
+        releaseFrame_(lru.value(), lru.key().first);
+        frames_.erase(lru);
+    }
+}
+
+}
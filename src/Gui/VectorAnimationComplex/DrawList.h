@@ -0,0 +1,176 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#ifndef VAC_DRAW_LIST_H
+#define VAC_DRAW_LIST_H
+
+// DrawList: draws all the cells of a ZOrderedCells at a given time, packing
+// runs of cells which are consecutive in z-order into large position and
+// color vertex buffers, with index buffers to share vertices between
+// triangles. This way, the number of draw calls is roughly
+// independent of the number of cells.
+//
+// Cells of a run which are only reordered, e.g. by raise() or lower(), keep
+// their vertices and indices: only the order in which their ranges of indices
+// are drawn changes, with one glMultiDrawElements() call.
+//
+// Colors are in a buffer of their own, so that a change of color only, e.g.
+// changing the color of selected cells, or their highlighting when hovered or
+// selected, rewrites the colors of the changed cells in place instead of
+// rebuilding their run.
+//
+// Runs are split at cells whose ID satisfy some hash condition, so that the
+// boundaries of runs do not depend on the position of cells in the z-ordering:
+// inserting, deleting or modifying a cell only invalidates the run containing
+// it, all other runs are reused as is. Runs are also split at cells which are
+// not batchable (see Cell::isBatchable()), which are drawn individually.
+//
+// Vertex buffers are specific to an OpenGL share group and a time, so one set
+// of runs is kept per (group, time) pair, for the few most recently drawn ones
+// (by default 8, but the 3D view uses one for all frames it draws). Since all
+// views share the same group, views showing the same time share their runs.
+//
+// Runs whose bounding box is outside of the visible rect of the view settings
+// are not drawn. Culling is done per run rather than per cell, so that panning
+// does not invalidate runs.
+//
+// A draw list either draws cells as in illustration mode (Cell::draw()), or
+// as in outline mode (Cell::drawTopology()), where all cells are batchable:
+// edges are strokes of the topology width, and vertices are disks.
+
+#include "../TimeDef.h"
+#include "../OpenGL.h"
+#include "ZOrderedCells.h"
+#include "BoundingBox.h"
+#include "CellList.h"
+#include "Eigen.h"
+
+#include <QMap>
+#include <QPair>
+#include <QHash>
+#include <QColor>
+#include <vector>
+
+class ViewSettings;
+class QOpenGLContextGroup;
+
+namespace VectorAnimationComplex
+{
+
+class Cell;
+
+class DrawList
+{
+public:
+    enum Mode {
+        Illustration,
+        Topology
+    };
+    DrawList(int maxNumFrames = 8, Mode mode = Illustration);
+    ~DrawList();
+
+    // Release all vertex buffers
+    void clear();
+
+    // Draw all cells, in z-order. Same as calling c->draw(time, viewSettings)
+    // (resp. c->drawTopology(time, viewSettings)) for all cells c in
+    // zOrdering.
+    void draw(ZOrderedCells & zOrdering, Time time, ViewSettings & viewSettings);
+
+    // Cells drawn individually under the given transformation, e.g., while
+    // they are being transformed (see TransformTool::isPreviewing()), so that
+    // neither their geometry nor the runs of other cells are rebuilt
+    void setTransformedCells(const CellSet & cells, const Eigen::Affine2d & xf);
+    void clearTransformedCells();
+
+private:
+    // Vertex data, in two separate buffers
+    struct Vertex
+    {
+        GLfloat x, y;
+    };
+    struct Color
+    {
+        GLfloat r, g, b, a;
+    };
+
+    // Everything about a cell which affects the vertices of its run, except
+    // its color
+    struct CellStamp
+    {
+        int id;
+        unsigned int geometryVersion;
+        const Triangles * triangles; // differs e.g. for each level of detail
+        int numTriangles;
+        bool operator==(const CellStamp & other) const
+        {
+            return id == other.id &&
+                   geometryVersion == other.geometryVersion &&
+                   triangles == other.triangles &&
+                   numTriangles == other.numTriangles;
+        }
+    };
+
+    // A run of consecutive batchable cells
+    struct Run
+    {
+        Run() : buffer(0), colorBuffer(0), indexBuffer(0), numIndices(0), isUsed(false) {}
+        std::vector<CellStamp> stamps;
+        std::vector<QColor> colors;        // one per cell
+        std::vector<int> firstVertices;    // one per cell, plus the total
+        std::vector<int> firstIndices;     // one per cell, plus the total
+        std::vector<int> drawOrder;        // index of each cell in z-order, empty if identity
+        QHash<int, int> idToIndex;         // built on first reorder
+        std::vector<Vertex> vertices;      // only kept when no buffer
+        std::vector<Color> vertexColors;   // only kept when no buffer
+        std::vector<GLuint> indices;       // only kept when no buffer
+        BoundingBox boundingBox;
+        GLuint buffer;
+        GLuint colorBuffer;
+        GLuint indexBuffer;
+        int numIndices;
+        bool isUsed;
+    };
+
+    // All runs drawn for a given (group, time) pair, by ID of first cell
+    struct Frame
+    {
+        Frame() : lastUsed(0) {}
+        QHash<int, Run> runs;
+        unsigned int lastUsed;
+    };
+    typedef QPair<QOpenGLContextGroup *, int> FrameKey;
+    QMap<FrameKey, Frame> frames_;
+    unsigned int counter_;
+    int maxNumFrames_; // maximum number of (group, time) pairs for which runs are kept
+    Mode mode_;
+    CellSet transformedCells_;
+    Eigen::Affine2d transform_;
+
+    // Helper methods
+    void drawRun_(Frame & frame, std::vector<Cell*> & cells,
+                  Time time, ViewSettings & viewSettings,
+                  const BoundingBox & visibleRect);
+    static bool findOrder_(Run & run, const std::vector<CellStamp> & stamps,
+                           std::vector<int> & order);
+    static void fillColors_(const Run & run, const std::vector<QColor> & colors,
+                            int begin, int end, std::vector<Color> & out);
+    void releaseRun_(Run & run, QOpenGLContextGroup * group);
+    void releaseFrame_(Frame & frame, QOpenGLContextGroup * group);
+    void evictFrames_();
+    static bool isRunBoundary_(Cell * cell);
+
+    // What is drawn depending on mode_
+    bool isBatchable_(Cell * cell, Time time) const;
+    const Triangles & drawnTriangles_(Cell * cell, Time time, ViewSettings & viewSettings) const;
+    QColor drawColor_(Cell * cell, Time time, ViewSettings & viewSettings) const;
+};
+
+}
+
+#endif // VAC_DRAW_LIST_H
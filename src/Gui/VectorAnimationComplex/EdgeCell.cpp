@@ -12,13 +12,22 @@
 #include "VAC.h"
 #include "../Random.h"
 #include "../DevSettings.h"
+#include "../RenderStats.h"
 #include "../Global.h"
 #include <cmath>
 #include <QtDebug>
 #include <QTextStream>
+
+namespace
+{
+// Coarsest level of detail, see EdgeCell::levelOfDetail()
+const int MAX_LEVEL_OF_DETAIL = 8;
+}
 #include "../SaveAndLoad.h"
 #include "../CssColor.h"
 #include "EdgeGeometry.h"
+#include "GeometryCache.h"
+#include "../IO/SvgStreamWriter.h"
 
 namespace VectorAnimationComplex
 {
@@ -26,6 +35,7 @@ namespace VectorAnimationComplex
 EdgeCell::EdgeCell(VAC * vac) :
     Cell(vac)
 {
+    addKindBit_(EdgeCellBit);
     QColor edgeColor = global()->edgeColor();
     color_[0] = edgeColor.redF();
     color_[1] = edgeColor.greenF();
@@ -42,6 +52,7 @@ EdgeCell::EdgeCell(VAC * vac) :
 EdgeCell::EdgeCell(VAC * vac, QTextStream & in) :
     Cell(vac, in)
 {
+    addKindBit_(EdgeCellBit);
     // highlighted/selected color
     colorSelected_[0] = 1;
     colorSelected_[1] = 0;
@@ -52,6 +63,7 @@ EdgeCell::EdgeCell(VAC * vac, QTextStream & in) :
 EdgeCell::EdgeCell(VAC * vac, XmlStreamReader & xml) :
     Cell(vac, xml)
 {
+    addKindBit_(EdgeCellBit);
     // highlighted/selected color
     colorSelected_[0] = 1;
     colorSelected_[1] = 0;
@@ -112,13 +124,23 @@ void EdgeCell::clearCachedGeometry_()
 {
     Cell::clearCachedGeometry_();
     trianglesTopo_.clear();
+    trianglesLevelOfDetail_.clear();
+}
+
+void EdgeCell::translateCachedGeometry_(double dx, double dy)
+{
+    Cell::translateCachedGeometry_(dx, dy);
+    for(auto it = trianglesTopo_.begin(); it != trianglesTopo_.end(); ++it)
+        it.value().translate(dx, dy);
+    for(auto it = trianglesLevelOfDetail_.begin(); it != trianglesLevelOfDetail_.end(); ++it)
+        it.value().translate(dx, dy);
 }
 
 void EdgeCell::computeOutlineBoundingBox_(Time t, BoundingBox & out) const
 {
     if (exists(t))
     {
-        const QList<EdgeSample> samples = getSampling(t);
+        const EdgeSampleVector samples = getSampling(t);
         out = BoundingBox();
         for (int i = 0; i<samples.size(); ++i)
             out.unite(BoundingBox(samples[i].x(), samples[i].y()));
@@ -132,50 +154,124 @@ void EdgeCell::computeOutlineBoundingBox_(Time t, BoundingBox & out) const
 const Triangles & EdgeCell::triangles(double width, Time time) const
 {
     // Get cache key
-    QPair<int,double> key = qMakePair(std::floor(time.floatTime() * 60 + 0.5), width);
+    QPair<int,double> key = qMakePair(GeometryCache::timeKey(time), width);
 
     // Compute triangles if not yet cached
     if(!trianglesTopo_.contains(key))
-        triangulate_(width, time, trianglesTopo_[key]);
+    {
+        Triangles & triangles = trianglesTopo_[key];
+        triangulate_(width, time, triangles);
+        RenderStats::add(RenderStats::Triangulations);
+        triangles.setRetained(true);
+    }
 
     // Return cached triangles
     return trianglesTopo_[key];
 }
 
-void EdgeCell::drawRawTopology(Time time, ViewSettings & viewSettings)
+int EdgeCell::levelOfDetail(ViewSettings & viewSettings)
 {
-    bool screenRelative = viewSettings.screenRelative();
-    if(screenRelative)
+    static const DevSettings::Bool levelOfDetail("level of detail");
+    if(!levelOfDetail)
+        return 0;
+
+    int level = 0;
+    double zoom = viewSettings.zoom();
+    while(zoom < 1 && level < MAX_LEVEL_OF_DETAIL)
     {
-        triangles(viewSettings.edgeTopologyWidth() / viewSettings.zoom(), time).draw();
+        zoom *= 2;
+        ++level;
     }
-    else
+    return level;
+}
+
+const Triangles & EdgeCell::triangles(Time time, int levelOfDetail) const
+{
+    if(levelOfDetail <= 0)
+        return triangles(time);
+
+    // Get cache key
+    QPair<int,int> key = qMakePair(GeometryCache::timeKey(time), levelOfDetail);
+
+    // Compute triangles if not yet cached
+    if(!trianglesLevelOfDetail_.contains(key))
     {
-        triangles(viewSettings.edgeTopologyWidth(), time).draw();
+        Triangles & triangles = trianglesLevelOfDetail_[key];
+        if(exists(time))
+        {
+            LinearSpline ls(levelOfDetailSampling(time, levelOfDetail));
+            if(isClosed())
+                ls.makeLoop();
+            ls.triangulateLevelOfDetail(levelOfDetail, triangles);
+            RenderStats::add(RenderStats::Triangulations);
+        }
+        triangles.setRetained(true);
     }
+
+    // Return cached triangles
+    return trianglesLevelOfDetail_[key];
+}
+
+// By default, the level of detail is only simplified from the full sampling
+EdgeSampleVector EdgeCell::levelOfDetailSampling(Time time, int /*levelOfDetail*/) const
+{
+    return getSampling(time);
+}
+
+void EdgeCell::drawRaw(Time time, ViewSettings & viewSettings)
+{
+    triangles(time, levelOfDetail(viewSettings)).draw();
+}
+
+const Triangles & EdgeCell::drawnTriangles(Time time, ViewSettings & viewSettings) const
+{
+    return triangles(time, levelOfDetail(viewSettings));
+}
+
+double EdgeCell::topologyWidth(ViewSettings & viewSettings)
+{
+    double width = viewSettings.edgeTopologyWidth();
+    if(viewSettings.screenRelative())
+        width /= viewSettings.zoom();
+    return width;
+}
+
+void EdgeCell::drawRawTopology(Time time, ViewSettings & viewSettings)
+{
+    drawnTopologyTriangles(time, viewSettings).draw();
+}
+
+const Triangles & EdgeCell::drawnTopologyTriangles(Time time, ViewSettings & viewSettings) const
+{
+    return triangles(topologyWidth(viewSettings), time);
+}
+
+double EdgeCell::pickTopologyDistanceCustom(double x, double y, Time time, ViewSettings & viewSettings)
+{
+    return drawnTopologyTriangles(time, viewSettings).distance(Eigen::Vector2d(x,y));
 }
 
 EdgeSample EdgeCell::startSample(Time time) const
 {
-    QList<EdgeSample> sampling = getSampling(time);
-    if(sampling.isEmpty())
+    EdgeSampleVector sampling = getSampling(time);
+    if(sampling.empty())
         return EdgeSample();
     else
-        return sampling.first();
+        return sampling.front();
 }
 
 EdgeSample EdgeCell::endSample(Time time) const
 {
-    QList<EdgeSample> sampling = getSampling(time);
-    if(sampling.isEmpty())
+    EdgeSampleVector sampling = getSampling(time);
+    if(sampling.empty())
         return EdgeSample();
     else
-        return sampling.last();
+        return sampling.back();
 }
 
-void EdgeCell::exportSVG(Time t, QTextStream & out)
+void EdgeCell::exportSVG(Time t, SvgStreamWriter & out)
 {
-    QList<EdgeSample> samples = getSampling(t);
+    EdgeSampleVector samples = getSampling(t);
     LinearSpline ls(samples);
     if(isClosed())
         ls.makeLoop();
@@ -198,6 +294,7 @@ EdgeCell::~EdgeCell()
 EdgeCell::EdgeCell(EdgeCell * other) :
     Cell(other)
 {
+    addKindBit_(EdgeCellBit);
     // highlighted/selected color
     colorSelected_[0] = 1;
     colorSelected_[1] = 0;
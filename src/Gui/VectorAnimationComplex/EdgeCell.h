@@ -37,21 +37,41 @@ public:
     // Drawing
     using Cell::triangles;
     const Triangles & triangles(double width, Time time) const;
+    void drawRaw(Time time, ViewSettings & viewSettings);
     void drawRawTopology(Time time, ViewSettings & viewSettings);
+    const Triangles & drawnTriangles(Time time, ViewSettings & viewSettings) const;
+    const Triangles & drawnTopologyTriangles(Time time, ViewSettings & viewSettings) const;
+
+    // Width of edges in topology mode, in scene units
+    static double topologyWidth(ViewSettings & viewSettings);
+
+    // Level of detail. When zoomed out, edges are drawn, on screen and for
+    // picking, from coarser triangles (see
+    // LinearSpline::triangulateLevelOfDetail()), so that their number of
+    // triangles follows their size on screen rather than their number of
+    // samples. Level 0 is full detail, i.e. triangles(time), and each level
+    // is meant for a zoom twice smaller than the previous one
+    static int levelOfDetail(ViewSettings & viewSettings);
+    const Triangles & triangles(Time time, int levelOfDetail) const;
 
     // Geometric getters
-    virtual QList<EdgeSample> getSampling(Time time) const = 0;
+    virtual EdgeSampleVector getSampling(Time time) const = 0;
+    virtual EdgeSampleVector levelOfDetailSampling(Time time, int levelOfDetail) const;
     virtual EdgeSample startSample(Time time) const;
     virtual EdgeSample endSample(Time time) const;
 
     // Export SVG
-    virtual void exportSVG(Time t, QTextStream & out);
+    virtual void exportSVG(Time t, SvgStreamWriter & out);
 
 protected:
     // Special handling to draw edges of fixed screen-width in topology mode
     // (int=time, double=width)
     mutable QMap< QPair<int,double>, Triangles> trianglesTopo_;
+
+    // Coarser levels of detail (int=time, int=level)
+    mutable QMap< QPair<int,int>, Triangles> trianglesLevelOfDetail_;
     virtual void clearCachedGeometry_();
+    virtual void translateCachedGeometry_(double dx, double dy);
     virtual void triangulate_(double width, Time time, Triangles & out) const=0;
 
 private:
@@ -60,6 +80,7 @@ private:
     bool checkEdge_() const;
 
     virtual bool isPickableCustom(Time time) const;
+    virtual double pickTopologyDistanceCustom(double x, double y, Time time, ViewSettings & viewSettings);
 
     // Implementation of outline bounding box for both KeyVertex and InbetweenVertex
     void computeOutlineBoundingBox_(Time t, BoundingBox & out) const;
@@ -7,14 +7,19 @@
 // directory of this distribution and at http://opensource.org/licenses/MIT
 
 #include "EdgeGeometry.h"
+#include "BezierSpline.h"
 
 #include <QTextStream>
 #include "../XmlStreamWriter.h"
 #include "../XmlStreamReader.h"
+#include "../IO/BinaryContainer.h"
+#include "../IO/SvgStreamWriter.h"
+#include "../NumberParser.h"
 
 #include "../SaveAndLoad.h"
 #include "../OpenGL.h"
 #include <cmath>
+#include <algorithm>
 #include "../DevSettings.h"
 #include <QtDebug>
 
@@ -63,18 +68,50 @@ EdgeGeometry * EdgeGeometry::clone()
  }
 
  EdgeGeometry * EdgeGeometry::read(XmlStreamReader & xml)
+ {
+     return read(xml.attributes().value("curve"), xml.binaryBlocks());
+ }
+
+ EdgeGeometry * EdgeGeometry::read(const QStringRef & str, const QByteArray * blocks)
  {
      // Find curve type and data
-     QStringRef str =  xml.attributes().value("curve");
      int i = str.indexOf('(');
      QStringRef curveType = str.left(i);
      QStringRef curveData = str.mid(i+1, str.length()-i-2);
 
      // Switch on type
-     if(curveType == "xywdense")
-         return new LinearSpline(curveData);
+     if(curveType == "xywdense" || curveType == "xywadaptive")
+     {
+         return new LinearSpline(curveData, curveType == "xywadaptive");
+     }
+     else if(curveType == "bezier")
+     {
+         return new BezierSpline(curveData);
+     }
+     else if((curveType == "xywblock" || curveType == "xywadaptiveblock" || curveType == "bezierblock") && blocks)
+     {
+         // Same data as xywdense (resp. xywadaptive, bezier), but stored in a binary block
+         QStringList strList = curveData.toString().split(' ', QString::SkipEmptyParts);
+         QVector<double> d;
+         if(strList.size() == 2 &&
+            BinaryContainer::readDoubles(*blocks,
+                                         strList[0].toLongLong(),
+                                         strList[1].toLongLong(), d))
+         {
+             if(curveType == "bezierblock")
+                 return new BezierSpline(d);
+             else
+                 return new LinearSpline(d, curveType == "xywadaptiveblock");
+         }
+         else
+         {
+             return 0;
+         }
+     }
      else
+     {
          return 0;
+     }
  }
 
 void EdgeGeometry::save(QTextStream & out)
@@ -97,7 +134,7 @@ void EdgeGeometry::draw()
 {
     // assumes sampling is up to date
 
-    if (sampling_.isEmpty())
+    if (sampling_.empty())
         sampling();
 
     glBegin(GL_LINE_STRIP);
@@ -115,7 +152,7 @@ void EdgeGeometry::draw(double width)
 {
     // assumes sampling is up to date
 
-    if (sampling_.isEmpty())
+    if (sampling_.empty())
         sampling();
 
     glLineWidth(width);
@@ -130,6 +167,20 @@ void EdgeGeometry::triangulate(double /*width*/, Triangles & /*triangles*/)
     // TODO
 }
 
+void EdgeGeometry::updateTriangulation(Triangles & triangles, int /*first*/, int /*last*/)
+{
+    triangulate(triangles);
+}
+
+EdgeSampleVector EdgeGeometry::strokeSampling() const
+{
+    // By default, no subdivision: the samples of the edge themselves
+    EdgeSampleVector res = edgeSampling();
+    if(isClosed() && !res.empty())
+        res << res[0];
+    return res;
+}
+
 
 // --------------- Accessing Curve Geometry --------------------
 
@@ -145,6 +196,20 @@ EdgeSample EdgeGeometry::pos(double /*s*/) const
     return EdgeSample();
 }
 
+void EdgeGeometry::pos(const std::vector<double> & ss, EdgeSampleVector & out) const
+{
+    for(unsigned int i=0; i<ss.size(); ++i)
+        out << pos(ss[i]);
+}
+
+void EdgeGeometry::pos2d(const std::vector<double> & ss, Vector2dVector & out) const
+{
+    EdgeSampleVector samples;
+    pos(ss, samples);
+    for(int i=0; i<samples.size(); ++i)
+        out << Eigen::Vector2d(samples[i].x(), samples[i].y());
+}
+
 Eigen::Vector2d EdgeGeometry::der(double /*s*/)
 {
     return Eigen::Vector2d(1,0);
@@ -175,10 +240,10 @@ Eigen::Vector2d EdgeGeometry::rightPos2d()
     return pos2d(length());
 }
 
-QList<EdgeSample> EdgeGeometry::edgeSampling() const
+EdgeSampleVector EdgeGeometry::edgeSampling() const
 {
     // TODO
-    return QList<EdgeSample>();
+    return EdgeSampleVector();
 }
 
 
@@ -203,7 +268,7 @@ void EdgeGeometry::resample()
 void EdgeGeometry::resample(double ds)
 {
     // do nothing if already sampled with the same ds
-    if ( !sampling_.isEmpty() && (ds==ds_) )
+    if ( !sampling_.empty() && (ds==ds_) )
         return;
 
     ds_ = ds;
@@ -231,14 +296,14 @@ void EdgeGeometry::resample_(double ds)
     }
 }
 
-QList<Eigen::Vector2d> & EdgeGeometry::sampling()
+Vector2dVector & EdgeGeometry::sampling()
 {
-    if(sampling_.isEmpty())
+    if(sampling_.empty())
         resample();
     return sampling_;
 }
 
-QList<Eigen::Vector2d> & EdgeGeometry::sampling(double ds)
+Vector2dVector & EdgeGeometry::sampling(double ds)
 {
     resample(ds);
     return sampling_;
@@ -248,6 +313,11 @@ void EdgeGeometry::clearSampling()
     sampling_.clear();
 }
 
+std::size_t EdgeGeometry::numBytes() const
+{
+    return sampling_.capacity() * sizeof(Eigen::Vector2d);
+}
+
 
 // --------------------- Manipulating --------------------------
 
@@ -306,6 +376,11 @@ void EdgeGeometry::endSculptEdgeWidth()
 {
 }
 
+bool EdgeGeometry::sculptedSamples(int & /*first*/, int & /*last*/) const
+{
+    return false;
+}
+
 void EdgeGeometry::beginSculptSmooth(double /*x*/, double /*y*/)
 {
 }
@@ -344,7 +419,7 @@ EdgeGeometry::ClosestVertexInfo EdgeGeometry::closestPoint(double x, double y)
     res.d = res.p.distanceTo(EdgeSample(x,y));
     return res;
 }
-void EdgeGeometry::exportSVG(QTextStream & /*out*/)
+void EdgeGeometry::exportSVG(SvgStreamWriter & /*out*/)
 {
 }
 void EdgeGeometry::write(XmlStreamWriter & /*xml*/) const
@@ -364,25 +439,25 @@ LinearSpline::LinearSpline(double ds) :
 {
 }
 
-LinearSpline::LinearSpline(const std::vector<EdgeSample,Eigen::aligned_allocator<EdgeSample> > & samples) //:
+LinearSpline::LinearSpline(const EdgeSampleVector & samples) //:
     //EdgeGeometry(ds),
     //curve_(ds)
 {
     curve_.setVertices(samples);
 }
 
-LinearSpline::LinearSpline(const QList<EdgeSample> & samples)
+LinearSpline::LinearSpline(const SculptCurve::Curve<EdgeSample> & other, bool loop) :
+    curve_(other)
 {
-    std::vector<EdgeSample,Eigen::aligned_allocator<EdgeSample> > stdvector;
-    foreach (EdgeSample es, samples)
+    if(loop)
     {
-        stdvector.push_back(es);
+        isClosed_ = true;
+        curve_.makeLoop();
     }
-    curve_.setVertices(stdvector);
 }
 
-LinearSpline::LinearSpline(const SculptCurve::Curve<EdgeSample> & other, bool loop) :
-    curve_(other)
+LinearSpline::LinearSpline(SculptCurve::Curve<EdgeSample> && other, bool loop) :
+    curve_(std::move(other))
 {
     if(loop)
     {
@@ -397,29 +472,31 @@ LinearSpline::LinearSpline(EdgeGeometry & other) //:
     //curve_(ds)
 {
     // get vertices of other geometry
-    QList<Eigen::Vector2d> & vertices = other.sampling();
+    Vector2dVector & vertices = other.sampling();
 
     // create a sampling with default width values
     std::vector<EdgeSample,Eigen::aligned_allocator<EdgeSample> > samples;
+    samples.reserve(vertices.size());
     for(int i=0; i<vertices.size(); ++i)
         samples << EdgeSample(vertices[i][0], vertices[i][1]);
 
     // set the curve to be this sampling
-    curve_.setVertices(samples);
+    curve_.setVertices(std::move(samples));
 }
 
 
-LinearSpline::LinearSpline(const QList<Eigen::Vector2d> & vertices) //:
+LinearSpline::LinearSpline(const Vector2dVector & vertices) //:
     //EdgeGeometry(ds),
     //curve_(ds)
 {
     // create a sampling with default width values
     std::vector<EdgeSample,Eigen::aligned_allocator<EdgeSample> > samples;
+    samples.reserve(vertices.size());
     for(int i=0; i<vertices.size(); ++i)
         samples << EdgeSample(vertices[i][0], vertices[i][1]);
 
     // set the curve to be this sampling
-    curve_.setVertices(samples);
+    curve_.setVertices(std::move(samples));
 }
 
 LinearSpline::~LinearSpline()
@@ -428,7 +505,10 @@ LinearSpline::~LinearSpline()
 
 LinearSpline * LinearSpline::clone()
 {
-    return new LinearSpline(curve_, isClosed());
+    // Copy everything, including the sculpting state, since geometry shared
+    // between edges is cloned when one of them starts being edited (see
+    // KeyEdge::editGeometry())
+    return new LinearSpline(*this);
 }
 
 // ---------------------- Draw ------------------------
@@ -440,7 +520,7 @@ namespace // Anonymous namespace for helper methods
 class EdgeSampling
 {
 private:
-    QList<EdgeSample> samples_;
+    EdgeSampleVector samples_;
     bool isClosed_;
     int inRange(int i) const
     {
@@ -474,12 +554,12 @@ public:
     }
 
     // building from existing sampling (repeating last sample when closed)
-    EdgeSampling(const QList<EdgeSample> & samples, bool isClosed) :
+    EdgeSampling(const EdgeSampleVector & samples, bool isClosed) :
         samples_(samples),
         isClosed_(isClosed)
     {
         if(isClosed)
-            samples_.removeLast();
+            samples_.pop_back();
     }
 
     // Getters
@@ -490,7 +570,18 @@ public:
 
 };
 
-EdgeSampling subdivided(const EdgeSampling & in, double w = 0.0625)
+// Weight of the four-point subdivision scheme
+const double SUBDIVISION_WEIGHT = 0.0625;
+
+// Sample inserted between in1 and in2 by the four-point subdivision scheme
+inline EdgeSample subdivisionSample(const EdgeSample & in0, const EdgeSample & in1,
+                                    const EdgeSample & in2, const EdgeSample & in3,
+                                    double w = SUBDIVISION_WEIGHT)
+{
+    return (in1+in2)*(0.5+w) - (in0+in3)*w;
+}
+
+EdgeSampling subdivided(const EdgeSampling & in, double w = SUBDIVISION_WEIGHT)
 {
     int n = in.size();
     int n2 = 2*n;
@@ -501,22 +592,16 @@ EdgeSampling subdivided(const EdgeSampling & in, double w = 0.0625)
     {
         out[2*i] =  in[i];
         if(in.isClosed() || i<n-1)
-            out[2*i+1] = (in[i]+in[i+1])*(0.5+w) - (in[i-1]+in[i+2])*w;
+            out[2*i+1] = subdivisionSample(in[i-1], in[i], in[i+1], in[i+2], w);
     }
     return out;
 }
 
-void triangulateHelper(const QList<EdgeSample> & samplesInput, Triangles & triangles, bool closed = false)
+// Subdivide numSub times a sampling repeating its first sample at the end if
+// closed. The result doesn't repeat it
+EdgeSampling subdividedSampling(const EdgeSampleVector & samples, bool closed, int numSub)
 {
-    // Initialization and basic case
-    triangles.clear();
-    int n=samplesInput.size();
-    if(n<2)
-        return;
-
-    // Subdivision
-    int numSub = DevSettings::getInt("num sub");
-    EdgeSampling sampling1(samplesInput, closed);
+    EdgeSampling sampling1(samples, closed);
     EdgeSampling sampling2(closed);
     for(int i=0; i<numSub; ++i)
     {
@@ -525,153 +610,183 @@ void triangulateHelper(const QList<EdgeSample> & samplesInput, Triangles & trian
         else
             sampling1 = subdivided(sampling2);
     }
-    EdgeSampling & sampling = ( (numSub%2) == 0 ) ? sampling1 : sampling2;
+    return ( (numSub%2) == 0 ) ? sampling1 : sampling2;
+}
+
+// Direction from s1 to s2
+Eigen::Vector2d getD(const EdgeSample & s1, const EdgeSample & s2)
+{
+    Eigen::Vector2d p1(s1.x(), s1.y());
+    Eigen::Vector2d p2(s2.x(), s2.y());
+    Eigen::Vector2d d = p2-p1; // Assumption: ||d|| > 0. Will result in NaN otherwise
+    d.normalize();
+    return d;
+}
+
+// Direction d of the segment before a sample, and offset points A and B
+// on each side of this sample
+struct QuadInfo    { EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    Eigen::Vector2d d;
+    double ax, ay, bx, by; };
+
+// Compute the offset points of a sample, given the direction d1 of the
+// segment before the sample and the direction d2 of the segment after it
+void computeOffsetPoints(const EdgeSample & sample,
+                         const Eigen::Vector2d & d1, const Eigen::Vector2d & d2,
+                         QuadInfo & quad)
+{
+    // Compute dotProduct, clamp to [-1.0,1.0] (could be outside due to numerical errors)
+    double dotProduct = - d1.dot(d2);
+    if(dotProduct < -1.0)
+        dotProduct = -1.0;
+    else if (dotProduct > 1.0)
+        dotProduct = 1.0;
+
+    // Compute angle. See http://en.cppreference.com/w/cpp/numeric/math/acos for specs of acos
+    double alpha = std::acos(dotProduct); // guaranteed to be in [0,pi] (well, unless dotProduct is NaN, which is assumed not to)
+    double sinAlphaOver2 = std::sin(0.5*alpha); // in [0,1]
+    if(sinAlphaOver2 < 0.3) // Bevel threshold
+        sinAlphaOver2 = 0.3; // Now, sinAlphaOver2 in [0.3,1]
+    double h = 0.5 * sample.width() / sinAlphaOver2;
+
+    // TODO: make this an preference option
+    // SIMPLE METHOD -- No bevel
+    h = 0.5 * sample.width();
+
+    // Compute bisection basis
+    Eigen::Vector2d u = d1 + d2;
+    Eigen::Vector2d v;
+    double unorm2 = u.squaredNorm();
+    if(unorm2 > 0)
+    {
+        u.normalize();
+        v = Eigen::Vector2d(-u[1],u[0]);
+    }
+    else
+    {
+        v = d1;
+    }
 
-    // Samples after subdivision
-    QList<EdgeSample> samples;
-    for(int i=0; i<sampling.size(); ++i)
-        samples << sampling[i];
-    if(sampling.isClosed())
-        samples << sampling[0];
-    n=samples.size();
+    quad.ax = sample.x() + h * v[0];
+    quad.ay = sample.y() + h * v[1];
+
+    quad.bx = sample.x() - h * v[0];
+    quad.by = sample.y() - h * v[1];
+}
+
+// Layout of the mesh of an edge, see triangulateHelper():
+//  * the offset points A and B of each sample, at vertices 2*i and 2*i+1
+//  * the two triangles of the quad between each pair of consecutive samples
+//  * the start cap then the end cap, each made of a center vertex followed
+//    by NUM_CAP_TRIANGLES+1 vertices on the circle, and NUM_CAP_TRIANGLES
+//    triangles
+
+// Set the offset points of the i-th sample
+void setOffsetPoints(Triangles & triangles, int i, const QuadInfo & q)
+{
+    triangles.setVertex(2*i, q.ax, q.ay);
+    triangles.setVertex(2*i+1, q.bx, q.by);
+}
 
-    // Helper function
-    auto getD = [] (double x1, double y1, double x2, double y2)
+// The two triangles of the quad between samples i-1 and i
+void addSegmentTriangles(Triangles & triangles, int i)
+{
+    int a = 2*i-2;
+    int b = 2*i-1;
+    int c = 2*i;
+    int d = 2*i+1;
+    triangles.addTriangle(a, b, d);
+    triangles.addTriangle(a, d, c);
+}
+
+// Number of triangles of each round cap
+const int NUM_CAP_TRIANGLES = 50;
+const int NUM_CAP_VERTICES = NUM_CAP_TRIANGLES + 2;
+
+// Coarser levels of detail (see LinearSpline::triangulateLevelOfDetail()):
+// maximum distance, in pixels, between the outlines of the simplified and
+// the full-resolution stroke, and minimum number of triangles of each cap
+const double LEVEL_OF_DETAIL_TOLERANCE = 0.5;
+const int MIN_CAP_TRIANGLES = 8;
+
+// Set the vertices of the round cap at a sample, starting at vertex first
+void setCapVertices(Triangles & triangles, int first, const EdgeSample & sample,
+                    int numCapTriangles = NUM_CAP_TRIANGLES)
+{
+    int m = numCapTriangles;
+    double cx = sample.x();
+    double cy = sample.y();
+    double r = 0.5 * sample.width();
+
+    triangles.setVertex(first, cx, cy);
+    for(int i=0; i<=m; ++i)
     {
-        Eigen::Vector2d p1(x1, y1);
-        Eigen::Vector2d p2(x2, y2);
-        Eigen::Vector2d d = p2-p1; // Assumption: ||d|| > 0. Will result in NaN otherwise
-        d.normalize();
-        return d;
-    };
+        double theta = 2 * (double) i * 3.14159 / (double) m ;
+        triangles.setVertex(first+1+i, cx + r*std::cos(theta), cy + r*std::sin(theta));
+    }
+}
+
+// Add the vertices and triangles of the round cap at a sample
+void addCap(Triangles & triangles, const EdgeSample & sample,
+            int numCapTriangles = NUM_CAP_TRIANGLES)
+{
+    int first = triangles.numVertices();
+    for(int i=0; i<numCapTriangles+2; ++i)
+        triangles.addVertex(0, 0);
+    setCapVertices(triangles, first, sample, numCapTriangles);
+    for(int i=0; i<numCapTriangles; ++i)
+        triangles.addTriangle(first+1+i, first+2+i, first);
+}
+
+// Second half of triangulateHelper(): triangulate samples which are already
+// subdivided, the first sample being repeated at the end if closed
+template <class Samples>
+void triangulateSubdividedHelper(const Samples & samples, Triangles & triangles, bool closed,
+                                 int numCapTriangles = NUM_CAP_TRIANGLES)
+{
+    int n=samples.size();
 
     // List to store the following:
     //  * n+1 vectors d0, d1, .... , dn
     //  * n   points  A0, A1, .... An-1 and B0, B1, .... Bn-1 (An and Bn are not defined)
-    struct QuadInfo    { EIGEN_MAKE_ALIGNED_OPERATOR_NEW
-        Eigen::Vector2d d;
-        double ax, ay, bx, by; };
     QList<QuadInfo> quads;
 
     // Computing the di's
     QuadInfo qs;
     if(closed)
-        qs.d = getD(samples[n-2].x(), samples[n-2].y(), samples[n-1].x(), samples[n-1].y());
+        qs.d = getD(samples[n-2], samples[n-1]);
     else
-        qs.d = getD(samples[0].x(), samples[0].y(), samples[1].x(), samples[1].y());
+        qs.d = getD(samples[0], samples[1]);
     quads << qs;
     for(int i=1; i<n; i++)
     {
-        qs.d = getD(samples[i-1].x(), samples[i-1].y(), samples[i].x(), samples[i].y());
+        qs.d = getD(samples[i-1], samples[i]);
         quads << qs;
     }
     if(closed)
-        qs.d = getD(samples[0].x(), samples[0].y(), samples[1].x(), samples[1].y());
+        qs.d = getD(samples[0], samples[1]);
     else
-        qs.d = getD(samples[n-2].x(), samples[n-2].y(), samples[n-1].x(), samples[n-1].y());
+        qs.d = getD(samples[n-2], samples[n-1]);
     quads << qs;
 
     // Computing the Ai's and Bi's
     for(int i=0; i<n; i++)
-    {
-        // Compute dotProduct, clamp to [-1.0,1.0] (could be outside due to numerical errors)
-        double dotProduct = - quads[i].d.dot(quads[i+1].d);
-        if(dotProduct < -1.0)
-            dotProduct = -1.0;
-        else if (dotProduct > 1.0)
-            dotProduct = 1.0;
-
-        // Compute angle. See http://en.cppreference.com/w/cpp/numeric/math/acos for specs of acos
-        double alpha = std::acos(dotProduct); // guaranteed to be in [0,pi] (well, unless dotProduct is NaN, which is assumed not to)
-        double sinAlphaOver2 = std::sin(0.5*alpha); // in [0,1]
-        if(sinAlphaOver2 < 0.3) // Bevel threshold
-            sinAlphaOver2 = 0.3; // Now, sinAlphaOver2 in [0.3,1]
-        double h = 0.5 * samples[i].width() / sinAlphaOver2;
-
-        // TODO: make this an preference option
-        // SIMPLE METHOD -- No bevel
-        h = 0.5 * samples[i].width();
-
-        // Compute bisection basis
-        Eigen::Vector2d u = quads[i].d + quads[i+1].d;
-        Eigen::Vector2d v;
-        double unorm2 = u.squaredNorm();
-        if(unorm2 > 0)
-        {
-            u.normalize();
-            v = Eigen::Vector2d(-u[1],u[0]);
-        }
-        else
-        {
-            v = quads[i].d;
-        }
-
-        quads[i].ax = samples[i].x() + h * v[0];
-        quads[i].ay = samples[i].y() + h * v[1];
-
-        quads[i].bx = samples[i].x() - h * v[0];
-        quads[i].by = samples[i].y() - h * v[1];
-    }
+        computeOffsetPoints(samples[i], quads[i].d, quads[i+1].d, quads[i]);
 
     // tesselate
-    for(int i=1; i<n; i++)
+    for(int i=0; i<n; i++)
     {
-        double ax = quads[i-1].ax;
-        double ay = quads[i-1].ay;
-        double bx = quads[i-1].bx;
-        double by = quads[i-1].by;
-
-        double cx = quads[i].ax;
-        double cy = quads[i].ay;
-        double dx = quads[i].bx;
-        double dy = quads[i].by;
-
-
-        triangles.append(ax,ay,bx,by,dx,dy);
-        triangles.append(ax,ay,dx,dy,cx,cy);
+        triangles.addVertex(quads[i].ax, quads[i].ay);
+        triangles.addVertex(quads[i].bx, quads[i].by);
     }
+    for(int i=1; i<n; i++)
+        addSegmentTriangles(triangles, i);
 
     // Start cap
-    {
-        int m = 50;
-        double cx = samples.front().x();
-        double cy = samples.front().y();
-        double r = 0.5 * samples.front().width();
-        for(int i=0; i<m; ++i)
-        {
-            double theta1 = 2 * (double) i * 3.14159 / (double) m ;
-            double theta2 = 2 * (double) (i+1) * 3.14159 / (double) m ;
-
-            double ax = cx + r*std::cos(theta1);
-            double ay = cy + r*std::sin(theta1);
-
-            double bx = cx + r*std::cos(theta2);
-            double by = cy + r*std::sin(theta2);
-
-            triangles.append(ax,ay,bx,by,cx,cy);
-        }
-    }
+    addCap(triangles, samples.front(), numCapTriangles);
 
     // End cap
-    {
-        int m = 50;
-        double cx = samples.back().x();
-        double cy = samples.back().y();
-        double r = 0.5 * samples.back().width();
-        for(int i=0; i<m; ++i)
-        {
-            double theta1 = 2 * (double) i * 3.14159 / (double) m ;
-            double theta2 = 2 * (double) (i+1) * 3.14159 / (double) m ;
-
-            double ax = cx + r*std::cos(theta1);
-            double ay = cy + r*std::sin(theta1);
-
-            double bx = cx + r*std::cos(theta2);
-            double by = cy + r*std::sin(theta2);
-
-            triangles.append(ax,ay,bx,by,cx,cy);
-        }
-    }
+    addCap(triangles, samples.back(), numCapTriangles);
 
     /*
 
@@ -699,6 +814,275 @@ void triangulateHelper(const QList<EdgeSample> & samplesInput, Triangles & trian
     glEnd();
     */
 }
+
+void triangulateHelper(const EdgeSampleVector & samplesInput, Triangles & triangles, bool closed,
+                       int numSub, int numCapTriangles)
+{
+    // Initialization and basic case
+    triangles.clear();
+    int n=samplesInput.size();
+    if(n<2)
+        return;
+
+    // Subdivision
+    EdgeSampling sampling = subdividedSampling(samplesInput, closed, numSub);
+
+    // Samples after subdivision
+    EdgeSampleVector samples;
+    for(int i=0; i<sampling.size(); ++i)
+        samples << sampling[i];
+    if(sampling.isClosed())
+        samples << sampling[0];
+
+    triangulateSubdividedHelper(samples, triangles, closed, numCapTriangles);
+}
+
+void triangulateHelper(const EdgeSampleVector & samplesInput, Triangles & triangles, bool closed = false)
+{
+    static const DevSettings::Int numSub("num sub");
+    triangulateHelper(samplesInput, triangles, closed, numSub, NUM_CAP_TRIANGLES);
+}
+
+// Douglas-Peucker simplification of samples, keeping the first and the last
+// one. The error of a removed sample is its distance to the simplified
+// polyline, plus half the difference between its width and the width
+// interpolated there, which bounds how much the outline of the stroke moves
+EdgeSampleVector simplifiedSamples(const EdgeSampleVector & samples, double tolerance)
+{
+    const int n = samples.size();
+    if(n < 3)
+        return samples;
+
+    std::vector<bool> isKept(n, false);
+    isKept[0] = true;
+    isKept[n-1] = true;
+    std::vector<std::pair<int,int> > ranges;
+    ranges.push_back(std::make_pair(0, n-1));
+    while(!ranges.empty())
+    {
+        const int first = ranges.back().first;
+        const int last = ranges.back().second;
+        ranges.pop_back();
+
+        const EdgeSample & a = samples[first];
+        const EdgeSample & b = samples[last];
+        Eigen::Vector2d ab(b.x() - a.x(), b.y() - a.y());
+        double l2 = ab.squaredNorm();
+        double maxError = -1;
+        int maxIndex = -1;
+        for(int i=first+1; i<last; ++i)
+        {
+            const EdgeSample & p = samples[i];
+            Eigen::Vector2d ap(p.x() - a.x(), p.y() - a.y());
+            double t = l2 > 0 ? ap.dot(ab) / l2 : 0;
+            t = std::max(0.0, std::min(1.0, t));
+            double error = (ap - t*ab).norm() +
+                           0.5 * std::abs(p.width() - (a.width() + t*(b.width()-a.width())));
+            if(error > maxError)
+            {
+                maxError = error;
+                maxIndex = i;
+            }
+        }
+
+        if(maxError > tolerance)
+        {
+            isKept[maxIndex] = true;
+            ranges.push_back(std::make_pair(first, maxIndex));
+            ranges.push_back(std::make_pair(maxIndex, last));
+        }
+    }
+
+    EdgeSampleVector res;
+    for(int i=0; i<n; ++i)
+        if(isKept[i])
+            res << samples[i];
+    return res;
+}
+
+// Inverse of simplifiedSamples(): splits each segment into the fewest equal
+// parts no longer than ds. Samples are only inserted on the segments, so
+// simplifying the result again gives back the same samples, and saving and
+// reading an edge again and again doesn't move it.
+EdgeSampleVector densifiedSamples(const EdgeSampleVector & samples, double ds)
+{
+    const int n = samples.size();
+    if(n < 2 || !(ds > 0))
+        return samples;
+
+    EdgeSampleVector res;
+    res.reserve(n);
+    res << samples[0];
+    for(int i=1; i<n; ++i)
+    {
+        const EdgeSample & a = samples[i-1];
+        const EdgeSample & b = samples[i];
+        const int numParts = std::max(1, (int) std::ceil(a.distanceTo(b) / ds));
+        for(int j=1; j<numParts; ++j)
+            res << a.lerp((double) j / numParts, b);
+        res << b;
+    }
+    return res;
+}
+
+// Update triangles computed by triangulateHelper(), knowing that only the
+// samples in [first, last] changed since, and that no sample was inserted or
+// removed. Only the triangles depending on these samples are recomputed,
+// which is much faster for long edges, e.g. while sculpting. This gives the
+// exact same result as triangulateHelper(). Returns false, leaving triangles
+// unchanged, when they can't be patched, e.g. if the number of samples
+// changed or if the changed samples span almost all of a closed edge.
+//
+// Samples is any container providing size() and operator[], e.g. an
+// EdgeSampleVector or a SculptCurve::Curve<EdgeSample>.
+template <class Samples>
+bool patchTriangulationHelper(const Samples & samplesInput, Triangles & triangles,
+                              int first, int last, bool closed = false)
+{
+    // Number of distinct samples, before and after subdivision
+    int n = closed ? samplesInput.size() - 1 : samplesInput.size();
+    if(n<2 || first<0 || last<first || last>=samplesInput.size())
+        return false;
+    static const DevSettings::Int numSubSetting("num sub");
+    int numSub = numSubSetting;
+    int m = n;
+    for(int i=0; i<numSub; ++i)
+        m = closed ? 2*m : 2*m-1;
+
+    // Check that the triangles were computed for the same number of samples
+    int numSegments = closed ? m : m-1;
+    int firstCapVertex = 2*(numSegments+1);
+    if(triangles.size() != 2*numSegments + 2*NUM_CAP_TRIANGLES ||
+       triangles.numVertices() != firstCapVertex + 2*NUM_CAP_VERTICES)
+        return false;
+
+    // Indices of closed edges are taken modulo the number of samples, so
+    // that ranges of samples can wrap around. They can be negative.
+    auto wrap = [] (int i, int size) { i = i % size; return i<0 ? i+size : i; };
+
+    // Window of samples to subdivide: the changed samples plus a margin
+    // enclosing the support of the subdivision scheme
+    const int margin = 8;
+    int lo = first - margin;
+    int hi = last + margin;
+    if(closed)
+    {
+        if(hi-lo+1 > n)
+            return false;
+    }
+    else
+    {
+        lo = std::max(lo, 0);
+        hi = std::min(hi, n-1);
+    }
+    typedef std::vector<EdgeSample, Eigen::aligned_allocator<EdgeSample> > SampleVector;
+    SampleVector window;
+    for(int i=lo; i<=hi; ++i)
+        window.push_back(samplesInput[closed ? wrap(i,n) : i]);
+
+    // Subdivision of the window. Samples near the window bounds can't be
+    // computed exactly, so the window shrinks at each level, except at the
+    // ends of open edges where the sampling is extended by clamping.
+    // [dlo, dhi] is the range of changed samples at the current level.
+    int size = n;
+    int dlo = first;
+    int dhi = last;
+    SampleVector subdividedWindow;
+    for(int k=0; k<numSub; ++k)
+    {
+        auto in = [&] (int i) -> const EdgeSample &
+        {
+            if(!closed)
+                i = std::max(0, std::min(i, size-1));
+            return window[i-lo];
+        };
+        int lo2 = (!closed && lo == 0) ? 0 : 2*lo+2;
+        int hi2 = (!closed && hi == size-1) ? 2*size-2 : 2*hi-3;
+        if(hi2 < lo2)
+            return false;
+        subdividedWindow.clear();
+        for(int j=lo2; j<=hi2; ++j)
+        {
+            int i = (j - (j&1)) / 2; // floor(j/2), also for negative j
+            if(j&1)
+                subdividedWindow.push_back(subdivisionSample(in(i-1), in(i), in(i+1), in(i+2)));
+            else
+                subdividedWindow.push_back(in(i));
+        }
+        window.swap(subdividedWindow);
+        lo = lo2;
+        hi = hi2;
+        size = closed ? 2*size : 2*size-1;
+        dlo = 2*dlo-3;
+        dhi = 2*dhi+3;
+        if(!closed)
+        {
+            dlo = std::max(dlo, 0);
+            dhi = std::min(dhi, size-1);
+        }
+    }
+
+    // Segments to retesselate, i.e. whose offset points depend on changed
+    // samples. Segment j goes from sample j-1 to sample j.
+    int jlo = dlo-1;
+    int jhi = dhi+2;
+    if(closed)
+    {
+        if(jhi-jlo+1 > numSegments)
+            return false;
+    }
+    else
+    {
+        jlo = std::max(jlo, 1);
+        jhi = std::min(jhi, numSegments);
+    }
+
+    // Offset points and samples they depend on
+    int ilo = jlo-1;
+    int ihi = jhi;
+    int slo = closed ? ilo-1 : std::max(ilo-1, 0);
+    int shi = closed ? ihi+1 : std::min(ihi+1, m-1);
+    if(slo < lo || shi > hi)
+        return false;
+    auto s = [&] (int i) -> const EdgeSample & { return window[i-lo]; };
+    auto d = [&] (int i)
+    {
+        if(!closed && i == 0)
+            return getD(s(0), s(1));
+        else if(!closed && i == m)
+            return getD(s(m-2), s(m-1));
+        else
+            return getD(s(i-1), s(i));
+    };
+    std::vector<QuadInfo, Eigen::aligned_allocator<QuadInfo> > quads(ihi-ilo+1);
+    for(int i=ilo; i<=ihi; ++i)
+        computeOffsetPoints(s(i), d(i), d(i+1), quads[i-ilo]);
+
+    // Move offset points. For closed edges, the first sample is also the
+    // last one, and has two pairs of offset points, at 0 and numSegments
+    for(int i=ilo; i<=ihi; ++i)
+    {
+        int k = closed ? wrap(i, numSegments) : i;
+        setOffsetPoints(triangles, k, quads[i-ilo]);
+        if(closed && k == 0)
+            setOffsetPoints(triangles, numSegments, quads[i-ilo]);
+    }
+
+    // Caps. The start and end samples are not affected by subdivision
+    bool isStartChanged = (first == 0) || (closed && last >= n);
+    bool isEndChanged = closed ? isStartChanged : (last == n-1);
+    if(isStartChanged)
+    {
+        setCapVertices(triangles, firstCapVertex, samplesInput[0]);
+    }
+    if(isEndChanged)
+    {
+        EdgeSample endSample = samplesInput[closed ? 0 : n-1];
+        setCapVertices(triangles, firstCapVertex + NUM_CAP_VERTICES, endSample);
+    }
+
+    return true;
+}
 } // End anonymous namespace for helper methods
 
 void LinearSpline::triangulate(Triangles & triangles)
@@ -712,7 +1096,8 @@ void LinearSpline::triangulate(Triangles & triangles)
         return;
     }
 
-    QList<EdgeSample> samples;
+    EdgeSampleVector samples;
+    samples.reserve(curve_.size());
     for(int i=0; i<curve_.size(); ++i)
     {
         samples << curve_[i];
@@ -721,9 +1106,78 @@ void LinearSpline::triangulate(Triangles & triangles)
     triangulateHelper(samples, triangles, isClosed());
 }
 
+void LinearSpline::updateTriangulation(Triangles & triangles, int first, int last)
+{
+    // Same as triangulate(triangles)
+    if(length() < 0.1)
+    {
+        triangles.clear();
+        return;
+    }
+
+    if(!patchTriangulationHelper(curve_, triangles, first, last, isClosed()))
+        triangulate(triangles);
+}
+
+void LinearSpline::triangulateLevelOfDetail(int level, Triangles & triangles)
+{
+    if(level <= 0)
+    {
+        triangulate(triangles);
+        return;
+    }
+
+    // Same as triangulate(triangles)
+    if(length() < 0.1)
+    {
+        triangles.clear();
+        return;
+    }
+
+    EdgeSampleVector samples;
+    samples.reserve(curve_.size());
+    for(int i=0; i<curve_.size(); ++i)
+    {
+        samples << curve_[i];
+    }
+
+    // At this level, a pixel is at least 2^(level-1) units wide. The error
+    // tolerance is a fraction of a pixel, there is one less subdivision per
+    // level, and caps have half as many triangles per level.
+    double tolerance = LEVEL_OF_DETAIL_TOLERANCE * std::pow(2.0, level-1);
+    static const DevSettings::Int numSubSetting("num sub");
+    int numSub = std::max(0, numSubSetting - level);
+    int numCapTriangles = std::max(MIN_CAP_TRIANGLES, NUM_CAP_TRIANGLES >> std::min(level, 16));
+
+    // A closed edge must not collapse to a single segment
+    EdgeSampleVector simplified = simplifiedSamples(samples, tolerance);
+    if(!isClosed() || simplified.size() >= 4)
+        samples.swap(simplified);
+
+    triangulateHelper(samples, triangles, isClosed(), numSub, numCapTriangles);
+}
+
+EdgeSampleVector LinearSpline::strokeSampling() const
+{
+    // Same as triangulate(triangles)
+    EdgeSampleVector res;
+    if(curve_.size() < 2 || length() < 0.1)
+        return res;
+
+    // Same subdivision as triangulateHelper()
+    static const DevSettings::Int numSub("num sub");
+    EdgeSampling sampling = subdividedSampling(edgeSampling(), isClosed(), numSub);
+    for(int i=0; i<sampling.size(); ++i)
+        res << sampling[i];
+    if(sampling.isClosed())
+        res << sampling[0];
+    return res;
+}
+
 void LinearSpline::triangulate(double width, Triangles & triangles)
 {
-    QList<EdgeSample> samples;
+    EdgeSampleVector samples;
+    samples.reserve(curve_.size());
     for(int i=0; i<curve_.size(); ++i)
     {
         EdgeSample sample = curve_[i];
@@ -749,6 +1203,107 @@ void LinearSpline::draw(double width)
 }
 
 
+// ---------------------- Interpolated stroke ------------------------
+
+InterpolatedStroke::InterpolatedStroke() :
+    closed_(false),
+    numSub_(0)
+{
+}
+
+void InterpolatedStroke::clear()
+{
+    before_.clear();
+    after_.clear();
+    subBefore_.clear();
+    subAfter_.clear();
+    subS_.clear();
+}
+
+void InterpolatedStroke::setSamplings(const SampleVector & before, const SampleVector & after,
+                                      bool closed, int numSub)
+{
+    assert(before.size() == after.size());
+    clear();
+    closed_ = closed;
+    numSub_ = numSub;
+    int n = before.size();
+    if(n<2)
+        return;
+
+    before_ = before;
+    after_ = after;
+
+    // Subdivide both samplings, as well as the relative index s of each
+    // sample, stored as the x-coordinate of a sample
+    EdgeSampleVector sList;
+    sList.reserve(n);
+    double ds = 1.0/(n-1);
+    for(int i=0; i<n; ++i)
+        sList << EdgeSample(i*ds);
+    EdgeSampling subBefore = subdividedSampling(before, closed, numSub);
+    EdgeSampling subAfter = subdividedSampling(after, closed, numSub);
+    EdgeSampling subS = subdividedSampling(sList, closed, numSub);
+    int m = subBefore.size();
+    subBefore_.reserve(m);
+    subAfter_.reserve(m);
+    subS_.reserve(m);
+    for(int i=0; i<m; ++i)
+    {
+        subBefore_.push_back(subBefore[i]);
+        subAfter_.push_back(subAfter[i]);
+        subS_.push_back(subS[i].x());
+    }
+}
+
+void InterpolatedStroke::triangulate(double u,
+                                     const Eigen::Vector2d & deltaStart,
+                                     const Eigen::Vector2d & deltaEnd,
+                                     Triangles & triangles) const
+{
+    triangles.clear();
+    int n = before_.size();
+    if(n<2)
+        return;
+
+    // Interpolation of a sample, translated for open strokes
+    auto interpolate = [&] (const EdgeSample & before, const EdgeSample & after, double s) -> EdgeSample
+    {
+        EdgeSample res = before + (after-before) * u;
+        if(!closed_)
+        {
+            Eigen::Vector2d delta = (1-s) * deltaStart + s * deltaEnd;
+            res.setX(res.x() + delta[0]);
+            res.setY(res.y() + delta[1]);
+        }
+        return res;
+    };
+
+    // Don't draw at all too small edges, as LinearSpline::triangulate()
+    double length = 0;
+    double ds = 1.0/(n-1);
+    EdgeSample previous = interpolate(before_[0], after_[0], 0);
+    for(int i=1; i<n; ++i)
+    {
+        EdgeSample sample = interpolate(before_[i], after_[i], i*ds);
+        length += previous.distanceTo(sample);
+        previous = sample;
+    }
+    if(length < 0.1)
+        return;
+
+    // Interpolate subdivided samplings, then tesselate
+    int m = subBefore_.size();
+    SampleVector samples;
+    samples.reserve(m+1);
+    for(int i=0; i<m; ++i)
+        samples.push_back(interpolate(subBefore_[i], subAfter_[i], subS_[i]));
+    if(closed_)
+        samples.push_back(samples.front());
+    triangulateSubdividedHelper(samples, triangles, closed_);
+}
+
+
 // ---------------------- Save and Load ------------------------
 
 LinearSpline::LinearSpline(QTextStream & in) //:
@@ -756,21 +1311,25 @@ LinearSpline::LinearSpline(QTextStream & in) //:
     //curve_(ds)
 {
     Field field;
-    QString bracket, nuple;
+    QString bracket;
 
     // Num Vertices
     int n;
     in >> field >> n;
 
-    // Vertices
+    // Vertices, as (x,y,w) tuples. They are read number by number, rather
+    // than as a string split with a regular expression, which was most of
+    // the time spent reading legacy documents
     std::vector<EdgeSample,Eigen::aligned_allocator<EdgeSample> > vertices;
+    vertices.reserve(n);
     in >> field >> bracket;
+    QChar c;
     for(int i=0; i<n; i++)
     {
-        in >> nuple;
-        QStringList list = nuple.split(QRegExp("\\s*[\\(\\,\\)]\\s*"),
-                                 QString::SkipEmptyParts);
-        vertices << EdgeSample(list[0].toDouble(), list[1].toDouble(), list[2].toDouble());
+        double x, y, w;
+        in.skipWhiteSpace();
+        in >> c >> x >> c >> y >> c >> w >> c;
+        vertices.push_back(EdgeSample(x, y, w));
     }
     in >> bracket;
     curve_.setVertices(vertices);
@@ -786,31 +1345,49 @@ void LinearSpline::save_(QTextStream & out)
     out << "]";
 }
 
-namespace
-{
-QString double2qstring(double x)
+LinearSpline::LinearSpline(const QStringRef & str, bool adaptive)
 {
-    const int numDigits = 15; // decimal representations of double precision floating points
-                              // are (typically) meaningless after 15 decimal digits
-    // 15 decimal digits guarantees that decimalstring->double->decimalstring is the identity
-    // 17 decimal digits guarantees that double->decimalstring->double is the identity
+    // Clear curve
+    curve_.clear();
 
-    return QString().setNum(x,'g',numDigits);
+    // Get ds, return if no data
+    NumberParser parser(str);
+    double ds;
+    if(!parser.readDouble(ds))
+        return;
+
+    // Get vertices, parsed in place
+    std::vector<EdgeSample,Eigen::aligned_allocator<EdgeSample> > vertices;
+    double x, y, w;
+    while(parser.readDouble(x) && parser.readDouble(y) && parser.readDouble(w))
+        vertices.push_back(EdgeSample(x, y, w));
+
+    // Set curve
+    curve_.setDs(ds);
+    curve_.setVertices(std::move(vertices));
+    clearSampling();
+    if(adaptive)
+        densify_();
 }
+
+LinearSpline::LinearSpline(const QVector<double> & d, bool adaptive)
+{
+    setData_(d);
+    if(adaptive)
+        densify_();
 }
 
-LinearSpline::LinearSpline(const QStringRef & str)
+void LinearSpline::densify_()
+{
+    curve_.setVertices(densifiedSamples(edgeSampling(), curve_.ds()));
+    clearSampling();
+}
+
+void LinearSpline::setData_(const QVector<double> & d)
 {
     // Clear curve
     curve_.clear();
 
-    // Get data from string
-    QStringList strList = str.toString() // Expensive, to change by only using QStringRef
-               .split(QRegExp("[\\,\\s]"), QString::SkipEmptyParts); // either ',', or any whitespace character
-    QVector<double> d;
-    for(int i=0; i<strList.size(); ++i)
-        d << strList[i].toDouble();
-
     // Return if not enough data
     if(d.size() < 1)
         return;
@@ -860,38 +1437,94 @@ LinearSpline::LinearSpline(XmlStreamReader & xml)
 
 void LinearSpline::write(XmlStreamWriter & xml) const
 {
-    QString d;
-    d += double2qstring(curve_.ds()) + " ";
-    const int n = curve_.size();
-    for(int i=0; i<n; ++i)
+    // In adaptive mode, only the samples needed to reconstruct the edge
+    // within the tolerance are written: nearly straight runs of samples,
+    // common in line art, are reduced to their endpoints. Older versions
+    // can't read such edges, hence this is optional.
+    static const DevSettings::Bool adaptiveSetting("adaptive edge samples");
+    static const DevSettings::Double adaptiveTolerance("adaptive samples tolerance");
+    EdgeSampleVector simplified;
+    bool adaptive = false;
+    if(adaptiveSetting)
     {
-        d += double2qstring(curve_[i].x()) + "," +
-             double2qstring(curve_[i].y()) + "," +
-             double2qstring(curve_[i].width());
+        simplified = simplifiedSamples(edgeSampling(), adaptiveTolerance);
+        adaptive = !isClosed() || simplified.size() >= 4;
+    }
+    const EdgeSampleVector * samples = adaptive ? &simplified : 0;
+    const int n = samples ? samples->size() : curve_.size();
+    auto sample = [&](int i) { return samples ? (*samples)[i] : curve_[i]; };
+
+    // Binary: same data as text, stored in a binary block
+    QByteArray * blocks = xml.binaryBlocks();
+    if(blocks)
+    {
+        QVector<double> d;
+        d.reserve(1 + 3*n);
+        d << curve_.ds();
+        for(int i=0; i<n; ++i)
+        {
+            const EdgeSample p = sample(i);
+            d << p.x() << p.y() << p.width();
+        }
 
-        if(i<n-1) d += " ";
+        qint64 offset = BinaryContainer::appendDoubles(*blocks, d);
+        xml.writeAttribute("curve", QString(adaptive ? "xywadaptiveblock(%1 %2)" : "xywblock(%1 %2)")
+                                    .arg(offset).arg(d.size()));
+        return;
     }
 
-    xml.writeAttribute("curve", "xywdense(" + d + ")");
+    // Text: streamed, since building a QString of all samples is slow
+    xml.writeStartAttribute("curve");
+    xml.writeAttributeChars(adaptive ? "xywadaptive(" : "xywdense(");
+    xml.writeAttributeDouble(curve_.ds());
+    for(int i=0; i<n; ++i)
+    {
+        const EdgeSample p = sample(i);
+        xml.writeAttributeChars(" ");
+        xml.writeAttributeDouble(p.x());
+        xml.writeAttributeChars(",");
+        xml.writeAttributeDouble(p.y());
+        xml.writeAttributeChars(",");
+        xml.writeAttributeDouble(p.width());
+    }
+    xml.writeAttributeChars(")");
+    xml.writeEndAttribute();
 }
 
 
 // --------------- Accessing Curve Geometry --------------------
 
-int LinearSpline::size() const { return curve_.size(); }
-EdgeSample LinearSpline::operator[] (int i) const { return curve_[i]; }
 void LinearSpline::beginSketch(const EdgeSample & sample) { curve_.beginSketch(sample); }
 void LinearSpline::continueSketch(const EdgeSample & sample) { curve_.continueSketch(sample); }
 void LinearSpline::endSketch() { curve_.endSketch(); }
 
-SculptCurve::Curve<EdgeSample> & LinearSpline::curve()
+std::size_t LinearSpline::numBytes() const
 {
-    return curve_;
+    return EdgeGeometry::numBytes() + curve_.numBytes();
 }
 
-EdgeSample LinearSpline::pos(double s) const
+void LinearSpline::pos(const std::vector<double> & ss, EdgeSampleVector & out) const
 {
-    return curve_(s);
+    if(ss.empty())
+        return;
+
+    SculptCurve::Curve<EdgeSample>::Cursor cursor(curve_);
+    for(unsigned int i=0; i<ss.size(); ++i)
+        out << cursor(ss[i]);
+}
+
+void LinearSpline::pos2d(const std::vector<double> & ss, Vector2dVector & out) const
+{
+    if(ss.empty())
+        return;
+
+    out.reserve(out.size() + ss.size());
+    SculptCurve::Curve<EdgeSample>::Cursor cursor(curve_);
+    for(unsigned int i=0; i<ss.size(); ++i)
+    {
+        EdgeSample p = cursor(ss[i]);
+        out << Eigen::Vector2d(p.x(), p.y());
+    }
 }
 
 EdgeSample LinearSpline::leftPos() const
@@ -904,9 +1537,10 @@ EdgeSample LinearSpline::rightPos() const
     return curve_.end();
 }
 
-QList<EdgeSample> LinearSpline::edgeSampling() const
+EdgeSampleVector LinearSpline::edgeSampling() const
 {
-    QList<EdgeSample> res;
+    EdgeSampleVector res;
+    res.reserve(curve_.size());
     for(int i=0; i<curve_.size(); ++i)
         res << curve_[i];
     return res;
@@ -927,11 +1561,6 @@ Eigen::Vector2d LinearSpline::der(double s)
     return dpe/norm;
 }
 
-double LinearSpline::length() const
-{
-    return curve_.length();
-}
-
 EdgeGeometry * LinearSpline::trimmed(double from, double to)
 {
     std::vector<double> splitValues;
@@ -1252,8 +1881,8 @@ void LinearSpline::continueSculptEdgeWidth(double x, double /*y*/)
             newSculptWidth *= -1;
         double widthRatio = newSculptWidth / sculptTemp_[0].width;
         vertices_[v.i].setWidth(v.width  * ( 1 + (widthRatio-1) * v.w) );
+        curve_.setWidth(v.i, vertices_[v.i].width());
     }
-    curve_.setVertices(vertices_);
     clearSampling();
 }
 
@@ -1265,6 +1894,27 @@ void LinearSpline::endSculptEdgeWidth()
     clearSampling();
 }
 
+bool LinearSpline::sculptedSamples(int & first, int & last) const
+{
+    // Only one of the two is non-empty, unless a sculpt deform and a sculpt
+    // edge width are interleaved, in which case we return their union
+    bool res = curve_.sculptedVertices(first, last);
+    for(auto & v: sculptTemp_)
+    {
+        if(res)
+        {
+            first = std::min(first, v.i);
+            last = std::max(last, v.i);
+        }
+        else
+        {
+            first = last = v.i;
+            res = true;
+        }
+    }
+    return res;
+}
+
 void LinearSpline::beginSculptSmooth(double /*x*/, double /*y*/)
 {
 }
@@ -1331,7 +1981,7 @@ EdgeGeometry::ClosestVertexInfo LinearSpline::closestPoint(double x, double y)
     }
 }
 
-void LinearSpline::exportSVG(QTextStream & out)
+void LinearSpline::exportSVG(SvgStreamWriter & out)
 {
     // ---- Compute data to export ----
 
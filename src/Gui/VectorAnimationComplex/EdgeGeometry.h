@@ -10,6 +10,7 @@
 #define VAC_EDGE_GEOMETRY_H
 
 #include <QList>
+#include <QVector>
 #include <QString>
 #include "Eigen.h"
 
@@ -18,12 +19,15 @@
 #include "Triangles.h"
 
 class QTextStream;
+class SvgStreamWriter;
 class XmlStreamWriter;
 class XmlStreamReader;
 
 namespace VectorAnimationComplex
 {
 
+class LinearSpline;
+
 class EdgeGeometry
 {
 public:
@@ -33,6 +37,12 @@ public:
 
     virtual EdgeGeometry * clone();
 
+    // this if the geometry is a LinearSpline (always, except for sketched
+    // edges fitted to a BezierSpline), or null.
+    // LinearSpline is final, so code calling it directly avoids the virtual
+    // calls, in loops evaluating many positions
+    virtual LinearSpline * toLinearSpline() { return 0; }
+
     // draw the edge with its stored variable width
     virtual void draw();
     virtual void triangulate(Triangles & triangles);
@@ -41,10 +51,26 @@ public:
     virtual void draw(double width);
     virtual void triangulate(double width, Triangles & triangles);
 
+    // update triangles computed by triangulate(triangles), knowing that only
+    // the samples in [first, last] changed since. By default, they are
+    // recomputed from scratch
+    virtual void updateTriangulation(Triangles & triangles, int first, int last);
+
+    // samples whose offset points are the vertices of triangulate(triangles),
+    // repeating the first sample at the end if closed. This is what
+    // StrokeBuffer expands on the GPU
+    virtual EdgeSampleVector strokeSampling() const;
+
     // override these for your specific curve representation
     Eigen::Vector2d pos2d(double s);
     virtual EdgeSample pos(double s) const;
     virtual Eigen::Vector2d der(double s);
+
+    // same as pos(s) and pos2d(s) for each s in ss, appended to out. The
+    // values should be sorted (increasing or decreasing), which allows to
+    // evaluate them all in a single sweep along the curve
+    virtual void pos(const std::vector<double> & ss, EdgeSampleVector & out) const;
+    void pos2d(const std::vector<double> & ss, Vector2dVector & out) const;
     virtual double length() const;
     virtual EdgeGeometry * trimmed(double from, double to);
 
@@ -59,12 +85,15 @@ public:
     // than in length/ds * pos(s) operations.
     void resample();
     void resample(double ds);
-    QList<Eigen::Vector2d> & sampling();
-    QList<Eigen::Vector2d> & sampling(double ds);
-    virtual QList<EdgeSample> edgeSampling() const;
+    Vector2dVector & sampling();
+    Vector2dVector & sampling(double ds);
+    virtual EdgeSampleVector edgeSampling() const;
 
     void clearSampling(); // call this if the geometry changed
 
+    // Memory used by the samples and sampling, in bytes
+    virtual std::size_t numBytes() const;
+
     // geometry manipulation
     virtual void setLeftRightPos(const Eigen::Vector2d & left,
                          const Eigen::Vector2d & right);
@@ -83,6 +112,9 @@ public:
     virtual void beginSculptEdgeWidth(double x, double y);
     virtual void continueSculptEdgeWidth(double x, double y);
     virtual void endSculptEdgeWidth();
+    // range of samples modified by the last call to continueSculptDeform()
+    // or continueSculptEdgeWidth(). Returns false if unknown
+    virtual bool sculptedSamples(int & first, int & last) const;
     // smooth
     virtual void beginSculptSmooth(double x, double y);
     virtual void continueSculptSmooth(double x, double y);
@@ -98,8 +130,9 @@ public:
     // Save and Load
     static EdgeGeometry * read(QTextStream & in);
     static EdgeGeometry * read(XmlStreamReader & xml);
+    static EdgeGeometry * read(const QStringRef & curve, const QByteArray * blocks);
     void save(QTextStream & out);
-    virtual void exportSVG(QTextStream & out);
+    virtual void exportSVG(SvgStreamWriter & out);
     virtual QString stringType() const {return "EdgeGeometry";}
     virtual void write(XmlStreamWriter & xml) const;
 
@@ -121,7 +154,7 @@ protected:
     // override this  only if sample_(ds) can be  done in less
     // than length/ds * pos(s) operations.
     virtual void resample_(double ds);
-    QList<Eigen::Vector2d> sampling_;
+    Vector2dVector sampling_;
 
     // Save and Load
     virtual void save_(QTextStream & out);
@@ -136,34 +169,47 @@ private:
 
 };
 
-class LinearSpline: public EdgeGeometry
+class LinearSpline final: public EdgeGeometry
 {
 public:
     LinearSpline(double ds = 5.0);
-    LinearSpline(const QList<EdgeSample> & samples);
-    LinearSpline(const std::vector<EdgeSample,Eigen::aligned_allocator<EdgeSample> > & samples);
+    LinearSpline(const EdgeSampleVector & samples);
     LinearSpline(const SculptCurve::Curve<EdgeSample> & other, bool loop = false);
+    LinearSpline(SculptCurve::Curve<EdgeSample> && other, bool loop = false); // takes ownership of the vertices
     LinearSpline(EdgeGeometry & other); // non-const cause
                             // sampling computed
-    LinearSpline(const QList<Eigen::Vector2d> & vertices);
+    LinearSpline(const Vector2dVector & vertices);
     virtual ~LinearSpline();
 
     LinearSpline * clone();
+    LinearSpline * toLinearSpline() { return this; }
 
     virtual void draw();
     virtual void draw(double width);
     virtual void triangulate(Triangles & triangles);
     virtual void triangulate(double width, Triangles & triangles);
+    virtual void updateTriangulation(Triangles & triangles, int first, int last);
+    virtual EdgeSampleVector strokeSampling() const;
+
+    // Same as triangulate(triangles), but at a coarser level of detail, meant
+    // to be drawn at a zoom of at most 2^(1-level). The samples are simplified
+    // (Douglas-Peucker) so that the outline of the stroke moves by less than
+    // half a pixel, then subdivided less, and caps have fewer triangles.
+    // Level 0 is the same as triangulate(triangles)
+    void triangulateLevelOfDetail(int level, Triangles & triangles);
 
-    void exportSVG(QTextStream & out);
+    void exportSVG(SvgStreamWriter & out);
 
     virtual EdgeSample leftPos() const;
     virtual EdgeSample rightPos() const;
-    virtual QList<EdgeSample> edgeSampling() const;
+    virtual EdgeSampleVector edgeSampling() const;
 
-    EdgeSample pos(double s) const;
+    EdgeSample pos(double s) const { return curve_(s); }
+    void pos(const std::vector<double> & ss, EdgeSampleVector & out) const; // linear time
+    Eigen::Vector2d pos2d(double s) const { EdgeSample p = curve_(s); return Eigen::Vector2d(p.x(), p.y()); }
+    void pos2d(const std::vector<double> & ss, Vector2dVector & out) const; // linear time
     Eigen::Vector2d der(double s);
-    double length() const;
+    double length() const { return curve_.length(); }
     EdgeGeometry * trimmed(double from, double to);
     void setLeftRightPos(const Eigen::Vector2d & left,
                    const Eigen::Vector2d & right);
@@ -183,6 +229,7 @@ public:
     void beginSculptEdgeWidth(double x, double y);
     void continueSculptEdgeWidth(double x, double y);
     void endSculptEdgeWidth();
+    bool sculptedSamples(int & first, int & last) const;
     // Change Edge Width
     void beginSculptSmooth(double x, double y);
     void continueSculptSmooth(double x, double y);
@@ -199,26 +246,37 @@ public:
 
     LinearSpline(QTextStream & in);
     //LinearSpline(XmlStreamReader & xml);
-    LinearSpline(const QStringRef & str); // str = curve data from XML, without the type
+    // str = curve data from XML, without the type, and d = same data,
+    // already parsed. If adaptive, the samples are those kept by write() in
+    // adaptive mode, and samples are inserted back between them: each
+    // segment is split evenly in parts no longer than ds, so the spacing
+    // is at most ds but not uniform along the edge
+    LinearSpline(const QStringRef & str, bool adaptive = false);
+    LinearSpline(const QVector<double> & d, bool adaptive = false);
     QString stringType() const {return "LinearSpline";}
 
-    SculptCurve::Curve<EdgeSample> & curve();
+    SculptCurve::Curve<EdgeSample> & curve() { return curve_; }
+    const SculptCurve::Curve<EdgeSample> & curve() const { return curve_; }
 
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
     // Sketch
-    int size() const;
-    EdgeSample operator[] (int i) const;
+    int size() const { return curve_.size(); }
+    EdgeSample operator[] (int i) const { return curve_[i]; }
     void beginSketch(const EdgeSample & resample);
     void continueSketch(const EdgeSample & resample);
     void endSketch();
 
+    std::size_t numBytes() const;
+
 protected:
     void save_(QTextStream & out);
     void write(XmlStreamWriter & xml) const;
 
 private:
     void resample_(double ds); // linear time
+    void setData_(const QVector<double> & d);
+    void densify_();
     //void computeLength();
     //double length_;
     //QList<Eigen::Vector2d> vertices_;
@@ -252,6 +310,45 @@ private:
     double dragAndDrop_lastDy_;
 };
 
+// Stroke of the linear interpolations between two samplings with the same
+// number of samples, e.g. the key paths of an inbetween edge. Subdivision
+// being linear, both samplings are subdivided once and for all, so that
+// triangulating an interpolation only requires blending the subdivided
+// samplings and computing their offset points. The result is the same as
+// LinearSpline::triangulate() applied to the interpolated sampling.
+class InterpolatedStroke
+{
+public:
+    typedef EdgeSampleVector SampleVector;
+
+    InterpolatedStroke();
+
+    // Set the samplings to interpolate, repeating their first sample at the
+    // end if closed, and the number of subdivisions ("num sub" setting)
+    void setSamplings(const SampleVector & before, const SampleVector & after,
+                      bool closed, int numSub);
+    void clear();
+    bool isEmpty() const { return before_.empty(); }
+    int numSub() const { return numSub_; }
+
+    // Triangulate before + (after-before)*u. For open strokes, the i-th of
+    // the n samples is then translated by (1-s)*deltaStart + s*deltaEnd,
+    // with s = i/(n-1)
+    void triangulate(double u,
+                     const Eigen::Vector2d & deltaStart,
+                     const Eigen::Vector2d & deltaEnd,
+                     Triangles & triangles) const;
+
+private:
+    SampleVector before_;
+    SampleVector after_;
+    SampleVector subBefore_; // subdivided, without repeating the first sample
+    SampleVector subAfter_;
+    std::vector<double> subS_; // subdivided s, see triangulate()
+    bool closed_;
+    int numSub_;
+};
+
 }
 
 #endif
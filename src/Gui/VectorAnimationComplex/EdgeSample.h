@@ -11,6 +11,8 @@
 
 #include "Eigen.h"
 
+#include <vector>
+
 namespace VectorAnimationComplex
 {
 
@@ -71,6 +73,11 @@ private:
     Eigen::Vector3d d_;
 };
 
+// Contiguous containers for samplings. Fixed-size Eigen types require an
+// aligned allocator, and QList would allocate each of them separately.
+typedef std::vector<EdgeSample, Eigen::aligned_allocator<EdgeSample> > EdgeSampleVector;
+typedef std::vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d> > Vector2dVector;
+
 }
 
 #endif // EDGESAMPLE_H
@@ -0,0 +1,44 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#include "EvaluationContext.h"
+
+#include "../Global.h"
+#include "../DevSettings.h"
+
+namespace VectorAnimationComplex
+{
+
+double EvaluationContext::sketchTolerance() const
+{
+    double tolerance = snapThreshold;
+    double toleranceEpsilon = 1e-2;
+    if( (tolerance < toleranceEpsilon) || !snapMode )
+        tolerance = 1e-2;
+    return tolerance;
+}
+
+EvaluationContext EvaluationContext::current()
+{
+    static const DevSettings::Double ds("ds");
+    static const DevSettings::Int numSub("num sub");
+    static const DevSettings::Bool coherentTriangulation("coherent triangulation");
+
+    EvaluationContext context;
+    context.edgeWidth = global()->edgeWidth();
+    context.planarMapMode = global()->planarMapMode();
+    context.snapMode = global()->snapMode();
+    context.snapThreshold = global()->snapThreshold();
+    context.sculptRadius = global()->sculptRadius();
+    context.ds = ds;
+    context.numSub = numSub;
+    context.coherentTriangulation = coherentTriangulation;
+    return context;
+}
+
+}
@@ -0,0 +1,46 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#ifndef VAC_EVALUATION_CONTEXT_H
+#define VAC_EVALUATION_CONTEXT_H
+
+// EvaluationContext: immutable snapshot of the settings that geometric
+// computations depend on, i.e., tool settings from Global and parameters
+// from DevSettings. It is captured once per operation or per frame, in the
+// GUI thread, then passed explicitly to computations such as triangulation,
+// sampling of inbetween edges, or insertion of sketched edges, which can
+// therefore run in worker threads without reading global().
+
+namespace VectorAnimationComplex
+{
+
+struct EvaluationContext
+{
+    // Sketching
+    double edgeWidth;
+    bool planarMapMode;
+    bool snapMode;
+    double snapThreshold;
+    double sculptRadius;
+
+    // Sampling and triangulation
+    double ds;
+    int numSub;
+    bool coherentTriangulation;
+
+    // Tolerance used to intersect sketched edges: the snap threshold, if
+    // snapping is on and it is not too small
+    double sketchTolerance() const;
+
+    // Captures the current settings. Must be called from the GUI thread.
+    static EvaluationContext current();
+};
+
+}
+
+#endif // VAC_EVALUATION_CONTEXT_H
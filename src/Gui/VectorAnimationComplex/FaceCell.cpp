@@ -11,6 +11,9 @@
 #include "../SaveAndLoad.h"
 #include "../DevSettings.h"
 #include "../Global.h"
+#include "../IO/SvgStreamWriter.h"
+#include "../OpenGL.h"
+#include <limits>
 
 
 namespace VectorAnimationComplex
@@ -19,6 +22,7 @@ namespace VectorAnimationComplex
 FaceCell::FaceCell(VAC * vac) :
     Cell(vac)
 {
+    addKindBit_(FaceCellBit);
     // highlighted/selected color
     colorSelected_[0] = 1;
     colorSelected_[1] = 0.5;
@@ -29,6 +33,7 @@ FaceCell::FaceCell(VAC * vac) :
 FaceCell::FaceCell(VAC * vac, XmlStreamReader & xml) :
     Cell(vac, xml)
 {
+    addKindBit_(FaceCellBit);
     // highlighted/selected color
     colorSelected_[0] = 1;
     colorSelected_[1] = 0.5;
@@ -39,6 +44,7 @@ FaceCell::FaceCell(VAC * vac, XmlStreamReader & xml) :
 FaceCell::FaceCell(VAC * vac, QTextStream & in) :
     Cell(vac, in)
 {
+    addKindBit_(FaceCellBit);
     // highlighted/selected color
     colorSelected_[0] = 1;
     colorSelected_[1] = 0.5;
@@ -46,10 +52,87 @@ FaceCell::FaceCell(VAC * vac, QTextStream & in) :
     colorSelected_[3] = 1;
 }
 
+bool FaceCell::isStencilFilled()
+{
+    static const DevSettings::Bool stencilFaces("stencil faces");
+    return stencilFaces;
+}
+
+bool FaceCell::isBatchable(Time /*time*/) const
+{
+    return !isStencilFilled();
+}
+
+void FaceCell::drawRaw(Time time, ViewSettings & viewSettings)
+{
+    // Cached triangles are drawn as is. The stencil buffer may be missing,
+    // e.g. in render thread targets.
+    GLint stencilBits = 0;
+    if(isStencilFilled() && !hasCachedTriangles(time))
+        glGetIntegerv(GL_STENCIL_BITS, &stencilBits);
+    if(stencilBits == 0)
+    {
+        Cell::drawRaw(time, viewSettings);
+        return;
+    }
+
+    const BoundingBox & bb = boundingBox(time);
+    if(bb.isEmpty())
+        return;
+    QList<Vector2dVector> cycles = getSampling(time);
+
+    // Stencil: invert the first bit under each fan. It is zero before, and
+    // reset to zero by the cover.
+    glEnable(GL_STENCIL_TEST);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glStencilMask(1);
+    glStencilFunc(GL_ALWAYS, 0, 1);
+    glStencilOp(GL_KEEP, GL_KEEP, GL_INVERT);
+    for(int k=0; k<cycles.size(); ++k)
+    {
+        const Vector2dVector & cycle = cycles[k];
+        if(cycle.size() < 3)
+            continue;
+        glBegin(GL_TRIANGLE_FAN);
+        for(unsigned int i=0; i<cycle.size(); ++i)
+            glVertex2d(cycle[i][0], cycle[i][1]);
+        glEnd();
+    }
+
+    // Cover
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glStencilFunc(GL_NOTEQUAL, 0, 1);
+    glStencilOp(GL_ZERO, GL_ZERO, GL_ZERO);
+    glBegin(GL_QUADS);
+    glVertex2d(bb.xMin(), bb.yMin());
+    glVertex2d(bb.xMax(), bb.yMin());
+    glVertex2d(bb.xMax(), bb.yMax());
+    glVertex2d(bb.xMin(), bb.yMax());
+    glEnd();
+    glStencilMask(~0);
+    glDisable(GL_STENCIL_TEST);
+}
+
 void FaceCell::drawRawTopology(Time time, ViewSettings & viewSettings)
 {
+    drawnTopologyTriangles(time, viewSettings).draw();
+}
+
+const Triangles & FaceCell::drawnTopologyTriangles(Time time, ViewSettings & viewSettings) const
+{
+    static const Triangles emptyTriangles;
     if(viewSettings.drawTopologyFaces())
-        triangles(time).draw();
+        return triangles(time);
+    else
+        return emptyTriangles;
+}
+
+double FaceCell::pickTopologyDistanceCustom(double x, double y, Time time, ViewSettings & viewSettings)
+{
+    if(viewSettings.drawTopologyFaces())
+        return triangles(time).distance(Eigen::Vector2d(x,y));
+    else
+        return std::numeric_limits<double>::infinity();
 }
 
 bool FaceCell::isPickableCustom(Time /*time*/) const
@@ -70,10 +153,27 @@ void FaceCell::computeOutlineBoundingBox_(Time t, BoundingBox & out) const
     out = boundingBox(t);
 }
 
-void FaceCell::exportSVG(Time t, QTextStream & out)
+void FaceCell::computeBoundingBox_(Time t, BoundingBox & out) const
+{
+    // Triangles have the same vertices as the sampling, except for points
+    // added at self-intersections, which are inside
+    if(!isStencilFilled() || hasCachedTriangles(t) || !exists(t))
+    {
+        Cell::computeBoundingBox_(t, out);
+        return;
+    }
+
+    out = BoundingBox();
+    QList<Vector2dVector> cycles = getSampling(t);
+    for(int k=0; k<cycles.size(); ++k)
+        for(unsigned int i=0; i<cycles[k].size(); ++i)
+            out.unite(BoundingBox(cycles[k][i][0], cycles[k][i][1]));
+}
+
+void FaceCell::exportSVG(Time t, SvgStreamWriter & out)
 {
     // Get polygon data
-    QList< QList<Eigen::Vector2d> > samples = getSampling(t);
+    QList<Vector2dVector> samples = getSampling(t);
 
     // Write file
     out << "<path d=\"";
@@ -127,6 +227,7 @@ FaceCell::~FaceCell()
 FaceCell::FaceCell(FaceCell * other) :
     Cell(other)
 {
+    addKindBit_(FaceCellBit);
 }
 
 void FaceCell::remapPointers(VAC * /*newVAC*/)
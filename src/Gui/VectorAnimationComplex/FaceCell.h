@@ -11,6 +11,7 @@
 
 #include "Cell.h"
 #include "Triangles.h"
+#include "EdgeSample.h"
 
 namespace VectorAnimationComplex
 {
@@ -20,14 +21,25 @@ class FaceCell: virtual public Cell
 public:
     FaceCell(VAC * vac);
 
-    // Drawing
+    // Drawing. If "stencil faces" is on, faces are filled by stencil then
+    // cover instead of from their triangles: the fans of their cycles are
+    // drawn into the stencil buffer, inverting it, which leaves odd pixels
+    // inside the face (odd winding rule, as the triangulation), then the
+    // bounding box is drawn where the stencil is odd, resetting it. Faces
+    // are then not triangulated for drawing, only if picking or
+    // intersection tests need it, and are drawn individually rather than
+    // batched. Falls back on triangles if there is no stencil buffer.
+    static bool isStencilFilled();
+    void drawRaw(Time time, ViewSettings & viewSettings);
+    bool isBatchable(Time time) const;
     void drawRawTopology(Time time, ViewSettings & viewSettings);
+    const Triangles & drawnTopologyTriangles(Time time, ViewSettings & viewSettings) const;
 
     // Get sampling of the boundary
-    virtual QList< QList<Eigen::Vector2d> > getSampling(Time time) const = 0;
+    virtual QList<Vector2dVector> getSampling(Time time) const = 0;
 
     // Export SVG
-    virtual void exportSVG(Time t, QTextStream & out);
+    virtual void exportSVG(Time t, SvgStreamWriter & out);
 
 protected:
     virtual ~FaceCell()=0;
@@ -38,10 +50,14 @@ private:
     bool checkFace_() const;
 
     virtual bool isPickableCustom(Time time) const;
+    virtual double pickTopologyDistanceCustom(double x, double y, Time time, ViewSettings & viewSettings);
 
     // Implementation of outline bounding box for both KeyFace and InbetweenFace
     void computeOutlineBoundingBox_(Time t, BoundingBox & out) const;
 
+    // Bounding box of the sampling, if not triangulated
+    void computeBoundingBox_(Time t, BoundingBox & out) const;
+
 // --------- Cloning, Assigning, Copying, Serializing ----------
 
 protected:
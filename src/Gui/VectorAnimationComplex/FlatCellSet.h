@@ -0,0 +1,248 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+
+#ifndef VAC_FLAT_CELL_SET_H
+#define VAC_FLAT_CELL_SET_H
+
+// FlatPtrSet<T>: a set of non-null T*, with the same basic API as QSet<T*>,
+// meant for the short-lived sets of topological algorithms (visited cells,
+// closures, etc.).
+//
+// Up to INLINE_SIZE pointers are stored inline, without any allocation, and
+// searched linearly. Beyond that, they are stored in a single open-addressing
+// hash table (linear probing, at most half full), instead of one node per
+// element like QSet. Iteration order is unspecified.
+//
+// Example:
+//   FlatCellSet visited(cells);
+//   if(!visited.contains(c))
+//       visited << c;
+//   CellSet res = visited.toSet();
+
+#include <QSet>
+#include <QtGlobal>
+#include <vector>
+#include "ForwardDeclaration.h"
+
+namespace VectorAnimationComplex
+{
+
+template <class T>
+class FlatPtrSet
+{
+public:
+    FlatPtrSet() : size_(0) {}
+    FlatPtrSet(const QSet<T*> & other) : size_(0) { unite(other); }
+
+    int size() const { return size_; }
+    bool isEmpty() const { return size_ == 0; }
+
+    void clear()
+    {
+        size_ = 0;
+        slots_.clear();
+    }
+
+    void reserve(int size)
+    {
+        if(size > INLINE_SIZE)
+            rehash_(capacityFor_(size));
+    }
+
+    bool contains(T * t) const
+    {
+        if(!t)
+            return false;
+
+        if(isInline_())
+        {
+            for(int i=0; i<size_; ++i)
+                if(inline_[i] == t)
+                    return true;
+            return false;
+        }
+        else
+        {
+            return slots_[find_(t)] == t;
+        }
+    }
+
+    void insert(T * t)
+    {
+        if(!t)
+            return;
+
+        if(isInline_())
+        {
+            for(int i=0; i<size_; ++i)
+                if(inline_[i] == t)
+                    return;
+            if(size_ < INLINE_SIZE)
+            {
+                inline_[size_++] = t;
+                return;
+            }
+            rehash_(capacityFor_(size_+1));
+        }
+        else if(2 * (size_+1) > (int) slots_.size())
+        {
+            rehash_(2 * slots_.size());
+        }
+
+        std::size_t i = find_(t);
+        if(!slots_[i])
+        {
+            slots_[i] = t;
+            ++size_;
+        }
+    }
+
+    bool remove(T * t)
+    {
+        if(!t)
+            return false;
+
+        if(isInline_())
+        {
+            for(int i=0; i<size_; ++i)
+            {
+                if(inline_[i] == t)
+                {
+                    inline_[i] = inline_[--size_];
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        std::size_t i = find_(t);
+        if(slots_[i] != t)
+            return false;
+
+        // Backward-shift deletion: move up the following entries of the
+        // cluster which would not be found anymore because of the hole
+        std::size_t mask = slots_.size() - 1;
+        std::size_t j = i;
+        while(true)
+        {
+            j = (j+1) & mask;
+            if(!slots_[j])
+                break;
+            std::size_t k = hash_(slots_[j]) & mask;
+            if( (i <= j) ? (i < k && k <= j) : (i < k || k <= j) )
+                continue;
+            slots_[i] = slots_[j];
+            i = j;
+        }
+        slots_[i] = 0;
+        --size_;
+        return true;
+    }
+
+    FlatPtrSet & operator<<(T * t) { insert(t); return *this; }
+
+    FlatPtrSet & unite(const FlatPtrSet & other)
+    {
+        for(T * t: other)
+            insert(t);
+        return *this;
+    }
+
+    FlatPtrSet & unite(const QSet<T*> & other)
+    {
+        for(T * t: other)
+            insert(t);
+        return *this;
+    }
+
+    QSet<T*> toSet() const
+    {
+        QSet<T*> res;
+        res.reserve(size_);
+        for(T * t: *this)
+            res << t;
+        return res;
+    }
+
+    // Iterating over the elements. Null pointers are empty slots.
+    class ConstIterator
+    {
+    public:
+        ConstIterator(T * const * p, T * const * end) : p_(p), end_(end) { skip_(); }
+        T * operator*() const { return *p_; }
+        ConstIterator & operator++() { ++p_; skip_(); return *this; }
+        bool operator==(const ConstIterator & other) const { return p_ == other.p_; }
+        bool operator!=(const ConstIterator & other) const { return p_ != other.p_; }
+
+    private:
+        void skip_() { while(p_ != end_ && !*p_) ++p_; }
+        T * const * p_;
+        T * const * end_;
+    };
+    ConstIterator begin() const { return ConstIterator(data_(), data_() + dataSize_()); }
+    ConstIterator end() const { return ConstIterator(data_() + dataSize_(), data_() + dataSize_()); }
+
+private:
+    enum { INLINE_SIZE = 8 };
+    T * inline_[INLINE_SIZE];
+    std::vector<T*> slots_; // empty while elements are inline
+    int size_;
+
+    bool isInline_() const { return slots_.empty(); }
+    T * const * data_() const { return isInline_() ? inline_ : slots_.data(); }
+    int dataSize_() const { return isInline_() ? size_ : (int) slots_.size(); }
+
+    static std::size_t hash_(T * t)
+    {
+        quintptr x = reinterpret_cast<quintptr>(t);
+        x ^= x >> 16;
+        x *= 0x45d9f3b;
+        x ^= x >> 16;
+        return (std::size_t) x;
+    }
+
+    static std::size_t capacityFor_(int size)
+    {
+        std::size_t capacity = 16;
+        while(capacity < 2 * (std::size_t) size)
+            capacity *= 2;
+        return capacity;
+    }
+
+    // Slot where t is, or the empty slot where it would be inserted
+    std::size_t find_(T * t) const
+    {
+        std::size_t mask = slots_.size() - 1;
+        std::size_t i = hash_(t) & mask;
+        while(slots_[i] && slots_[i] != t)
+            i = (i+1) & mask;
+        return i;
+    }
+
+    void rehash_(std::size_t capacity)
+    {
+        if(capacity <= slots_.size())
+            return;
+
+        std::vector<T*> old(capacity, (T*) 0);
+        old.swap(slots_);
+        T * const * p = old.empty() ? inline_ : old.data();
+        int n = old.empty() ? size_ : (int) old.size();
+        for(int i=0; i<n; ++i)
+            if(p[i])
+                slots_[find_(p[i])] = p[i];
+    }
+};
+
+typedef FlatPtrSet<Cell> FlatCellSet;
+typedef FlatPtrSet<KeyEdge> FlatKeyEdgeSet;
+
+}
+
+#endif
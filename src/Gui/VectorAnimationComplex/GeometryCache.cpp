@@ -0,0 +1,171 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#include "GeometryCache.h"
+
+#include "Cell.h"
+
+#include <cmath>
+
+namespace VectorAnimationComplex
+{
+
+GeometryCache::EntryList GeometryCache::entries_;
+QHash<GeometryCache::EntryKey, GeometryCache::EntryList::iterator> GeometryCache::index_;
+std::size_t GeometryCache::numBytes_ = 0;
+std::size_t GeometryCache::maxBytes_ = std::size_t(512) * 1024 * 1024;
+unsigned long long GeometryCache::numHits_ = 0;
+unsigned long long GeometryCache::numMisses_ = 0;
+unsigned long long GeometryCache::numEvictions_ = 0;
+const int GeometryCache::MAX_TIME_QUANTUM;
+int GeometryCache::keyStep_ = 1;
+bool GeometryCache::isInterpolating_ = false;
+
+void GeometryCache::touch(const Cell * cell, int key)
+{
+    auto it = index_.find(EntryKey(cell, key));
+    if (it != index_.end())
+    {
+        entries_.splice(entries_.begin(), entries_, it.value());
+        ++numHits_;
+    }
+}
+
+void GeometryCache::insert(const Cell * cell, int key, std::size_t numBytes)
+{
+    remove(cell, key);
+    Entry entry;
+    entry.cell = cell;
+    entry.key = key;
+    entry.numBytes = numBytes;
+    entries_.push_front(entry);
+    index_.insert(EntryKey(cell, key), entries_.begin());
+    numBytes_ += numBytes;
+    ++numMisses_;
+}
+
+void GeometryCache::remove(const Cell * cell, int key)
+{
+    auto it = index_.find(EntryKey(cell, key));
+    if (it != index_.end())
+    {
+        numBytes_ -= it.value()->numBytes;
+        entries_.erase(it.value());
+        index_.erase(it);
+    }
+}
+
+void GeometryCache::setMaxBytes(std::size_t maxBytes)
+{
+    maxBytes_ = maxBytes;
+}
+
+std::size_t GeometryCache::maxBytes()
+{
+    return maxBytes_;
+}
+
+void GeometryCache::trim()
+{
+    while (numBytes_ > maxBytes_ && !entries_.empty())
+    {
+        Entry entry = entries_.back();
+        entries_.pop_back();
+        index_.remove(EntryKey(entry.cell, entry.key));
+        numBytes_ -= entry.numBytes;
+        ++numEvictions_;
+        entry.cell->evictCachedGeometry_(entry.key);
+    }
+}
+
+void GeometryCache::setTimeQuantum(int quantum)
+{
+    if (quantum < 1 || quantum > MAX_TIME_QUANTUM || MAX_TIME_QUANTUM % quantum != 0)
+        quantum = MAX_TIME_QUANTUM;
+    keyStep_ = MAX_TIME_QUANTUM / quantum;
+}
+
+int GeometryCache::timeQuantum()
+{
+    return MAX_TIME_QUANTUM / keyStep_;
+}
+
+void GeometryCache::setInterpolation(bool b)
+{
+    isInterpolating_ = b;
+}
+
+bool GeometryCache::isInterpolating()
+{
+    return isInterpolating_;
+}
+
+int GeometryCache::timeKey(Time t)
+{
+    if (keyStep_ == 1 || isInterpolating_)
+        return std::floor(t.floatTime() * MAX_TIME_QUANTUM + 0.5);
+    else
+        return keyStep_ * (int) std::floor(t.floatTime() * timeQuantum() + 0.5);
+}
+
+Time GeometryCache::keyTime(int key)
+{
+    if (key % MAX_TIME_QUANTUM == 0)
+        return Time(key / MAX_TIME_QUANTUM); // exact frame
+    else
+        return Time((double) key / MAX_TIME_QUANTUM);
+}
+
+bool GeometryCache::isQuantumKey(int key)
+{
+    return key % keyStep_ == 0;
+}
+
+int GeometryCache::previousQuantumKey(int key)
+{
+    return keyStep_ * (int) std::floor((double) key / keyStep_);
+}
+
+int GeometryCache::nextQuantumKey(int key)
+{
+    return previousQuantumKey(key) + keyStep_;
+}
+
+std::size_t GeometryCache::numBytes()
+{
+    return numBytes_;
+}
+
+int GeometryCache::numEntries()
+{
+    return index_.size();
+}
+
+unsigned long long GeometryCache::numHits()
+{
+    return numHits_;
+}
+
+unsigned long long GeometryCache::numMisses()
+{
+    return numMisses_;
+}
+
+unsigned long long GeometryCache::numEvictions()
+{
+    return numEvictions_;
+}
+
+void GeometryCache::resetCounters()
+{
+    numHits_ = 0;
+    numMisses_ = 0;
+    numEvictions_ = 0;
+}
+
+}
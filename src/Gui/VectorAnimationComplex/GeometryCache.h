@@ -0,0 +1,106 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#ifndef VAC_GEOMETRY_CACHE_H
+#define VAC_GEOMETRY_CACHE_H
+
+// GeometryCache: bookkeeping of the geometry cached by all cells (see
+// Cell::triangles(Time) and Cell::boundingBox(Time)), in order to bound its
+// memory usage. Each entry is the geometry of one cell at one time. Entries
+// are kept in least recently used order, and trim() evicts the least recently
+// used ones until the total size is within budget.
+//
+// Eviction is never performed while cells are being queried, since callers
+// may hold references to cached geometry. Instead, trim() is called at safe
+// points, typically once per frame before drawing (see VAC::draw()).
+//
+// Time is quantized: the geometry at time t is cached under timeKey(t), in
+// 1/60 of a frame, and shared by all times with the same key. The quantum is
+// finest by default, and coarser while playing back subframes, so that
+// inbetween cells are triangulated a few times per frame rather than up to
+// 60 times. With interpolation enabled, geometry at times between two quanta
+// is instead cached under its fine key, and interpolated between the
+// geometry at these quanta when possible (see Cell::triangles(Time)).
+
+#include "../TimeDef.h"
+
+#include <QHash>
+#include <QPair>
+#include <list>
+#include <cstddef>
+
+namespace VectorAnimationComplex
+{
+
+class Cell;
+
+class GeometryCache
+{
+public:
+    // Called by cells when cached geometry is used, computed, or cleared
+    static void touch(const Cell * cell, int key);
+    static void insert(const Cell * cell, int key, std::size_t numBytes);
+    static void remove(const Cell * cell, int key);
+
+    // Memory budget, in bytes
+    static void setMaxBytes(std::size_t maxBytes);
+    static std::size_t maxBytes();
+
+    // Evict least recently used entries until within budget
+    static void trim();
+
+    // Time quantization. The quantum is a number of steps per frame, which
+    // must divide MAX_TIME_QUANTUM (e.g. 1 for frames only, 60 for finest)
+    static const int MAX_TIME_QUANTUM = 60;
+    static void setTimeQuantum(int quantum);
+    static int timeQuantum();
+    static void setInterpolation(bool b);
+    static bool isInterpolating();
+
+    // Key under which geometry at time t is cached, the time at which the
+    // geometry of a key is computed, and whether a key is on a quantum
+    static int timeKey(Time t);
+    static Time keyTime(int key);
+    static bool isQuantumKey(int key);
+
+    // Keys of the quanta just before and after a key between two quanta
+    static int previousQuantumKey(int key);
+    static int nextQuantumKey(int key);
+
+    // Statistics
+    static std::size_t numBytes();
+    static int numEntries();
+    static unsigned long long numHits();
+    static unsigned long long numMisses();
+    static unsigned long long numEvictions();
+    static void resetCounters();
+
+private:
+    struct Entry
+    {
+        const Cell * cell;
+        int key;
+        std::size_t numBytes;
+    };
+    typedef std::list<Entry> EntryList; // from most to least recently used
+    typedef QPair<const Cell *, int> EntryKey;
+
+    static EntryList entries_;
+    static QHash<EntryKey, EntryList::iterator> index_;
+    static std::size_t numBytes_;
+    static std::size_t maxBytes_;
+    static unsigned long long numHits_;
+    static unsigned long long numMisses_;
+    static unsigned long long numEvictions_;
+    static int keyStep_; // MAX_TIME_QUANTUM / quantum
+    static bool isInterpolating_;
+};
+
+}
+
+#endif // VAC_GEOMETRY_CACHE_H
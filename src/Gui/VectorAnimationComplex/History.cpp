@@ -0,0 +1,396 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#include "History.h"
+
+#include "VAC.h"
+#include "Cell.h"
+#include "KeyEdge.h"
+#include "EdgeGeometry.h"
+#include "../XmlStreamWriter.h"
+#include "../XmlStreamReader.h"
+
+#include <QFile>
+#include <QtDebug>
+
+namespace VectorAnimationComplex
+{
+
+namespace
+{
+
+// Estimated memory used by a copy of a cell: a fixed amount for the cell
+// itself and its stars, plus the samples of key edges, which dominate. Not
+// read geometries (see VAC::read()) are ignored rather than read.
+std::size_t cellNumBytes(Cell * cell)
+{
+    std::size_t res = 512;
+    KeyEdge * edge = cell->toKeyEdge();
+    if(edge && edge->isGeometryRead())
+    {
+        LinearSpline * spline = edge->linearSpline();
+        if(spline)
+            res += spline->size() * (sizeof(EdgeSample) + sizeof(double));
+    }
+    return res;
+}
+
+std::size_t cellsNumBytes(const QMap<int, Cell*> & cells)
+{
+    std::size_t res = 0;
+    foreach(Cell * cell, cells)
+        if(cell)
+            res += cellNumBytes(cell);
+    return res;
+}
+
+}
+
+History::History() :
+    checkpoints_(),
+    index_(-1),
+    cells_(new VAC()),
+    storeIndex_(-1),
+    firstInMemory_(0),
+    numBytes_(0),
+    maxBytes_(std::size_t(512) * 1024 * 1024),
+    spillPath_(),
+    stateVersions_(),
+    zOrderingVersion_(0),
+    symbolsVersion_(0)
+{
+}
+
+History::~History()
+{
+    clear();
+    delete cells_;
+}
+
+void History::clear()
+{
+    for(Checkpoint & checkpoint: checkpoints_)
+        deleteCheckpoint_(checkpoint);
+    checkpoints_.clear();
+    index_ = -1;
+
+    // Not owned by cells_: release them without deleting them
+    cells_->cells_.clear();
+    cells_->zOrdering_.clear();
+    storeIndex_ = -1;
+    firstInMemory_ = 0;
+    numBytes_ = 0;
+
+    stateVersions_.clear();
+    zOrderingVersion_ = 0;
+    symbolsVersion_ = 0;
+}
+
+int History::size() const
+{
+    return checkpoints_.size();
+}
+
+int History::index() const
+{
+    return index_;
+}
+
+void History::setMaxBytes(std::size_t maxBytes)
+{
+    maxBytes_ = maxBytes;
+    trim_();
+}
+
+std::size_t History::maxBytes() const
+{
+    return maxBytes_;
+}
+
+void History::setSpillPath(const QString & path)
+{
+    spillPath_ = path;
+    trim_();
+}
+
+QString History::spillPath() const
+{
+    return spillPath_;
+}
+
+std::size_t History::numBytes() const
+{
+    return numBytes_;
+}
+
+int History::numSpilledCheckpoints() const
+{
+    return firstInMemory_;
+}
+
+void History::deleteCheckpoint_(Checkpoint & checkpoint)
+{
+    foreach(Cell * cell, checkpoint.cells)
+        delete cell;
+    checkpoint.cells.clear();
+    checkpoint.previousCells.clear();
+    numBytes_ -= checkpoint.numBytes;
+    checkpoint.numBytes = 0;
+    if(!checkpoint.fileName.isEmpty())
+    {
+        QFile::remove(checkpoint.fileName);
+        checkpoint.fileName.clear();
+    }
+}
+
+void History::setCells_(const QMap<int, Cell*> & cells)
+{
+    for(auto it = cells.cbegin(); it != cells.cend(); ++it)
+    {
+        if(it.value())
+            cells_->cells_.insert(it.key(), it.value());
+        else
+            cells_->cells_.remove(it.key());
+    }
+}
+
+void History::addCheckpoint(VAC * vac)
+{
+    // Remove checkpoints after the current one. None of the cells they own
+    // is pointed to by the cells of the current or previous checkpoints.
+    while(checkpoints_.size() > index_+1)
+    {
+        deleteCheckpoint_(checkpoints_.last());
+        checkpoints_.removeLast();
+    }
+
+    // If the current checkpoint was read from a file, then no checkpoint is
+    // left in memory: the new one stores all the cells
+    if(index_ < firstInMemory_)
+    {
+        cells_->cells_.clear();
+        storeIndex_ = -1;
+        firstInMemory_ = checkpoints_.size();
+        stateVersions_.clear();
+        zOrderingVersion_ = 0;
+        symbolsVersion_ = 0;
+    }
+
+    Checkpoint checkpoint;
+    checkpoint.maxID = vac->maxID_;
+    checkpoint.ds = vac->ds_;
+
+    // Copy cells created or modified since the current checkpoint
+    for(auto it = vac->cells_.cbegin(); it != vac->cells_.cend(); ++it)
+    {
+        Cell * cell = it.value();
+        auto version = stateVersions_.find(it.key());
+        if(version == stateVersions_.end() || version.value() != cell->stateVersion())
+        {
+            checkpoint.cells[it.key()] = cell->clone();
+            stateVersions_[it.key()] = cell->stateVersion();
+        }
+    }
+
+    // Find cells deleted since the current checkpoint
+    for(auto it = stateVersions_.begin(); it != stateVersions_.end(); )
+    {
+        if(vac->cells_.contains(it.key()))
+        {
+            ++it;
+        }
+        else
+        {
+            checkpoint.cells[it.key()] = 0;
+            it = stateVersions_.erase(it);
+        }
+    }
+
+    // Update the state of cells, and make the copies point to each other
+    // instead of to the cells of vac
+    for(auto it = checkpoint.cells.cbegin(); it != checkpoint.cells.cend(); ++it)
+        checkpoint.previousCells[it.key()] = cells_->cells_.value(it.key(), 0);
+    setCells_(checkpoint.cells);
+    foreach(Cell * cell, checkpoint.cells)
+        if(cell)
+            cell->remapPointers(cells_);
+
+    // Depth ordering
+    if(index_ >= 0 && vac->zOrdering_.version() == zOrderingVersion_)
+    {
+        checkpoint.zOrdering = checkpoints_[index_].zOrdering;
+    }
+    else
+    {
+        for(auto c: vac->zOrdering_)
+            checkpoint.zOrdering << c->id();
+        zOrderingVersion_ = vac->zOrdering_.version();
+    }
+
+    // Symbols
+    if(index_ >= 0 && vac->symbols_.version() == symbolsVersion_)
+    {
+        checkpoint.symbols = checkpoints_[index_].symbols;
+    }
+    else
+    {
+        std::shared_ptr<Symbols> symbols = std::make_shared<Symbols>();
+        symbols->copyFrom(vac->symbols_);
+        checkpoint.symbols = symbols;
+        symbolsVersion_ = vac->symbols_.version();
+    }
+
+    checkpoint.numBytes = cellsNumBytes(checkpoint.cells);
+    numBytes_ += checkpoint.numBytes;
+
+    checkpoints_ << checkpoint;
+    index_ = checkpoints_.size() - 1;
+    storeIndex_ = index_;
+
+    trim_();
+}
+
+void History::trim_()
+{
+    // The oldest checkpoint in memory is merged into the next one, which
+    // must therefore be in the state of cells or before
+    while(numBytes_ > maxBytes_ && !spillPath_.isEmpty() && firstInMemory_ < storeIndex_)
+    {
+        if(!spill_())
+            break;
+    }
+}
+
+bool History::spill_()
+{
+    Checkpoint & checkpoint = checkpoints_[firstInMemory_];
+    Checkpoint & next = checkpoints_[firstInMemory_+1];
+    CellTable store = cells_->cells_;
+
+    // Write the checkpoint, whose cells are the state of all cells
+    QString fileName = QString("%1.%2").arg(spillPath_).arg(firstInMemory_);
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QFile::Truncate | QFile::Text))
+    {
+        qWarning("Couldn't write undo history file.");
+        return false;
+    }
+    cells_->cells_.assign(checkpoint.cells);
+    foreach(int id, checkpoint.zOrdering)
+        cells_->zOrdering_.insertLast(cells_->getCell(id));
+    XmlStreamWriter xml(&file);
+    xml.writeStartDocument();
+    xml.writeStartElement("objects");
+    cells_->write(xml);
+    xml.writeEndElement();
+    xml.writeEndDocument();
+    file.close();
+    cells_->zOrdering_.clear();
+
+    // Merge it into the next checkpoint: the cells it modified or deleted
+    // are not needed anymore, and the others are moved to the next one
+    QList<Cell*> movedCells;
+    for(auto it = checkpoint.cells.cbegin(); it != checkpoint.cells.cend(); ++it)
+    {
+        if(next.cells.contains(it.key()))
+        {
+            delete it.value();
+            if(!next.cells.value(it.key()))
+                next.cells.remove(it.key());
+        }
+        else
+        {
+            next.cells[it.key()] = it.value();
+            movedCells << it.value();
+        }
+    }
+    checkpoint.cells.clear();
+    next.previousCells.clear();
+    numBytes_ -= checkpoint.numBytes;
+    checkpoint.numBytes = 0;
+    checkpoint.fileName = fileName;
+    numBytes_ -= next.numBytes;
+    next.numBytes = cellsNumBytes(next.cells);
+    numBytes_ += next.numBytes;
+
+    // Moved cells may point to the deleted ones: make them point to the
+    // cells of the next checkpoint instead
+    cells_->cells_.assign(next.cells);
+    foreach(Cell * cell, movedCells)
+        cell->remapPointers(cells_);
+    cells_->cells_ = store;
+
+    ++firstInMemory_;
+    return true;
+}
+
+VAC * History::goToCheckpoint(int i)
+{
+    index_ = i;
+    const Checkpoint & checkpoint = checkpoints_[index_];
+
+    // Read the checkpoint if it is not in memory
+    if(index_ < firstInMemory_)
+    {
+        VAC * vac = new VAC();
+        QFile file(checkpoint.fileName);
+        if (file.open(QIODevice::ReadOnly | QIODevice::Text))
+        {
+            XmlStreamReader xml(&file);
+            if (xml.readNextStartElement() && xml.name() == "objects")
+                vac->read(xml);
+            file.close();
+        }
+        else
+        {
+            qWarning("Couldn't read undo history file.");
+        }
+        vac->setMaxID_(checkpoint.maxID);
+        vac->ds_ = checkpoint.ds;
+        vac->symbols_.copyFrom(*checkpoint.symbols);
+
+        // No cell in memory to compare against
+        stateVersions_.clear();
+        zOrderingVersion_ = 0;
+        symbolsVersion_ = vac->symbols_.version();
+
+        return vac;
+    }
+
+    // Update the state of cells
+    while(storeIndex_ > i)
+    {
+        setCells_(checkpoints_[storeIndex_].previousCells);
+        --storeIndex_;
+    }
+    while(storeIndex_ < i)
+    {
+        ++storeIndex_;
+        setCells_(checkpoints_[storeIndex_].cells);
+    }
+
+    // Copy them into a new VAC
+    foreach(int id, checkpoint.zOrdering)
+        cells_->zOrdering_.insertLast(cells_->getCell(id));
+    cells_->setMaxID_(checkpoint.maxID);
+    cells_->ds_ = checkpoint.ds;
+    VAC * vac = cells_->clone();
+    vac->symbols_.copyFrom(*checkpoint.symbols);
+    cells_->zOrdering_.clear();
+
+    // Remember their stamps, to detect which ones are modified next
+    stateVersions_.clear();
+    for(auto it = vac->cells_.cbegin(); it != vac->cells_.cend(); ++it)
+        stateVersions_[it.key()] = it.value()->stateVersion();
+    zOrderingVersion_ = vac->zOrdering_.version();
+    symbolsVersion_ = vac->symbols_.version();
+
+    return vac;
+}
+
+}
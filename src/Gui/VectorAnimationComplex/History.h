@@ -0,0 +1,143 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#ifndef VAC_HISTORY_H
+#define VAC_HISTORY_H
+
+// History: undo history of a VAC, as a list of checkpoints. Rather than a full
+// copy of the VAC, each checkpoint stores a copy of the cells created or
+// modified since the previous checkpoint, and the IDs of the cells deleted
+// since then. Unmodified cells are shared with previous checkpoints, so that
+// memory usage is proportional to the edits made, and adding a checkpoint
+// only copies the modified cells.
+//
+// Symbols (see Symbols) are small: each checkpoint stores a copy of all of
+// them, shared with the previous checkpoint if unchanged.
+//
+// Modified cells are detected by comparing their Cell::stateVersion() with
+// the one they had at the previous checkpoint. Copies stored in the history
+// point to each other (see Cell::remapPointers()) rather than to the cells of
+// the VAC, and are never used for anything else than being copied back.
+//
+// The memory used by checkpoints can be bounded (see setMaxBytes()): when
+// over budget, the oldest checkpoint is written to a file, and merged into
+// the next one, which then stores all the cells. Going back to a checkpoint
+// written to a file reads it back, using the same XML format as documents.
+
+#include <QMap>
+#include <QList>
+#include <QString>
+#include <cstddef>
+#include <memory>
+
+namespace VectorAnimationComplex
+{
+
+class VAC;
+class Cell;
+class Symbols;
+
+class History
+{
+public:
+    History();
+    ~History();
+
+    // Remove all checkpoints
+    void clear();
+
+    // Number of checkpoints, and index of the current checkpoint (-1 if empty)
+    int size() const;
+    int index() const;
+
+    // Add a checkpoint storing the current state of vac right after the
+    // current checkpoint, and make it current. Checkpoints after the current
+    // checkpoint are removed.
+    void addCheckpoint(VAC * vac);
+
+    // Make the i-th checkpoint current, and return a new VAC in its state.
+    // The caller takes ownership of the returned VAC. Subsequent checkpoints
+    // are expected to be added from this VAC (adding them from another VAC
+    // is correct, but copies all its cells).
+    VAC * goToCheckpoint(int i);
+
+    // Memory budget, in bytes, of the checkpoints kept in memory. It is only
+    // enforced if a spill path is set.
+    void setMaxBytes(std::size_t maxBytes);
+    std::size_t maxBytes() const;
+
+    // Checkpoints over budget are written to the files <path>.<index>. The
+    // default, an empty path, keeps all checkpoints in memory.
+    void setSpillPath(const QString & path);
+    QString spillPath() const;
+
+    // Statistics. The memory used by checkpoints is an estimate, and does not
+    // account for edge geometry shared with the VAC (see KeyEdge::geometry()).
+    std::size_t numBytes() const;
+    int numSpilledCheckpoints() const;
+
+private:
+    struct Checkpoint
+    {
+        // Cells created, modified, or deleted (null) at this checkpoint,
+        // and their state at the previous checkpoint (null if created).
+        // The former are owned by the checkpoint, not the latter.
+        QMap<int, Cell*> cells;
+        QMap<int, Cell*> previousCells;
+
+        // IDs of all cells in depth order. Implicitly shared with the
+        // previous checkpoint if unchanged.
+        QList<int> zOrdering;
+
+        // Symbols and their instances. Shared with the previous checkpoint
+        // if unchanged. Kept in memory even if the cells are written to a
+        // file.
+        std::shared_ptr<const Symbols> symbols;
+
+        // Data of the VAC which is not stored in cells
+        int maxID;
+        double ds;
+
+        // Estimated memory used by cells
+        std::size_t numBytes;
+
+        // File the checkpoint is written to, if not in memory. Its cells
+        // are then empty.
+        QString fileName;
+    };
+    QList<Checkpoint> checkpoints_;
+    int index_;
+
+    // State of all cells at checkpoint storeIndex_, which is index_ unless
+    // the current checkpoint is not in memory (-1 if none). Their copies
+    // are stored in a VAC so that they can be remapped to point to each
+    // other, but they are owned by the checkpoints, not by this VAC.
+    VAC * cells_;
+    int storeIndex_;
+    void setCells_(const QMap<int, Cell*> & cells);
+
+    // Checkpoints before firstInMemory_ are written to files. The cells of
+    // checkpoint firstInMemory_ are the state of all cells.
+    int firstInMemory_;
+    std::size_t numBytes_;
+    std::size_t maxBytes_;
+    QString spillPath_;
+    void trim_();
+    bool spill_();
+
+    // Stamps of the cells of the VAC at the current checkpoint
+    QMap<int, unsigned int> stateVersions_;
+    unsigned int zOrderingVersion_;
+    unsigned int symbolsVersion_;
+
+    void deleteCheckpoint_(Checkpoint & checkpoint);
+};
+
+}
+
+#endif // VAC_HISTORY_H
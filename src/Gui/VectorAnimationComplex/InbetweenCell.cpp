@@ -20,11 +20,13 @@ namespace VectorAnimationComplex
 InbetweenCell::InbetweenCell(VAC * vac) :
     Cell(vac)
 {
+    addKindBit_(InbetweenCellBit);
 }
 
 InbetweenCell::InbetweenCell(InbetweenCell * other) :
     Cell(other)
 {
+    addKindBit_(InbetweenCellBit);
 }
 
 void InbetweenCell::remapPointers(VAC * /*newVAC*/)
@@ -38,6 +40,7 @@ InbetweenCell::~InbetweenCell()
 InbetweenCell::InbetweenCell(VAC * vac, QTextStream & in) :
     Cell(vac, in)
 {
+    addKindBit_(InbetweenCellBit);
 }
 
 void InbetweenCell::read2ndPass()
@@ -51,6 +54,7 @@ void InbetweenCell::save_(QTextStream & /*out*/)
 InbetweenCell::InbetweenCell(VAC * vac, XmlStreamReader & xml) :
     Cell(vac, xml)
 {
+    addKindBit_(InbetweenCellBit);
 }
 
 void InbetweenCell::write_(XmlStreamWriter & /*xml*/) const
@@ -12,6 +12,7 @@
 #include "InbetweenVertex.h"
 #include "Halfedge.h"
 #include "EdgeGeometry.h"
+#include "EvaluationContext.h"
 #include "VAC.h"
 
 #include "Eigen.h"
@@ -21,13 +22,14 @@
 #include <QtDebug>
 #include <QTextStream>
 #include "../SaveAndLoad.h"
-#include "../DevSettings.h"
 #include "../Global.h"
+#include "../DevSettings.h"
 
 #include "../XmlStreamWriter.h"
 #include "../XmlStreamReader.h"
 
 #include <assert.h>
+#include <cmath>
 
 namespace VectorAnimationComplex
 {
@@ -322,6 +324,10 @@ InbetweenEdge::InbetweenEdge(VAC * vac, XmlStreamReader & xml) :
         afterCycle_.replaceVertex(oldVertex,newVertex);
         startAnimatedVertex_.replaceVertex(oldVertex,newVertex);
         endAnimatedVertex_.replaceVertex(oldVertex,newVertex);
+        beforeSampling_.clear();
+        afterSampling_.clear();
+        stroke_.clear();
+        lodSamplings_.clear();
     }
     void InbetweenEdge::updateBoundary_impl(const KeyHalfedge & oldHalfedge, const KeyHalfedge & newHalfedge)
     {
@@ -329,6 +335,10 @@ InbetweenEdge::InbetweenEdge(VAC * vac, XmlStreamReader & xml) :
         afterPath_.replaceHalfedge(oldHalfedge,newHalfedge);
         beforeCycle_.replaceHalfedge(oldHalfedge,newHalfedge);
         afterCycle_.replaceHalfedge(oldHalfedge,newHalfedge);
+        beforeSampling_.clear();
+        afterSampling_.clear();
+        stroke_.clear();
+        lodSamplings_.clear();
     }
     void InbetweenEdge::updateBoundary_impl(KeyEdge * oldEdge, const KeyEdgeList & newEdges)
     {
@@ -336,6 +346,10 @@ InbetweenEdge::InbetweenEdge(VAC * vac, XmlStreamReader & xml) :
         afterPath_.replaceEdges(oldEdge,newEdges);
         beforeCycle_.replaceEdges(oldEdge,newEdges);
         afterCycle_.replaceEdges(oldEdge,newEdges);
+        beforeSampling_.clear();
+        afterSampling_.clear();
+        stroke_.clear();
+        lodSamplings_.clear();
     }
 
 
@@ -347,106 +361,124 @@ InbetweenEdge::InbetweenEdge(VAC * vac, XmlStreamReader & xml) :
     void InbetweenEdge::clearCachedGeometry_()
     {
         EdgeCell::clearCachedGeometry_();
-        surf_.clear();
-        norm_.clear();
+        surfVertices_.clear();
+        surfNormals_.clear();
+        surfIndices_.clear();
+        beforeSampling_.clear();
+        afterSampling_.clear();
+        stroke_.clear();
+        lodSamplings_.clear();
     }
 
     void InbetweenEdge::computeInbetweenSurface(View3DSettings & viewSettings)
     {
-        surf_.clear();
-        norm_.clear();
+        surfVertices_.clear();
+        surfNormals_.clear();
+        surfIndices_.clear();
+        surfK1_ = viewSettings.k1();
+        surfK2_ = viewSettings.k2();
 
         double eps = 1e-5;
         double tMin = beforeTime().floatTime();
         double tMax = afterTime().floatTime();
-        int k = viewSettings.k1(); // number of samples per frame
+        int k = surfK1_; // number of samples per frame
         double dt = 1 / (double)k;
 
-        // positions
+        // positions. The key paths are sampled once for all rows
+        Vector2dVector beforeSampling;
+        Vector2dVector afterSampling;
+        sampleKeyPaths_(beforeSampling, afterSampling);
+        int n = beforeSampling.size(); // number of samples per row
+        int numRows = 0;
         for(double t=tMin; t<tMax+eps; t+=dt)
         {
-            QList<Eigen::Vector3d> geo3D;
-
-            QList<Eigen::Vector2d> geo2D = getGeometry(Time(t));
-            for(int i=0; i< geo2D.size(); ++i)
+            Vector2dVector geo2D = interpolateKeyPaths_(Time(t), beforeSampling, afterSampling);
+            for(int j=0; j<n; ++j)
             {
-                Eigen::Vector3d pos(
-                        viewSettings.xFromX2D(geo2D[i][0]),
-                        viewSettings.yFromY2D(geo2D[i][1]),
-                        viewSettings.zFromT(t));
-                geo3D << pos;
+                surfVertices_.push_back(Eigen::Vector3d(
+                        viewSettings.xFromX2D(geo2D[j][0]),
+                        viewSettings.yFromY2D(geo2D[j][1]),
+                        t));
             }
-
-            surf_ << geo3D;
+            ++numRows;
         }
 
-
-        if(surf_.size() < 2)
+        if(numRows < 2 || n < 2)
             return;
 
-        // normals
-        for(int i=0; i<surf_.size(); i++)
+        // normals. Note: the z axis of the view is scaled by zFromT(1.0),
+        // which is negative, hence u x v instead of -u x v
+        surfNormals_.reserve(surfVertices_.size());
+        for(int i=0; i<numRows; i++)
         {
-            QList<Eigen::Vector3d> list;
-            for(int j=0; j<surf_[0].size(); j++)
+            for(int j=0; j<n; j++)
             {
-                int i_=i;
-                int j_=j;
-                if(i==surf_.size()-1)
-                    i_--;
-                if(j==surf_[0].size()-1)
-                    j_--;
-                Eigen::Vector3d a = surf_[i_][j_];
-                Eigen::Vector3d b = surf_[i_][j_+1];
-                Eigen::Vector3d c = surf_[i_+1][j_];
+                int i_ = (i == numRows-1) ? i-1 : i;
+                int j_ = (j == n-1) ? j-1 : j;
+                const Eigen::Vector3d & a = surfVertices_[i_*n + j_];
+                const Eigen::Vector3d & b = surfVertices_[i_*n + j_+1];
+                const Eigen::Vector3d & c = surfVertices_[(i_+1)*n + j_];
                 Eigen::Vector3d u = b-a;
                 Eigen::Vector3d v = c-a;
-                Eigen::Vector3d N = -u.cross(v);
-                list << N;
-                //qDebug() << N[0] << N[1] << N[2];
+                surfNormals_.push_back(u.cross(v));
             }
-            norm_ << list;
         }
-    }
 
-    void InbetweenEdge::drawRaw3D(View3DSettings & viewSettings)
-    {
-        if(surf_.isEmpty())
-            computeInbetweenSurface(viewSettings);
-
-        // drawn in  backward order  to improve the  likeliness the
-        // polygon are  drawn from rear  to near, and  improve the
+        // triangles, in backward order to improve the likeliness the
+        // polygon are drawn from rear to near, and improve the
         // chance to get the transparency right
-        int n = surf_[0].size();
-        for(int i=surf_.size()-2; i>=0; i--)
+        for(int i=numRows-2; i>=0; i--)
         {
-            glBegin(GL_QUAD_STRIP);
-            for(int j=0; j<n;)
+            int j = 0;
+            while(j < n-1)
             {
-                //glColor4d(1.0,0.5,0.5,0.2);
-                glNormal3d(norm_[i][j][0],norm_[i][j][1],norm_[i][j][2]);
-                glVertex3d(surf_[i][j][0],surf_[i][j][1],surf_[i][j][2]);
-                glNormal3d(norm_[i+1][j][0],norm_[i+1][j][1],norm_[i+1][j][2]);
-                glVertex3d(surf_[i+1][j][0],surf_[i+1][j][1],surf_[i+1][j][2]);
-
-                if(j == n-1)
-                {
-                    break;
-                }
-                else
-                {
-                    j += viewSettings.k2();
-                    if(j >= n)
-                        j = n-1;
-                }
+                int jNext = std::min(j + surfK2_, n-1);
+                unsigned int a0 = i*n + j;
+                unsigned int a1 = (i+1)*n + j;
+                unsigned int b0 = i*n + jNext;
+                unsigned int b1 = (i+1)*n + jNext;
+                surfIndices_.push_back(a0);
+                surfIndices_.push_back(a1);
+                surfIndices_.push_back(b0);
+                surfIndices_.push_back(b0);
+                surfIndices_.push_back(a1);
+                surfIndices_.push_back(b1);
+                j = jNext;
             }
-            glEnd();
         }
     }
 
-    QList<Eigen::Vector2d>  InbetweenEdge::getGeometry(Time time)
+    void InbetweenEdge::drawRaw3D(View3DSettings & viewSettings)
+    {
+        if(surfVertices_.empty() || surfK1_ != viewSettings.k1() || surfK2_ != viewSettings.k2())
+            computeInbetweenSurface(viewSettings);
+        if(surfIndices_.empty())
+            return;
+
+        // zFromT() is linear, so the time scale is applied as a transform
+        glPushMatrix();
+        glScaled(1, 1, viewSettings.zFromT(1.0));
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glEnableClientState(GL_NORMAL_ARRAY);
+        glVertexPointer(3, GL_DOUBLE, 0, surfVertices_[0].data());
+        glNormalPointer(GL_DOUBLE, 0, surfNormals_[0].data());
+        glDrawElements(GL_TRIANGLES, surfIndices_.size(), GL_UNSIGNED_INT, surfIndices_.data());
+        glDisableClientState(GL_NORMAL_ARRAY);
+        glDisableClientState(GL_VERTEX_ARRAY);
+        glPopMatrix();
+    }
+
+    Vector2dVector InbetweenEdge::getGeometry(Time time)
     {
+        Vector2dVector beforeSampling;
+        Vector2dVector afterSampling;
+        sampleKeyPaths_(beforeSampling, afterSampling);
+        return interpolateKeyPaths_(time, beforeSampling, afterSampling);
+    }
 
+    void InbetweenEdge::sampleKeyPaths_(Vector2dVector & beforeSampling,
+                                        Vector2dVector & afterSampling) const
+    {
         // Compute lengths of key paths
         double beforeLength = 0;
         double afterLength = 0;
@@ -463,8 +495,6 @@ InbetweenEdge::InbetweenEdge(VAC * vac, XmlStreamReader & xml) :
         double maxLength = std::max(beforeLength,afterLength);
         // Compute uniform sampling of key paths
         int numSamples = (int) (maxLength/5.0) + 2;
-        QList<Eigen::Vector2d> beforeSampling;
-        QList<Eigen::Vector2d> afterSampling;
         if(isClosed())
         {
             beforeCycle_.sample(numSamples,beforeSampling);
@@ -477,6 +507,14 @@ InbetweenEdge::InbetweenEdge(VAC * vac, XmlStreamReader & xml) :
         }
         assert(beforeSampling.size() == numSamples);
         assert(afterSampling.size() == numSamples);
+    }
+
+    Vector2dVector InbetweenEdge::interpolateKeyPaths_(Time time,
+                                                       const Vector2dVector & beforeSampling,
+                                                       const Vector2dVector & afterSampling) const
+    {
+        int numSamples = beforeSampling.size();
+
         // Interpolate key paths
         double t = time.floatTime(); // in [t1,t2]
         double t1 = beforeTime().floatTime();
@@ -489,14 +527,15 @@ InbetweenEdge::InbetweenEdge(VAC * vac, XmlStreamReader & xml) :
             u = 0;
         else
             u = 1;
-        QList<Eigen::Vector2d> sampling;
+        Vector2dVector sampling;
+        sampling.reserve(numSamples);
         for(int i=0; i<numSamples; ++i)
-            sampling << beforeSampling[i] + u * (afterSampling[i]-beforeSampling[i]);
+            sampling.push_back(beforeSampling[i] + u * (afterSampling[i]-beforeSampling[i]));
         // Warp to ensure topological constraints
         if(!isClosed())
         {
-            Eigen::Vector2d currentStartPos = sampling.first();
-            Eigen::Vector2d currentEndPos = sampling.last();
+            Eigen::Vector2d currentStartPos = sampling.front();
+            Eigen::Vector2d currentEndPos = sampling.back();
             Eigen::Vector2d desiredStartPos = startAnimatedVertex_.pos(time);
             Eigen::Vector2d desiredEndPos = endAnimatedVertex_.pos(time);
             Eigen::Vector2d deltaStartPos =  desiredStartPos - currentStartPos;
@@ -512,7 +551,30 @@ InbetweenEdge::InbetweenEdge(VAC * vac, XmlStreamReader & xml) :
         return sampling;
     }
 
-    QList<EdgeSample> InbetweenEdge::getSampling(Time time) const
+    void InbetweenEdge::reportMemory(MemoryStats::Report & report) const
+    {
+        report.add(MemoryStats::Geometry,
+                   (beforeSampling_.capacity() + afterSampling_.capacity()) * sizeof(EdgeSample) +
+                   lodSamplingsNumBytes_() +
+                   (surfVertices_.capacity() + surfNormals_.capacity()) * sizeof(Eigen::Vector3d) +
+                   surfIndices_.capacity() * sizeof(unsigned int));
+    }
+
+    std::size_t InbetweenEdge::lodSamplingsNumBytes_() const
+    {
+        std::size_t res = 0;
+        for(const LodSampling_ & lodSampling: lodSamplings_)
+            res += (lodSampling.beforeSampling.capacity() + lodSampling.afterSampling.capacity()) * sizeof(EdgeSample);
+        return res;
+    }
+
+    void InbetweenEdge::prepareSampling() const
+    {
+        prepareSampling(EvaluationContext::current());
+    }
+
+    void InbetweenEdge::sampleKeyPaths_(double ds, EdgeSampleVector & beforeSampling,
+                                        EdgeSampleVector & afterSampling) const
     {
         // Compute lengths of key paths
         double beforeLength = 0;
@@ -530,10 +592,7 @@ InbetweenEdge::InbetweenEdge(VAC * vac, XmlStreamReader & xml) :
         double maxLength = std::max(beforeLength,afterLength);
 
         // Compute uniform sampling of key paths
-        double ds = DevSettings::getDouble("ds");
         int numSamples = (int) (maxLength/ds) + 2;
-        QList<EdgeSample> beforeSampling;
-        QList<EdgeSample> afterSampling;
         if(isClosed())
         {
             beforeCycle_.sample(numSamples,beforeSampling);
@@ -546,32 +605,150 @@ InbetweenEdge::InbetweenEdge(VAC * vac, XmlStreamReader & xml) :
         }
         assert(beforeSampling.size() == numSamples);
         assert(afterSampling.size() == numSamples);
+    }
 
-        // Interpolate key paths
+    void InbetweenEdge::prepareSampling(const EvaluationContext & context) const
+    {
+        double ds = context.ds;
+        if(!beforeSampling_.empty() && samplingDs_ == ds)
+        {
+            if(stroke_.isEmpty() || stroke_.numSub() != context.numSub)
+                prepareStroke_(context.numSub);
+            return;
+        }
+
+        EdgeSampleVector beforeSampling;
+        EdgeSampleVector afterSampling;
+        sampleKeyPaths_(ds, beforeSampling, afterSampling);
+        beforeSampling_.swap(beforeSampling);
+        afterSampling_.swap(afterSampling);
+        samplingDs_ = ds;
+        prepareStroke_(context.numSub);
+    }
+
+    void InbetweenEdge::prepareStroke_(int numSub) const
+    {
+        // Do not shrink edge width when edge shrink to vertex, see getSampling()
+        EdgeSampleVector beforeSampling = beforeSampling_;
+        EdgeSampleVector afterSampling = afterSampling_;
+        int numSamples = beforeSampling.size();
+        if(beforePath_.type() == Path::SingleVertex ||
+           beforeCycle_.type() == Cycle::SingleVertex)
+        {
+            for(int i=0; i<numSamples; ++i)
+                beforeSampling[i].setWidth(afterSampling[i].width());
+        }
+        else if (afterPath_.type() == Path::SingleVertex ||
+                 afterCycle_.type() == Cycle::SingleVertex)
+        {
+            for(int i=0; i<numSamples; ++i)
+                afterSampling[i].setWidth(beforeSampling[i].width());
+        }
+
+        stroke_.setSamplings(beforeSampling, afterSampling, isClosed(), numSub);
+    }
+
+    EdgeSampleVector InbetweenEdge::getSampling(Time time) const
+    {
+        EdgeSampleVector samples;
+        getSampling(time, samples);
+        return samples;
+    }
+
+    void InbetweenEdge::interpolationParameters_(Time time, double & u,
+                                                 Eigen::Vector2d & deltaStart,
+                                                 Eigen::Vector2d & deltaEnd) const
+    {
+        // Interpolation parameter
         double t = time.floatTime(); // in [t1,t2]
         double t1 = beforeTime().floatTime();
         double t2 = afterTime().floatTime();
         double dt = t2-t1;
-        double u; // in [0,1]
         if(dt > 0)
             u = (t-t1)/dt;
         else if (t<t1)
             u = 0;
         else
             u = 1;
-        QList<EdgeSample> sampling;
-        for(int i=0; i<numSamples; ++i)
-            sampling << beforeSampling[i] + (afterSampling[i]-beforeSampling[i]) * u;
 
-        // Warp to ensure topological constraints
+        // Warp to ensure topological constraints: translations of the start
+        // and end samples of the interpolated key paths to the animated
+        // vertices, linearly distributed along the edge
+        deltaStart = Eigen::Vector2d(0,0);
+        deltaEnd = Eigen::Vector2d(0,0);
         if(!isClosed())
         {
-            Eigen::Vector2d currentStartPos(sampling.first().x(),sampling.first().y());
-            Eigen::Vector2d currentEndPos(sampling.last().x(),sampling.last().y());
+            const EdgeSample & beforeStart = beforeSampling_.front();
+            const EdgeSample & afterStart = afterSampling_.front();
+            const EdgeSample & beforeEnd = beforeSampling_.back();
+            const EdgeSample & afterEnd = afterSampling_.back();
+            EdgeSample currentStart = beforeStart + (afterStart-beforeStart) * u;
+            EdgeSample currentEnd = beforeEnd + (afterEnd-beforeEnd) * u;
+            Eigen::Vector2d currentStartPos(currentStart.x(),currentStart.y());
+            Eigen::Vector2d currentEndPos(currentEnd.x(),currentEnd.y());
             Eigen::Vector2d desiredStartPos = startAnimatedVertex_.pos(time);
             Eigen::Vector2d desiredEndPos = endAnimatedVertex_.pos(time);
-            Eigen::Vector2d deltaStartPos =  desiredStartPos - currentStartPos;
-            Eigen::Vector2d deltaEndPos =  desiredEndPos - currentEndPos;
+            deltaStart =  desiredStartPos - currentStartPos;
+            deltaEnd =  desiredEndPos - currentEndPos;
+        }
+    }
+
+    void InbetweenEdge::getSampling(Time time, EdgeSampleVector & sampling) const
+    {
+        getSampling(time, EvaluationContext::current(), sampling);
+    }
+
+    void InbetweenEdge::getSampling(Time time, const EvaluationContext & context, EdgeSampleVector & sampling) const
+    {
+        // Get uniform sampling of key paths
+        prepareSampling(context);
+        interpolateSamplings_(time, beforeSampling_, afterSampling_, sampling);
+    }
+
+    // The spacing of samples is ds at level 1, where a pixel is at most one
+    // unit wide, and doubles at each coarser level, so that it stays about
+    // the same on screen (see EdgeCell::levelOfDetail()). The samplings of
+    // the key paths are cached per level, and only used for drawing.
+    EdgeSampleVector InbetweenEdge::levelOfDetailSampling(Time time, int levelOfDetail) const
+    {
+        static const DevSettings::Bool inbetweenLevelOfDetail("inbetween level of detail");
+        if(levelOfDetail <= 1 || !inbetweenLevelOfDetail)
+            return getSampling(time);
+
+        EvaluationContext context = EvaluationContext::current();
+        double ds = context.ds * std::pow(2.0, levelOfDetail-1);
+        LodSampling_ & lodSampling = lodSamplings_[levelOfDetail];
+        if(lodSampling.beforeSampling.empty() || lodSampling.ds != ds)
+        {
+            // Endpoints of the key paths are used to warp the interpolation
+            prepareSampling(context);
+            sampleKeyPaths_(ds, lodSampling.beforeSampling, lodSampling.afterSampling);
+            lodSampling.ds = ds;
+        }
+
+        EdgeSampleVector sampling;
+        interpolateSamplings_(time, lodSampling.beforeSampling, lodSampling.afterSampling, sampling);
+        return sampling;
+    }
+
+    void InbetweenEdge::interpolateSamplings_(Time time,
+                                              const EdgeSampleVector & beforeSampling,
+                                              const EdgeSampleVector & afterSampling,
+                                              EdgeSampleVector & sampling) const
+    {
+        int numSamples = beforeSampling.size();
+
+        // Interpolate key paths
+        double u; // in [0,1]
+        Eigen::Vector2d deltaStartPos, deltaEndPos;
+        interpolationParameters_(time, u, deltaStartPos, deltaEndPos);
+        sampling.clear();
+        for(int i=0; i<numSamples; ++i)
+            sampling.push_back(beforeSampling[i] + (afterSampling[i]-beforeSampling[i]) * u);
+
+        // Warp to ensure topological constraints
+        if(!isClosed())
+        {
             double du = 1.0/(numSamples-1);
             for(int i=0; i<numSamples; ++i)
             {
@@ -600,20 +777,20 @@ InbetweenEdge::InbetweenEdge(VAC * vac, XmlStreamReader & xml) :
                 sampling[i].setWidth(beforeSampling[i].width());
             }
         }
-
-        return sampling;
     }
 
-    void InbetweenEdge::triangulate_(Time time, Triangles & out) const
+    void InbetweenEdge::triangulate_(Time time, const EvaluationContext & context, Triangles & out) const
     {
+        // Same as LinearSpline(getSampling(time)).triangulate(out), without
+        // subdividing the interpolated sampling
         out.clear();
         if (exists(time))
         {
-            QList<EdgeSample> samples = getSampling(time);
-            LinearSpline ls(samples);
-            if(isClosed())
-                ls.makeLoop();
-            ls.triangulate(out);
+            prepareSampling(context);
+            double u;
+            Eigen::Vector2d deltaStart, deltaEnd;
+            interpolationParameters_(time, u, deltaStart, deltaEnd);
+            stroke_.triangulate(u, deltaStart, deltaEnd, out);
         }
     }
 
@@ -622,7 +799,8 @@ InbetweenEdge::InbetweenEdge(VAC * vac, XmlStreamReader & xml) :
         out.clear();
         if (exists(time))
         {
-            QList<EdgeSample> samples = getSampling(time);
+            EdgeSampleVector samples;
+            getSampling(time, samples);
             LinearSpline ls(samples);
             if(isClosed())
                 ls.makeLoop();
@@ -16,9 +16,12 @@
 #include "Cycle.h"
 #include "AnimatedVertex.h"
 #include "EdgeSample.h"
+#include "EdgeGeometry.h"
 
 #include <QList>
+#include <vector>
 #include <QPair>
+#include <QMap>
 
 namespace VectorAnimationComplex
 {
@@ -77,22 +80,87 @@ public:
     //void resetSampling();
 
     // Other
-    QList<EdgeSample> getSampling(Time time) const; // Note: repeat start and end vertices even when closed.
-    QList<Eigen::Vector2d> getGeometry(Time time); // Note: repeat start and end vertices even when closed.
+    typedef VectorAnimationComplex::EdgeSampleVector EdgeSampleVector;
+    EdgeSampleVector getSampling(Time time) const; // Note: repeat start and end vertices even when closed.
+    void getSampling(Time time, EdgeSampleVector & out) const; // Same, written into a reusable buffer
+    void getSampling(Time time, const EvaluationContext & context, EdgeSampleVector & out) const;
+
+    // The uniform samplings of the key paths, which getSampling() interpolates,
+    // are cached and computed lazily, which is not thread-safe. Call this
+    // beforehand to be able to call getSampling() from several threads, with
+    // the same context. Overloads without context use the current one, and
+    // must be called from the GUI thread.
+    void prepareSampling() const;
+    void prepareSampling(const EvaluationContext & context) const;
+
+    // Coarser sampling for the given level of detail (see EdgeCell)
+    EdgeSampleVector levelOfDetailSampling(Time time, int levelOfDetail) const;
+
+    // Memory used by the cached samplings and 3D surface
+    void reportMemory(MemoryStats::Report & report) const;
+    Vector2dVector getGeometry(Time time); // Note: repeat start and end vertices even when closed.
 
 private:
-    // Cached geometry
-    QList< QList<Eigen::Vector3d> > surf_;
-    QList< QList<Eigen::Vector3d> > norm_;
+    // Cached swept surface drawn in the 3D view (empty if not computed yet):
+    // one row of getGeometry(t) per step of 1/k1 frame between beforeTime()
+    // and afterTime(), with z = t, so that it doesn't depend on the time
+    // scale of the view, and triangles using every k2-th sample of each row.
+    // k1 and k2 are the values of the view settings it was computed with
+    std::vector<Eigen::Vector3d> surfVertices_;
+    std::vector<Eigen::Vector3d> surfNormals_;
+    std::vector<unsigned int> surfIndices_;
+    int surfK1_;
+    int surfK2_;
     virtual void clearCachedGeometry_();
     void computeInbetweenSurface(View3DSettings & viewSettings);
 
+    // Implementation of getGeometry(): uniform samplings of the key paths,
+    // then their interpolation at the given time
+    void sampleKeyPaths_(Vector2dVector & beforeSampling,
+                         Vector2dVector & afterSampling) const;
+    Vector2dVector interpolateKeyPaths_(Time time,
+                                        const Vector2dVector & beforeSampling,
+                                        const Vector2dVector & afterSampling) const;
+
+    // Cached uniform samplings of the key paths (empty if not computed yet),
+    // and the value of the "ds" setting they were computed with
+    mutable EdgeSampleVector beforeSampling_;
+    mutable EdgeSampleVector afterSampling_;
+    mutable double samplingDs_;
+    void sampleKeyPaths_(double ds, EdgeSampleVector & beforeSampling,
+                         EdgeSampleVector & afterSampling) const;
+    void interpolateSamplings_(Time time,
+                               const EdgeSampleVector & beforeSampling,
+                               const EdgeSampleVector & afterSampling,
+                               EdgeSampleVector & sampling) const;
+
+    // Cached samplings of the key paths for coarser levels of detail
+    struct LodSampling_
+    {
+        EdgeSampleVector beforeSampling;
+        EdgeSampleVector afterSampling;
+        double ds;
+    };
+    mutable QMap<int, LodSampling_> lodSamplings_;
+    std::size_t lodSamplingsNumBytes_() const;
+
+    // Stroke of the interpolations of the cached samplings, which
+    // triangulate_() uses so that the samplings are only subdivided once
+    mutable InterpolatedStroke stroke_;
+    void prepareStroke_(int numSub) const;
+
+    // Parameters of the interpolation at the given time, see getSampling()
+    void interpolationParameters_(Time time, double & u,
+                                  Eigen::Vector2d & deltaStart,
+                                  Eigen::Vector2d & deltaEnd) const;
+
     // Trusting operators
     friend class VAC;
     friend class Operator;
     bool check_() const;
 
     ~InbetweenEdge();
+    InbetweenEdge * asInbetweenEdge_() { return this; }
 
     // Update Boundary
     void updateBoundary_impl(KeyVertex * oldVertex, KeyVertex * newVertex);
@@ -114,7 +182,7 @@ private:
     Cycle afterCycle_;
 
     // Implementation of triangulate
-    void triangulate_(Time time, Triangles & out) const;
+    void triangulate_(Time time, const EvaluationContext & context, Triangles & out) const;
     void triangulate_(double width, Time time, Triangles & out) const;
 
 // --------- Cloning, Assigning, Copying, Serializing ----------
@@ -13,6 +13,7 @@
 #include "FaceCell.h"
 
 #include "AnimatedCycle.h"
+#include "Triangulation.h"
 
 namespace VectorAnimationComplex
 {
@@ -46,7 +47,7 @@ public:
     void removeAfterFace(KeyFace * afterFace);
 
     // Get sampling of the boundary
-    QList< QList<Eigen::Vector2d> > getSampling(Time time) const;
+    QList<Vector2dVector> getSampling(Time time) const;
 
     // Getter
     int numAnimatedCycles() const;
@@ -61,6 +62,7 @@ private:
     bool check_() const;
 
     ~InbetweenFace();
+    InbetweenFace * asInbetweenFace_() { return this; }
 
     // Update Boundary
     void updateBoundary_impl(KeyVertex * oldVertex, KeyVertex * newVertex);
@@ -72,8 +74,11 @@ private:
     QSet<KeyFace*> beforeFaces_;
     QSet<KeyFace*> afterFaces_;
 
-    // Implementation of triangulate
-    void triangulate_(Time time, Triangles & out) const;
+    // Implementation of triangulate. The connectivity of the last
+    // triangulation is reused by the next one whenever possible, since
+    // successive times usually only differ by moving vertices
+    void triangulate_(Time time, const EvaluationContext & context, Triangles & out) const;
+    mutable Triangulation::Connectivity connectivity_;
 
 // --------- Cloning, Assigning, Copying, Serializing ----------
 
@@ -18,10 +18,20 @@
 
 #include <QtDebug>
 #include <QTextStream>
+#include <QMutex>
+#include <QMutexLocker>
 
 #include "../XmlStreamReader.h"
 #include "../XmlStreamWriter.h"
 
+namespace
+{
+
+// Protects the computation of the cubic splines of all inbetween vertices
+QMutex splineMutex;
+
+}
+
 namespace VectorAnimationComplex
 {
 
@@ -34,7 +44,8 @@ InbetweenVertex::InbetweenVertex(VAC * vac,
     VertexCell(vac),
 
     beforeVertex_(beforeVertex),
-    afterVertex_(afterVertex)
+    afterVertex_(afterVertex),
+    splineStamp_(0)
 {
     // color
     color_[0] = 0;
@@ -57,7 +68,8 @@ InbetweenVertex::InbetweenVertex(VAC * vac, QTextStream & in) :
     VertexCell(vac, in),
 
     beforeVertex_(0),
-    afterVertex_(0)
+    afterVertex_(0),
+    splineStamp_(0)
 {
     color_[0] = 0;
     color_[1] = 0;
@@ -121,7 +133,8 @@ InbetweenVertex::InbetweenVertex(VAC * vac, XmlStreamReader & xml) :
     VertexCell(vac, xml),
 
     beforeVertex_(0),
-    afterVertex_(0)
+    afterVertex_(0),
+    splineStamp_(0)
 {
     color_[0] = 0;
     color_[1] = 0;
@@ -156,7 +169,8 @@ InbetweenVertex::InbetweenVertex(InbetweenVertex * other):
     VertexCell(other),
 
     beforeVertex_(other->beforeVertex_),
-    afterVertex_(other->afterVertex_)
+    afterVertex_(other->afterVertex_),
+    splineStamp_(0)
 {
 }
 
@@ -210,13 +224,19 @@ void InbetweenVertex::drawRaw3D(View3DSettings & viewSettings)
 
     int lineWidth = 3;
     glLineWidth(lineWidth);
-    glBegin(GL_LINE_STRIP);
+    std::vector<double> times;
     for(double t=t1; t<t2+eps; t+=dt)
+        times.push_back(t);
+    std::vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d> > positions;
+    pos(times, positions);
+
+    glBegin(GL_LINE_STRIP);
+    for(size_t i=0; i<times.size(); ++i)
     {
-        Eigen::Vector2d p = pos(Time(t));
+        const Eigen::Vector2d & p = positions[i];
         double x = viewSettings.xFromX2D(p[0]);
         double y = viewSettings.yFromY2D(p[1]);
-        double z = viewSettings.zFromT(t);
+        double z = viewSettings.zFromT(times[i]);
         glVertex3d(x,y,z);
     }
     glEnd();
@@ -230,12 +250,44 @@ Eigen::Vector2d InbetweenVertex::pos(Time time) const
     return posCubic(time);
 }
 
+void InbetweenVertex::pos(const std::vector<double> & times,
+                          std::vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d> > & out) const
+{
+    const CubicSpline & spline = cubicSpline_();
+    out.resize(times.size());
+    for(size_t i=0; i<times.size(); ++i)
+        out[i] = spline.eval(times[i]);
+}
+
 // --------- Cubic spline interpolation---------
 
 Eigen::Vector2d InbetweenVertex::posCubic(Time time) const
+{
+    return cubicSpline_().eval(time.floatTime());
+}
+
+Eigen::Vector2d InbetweenVertex::CubicSpline::eval(double t_) const
 {
     // a notation like var_ means it is in the [t1,t2] domain
     // a notation like var  means it is in the [0 ,1 ] domain
+    double t;
+    if(dt > 0)      t = (t_-t1)/dt;
+    else if(t_<t1)  t = 0;
+    else            t = 1;
+
+    return ((c3*t + c2)*t + c1)*t + c0;
+}
+
+const InbetweenVertex::CubicSpline & InbetweenVertex::cubicSpline_() const
+{
+    // Stamps are never 0, since topology versions start at 1
+    const quint64 stamp = (static_cast<quint64>(topologyVersion()) << 32) | geometryVersion();
+    if(splineStamp_.load(std::memory_order_acquire) == stamp)
+        return spline_;
+
+    QMutexLocker locker(&splineMutex);
+    if(splineStamp_.load(std::memory_order_relaxed) == stamp)
+        return spline_;
 
     // --- get parameters in the [t1,t2] domain ---
 
@@ -251,31 +303,27 @@ Eigen::Vector2d InbetweenVertex::posCubic(Time time) const
     Eigen::Vector2d m2_ = afterVertex()->dividedDifferencesTangent(false);
     double t2_ = afterVertex()->time().floatTime();
 
-    double t_ = time.floatTime();
     double dt_ = t2_-t1_;
 
-
     // --- convert in the [0,1] domain ---
 
-    double t;
-    if(dt_ > 0)      t = (t_-t1_)/dt_;
-    else if(t_<t1_)  t = 0;
-    else             t = 1;
-
     Eigen::Vector2d p1 = p1_;
     Eigen::Vector2d p2 = p2_;
     Eigen::Vector2d m1 = m1_ * dt_;
     Eigen::Vector2d m2 = m2_ * dt_;
 
+    // --- compute cubic Hermite, in polynomial form ---
+    //   (2t3-3t2+1) p1 + (t3-2t2+t) m1 + (-2t3+3t2) p2 + (t3-t2) m2
 
-    // --- compute cubic Hermite ---
+    spline_.c0 = p1;
+    spline_.c1 = m1;
+    spline_.c2 = -3*p1 - 2*m1 + 3*p2 - m2;
+    spline_.c3 = 2*p1 + m1 - 2*p2 + m2;
+    spline_.t1 = t1_;
+    spline_.dt = dt_;
 
-    double t2 = t*t;
-    double t3 = t2*t;
-    return (2*t3-3*t2+1) * p1
-        + (t3-2*t2+t) * m1
-        + (-2*t3+3*t2) * p2
-        + (t3-t2) * m2;
+    splineStamp_.store(stamp, std::memory_order_release);
+    return spline_;
 }
 
 Eigen::Vector2d InbetweenVertex::posLinear(Time time) const
@@ -12,7 +12,10 @@
 #include "Eigen.h"
 #include "InbetweenCell.h"
 #include "VertexCell.h"
+#include "Eigen.h"
 #include <QList>
+#include <atomic>
+#include <vector>
 
 namespace VectorAnimationComplex
 {
@@ -39,6 +42,13 @@ public:
     Eigen::Vector2d pos(Time time) const;
     //double size(Time time) const;
 
+    // Positions at several times at once, e.g. to draw the trajectory of the
+    // vertex. Faster than calling pos() for each time
+    void pos(const std::vector<double> & times,
+             std::vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d> > & out) const;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
 
 
     // Operators
@@ -56,6 +66,7 @@ private:
     bool check_() const;
 
     ~InbetweenVertex();
+    InbetweenVertex * asInbetweenVertex_() { return this; }
 
     // Update Boundary
     void updateBoundary_impl(KeyVertex * oldVertex, KeyVertex * newVertex);
@@ -68,6 +79,24 @@ private:
     //KeyVertexList afterAfternodes() const;
     Eigen::Vector2d posCubic(Time time) const;
 
+    // Cubic Hermite spline of posCubic(), in polynomial form in the [0,1]
+    // domain: p(u) = ((c3*u + c2)*u + c1)*u + c0, with u = (t-t1)/dt. It
+    // depends on the positions and times of the before and after vertices,
+    // and of their own before and after vertices (through the tangents), so
+    // it is cached until the cached geometry of this cell is cleared (see
+    // Cell::geometryDependentCells_()) or the topology changes. The stamp is
+    // atomic since inbetween vertices are evaluated concurrently by the
+    // inbetween edges triangulated in parallel
+    struct CubicSpline
+    {
+        Eigen::Vector2d c0, c1, c2, c3;
+        double t1, dt;
+        Eigen::Vector2d eval(double t) const;
+    };
+    mutable CubicSpline spline_;
+    mutable std::atomic<quint64> splineStamp_;
+    const CubicSpline & cubicSpline_() const;
+
     // Linear interpolation
     Eigen::Vector2d posLinear(Time time) const;
 
@@ -0,0 +1,154 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#ifndef VAC_INCIDENCE_LIST_H
+#define VAC_INCIDENCE_LIST_H
+
+// IncidenceList<T>: a set of non-null T*, stored as a contiguous array, for
+// the relationships each cell stores (its star, its observers). Most cells
+// have only a few neighbours, so, unlike QSet<T*> which allocates a hash
+// table and one node per element, up to two pointers are stored inline,
+// without any allocation, and membership is a linear search.
+//
+// The size of the list is three pointers, and iteration order is insertion
+// order, except that removing an element moves the last one in its place.
+//
+// Example:
+//   IncidenceList<Cell> star;
+//   star << c;
+//   for(Cell * c: star)
+//       ...
+
+#include <QSet>
+#include <algorithm>
+
+namespace VectorAnimationComplex
+{
+
+template <class T>
+class IncidenceList
+{
+public:
+    typedef T * const * const_iterator;
+
+    IncidenceList() : size_(0), capacity_(INLINE_SIZE) {}
+    IncidenceList(const IncidenceList & other) : size_(0), capacity_(INLINE_SIZE) { *this = other; }
+    ~IncidenceList() { release_(); }
+
+    IncidenceList & operator=(const IncidenceList & other)
+    {
+        if(this != &other)
+        {
+            size_ = 0;
+            reserve(other.size_);
+            std::copy(other.begin(), other.end(), data_());
+            size_ = other.size_;
+        }
+        return *this;
+    }
+
+    int size() const { return size_; }
+    bool isEmpty() const { return size_ == 0; }
+
+    // Removes all elements, releasing memory
+    void clear()
+    {
+        release_();
+        size_ = 0;
+    }
+
+    void reserve(int size)
+    {
+        if(size <= capacity_)
+            return;
+
+        T ** heap = new T*[size];
+        std::copy(begin(), end(), heap);
+        release_();
+        heap_ = heap;
+        capacity_ = size;
+    }
+
+    bool contains(T * t) const
+    {
+        return std::find(begin(), end(), t) != end();
+    }
+
+    // Returns false if t is null or already in the list
+    bool insert(T * t)
+    {
+        if(!t || contains(t))
+            return false;
+        if(size_ == capacity_)
+            reserve(2 * capacity_);
+        data_()[size_++] = t;
+        return true;
+    }
+
+    // Returns false if t is not in the list
+    bool remove(T * t)
+    {
+        T ** data = data_();
+        T ** it = std::find(data, data + size_, t);
+        if(it == data + size_)
+            return false;
+        *it = data[--size_];
+        return true;
+    }
+
+    IncidenceList & operator<<(T * t) { insert(t); return *this; }
+
+    const_iterator begin() const { return data_(); }
+    const_iterator end() const { return data_() + size_; }
+    T * first() const { return *data_(); }
+
+    QSet<T*> toSet() const
+    {
+        QSet<T*> res;
+        res.reserve(size_);
+        for(T * t: *this)
+            res.insert(t);
+        return res;
+    }
+
+    // Heap memory used, in bytes
+    std::size_t numBytes() const
+    {
+        return isInline_() ? 0 : capacity_ * sizeof(T*);
+    }
+
+private:
+    enum { INLINE_SIZE = 2 };
+    union
+    {
+        T * inline_[INLINE_SIZE];
+        T ** heap_;
+    };
+    int size_;
+    int capacity_;
+
+    bool isInline_() const { return capacity_ == INLINE_SIZE; }
+    T ** data_() { return isInline_() ? inline_ : heap_; }
+    T * const * data_() const { return isInline_() ? inline_ : heap_; }
+
+    void release_()
+    {
+        if(!isInline_())
+        {
+            delete[] heap_;
+            capacity_ = INLINE_SIZE;
+        }
+    }
+};
+
+class Cell;
+typedef IncidenceList<Cell> CellIncidenceList;
+
+}
+
+#endif // VAC_INCIDENCE_LIST_H
@@ -9,9 +9,11 @@
 #ifndef VAC_INTERSECTION_H
 #define VAC_INTERSECTION_H
 
-#include <QList>
 #include "Eigen.h"
 
+#include <algorithm>
+#include <vector>
+
 namespace VectorAnimationComplex
 {
 class KeyVertex;
@@ -29,11 +31,12 @@ bool segmentIntersection(
     const Eigen::Vector2d & c, const Eigen::Vector2d & d,
     double dsSquared, double &s, double &t);
 
-// convenient structure to store intersections between objects
+// convenient structure to store intersections between objects. Stored by
+// value: the type tells which members are meaningful
 struct Intersection
 {
     Intersection(double s0, double t0, KeyVertex * n0 = 0) :
-        type(SELF), s(s0), t(t0), vertex(n0), removed(false) {}
+        type(SELF), s(s0), t(t0), vertex(n0), edge(0), removed(false) {}
 
     enum Type { SELF, EDGE, ANIMEDGE };
 
@@ -41,46 +44,39 @@ struct Intersection
     double s;
     double t;
     KeyVertex * vertex;
+    KeyEdge * edge; // EDGE only
     bool removed;
 
     bool operator< (const Intersection & other) const {
             return s < other.s;}
     static bool compareT (const Intersection & e1, const Intersection & e2) {
             return e1.t < e2.t;}
-    static bool pLessThanS( Intersection * const & i1, Intersection* const & i2)
-        {return (*i1) < (*i2);}
-    static bool pLessThanT( Intersection * const & i1, Intersection* const & i2)
-        {return i1->t < i2->t;}
 };
 
-// intersection between a stroke and an edge
+// intersection between a stroke and an edge. Adds no data, so that it can
+// be stored in an IntersectionList
 class EdgeInter: public Intersection
 {
 public:
     EdgeInter(KeyEdge * e0, double s0, double t0) :
-        Intersection(s0,t0), edge(e0) { type = EDGE; }
-
-    KeyEdge * edge;
+        Intersection(s0,t0) { type = EDGE; edge = e0; }
 };
 
-// remove from a list all intersections marked "removed"
-class IntersectionList: public QList<Intersection*>
+// contiguous list of intersections, sorted and compacted in place
+class IntersectionList: public std::vector<Intersection>
 {
 public:
 
-    void sort() {qSort(begin(), end(), Intersection::pLessThanS);}
-    void sortT() {qSort(begin(), end(), Intersection::pLessThanT);}
+    void sort() {std::sort(begin(), end());}
+    void sortT() {std::sort(begin(), end(), Intersection::compareT);}
 
+    // remove all intersections marked "removed", preserving the order of
+    // the others
     void clean()
     {
-        IntersectionList aux;
-        for(int i=0; i<size(); i++)
-        {
-            Intersection* inter = at(i);
-            if(!inter->removed)
-                aux << inter;
-        }
-        *this = aux;
+        erase(std::remove_if(begin(), end(),
+                             [](const Intersection & inter) { return inter.removed; }),
+              end());
     }
 };
     
@@ -26,11 +26,13 @@ KeyCell::KeyCell(VAC * vac, Time time) :
     Cell(vac),
     time_(time)
 {
+    addKindBit_(KeyCellBit);
 }
 
 KeyCell::KeyCell(KeyCell * other) :
     Cell(other)
 {
+    addKindBit_(KeyCellBit);
     time_ = other->time_;
 }
 
@@ -76,6 +78,8 @@ void KeyCell::setTime(Time time)
     {
         time_ = time;
         processGeometryChanged_();
+        processTopologyChanged_();
+        processStarChanged_();
     }
 }
 
@@ -90,6 +94,7 @@ KeyCell::~KeyCell()
 KeyCell::KeyCell(VAC * vac, XmlStreamReader & xml) :
     Cell(vac, xml)
 {
+    addKindBit_(KeyCellBit);
     int cellFrame = 0;
     if(xml.attributes().hasAttribute("frame"))
         cellFrame = xml.attributes().value("frame").toInt();
@@ -100,6 +105,7 @@ KeyCell::KeyCell(VAC * vac, XmlStreamReader & xml) :
 KeyCell::KeyCell(VAC * vac, QTextStream & in) :
     Cell(vac, in)
 {
+    addKindBit_(KeyCellBit);
     Field field;
 
     // Time
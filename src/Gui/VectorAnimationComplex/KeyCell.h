@@ -14,6 +14,18 @@
 namespace VectorAnimationComplex
 {
 
+// Cached incidence queries of key vertices and key edges, see
+// KeyVertex::nUses() and KeyEdge::nUses(). Stamps are 0 until computed
+struct KeyIncidenceCache
+{
+    KeyIncidenceCache() : nUses(0), nUsesVersion(0), incidentFacesVersion(0) {}
+
+    int nUses;
+    unsigned int nUsesVersion;         // Cell::lastStateVersion() when computed
+    KeyFaceSet incidentFaces;
+    unsigned int incidentFacesVersion; // Cell::topologyVersion() when computed
+};
+
 class KeyCell: virtual public Cell
 {
 public:
@@ -7,10 +7,13 @@
 // directory of this distribution and at http://opensource.org/licenses/MIT
 
 #include "EdgeGeometry.h"
+#include "BezierSpline.h"
 
 #include "InbetweenEdge.h"
 #include "KeyEdge.h"
 #include "KeyVertex.h"
+#include "KeyFace.h"
+#include "StrokeBuffer.h"
 #include "VAC.h"
 #include "Intersection.h"
 
@@ -85,8 +88,8 @@ void KeyEdge::save_(QTextStream & out)
     // Geometry
     out << Save::newField("Geometry");
     out << Save::openCurlyBrackets();
-    if(geometry_)
-            geometry_->save(out);
+    if(geometry())
+            geometry()->save(out);
     out << Save::closeCurlyBrackets();
 
 }
@@ -107,7 +110,9 @@ KeyEdge::KeyEdge(VAC * vac, XmlStreamReader & xml)  :
     else
         tmp_->right = -1;
 
-    geometry_ = EdgeGeometry::read(xml);
+    // Parsed later by readGeometry_()
+    tmp_->curve = xml.attributes().value("curve").toString();
+    tmp_->blocks = xml.binaryBlocks();
 }
 
 KeyEdge::KeyEdge(VAC * vac, QTextStream & in) :
@@ -118,6 +123,7 @@ KeyEdge::KeyEdge(VAC * vac, QTextStream & in) :
     Field field;
     QString bracket;
     tmp_ = new TempRead();
+    tmp_->blocks = 0;
 
     // Left node
     in >> /*field >>*/ tmp_->left; // Reason of comment: see Cell::Cell(VAC * vac, QTextStream & in)
@@ -127,7 +133,7 @@ KeyEdge::KeyEdge(VAC * vac, QTextStream & in) :
 
     // Geometry
     in >> field >> bracket;
-    geometry_ = EdgeGeometry::read(in);
+    geometry_.reset(EdgeGeometry::read(in));
     in >> bracket;
 }
 
@@ -153,8 +159,8 @@ void KeyEdge::read2ndPass()
     else
         endVertex_ = 0;
 
-    // Geometry
-    if(isClosed())
+    // Geometry. If deferred, done by readLazyGeometry_() instead.
+    if(isClosed() && geometry_)
         geometry_->makeLoop();
 
     delete tmp_;
@@ -180,8 +186,11 @@ void KeyEdge::write_(XmlStreamWriter & xml) const
     if(endVertex_)
         xml.writeAttribute("endvertex", QString().setNum(endVertex_->id()));
 
-    // Geometry
-    geometry_->write(xml);
+    // Geometry. If not read yet, and written as text, it is unchanged.
+    if(!isGeometryRead() && !xml.binaryBlocks())
+        xml.writeAttribute("curve", lazyCurve_);
+    else
+        geometry()->write(xml);
 }
 
 
@@ -219,13 +228,63 @@ KeyEdge::KeyEdge(KeyEdge * other) :
 {
     startVertex_ = other->startVertex_;
     endVertex_ = other->endVertex_;
-    geometry_ = other->geometry_->clone();
+    geometry_ = other->geometry_;
+    lazyCurve_ = other->lazyCurve_;
 }
 
 
 KeyEdge::~KeyEdge()
 {
-    delete geometry_;
+}
+
+EdgeGeometry * KeyEdge::geometry() const
+{
+    // Reading it doesn't change the state of the edge
+    if(!isGeometryRead())
+        const_cast<KeyEdge*>(this)->readLazyGeometry_();
+    return geometry_.get();
+}
+
+void KeyEdge::reportMemory(MemoryStats::Report & report) const
+{
+    // Shared geometries are split between the edges sharing them. Lazy
+    // geometries are not read, their text is counted instead.
+    if(!isGeometryRead())
+        report.add(MemoryStats::Geometry, lazyCurve_.capacity() * sizeof(QChar));
+    else if(geometry_)
+        report.add(MemoryStats::Geometry, geometry_->numBytes() / geometry_.use_count());
+}
+
+LinearSpline * KeyEdge::linearSpline() const
+{
+    EdgeGeometry * g = geometry();
+    return g ? g->toLinearSpline() : 0;
+}
+
+EdgeGeometry * KeyEdge::editGeometry()
+{
+    if(!isGeometryRead())
+        readLazyGeometry_();
+    if(geometry_.use_count() > 1)
+        geometry_.reset(geometry_->clone());
+    return geometry_.get();
+}
+
+LinearSpline * KeyEdge::editLinearSpline()
+{
+    EdgeGeometry * g = editGeometry();
+    if(!g)
+        return 0;
+    if(LinearSpline * spline = g->toLinearSpline())
+        return spline;
+
+    BezierSpline * bezier = dynamic_cast<BezierSpline*>(g);
+    LinearSpline * spline = bezier ? bezier->toDenseLinearSpline() : new LinearSpline(g->edgeSampling());
+    if(isClosed() && !spline->isClosed())
+        spline->makeLoop();
+    geometry_.reset(spline);
+    processGeometryChanged_();
+    return spline;
 }
 
 VertexCellSet KeyEdge::startVertices() const
@@ -261,6 +320,50 @@ void KeyEdge::draw3DSmall()
     glLineWidth(1);
 }
 
+bool KeyEdge::isStrokeExpandedOnGpu_()
+{
+    static const DevSettings::Bool gpuStrokeExpansion("gpu stroke expansion");
+    return gpuStrokeExpansion && StrokeBuffer::isSupported();
+}
+
+void KeyEdge::drawRaw(Time time, ViewSettings & viewSettings)
+{
+    // Coarser levels of detail are drawn from their own triangles, which
+    // have fewer samples than the stroke buffer
+    if(isStrokeExpandedOnGpu_() && levelOfDetail(viewSettings) == 0)
+    {
+        if(!exists(time))
+            return;
+
+        if(!strokeBuffer_)
+        {
+            strokeBuffer_.reset(new StrokeBuffer());
+            strokeBuffer_->setSamples(geometry()->strokeSampling(), geometry()->isClosed());
+        }
+        if(strokeBuffer_->draw())
+            return;
+    }
+
+    EdgeCell::drawRaw(time, viewSettings);
+}
+
+bool KeyEdge::isBatchable(Time /*time*/) const
+{
+    return !isStrokeExpandedOnGpu_();
+}
+
+void KeyEdge::clearCachedGeometry_()
+{
+    EdgeCell::clearCachedGeometry_();
+    strokeBuffer_.reset();
+}
+
+void KeyEdge::translateCachedGeometry_(double dx, double dy)
+{
+    EdgeCell::translateCachedGeometry_(dx, dy);
+    strokeBuffer_.reset();
+}
+
 void KeyEdge::drawPickTopology(Time time, ViewSettings & /*viewSettings*/)
 {
     if (!exists(time))
@@ -275,7 +378,7 @@ void KeyEdge::drawRaw3D(View3DSettings & viewSettings)
     triangles(time()).draw3D(time(), viewSettings);
 }
 
-void KeyEdge::triangulate_(Time time, Triangles & out) const
+void KeyEdge::triangulate_(Time time, const EvaluationContext & /*context*/, Triangles & out) const
 {
     out.clear();
     if (exists(time))
@@ -289,12 +392,76 @@ void KeyEdge::triangulate_(double width, Time time, Triangles & out) const
         geometry()->triangulate(width, out);
 }
 
-QList<EdgeSample> KeyEdge::getSampling(Time /*time*/) const
+EdgeSampleVector KeyEdge::getSampling(Time /*time*/) const
 {
     return geometry()->edgeSampling();
 }
 
+void KeyEdge::readGeometry_()
+{
+    geometry_.reset(EdgeGeometry::read(QStringRef(&tmp_->curve), tmp_->blocks));
+    tmp_->curve.clear();
+}
+
+bool KeyEdge::deferGeometry_()
+{
+    if(tmp_->blocks || tmp_->curve.isEmpty())
+        return false;
+
+    lazyCurve_ = tmp_->curve;
+    tmp_->curve.clear();
+    return true;
+}
+
+void KeyEdge::readLazyGeometry_()
+{
+    QString curve = lazyCurve_;
+    lazyCurve_.clear();
+    geometry_.reset(EdgeGeometry::read(QStringRef(&curve), 0));
+
+    // What read2ndPass() and VAC::read2ndPass_() do for other edges
+    if(geometry_)
+    {
+        if(isClosed())
+            geometry_->makeLoop();
+        correctGeometryShape_();
+    }
+}
+
+int KeyEdge::nUses() const
+{
+    if(incidence_.nUsesVersion != lastStateVersion())
+    {
+        int res = 0;
+        foreach(KeyFace * f, incidentFaces())
+            res += f->nUses(const_cast<KeyEdge*>(this));
+
+        incidence_.nUses = res;
+        incidence_.nUsesVersion = lastStateVersion();
+    }
+    return incidence_.nUses;
+}
+
+const KeyFaceSet & KeyEdge::incidentFaces() const
+{
+    if(incidence_.incidentFacesVersion != topologyVersion())
+    {
+        incidence_.incidentFaces = spatialStar();
+        incidence_.incidentFacesVersion = topologyVersion();
+    }
+    return incidence_.incidentFaces;
+}
+
 void KeyEdge::correctGeometry()
+{
+    if(geometry())
+    {
+        correctGeometryShape_();
+        processGeometryChanged_();
+    }
+}
+
+void KeyEdge::correctGeometryShape_()
 {
     if(geometry())
     {
@@ -302,27 +469,29 @@ void KeyEdge::correctGeometry()
         {
             // Fast hack to call linearSpline->curve()->resample(true).
             // will not actually change the start and end position
-            geometry()->makeLoop();
-            geometry()->setLeftRightPos(Eigen::Vector2d(0,0), Eigen::Vector2d(0,0));
+            editGeometry()->makeLoop();
+            editGeometry()->setLeftRightPos(Eigen::Vector2d(0,0), Eigen::Vector2d(0,0));
         }
         else
         {
-            geometry()->setLeftRightPos(startVertex()->pos(), endVertex()->pos());
+            editGeometry()->setLeftRightPos(startVertex()->pos(), endVertex()->pos());
         }
-
-        processGeometryChanged_();
     }
 }
 
 void KeyEdge::setWidth(double newWidth)
 {
-    geometry()->setWidth(newWidth);
+    editGeometry()->setWidth(newWidth);
     processGeometryChanged_();
 }
 
 double KeyEdge::updateSculpt(double x, double y, double radius)
 {
     sculptRadius_ = radius;
+
+    // Only changes the sculpting state of the geometry, not its shape: no
+    // need to copy it if shared. It will be copied with its sculpting state
+    // when sculpting actually starts.
     double res = geometry()->updateSculpt(x, y, radius);
     remainingRadiusLeft_ = radius - geometry()->arclengthOfSculptVertex();
     if(remainingRadiusLeft_ < 0)
@@ -333,10 +502,22 @@ double KeyEdge::updateSculpt(double x, double y, double radius)
     return res;
 }
 
+void KeyEdge::prepareSculpt_(double x, double y)
+{
+    // Sculpting edits samples: a Bezier edge is first converted, and its
+    // sculpt vertex found again among its samples
+    if(geometry() && !linearSpline())
+    {
+        editLinearSpline();
+        updateSculpt(x, y, sculptRadius_);
+    }
+}
+
 void KeyEdge::beginSculptDeform(double x, double y)
 {
+    prepareSculpt_(x, y);
     // prepare geometry for sculpting
-    geometry()->beginSculptDeform(x, y);
+    editGeometry()->beginSculptDeform(x, y);
     prepareSculptPreserveTangents_();
 }
 
@@ -423,8 +604,8 @@ void KeyEdge::prepareSculptPreserveTangents_()
 
 void KeyEdge::continueSculptDeform(double x, double y)
 {
-    geometry()->continueSculptDeform(x, y);
-    processGeometryChanged_();
+    editGeometry()->continueSculptDeform(x, y);
+    processSculptedGeometryChanged_();
     continueSculptPreserveTangents_();
 }
 
@@ -438,54 +619,75 @@ void KeyEdge::continueSculptPreserveTangents_()
     Eigen::Vector2d continueLeftDer = geometry()->der(0);
     Eigen::Vector2d continueRightDer = geometry()->der(geometry()->length());
     foreach(KeyEdge * ie, sculpt_keepRightAsLeft_)
-        ie->geometry()->setRightDer(continueLeftDer, remainingRadiusLeft_, true);
+        ie->editGeometry()->setRightDer(continueLeftDer, remainingRadiusLeft_, true);
     foreach(KeyEdge * ie, sculpt_keepLeftAsLeft_)
-        ie->geometry()->setLeftDer(-continueLeftDer, remainingRadiusLeft_, true);
+        ie->editGeometry()->setLeftDer(-continueLeftDer, remainingRadiusLeft_, true);
     foreach(KeyEdge * ie, sculpt_keepLeftAsRight_)
-        ie->geometry()->setLeftDer(continueRightDer, remainingRadiusRight_, true);
+        ie->editGeometry()->setLeftDer(continueRightDer, remainingRadiusRight_, true);
     foreach(KeyEdge * ie, sculpt_keepRightAsRight_)
-        ie->geometry()->setRightDer(-continueRightDer, remainingRadiusRight_, true);
+        ie->editGeometry()->setRightDer(-continueRightDer, remainingRadiusRight_, true);
     if(sculpt_keepMyselfTangent_)
     {
-        geometry()->setRightDer(continueLeftDer, remainingRadiusLeft_, false);
-        geometry()->setLeftDer(continueRightDer, remainingRadiusRight_, false);
+        editGeometry()->setRightDer(continueLeftDer, remainingRadiusLeft_, false);
+        editGeometry()->setLeftDer(continueRightDer, remainingRadiusRight_, false);
 
     }
 }
 
 void KeyEdge::endSculptDeform()
 {
-    geometry()->endSculptDeform();
+    editGeometry()->endSculptDeform();
     processGeometryChanged_();
 }
 
 void KeyEdge::beginSculptEdgeWidth(double x, double y)
 {
-    geometry()->beginSculptEdgeWidth(x, y);
+    prepareSculpt_(x, y);
+    editGeometry()->beginSculptEdgeWidth(x, y);
 }
 
 void KeyEdge::continueSculptEdgeWidth(double x, double y)
 {
-    geometry()->continueSculptEdgeWidth(x, y);
+    editGeometry()->continueSculptEdgeWidth(x, y);
+    processSculptedGeometryChanged_();
+}
+
+void KeyEdge::processSculptedGeometryChanged_()
+{
+    // Sculpting only changes a few samples: rather than recomputing the
+    // triangles from scratch, patch the ones we had before the change
+    int first, last;
+    bool patch = hasCachedTriangles(time()) && geometry()->sculptedSamples(first, last);
+    Triangles patched;
+    if(patch)
+        patched = triangles(time());
+
     processGeometryChanged_();
+
+    if(patch)
+    {
+        geometry()->updateTriangulation(patched, first, last);
+        setCachedTriangles(time(), patched);
+    }
 }
 
 void KeyEdge::endSculptEdgeWidth()
 {
-    geometry()->endSculptEdgeWidth();
+    editGeometry()->endSculptEdgeWidth();
     processGeometryChanged_();
 }
 
 void KeyEdge::beginSculptSmooth(double x, double y)
 {
-    geometry()->beginSculptSmooth(x, y);
+    prepareSculpt_(x, y);
+    editGeometry()->beginSculptSmooth(x, y);
     //prepareSculptPreserveTangents_(); // doesn't make sense since sculpt vertex can be different in continueSculptSmooth
 }
 
 void KeyEdge::continueSculptSmooth(double x, double y)
 {
     prepareSculptPreserveTangents_();
-    geometry()->continueSculptSmooth(x, y);
+    editGeometry()->continueSculptSmooth(x, y);
     processGeometryChanged_();
     //correctGeometry(); // now ensured by geometry()->continueSculptSmooth(x, y)
     continueSculptPreserveTangents_();
@@ -493,18 +695,18 @@ void KeyEdge::continueSculptSmooth(double x, double y)
 
 void KeyEdge::endSculptSmooth()
 {
-    geometry()->endSculptSmooth();
+    editGeometry()->endSculptSmooth();
     processGeometryChanged_();
 }
 
 void KeyEdge::prepareAffineTransform()
 {
-    geometry()->prepareAffineTransform();
+    editGeometry()->prepareAffineTransform();
 }
 
 void KeyEdge::performAffineTransform(const Eigen::Affine2d & xf)
 {
-    geometry()->performAffineTransform(xf);
+    editGeometry()->performAffineTransform(xf);
     processGeometryChanged_();
 }
 
@@ -14,9 +14,13 @@
 #include "Eigen.h"
 #include "Triangles.h"
 
+#include <memory>
+
 namespace VectorAnimationComplex
 {
 class EdgeGeometry;
+class LinearSpline;
+class StrokeBuffer;
 class EdgeInter;
 class IntersectionList;
 
@@ -37,7 +41,11 @@ public:
     KeyEdge(VAC * vac, Time time,
          EdgeGeometry * geometry);
 
-    // Drawing
+    // Drawing. With the "gpu stroke expansion" setting, the edge is drawn at
+    // full detail by expanding its samples on the GPU (see StrokeBuffer),
+    // without computing its triangles. Such edges are not batched
+    void drawRaw(Time time, ViewSettings & viewSettings);
+    bool isBatchable(Time time) const;
     virtual void drawPickTopology(Time time, ViewSettings & viewSettings);
     void draw3DSmall();
     void drawRaw3D(View3DSettings & viewSettings);
@@ -49,16 +57,32 @@ public:
         { return (!isClosed()) && (startVertex_ == endVertex_); }
     bool isClosed() const { return !startVertex_; }
 
+    // Incidence. nUses() is the number of times this edge is used by the
+    // cycles of its incident faces. Both are cached, see KeyVertex::nUses()
+    int nUses() const;
+    const KeyFaceSet & incidentFaces() const;
+
     // reimplements
     VertexCellSet startVertices() const;
     VertexCellSet endVertices() const;
 
 
-    // Geometry
-    EdgeGeometry * geometry() const { return geometry_; }
+    // Geometry. It is shared with the copies of this edge (see clone()) until
+    // either of them is modified, and must not be modified via geometry():
+    // editGeometry() returns the same geometry, first copied if it is shared.
+    // If the edge was read in lazy loading mode (see VAC::read()), its
+    // geometry is only read on the first call to either of them.
+    EdgeGeometry * geometry() const;
+    EdgeGeometry * editGeometry();
+    LinearSpline * linearSpline() const; // geometry() if it is a LinearSpline, otherwise null
+    // Same as editGeometry(), but first replacing a geometry which is not a
+    // LinearSpline (e.g. a BezierSpline) by its samples, for operations
+    // editing samples: cutting, gluing and sculpting
+    LinearSpline * editLinearSpline();
+    bool isGeometryRead() const { return lazyCurve_.isEmpty(); }
     void correctGeometry();
     void setWidth(double newWidth);
-    QList<EdgeSample> getSampling(Time time) const;
+    EdgeSampleVector getSampling(Time time) const;
 
 
     // Sculpting
@@ -84,13 +108,30 @@ public:
     void prepareAffineTransform();
     void performAffineTransform(const Eigen::Affine2d & xf);
 
+    // Memory
+    void reportMemory(MemoryStats::Report & report) const;
+
 private:
     friend class VAC;
 
     ~KeyEdge();
+    KeyEdge * asKeyEdge_() { return this; }
     KeyVertex * startVertex_;
     KeyVertex * endVertex_;
-    EdgeGeometry * geometry_;
+    std::shared_ptr<EdgeGeometry> geometry_;
+
+    // Cached GPU stroke, see drawRaw()
+    mutable std::unique_ptr<StrokeBuffer> strokeBuffer_;
+    static bool isStrokeExpandedOnGpu_();
+    void clearCachedGeometry_();
+    void translateCachedGeometry_(double dx, double dy);
+
+    // Unparsed curve attribute, if the geometry is not read yet
+    QString lazyCurve_;
+    void readLazyGeometry_();
+
+    // See nUses()
+    mutable KeyIncidenceCache incidence_;
 
     // Trusting operators
     friend class Operator;
@@ -106,8 +147,10 @@ private:
     // EdgeObject base class
 
     // for sculpting
+    void prepareSculpt_(double x, double y);
     void prepareSculptPreserveTangents_();
     void continueSculptPreserveTangents_();
+    void processSculptedGeometryChanged_();
     KeyEdgeSet sculpt_keepRightAsLeft_;
     KeyEdgeSet sculpt_keepLeftAsLeft_;
     KeyEdgeSet sculpt_keepLeftAsRight_;
@@ -120,7 +163,7 @@ private:
     double remainingRadiusRight_;
 
     // Implementation of triangulate
-    void triangulate_(Time time, Triangles & out) const;
+    void triangulate_(Time time, const EvaluationContext & context, Triangles & out) const;
     void triangulate_(double width, Time time, Triangles & out) const;
 
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
@@ -150,8 +193,22 @@ protected:
             {return new KeyEdge(g, in);}  };
       protected: virtual void read2ndPass();
 private:
-    struct TempRead { int left, right; };
+    struct TempRead { int left, right; QString curve; const QByteArray * blocks; };
     TempRead * tmp_;
+
+    // Parses the geometry whose data was stored in tmp_ by the XML
+    // constructor. Only accesses this edge, so that VAC::read() can call it
+    // for all edges in parallel.
+    void readGeometry_();
+
+    // Instead of readGeometry_(), keeps the data to read it on the first call
+    // to geometry(). Returns false if not possible, i.e., for binary data,
+    // which is only available while reading.
+    bool deferGeometry_();
+
+    // Part of correctGeometry() that only modifies the geometry of this
+    // edge, without notifying dependent cells
+    void correctGeometryShape_();
 };
 
 }
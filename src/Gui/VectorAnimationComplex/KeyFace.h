@@ -16,6 +16,8 @@
 #include "Cycle.h"
 #include "Triangles.h"
 
+#include <QHash>
+
 namespace VectorAnimationComplex
 {
 
@@ -58,16 +60,24 @@ public:
     // Drawing
 
     // Get sampling of the boundary
-    QList< QList<Eigen::Vector2d> > getSampling(Time time) const;
+    QList<Vector2dVector> getSampling(Time time) const;
 
     // Boundary
     CellSet spatialBoundary() const;
 
+    // Number of times the cycles of this face use the given vertex (as a
+    // Steiner vertex or as the start vertex of a halfedge) or edge. Counts
+    // of all boundary cells are computed at once, and cached until the
+    // state of this face changes
+    int nUses(KeyVertex * v) const;
+    int nUses(KeyEdge * e) const;
+
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
 private:
     friend class VAC;
     virtual ~KeyFace();
+    KeyFace * asKeyFace_() { return this; }
 
     // Constructor helper
     void initColor_();
@@ -84,11 +94,21 @@ private:
     // Cycles
     QList<Cycle> cycles_;
 
+    // See nUses()
+    struct UseCounts
+    {
+        UseCounts() : version(0) {}
+        QHash<KeyCell*, int> counts;
+        unsigned int version; // stateVersion() when computed
+    };
+    mutable UseCounts uses_;
+    void computeUseCounts_() const;
+
     // Remove all cycles.
     void clearCycles_();
 
     // Implementation of triangulate
-    void triangulate_(Time time, Triangles & out) const;
+    void triangulate_(Time time, const EvaluationContext & context, Triangles & out) const;
 
 // --------- Cloning, Assigning, Copying, Serializing ----------
 
@@ -139,6 +159,9 @@ public:
     // Test whether the point (x,y) is within the face
     bool intersects(double x, double y) const;
 
+    // Triangulation of the face
+    const Triangles & triangles() const {return triangles_;}
+
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
 private:
@@ -168,12 +168,18 @@ QList<KeyHalfedge> KeyHalfedge::sorted(const QList<KeyHalfedge> & adj)
     return res;
 }
 
+// The functions below are called once per sample of the cycles of faces,
+// so they call LinearSpline directly when possible, without virtual calls
+
 double KeyHalfedge::length()
 {
     if(!edge)
         return 0;
 
-    return edge->geometry()->length();
+    if(LinearSpline * spline = edge->linearSpline())
+        return spline->length();
+    else
+        return edge->geometry()->length();
 }
 
 Eigen::Vector2d KeyHalfedge::pos(double s)
@@ -181,23 +187,68 @@ Eigen::Vector2d KeyHalfedge::pos(double s)
     if(!edge)
         return Eigen::Vector2d(0,0);
 
-    if(side)
-        return edge->geometry()->pos2d(s);
+    if(!side)
+        s = length() - s;
+    if(LinearSpline * spline = edge->linearSpline())
+        return spline->pos2d(s);
     else
-        return edge->geometry()->pos2d(length()-s);
+        return edge->geometry()->pos2d(s);
 }
 EdgeSample KeyHalfedge::sample(double s)
 {
     if(!edge)
         return EdgeSample();
 
-    if(side)
+    if(!side)
+        s = length() - s;
+    if(LinearSpline * spline = edge->linearSpline())
+        return spline->pos(s);
+    else
         return edge->geometry()->pos(s);
+}
+
+
+void KeyHalfedge::pos(std::vector<double> & ss, Vector2dVector & out)
+{
+    if(!edge)
+    {
+        for(unsigned int i=0; i<ss.size(); ++i)
+            out << Eigen::Vector2d(0,0);
+        return;
+    }
+
+    if(!side)
+    {
+        double l = length();
+        for(unsigned int i=0; i<ss.size(); ++i)
+            ss[i] = l - ss[i];
+    }
+    if(LinearSpline * spline = edge->linearSpline())
+        spline->pos2d(ss, out);
     else
-        return edge->geometry()->pos(length()-s);
+        edge->geometry()->pos2d(ss, out);
 }
 
+void KeyHalfedge::sample(std::vector<double> & ss, EdgeSampleVector & out)
+{
+    if(!edge)
+    {
+        for(unsigned int i=0; i<ss.size(); ++i)
+            out << EdgeSample();
+        return;
+    }
 
+    if(!side)
+    {
+        double l = length();
+        for(unsigned int i=0; i<ss.size(); ++i)
+            ss[i] = l - ss[i];
+    }
+    if(LinearSpline * spline = edge->linearSpline())
+        spline->pos(ss, out);
+    else
+        edge->geometry()->pos(ss, out);
+}
 
 Eigen::Vector2d KeyHalfedge::leftPos()
 {
@@ -14,6 +14,8 @@
 
 #include "EdgeSample.h"
 
+#include <vector>
+
 namespace VectorAnimationComplex
 {
 
@@ -38,6 +40,11 @@ public:
     double length();
     Eigen::Vector2d pos(double s);
     EdgeSample sample(double s);
+    // same as pos(s) and sample(s) for each s in ss, appended to out. The
+    // values should be sorted, see EdgeGeometry::pos(ss, out). Note: ss is
+    // used as a temporary buffer, and is thus modified
+    void pos(std::vector<double> & ss, Vector2dVector & out);
+    void sample(std::vector<double> & ss, EdgeSampleVector & out);
     Eigen::Vector2d leftPos();
     Eigen::Vector2d rightPos();
     Eigen::Vector2d leftDer();
@@ -0,0 +1,163 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+
+#include "KeyTimeIndex.h"
+
+#include "Cell.h"
+#include "KeyCell.h"
+#include "InbetweenCell.h"
+
+namespace VectorAnimationComplex
+{
+
+namespace
+{
+
+void decrement_(QMap<double, int> & map, double key)
+{
+    auto it = map.find(key);
+    if (it != map.end() && --it.value() == 0)
+        map.erase(it);
+}
+
+}
+
+KeyTimeIndex::KeyTimeIndex() :
+    isBuilt_(false),
+    zOrderingVersion_(0),
+    isLifespansBuilt_(false),
+    lifespansTopologyVersion_(0),
+    lifespansZOrderingVersion_(0)
+{
+}
+
+void KeyTimeIndex::clear()
+{
+    indexedKeyCells_.clear();
+    keyTimes_.clear();
+    isBuilt_ = false;
+    inbetweenLifespans_.clear();
+    isLifespansBuilt_ = false;
+}
+
+bool KeyTimeIndex::isUpToDate_(unsigned int zOrderingVersion) const
+{
+    return isBuilt_ && zOrderingVersion_ == zOrderingVersion;
+}
+
+void KeyTimeIndex::insertCell(Cell * cell, unsigned int zOrderingVersionBefore,
+                                           unsigned int zOrderingVersionAfter)
+{
+    // If out of date, the index is rebuilt anyway on next query
+    if (!isUpToDate_(zOrderingVersionBefore))
+        return;
+
+    add_(cell);
+    zOrderingVersion_ = zOrderingVersionAfter;
+}
+
+void KeyTimeIndex::removeCell(Cell * cell, unsigned int zOrderingVersionBefore,
+                                           unsigned int zOrderingVersionAfter)
+{
+    if (!isUpToDate_(zOrderingVersionBefore))
+        return;
+
+    remove_(cell);
+    zOrderingVersion_ = zOrderingVersionAfter;
+}
+
+void KeyTimeIndex::updateKeyCellTime(KeyCell * keyCell, const ZOrderedCells & zOrdering)
+{
+    if (!isUpToDate_(zOrdering.version()))
+        return;
+
+    remove_(keyCell);
+    add_(keyCell);
+}
+
+void KeyTimeIndex::add_(Cell * cell)
+{
+    KeyCell * kc = cell->toKeyCell();
+    if (!kc || indexedKeyCells_.contains(cell))
+        return;
+
+    const double t = kc->time().floatTime();
+    indexedKeyCells_.insert(cell, t);
+    ++keyTimes_[t];
+}
+
+void KeyTimeIndex::remove_(Cell * cell)
+{
+    // Note: the cell is not dereferenced, it may be about to be deleted
+    auto it = indexedKeyCells_.find(cell);
+    if (it == indexedKeyCells_.end())
+        return;
+
+    decrement_(keyTimes_, it.value());
+    indexedKeyCells_.erase(it);
+}
+
+void KeyTimeIndex::update_(const CellTable & cells, const ZOrderedCells & zOrdering)
+{
+    if (isUpToDate_(zOrdering.version()))
+        return;
+
+    indexedKeyCells_.clear();
+    keyTimes_.clear();
+    for (Cell * c: cells)
+        add_(c);
+    isBuilt_ = true;
+    zOrderingVersion_ = zOrdering.version();
+}
+
+QVector<double> KeyTimeIndex::keyTimes(double t1, double t2,
+                                       const CellTable & cells, const ZOrderedCells & zOrdering)
+{
+    update_(cells, zOrdering);
+
+    QVector<double> res;
+    for (auto it = keyTimes_.lowerBound(t1); it != keyTimes_.end() && it.key() <= t2; ++it)
+        res << it.key();
+    return res;
+}
+
+QVector< QPair<double, double> > KeyTimeIndex::inbetweenLifespans(double t1, double t2,
+                                                                  const CellTable & cells,
+                                                                  const ZOrderedCells & zOrdering)
+{
+    if (!isLifespansBuilt_ ||
+        lifespansTopologyVersion_ != Cell::topologyVersion() ||
+        lifespansZOrderingVersion_ != zOrdering.version())
+    {
+        inbetweenLifespans_.clear();
+        for (Cell * c: cells)
+        {
+            if (InbetweenCell * ic = c->toInbetweenCell())
+            {
+                ++inbetweenLifespans_[qMakePair(ic->beforeTime().floatTime(),
+                                                ic->afterTime().floatTime())];
+            }
+        }
+        isLifespansBuilt_ = true;
+        lifespansTopologyVersion_ = Cell::topologyVersion();
+        lifespansZOrderingVersion_ = zOrdering.version();
+    }
+
+    // Lifespans are sorted by before time: stop at the first one starting
+    // after t2. There are typically few distinct lifespans
+    QVector< QPair<double, double> > res;
+    for (auto it = inbetweenLifespans_.begin(); it != inbetweenLifespans_.end() && it.key().first <= t2; ++it)
+    {
+        if (it.key().second >= t1)
+            res << it.key();
+    }
+    return res;
+}
+
+}
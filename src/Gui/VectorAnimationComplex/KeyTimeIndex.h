@@ -0,0 +1,91 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+
+#ifndef VAC_KEY_TIME_INDEX_H
+#define VAC_KEY_TIME_INDEX_H
+
+// KeyTimeIndex: the sorted times where key cells exist, each with the number
+// of key cells sharing it, and the distinct lifespans of inbetween cells, so
+// that the timeline can paint the visible frames through range queries
+// instead of scanning all cells at each repaint.
+//
+// Key times are updated incrementally by the VAC as cells are inserted or
+// removed, or as key cells are moved in time. Other modifications of the
+// cells, e.g. undo or reading a file, are detected through
+// ZOrderedCells::version(): the VAC passes the version before and after each
+// incremental update, and if the index wasn't up to date before it, it is
+// entirely rebuilt on next query. The time each key cell was indexed at is
+// stored, so that removing a cell doesn't need to access it.
+//
+// Lifespans of inbetween cells also change when their boundary is modified,
+// e.g. when keyframing them, so they are instead rebuilt lazily after the
+// star of any cell changes (see Cell::topologyVersion()), like TimeIndex.
+
+#include "CellTable.h"
+#include "ZOrderedCells.h"
+
+#include <QHash>
+#include <QMap>
+#include <QPair>
+#include <QVector>
+
+namespace VectorAnimationComplex
+{
+
+class Cell;
+class KeyCell;
+
+class KeyTimeIndex
+{
+public:
+    KeyTimeIndex();
+
+    // Forget everything. The index is rebuilt on next query
+    void clear();
+
+    // To be called when a cell is inserted in or removed from the VAC, with
+    // the version of its ZOrderedCells before and after
+    void insertCell(Cell * cell, unsigned int zOrderingVersionBefore,
+                                 unsigned int zOrderingVersionAfter);
+    void removeCell(Cell * cell, unsigned int zOrderingVersionBefore,
+                                 unsigned int zOrderingVersionAfter);
+
+    // To be called after the time of the given key cell changed
+    void updateKeyCellTime(KeyCell * keyCell, const ZOrderedCells & zOrdering);
+
+    // Times of key cells within [t1, t2], sorted, without duplicates
+    QVector<double> keyTimes(double t1, double t2,
+                             const CellTable & cells, const ZOrderedCells & zOrdering);
+
+    // Lifespans of inbetween cells intersecting [t1, t2], sorted, without
+    // duplicates
+    QVector< QPair<double, double> > inbetweenLifespans(double t1, double t2,
+                                                        const CellTable & cells,
+                                                        const ZOrderedCells & zOrdering);
+
+private:
+    QHash<Cell*, double> indexedKeyCells_;
+    QMap<double, int> keyTimes_;
+    bool isBuilt_;
+    unsigned int zOrderingVersion_;
+
+    QMap<QPair<double, double>, int> inbetweenLifespans_;
+    bool isLifespansBuilt_;
+    unsigned int lifespansTopologyVersion_;
+    unsigned int lifespansZOrderingVersion_;
+
+    bool isUpToDate_(unsigned int zOrderingVersion) const;
+    void update_(const CellTable & cells, const ZOrderedCells & zOrdering);
+    void add_(Cell * cell);
+    void remove_(Cell * cell);
+};
+
+}
+
+#endif // VAC_KEY_TIME_INDEX_H
@@ -8,6 +8,7 @@
 
 #include "KeyVertex.h"
 #include "KeyEdge.h"
+#include "KeyFace.h"
 #include "InbetweenVertex.h"
 #include "EdgeGeometry.h"
 
@@ -19,6 +20,7 @@
 #include "../Global.h"
 
 #include "../XmlStreamReader.h"
+#include "../NumberParser.h"
 #include "../XmlStreamWriter.h"
 
 namespace VectorAnimationComplex
@@ -98,10 +100,11 @@ KeyVertex::KeyVertex(VAC * vac, XmlStreamReader & xml) :
     initColor();
 
     // Position
-    QString stringPos = xml.attributes().value("position").toString();
-    QStringList list = stringPos.split(" ");
-    pos_[0] = list[0].toDouble();
-    pos_[1] = list[1].toDouble();
+    NumberParser parser(xml.attributes().value("position"));
+    pos_[0] = 0;
+    pos_[1] = 0;
+    parser.readDouble(pos_[0]);
+    parser.readDouble(pos_[1]);
 
     // Size
     //in >> field >> size_;
@@ -242,6 +245,45 @@ Eigen::Vector2d KeyVertex::pos() const
     return pos_;
 }
 
+int KeyVertex::nUses() const
+{
+    if(incidence_.nUsesVersion != lastStateVersion())
+    {
+        int res = 0;
+
+        // Uses by the cycles of incident faces
+        foreach(KeyFace * f, incidentFaces())
+            res += f->nUses(const_cast<KeyVertex*>(this));
+
+        // Uses by incident edges, unless counted as a use by a face
+        KeyEdgeSet incidentEdges = spatialStar();
+        foreach(KeyEdge * e, incidentEdges)
+        {
+            if(e->incidentFaces().isEmpty())
+            {
+                if(e->startVertex() == this)
+                    res++;
+                if(e->endVertex() == this)
+                    res++;
+            }
+        }
+
+        incidence_.nUses = res;
+        incidence_.nUsesVersion = lastStateVersion();
+    }
+    return incidence_.nUses;
+}
+
+const KeyFaceSet & KeyVertex::incidentFaces() const
+{
+    if(incidence_.incidentFacesVersion != topologyVersion())
+    {
+        incidence_.incidentFaces = spatialStar();
+        incidence_.incidentFacesVersion = topologyVersion();
+    }
+    return incidence_.incidentFaces;
+}
+
 KeyVertexList KeyVertex::beforeVertices() const
 {
     InbetweenVertexSet beforeAN = temporalStarBefore();
@@ -46,12 +46,21 @@ public:
     KeyVertexList beforeVertices() const;
     KeyVertexList afterVertices() const;
 
+    // Incidence. nUses() is the number of times this vertex is used by the
+    // cycles of its incident faces, plus the number of times it is used by
+    // the incident edges that have no incident faces. Both are cached, until
+    // the state (resp. the star) of any cell changes, so that operators can
+    // query them repeatedly even at vertices of high valence
+    int nUses() const;
+    const KeyFaceSet & incidentFaces() const;
+
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
 
 private:
         friend class VAC;
     ~KeyVertex();
+    KeyVertex * asKeyVertex_() { return this; }
 
     // Geometry
     Eigen::Vector2d pos_;
@@ -67,6 +76,9 @@ private:
     // dragAndDrop
     Eigen::Vector2d posBack_;
 
+    // See nUses()
+    mutable KeyIncidenceCache incidence_;
+
     void initColor();
 
 
@@ -0,0 +1,102 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+
+#include "MemoryPool.h"
+
+#include <QMutex>
+#include <QMutexLocker>
+
+namespace VectorAnimationComplex
+{
+
+namespace
+{
+
+// Objects larger than this are allocated with the global operator new
+const std::size_t MAX_POOLED_SIZE = 2048;
+const std::size_t ALIGNMENT = 16;
+const std::size_t NUM_SIZE_CLASSES = MAX_POOLED_SIZE / ALIGNMENT;
+const std::size_t BLOCK_SIZE = 64 * 1024;
+
+struct FreeObject
+{
+    FreeObject * next;
+};
+
+FreeObject * freeLists[NUM_SIZE_CLASSES] = {};
+std::size_t numBytesReserved_ = 0;
+QMutex mutex;
+
+std::size_t sizeClass(std::size_t size)
+{
+    return (size + ALIGNMENT - 1) / ALIGNMENT - 1;
+}
+
+// Carves a new block into free objects of the given size class
+void allocateBlock(std::size_t k)
+{
+    const std::size_t objectSize = (k+1) * ALIGNMENT;
+    const std::size_t numObjects = BLOCK_SIZE / objectSize;
+    char * block = static_cast<char*>(::operator new(numObjects * objectSize));
+    numBytesReserved_ += numObjects * objectSize;
+
+    // Link objects in increasing address order, so that objects allocated
+    // in a row are contiguous in memory
+    for (std::size_t i = numObjects; i > 0; --i)
+    {
+        FreeObject * object = reinterpret_cast<FreeObject*>(block + (i-1) * objectSize);
+        object->next = freeLists[k];
+        freeLists[k] = object;
+    }
+}
+
+}
+
+void * MemoryPool::allocate(std::size_t size)
+{
+    if (size == 0)
+        size = 1;
+    if (size > MAX_POOLED_SIZE)
+        return ::operator new(size);
+
+    const std::size_t k = sizeClass(size);
+    QMutexLocker locker(&mutex);
+    if (!freeLists[k])
+        allocateBlock(k);
+    FreeObject * object = freeLists[k];
+    freeLists[k] = object->next;
+    return object;
+}
+
+void MemoryPool::deallocate(void * p, std::size_t size)
+{
+    if (!p)
+        return;
+    if (size == 0)
+        size = 1;
+    if (size > MAX_POOLED_SIZE)
+    {
+        ::operator delete(p);
+        return;
+    }
+
+    const std::size_t k = sizeClass(size);
+    QMutexLocker locker(&mutex);
+    FreeObject * object = static_cast<FreeObject*>(p);
+    object->next = freeLists[k];
+    freeLists[k] = object;
+}
+
+std::size_t MemoryPool::numBytesReserved()
+{
+    QMutexLocker locker(&mutex);
+    return numBytesReserved_;
+}
+
+}
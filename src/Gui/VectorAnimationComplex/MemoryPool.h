@@ -0,0 +1,70 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+
+#ifndef VAC_MEMORY_POOL_H
+#define VAC_MEMORY_POOL_H
+
+// MemoryPool: allocates the small objects which the VAC creates by the
+// millions, e.g. when cloning for undo or pasting: cells (see Cell::operator
+// new) and the nodes of CellLinkedList (see PoolAllocator).
+//
+// Objects are rounded up to a multiple of 16 bytes, and each size is served
+// from 64 KB blocks through a free list. This avoids most calls to malloc,
+// and keeps cells allocated together close to each other in memory, which
+// makes traversals of ZOrderedCells more cache-friendly.
+//
+// Cells are moved between VACs (import, paste, undo history), so the pool is
+// shared by all VACs rather than released with a VAC. Freed objects are kept
+// for reuse: memory is only returned to the system at exit.
+//
+// Allocation and deallocation are thread-safe.
+
+#include <cstddef>
+#include <new>
+
+namespace VectorAnimationComplex
+{
+
+class MemoryPool
+{
+public:
+    static void * allocate(std::size_t size);
+    static void deallocate(void * p, std::size_t size);
+
+    // Statistics
+    static std::size_t numBytesReserved(); // in blocks, whether used or free
+};
+
+// Standard allocator using MemoryPool, e.g., for std::list nodes
+template <class T>
+class PoolAllocator
+{
+public:
+    typedef T value_type;
+
+    PoolAllocator() {}
+    template <class U> PoolAllocator(const PoolAllocator<U> &) {}
+
+    T * allocate(std::size_t n)
+    {
+        return static_cast<T*>(MemoryPool::allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T * p, std::size_t n)
+    {
+        MemoryPool::deallocate(p, n * sizeof(T));
+    }
+
+    template <class U> bool operator==(const PoolAllocator<U> &) const { return true; }
+    template <class U> bool operator!=(const PoolAllocator<U> &) const { return false; }
+};
+
+}
+
+#endif // VAC_MEMORY_POOL_H
@@ -496,10 +496,13 @@ double Path::length() const
     }
 }
 
-void Path::sample(int numSamples, QList<EdgeSample> & out) const
+void Path::sample(int numSamples, EdgeSampleVector & out) const
 {
     assert(isValid());
+    if(samplingCache_.get(halfedges_, vertex_, numSamples, 0, out))
+        return;
     out.clear();
+    out.reserve(numSamples);
 
     if(type() == SingleVertex)
     {
@@ -516,50 +519,38 @@ void Path::sample(int numSamples, QList<EdgeSample> & out) const
         double cumulativeLength = 0;
         int indexHe = 0;
         KeyHalfedge he = halfedges_[indexHe];
+        std::vector<double> heSamples; // arclengths of samples along he, in increasing order
         for(int i=0; i<numSamples; ++i)
         {
             double s = i*ds;
             while ( (s > cumulativeLength + he.length()) && (indexHe+1 < halfedges_.size()) )
             {
+                he.sample(heSamples, out);
+                heSamples.clear();
                 cumulativeLength += he.length();
                 he = halfedges_[++indexHe];
             }
-            out << he.sample(s-cumulativeLength);
+            heSamples.push_back(s-cumulativeLength);
         }
+        he.sample(heSamples, out);
     }
 
+    samplingCache_.set(halfedges_, vertex_, numSamples, 0, out);
 }
 
-void Path::sample(int numSamples, QList<Eigen::Vector2d> & out) const
+void Path::sample(int numSamples, Vector2dVector & out) const
 {
     assert(isValid());
-    out.clear();
-
-    if(type() == SingleVertex)
-    {
-        Eigen::Vector2d pos = singleVertex()->pos();
-        for(int i=0; i<numSamples; ++i)
-            out << pos;
-    }
-    else
-    {
-        assert(numSamples >= 2);
-        double ds = length()/(numSamples-1);
+    if(samplingCache_.get(halfedges_, vertex_, numSamples, 0, out))
+        return;
 
-        double cumulativeLength = 0;
-        int indexHe = 0;
-        KeyHalfedge he = halfedges_[indexHe];
-        for(int i=0; i<numSamples; ++i)
-        {
-            double s = i*ds;
-            while ( (s > cumulativeLength + he.length()) && (indexHe+1 < halfedges_.size()) )
-            {
-                cumulativeLength += he.length();
-                he = halfedges_[++indexHe];
-            }
-            out << he.pos(s-cumulativeLength);
-        }
-    }
+    // Sample widths too, so that both samplings share the cache
+    EdgeSampleVector samples;
+    sample(numSamples, samples);
+    out.clear();
+    out.reserve(samples.size());
+    foreach(const EdgeSample & s, samples)
+        out << Eigen::Vector2d(s.x(), s.y());
 }
 
 Path Path::reversed() const
@@ -13,6 +13,7 @@
 
 #include <QList>
 #include "KeyHalfedge.h"
+#include "PathSamplingCache.h"
 #include "ProperPath.h"
 #include "ProperCycle.h"
 
@@ -87,8 +88,8 @@ public:
 
     // geometry
     double length() const;
-    void sample(int numSamples, QList<Eigen::Vector2d> & out) const;
-    void sample(int numSamples, QList<EdgeSample> & out) const;
+    void sample(int numSamples, Vector2dVector & out) const;
+    void sample(int numSamples, EdgeSampleVector & out) const;
 
     // Reversed path
     Path reversed() const;
@@ -102,6 +103,9 @@ private:
 
     // sorted list of instant edges
     QList<KeyHalfedge> halfedges_;
+
+    // last uniform sampling
+    PathSamplingCache samplingCache_;
 };
 
 } // end namespace VectorAnimationComplex
@@ -0,0 +1,145 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#include "PathSamplingCache.h"
+#include "KeyVertex.h"
+#include "KeyEdge.h"
+
+#include <QMutexLocker>
+
+namespace VectorAnimationComplex
+{
+
+PathSamplingCache::Key::Key() :
+    vertex(0),
+    vertexGeometryVersion(0),
+    numSamples(-1),
+    s0(0)
+{
+}
+
+void PathSamplingCache::Key::clear()
+{
+    stamps.clear();
+    vertex = 0;
+    numSamples = -1;
+}
+
+bool PathSamplingCache::Key::isValid(const QList<KeyHalfedge> & halfedges, KeyVertex * vertex,
+                                     int numSamples, double s0) const
+{
+    if(numSamples != this->numSamples || s0 != this->s0 || vertex != this->vertex)
+        return false;
+
+    if(vertex)
+        return vertex->geometryVersion() == vertexGeometryVersion;
+
+    if((int) stamps.size() != halfedges.size())
+        return false;
+    for(int i=0; i<halfedges.size(); ++i)
+    {
+        const KeyHalfedge & he = halfedges[i];
+        const Stamp & stamp = stamps[i];
+        if(he.edge != stamp.edge || he.side != stamp.side ||
+           !he.edge || he.edge->geometryVersion() != stamp.geometryVersion)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void PathSamplingCache::Key::set(const QList<KeyHalfedge> & halfedges, KeyVertex * vertex,
+                                 int numSamples, double s0)
+{
+    stamps.clear();
+    foreach(const KeyHalfedge & he, halfedges)
+    {
+        Stamp stamp = { he.edge, he.side, he.edge ? he.edge->geometryVersion() : 0 };
+        stamps.push_back(stamp);
+    }
+    this->vertex = vertex;
+    vertexGeometryVersion = vertex ? vertex->geometryVersion() : 0;
+    this->numSamples = numSamples;
+    this->s0 = s0;
+}
+
+PathSamplingCache::PathSamplingCache() :
+    totalCurvature_(0)
+{
+}
+
+PathSamplingCache::PathSamplingCache(const PathSamplingCache & /*other*/) :
+    totalCurvature_(0)
+{
+}
+
+PathSamplingCache & PathSamplingCache::operator=(const PathSamplingCache & /*other*/)
+{
+    QMutexLocker locker(&mutex_);
+    samplesKey_.clear();
+    samples_.clear();
+    totalCurvatureKey_.clear();
+    return *this;
+}
+
+bool PathSamplingCache::get(const QList<KeyHalfedge> & halfedges, KeyVertex * vertex,
+                            int numSamples, double s0, EdgeSampleVector & out) const
+{
+    QMutexLocker locker(&mutex_);
+    if(!samplesKey_.isValid(halfedges, vertex, numSamples, s0))
+        return false;
+
+    out = samples_;
+    return true;
+}
+
+bool PathSamplingCache::get(const QList<KeyHalfedge> & halfedges, KeyVertex * vertex,
+                            int numSamples, double s0, Vector2dVector & out) const
+{
+    QMutexLocker locker(&mutex_);
+    if(!samplesKey_.isValid(halfedges, vertex, numSamples, s0))
+        return false;
+
+    out.clear();
+    out.reserve(samples_.size());
+    for(const EdgeSample & sample: samples_)
+        out.push_back(Eigen::Vector2d(sample.x(), sample.y()));
+    return true;
+}
+
+void PathSamplingCache::set(const QList<KeyHalfedge> & halfedges, KeyVertex * vertex,
+                            int numSamples, double s0, const EdgeSampleVector & samples) const
+{
+    QMutexLocker locker(&mutex_);
+    samplesKey_.set(halfedges, vertex, numSamples, s0);
+    samples_ = samples;
+}
+
+// The number of samples used to compute the total curvature only depends on
+// the geometry of the cycle, so it isn't part of its key
+bool PathSamplingCache::getTotalCurvature(const QList<KeyHalfedge> & halfedges, KeyVertex * vertex,
+                                          double s0, double & out) const
+{
+    QMutexLocker locker(&mutex_);
+    if(!totalCurvatureKey_.isValid(halfedges, vertex, 0, s0))
+        return false;
+
+    out = totalCurvature_;
+    return true;
+}
+
+void PathSamplingCache::setTotalCurvature(const QList<KeyHalfedge> & halfedges, KeyVertex * vertex,
+                                          double s0, double totalCurvature) const
+{
+    QMutexLocker locker(&mutex_);
+    totalCurvatureKey_.set(halfedges, vertex, 0, s0);
+    totalCurvature_ = totalCurvature;
+}
+
+}
@@ -0,0 +1,103 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#ifndef VAC_PATH_SAMPLING_CACHE_H
+#define VAC_PATH_SAMPLING_CACHE_H
+
+// PathSamplingCache: the last uniform sampling of a Path or Cycle, stored in
+// a contiguous buffer. Inbetween edges sample their key paths with the same
+// number of samples at every time (see InbetweenEdge::getGeometry()), so
+// playing back inbetweens only resamples key paths once.
+//
+// The sampling is reused as long as it is requested with the same number of
+// samples (and starting point, for cycles), and the path is still made of
+// the same halfedges, whose edges (or single vertex) haven't changed since,
+// i.e. kept the same Cell::geometryVersion().
+//
+// It also caches the total curvature of cycles (see Cycle::totalCurvature()),
+// under its own key, so that samplings with other parameters (e.g., by
+// inbetween faces) don't evict it.
+//
+// Copying a cache doesn't copy the sampling: each copy of a path samples on
+// its own, so that paths copied by different cells can be sampled
+// concurrently. Sampling a given path is guarded by a mutex, for cells
+// triangulated at several times in parallel.
+
+#include "EdgeSample.h"
+#include "KeyHalfedge.h"
+#include "Eigen.h"
+
+#include <QList>
+#include <QMutex>
+#include <vector>
+
+namespace VectorAnimationComplex
+{
+
+class KeyVertex;
+
+class PathSamplingCache
+{
+public:
+    PathSamplingCache();
+    PathSamplingCache(const PathSamplingCache & other);
+    PathSamplingCache & operator=(const PathSamplingCache & other);
+
+    // If the sampling of the given path (halfedges, or single vertex) with
+    // the given parameters is cached, write it into out and return true
+    bool get(const QList<KeyHalfedge> & halfedges, KeyVertex * vertex,
+             int numSamples, double s0, EdgeSampleVector & out) const;
+    bool get(const QList<KeyHalfedge> & halfedges, KeyVertex * vertex,
+             int numSamples, double s0, Vector2dVector & out) const;
+
+    // Cache the sampling of the given path with the given parameters
+    void set(const QList<KeyHalfedge> & halfedges, KeyVertex * vertex,
+             int numSamples, double s0, const EdgeSampleVector & samples) const;
+
+    // Same as get() and set(), for the total curvature of a cycle with the
+    // given starting point
+    bool getTotalCurvature(const QList<KeyHalfedge> & halfedges, KeyVertex * vertex,
+                           double s0, double & out) const;
+    void setTotalCurvature(const QList<KeyHalfedge> & halfedges, KeyVertex * vertex,
+                           double s0, double totalCurvature) const;
+
+private:
+    struct Stamp
+    {
+        KeyEdge * edge;
+        bool side;
+        unsigned int geometryVersion;
+    };
+
+    // The path and parameters a cached value was computed for
+    struct Key
+    {
+        Key();
+        void clear();
+        bool isValid(const QList<KeyHalfedge> & halfedges, KeyVertex * vertex,
+                     int numSamples, double s0) const;
+        void set(const QList<KeyHalfedge> & halfedges, KeyVertex * vertex,
+                 int numSamples, double s0);
+
+        std::vector<Stamp> stamps;
+        KeyVertex * vertex;
+        unsigned int vertexGeometryVersion;
+        int numSamples; // -1 if nothing is cached
+        double s0;
+    };
+
+    mutable Key samplesKey_;
+    mutable EdgeSampleVector samples_;
+    mutable Key totalCurvatureKey_;
+    mutable double totalCurvature_;
+    mutable QMutex mutex_;
+};
+
+}
+
+#endif // VAC_PATH_SAMPLING_CACHE_H
@@ -0,0 +1,405 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#include "PlanarArrangement.h"
+
+#include "KeyEdge.h"
+#include "KeyVertex.h"
+#include "KeyHalfedge.h"
+#include "Cycle.h"
+#include "EdgeGeometry.h"
+#include "GeometryCache.h"
+
+#include <QHash>
+#include <QSet>
+#include <algorithm>
+#include <cmath>
+
+namespace VectorAnimationComplex
+{
+
+namespace
+{
+
+// Maximum number of times for which arrangements are kept
+const int MAX_NUM_FRAMES = 8;
+
+// Maximum number of grid cells along each axis, see PlanarArrangement::buildGrid_()
+const int MAX_GRID_SIZE = 256;
+
+// Relative tolerance on signed areas, so that cycles around trees of edges,
+// whose area is zero up to rounding errors, are never external boundaries
+const double AREA_EPSILON = 1e-9;
+
+// Twice the signed area swept by the sampling of an edge, from its start to
+// its end. The signed area of a cycle is half the sum of the terms of its
+// halfedges, counted negatively for backward halfedges.
+double areaTerm(const EdgeSampleVector & samples, bool closed)
+{
+    double res = 0;
+    int n = samples.size();
+    int m = closed ? n : n-1;
+    for (int i=0; i<m; ++i)
+    {
+        const EdgeSample & a = samples[i];
+        const EdgeSample & b = samples[(i+1)%n];
+        res += a.x() * b.y() - b.x() * a.y();
+    }
+    return res;
+}
+
+// Union-find of the connected components of edges, by their vertices
+KeyVertex * root(QHash<KeyVertex*, KeyVertex*> & parents, KeyVertex * v)
+{
+    KeyVertex * r = v;
+    for (KeyVertex * p = parents.value(r, r); p != r; p = parents.value(r, r))
+        r = p;
+    while (v != r)
+    {
+        KeyVertex * p = parents.value(v, v);
+        parents[v] = r;
+        v = p;
+    }
+    return r;
+}
+
+struct TracedCycle
+{
+    Cycle cycle;
+    double area;            // signed
+    const void * component; // root vertex, or closed edge
+    BoundingBox boundingBox;
+    double x, y;            // a point of the cycle
+};
+
+// Centroid of the largest triangle, which is inside the triangles
+void interiorPoint(const Triangles & triangles, double & x, double & y)
+{
+    double maxArea = -1;
+    for (int i=0; i<triangles.size(); ++i)
+    {
+        Triangle t = triangles[i];
+        Eigen::Vector2d a = t.a.cast<double>();
+        Eigen::Vector2d b = t.b.cast<double>();
+        Eigen::Vector2d c = t.c.cast<double>();
+        Eigen::Vector2d u = b - a;
+        Eigen::Vector2d v = c - a;
+        double area = std::abs(u[0] * v[1] - u[1] * v[0]);
+        if (area > maxArea)
+        {
+            maxArea = area;
+            Eigen::Vector2d p = (a + b + c) / 3.0;
+            x = p[0];
+            y = p[1];
+        }
+    }
+}
+
+}
+
+PlanarArrangement::PlanarArrangement() :
+    gridWidth_(0),
+    gridHeight_(0)
+{
+}
+
+void PlanarArrangement::clear()
+{
+    faces_.clear();
+    grid_.clear();
+    gridBoundingBox_ = BoundingBox();
+    gridWidth_ = 0;
+    gridHeight_ = 0;
+}
+
+void PlanarArrangement::compute(const KeyEdgeList & edges, Time time)
+{
+    clear();
+
+    // Compute signed areas swept by edges, and connected components
+    QHash<KeyEdge*, double> areaTerms;
+    QHash<KeyVertex*, KeyVertex*> parents;
+    for (KeyEdge * e: edges)
+    {
+        areaTerms[e] = areaTerm(e->getSampling(time), e->isClosed());
+        if (!e->isClosed())
+        {
+            KeyVertex * a = root(parents, e->startVertex());
+            KeyVertex * b = root(parents, e->endVertex());
+            if (a != b)
+                parents[a] = b;
+        }
+    }
+
+    // Find all cycles, and sort them into external boundaries and holes
+    std::vector<TracedCycle> boundaries;
+    std::vector<TracedCycle> holes;
+    QSet<KeyEdge*> visited[2]; // by side of halfedges
+    const int maxIter = 2 * edges.size() + 2;
+    for (KeyEdge * e: edges)
+    {
+        if (e->isClosed())
+        {
+            // A closed edge bounds a face on one side, and is a hole on the other
+            KeyEdgeSet edgeSet;
+            edgeSet << e;
+            TracedCycle c;
+            c.cycle = Cycle(edgeSet);
+            if (!c.cycle.isValid())
+                continue;
+            c.area = 0.5 * std::abs(areaTerms[e]);
+            c.component = e;
+            c.boundingBox = e->outlineBoundingBox(time);
+            Eigen::Vector2d p = e->geometry()->pos2d(0);
+            c.x = p[0];
+            c.y = p[1];
+            holes.push_back(c);
+            c.area = - c.area;
+            boundaries.push_back(c);
+            continue;
+        }
+
+        for (int side=0; side<2; ++side)
+        {
+            if (visited[side].contains(e))
+                continue;
+
+            // Follow halfedges until back to the first one
+            KeyHalfedge h0(e, side == 1);
+            KeyHalfedge h = h0;
+            QList<KeyHalfedge> halfedges;
+            TracedCycle c;
+            c.area = 0;
+            bool isComplete = false;
+            for (int i=0; i<maxIter; ++i)
+            {
+                int hSide = h.side ? 1 : 0;
+                if (!areaTerms.contains(h.edge) || visited[hSide].contains(h.edge))
+                    break;
+                visited[hSide].insert(h.edge);
+                halfedges << h;
+                c.area += 0.5 * (h.side ? areaTerms[h.edge] : - areaTerms[h.edge]);
+                c.boundingBox.unite(h.edge->outlineBoundingBox(time));
+                h = h.next();
+                if (h == h0)
+                {
+                    isComplete = true;
+                    break;
+                }
+            }
+            if (!isComplete)
+                continue;
+
+            c.cycle = Cycle(halfedges);
+            if (!c.cycle.isValid())
+                continue;
+            c.component = root(parents, e->startVertex());
+            Eigen::Vector2d p = h0.leftPos();
+            c.x = p[0];
+            c.y = p[1];
+            if (c.area < - AREA_EPSILON * (1 + c.boundingBox.area()))
+                boundaries.push_back(c);
+            else
+                holes.push_back(c);
+        }
+    }
+
+    // Add each hole to the smallest external boundary containing it, among
+    // those of other connected components
+    std::vector<PreviewKeyFace> boundaryFaces;
+    std::vector< QList<Cycle> > faceCycles;
+    boundaryFaces.reserve(boundaries.size());
+    faceCycles.reserve(boundaries.size());
+    for (const TracedCycle & b: boundaries)
+    {
+        boundaryFaces.push_back(PreviewKeyFace(b.cycle));
+        faceCycles.push_back(QList<Cycle>() << b.cycle);
+    }
+    for (const TracedCycle & hole: holes)
+    {
+        BoundingBox p(hole.x, hole.y);
+        int best = -1;
+        for (size_t i=0; i<boundaries.size(); ++i)
+        {
+            const TracedCycle & b = boundaries[i];
+            if (b.component == hole.component ||
+                (best >= 0 && b.area <= boundaries[best].area) ||
+                !b.boundingBox.intersects(p))
+            {
+                continue;
+            }
+            if (boundaryFaces[i].intersects(hole.x, hole.y))
+                best = i;
+        }
+        if (best >= 0)
+            faceCycles[best] << hole.cycle;
+    }
+
+    // Create faces
+    faces_.reserve(boundaries.size());
+    for (size_t i=0; i<boundaries.size(); ++i)
+    {
+        Face face;
+        if (faceCycles[i].size() == 1)
+            face.face = boundaryFaces[i];
+        else
+            face.face = PreviewKeyFace(faceCycles[i]);
+        if (face.face.triangles().size() == 0)
+            continue;
+        face.cycles = faceCycles[i];
+        face.boundingBox = boundaries[i].boundingBox;
+        face.area = - boundaries[i].area;
+        interiorPoint(face.face.triangles(), face.x, face.y);
+        faces_.push_back(face);
+    }
+
+    buildGrid_();
+}
+
+void PlanarArrangement::buildGrid_()
+{
+    // Choose about one grid cell per face
+    for (const Face & f: faces_)
+        gridBoundingBox_.unite(f.boundingBox);
+    if (gridBoundingBox_.isEmpty())
+        return;
+    int n = std::ceil(std::sqrt((double) faces_.size()));
+    n = std::max(1, std::min(n, MAX_GRID_SIZE));
+    gridWidth_ = gridBoundingBox_.width() > 0 ? n : 1;
+    gridHeight_ = gridBoundingBox_.height() > 0 ? n : 1;
+    grid_.assign(gridWidth_ * gridHeight_, std::vector<int>());
+
+    // Insert faces by increasing area, in all cells overlapped by their
+    // bounding box
+    std::vector<int> order(faces_.size());
+    for (size_t i=0; i<order.size(); ++i)
+        order[i] = i;
+    std::sort(order.begin(), order.end(),
+              [this](int a, int b) { return faces_[a].area < faces_[b].area; });
+    for (int i: order)
+    {
+        const BoundingBox & bb = faces_[i].boundingBox;
+        int c1 = gridCell_(bb.xMin(), bb.yMin());
+        int c2 = gridCell_(bb.xMax(), bb.yMax());
+        for (int k = c1 / gridWidth_; k <= c2 / gridWidth_; ++k)
+            for (int j = c1 % gridWidth_; j <= c2 % gridWidth_; ++j)
+                grid_[k * gridWidth_ + j].push_back(i);
+    }
+}
+
+int PlanarArrangement::gridCell_(double x, double y) const
+{
+    const BoundingBox & bb = gridBoundingBox_;
+    if (grid_.empty() || x < bb.xMin() || x > bb.xMax() || y < bb.yMin() || y > bb.yMax())
+        return -1;
+    int j = bb.width() > 0 ? (int) ((x - bb.xMin()) / bb.width() * gridWidth_) : 0;
+    int k = bb.height() > 0 ? (int) ((y - bb.yMin()) / bb.height() * gridHeight_) : 0;
+    j = std::min(j, gridWidth_ - 1);
+    k = std::min(k, gridHeight_ - 1);
+    return k * gridWidth_ + j;
+}
+
+int PlanarArrangement::numFaces() const
+{
+    return faces_.size();
+}
+
+const PreviewKeyFace & PlanarArrangement::face(int i) const
+{
+    return faces_[i].face;
+}
+
+const QList<Cycle> & PlanarArrangement::faceCycles(int i) const
+{
+    return faces_[i].cycles;
+}
+
+Eigen::Vector2d PlanarArrangement::interiorPoint(int i) const
+{
+    return Eigen::Vector2d(faces_[i].x, faces_[i].y);
+}
+
+int PlanarArrangement::faceAt(double x, double y) const
+{
+    int cell = gridCell_(x, y);
+    if (cell < 0)
+        return -1;
+
+    BoundingBox p(x, y);
+    for (int i: grid_[cell])
+    {
+        const Face & f = faces_[i];
+        if (f.boundingBox.intersects(p) && f.face.intersects(x, y))
+            return i;
+    }
+    return -1;
+}
+
+bool PlanarArrangementCache::EdgeStamp::operator==(const EdgeStamp & other) const
+{
+    return id == other.id &&
+           geometryVersion == other.geometryVersion &&
+           startVertexId == other.startVertexId &&
+           endVertexId == other.endVertexId;
+}
+
+PlanarArrangementCache::PlanarArrangementCache() :
+    counter_(0)
+{
+}
+
+void PlanarArrangementCache::clear()
+{
+    frames_.clear();
+}
+
+const PlanarArrangement & PlanarArrangementCache::arrangement(const KeyEdgeList & edges, Time time)
+{
+    // Get stamps of edges
+    std::vector<EdgeStamp> stamps;
+    stamps.reserve(edges.size());
+    for (KeyEdge * e: edges)
+    {
+        EdgeStamp stamp;
+        stamp.id = e->id();
+        stamp.geometryVersion = e->geometryVersion();
+        stamp.startVertexId = e->isClosed() ? -1 : e->startVertex()->id();
+        stamp.endVertexId = e->isClosed() ? -1 : e->endVertex()->id();
+        stamps.push_back(stamp);
+    }
+    std::sort(stamps.begin(), stamps.end(),
+              [](const EdgeStamp & a, const EdgeStamp & b) { return a.id < b.id; });
+
+    // Get existing arrangement, or evict least recently used ones
+    int timeKey = GeometryCache::timeKey(time);
+    auto it = frames_.find(timeKey);
+    if (it == frames_.end())
+    {
+        while (frames_.size() >= MAX_NUM_FRAMES)
+        {
+            auto lru = frames_.begin();
+            for (auto it2 = frames_.begin(); it2 != frames_.end(); ++it2)
+                if (it2->lastUsed < lru->lastUsed)
+                    lru = it2;
+            frames_.erase(lru);
+        }
+        it = frames_.insert(timeKey, Frame());
+    }
+
+    // Recompute it if any edge changed
+    Frame & frame = *it;
+    frame.lastUsed = ++counter_;
+    if (frame.stamps != stamps)
+    {
+        frame.arrangement.compute(edges, time);
+        frame.stamps.swap(stamps);
+    }
+    return frame.arrangement;
+}
+
+}
@@ -0,0 +1,125 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#ifndef VAC_PLANAR_ARRANGEMENT_H
+#define VAC_PLANAR_ARRANGEMENT_H
+
+// PlanarArrangement: the faces of the planar map formed by the key edges
+// existing at a given time, assuming they don't intersect. Each face is
+// described by the cycle of halfedges around it (its external boundary) and
+// the outermost cycles of the connected components of edges it contains (its
+// holes), ready to be used to create a KeyFace. This is what the paint bucket
+// creates, see VAC::updateToBePaintedFace() and VAC::fillAllEnclosedRegions().
+//
+// Cycles are found by following KeyHalfedge::next() from every halfedge,
+// which keeps faces on the right of halfedges (in the non-flipped coordinates
+// of the scene). Hence, the external boundary of a face is a cycle with a
+// negative signed area, while cycles with a positive signed area are holes.
+//
+// Point location uses a uniform grid over the faces, each grid cell listing
+// the faces whose bounding box overlaps it, from smallest to largest. Only
+// these faces are tested, and the first one containing the point is the one
+// returned.
+//
+// PlanarArrangementCache keeps the arrangements of the few most recently
+// queried times. Each is recomputed as soon as any of its edges is inserted,
+// removed, or its geometry or end vertices change.
+
+#include "../TimeDef.h"
+#include "CellList.h"
+#include "KeyFace.h"
+#include "BoundingBox.h"
+#include "Eigen.h"
+
+#include <QMap>
+#include <vector>
+
+namespace VectorAnimationComplex
+{
+
+class PlanarArrangement
+{
+public:
+    PlanarArrangement();
+
+    // Remove all faces
+    void clear();
+
+    // Compute the faces of the planar map formed by the given edges, which
+    // must all exist at the given time
+    void compute(const KeyEdgeList & edges, Time time);
+
+    // Faces, in no particular order. The first cycle of each face is its
+    // external boundary, and the others are its holes
+    int numFaces() const;
+    const PreviewKeyFace & face(int i) const;
+    const QList<Cycle> & faceCycles(int i) const;
+
+    // A point in the interior of the i-th face
+    Eigen::Vector2d interiorPoint(int i) const;
+
+    // Index of the face containing (x,y), or -1 if none. If edges intersect
+    // and several faces contain (x,y), the one with the smallest external
+    // boundary is returned
+    int faceAt(double x, double y) const;
+
+private:
+    struct Face
+    {
+        PreviewKeyFace face;
+        QList<Cycle> cycles;
+        BoundingBox boundingBox; // of the external boundary
+        double area;             // of the external boundary, positive
+        double x, y;             // interior point
+    };
+    std::vector<Face> faces_;
+
+    // Point location grid
+    void buildGrid_();
+    int gridCell_(double x, double y) const; // -1 if outside
+    BoundingBox gridBoundingBox_;
+    int gridWidth_, gridHeight_;
+    std::vector< std::vector<int> > grid_; // face indices, by increasing area
+};
+
+class PlanarArrangementCache
+{
+public:
+    PlanarArrangementCache();
+
+    // Release all arrangements
+    void clear();
+
+    // Get the arrangement of the given edges, which must be all the key
+    // edges existing at the given time
+    const PlanarArrangement & arrangement(const KeyEdgeList & edges, Time time);
+
+private:
+    struct EdgeStamp
+    {
+        int id;
+        unsigned int geometryVersion;
+        int startVertexId; // -1 if closed
+        int endVertexId;   // -1 if closed
+        bool operator==(const EdgeStamp & other) const;
+    };
+
+    struct Frame
+    {
+        Frame() : lastUsed(0) {}
+        PlanarArrangement arrangement;
+        std::vector<EdgeStamp> stamps; // sorted by ID
+        unsigned int lastUsed;
+    };
+    QMap<int, Frame> frames_;
+    unsigned int counter_;
+};
+
+}
+
+#endif // VAC_PLANAR_ARRANGEMENT_H
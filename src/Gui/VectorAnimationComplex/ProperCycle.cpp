@@ -8,6 +8,7 @@
 
 #include "ProperCycle.h"
 #include "KeyEdge.h"
+#include "Algorithms.h"
 
 #include "../SaveAndLoad.h"
 
@@ -40,17 +41,17 @@ ProperCycle::ProperCycle(const KeyEdgeSet & edgeSetConst)
         }
     }
 
-    // copy the set to be able to modify it
-    KeyEdgeSet edgeSet = edgeSetConst;
+    // index the set by vertices, and remove edges as they are chained
+    Algorithms::IncidentEdges edgeSet(edgeSetConst);
 
     // insert first edge
     halfedges_ << KeyHalfedge(first, true);
-    edgeSet.erase(edgeSet.begin());
+    edgeSet.remove(0);
 
     // check case where it's a pure loop
     if(first->isClosed())
     {
-        if(!edgeSet.isEmpty())
+        if(edgeSet.numRemaining() > 0)
         {
             //QMessageBox::information(0, QObject::tr("operation aborted"),
             //                         QObject::tr("more than one edge and one of them is a pure loop"));
@@ -63,34 +64,22 @@ ProperCycle::ProperCycle(const KeyEdgeSet & edgeSetConst)
     else
     {
         // not a pure loop, let's find the chain
-        while(!edgeSet.isEmpty())
+        while(edgeSet.numRemaining() > 0)
         {
             KeyHalfedge lastAddedHalfedge = halfedges_.last(); // we know it's not a loop, otherwise couldn't be here
             KeyVertex * lastVertex = lastAddedHalfedge.endVertex();  // hence this is a valid vertex
 
-            // find next
+            // find next: the first remaining edge of the set incident to lastVertex
             KeyHalfedge nextHalfedge;
-            auto it = edgeSet.begin();
-            auto itEnd = edgeSet.end();
-            for(;it!=itEnd;++it)
-            {
-                if((*it)->startVertex() == lastVertex)
-                {
-                    nextHalfedge = KeyHalfedge(*it, true);
-                    break;
-                }
-                else if((*it)->endVertex() == lastVertex)
-                {
-                    nextHalfedge = KeyHalfedge(*it, false);
-                    break;
-                }
-            }
+            int next = edgeSet.firstIncidentEdge(lastVertex);
+            if(next != -1)
+                nextHalfedge = KeyHalfedge(edgeSet[next], edgeSet[next]->startVertex() == lastVertex);
 
             // if found: great, insert it!
             if(nextHalfedge.isValid())
             {
                 halfedges_ << nextHalfedge;
-                edgeSet.erase(it);
+                edgeSet.remove(next);
             }
             else
             {
@@ -8,6 +8,7 @@
 
 #include "ProperPath.h"
 #include "KeyEdge.h"
+#include "Algorithms.h"
 
 #include "../SaveAndLoad.h"
 
@@ -40,12 +41,12 @@ ProperPath::ProperPath(const KeyEdgeSet & edgeSetConst)
         }
     }
 
-    // copy the set to be able to modify it
-    KeyEdgeSet edgeSet = edgeSetConst;
+    // index the set by vertices, and remove edges as they are chained
+    Algorithms::IncidentEdges edgeSet(edgeSetConst);
 
     // insert first edge
     halfedges_ << KeyHalfedge(first, true);
-    edgeSet.erase(edgeSet.begin());
+    edgeSet.remove(0);
     if(first->isClosed())
     {
         //QMessageBox::information(0, QObject::tr("operation aborted"),
@@ -56,7 +57,7 @@ ProperPath::ProperPath(const KeyEdgeSet & edgeSetConst)
     }
 
     // not a pure loop, let's find the chain
-    while(!edgeSet.isEmpty())
+    while(edgeSet.numRemaining() > 0)
     {
         KeyHalfedge lastHalfedge = halfedges_.last(); // we know it's not a loop, otherwise couldn't be here
         KeyVertex * lastVertex = lastHalfedge.endVertex();  // hence this is a valid vertex
@@ -64,37 +65,26 @@ ProperPath::ProperPath(const KeyEdgeSet & edgeSetConst)
         KeyHalfedge firstHalfedge = halfedges_.first(); // we know it's not a loop, otherwise couldn't be here
         KeyVertex * firstVertex = firstHalfedge.startVertex();  // hence this is a valid vertex
 
-        // find next
-        auto it = edgeSet.begin();
-        auto itEnd = edgeSet.end();
-        for(;it!=itEnd;++it)
-        {
-            if((*it)->startVertex() == lastVertex)
-            {
-                halfedges_.append(KeyHalfedge(*it, true));
-                break;
-            }
-            else if((*it)->endVertex() == lastVertex)
-            {
-                halfedges_.append(KeyHalfedge(*it, false));
-                break;
-            }
-            else if((*it)->endVertex() == firstVertex)
-            {
-                halfedges_.prepend(KeyHalfedge(*it, true));
-                break;
-            }
-            else if((*it)->startVertex() == firstVertex)
-            {
-                halfedges_.prepend(KeyHalfedge(*it, false));
-                break;
-            }
-        }
+        // find next: the first remaining edge of the set incident to
+        // either lastVertex or firstVertex
+        int next = edgeSet.firstIncidentEdge(lastVertex);
+        int nextAtFirst = edgeSet.firstIncidentEdge(firstVertex);
+        if(next == -1 || (nextAtFirst != -1 && nextAtFirst < next))
+            next = nextAtFirst;
 
         // if found: great!
-        if(it!=itEnd)
+        if(next != -1)
         {
-            edgeSet.erase(it);
+            KeyEdge * edge = edgeSet[next];
+            if(edge->startVertex() == lastVertex)
+                halfedges_.append(KeyHalfedge(edge, true));
+            else if(edge->endVertex() == lastVertex)
+                halfedges_.append(KeyHalfedge(edge, false));
+            else if(edge->endVertex() == firstVertex)
+                halfedges_.prepend(KeyHalfedge(edge, true));
+            else
+                halfedges_.prepend(KeyHalfedge(edge, false));
+            edgeSet.remove(next);
         }
         else
         {
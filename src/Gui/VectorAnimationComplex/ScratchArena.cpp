@@ -0,0 +1,134 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+
+#include "ScratchArena.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace VectorAnimationComplex
+{
+
+namespace
+{
+
+const std::size_t ALIGNMENT = 16;
+const std::size_t BLOCK_SIZE = 64 * 1024;
+
+// Blocks kept when the outermost scope is closed. Blocks larger than
+// BLOCK_SIZE, allocated for large temporaries, are not kept.
+const std::size_t MAX_NUM_KEPT_BLOCKS = 16;
+
+ScratchArena & threadArena()
+{
+    thread_local ScratchArena arena;
+    return arena;
+}
+
+}
+
+ScratchArena::ScratchArena() :
+    block_(0),
+    offset_(0),
+    depth_(0)
+{
+}
+
+ScratchArena::~ScratchArena()
+{
+    for (const Block & block: blocks_)
+        ::operator delete(block.data);
+}
+
+ScratchArena * ScratchArena::active()
+{
+    ScratchArena & arena = threadArena();
+    return arena.depth_ > 0 ? &arena : 0;
+}
+
+void * ScratchArena::allocate(std::size_t size)
+{
+    size = std::max(ALIGNMENT, (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT);
+    if (blocks_.empty() || offset_ + size > blocks_[block_].size)
+        nextBlock_(size);
+
+    void * p = blocks_[block_].data + offset_;
+    offset_ += size;
+    return p;
+}
+
+void ScratchArena::deallocate(void * p, std::size_t size)
+{
+    size = std::max(ALIGNMENT, (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT);
+    if (!blocks_.empty() && static_cast<char*>(p) + size == blocks_[block_].data + offset_)
+        offset_ -= size;
+}
+
+void ScratchArena::nextBlock_(std::size_t size)
+{
+    // Move to the next block, replacing it if too small. Open scopes never
+    // point after the current block, so this block is not in use.
+    std::size_t next = blocks_.empty() ? 0 : block_ + 1;
+    std::size_t blockSize = std::max(BLOCK_SIZE, size);
+    if (next < blocks_.size() && blocks_[next].size < size)
+    {
+        ::operator delete(blocks_[next].data);
+        blocks_[next].data = static_cast<char*>(::operator new(blockSize));
+        blocks_[next].size = blockSize;
+    }
+    else if (next == blocks_.size())
+    {
+        Block block;
+        block.data = static_cast<char*>(::operator new(blockSize));
+        block.size = blockSize;
+        blocks_.push_back(block);
+    }
+    block_ = next;
+    offset_ = 0;
+}
+
+void ScratchArena::releaseLargeBlocks_()
+{
+    assert(depth_ == 0 && block_ == 0 && offset_ == 0);
+    std::size_t numKept = 0;
+    for (const Block & block: blocks_)
+    {
+        if (block.size == BLOCK_SIZE && numKept < MAX_NUM_KEPT_BLOCKS)
+            blocks_[numKept++] = block;
+        else
+            ::operator delete(block.data);
+    }
+    blocks_.resize(numKept);
+}
+
+std::size_t ScratchArena::numBytesReserved() const
+{
+    std::size_t res = 0;
+    for (const Block & block: blocks_)
+        res += block.size;
+    return res;
+}
+
+ScratchArena::Scope::Scope() :
+    arena_(&threadArena()),
+    block_(arena_->block_),
+    offset_(arena_->offset_)
+{
+    ++arena_->depth_;
+}
+
+ScratchArena::Scope::~Scope()
+{
+    arena_->block_ = block_;
+    arena_->offset_ = offset_;
+    if (--arena_->depth_ == 0)
+        arena_->releaseLargeBlocks_();
+}
+
+}
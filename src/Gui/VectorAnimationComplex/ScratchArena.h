@@ -0,0 +1,135 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+
+#ifndef VAC_SCRATCH_ARENA_H
+#define VAC_SCRATCH_ARENA_H
+
+// ScratchArena: allocates the short-lived temporaries of one user action or
+// one drawing pass, e.g. the cells found by SpatialIndex, which would
+// otherwise be allocated and freed many times per mouse move.
+//
+// Each thread has its own arena, made of 64 KB blocks. Memory is allocated
+// by incrementing an offset, and is released all at once when the
+// ScratchArena::Scope opened at the beginning of the action is closed:
+//
+//     void VAC::someAction()
+//     {
+//         ScratchArena::Scope scratchScope;
+//         ScratchVector<Cell*> cells; // allocated from the arena
+//         ...
+//     }
+//
+// Scopes can be nested. Blocks are kept for reuse by the next actions, so
+// after the first few actions, temporaries no longer call malloc at all.
+//
+// Containers using a ScratchAllocator must be declared after the scope, and
+// must not be returned or stored. Outside of any scope, ScratchAllocator
+// falls back to the global operator new, so that functions using scratch
+// containers can be called from anywhere.
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+namespace VectorAnimationComplex
+{
+
+class ScratchArena
+{
+public:
+    // Arena of the calling thread if a scope is open in this thread, or null
+    static ScratchArena * active();
+
+    // Allocates size bytes, aligned to 16 bytes. Deallocating the last
+    // allocated bytes gives them back, which helps growing vectors.
+    void * allocate(std::size_t size);
+    void deallocate(void * p, std::size_t size);
+
+    // Releases all memory allocated from the arena of the calling thread
+    // during its lifetime
+    class Scope
+    {
+    public:
+        Scope();
+        ~Scope();
+
+    private:
+        Scope(const Scope &);
+        Scope & operator=(const Scope &);
+
+        ScratchArena * arena_;
+        std::size_t block_;
+        std::size_t offset_;
+    };
+
+    // Statistics
+    std::size_t numBytesReserved() const; // in blocks, whether used or free
+
+    ScratchArena();
+    ~ScratchArena();
+
+private:
+    ScratchArena(const ScratchArena &);
+    ScratchArena & operator=(const ScratchArena &);
+
+    struct Block
+    {
+        char * data;
+        std::size_t size;
+    };
+    std::vector<Block> blocks_;
+    std::size_t block_;  // current block
+    std::size_t offset_; // in current block
+    int depth_;          // number of open scopes
+
+    void nextBlock_(std::size_t size);
+    void releaseLargeBlocks_();
+};
+
+// Standard allocator using the arena active at construction, if any
+template <class T>
+class ScratchAllocator
+{
+public:
+    typedef T value_type;
+
+    ScratchAllocator() : arena_(ScratchArena::active()) {}
+    template <class U> ScratchAllocator(const ScratchAllocator<U> & other) : arena_(other.arena_) {}
+
+    T * allocate(std::size_t n)
+    {
+        static_assert(alignof(T) <= 16, "ScratchAllocator only aligns to 16 bytes");
+        if (arena_)
+            return static_cast<T*>(arena_->allocate(n * sizeof(T)));
+        else
+            return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T * p, std::size_t n)
+    {
+        if (arena_)
+            arena_->deallocate(p, n * sizeof(T));
+        else
+            ::operator delete(p);
+    }
+
+    template <class U> bool operator==(const ScratchAllocator<U> & other) const { return arena_ == other.arena_; }
+    template <class U> bool operator!=(const ScratchAllocator<U> & other) const { return arena_ != other.arena_; }
+
+private:
+    template <class U> friend class ScratchAllocator;
+    ScratchArena * arena_;
+};
+
+template <class T>
+using ScratchVector = std::vector<T, ScratchAllocator<T> >;
+
+}
+
+#endif // VAC_SCRATCH_ARENA_H
@@ -38,9 +38,9 @@
 #include <iostream>
 
 #include <vector>
-#include <list>
 #include <queue>
 #include <cmath>
+#include <limits>
 #include <algorithm>
 #include <cassert>
 
@@ -48,6 +48,10 @@
 #include <Eigen/LU>
 #include <Eigen/StdVector>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #ifndef DEFINE_STD_VECTOR_INSERTION_OPERATOR
 #define DEFINE_STD_VECTOR_INSERTION_OPERATOR
 // Defines insertion operator (<<) for std::vector, for convenience
@@ -89,13 +93,13 @@ public:
 
     // Construct an empty curve. Optionally, specify a sampling rate
     Curve(double ds = 5.0) :
-        dirtyArclengths_(false), isClosed_(false), sketchInProgress_(false),
+        firstDirtyArclength_(-1), dirtyCoordinates_(true), dirtyHierarchy_(true), isClosed_(false), sketchInProgress_(false),
         N_(10), fitterType_(QUARTIC_BEZIER_FITTER),
         ds_(ds), lastDs_(-1) {}
 
     // Construct a straight line
     Curve(const T & start, const T & end, double ds = 5.0) :
-        dirtyArclengths_(true), isClosed_(false), sketchInProgress_(false),
+        firstDirtyArclength_(0), dirtyCoordinates_(true), dirtyHierarchy_(true), isClosed_(false), sketchInProgress_(false),
         N_(20), fitterType_(QUARTIC_BEZIER_FITTER),
         ds_(ds), lastDs_(-1)
     {
@@ -106,12 +110,13 @@ public:
 
     // Reinitialize curve
     void clear() {
-        vertices_.clear(); arclengths_.clear(); lastDs_ = -1; dirtyArclengths_ = false; isClosed_ = false;
+        vertices_.clear(); arclengths_.clear(); lastDs_ = -1; firstDirtyArclength_ = -1; isClosed_ = false;
+        setDirtyCoordinates_();
 
 
         p_.clear(); // raw input from mouse
         qTemp_.clear(); // temp vertices
-        clearFits_();
+        fits_.clear();
     }
 
     // must ensure that the first vertex is equal to the last
@@ -141,6 +146,7 @@ public:
         pushFirstVertex_(vertex);
 
         lastFinalS_ = 0;
+        fits_.reserve(N_);
         sketchInProgress_ = true;
     }
 
@@ -167,8 +173,8 @@ public:
         // compute new fit
         if(p_.size() < (unsigned int) N_)
         {
-            // Compute fit
-            Fitter * fit = fitter(fitterType_, p_, 0, p_.size(), ds_);
+            // Compute fit of the whole stroke, reusing the same fitter
+            wholeFit_.fit(p_, 0, p_.size(), ds_);
 
             T q = vertices_.back(); // = q_[0]
             double s = lastFinalS_;                 // = 0
@@ -179,20 +185,17 @@ public:
             {
                 // add a new vertex
                 s += 0.75*ds_;
-                q = phi_(s, fit);
+                q = phi_(s, &wholeFit_);
                 qTemp_.push_back(q);
             }
             // add last vertex
             T lastP = p_.back().p;
             qTemp_.push_back(lastP);
-
-            delete fit;
         }
         else
         {
-            // compute new fitting
-            Fitter * fit = fitter(fitterType_,p_,p_.size()-N_,N_,ds_);
-            fits_ << fit;
+            // compute new fitting, reusing the storage of a released one
+            fits_.push().fit(p_,p_.size()-N_,N_,ds_);
 
             T q = vertices_.back();
             //double qt = qt_.last();
@@ -219,6 +222,10 @@ public:
             // add last vertex
             T lastP = p_.back().p;
             qTemp_.push_back(lastP);
+
+            // Release fits that won't be blended anymore: vertices are only
+            // sampled after lastFinalS_ from now on (see phi_())
+            fits_.releaseBefore(lastFittingInvolved_(lastFinalS_) - N_ + 2);
         }
 
         lastDs_ = -1;
@@ -232,7 +239,7 @@ public:
         qTemp_.clear();
 
         //vertices_.insert(vertices_.end(), qTemp_.begin(), qTemp_.end());
-        clearFits_();
+        fits_.clear();
         //makeQuasiUniform_();
         //computeQS_();
 
@@ -252,6 +259,14 @@ public:
     {
         return vertices_.size() + qTemp_.size();
     }
+
+    // Number of vertices which are not temporary: while sketching, they are
+    // only appended to, the following ones being recomputed for each input
+    int numFinalVertices() const
+    {
+        return vertices_.size();
+    }
+
     T operator[] (int i) const
     {
         int k = i-vertices_.size();
@@ -266,6 +281,40 @@ public:
         return arclengths_[i];
     }
 
+    // Coordinates of the vertices, as separate arrays of x and y (aligned for
+    // SIMD loads), for the computations that don't need the widths. Like
+    // arclengths, they ignore qTemp, and are recomputed lazily when vertices
+    // change. The pointers are invalidated by any change to the curve.
+    const double * xs() const
+    {
+        precomputeCoordinates_();
+        return xs_.data();
+    }
+    const double * ys() const
+    {
+        precomputeCoordinates_();
+        return ys_.data();
+    }
+
+    // Computes now the arclengths and coordinates, otherwise computed
+    // lazily, so that the curve can then be queried by several threads at
+    // once, e.g. with intersections(), without being copied
+    void precompute() const
+    {
+        if(size() > 0)
+            precomputeArclengths_();
+        precomputeCoordinates_();
+    }
+
+    // Memory used by the samples and cached data, in bytes
+    std::size_t numBytes() const
+    {
+        return vertices_.capacity() * sizeof(T) +
+               arclengths_.capacity() * sizeof(double) +
+               (xs_.capacity() + ys_.capacity()) * sizeof(double) +
+               hierarchy_.capacity() * sizeof(HierarchyNode);
+    }
+
     T start() const
     {
         if(size())
@@ -297,13 +346,14 @@ public:
                 lastDs_ = ds_;
         }
 
-        // We'll work on a linked list for fast insertion/deletion in the middle
-        typedef std::list<T,Eigen::aligned_allocator<T> > SampleList;
-        SampleList samples;
+        // We work on arrays: samples are removed by compacting them in place
+        // with a write cursor, and inserted by writing them to a second array
+        typedef std::vector<T,Eigen::aligned_allocator<T> > SampleVector;
+        SampleVector samples;
+        samples.reserve(size());
 
-        // First pass: copy all non-NaN samples to the list
+        // First pass: copy all non-NaN samples to the array
         double defaultWidth = 10;
-        int n = 0;
         for(int i=0; i<size(); ++i)
         {
             T sample = operator[](i);
@@ -315,9 +365,9 @@ public:
             if(!isnan(sample.x()) && !isnan(sample.y()))
             {
                 samples.push_back(sample);
-                ++n;
             }
         }
+        int n = samples.size();
 
         // Step 1: While(n>4), Remove all (d < ds/2). Remove prelast if (dlast < ds/4)
         //         While(n<=4), Remove all (d < eps/2), and push (eps/2 <= d < eps) to (d == eps). Remove prelast if (dlast < eps/2)
@@ -327,68 +377,56 @@ public:
         double halfEps = 0.5*eps;
         if(n >= 3)
         {
-            typename SampleList::iterator it1 = samples.begin();
-            typename SampleList::iterator it2 = it1; ++it2;
-            typename SampleList::iterator itLast = samples.end(); --itLast;
-            // Here is the current state of the linked list:
-            //  begin=it1  it2                          last       end
-            //        ()-->()-->()-->()-->()-->()-->()-->()------>(NULL)
-            while(it2 != itLast)
+            // i1 is the last kept sample, and i2 the next sample to test.
+            // Kept samples are moved to i1+1 <= i2. The last sample is
+            // always kept.
+            int iLast = n-1;
+            int i1 = 0;
+            int i2 = 1;
+            while(i2 != iLast)
             {
-                double d = it1->distanceTo(*it2); // note: could use squared distance, would be more efficient
+                double d = samples[i1].distanceTo(samples[i2]); // note: could use squared distance, would be more efficient
                 if(n<=4)
                 {
                     if(d<halfEps)
                     {
-                        it2 = samples.erase(it2);
+                        ++i2;
                         --n;
                     }
                     else
                     {
                         if(d<eps)
                         {
-                            *it2 = it1->lerp(eps/d,*it2);
+                            samples[i2] = samples[i1].lerp(eps/d,samples[i2]);
                         }
-                        ++it1;
-                        ++it2;
+                        samples[++i1] = samples[i2++];
                     }
                 }
                 else
                 {
                     if(d<halfDs)
                     {
-                        it2 = samples.erase(it2);
+                        ++i2;
                         --n;
                     }
                     else
                     {
-                        ++it1;
-                        ++it2;
+                        samples[++i1] = samples[i2++];
                     }
                 }
             }
-            // Here is the current state of the linked list:
-            //       begin                     it1       it2=last  end
-            //        ()------->()------->()-->()------->()------>(NULL)
-            //
-            if(it1 != samples.begin())
+            samples[i1+1] = samples[iLast];
+            samples.resize(i1+2);
+
+            // Remove prelast
+            if(i1 != 0)
             {
-                double d = it1->distanceTo(*it2); // note: could use squared distance, would be more efficient
-                if(n<=4)
+                double d = samples[i1].distanceTo(samples[i1+1]); // note: could use squared distance, would be more efficient
+                if(n<=4 ? d<halfEps : d<quarterDs)
                 {
-                    if(d<halfEps)
-                    {
-                        samples.erase(it1);
-                        --n;
-                    }
-                }
-                else
-                {
-                    if(d<quarterDs)
-                    {
-                        samples.erase(it1);
-                        --n;
-                    }
+                    samples[i1] = samples[i1+1];
+                    samples.pop_back();
+                    --n;
                 }
             }
         }
@@ -405,8 +443,7 @@ public:
                 ++n;
             }
             // now, n == 1
-            typename SampleList::iterator it = samples.begin();
-            T sample0 = *it;
+            T sample0 = samples[0];
             T sample1 = sample0; sample1.setX(sample0.x()+eps);
             T sample2 = sample1; sample2.setY(sample1.y()+eps);
             T sample3 = sample0;
@@ -419,27 +456,25 @@ public:
         }
         else if(n == 2)
         {
-            typename SampleList::iterator it1 = samples.begin();
-            typename SampleList::iterator it2 = it1; ++it2;
-            double d = it1->distanceTo(*it2); // note: could use squared distance, would be more efficient
+            T sample0 = samples[0];
+            T sample3 = samples[1];
+            double d = sample0.distanceTo(sample3); // note: could use squared distance, would be more efficient
             if(d<halfEps)
             {
                 // same as n<2, we have guarantee that the last distance will be > halfEps
-                T sample0 = *it1;
                 T sample1 = sample0; sample1.setX(sample0.x()+eps);
                 T sample2 = sample1; sample2.setY(sample1.y()+eps);
-                samples.insert(it2,sample1); // insert just before it2
-                ++n;
-                samples.insert(it2,sample2); // insert just before it2
-                ++n;
+                samples.resize(4);
+                samples[1] = sample1;
+                samples[2] = sample2;
+                samples[3] = sample3;
+                n = 4;
             }
             else if(d<eps)
             {
                 // we have safe access to tangent
-                T sample0 = *it1;
                 T sample1 = sample0; // copy width, pos will be overriden
                 T sample2 = sample0;// copy width, pos will be overriden
-                T sample3 = *it2;
                 Eigen::Vector2d p0(sample0.x(),sample0.y());
                 Eigen::Vector2d p3(sample3.x(),sample3.y());
                 Eigen::Vector2d u = p3 - p0;
@@ -452,10 +487,11 @@ public:
                 sample1.setY(p1[1]);
                 sample2.setX(p2[0]);
                 sample2.setY(p2[1]);
-                samples.insert(it2,sample1); // insert just before it2
-                ++n;
-                samples.insert(it2,sample2); // insert just before it2
-                ++n;
+                samples.resize(4);
+                samples[1] = sample1;
+                samples[2] = sample2;
+                samples[3] = sample3;
+                n = 4;
             }
             else
             {
@@ -464,28 +500,25 @@ public:
                 if(n>2)
                 {
                     // we have safe access to tangent
+                    samples.resize(n);
                     for(int i=1; i<n-1; ++i)
                     {
                         double u = (double) i / (double) (n-1);
-                        T sample = it1->lerp(u,*it2);
-                        samples.insert(it2,sample); // insert just before it2
+                        samples[i] = sample0.lerp(u,sample3);
                     }
+                    samples[n-1] = sample3;
                 }
             }
         }
         else if(n == 3)
         {
-            typename SampleList::iterator it1 = samples.begin();
-            typename SampleList::iterator it2 = it1; ++it2;
-            typename SampleList::iterator it3 = it2; ++it3;
             // Since p1 has survived the cleaning, we know ||p1-p0|| > eps
-            double d = it1->distanceTo(*it3); // note: could use squared distance, would be more efficient
+            double d = samples[0].distanceTo(samples[2]); // note: could use squared distance, would be more efficient
             if(d<halfEps)
             {
-                T sample0 = *it1;
-                T sample1 = *it2;
+                T sample0 = samples[0];
+                T sample1 = samples[1];
                 T sample2 = sample0;// copy width, pos will be overriden
-                //T sample3 = *it3;
                 Eigen::Vector2d p0(sample0.x(),sample0.y());
                 Eigen::Vector2d p1(sample1.x(),sample1.y());
                 Eigen::Vector2d u = p1 - p0;
@@ -494,7 +527,7 @@ public:
                 Eigen::Vector2d p2 = p1 - eps*v;
                 sample2.setX(p2[0]);
                 sample2.setY(p2[1]);
-                samples.insert(it3,sample2); // insert just before it3
+                samples.insert(samples.begin()+2,sample2); // insert just before the last sample
                 ++n;
             }
             else
@@ -512,40 +545,29 @@ public:
         // Step 3: Subdivision scheme
         if(subdivide) // Note: this implies n>=3
         {
-            SampleList subdividedSamples;
+            SampleVector subdividedSamples;
             bool subdivideAgain = true;
             while(subdivideAgain)
             {
-                // Initialization
+                // Initialization. At most one sample is inserted per segment
                 subdivideAgain = false;
-                typename SampleList::iterator it1 = samples.begin();
-                typename SampleList::iterator it2 = it1; ++it2;
-                typename SampleList::iterator itEnd = samples.end();
-                typename SampleList::iterator itFirst = it1;
-                typename SampleList::iterator itLast = itEnd; --itLast;
-                subdividedSamples.push_back(*it1);
-
-                // Main loop through list
-                while(it2 != itEnd)
+                int m = samples.size();
+                subdividedSamples.clear();
+                subdividedSamples.reserve(2*m-1);
+                subdividedSamples.push_back(samples[0]);
+
+                // Main loop through array
+                for(int i1=0, i2=1; i2<m; ++i1, ++i2)
                 {
-                    double d = it1->distanceTo(*it2); // note: could use squared distance, would be more efficient
+                    double d = samples[i1].distanceTo(samples[i2]); // note: could use squared distance, would be more efficient
                     if(d>ds()) // should subdivide
                     {
                         // compute new sample using 4-point subdivision scheme [Dyn 1987]
-                        typename SampleList::iterator it0 = it1; if(it0!=itFirst) --it0;
-                        typename SampleList::iterator it3 = it2; if(it3!=itLast) ++it3;
-                        T sample0 = *it0;
-                        T sample1 = *it1;
-                        T sample2 = *it2;
-                        T sample3 = *it3;
-                        //Eigen::Vector2d p0(sample0.x(),sample0.y());
-                        //Eigen::Vector2d p1(sample1.x(),sample1.y());
-                        //Eigen::Vector2d p2(sample2.x(),sample2.y());
-                        //Eigen::Vector2d p3(sample3.x(),sample3.y());
+                        int i0 = (i1 > 0) ? i1-1 : i1;
+                        int i3 = (i2 < m-1) ? i2+1 : i2;
                         double w = 0.0625; // i.e., 1/16
                         double halfPlusW = 0.5625; // i.e., 1/2 + 1/16
-                        //Eigen::Vector2d p = halfPlusW*(p1+p2) + w*(p0+p3);
-                        T newSample = (sample1+sample2)*halfPlusW - (sample0+sample3)*w;
+                        T newSample = (samples[i1]+samples[i2])*halfPlusW - (samples[i0]+samples[i3])*w;
 
                         // insert
                         subdividedSamples.push_back(newSample);
@@ -554,26 +576,17 @@ public:
                         subdivideAgain = true;
                     }
 
-                    // insert it2 anyway
-                    subdividedSamples.push_back(*it2);
-
-                    // advance in list
-                    ++it1;
-                    ++it2;
+                    // insert i2 anyway
+                    subdividedSamples.push_back(samples[i2]);
                 }
 
                 // What to do at the end
                 samples.swap(subdividedSamples);
-                subdividedSamples.clear();
             }
         }
 
-        // Copy back the list to the vector
-        vertices_.clear();
-        typename SampleList::iterator itBegin = samples.begin();
-        typename SampleList::iterator itEnd = samples.end();
-        for(typename SampleList::iterator it = itBegin; it != itEnd; ++it)
-            vertices_.push_back(*it);
+        // Move the array to the vertices
+        vertices_.swap(samples);
         setDirtyArclengths_();
     }
 
@@ -592,6 +605,67 @@ public:
         setDirtyArclengths_();
     }
 
+    // same as above, but takes ownership of the vertices instead of copying
+    // them, e.g., when they have just been parsed from a file
+    void setVertices(std::vector<T,Eigen::aligned_allocator<T> > && newVertices)
+    {
+        // clear but keep loopness
+        bool loopTmp = isClosed_;
+        clear();
+        isClosed_ = loopTmp;
+
+        // set vertices
+        vertices_.swap(newVertices);
+        setDirtyArclengths_();
+    }
+
+    // set the curve to be a followed by b, each traversed backward if
+    // reverseA (resp. reverseB), where the last vertex of a is the first of
+    // b and is kept only once, e.g. when merging two edges at their common
+    // vertex. Arclengths are derived from the ones of a and b instead of
+    // being measured again, and no resampling occurs.
+    // keep the loopness it has before calling the function
+    void setSplicedVertices(const Curve & a, bool reverseA, const Curve & b, bool reverseB)
+    {
+        a.precomputeArclengths_();
+        b.precomputeArclengths_();
+        const int na = a.size();
+        const int nb = b.size();
+        const double la = a.arclengths_.back();
+        const double lb = b.arclengths_.back();
+
+        std::vector<T,Eigen::aligned_allocator<T> > vertices;
+        std::vector<double> arclengths;
+        vertices.reserve(na+nb-1);
+        arclengths.reserve(na+nb-1);
+        for(int i=0; i<na; ++i)
+        {
+            int k = reverseA ? na-1-i : i;
+            vertices.push_back(a.vertices_[k]);
+            arclengths.push_back(reverseA ? la - a.arclengths_[k] : a.arclengths_[k]);
+        }
+        for(int i=1; i<nb; ++i)
+        {
+            int k = reverseB ? nb-1-i : i;
+            vertices.push_back(b.vertices_[k]);
+            arclengths.push_back(la + (reverseB ? lb - b.arclengths_[k] : b.arclengths_[k]));
+        }
+
+        // The junction vertex takes the average width of both ends, which
+        // leaves arclengths unchanged
+        T & junction = vertices[na-1];
+        junction.setWidth(0.5 * (junction.width() + b.vertices_[reverseB ? nb-1 : 0].width()));
+
+        // clear but keep loopness
+        bool loopTmp = isClosed_;
+        clear();
+        isClosed_ = loopTmp;
+
+        // set vertices and their (already up to date) arclengths
+        vertices_.swap(vertices);
+        arclengths_.swap(arclengths);
+    }
+
     // -------- Continuous curve --------
 
     // Note: these functions ignore whatever is in qTemp
@@ -613,6 +687,47 @@ public:
             return interpolatedVertex_(s);
     }
 
+    // Cursor: same as operator()(s), but remembers the segment where the
+    // last s was found, and searches the next one linearly from there.
+    // Evaluating a sorted sequence of values (increasing or decreasing),
+    // e.g. when resampling, is thus done in a single sweep along the
+    // vertices, instead of one search per value. A cursor is invalidated
+    // when the curve is modified.
+    class Cursor
+    {
+    public:
+        Cursor(const Curve<T> & curve) : curve_(curve), i_(0)
+        {
+            curve_.precomputeArclengths_();
+        }
+
+        T operator() (double s)
+        {
+            const std::vector<T,Eigen::aligned_allocator<T> > & vertices = curve_.vertices_;
+            const std::vector<double> & arclengths = curve_.arclengths_;
+            int n = vertices.size();
+            assert(n>0);
+            if(n == 1)
+                return vertices.front();
+
+            // Find the last segment i such that arclengths[i] <= s, if any
+            i_ = std::min(i_, n-2);
+            while(i_ < n-2 && arclengths[i_+1] <= s)
+                ++i_;
+            while(i_ > 0 && arclengths[i_] > s)
+                --i_;
+
+            double si = arclengths[i_];
+            double sj = arclengths[i_+1];
+            double u = (sj > si) ? (s - si) / (sj - si) : 0;
+            return vertices[i_].lerp(u,vertices[i_+1]);
+        }
+
+    private:
+        const Curve<T> & curve_;
+        int i_;
+    };
+
     // -------- Apply affine transform --------
 
 
@@ -648,34 +763,93 @@ public:
             vertices_[i].setX(vertices_[i].x() + dx);
             vertices_[i].setY(vertices_[i].y() + dy);
         }
+        setDirtyCoordinates_();
+    }
+
+    // change the width of the i-th vertex. Widths do not affect arclengths,
+    // so this is cheaper than setVertices() when only a few widths change
+    void setWidth(int i, double width)
+    {
+        vertices_[i].setWidth(width);
     }
 
     // return -1 if no vertices
+    //
+    // The search goes through a hierarchy of bounding boxes over runs of
+    // consecutive vertices, built lazily and invalidated with the
+    // coordinates, so that it only visits the runs that may contain a
+    // vertex closer than the closest one found so far. If maxDistance is
+    // given, vertices further away than maxDistance are ignored, which
+    // prunes the search further, and -1 is returned if there are none.
+    // On ties, the vertex with the smallest index is returned.
     struct ClosestVertex { int i; double d; };
-    ClosestVertex findClosestVertex(double x, double y) const
+    ClosestVertex findClosestVertex(double x, double y,
+                                    double maxDistance = std::numeric_limits<double>::infinity()) const
     {
         double minD2 = std::numeric_limits<double>::max();
-        int i = -1;
-        int minI = i;
-        for(auto v: vertices_)
-        {
-            ++i;
-            double dx = x-v.x();
-            double dy = y-v.y();
-            double d2 = dx*dx + dy*dy;
-            if(d2<minD2)
+        if(maxDistance < std::numeric_limits<double>::infinity())
+            minD2 = maxDistance*maxDistance;
+        int minI = -1;
+
+        const double * xs = this->xs();
+        const double * ys = this->ys();
+        auto visit = [&](int begin, int end)
+        {
+            for(int i=begin; i<end; ++i)
             {
-                minD2 = d2;
-                minI = i;
+                double dx = x-xs[i];
+                double dy = y-ys[i];
+                double d2 = dx*dx + dy*dy;
+                if(d2<minD2 || (d2==minD2 && (minI == -1 || i<minI)))
+                {
+                    minD2 = d2;
+                    minI = i;
+                }
             }
+        };
+
+        int n = vertices_.size();
+        if(n <= 2*HIERARCHY_LEAF_SIZE)
+        {
+            visit(0, n);
         }
-        ClosestVertex res = { minI, sqrt(minD2) };
+        else
+        {
+            precomputeHierarchy_();
+            int stack[64];
+            int stackSize = 0;
+            stack[stackSize++] = 0;
+            while(stackSize > 0)
+            {
+                const HierarchyNode & node = hierarchy_[stack[--stackSize]];
+                if(node.distance2(x,y) > minD2)
+                    continue;
+
+                if(node.left == -1)
+                {
+                    visit(node.begin, node.end);
+                }
+                else
+                {
+                    // Push the furthest child first, so that the closest
+                    // one is visited first and tightens minD2 sooner
+                    int left = node.left;
+                    int right = node.right;
+                    if(hierarchy_[left].distance2(x,y) > hierarchy_[right].distance2(x,y))
+                        std::swap(left, right);
+                    stack[stackSize++] = right;
+                    stack[stackSize++] = left;
+                }
+            }
+        }
+
+        ClosestVertex res = { minI, minI == -1 ? std::numeric_limits<double>::infinity() : sqrt(minD2) };
         return res;
     }
 
     double prepareSculpt(double x, double y, double radius)
     {
-        ClosestVertex v = findClosestVertex(x,y);
+        ClosestVertex v = findClosestVertex(x,y,radius);
         sculptIndex_ = v.i;
         sculptRadius_ = radius;
         return v.d;
@@ -853,7 +1027,10 @@ public:
 
     void continueSculptDeform(double x, double y)
     {
-        setDirtyArclengths_();
+        // only arclengths after the first sculpted vertex change
+        int first, last;
+        if(sculptedVertices(first, last))
+            setDirtyArclengths_(first);
 
         for(auto & v: sculptTemp_)
         {
@@ -868,12 +1045,27 @@ public:
         resample(true);
     }
 
+    // Range [first, last] of the vertices moved by continueSculptDeform().
+    // Returns false if there are none
+    bool sculptedVertices(int & first, int & last) const
+    {
+        if(sculptTemp_.empty())
+            return false;
+
+        first = last = sculptTemp_[0].i;
+        for(auto & v: sculptTemp_)
+        {
+            first = std::min(first, v.i);
+            last = std::max(last, v.i);
+        }
+        return true;
+    }
+
     // apply a smooth filter of radius sculptRadius_ and intensity intensity at sculptVertex_
     void sculptSmooth(double intensity)
     {
         precomputeArclengths_();
-        std::vector<T,Eigen::aligned_allocator<T> > copyVertices = vertices_;
-        if(!size())
+        if(sculptIndex_<0 || sculptIndex_>=size())
             return;
 
         // to handle loops
@@ -889,17 +1081,10 @@ public:
             w0 = w_(halfLength);
         }
 
-        // compute first local intensity of extremities
-        // this is only useful if isClosed == false
-        double sSculpt = arclengthOfSculptVertex();
-
-        for(int i=0; i<size(); ++i)
+        // signed distance between vertices i and j, loop-aware if closed
+        auto distance = [&](int i, int j)
         {
-            if(!isClosed_ && (i==0 || i==size()-1))
-                continue;
-
-            // for every affected vertex i
-            double d = arclengths_[sculptIndex_] - arclengths_[i];
+            double d = arclengths_[i] - arclengths_[j];
             if(isClosed_)
             {
                 // transform it into unsigned distance, loop-aware: 0 <= d <= length / 2
@@ -910,6 +1095,71 @@ public:
                 if(d<0)
                     d *= -1;
             }
+            return d;
+        };
+
+        // Only vertices within sculptRadius_ of the sculpt vertex are
+        // smoothed, using neighbours within sculptRadius_ of them: the window
+        // is made of all vertices within 2 * sculptRadius_ of the sculpt
+        // vertex. It is sorted by index, so that weighted sums are computed
+        // in the same order as if iterating over all vertices.
+        std::vector<int> window;
+        int n = size();
+        double windowRadius = 2 * sculptRadius_;
+        if(isClosed_ && windowRadius >= halfLength)
+        {
+            for(int i=0; i<n; ++i)
+                window.push_back(i);
+        }
+        else
+        {
+            window.push_back(sculptIndex_);
+            for(int k=1; k<n; ++k) // before sculpt vertex
+            {
+                int i = sculptIndex_ - k;
+                if(i < 0)
+                {
+                    if(!isClosed_)
+                        break;
+                    i += n;
+                }
+                if(std::abs(distance(sculptIndex_, i)) >= windowRadius)
+                    break;
+                window.push_back(i);
+            }
+            for(int k=1; k<n; ++k) // after sculpt vertex
+            {
+                int i = sculptIndex_ + k;
+                if(i >= n)
+                {
+                    if(!isClosed_)
+                        break;
+                    i -= n;
+                }
+                if(std::abs(distance(sculptIndex_, i)) >= windowRadius)
+                    break;
+                window.push_back(i);
+            }
+            std::sort(window.begin(), window.end());
+            window.erase(std::unique(window.begin(), window.end()), window.end());
+        }
+        std::vector<T,Eigen::aligned_allocator<T> > copyVertices;
+        copyVertices.reserve(window.size());
+        for(int i: window)
+            copyVertices.push_back(vertices_[i]);
+
+        // compute first local intensity of extremities
+        // this is only useful if isClosed == false
+        double sSculpt = arclengthOfSculptVertex();
+
+        for(unsigned int ki=0; ki<window.size(); ++ki)
+        {
+            int i = window[ki];
+            if(!isClosed_ && (i==0 || i==size()-1))
+                continue;
+
+            // for every affected vertex i
+            double d = distance(sculptIndex_, i);
             if(std::abs(d)<sculptRadius_)
             {
                 // replace vertices_[i] by the weighted average of neighbours
@@ -922,23 +1172,13 @@ public:
                     localIntensity = intensity * w_(d);
                 T res;
                 double sum = 0;
-                for(int j=0; j<size(); ++j)
+                for(unsigned int kj=0; kj<window.size(); ++kj)
                 {
-                    double d2 = arclengths_[i] - arclengths_[j];
-                    if(isClosed_)
-                    {
-                        // transform it into unsigned distance, loop-aware: 0 <= d <= length / 2
-                        if(d2>halfLength)
-                            d2 -= l;
-                        if(d2<-halfLength)
-                            d2 += l;
-                        if(d2<0)
-                            d2 *= -1;
-                    }
+                    double d2 = distance(i, window[kj]);
                     if(std::abs(d2)<localRadius)
                     {
                         double w = exp( - 5 * d2*d2 / (double) (localRadius*localRadius) ); //w_(d2,localRadius);
-                        res = res + copyVertices[j] * w;
+                        res = res + copyVertices[kj] * w;
                         sum += w;
                     }
                 }
@@ -959,7 +1199,7 @@ public:
                             finalIntensity = localIntensity * alpha;
                         }
                     }
-                    vertices_[i] = copyVertices[i].lerp(finalIntensity, res);
+                    vertices_[i] = copyVertices[ki].lerp(finalIntensity, res);
                 }
             }
         }
@@ -1071,11 +1311,273 @@ public:
     }
 
 
+    // Batch version of intersects(): tests the four pairs of segments
+    // ([A[k]B[k]], [C[k]D[k]]), with exactly the same arithmetic as the scalar
+    // version, and returns a bitmask of the intersecting pairs. For those, u[k]
+    // and v[k] are set as in intersects(). Vectorized with SSE2 when available.
+    inline static int intersects4(
+            // input
+            const double ax[4], const double ay[4],
+            const double bx[4], const double by[4],
+            const double cx[4], const double cy[4],
+            const double dx[4], const double dy[4],
+            // output
+            double u[4], double v[4],
+            // parameters
+            double epsilon = 1e-10)
+    {
+#ifdef __SSE2__
+        const __m128d eps = _mm_set1_pd(epsilon);
+        const __m128d minusEps = _mm_set1_pd(-epsilon);
+        const __m128d onePlusEps = _mm_set1_pd(1+epsilon);
+        const __m128d one = _mm_set1_pd(1.0);
+        const __m128d signMask = _mm_set1_pd(-0.0);
+        int res = 0;
+        for(int h=0; h<4; h+=2)
+        {
+            __m128d Ax = _mm_loadu_pd(ax+h), Ay = _mm_loadu_pd(ay+h);
+            __m128d Bx = _mm_loadu_pd(bx+h), By = _mm_loadu_pd(by+h);
+            __m128d Cx = _mm_loadu_pd(cx+h), Cy = _mm_loadu_pd(cy+h);
+            __m128d Dx = _mm_loadu_pd(dx+h), Dy = _mm_loadu_pd(dy+h);
+
+            // pruning
+            __m128d pruned = _mm_or_pd(
+                        _mm_or_pd(_mm_cmpgt_pd(_mm_min_pd(Ax,Bx), _mm_max_pd(Cx,Dx)),
+                                  _mm_cmpgt_pd(_mm_min_pd(Cx,Dx), _mm_max_pd(Ax,Bx))),
+                        _mm_or_pd(_mm_cmpgt_pd(_mm_min_pd(Ay,By), _mm_max_pd(Cy,Dy)),
+                                  _mm_cmpgt_pd(_mm_min_pd(Cy,Dy), _mm_max_pd(Ay,By))));
+
+            // actual computation
+            __m128d ABx = _mm_sub_pd(Bx,Ax), ABy = _mm_sub_pd(By,Ay);
+            __m128d CDx = _mm_sub_pd(Dx,Cx), CDy = _mm_sub_pd(Dy,Cy);
+            __m128d ACx = _mm_sub_pd(Ax,Cx), ACy = _mm_sub_pd(Ay,Cy);
+            __m128d det_ = _mm_sub_pd(_mm_mul_pd(ABx,CDy), _mm_mul_pd(ABy,CDx)); // det(AB,CD)
+            __m128d numU = _mm_sub_pd(_mm_mul_pd(CDx,ACy), _mm_mul_pd(CDy,ACx)); // det(CD,AC)
+            __m128d numV = _mm_sub_pd(_mm_mul_pd(ABx,ACy), _mm_mul_pd(ABy,ACx)); // det(AB,AC)
+            __m128d parallel = _mm_cmplt_pd(_mm_andnot_pd(signMask, det_), eps);
+            __m128d invDet = _mm_div_pd(one, det_);
+            __m128d U = _mm_mul_pd(numU, invDet);
+            __m128d V = _mm_mul_pd(numV, invDet);
+            __m128d inside = _mm_and_pd(
+                        _mm_and_pd(_mm_cmpge_pd(U,minusEps), _mm_cmplt_pd(U,onePlusEps)),
+                        _mm_and_pd(_mm_cmpge_pd(V,minusEps), _mm_cmplt_pd(V,onePlusEps)));
+            _mm_storeu_pd(u+h, U);
+            _mm_storeu_pd(v+h, V);
+            res |= _mm_movemask_pd(_mm_andnot_pd(_mm_or_pd(pruned,parallel), inside)) << h;
+        }
+        return res;
+#else
+        int res = 0;
+        for(int k=0; k<4; ++k)
+            if(intersects(ax[k], ay[k], bx[k], by[k], cx[k], cy[k], dx[k], dy[k], u[k], v[k], epsilon))
+                res |= 1 << k;
+        return res;
+#endif
+    }
+
+    // Helper to test pairs of segments by batches of four using intersects4().
+    // Pairs are given with add(), together with an integer i, and f(i, u, v)
+    // is called for each intersecting pair, in order. Call flush() when done.
+    template<class F>
+    class IntersectionBatch
+    {
+    public:
+        IntersectionBatch(F f) : f_(f), n_(0) {}
+
+        void add(const T & a, const T & b, const T & c, const T & d, int i)
+        {
+            ax_[n_] = a.x(); ay_[n_] = a.y();
+            bx_[n_] = b.x(); by_[n_] = b.y();
+            cx_[n_] = c.x(); cy_[n_] = c.y();
+            dx_[n_] = d.x(); dy_[n_] = d.y();
+            i_[n_] = i;
+            if(++n_ == 4)
+                flush();
+        }
+
+        // Same as above, with the segments [AB] and [CD] given by coordinates
+        void add(double ax, double ay, double bx, double by,
+                 double cx, double cy, double dx, double dy, int i)
+        {
+            ax_[n_] = ax; ay_[n_] = ay;
+            bx_[n_] = bx; by_[n_] = by;
+            cx_[n_] = cx; cy_[n_] = cy;
+            dx_[n_] = dx; dy_[n_] = dy;
+            i_[n_] = i;
+            if(++n_ == 4)
+                flush();
+        }
+
+        void flush()
+        {
+            if(n_ == 0)
+                return;
+            for(int k=n_; k<4; ++k)
+            {
+                ax_[k] = ay_[k] = bx_[k] = by_[k] = 0;
+                cx_[k] = cy_[k] = dx_[k] = dy_[k] = 0;
+            }
+            double u[4], v[4];
+            int mask = intersects4(ax_, ay_, bx_, by_, cx_, cy_, dx_, dy_, u, v);
+            for(int k=0; k<n_; ++k)
+                if(mask & (1 << k))
+                    f_(i_[k], u[k], v[k]);
+            n_ = 0;
+        }
+
+    private:
+        F f_;
+        int n_;
+        double ax_[4], ay_[4], bx_[4], by_[4];
+        double cx_[4], cy_[4], dx_[4], dy_[4];
+        int i_[4];
+    };
+    template<class F>
+    static IntersectionBatch<F> intersectionBatch(F f) { return IntersectionBatch<F>(f); }
+
+    // Uniform grid of the segments of a curve, to quickly find segments whose
+    // bounding box intersects a given box. When the same curve is intersected
+    // with many others, build it once and pass it to each intersections() call.
+    // It must be rebuilt whenever the vertices of the curve change.
+    class SegmentGrid
+    {
+    public:
+        SegmentGrid() { clear(); }
+        explicit SegmentGrid(const Curve & curve) { build(curve); }
+
+        void clear()
+        {
+            nx_ = 0; ny_ = 0;
+            cellStart_.clear();
+            items_.clear();
+            stamps_.clear();
+            stamp_ = 0;
+        }
+
+        // Note: the curve must not be being sketched (see xs())
+        void build(const Curve & curve)
+        {
+            clear();
+            int n = curve.size();
+            if(n<2)
+                return;
+
+            // Bounding box and total length
+            const double * xs = curve.xs();
+            const double * ys = curve.ys();
+            xMin_ = xMax_ = xs[0];
+            yMin_ = yMax_ = ys[0];
+            for(int i=1; i<n; ++i)
+            {
+                xMin_ = std::min(xMin_, xs[i]); xMax_ = std::max(xMax_, xs[i]);
+                yMin_ = std::min(yMin_, ys[i]); yMax_ = std::max(yMax_, ys[i]);
+            }
+            double totalLength = curve.length();
+
+            // Cells of about the size of two segments, but not too many of them
+            const int MAX_DIM = 256;
+            double w = xMax_ - xMin_;
+            double h = yMax_ - yMin_;
+            double cellSize = std::max(2 * totalLength / (n-1), std::max(w,h) / MAX_DIM);
+            if(!(cellSize > 0))
+                cellSize = 1;
+            invCellSize_ = 1 / cellSize;
+            margin_ = 1e-6 * (std::max(w,h) + 1);
+            nx_ = std::min(MAX_DIM, (int) (w * invCellSize_) + 1);
+            ny_ = std::min(MAX_DIM, (int) (h * invCellSize_) + 1);
+
+            // Count segments per cell, then fill cells (compressed storage)
+            cellStart_.assign(nx_*ny_+1, 0);
+            for(int pass=0; pass<2; ++pass)
+            {
+                for(int i=0; i<n-1; ++i)
+                {
+                    int ix1 = cellX_(std::min(xs[i], xs[i+1]) - margin_);
+                    int ix2 = cellX_(std::max(xs[i], xs[i+1]) + margin_);
+                    int iy1 = cellY_(std::min(ys[i], ys[i+1]) - margin_);
+                    int iy2 = cellY_(std::max(ys[i], ys[i+1]) + margin_);
+                    for(int iy=iy1; iy<=iy2; ++iy)
+                        for(int ix=ix1; ix<=ix2; ++ix)
+                            if(pass == 0)
+                                ++cellStart_[iy*nx_+ix+1];
+                            else
+                                items_[fill_[iy*nx_+ix]++] = i;
+                }
+                if(pass == 0)
+                {
+                    for(int k=0; k<nx_*ny_; ++k)
+                        cellStart_[k+1] += cellStart_[k];
+                    items_.resize(cellStart_.back());
+                    fill_.assign(cellStart_.begin(), cellStart_.end()-1);
+                }
+            }
+            fill_.clear();
+            stamps_.assign(n-1, 0);
+        }
+
+        // Get the indices i, in increasing order, of the segments [i,i+1]
+        // whose bounding box may intersect [x1,x2]x[y1,y2]
+        void query(double x1, double y1, double x2, double y2, std::vector<int> & out) const
+        {
+            out.clear();
+            if(nx_ == 0 ||
+               x2 < xMin_ - margin_ || x1 > xMax_ + margin_ ||
+               y2 < yMin_ - margin_ || y1 > yMax_ + margin_)
+                return;
+
+            if(++stamp_ == 0)
+            {
+                std::fill(stamps_.begin(), stamps_.end(), 0);
+                stamp_ = 1;
+            }
+            int ix1 = cellX_(x1), ix2 = cellX_(x2);
+            int iy1 = cellY_(y1), iy2 = cellY_(y2);
+            for(int iy=iy1; iy<=iy2; ++iy)
+            {
+                for(int ix=ix1; ix<=ix2; ++ix)
+                {
+                    int k = iy*nx_+ix;
+                    for(int m=cellStart_[k]; m<cellStart_[k+1]; ++m)
+                    {
+                        int i = items_[m];
+                        if(stamps_[i] != stamp_)
+                        {
+                            stamps_[i] = stamp_;
+                            out.push_back(i);
+                        }
+                    }
+                }
+            }
+            std::sort(out.begin(), out.end());
+        }
+
+    private:
+        int nx_, ny_;
+        double xMin_, xMax_, yMin_, yMax_;
+        double invCellSize_, margin_;
+        std::vector<int> cellStart_;
+        std::vector<int> items_;
+        std::vector<int> fill_;
+        mutable std::vector<unsigned int> stamps_;
+        mutable unsigned int stamp_;
+
+        int cellX_(double x) const { return std::min(nx_-1, std::max(0, (int) std::floor((x - xMin_) * invCellSize_))); }
+        int cellY_(double y) const { return std::min(ny_-1, std::max(0, (int) std::floor((y - yMin_) * invCellSize_))); }
+    };
+
     // Compute unclean intersections.
     // May have duplicates. May miss some if segments nearly parallel.
     // Includes "virtual intersections": when extending the end of the curve by tolerance would create a new intersection.
     // Return value not sorted.
     std::vector<Intersection> intersections(const SculptCurve::Curve<T> & other, double tolerance = 15.0) const
+    {
+        SegmentGrid grid(*this);
+        return intersections(other, tolerance, grid);
+    }
+
+    // Same as above, using a previously built grid of the segments of this curve
+    std::vector<Intersection> intersections(const SculptCurve::Curve<T> & other, double tolerance,
+                                            const SegmentGrid & grid) const
     {
         precomputeArclengths_();
         other.precomputeArclengths_();
@@ -1095,35 +1597,45 @@ public:
         double maxS = 0;
         double minT = lOther;
         double maxT = 0;
-
-        double u, v;
-        for(int i=0; i<n-1; ++i)
+        auto addIntersection = [&](double s, double t)
         {
-            T va = (*this)[i];
-            T vb = (*this)[i+1];
-            for(int j=0; j<nOther-1; ++j)
-            {
-                T vc = other[j];
-                T vd = other[j+1];
+            res.push_back(Intersection(s,t));
+
+            // update min/max
+            if(s<minS)
+                minS = s;
+            if(s>maxS)
+                maxS = s;
+            if(t<minT)
+                minT = t;
+            if(t>maxT)
+                maxT = t;
+        };
+
+        // Coordinates of both curves
+        const double * xs = this->xs();
+        const double * ys = this->ys();
+        const double * xsOther = other.xs();
+        const double * ysOther = other.ys();
+
+        std::vector<int> candidates;
+        for(int j=0; j<nOther-1; ++j)
+        {
+            double cx = xsOther[j], cy = ysOther[j];
+            double dx = xsOther[j+1], dy = ysOther[j+1];
 
-                bool doIntersect = intersects(va, vb, vc, vd, u, v);
-                if(doIntersect)
-                {
-                    double s = (1-u)*arclengths_[i] + u*arclengths_[i+1];
-                    double t = (1-v)*other.arclengths_[j] + v*other.arclengths_[j+1];
-                    res.push_back(Intersection(s,t));
-
-                    // update min/max
-                    if(s<minS)
-                        minS = s;
-                    if(s>maxS)
-                        maxS = s;
-                    if(t<minT)
-                        minT = t;
-                    if(t>maxT)
-                        maxT = t;
-                }
-            }
+            grid.query(std::min(cx, dx), std::min(cy, dy),
+                       std::max(cx, dx), std::max(cy, dy),
+                       candidates);
+            auto batch = intersectionBatch([&](int i, double u, double v)
+            {
+                double s = (1-u)*arclengths_[i] + u*arclengths_[i+1];
+                double t = (1-v)*other.arclengths_[j] + v*other.arclengths_[j+1];
+                addIntersection(s,t);
+            });
+            for(int i: candidates)
+                batch.add(xs[i], ys[i], xs[i+1], ys[i+1], cx, cy, dx, dy, i);
+            batch.flush();
         }
 
         // Compute endpoints intersections
@@ -1132,116 +1644,66 @@ public:
             T va = vertices_.front();
             T ve = (*this)(tolerance);
             T vb = ve.lerp(2.0, va);
-            for(int j=0; j<nOther-1; ++j)
+            auto batch = intersectionBatch([&](int j, double /*u*/, double v)
             {
-                T vc = other[j];
-                T vd = other[j+1];
-
-                bool doIntersect = intersects(va, vb, vc, vd, u, v);
-                if(doIntersect)
-                {
-                    double s = 0;
-                    double t = (1-v)*other.arclengths_[j] + v*other.arclengths_[j+1];
-                    res.push_back(Intersection(s,t));
-
-                    // update min/max
-                    if(s<minS)
-                        minS = s;
-                    if(s>maxS)
-                        maxS = s;
-                    if(t<minT)
-                        minT = t;
-                    if(t>maxT)
-                        maxT = t;
-                }
-            }
+                double s = 0;
+                double t = (1-v)*other.arclengths_[j] + v*other.arclengths_[j+1];
+                addIntersection(s,t);
+            });
+            for(int j=0; j<nOther-1; ++j)
+                batch.add(va.x(), va.y(), vb.x(), vb.y(), xsOther[j], ysOther[j], xsOther[j+1], ysOther[j+1], j);
+            batch.flush();
         }
         if(maxS < l-tolerance && !isClosed_) // end of this
         {
             T va = vertices_.back();
             T ve = (*this)(l-tolerance);
             T vb = ve.lerp(2.0, va);
-            for(int j=0; j<nOther-1; ++j)
+            auto batch = intersectionBatch([&](int j, double /*u*/, double v)
             {
-                T vc = other[j];
-                T vd = other[j+1];
-
-                bool doIntersect = intersects(va, vb, vc, vd, u, v);
-                if(doIntersect)
-                {
-                    double s = l;
-                    double t = (1-v)*other.arclengths_[j] + v*other.arclengths_[j+1];
-                    res.push_back(Intersection(s,t));
-
-                    // update min/max
-                    if(s<minS)
-                        minS = s;
-                    if(s>maxS)
-                        maxS = s;
-                    if(t<minT)
-                        minT = t;
-                    if(t>maxT)
-                        maxT = t;
-                }
-            }
+                double s = l;
+                double t = (1-v)*other.arclengths_[j] + v*other.arclengths_[j+1];
+                addIntersection(s,t);
+            });
+            for(int j=0; j<nOther-1; ++j)
+                batch.add(va.x(), va.y(), vb.x(), vb.y(), xsOther[j], ysOther[j], xsOther[j+1], ysOther[j+1], j);
+            batch.flush();
         }
         if(minT > tolerance && !other.isClosed_) // start of other
         {
             T va = other.vertices_.front();
             T ve = other(tolerance);
             T vb = ve.lerp(2.0, va);
-            for(int i=0; i<n-1; ++i)
+            grid.query(std::min(va.x(), vb.x()), std::min(va.y(), vb.y()),
+                       std::max(va.x(), vb.x()), std::max(va.y(), vb.y()),
+                       candidates);
+            auto batch = intersectionBatch([&](int i, double /*u*/, double v)
             {
-                T vc = vertices_[i];
-                T vd = vertices_[i+1];
-
-                bool doIntersect = intersects(va, vb, vc, vd, u, v);
-                if(doIntersect)
-                {
-                    double t = 0;
-                    double s = (1-v)*arclengths_[i] + v*arclengths_[i+1];
-                    res.push_back(Intersection(s,t));
-
-                    // update min/max
-                    if(s<minS)
-                        minS = s;
-                    if(s>maxS)
-                        maxS = s;
-                    if(t<minT)
-                        minT = t;
-                    if(t>maxT)
-                        maxT = t;
-                }
-            }
+                double t = 0;
+                double s = (1-v)*arclengths_[i] + v*arclengths_[i+1];
+                addIntersection(s,t);
+            });
+            for(int i: candidates)
+                batch.add(va.x(), va.y(), vb.x(), vb.y(), xs[i], ys[i], xs[i+1], ys[i+1], i);
+            batch.flush();
         }
         if(maxS < l-tolerance && !other.isClosed_) // end of this
         {
             T va = other.vertices_.back();
             T ve = other(lOther-tolerance);
             T vb = ve.lerp(2.0, va);
-            for(int i=0; i<n-1; ++i)
+            grid.query(std::min(va.x(), vb.x()), std::min(va.y(), vb.y()),
+                       std::max(va.x(), vb.x()), std::max(va.y(), vb.y()),
+                       candidates);
+            auto batch = intersectionBatch([&](int i, double /*u*/, double v)
             {
-                T vc = vertices_[i];
-                T vd = vertices_[i+1];
-
-                bool doIntersect = intersects(va, vb, vc, vd, u, v);
-                if(doIntersect)
-                {
-                    double t = lOther;
-                    double s = (1-v)*arclengths_[i] + v*arclengths_[i+1];
-                    res.push_back(Intersection(s,t));
-
-                    // update min/max
-                    if(s<minS)
-                        minS = s;
-                    if(s>maxS)
-                        maxS = s;
-                    if(t<minT)
-                        minT = t;
-                    if(t>maxT)
-                        maxT = t;
-                }
-            }
+                double t = lOther;
+                double s = (1-v)*arclengths_[i] + v*arclengths_[i+1];
+                addIntersection(s,t);
+            });
+            for(int i: candidates)
+                batch.add(va.x(), va.y(), vb.x(), vb.y(), xs[i], ys[i], xs[i+1], ys[i+1], i);
+            batch.flush();
         }
 
         return res;
@@ -1267,30 +1729,36 @@ public:
         double minS = l;
         double maxS = 0;
 
-        double u, v;
-        for(int i=0; i<n-3; ++i)
+        // Only test pairs of segments whose bounding boxes are close
+        SegmentGrid grid(*this);
+        std::vector<int> candidates;
+
+        for(int j=2; j<n-1; ++j)
         {
-            T va = (*this)[i];
-            T vb = (*this)[i+1];
-            for(int j=i+2; j<n-1; ++j)
+            T vc = (*this)[j];
+            T vd = (*this)[j+1];
+            grid.query(std::min(vc.x(), vd.x()), std::min(vc.y(), vd.y()),
+                       std::max(vc.x(), vd.x()), std::max(vc.y(), vd.y()),
+                       candidates);
+            auto batch = intersectionBatch([&](int i, double u, double v)
             {
-                T vc = (*this)[j];
-                T vd = (*this)[j+1];
-
-                bool doIntersect = intersects(va, vb, vc, vd, u, v);
-                if(doIntersect)
-                {
-                    double s = (1-u)*arclengths_[i] + u*arclengths_[i+1];
-                    double t = (1-v)*arclengths_[j] + v*arclengths_[j+1];
-                    res.push_back(Intersection(s,t));
-
-                    // update min/max
-                    if(s<minS)
-                        minS = s;
-                    if(t>maxS)
-                        maxS = t;
-                }
+                double s = (1-u)*arclengths_[i] + u*arclengths_[i+1];
+                double t = (1-v)*arclengths_[j] + v*arclengths_[j+1];
+                res.push_back(Intersection(s,t));
+
+                // update min/max
+                if(s<minS)
+                    minS = s;
+                if(t>maxS)
+                    maxS = t;
+            });
+            for(int i: candidates)
+            {
+                if(i > j-2)
+                    break;
+                batch.add((*this)[i], (*this)[i+1], vc, vd, i);
             }
+            batch.flush();
         }
 
         // Compute endpoints intersections
@@ -1299,40 +1767,46 @@ public:
             T va = vertices_.front();
             T ve = (*this)(tolerance);
             T vb = ve.lerp(2.0, va);
-            for(int j=1; j<n-1; ++j)
+            grid.query(std::min(va.x(), vb.x()), std::min(va.y(), vb.y()),
+                       std::max(va.x(), vb.x()), std::max(va.y(), vb.y()),
+                       candidates);
+            auto batch = intersectionBatch([&](int j, double /*u*/, double v)
             {
-                T vc = (*this)[j];
-                T vd = (*this)[j+1];
-
-                bool doIntersect = intersects(va, vb, vc, vd, u, v);
-                if(doIntersect)
-                {
-                    double t = (1-v)*arclengths_[j] + v*arclengths_[j+1];
-                    res.push_back(Intersection(0,t));
-
-                    // update min/max
-                    if(t>maxS)
-                        maxS = t;
-                }
+                double t = (1-v)*arclengths_[j] + v*arclengths_[j+1];
+                res.push_back(Intersection(0,t));
+
+                // update min/max
+                if(t>maxS)
+                    maxS = t;
+            });
+            for(int j: candidates)
+            {
+                if(j < 1)
+                    continue;
+                batch.add(va, vb, (*this)[j], (*this)[j+1], j);
             }
+            batch.flush();
         }
         if(maxS < l-tolerance && !isClosed_) // end
         {
             T va = vertices_.back();
             T ve = (*this)(l-tolerance);
             T vb = ve.lerp(2.0, va);
-            for(int j=0; j<n-3; ++j)
+            grid.query(std::min(va.x(), vb.x()), std::min(va.y(), vb.y()),
+                       std::max(va.x(), vb.x()), std::max(va.y(), vb.y()),
+                       candidates);
+            auto batch = intersectionBatch([&](int j, double /*u*/, double v)
             {
-                T vc = (*this)[j];
-                T vd = (*this)[j+1];
-
-                bool doIntersect = intersects(va, vb, vc, vd, u, v);
-                if(doIntersect)
-                {
-                    double t = (1-v)*arclengths_[j] + v*arclengths_[j+1];
-                    res.push_back(Intersection(t,l));
-                }
+                double t = (1-v)*arclengths_[j] + v*arclengths_[j+1];
+                res.push_back(Intersection(t,l));
+            });
+            for(int j: candidates)
+            {
+                if(j > n-4)
+                    break;
+                batch.add(va, vb, (*this)[j], (*this)[j+1], j);
             }
+            batch.flush();
         }
 
         return res;
@@ -1396,11 +1870,8 @@ public:
         // find first vertex
         // skip all vertices 0, 1, .., i, i+1, i+2, ...., i+k with an arclength strictly less than splitValues.front()
         //cout << "arclengths_[i] to be tested = arclength[" << 0 << "] = " << arclengths_[0] << endl;
-        while(i<n && arclengths_[i] < splitValues.front() /*+ epsilon*/)
-        {
-            i++;
-            //cout << "arclengths_[i] to be tested = arclength[" << i << "] = " << arclengths_[i] << endl;
-        }
+        // Note: arclengths are sorted, so this is a binary search
+        i = std::lower_bound(arclengths_.begin(), arclengths_.begin() + n, splitValues.front() /*+ epsilon*/) - arclengths_.begin();
         //cout << "now, i = " << i << endl;
         // compute first vertex
         if(i == 0)
@@ -1437,6 +1908,7 @@ public:
 
         int splitIndex = 1;
         std::vector< Curve<T>,Eigen::aligned_allocator<Curve<T> >  > res;
+        res.reserve(nSplitValues-1);
         // loop invariant: splitIndex-1 == res.size()
         //cout << "entering loop over split values" << endl;
         while(splitIndex < nSplitValues)
@@ -1554,7 +2026,7 @@ public:
                 curve.setDirtyArclengths_();
 
             // add the curve to the result
-            res.push_back(curve);
+            res.push_back(std::move(curve));
             lastVertexOfLastCurve = res.back().end();
             //cout << "added the new curve to split curve list, its last vertex is: "
             //     << lastVertexOfLastCurve.x() << ","
@@ -1609,7 +2081,34 @@ private:
 
     // Arc-length precomputation
     mutable std::vector<double> arclengths_;
-    mutable bool dirtyArclengths_;
+    mutable int firstDirtyArclength_; // -1 if all arclengths are up to date
+
+    // Coordinates precomputation, see xs()
+    mutable std::vector<double,Eigen::aligned_allocator<double> > xs_;
+    mutable std::vector<double,Eigen::aligned_allocator<double> > ys_;
+    mutable bool dirtyCoordinates_;
+
+    // Bounding box hierarchy over runs of consecutive vertices, see
+    // findClosestVertex(). Stored in preorder, the root being the first
+    // node. Leaves have no children and cover at most HIERARCHY_LEAF_SIZE
+    // vertices. Invalidated together with the coordinates.
+    enum { HIERARCHY_LEAF_SIZE = 8 };
+    struct HierarchyNode
+    {
+        double xMin, xMax, yMin, yMax;
+        int begin, end;   // range of vertices covered
+        int left, right;  // children, or -1 for leaves
+
+        // squared distance from (x,y) to the bounding box
+        double distance2(double x, double y) const
+        {
+            double dx = std::max(0.0, std::max(xMin - x, x - xMax));
+            double dy = std::max(0.0, std::max(yMin - y, y - yMax));
+            return dx*dx + dy*dy;
+        }
+    };
+    mutable std::vector<HierarchyNode> hierarchy_;
+    mutable bool dirtyHierarchy_;
 
     // If treated as a loop
     bool isClosed_;
@@ -1621,6 +2120,7 @@ private:
     {
         arclengths_.push_back(0);
         vertices_.push_back(vertex);
+        setDirtyCoordinates_();
     }
     void pushVertex_(const T & vertex)
     {
@@ -1629,6 +2129,7 @@ private:
         {
             arclengths_.push_back(arclengths_.back() + d);
             vertices_.push_back(vertex);
+            setDirtyCoordinates_();
         }
     }
     T interpolatedVertex_(double s) const // size must be > 1
@@ -1693,19 +2194,27 @@ private:
     std::vector<Input,Eigen::aligned_allocator<Input> > p_;
 
     // fit a smooth curve to a subpart of the raw mouse input
+    //
+    // Fitters are not polymorphic: they are stored by value (see FitRing), and
+    // refitted in place to reuse their memory, so that no allocation occurs
+    // while sketching. A fitter type must derive from Fitter, be default
+    // constructible, and implement fit() and eval() (see below).
     class Fitter
     {
     public:
-        // the fitting computation must be implemented in derived constructors.
+        Fitter() : p_(0), j_(0), N_(0), ds_(0) {}
+
+        // fit() must be implemented in derived classes, calling setRange_()
+        // then computing the fitting:
+        //
+        //   void fit(const std::vector<Input,Eigen::aligned_allocator<Input> > & p, int j, int N, double ds);
         //
         // the N input points from p[j] to p[j+N-1] (guaranteed to exist)
         // is the local part of the curve that should be fit.
         //
-        Fitter(const std::vector<Input,Eigen::aligned_allocator<Input> > & p, int j, int N, double ds) :
-            p_(p), j_(j), N_(N), ds_(ds) {}
-        virtual ~Fitter() {}
-
-        // eval() must be implemented in derived classes
+        // eval() must be implemented in derived classes:
+        //
+        //   Eigen::Vector2d eval(double s) const;
         //
         // the fitting curve C must:
         //    - be a continuous curve parameterized from startS to endS
@@ -1720,34 +2229,37 @@ private:
         //
         // if useful, the method u_(s) can be used to map [startS, endS] to
         // [0,1], if a this parameterization range is easier to handle
-        //
-        virtual Eigen::Vector2d eval(double s) const=0;
 
         // weight that should be use for this curve at this parameter to
         // blend the different overlapping local fits together
-        //
-        // this method can be overriden in derived class if custom blending
-        // weights are desired (but the default ones should be fine)
-        virtual double w(double s) const
+        double w(double s) const
         {
             double u = u_(s);
             return u*u*(1-u)*(1-u);
         }
 
         // convenient inline methods to make code easier to write and read
-        inline Eigen::Vector2d p(int i) const {return Eigen::Vector2d(p_[i].p.x(), p_[i].p.y()) ;}
-        inline double s(int i) const {return p_[i].s;}
+        inline Eigen::Vector2d p(int i) const {return Eigen::Vector2d((*p_)[i].p.x(), (*p_)[i].p.y()) ;}
+        inline double s(int i) const {return (*p_)[i].s;}
         inline double startS() const {return s(j_);}
         inline double endS() const {return s(j_+N_-1);}
         inline Eigen::Vector2d startP() const {return p(j_);}
         inline Eigen::Vector2d endP() const {return p(j_+N_-1);}
 
     protected:
+        void setRange_(const std::vector<Input,Eigen::aligned_allocator<Input> > & p, int j, int N, double ds)
+        {
+            p_ = &p;
+            j_ = j;
+            N_ = N;
+            ds_ = ds;
+        }
+
         // maps [startS, endS] to [0,1]
         double u_(double s) const {return (s-startS())/(endS()-startS());}
 
-        // reference to the whole raw mouse input
-        const std::vector<Input,Eigen::aligned_allocator<Input> > & p_;
+        // the whole raw mouse input
+        const std::vector<Input,Eigen::aligned_allocator<Input> > * p_;
 
         // local range of vertices to fit: the N points p_[j] to p_[j+N-1]
         int j_;
@@ -1757,14 +2269,61 @@ private:
         double ds_;
     };
 
-    // List storing all the local fitting
-    std::vector<Fitter*> fits_;
-    void clearFits_()
+    // Ring buffer of the local fits, indexed by the index j of their first
+    // input point. Only the last few fits are blended together (see phi_()),
+    // so older ones are released and their storage is reused by new ones.
+    // It only grows if more fits than reserved are in use at the same time.
+    template <class F>
+    class FitRing
     {
-        for(Fitter * f : fits_)
-            delete f;
-        fits_.clear();
-    }
+    public:
+        FitRing() : begin_(0), end_(0) {}
+
+        void clear() { begin_ = end_ = 0; }
+        void reserve(int n)
+        {
+            if((int) fits_.size() < n)
+                grow_(n);
+        }
+
+        // Returns the fit with index endIndex(), to be refitted by the caller
+        F & push()
+        {
+            if(end_ - begin_ == (int) fits_.size())
+                grow_(std::max(4, 2 * (int) fits_.size()));
+            return fits_[end_++ % fits_.size()];
+        }
+
+        // Releases all fits with index less than j
+        void releaseBefore(int j)
+        {
+            begin_ = std::min(end_, std::max(begin_, j));
+        }
+
+        const F & operator[](int j) const
+        {
+            assert(j >= begin_ && j < end_);
+            return fits_[j % fits_.size()];
+        }
+
+    private:
+        void grow_(int capacity)
+        {
+            std::vector<F,Eigen::aligned_allocator<F> > fits(capacity);
+            for(int j=begin_; j<end_; ++j)
+                std::swap(fits[j % capacity], fits_[j % fits_.size()]);
+            fits_.swap(fits);
+        }
+
+        std::vector<F,Eigen::aligned_allocator<F> > fits_;
+        int begin_, end_;
+    };
+
+    // Fitting algorithm in use (defined below)
+    class CubicBezierFitter;
+    class QuarticBezierFitter;
+    typedef CubicBezierFitter Fit;
+
 
     // Blend overlapping fitting together
     int lastFittingInvolved_i; // not initialized, but it's ok
@@ -1780,7 +2339,7 @@ private:
         return i;
     }
 
-    T phi_(double s, Fitter * useSingleFit = 0)
+    T phi_(double s, const Fit * useSingleFit = 0)
     {
         // compute pos
         Eigen::Vector2d pos(0,0);
@@ -1795,15 +2354,15 @@ private:
             int endJ = std::min(i,(int)p_.size()-N_);
             if(startJ==endJ)
             {
-                pos = fits_[startJ]->eval(s);
+                pos = fits_[startJ].eval(s);
             }
             else
             {
                 double sumW = 0;
                 for(int j=startJ; j<=endJ; j++)
                 {
-                    double w = fits_[j]->w(s);
-                    Eigen::Vector2d q = fits_[j]->eval(s);
+                    double w = fits_[j].w(s);
+                    Eigen::Vector2d q = fits_[j].eval(s);
                     pos = pos + w * q;
                     sumW += w;
                 }
@@ -1851,9 +2410,16 @@ private:
     class CubicBezierFitter: public Fitter
     {
     public:
-        CubicBezierFitter(const std::vector<Input,Eigen::aligned_allocator<Input> > & p, int j, int N, double ds) :
-            Fitter(p,j,N, ds)
+        CubicBezierFitter() {}
+        CubicBezierFitter(const std::vector<Input,Eigen::aligned_allocator<Input> > & p, int j, int N, double ds)
+        {
+            fit(p, j, N, ds);
+        }
+
+        void fit(const std::vector<Input,Eigen::aligned_allocator<Input> > & p, int j, int N, double ds)
         {
+            this->setRange_(p, j, N, ds);
+            sampling_.clear();
 
             assert(N>=2);
 
@@ -1880,54 +2446,31 @@ private:
             else
             {
 
-                // create linear system
-                Eigen::MatrixXd A(2*(this->N_-2),4);
-                Eigen::VectorXd B(2*(this->N_-2));
-                double Ax = this->startP()[0];
-                double Ay = this->startP()[1];
-                double Dx = this->endP()[0];
-                double Dy = this->endP()[1];
+                // Least-squares fit of P1 and P2. The x and y coordinates share
+                // the same 2x2 normal equations, which are accumulated directly
+                // in fixed-size matrices: rows of R are for P1 and P2, its
+                // columns for x and y.
+                Eigen::Matrix2d M = Eigen::Matrix2d::Zero();
+                Eigen::Matrix2d R = Eigen::Matrix2d::Zero();
                 for(int i=1; i<this->N_-1; i++)
                 {
-                    double Ui = this->u_(this->s(i+this->j_));
-                    double OneMinusUi = 1-Ui;
-                    double Ui2 = Ui*Ui;
-                    double OneMinusUi2 = OneMinusUi*OneMinusUi;
-                    double Ui3 = Ui2*Ui;
-                    double OneMinusUi3 = OneMinusUi2*OneMinusUi;
-                    double ThreeOneMinusUi2Ui = 3 * OneMinusUi2 * Ui;
-                    double ThreeOneMinusUiUi2 = 3 * OneMinusUi * Ui2;
-
-                    int TwoTimesIMinus1 = 2*(i-1);
-                    int TwoTimesIMinus1Plus1 = 2*(i-1)+1;
-
-                    A(TwoTimesIMinus1, 0) = ThreeOneMinusUi2Ui;
-                    A(TwoTimesIMinus1, 1) = 0;
-                    A(TwoTimesIMinus1, 2) = ThreeOneMinusUiUi2;
-                    A(TwoTimesIMinus1, 3) = 0;
-
-                    A(TwoTimesIMinus1Plus1, 0) = 0;
-                    A(TwoTimesIMinus1Plus1, 1) = ThreeOneMinusUi2Ui;
-                    A(TwoTimesIMinus1Plus1, 2) = 0;
-                    A(TwoTimesIMinus1Plus1, 3) = ThreeOneMinusUiUi2;
-
-                    B(TwoTimesIMinus1) = this->p(i+this->j_)[0] - OneMinusUi3 * Ax - Ui3 * Dx;
-                    B(TwoTimesIMinus1Plus1) = this->p(i+this->j_)[1] - OneMinusUi3 * Ay - Ui3 * Dy;
+                    double u = this->u_(this->s(i+this->j_));
+                    double v = 1-u;
+                    Eigen::Vector2d b(3*v*v*u, 3*v*u*u);
+                    Eigen::Vector2d r = this->p(i+this->j_) - (v*v*v) * P0_ - (u*u*u) * P3_;
+                    M.noalias() += b * b.transpose();
+                    R.noalias() += b * r.transpose();
                 }
 
                 // solve it
-                //Eigen::VectorXd X = (A.transpose() * A).inverse() * A.transpose() * B;
-                // For some reason above code breaks with Eigen 3.2, need to split it
-                Eigen::MatrixXd M = (A.transpose() * A).inverse();
-                M *= A.transpose();
-                Eigen::VectorXd X = M * B;
-
-                P1_ = Eigen::Vector2d(X(0),X(1));
-                P2_ = Eigen::Vector2d(X(2),X(3));
+                Eigen::Matrix2d X = M.inverse() * R;
+                P1_ = X.row(0).transpose();
+                P2_ = X.row(1).transpose();
             }
 
             // --- Compute an approximate uniform parameterization ---
 
+            computeCoefficients_();
             for(double u=0; u<1; u+=0.75*this->ds_/der(u).norm())
             {
                 sampling_ << this->pos(u);
@@ -1957,17 +2500,27 @@ private:
         }
 
     private:
-        Eigen::Vector2d pos(double u)
+        // The curve in the power basis, evaluated with Horner's scheme
+        void computeCoefficients_()
+        {
+            C0_ = P0_;
+            C1_ = 3*(P1_-P0_);
+            C2_ = 3*(P0_-2*P1_+P2_);
+            C3_ = P3_-P0_+3*(P1_-P2_);
+        }
+
+        Eigen::Vector2d pos(double u) const
         {
-            return (1-u)*(1-u)*(1-u)*P0_ + 3*(1-u)*(1-u)*u*P1_ + 3*(1-u)*u*u*P2_ + u*u*u*P3_;
+            return ((C3_*u + C2_)*u + C1_)*u + C0_;
         }
 
-        Eigen::Vector2d der(double u)
+        Eigen::Vector2d der(double u) const
         {
-            return 3*( (1-u)*(1-u)*(P1_-P0_) + 2*(1-u)*u*(P2_-P1_) + u*u*(P3_-P2_) );
+            return (3*C3_*u + 2*C2_)*u + C1_;
         }
 
         Eigen::Vector2d P0_, P1_, P2_, P3_;
+        Eigen::Vector2d C0_, C1_, C2_, C3_;
         std::vector<Eigen::Vector2d,Eigen::aligned_allocator<Eigen::Vector2d> > sampling_;
     public:
         EIGEN_MAKE_ALIGNED_OPERATOR_NEW
@@ -1976,9 +2529,17 @@ private:
     class QuarticBezierFitter: public Fitter
     {
     public:
-        QuarticBezierFitter(const std::vector<Input,Eigen::aligned_allocator<Input> > & p, int j, int N, double ds) :
-            Fitter(p,j,N, ds)
+        QuarticBezierFitter() {}
+        QuarticBezierFitter(const std::vector<Input,Eigen::aligned_allocator<Input> > & p, int j, int N, double ds)
         {
+            fit(p, j, N, ds);
+        }
+
+        void fit(const std::vector<Input,Eigen::aligned_allocator<Input> > & p, int j, int N, double ds)
+        {
+            this->setRange_(p, j, N, ds);
+            sampling_.clear();
+
             assert(N>=2);
 
             // --- Fit a quartic (degree four) bezier curve to the input points ---
@@ -1995,58 +2556,42 @@ private:
             }
             else if(N==3)
             {
-                P2_ = p(j+1);
+                P2_ = this->p(j+1);
                 P1_ = 0.5 * (P0_ + P2_);
                 P3_ = 0.5 * (P2_ + P4_);
             }
             else if(N==4)
             {
-                P1_ = p(j+1);
-                P3_ = p(j+2);
+                P1_ = this->p(j+1);
+                P3_ = this->p(j+2);
                 P2_ = 0.5 * (P1_ + P3_);
             }
             else
             {
 
-                // create linear system
-                Eigen::MatrixXd A(2*(this->N_-2),6);
-                Eigen::VectorXd B(2*(this->N_-2));
+                // Least-squares fit of P1, P2 and P3, see CubicBezierFitter
+                Eigen::Matrix3d M = Eigen::Matrix3d::Zero();
+                Eigen::Matrix<double,3,2> R = Eigen::Matrix<double,3,2>::Zero();
                 for(int i=1; i<this->N_-1; i++)
                 {
-                    int TwoTimesIMinus1 = 2*(i-1);
-                    int TwoTimesIMinus1Plus1 = 2*(i-1)+1;
-
-                    double u = u_(s(i+this->j_));
-
-                    A(TwoTimesIMinus1, 0) = 4*(1-u)*(1-u)*(1-u)*u;
-                    A(TwoTimesIMinus1, 1) = 0;
-                    A(TwoTimesIMinus1, 2) = 6*(1-u)*(1-u)*u*u;
-                    A(TwoTimesIMinus1, 3) = 0;
-                    A(TwoTimesIMinus1, 4) = 4*(1-u)*u*u*u;
-                    A(TwoTimesIMinus1, 5) = 0;
-
-                    A(TwoTimesIMinus1Plus1, 0) = 0;
-                    A(TwoTimesIMinus1Plus1, 1) = 4*(1-u)*(1-u)*(1-u)*u;
-                    A(TwoTimesIMinus1Plus1, 2) = 0;
-                    A(TwoTimesIMinus1Plus1, 3) = 6*(1-u)*(1-u)*u*u;
-                    A(TwoTimesIMinus1Plus1, 4) = 0;
-                    A(TwoTimesIMinus1Plus1, 5) = 4*(1-u)*u*u*u;
-
-                    B(TwoTimesIMinus1) = p(i+this->j_)[0] - (1-u)*(1-u)*(1-u)*(1-u) * P0_[0] - u*u*u*u * P4_[0];
-                    B(TwoTimesIMinus1Plus1) = p(i+this->j_)[1] - (1-u)*(1-u)*(1-u)*(1-u) * P0_[1] - u*u*u*u * P4_[1];
+                    double u = this->u_(this->s(i+this->j_));
+                    double v = 1-u;
+                    Eigen::Vector3d b(4*v*v*v*u, 6*v*v*u*u, 4*v*u*u*u);
+                    Eigen::Vector2d r = this->p(i+this->j_) - (v*v*v*v) * P0_ - (u*u*u*u) * P4_;
+                    M.noalias() += b * b.transpose();
+                    R.noalias() += b * r.transpose();
                 }
 
                 // solve it
-                Eigen::MatrixXd M = (A.transpose() * A).inverse();
-                M *= A.transpose();
-                Eigen::VectorXd X = M * B;
-                P1_ = Eigen::Vector2d(X(0),X(1));
-                P2_ = Eigen::Vector2d(X(2),X(3));
-                P3_ = Eigen::Vector2d(X(4),X(5));
+                Eigen::Matrix<double,3,2> X = M.inverse() * R;
+                P1_ = X.row(0).transpose();
+                P2_ = X.row(1).transpose();
+                P3_ = X.row(2).transpose();
             }
 
             // --- Compute an approximate uniform parameterization ---
 
+            computeCoefficients_();
             for(double u=0; u<1; u+=0.75*this->ds_/der(u).norm())
             {
                 sampling_ << this->pos(u);
@@ -2074,17 +2619,28 @@ private:
         }
 
     private:
-        Eigen::Vector2d pos(double u)
+        // The curve in the power basis, evaluated with Horner's scheme
+        void computeCoefficients_()
         {
-            return (1-u)*(1-u)*(1-u)*(1-u)*P0_ + 4*(1-u)*(1-u)*(1-u)*u*P1_ + 6*(1-u)*(1-u)*u*u*P2_ + 4*(1-u)*u*u*u*P3_ + u*u*u*u*P4_;
+            C0_ = P0_;
+            C1_ = 4*(P1_-P0_);
+            C2_ = 6*(P0_-2*P1_+P2_);
+            C3_ = 4*(3*(P1_-P2_)+P3_-P0_);
+            C4_ = P0_-4*P1_+6*P2_-4*P3_+P4_;
         }
-        Eigen::Vector2d der(double u)
+
+        Eigen::Vector2d pos(double u) const
         {
-            return 4*( (1-u)*(1-u)*(1-u)*(P1_-P0_) + 3*(1-u)*(1-u)*u*(P2_-P1_) + 3*(1-u)*u*u*(P3_-P2_) + u*u*u*(P4_-P3_) );
+            return (((C4_*u + C3_)*u + C2_)*u + C1_)*u + C0_;
         }
 
+        Eigen::Vector2d der(double u) const
+        {
+            return ((4*C4_*u + 3*C3_)*u + 2*C2_)*u + C1_;
+        }
 
         Eigen::Vector2d P0_, P1_, P2_, P3_, P4_;
+        Eigen::Vector2d C0_, C1_, C2_, C3_, C4_;
         std::vector<Eigen::Vector2d,Eigen::aligned_allocator<Eigen::Vector2d> > sampling_;
     public:
         EIGEN_MAKE_ALIGNED_OPERATOR_NEW
@@ -2099,40 +2655,109 @@ private:
     };
     FitterType fitterType_;
 
-    // Create a new Fitter object (call the appropriate derived constructor)
-    // It is caller's responsability to call "delete" to free the memory
-    static Fitter * fitter(FitterType /*type*/, const std::vector<Input,Eigen::aligned_allocator<Input> > & p, int j, int N, double ds)
-    {
-        /*
-        switch(type)
-        {
-        case CUBIC_BEZIER_FITTER:
-            return new CubicBezierFitter(p, j, N, ds);
-        case QUARTIC_BEZIER_FITTER:
-            return new QuarticBezierFitter(p, j, N, ds);
-        }
-        */
-        return new CubicBezierFitter(p, j, N, ds);
-    }
+    // Local fits blended together while sketching, and fit of the whole
+    // stroke while it has less than N_ input points. Only Fit is used for now,
+    // whatever fitterType_.
+    FitRing<Fit> fits_;
+    Fit wholeFit_;
 
     // Sampling
     double ds_;
     double lastDs_;
-    void setDirtyArclengths_()   const { dirtyArclengths_ = true; }
+    // Marks the arclengths from the i-th vertex onward as dirty, i.e. after
+    // any of vertices_[i..n-1] has moved, or vertices have been added
+    void setDirtyArclengths_(int i = 0) const
+    {
+        if(firstDirtyArclength_ < 0 || i < firstDirtyArclength_)
+            firstDirtyArclength_ = i;
+        dirtyCoordinates_ = true;
+        dirtyHierarchy_ = true;
+    }
+    void setDirtyCoordinates_()  const { dirtyCoordinates_ = true; dirtyHierarchy_ = true; }
     void precomputeArclengths_() const
     {
-        if(!dirtyArclengths_)
+        if(firstDirtyArclength_ < 0)
             return;
 
         int n = size();
         assert(n>0);
 
+        // Only recompute the prefix sums from the first dirty index onward
+        int begin = std::min(firstDirtyArclength_, (int) arclengths_.size());
         arclengths_.resize(n);
-        arclengths_[0] = 0;
-        for(int i=1; i<n; ++i)
+        if(begin == 0)
+        {
+            arclengths_[0] = 0;
+            begin = 1;
+        }
+        for(int i=begin; i<n; ++i)
             arclengths_[i] = arclengths_[i-1] + vertices_[i-1].distanceTo(vertices_[i]);
 
-        dirtyArclengths_ = false;
+        firstDirtyArclength_ = -1;
+    }
+    void precomputeCoordinates_() const
+    {
+        if(!dirtyCoordinates_)
+            return;
+
+        int n = vertices_.size();
+        xs_.resize(n);
+        ys_.resize(n);
+        for(int i=0; i<n; ++i)
+        {
+            xs_[i] = vertices_[i].x();
+            ys_[i] = vertices_[i].y();
+        }
+
+        dirtyCoordinates_ = false;
+    }
+    void precomputeHierarchy_() const
+    {
+        if(!dirtyHierarchy_)
+            return;
+
+        precomputeCoordinates_();
+        hierarchy_.clear();
+        int n = vertices_.size();
+        if(n > 0)
+            buildHierarchy_(0, n);
+
+        dirtyHierarchy_ = false;
+    }
+    int buildHierarchy_(int begin, int end) const // returns index of created node
+    {
+        int k = hierarchy_.size();
+        hierarchy_.push_back(HierarchyNode());
+        HierarchyNode node;
+        node.begin = begin;
+        node.end = end;
+        if(end - begin <= HIERARCHY_LEAF_SIZE)
+        {
+            node.left = node.right = -1;
+            node.xMin = node.xMax = xs_[begin];
+            node.yMin = node.yMax = ys_[begin];
+            for(int i=begin+1; i<end; ++i)
+            {
+                node.xMin = std::min(node.xMin, xs_[i]);
+                node.xMax = std::max(node.xMax, xs_[i]);
+                node.yMin = std::min(node.yMin, ys_[i]);
+                node.yMax = std::max(node.yMax, ys_[i]);
+            }
+        }
+        else
+        {
+            int mid = (begin + end) / 2;
+            node.left = buildHierarchy_(begin, mid);
+            node.right = buildHierarchy_(mid, end);
+            const HierarchyNode & l = hierarchy_[node.left];
+            const HierarchyNode & r = hierarchy_[node.right];
+            node.xMin = std::min(l.xMin, r.xMin);
+            node.xMax = std::max(l.xMax, r.xMax);
+            node.yMin = std::min(l.yMin, r.yMin);
+            node.yMax = std::max(l.yMax, r.yMax);
+        }
+        hierarchy_[k] = node;
+        return k;
     }
 public:
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
@@ -0,0 +1,122 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#include "SelectionClosure.h"
+#include "Cell.h"
+#include "KeyVertex.h"
+#include "KeyEdge.h"
+
+namespace VectorAnimationComplex
+{
+
+SelectionClosure::SelectionClosure() :
+    isBuilt_(false),
+    topologyVersion_(0)
+{
+}
+
+void SelectionClosure::clear()
+{
+    cells_.clear();
+    keyVertices_.clear();
+    keyEdges_.clear();
+    entries_.clear();
+    isBuilt_ = false;
+}
+
+bool SelectionClosure::isUpToDate_() const
+{
+    return isBuilt_ && topologyVersion_ == Cell::topologyVersion();
+}
+
+void SelectionClosure::addSelectedCell(Cell * cell)
+{
+    // If out of date, the closure is rebuilt anyway on next access
+    if(!isUpToDate_())
+        return;
+
+    add_(cell);
+    foreach(Cell * b, cell->boundary())
+        add_(b);
+}
+
+void SelectionClosure::removeSelectedCell(Cell * cell)
+{
+    if(!isUpToDate_())
+        return;
+
+    remove_(cell);
+    foreach(Cell * b, cell->boundary())
+        remove_(b);
+}
+
+void SelectionClosure::add_(Cell * cell)
+{
+    QHash<Cell*, Entry>::iterator it = entries_.find(cell);
+    if(it != entries_.end())
+    {
+        ++it.value().count;
+        return;
+    }
+
+    Entry entry = { 1, cell->toKeyVertex(), cell->toKeyEdge() };
+    entries_.insert(cell, entry);
+    cells_ << cell;
+    if(entry.keyVertex)
+        keyVertices_ << entry.keyVertex;
+    if(entry.keyEdge)
+        keyEdges_ << entry.keyEdge;
+}
+
+void SelectionClosure::remove_(Cell * cell)
+{
+    // Note: the cell is not dereferenced, since boundary cells may already be
+    // deleted when a selected cell is removed from the VAC
+    QHash<Cell*, Entry>::iterator it = entries_.find(cell);
+    if(it == entries_.end() || --it.value().count > 0)
+        return;
+
+    cells_.remove(cell);
+    if(it.value().keyVertex)
+        keyVertices_.remove(it.value().keyVertex);
+    if(it.value().keyEdge)
+        keyEdges_.remove(it.value().keyEdge);
+    entries_.erase(it);
+}
+
+void SelectionClosure::update_(const CellSet & selectedCells)
+{
+    if(isUpToDate_())
+        return;
+
+    clear();
+    isBuilt_ = true;
+    topologyVersion_ = Cell::topologyVersion();
+    foreach(Cell * c, selectedCells)
+        addSelectedCell(c);
+}
+
+const CellSet & SelectionClosure::cells(const CellSet & selectedCells)
+{
+    update_(selectedCells);
+    return cells_;
+}
+
+const KeyVertexSet & SelectionClosure::keyVertices(const CellSet & selectedCells)
+{
+    update_(selectedCells);
+    return keyVertices_;
+}
+
+const KeyEdgeSet & SelectionClosure::keyEdges(const CellSet & selectedCells)
+{
+    update_(selectedCells);
+    return keyEdges_;
+}
+
+}
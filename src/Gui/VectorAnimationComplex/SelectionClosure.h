@@ -0,0 +1,73 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+
+#ifndef VAC_SELECTION_CLOSURE_H
+#define VAC_SELECTION_CLOSURE_H
+
+// SelectionClosure: the closure of the selected cells, i.e. the selected
+// cells and their boundaries, already partitioned into key vertices and key
+// edges, so that starting a drag and drop or a transform of a large
+// selection doesn't have to compute it. It is updated incrementally as cells
+// are added to or removed from the selection, by counting for each cell of
+// the closure how many selected cells have it in their closure. Since the
+// boundary of a cell may change without changing the selection, it is
+// entirely rebuilt, lazily, after the star of any cell changes (see
+// Cell::topologyVersion()).
+
+#include "CellList.h"
+
+#include <QHash>
+
+namespace VectorAnimationComplex
+{
+
+class SelectionClosure
+{
+public:
+    SelectionClosure();
+
+    // Forget everything. The closure is rebuilt on next access
+    void clear();
+
+    // To be called after a cell is added to or removed from the selection
+    void addSelectedCell(Cell * cell);
+    void removeSelectedCell(Cell * cell);
+
+    // Closure of the given selection, which must be the one reported by
+    // addSelectedCell() and removeSelectedCell() since the last clear()
+    const CellSet & cells(const CellSet & selectedCells);
+    const KeyVertexSet & keyVertices(const CellSet & selectedCells);
+    const KeyEdgeSet & keyEdges(const CellSet & selectedCells);
+
+private:
+    CellSet cells_;
+    KeyVertexSet keyVertices_;
+    KeyEdgeSet keyEdges_;
+
+    // For each cell of the closure, how many selected cells have it in their
+    // closure, and the cell as a key vertex or key edge, if it is one
+    struct Entry
+    {
+        int count;
+        KeyVertex * keyVertex;
+        KeyEdge * keyEdge;
+    };
+    QHash<Cell*, Entry> entries_;
+    bool isBuilt_;
+    unsigned int topologyVersion_;
+
+    bool isUpToDate_() const;
+    void update_(const CellSet & selectedCells);
+    void add_(Cell * cell);
+    void remove_(Cell * cell);
+};
+
+}
+
+#endif // VAC_SELECTION_CLOSURE_H
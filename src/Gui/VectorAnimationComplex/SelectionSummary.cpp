@@ -0,0 +1,191 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#include "SelectionSummary.h"
+#include "Cell.h"
+#include "KeyCell.h"
+#include "InbetweenCell.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace VectorAnimationComplex
+{
+
+namespace
+{
+
+void erase_(std::multiset<double> & set, double value)
+{
+    std::multiset<double>::iterator it = set.find(value);
+    if(it != set.end())
+        set.erase(it);
+}
+
+SelectionSummary::CellType cellType_(Cell * cell)
+{
+    if(cell->toKeyVertex())            return SelectionSummary::KeyVertexType;
+    else if(cell->toKeyEdge())         return SelectionSummary::KeyEdgeType;
+    else if(cell->toKeyFace())         return SelectionSummary::KeyFaceType;
+    else if(cell->toInbetweenVertex()) return SelectionSummary::InbetweenVertexType;
+    else if(cell->toInbetweenEdge())   return SelectionSummary::InbetweenEdgeType;
+    else                               return SelectionSummary::InbetweenFaceType;
+}
+
+}
+
+SelectionSummary::SelectionSummary() :
+    isBuilt_(false),
+    topologyVersion_(0)
+{
+    clear();
+}
+
+void SelectionSummary::clear()
+{
+    entries_.clear();
+    std::fill(numCells_, numCells_ + NumCellTypes, 0);
+    keyTimes_.clear();
+    keyT1_.clear();
+    keyT2_.clear();
+    inbetweenLifespans_.clear();
+    isBuilt_ = false;
+}
+
+bool SelectionSummary::isUpToDate_() const
+{
+    return isBuilt_ && topologyVersion_ == Cell::topologyVersion();
+}
+
+void SelectionSummary::addSelectedCell(Cell * cell)
+{
+    // If out of date, the summary is rebuilt anyway on next access
+    if(!isUpToDate_() || entries_.contains(cell))
+        return;
+
+    Entry entry;
+    entry.type = cellType_(cell);
+    KeyCell * keyCell = cell->toKeyCell();
+    InbetweenCell * inbetweenCell = cell->toInbetweenCell();
+    if(keyCell)
+    {
+        entry.t = keyCell->time().floatTime();
+        entry.t1 = std::numeric_limits<double>::lowest();
+        entry.t2 = std::numeric_limits<double>::max();
+        foreach(InbetweenCell * scell, keyCell->temporalStarBefore())
+            entry.t1 = std::max(scell->beforeTime().floatTime(), entry.t1);
+        foreach(InbetweenCell * scell, keyCell->temporalStarAfter())
+            entry.t2 = std::min(scell->afterTime().floatTime(), entry.t2);
+
+        keyTimes_.insert(entry.t);
+        keyT1_.insert(entry.t1);
+        keyT2_.insert(entry.t2);
+    }
+    else if(inbetweenCell)
+    {
+        entry.t1 = entry.t = inbetweenCell->beforeTime().floatTime();
+        entry.t2 = inbetweenCell->afterTime().floatTime();
+        inbetweenLifespans_.insert(std::make_pair(entry.t1, entry.t2));
+    }
+
+    ++numCells_[entry.type];
+    entries_.insert(cell, entry);
+}
+
+void SelectionSummary::removeSelectedCell(Cell * cell)
+{
+    if(!isUpToDate_())
+        return;
+
+    QHash<Cell*, Entry>::iterator it = entries_.find(cell);
+    if(it == entries_.end())
+        return;
+
+    const Entry & entry = it.value();
+    if(entry.type <= KeyFaceType)
+    {
+        erase_(keyTimes_, entry.t);
+        erase_(keyT1_, entry.t1);
+        erase_(keyT2_, entry.t2);
+    }
+    else
+    {
+        std::multiset<std::pair<double, double> >::iterator lifespan =
+                inbetweenLifespans_.find(std::make_pair(entry.t1, entry.t2));
+        if(lifespan != inbetweenLifespans_.end())
+            inbetweenLifespans_.erase(lifespan);
+    }
+
+    --numCells_[entry.type];
+    entries_.erase(it);
+}
+
+void SelectionSummary::update_(const CellSet & selectedCells)
+{
+    if(isUpToDate_())
+        return;
+
+    clear();
+    isBuilt_ = true;
+    topologyVersion_ = Cell::topologyVersion();
+    foreach(Cell * c, selectedCells)
+        addSelectedCell(c);
+}
+
+int SelectionSummary::numCells(CellType type, const CellSet & selectedCells)
+{
+    update_(selectedCells);
+    return numCells_[type];
+}
+
+SelectionSummary::TimelineInfo SelectionSummary::timelineInfo(const CellSet & selectedCells)
+{
+    update_(selectedCells);
+
+    TimelineInfo res = { 0, 0, 0, 0 };
+    if(!keyTimes_.empty())
+    {
+        res.selectionType = 1;
+        res.t = *keyTimes_.begin();
+        res.t1 = *keyT1_.rbegin();
+        res.t2 = *keyT2_.begin();
+        if(res.t1 == std::numeric_limits<double>::lowest())
+            res.t1 = res.t;
+        if(res.t2 == std::numeric_limits<double>::max())
+            res.t2 = res.t;
+    }
+    else if(!inbetweenLifespans_.empty())
+    {
+        res.selectionType = 2;
+        res.t1 = inbetweenLifespans_.begin()->first;
+        res.t2 = inbetweenLifespans_.begin()->second;
+    }
+    return res;
+}
+
+QVector<double> SelectionSummary::keyTimes(const CellSet & selectedCells)
+{
+    update_(selectedCells);
+
+    QVector<double> res;
+    for(auto it = keyTimes_.begin(); it != keyTimes_.end(); it = keyTimes_.upper_bound(*it))
+        res << *it;
+    return res;
+}
+
+QVector< QPair<double, double> > SelectionSummary::inbetweenLifespans(const CellSet & selectedCells)
+{
+    update_(selectedCells);
+
+    QVector< QPair<double, double> > res;
+    for(auto it = inbetweenLifespans_.begin(); it != inbetweenLifespans_.end(); it = inbetweenLifespans_.upper_bound(*it))
+        res << qMakePair(it->first, it->second);
+    return res;
+}
+
+}
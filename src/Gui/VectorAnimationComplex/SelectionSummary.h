@@ -0,0 +1,108 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+
+#ifndef VAC_SELECTION_SUMMARY_H
+#define VAC_SELECTION_SUMMARY_H
+
+// SelectionSummary: aggregates over the selected cells, used by the timeline
+// and the selection info widget: the number of selected cells of each type,
+// and the times of the selected cells and of their temporal neighbours.
+//
+// Like SelectionClosure, it is updated incrementally as cells are added to
+// or removed from the selection, so that shift-clicking in a large selection
+// doesn't iterate over the whole selection. What each selected cell
+// contributes is stored, so that removing a cell doesn't need to access it
+// again. Since the times and temporal stars of cells may change without
+// changing the selection, it is entirely rebuilt, lazily, after the star of
+// any cell or the time of any key cell changes (see Cell::topologyVersion()).
+
+#include "CellList.h"
+
+#include <QHash>
+#include <QPair>
+#include <QVector>
+#include <set>
+#include <utility>
+
+namespace VectorAnimationComplex
+{
+
+class SelectionSummary
+{
+public:
+    SelectionSummary();
+
+    // Forget everything. The summary is rebuilt on next access
+    void clear();
+
+    // To be called after a cell is added to or removed from the selection
+    void addSelectedCell(Cell * cell);
+    void removeSelectedCell(Cell * cell);
+
+    // Number of selected cells of each type. The given selection must be the
+    // one reported by addSelectedCell() and removeSelectedCell() since the
+    // last clear()
+    enum CellType
+    {
+        KeyVertexType,
+        KeyEdgeType,
+        KeyFaceType,
+        InbetweenVertexType,
+        InbetweenEdgeType,
+        InbetweenFaceType,
+        NumCellTypes
+    };
+    int numCells(CellType type, const CellSet & selectedCells);
+
+    // What the timeline shows of the selection:
+    //  - 0: no selection
+    //  - 1: key cells are selected. t is the time of the earliest one, and
+    //       [t1, t2] the range over which they can be moved in time without
+    //       crossing the inbetween cells they are attached to
+    //  - 2: only inbetween cells are selected. [t1, t2] is the lifespan
+    //       of the one starting first
+    struct TimelineInfo
+    {
+        int selectionType;
+        double t, t1, t2;
+    };
+    TimelineInfo timelineInfo(const CellSet & selectedCells);
+
+    // Times of the selected key cells, and lifespans of the selected
+    // inbetween cells, sorted, without duplicates
+    QVector<double> keyTimes(const CellSet & selectedCells);
+    QVector< QPair<double, double> > inbetweenLifespans(const CellSet & selectedCells);
+
+private:
+    // What a selected cell contributes
+    struct Entry
+    {
+        CellType type;
+        // For key cells: time, latest before time and earliest after time of
+        // their temporal star (or +/- infinity). For inbetween cells: before
+        // time, before time, and after time
+        double t, t1, t2;
+    };
+    QHash<Cell*, Entry> entries_;
+    int numCells_[NumCellTypes];
+    std::multiset<double> keyTimes_;
+    std::multiset<double> keyT1_;
+    std::multiset<double> keyT2_;
+    std::multiset<std::pair<double, double> > inbetweenLifespans_;
+
+    bool isBuilt_;
+    unsigned int topologyVersion_;
+
+    bool isUpToDate_() const;
+    void update_(const CellSet & selectedCells);
+};
+
+}
+
+#endif // VAC_SELECTION_SUMMARY_H
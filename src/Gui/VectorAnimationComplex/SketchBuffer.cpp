@@ -0,0 +1,198 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#include "SketchBuffer.h"
+#include "../GLUtils.h"
+#include "../RenderStats.h"
+
+#include <QOpenGLContext>
+#include <algorithm>
+
+namespace VectorAnimationComplex
+{
+
+namespace
+{
+
+// Initial capacity of the GPU buffers, in samples
+const int MIN_CAPACITY = 1024;
+
+// Normal of the segment (x1,y1) -> (x2,y2)
+Eigen::Vector2d normal(double x1, double y1, double x2, double y2)
+{
+    Eigen::Vector2d v(x2-x1, y2-y1);
+    v.normalize();
+    return Eigen::Vector2d(-v[1],v[0]);
+}
+
+// Uploads data[first, size) to the buffer, reallocating it and uploading
+// everything if it is too small
+void uploadRange(GLuint & id, int & capacity, const std::vector<GLfloat> & data, int first)
+{
+    const int size = data.size();
+    if(!id)
+    {
+        glGenBuffers(1, &id);
+        capacity = 0;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, id);
+    if(size > capacity)
+    {
+        capacity = std::max(2 * capacity, std::max(size, MIN_CAPACITY));
+        glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(GLfloat), 0, GL_DYNAMIC_DRAW);
+        first = 0;
+    }
+    if(first < size)
+        glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(GLfloat),
+                        (size - first) * sizeof(GLfloat), data.data() + first);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+}
+
+SketchBuffer::SketchBuffer() :
+    numSamples_(0),
+    numFinalSamples_(0),
+    group_(0),
+    firstDirty_(0)
+{
+    strokeBuffer_.id = 0;
+    strokeBuffer_.capacity = 0;
+    centerlineBuffer_.id = 0;
+    centerlineBuffer_.capacity = 0;
+}
+
+SketchBuffer::~SketchBuffer()
+{
+    deleteBuffers_();
+}
+
+void SketchBuffer::deleteBuffers_()
+{
+    GLUtils::deleteBuffer(strokeBuffer_.id, group_);
+    GLUtils::deleteBuffer(centerlineBuffer_.id, group_);
+    strokeBuffer_.id = 0;
+    strokeBuffer_.capacity = 0;
+    centerlineBuffer_.id = 0;
+    centerlineBuffer_.capacity = 0;
+    group_ = 0;
+}
+
+void SketchBuffer::clear()
+{
+    // The GPU buffers are kept for the next curve
+    stroke_.clear();
+    centerline_.clear();
+    numSamples_ = 0;
+    numFinalSamples_ = 0;
+    firstDirty_ = 0;
+}
+
+void SketchBuffer::update(const SculptCurve::Curve<EdgeSample> & curve)
+{
+    const int n = curve.size();
+    const int numFinal = curve.numFinalVertices();
+    if(numFinal < numFinalSamples_ || n < numFinalSamples_)
+        clear();
+
+    // Samples are not only appended to once sketching ends (resampling,
+    // snapping): detected by the last final sample having moved
+    if(numFinalSamples_ > 0)
+    {
+        const EdgeSample last = curve[numFinalSamples_-1];
+        if(last.x() != centerline_[2*numFinalSamples_-2] ||
+           last.y() != centerline_[2*numFinalSamples_-1])
+        {
+            clear();
+        }
+    }
+
+    // The quad of sample i depends on samples i-1 and i, and the one of
+    // sample 0 on sample 1: recompute from the first sample which was
+    // temporary, or from the start if sample 1 was
+    int first = numFinalSamples_ >= 2 ? numFinalSamples_ : 0;
+    stroke_.resize(4 * first);
+    centerline_.resize(2 * first);
+    for(int i=first; i<n; ++i)
+    {
+        const EdgeSample p = curve[i];
+        if(n >= 2)
+        {
+            const EdgeSample q = i == 0 ? curve[1] : curve[i-1];
+            Eigen::Vector2d u = i == 0 ? normal(p.x(), p.y(), q.x(), q.y()) :
+                                         normal(q.x(), q.y(), p.x(), p.y());
+            Eigen::Vector2d c(p.x(), p.y());
+            Eigen::Vector2d a = c + p.width() * 0.5 * u;
+            Eigen::Vector2d b = c - p.width() * 0.5 * u;
+            stroke_.push_back(a[0]); stroke_.push_back(a[1]);
+            stroke_.push_back(b[0]); stroke_.push_back(b[1]);
+        }
+        centerline_.push_back(p.x());
+        centerline_.push_back(p.y());
+    }
+
+    numSamples_ = n;
+    numFinalSamples_ = numFinal;
+    firstDirty_ = std::min(firstDirty_, first);
+}
+
+// Uploads the vertices changed since the last upload. Returns false if the
+// buffers can't be used in the current context
+bool SketchBuffer::upload_() const
+{
+    if(!GLEW_VERSION_1_5)
+        return false;
+
+    QOpenGLContextGroup * group = QOpenGLContextGroup::currentContextGroup();
+    if(!group)
+        return false;
+    if(group_ && group_ != group)
+        return false;
+    group_ = group;
+
+    GLUtils::deleteOrphanedBuffers();
+    uploadRange(strokeBuffer_.id, strokeBuffer_.capacity, stroke_, 4 * firstDirty_);
+    uploadRange(centerlineBuffer_.id, centerlineBuffer_.capacity, centerline_, 2 * firstDirty_);
+    firstDirty_ = numSamples_;
+    return true;
+}
+
+bool SketchBuffer::drawStroke() const
+{
+    if(numSamples_ < 2)
+        return true;
+    if(!upload_())
+        return false;
+
+    glBindBuffer(GL_ARRAY_BUFFER, strokeBuffer_.id);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(2, GL_FLOAT, 0, 0);
+    glDrawArrays(GL_QUAD_STRIP, 0, 2 * numSamples_);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    RenderStats::add(RenderStats::TrianglesSubmitted, 2 * numSamples_ - 2);
+    return true;
+}
+
+bool SketchBuffer::drawCenterline() const
+{
+    if(numSamples_ < 2)
+        return true;
+    if(!upload_())
+        return false;
+
+    glBindBuffer(GL_ARRAY_BUFFER, centerlineBuffer_.id);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(2, GL_FLOAT, 0, 0);
+    glDrawArrays(GL_LINE_STRIP, 0, numSamples_);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return true;
+}
+
+}
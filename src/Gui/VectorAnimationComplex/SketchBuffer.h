@@ -0,0 +1,83 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#ifndef VAC_SKETCH_BUFFER_H
+#define VAC_SKETCH_BUFFER_H
+
+// SketchBuffer: GPU buffers of the edge being sketched (see
+// VAC::drawSketchedEdge()), updated incrementally as it grows.
+//
+// While sketching, the samples of the curve are only appended to, except for
+// its last few, temporary samples (see SculptCurve::Curve::numFinalVertices()).
+// update() therefore only recomputes the vertices of the samples from the
+// first temporary one of the previous update, and draw*() only uploads
+// these, so that the cost per input event does not depend on the length of
+// the stroke. Storage grows geometrically, uploading everything again when
+// it does.
+//
+// Vertices are the same as the immediate mode drawing they replace: a quad
+// strip offsetting each sample half its width along the normal of the
+// segment before it, and the line strip of the samples in outline mode.
+// Like StrokeBuffer, the buffers are only valid in the share group in which
+// they have been created: draw*() return false without drawing anything in
+// another group, or if vertex buffers are not supported.
+
+#include "EdgeSample.h"
+#include "SculptCurve.h"
+#include "../OpenGL.h"
+
+#include <vector>
+
+class QOpenGLContextGroup;
+
+namespace VectorAnimationComplex
+{
+
+class SketchBuffer
+{
+public:
+    SketchBuffer();
+    ~SketchBuffer();
+
+    // Update from the curve being sketched. Must be cleared before a new
+    // curve is sketched.
+    void update(const SculptCurve::Curve<EdgeSample> & curve);
+    void clear();
+
+    // Draw with the current color, without caps
+    bool drawStroke() const;
+    bool drawCenterline() const;
+
+private:
+    SketchBuffer(const SketchBuffer &);
+    SketchBuffer & operator=(const SketchBuffer &);
+
+    // Vertices, in CPU memory, and the number of samples which were final at
+    // the last update
+    std::vector<GLfloat> stroke_;     // 4 floats per sample
+    std::vector<GLfloat> centerline_; // 2 floats per sample
+    int numSamples_;
+    int numFinalSamples_;
+
+    // GPU buffers. The vertices of samples from firstDirty_ are not uploaded
+    struct GpuBuffer
+    {
+        GLuint id;
+        int capacity; // in floats
+    };
+    mutable GpuBuffer strokeBuffer_;
+    mutable GpuBuffer centerlineBuffer_;
+    mutable QOpenGLContextGroup * group_;
+    mutable int firstDirty_;
+    bool upload_() const;
+    void deleteBuffers_();
+};
+
+}
+
+#endif // VAC_SKETCH_BUFFER_H
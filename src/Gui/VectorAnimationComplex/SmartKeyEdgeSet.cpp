@@ -7,8 +7,7 @@
 // directory of this distribution and at http://opensource.org/licenses/MIT
 
 #include "SmartKeyEdgeSet.h"
-
-#include <QStack>
+#include "Algorithms.h"
 
 namespace VectorAnimationComplex
 {
@@ -18,13 +17,25 @@ namespace VectorAnimationComplex
 
 SmartConnectedKeyEdgeSet::SmartConnectedKeyEdgeSet(const KeyEdgeSet & edgeSet):
     edgeSet_(edgeSet),
-    path_(edgeSet),
-    loop_(edgeSet),
-    hole_(edgeSet)
+    isPathComputed_(false),
+    isLoopComputed_(false),
+    isHoleComputed_(false),
+    isTypeComputed_(false),
+    type_(EMPTY)
 {
 }
 
 SmartConnectedKeyEdgeSet::EdgeSetType SmartConnectedKeyEdgeSet::type() const
+{
+    if(!isTypeComputed_)
+    {
+        type_ = computeType_();
+        isTypeComputed_ = true;
+    }
+    return type_;
+}
+
+SmartConnectedKeyEdgeSet::EdgeSetType SmartConnectedKeyEdgeSet::computeType_() const
 {
     KeyEdge * singleEdge = edge();
 
@@ -47,15 +58,15 @@ SmartConnectedKeyEdgeSet::EdgeSetType SmartConnectedKeyEdgeSet::type() const
             return OPEN_EDGE_PATH;
         }
     }
-    else if(path_.isValid())
+    else if(path().isValid())
     {
         return SIMPLE_PATH;
     }
-    else if(loop_.isValid())
+    else if(loop().isValid())
     {
         return SIMPLE_LOOP;
     }
-    else if(hole_.isValid())
+    else if(hole().isValid())
     {
         return PATH_LOOP_DECOMPOSITION;
     }
@@ -79,16 +90,31 @@ KeyEdge * SmartConnectedKeyEdgeSet::edge() const
 
 ProperPath SmartConnectedKeyEdgeSet::path() const
 {
+    if(!isPathComputed_)
+    {
+        path_ = ProperPath(edgeSet_);
+        isPathComputed_ = true;
+    }
     return path_;
 }
 
 ProperCycle SmartConnectedKeyEdgeSet::loop() const
 {
+    if(!isLoopComputed_)
+    {
+        loop_ = ProperCycle(edgeSet_);
+        isLoopComputed_ = true;
+    }
     return loop_;
 }
 
 CycleHelper SmartConnectedKeyEdgeSet::hole() const
 {
+    if(!isHoleComputed_)
+    {
+        hole_ = CycleHelper(edgeSet_);
+        isHoleComputed_ = true;
+    }
     return hole_;
 }
 
@@ -107,146 +133,19 @@ SmartKeyEdgeSet::SmartKeyEdgeSet(const KeyEdgeSet & edgeSetConst) :
 {
     // ----- Compute connected components -----
 
-    // This variable store the edges that have not yet been assigned a connected component
-    KeyEdgeSet remainingEdges = edgeSet_;
-
-
-    // ===== First, each closed edge is its own connected component =====
-
-    KeyEdgeSet remainingEdgesCopy = remainingEdges;
-    foreach(KeyEdge * iedge, remainingEdgesCopy)
-    {
-        if(iedge->isClosed())
-        {
-            remainingEdges.remove(iedge);
-            KeyEdgeSet connectedEdges;
-            connectedEdges << iedge;
-            connectedComponents_ << SmartConnectedKeyEdgeSet(connectedEdges);
-        }
-    }
-
-
-    // ===== Define the 1-subcomplex made of the remaining vertices and open edges =====
-
-    // Data structure for cells of the original complex
-    typedef KeyVertex Vertex;
-    typedef KeyEdge Edge;
-
-    // Data structure for cells of the subcomplex
-    struct SubVertex;
-    struct SubEdge
-    {
-        SubEdge(Edge * edge) : edge(edge), leftSubVertex(0), rightSubVertex(0), marked(false) {}
-
-        // Edge from SubEdge
-        Edge * edge;
-
-        // Boundary SubVertices
-        SubVertex * leftSubVertex;
-        SubVertex * rightSubVertex;
-
-        // Has the edge already been visited
-        bool marked;
-    };
-    struct SubVertex
+    // Each closed edge is its own connected component. They are listed
+    // first, followed by the connected components of open edges
+    QList<KeyEdgeSet> components = Algorithms::connectedComponents(edgeSet_);
+    QList<KeyEdgeSet> openComponents;
+    foreach(const KeyEdgeSet & component, components)
     {
-        SubVertex(Vertex * vertex) : vertex(vertex), subEdges() {}
-
-        // Vertex from SubVertex
-        Vertex * vertex;
-
-        // Star SubEdges
-        QSet<SubEdge*> subEdges;
-    };
-
-    // Populate subcomplex
-    QSet<SubEdge*> subEdges;
-    QSet<SubVertex*> subVertices;
-    QMap<Vertex*, SubVertex*> vertexToSubVertex;
-    QMap<Edge*, SubEdge*> edgeToSubEdge;
-    foreach(Edge * edge, remainingEdges)
-    {
-        // create new subcomplex edge
-        SubEdge * subEdge = new SubEdge(edge);
-        subEdges << subEdge;
-        edgeToSubEdge[edge] = subEdge;
-
-        // assign its left subcomplex vertex (create it if doesn't exist yet)
-        Vertex * startVertex = edge->startVertex(); // not NULL because edge is open
-        SubVertex * leftSubVertex = vertexToSubVertex.value(startVertex, 0); // returns 0 if not found
-        if(!leftSubVertex)
-        {
-            leftSubVertex = new SubVertex(startVertex);
-            subVertices << leftSubVertex;
-            vertexToSubVertex[startVertex] = leftSubVertex;
-        }
-        subEdge->leftSubVertex = leftSubVertex;
-        leftSubVertex->subEdges << subEdge;
-
-        // assign its right subcomplex vertex (create it if doesn't exist yet)
-        Vertex * endVertex = edge->endVertex(); // we know it's not null since we rejected pure loops
-        SubVertex * rightSubVertex = vertexToSubVertex.value(endVertex, 0); // returns 0 if not found
-        if(!rightSubVertex)
-        {
-            rightSubVertex = new SubVertex(endVertex);
-            subVertices << rightSubVertex;
-            vertexToSubVertex[endVertex] = rightSubVertex;
-        }
-        subEdge->rightSubVertex = rightSubVertex;
-        rightSubVertex->subEdges << subEdge;
-    }
-
-    // ===== Compute connected components of subcomplex =====
-
-    while(!remainingEdges.isEmpty())
-    {
-        // New connected component
-        KeyEdgeSet connectedEdges;
-
-        // get the first edge/subEdge of a new connected component
-        Edge * firstEdge = *remainingEdges.begin();
-        SubEdge * firstSubEdge =    edgeToSubEdge[firstEdge];
-
-        // get all subEdges/edges connected to this sub/edge/edge
-        QStack<SubEdge *> toProcess;
-        toProcess.push(firstSubEdge);
-        while(!toProcess.isEmpty())
-        {
-            SubEdge * subEdge = toProcess.top();
-            toProcess.pop();
-
-            // marked means:
-            //  - it has already been removed from remainingEdges
-            //  - it has already been added to connectedEdges
-            //  - all its neighbours have already been inserted in toProcess (possibly twice)
-
-            if(!subEdge->marked)
-            {
-                // Mark and remove
-                remainingEdges.remove(subEdge->edge);
-                connectedEdges.insert(subEdge->edge);
-                subEdge->marked = true;
-
-                // Insert neighbours in stack
-                foreach(SubEdge * neighbour, subEdge->leftSubVertex->subEdges)
-                    toProcess.push(neighbour);
-                foreach(SubEdge * neighbour, subEdge->rightSubVertex->subEdges)
-                    toProcess.push(neighbour);
-            }
-        }
-
-        // Process connected component
-        connectedComponents_ << SmartConnectedKeyEdgeSet(connectedEdges);
+        if(component.size() == 1 && (*component.begin())->isClosed())
+            connectedComponents_ << SmartConnectedKeyEdgeSet(component);
+        else
+            openComponents << component;
     }
-
-
-    // ===== Release memory =====
-
-    // release memory
-    foreach(SubEdge * subEdge, subEdges)
-        delete subEdge;
-    foreach(SubVertex * subVertex, subVertices)
-        delete subVertex;
+    foreach(const KeyEdgeSet & component, openComponents)
+        connectedComponents_ << SmartConnectedKeyEdgeSet(component);
 }
 
 int SmartKeyEdgeSet::numConnectedComponents() const
@@ -19,6 +19,10 @@ namespace VectorAnimationComplex
 {
 
 // Assumes edgeSet is connected
+//
+// The type and the decompositions are computed lazily, when first
+// requested, and each at most once. For instance, a simple loop never
+// computes its path-loop decomposition unless hole() is called.
 class SmartConnectedKeyEdgeSet
 {
 public:
@@ -92,9 +96,15 @@ public:
 
 private:
     KeyEdgeSet edgeSet_;
-    ProperPath path_;
-    ProperCycle loop_;
-    CycleHelper hole_;
+    mutable ProperPath path_;
+    mutable ProperCycle loop_;
+    mutable CycleHelper hole_;
+    mutable bool isPathComputed_;
+    mutable bool isLoopComputed_;
+    mutable bool isHoleComputed_;
+    mutable bool isTypeComputed_;
+    mutable EdgeSetType type_;
+    EdgeSetType computeType_() const;
 };
 
 class SmartKeyEdgeSet
@@ -0,0 +1,254 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#include "SpatialIndex.h"
+
+#include "Cell.h"
+#include "GeometryCache.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+namespace VectorAnimationComplex
+{
+
+namespace
+{
+
+// Maximum number of times for which trees are kept
+const int MAX_NUM_FRAMES = 8;
+
+// Trees are rebuilt rather than refit when more than this many items, or a
+// quarter of the cells, changed since they were built. Changes are forgotten,
+// rebuilding the trees not up to date, above the same number
+const int MIN_NUM_CHANGES = 64;
+
+int maxNumChanges(int numCells)
+{
+    return std::max(MIN_NUM_CHANGES, numCells / 4);
+}
+
+}
+
+SpatialIndex::SpatialIndex() :
+    zOrderingVersion_(0),
+    topologyVersion_(0),
+    counter_(0)
+{
+}
+
+void SpatialIndex::clear()
+{
+    frames_.clear();
+    cells_.clear();
+    indices_.clear();
+    changes_.clear();
+}
+
+void SpatialIndex::processGeometryChanged(Cell * cell)
+{
+    if (frames_.isEmpty())
+        return;
+
+    changes_.push_back(cell);
+
+    // Forget changes not applied by trees which are not queried anymore,
+    // e.g. the times of a previous playback
+    if ((int) changes_.size() > maxNumChanges(cells_.size()))
+    {
+        for (auto it = frames_.begin(); it != frames_.end(); )
+        {
+            if (it->numChangesApplied < (int) changes_.size() - 1)
+            {
+                it = frames_.erase(it);
+            }
+            else
+            {
+                it->numChangesApplied -= changes_.size() - 1;
+                ++it;
+            }
+        }
+        changes_.erase(changes_.begin(), changes_.end() - 1);
+    }
+}
+
+SpatialIndex::Frame & SpatialIndex::frame_(const ZOrderedCells & zOrdering, Time time)
+{
+    // Rebuild all trees if cells or lifespans changed
+    if (frames_.isEmpty() ||
+        zOrderingVersion_ != zOrdering.version() ||
+        topologyVersion_ != Cell::topologyVersion())
+    {
+        frames_.clear();
+        changes_.clear();
+        cells_.clear();
+        indices_.clear();
+        for (auto it = zOrdering.cbegin(); it != zOrdering.cend(); ++it)
+        {
+            indices_.insert(*it, cells_.size());
+            cells_.push_back(*it);
+        }
+        zOrderingVersion_ = zOrdering.version();
+        topologyVersion_ = Cell::topologyVersion();
+    }
+
+    // Get existing trees
+    int timeKey = GeometryCache::timeKey(time);
+    auto it = frames_.find(timeKey);
+    if (it != frames_.end())
+    {
+        it->lastUsed = ++counter_;
+        update_(*it, time);
+        return *it;
+    }
+
+    // Evict least recently used trees
+    while (frames_.size() >= MAX_NUM_FRAMES)
+    {
+        auto lru = frames_.begin();
+        for (auto it2 = frames_.begin(); it2 != frames_.end(); ++it2)
+            if (it2->lastUsed < lru->lastUsed)
+                lru = it2;
+        frames_.erase(lru);
+    }
+
+    // Build new trees
+    Frame & frame = frames_[timeKey];
+    frame.lastUsed = ++counter_;
+    build_(frame, time);
+    return frame;
+}
+
+// Note: computing bounding boxes may triangulate cells, but never clears
+// cached geometry, so no change is recorded while building or updating
+void SpatialIndex::build_(Frame & frame, Time time)
+{
+    std::vector<BoundingBox> boxes;
+    std::vector<BoundingBox> outlineBoxes;
+    boxes.reserve(cells_.size());
+    outlineBoxes.reserve(cells_.size());
+    for (Cell * c: cells_)
+    {
+        if (c->exists(time))
+        {
+            boxes.push_back(c->boundingBox(time));
+            outlineBoxes.push_back(c->outlineBoundingBox(time));
+        }
+        else
+        {
+            boxes.push_back(BoundingBox());
+            outlineBoxes.push_back(BoundingBox());
+        }
+    }
+    frame.tree.build(boxes);
+    frame.outlineTree.build(outlineBoxes);
+    frame.numChangesApplied = changes_.size();
+    frame.numRefitItems = 0;
+}
+
+void SpatialIndex::update_(Frame & frame, Time time)
+{
+    const int numChanges = changes_.size();
+    if (frame.numChangesApplied == numChanges)
+        return;
+
+    // Items of the cells changed since the last update, once each
+    std::vector<int> changedItems;
+    for (int k=frame.numChangesApplied; k<numChanges; ++k)
+    {
+        auto it = indices_.constFind(changes_[k]);
+        if (it != indices_.constEnd())
+            changedItems.push_back(*it);
+    }
+    std::sort(changedItems.begin(), changedItems.end());
+    changedItems.erase(std::unique(changedItems.begin(), changedItems.end()),
+                       changedItems.end());
+
+    // Refit trees, or rebuild them if they changed too much
+    frame.numRefitItems += changedItems.size();
+    bool rebuild = frame.numRefitItems > maxNumChanges(cells_.size());
+    for (int i=0; i<(int)changedItems.size() && !rebuild; ++i)
+    {
+        const int item = changedItems[i];
+        Cell * c = cells_[item];
+        BoundingBox box;
+        BoundingBox outlineBox;
+        if (c->exists(time))
+        {
+            box = c->boundingBox(time);
+            outlineBox = c->outlineBoundingBox(time);
+        }
+        rebuild = !frame.tree.setBoundingBox(item, box) ||
+                  !frame.outlineTree.setBoundingBox(item, outlineBox);
+    }
+    if (rebuild)
+    {
+        build_(frame, time);
+    }
+    else
+    {
+        frame.tree.refit();
+        frame.outlineTree.refit();
+        frame.numChangesApplied = numChanges;
+    }
+
+    // Forget changes applied by all trees
+    int minNumChangesApplied = numChanges;
+    for (const Frame & f: frames_)
+        minNumChangesApplied = std::min(minNumChangesApplied, f.numChangesApplied);
+    if (minNumChangesApplied > 0)
+    {
+        changes_.erase(changes_.begin(), changes_.begin() + minNumChangesApplied);
+        for (Frame & f: frames_)
+            f.numChangesApplied -= minNumChangesApplied;
+    }
+}
+
+void SpatialIndex::query_(const Frame & frame, const BoundingBoxTree & tree,
+                          const BoundingBox & rect, ScratchVector<Cell*> & out) const
+{
+    std::vector<int> & items = items_;
+    items.clear();
+    tree.query(rect, items);
+    std::sort(items.begin(), items.end(), std::greater<int>());
+    for (int i: items)
+        out.push_back(cells_[i]);
+}
+
+std::size_t SpatialIndex::numBytes() const
+{
+    std::size_t res = items_.capacity() * sizeof(int) +
+                      cells_.capacity() * sizeof(Cell*) +
+                      indices_.size() * (sizeof(Cell*) + sizeof(int)) +
+                      changes_.capacity() * sizeof(Cell*);
+    for (const Frame & frame: frames_)
+        res += frame.tree.numBytes() + frame.outlineTree.numBytes();
+    return res;
+}
+
+void SpatialIndex::cells(const ZOrderedCells & zOrdering, Time time,
+                         const BoundingBox & rect, ScratchVector<Cell*> & out)
+{
+    const Frame & frame = frame_(zOrdering, time);
+    query_(frame, frame.tree, rect, out);
+}
+
+void SpatialIndex::outlineCells(const ZOrderedCells & zOrdering, Time time,
+                                const BoundingBox & rect, ScratchVector<Cell*> & out)
+{
+    const Frame & frame = frame_(zOrdering, time);
+    query_(frame, frame.outlineTree, rect, out);
+}
+
+BoundingBox SpatialIndex::boundingBox(const ZOrderedCells & zOrdering, Time time)
+{
+    return frame_(zOrdering, time).tree.boundingBox();
+}
+
+}
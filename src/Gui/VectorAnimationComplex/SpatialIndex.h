@@ -0,0 +1,102 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#ifndef VAC_SPATIAL_INDEX_H
+#define VAC_SPATIAL_INDEX_H
+
+// SpatialIndex: finds the cells of a ZOrderedCells whose bounding box at a
+// given time intersects a given rect, without testing all cells. Owned by the
+// VAC, and shared by all its spatial queries (picking, culling, selection,
+// snapping, framing the view...).
+//
+// It keeps one BoundingBoxTree of Cell::boundingBox(Time) and one of
+// Cell::outlineBoundingBox(Time) per time, for the few most recently queried
+// times. They are built lazily, and all rebuilt when cells are inserted,
+// removed, or reordered (see ZOrderedCells::version()) or when lifespans
+// change (see Cell::topologyVersion()).
+//
+// When the geometry of a few cells changes, e.g. while dragging or
+// sculpting, the cells report it (see processGeometryChanged()), and each
+// tree only recomputes their boxes and is refit when it is next queried.
+// Trees are rebuilt instead after too many changes, since refit trees get
+// slower to query.
+
+#include "../TimeDef.h"
+#include "ZOrderedCells.h"
+#include "BoundingBox.h"
+#include "BoundingBoxTree.h"
+#include "ScratchArena.h"
+
+#include <QHash>
+#include <QMap>
+#include <vector>
+
+namespace VectorAnimationComplex
+{
+
+class Cell;
+
+class SpatialIndex
+{
+public:
+    SpatialIndex();
+
+    // Release all trees
+    void clear();
+
+    // To be called when the cached geometry of a cell is cleared or
+    // translated (see Cell::clearCachedGeometry_()). Only records the cell
+    void processGeometryChanged(Cell * cell);
+
+    // Get the cells existing at the given time whose bounding box (resp.
+    // outline bounding box) intersects rect. They are sorted in z-order,
+    // from top to bottom.
+    void cells(const ZOrderedCells & zOrdering, Time time,
+               const BoundingBox & rect, ScratchVector<Cell*> & out);
+    void outlineCells(const ZOrderedCells & zOrdering, Time time,
+                      const BoundingBox & rect, ScratchVector<Cell*> & out);
+
+    // Bounding box of all cells existing at the given time
+    BoundingBox boundingBox(const ZOrderedCells & zOrdering, Time time);
+
+    // Memory used by all trees, in bytes
+    std::size_t numBytes() const;
+
+private:
+    struct Frame
+    {
+        Frame() : lastUsed(0), numChangesApplied(0), numRefitItems(0) {}
+        BoundingBoxTree tree;
+        BoundingBoxTree outlineTree;
+        unsigned int lastUsed;
+        int numChangesApplied; // prefix of changes_ applied to the trees
+        int numRefitItems;     // since the trees were built
+    };
+    QMap<int, Frame> frames_;
+    mutable std::vector<int> items_; // reused by query_()
+    unsigned int zOrderingVersion_;
+    unsigned int topologyVersion_;
+    unsigned int counter_;
+
+    // Cells of all trees, in z-order from bottom to top, and their index
+    std::vector<Cell*> cells_;
+    QHash<Cell*, int> indices_;
+
+    // Cells whose geometry changed, in order, possibly repeated
+    std::vector<Cell*> changes_;
+
+    Frame & frame_(const ZOrderedCells & zOrdering, Time time);
+    void build_(Frame & frame, Time time);
+    void update_(Frame & frame, Time time);
+    void query_(const Frame & frame, const BoundingBoxTree & tree,
+                const BoundingBox & rect, ScratchVector<Cell*> & out) const;
+};
+
+}
+
+#endif // VAC_SPATIAL_INDEX_H
@@ -0,0 +1,285 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+
+#include "StrokeBuffer.h"
+#include "../GLRenderer.h"
+#include "../GLUtils.h"
+#include "../RenderStats.h"
+
+#include <QOpenGLContext>
+#include <QMap>
+#include <QSet>
+#include <QtDebug>
+#include <cmath>
+
+namespace VectorAnimationComplex
+{
+
+namespace
+{
+
+// Number of floats per record, and number of triangles of each round cap
+// (same as EdgeGeometry::triangulate())
+const int RECORD_SIZE = 3;
+const int NUM_CAP_TRIANGLES = 50;
+
+// Attribute locations. The current sample uses location 0, since some
+// implementations do not draw anything unless attribute 0 is enabled
+const GLuint SAMPLE_LOCATION = 0;
+const GLuint PREVIOUS_SAMPLE_LOCATION = 1;
+const GLuint NEXT_SAMPLE_LOCATION = 2;
+
+// Offset the sample half its width along the normal of the bisector of the
+// directions d1 and d2 of the segments before and after it, like
+// computeOffsetPoints() in EdgeGeometry.cpp. At the ends of open strokes,
+// the previous (resp. next) sample is the sample itself, and the direction
+// of the other segment is used
+const char * VERTEX_SHADER =
+    "#version 110\n"
+    "attribute vec3 sample;\n"
+    "attribute vec3 previousSample;\n"
+    "attribute vec3 nextSample;\n"
+    "vec2 direction(vec2 p, vec2 q)\n"
+    "{\n"
+    "    vec2 d = q - p;\n"
+    "    float l = length(d);\n"
+    "    return l > 0.0 ? d / l : vec2(0.0);\n"
+    "}\n"
+    "void main()\n"
+    "{\n"
+    "    vec2 p = sample.xy;\n"
+    "    vec2 d1 = direction(previousSample.xy, p);\n"
+    "    vec2 d2 = direction(p, nextSample.xy);\n"
+    "    if (d1 == vec2(0.0)) d1 = d2;\n"
+    "    if (d2 == vec2(0.0)) d2 = d1;\n"
+    "    vec2 u = d1 + d2;\n"
+    "    float l = length(u);\n"
+    "    vec2 v = l > 0.0 ? vec2(-u.y, u.x) / l : d1;\n"
+    "    gl_Position = gl_ModelViewProjectionMatrix * vec4(p + sample.z * v, 0.0, 1.0);\n"
+    "    gl_FrontColor = gl_Color;\n"
+    "}\n";
+
+const char * FRAGMENT_SHADER =
+    "#version 110\n"
+    "void main()\n"
+    "{\n"
+    "    gl_FragColor = gl_Color;\n"
+    "}\n";
+
+GLuint compileShader(GLenum type, const char * source)
+{
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, 0);
+    glCompileShader(shader);
+    GLint isCompiled = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &isCompiled);
+    if (!isCompiled)
+    {
+        char log[1024];
+        glGetShaderInfoLog(shader, sizeof(log), 0, log);
+        qDebug() << "StrokeBuffer: failed to compile shader:" << log;
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+GLuint linkProgram()
+{
+    GLuint vertexShader = compileShader(GL_VERTEX_SHADER, VERTEX_SHADER);
+    GLuint fragmentShader = compileShader(GL_FRAGMENT_SHADER, FRAGMENT_SHADER);
+    if (!vertexShader || !fragmentShader)
+    {
+        glDeleteShader(vertexShader);
+        glDeleteShader(fragmentShader);
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+    glBindAttribLocation(program, SAMPLE_LOCATION, "sample");
+    glBindAttribLocation(program, PREVIOUS_SAMPLE_LOCATION, "previousSample");
+    glBindAttribLocation(program, NEXT_SAMPLE_LOCATION, "nextSample");
+    glLinkProgram(program);
+    glDeleteShader(vertexShader); // flagged for deletion with the program
+    glDeleteShader(fragmentShader);
+    GLint isLinked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &isLinked);
+    if (!isLinked)
+    {
+        char log[1024];
+        glGetProgramInfoLog(program, sizeof(log), 0, log);
+        qDebug() << "StrokeBuffer: failed to link program:" << log;
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+// The program of the current share group, linked on first use. Zero if it
+// failed to link, in which case linking is not attempted again
+GLuint currentProgram()
+{
+    static QMap<QOpenGLContextGroup *, GLuint> programs;
+    QOpenGLContextGroup * group = QOpenGLContextGroup::currentContextGroup();
+    if (!group)
+        return 0;
+
+    auto it = programs.find(group);
+    if (it == programs.end())
+    {
+        it = programs.insert(group, linkProgram());
+        QObject::connect(group, &QObject::destroyed, [group] ()
+        {
+            programs.remove(group);
+        });
+    }
+    return it.value();
+}
+
+void appendRecords(std::vector<GLfloat> & records, const EdgeSample & sample)
+{
+    GLfloat x = sample.x();
+    GLfloat y = sample.y();
+    GLfloat h = 0.5 * sample.width();
+    records.push_back(x); records.push_back(y); records.push_back(h);
+    records.push_back(x); records.push_back(y); records.push_back(-h);
+}
+
+void addCap(Triangles & triangles, const EdgeSample & sample)
+{
+    int first = triangles.addVertex(sample.x(), sample.y());
+    double r = 0.5 * sample.width();
+    for(int i=0; i<=NUM_CAP_TRIANGLES; ++i)
+    {
+        double theta = 2 * (double) i * 3.14159 / (double) NUM_CAP_TRIANGLES;
+        triangles.addVertex(sample.x() + r*std::cos(theta), sample.y() + r*std::sin(theta));
+    }
+    for(int i=0; i<NUM_CAP_TRIANGLES; ++i)
+        triangles.addTriangle(first+1+i, first+2+i, first);
+}
+
+}
+
+StrokeBuffer::StrokeBuffer() :
+    records_(),
+    numSamples_(0),
+    caps_(),
+    gpuBuffer_(0),
+    gpuBufferGroup_(0)
+{
+    caps_.setRetained(true);
+}
+
+StrokeBuffer::~StrokeBuffer()
+{
+    GLUtils::deleteBuffer(gpuBuffer_, gpuBufferGroup_);
+}
+
+void StrokeBuffer::setSamples(const EdgeSampleVector & samples, bool closed)
+{
+    GLUtils::deleteBuffer(gpuBuffer_, gpuBufferGroup_);
+    gpuBuffer_ = 0;
+    gpuBufferGroup_ = 0;
+    records_.clear();
+    caps_.clear();
+
+    numSamples_ = samples.size();
+    if (numSamples_ < 2)
+    {
+        numSamples_ = 0;
+        return;
+    }
+
+    records_.reserve(2 * RECORD_SIZE * (numSamples_ + 2));
+    appendRecords(records_, closed ? samples[numSamples_-2] : samples.front());
+    for (const EdgeSample & sample: samples)
+        appendRecords(records_, sample);
+    appendRecords(records_, closed ? samples[1] : samples.back());
+
+    if (!closed)
+    {
+        addCap(caps_, samples.front());
+        addCap(caps_, samples.back());
+    }
+}
+
+bool StrokeBuffer::isSupported()
+{
+    return GLEW_VERSION_2_0;
+}
+
+// Binds the GPU buffer, creating it if necessary. Returns false if it can't
+bool StrokeBuffer::bindGpuBuffer_() const
+{
+    QOpenGLContextGroup * group = QOpenGLContextGroup::currentContextGroup();
+    if (!group)
+        return false;
+
+    GLUtils::deleteOrphanedBuffers();
+
+    if (!gpuBuffer_)
+    {
+        glGenBuffers(1, &gpuBuffer_);
+        gpuBufferGroup_ = group;
+        glBindBuffer(GL_ARRAY_BUFFER, gpuBuffer_);
+        glBufferData(GL_ARRAY_BUFFER, records_.size() * sizeof(GLfloat),
+                     records_.data(), GL_STATIC_DRAW);
+
+        // Only the GPU buffer is used from now on
+        std::vector<GLfloat>().swap(records_);
+        return true;
+    }
+    else if (gpuBufferGroup_ != group)
+    {
+        return false;
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, gpuBuffer_);
+    return true;
+}
+
+bool StrokeBuffer::draw() const
+{
+    if (numSamples_ == 0)
+        return true;
+
+    // The program of the picking pass must stay bound: fall back to triangles
+    if (!isSupported() || GLRenderer::isPicking())
+        return false;
+
+    GLuint program = currentProgram();
+    if (!program || !bindGpuBuffer_())
+        return false;
+
+    // The k-th vertex of the strip is a side of sample k/2, i.e. the record
+    // k+2 of the buffer, and its neighbours are the records k and k+4
+    const GLsizei stride = RECORD_SIZE * sizeof(GLfloat);
+    const char * records = 0;
+    glUseProgram(program);
+    glEnableVertexAttribArray(SAMPLE_LOCATION);
+    glEnableVertexAttribArray(PREVIOUS_SAMPLE_LOCATION);
+    glEnableVertexAttribArray(NEXT_SAMPLE_LOCATION);
+    glVertexAttribPointer(PREVIOUS_SAMPLE_LOCATION, 3, GL_FLOAT, GL_FALSE, stride, records);
+    glVertexAttribPointer(SAMPLE_LOCATION, 3, GL_FLOAT, GL_FALSE, stride, records + 2*stride);
+    glVertexAttribPointer(NEXT_SAMPLE_LOCATION, 3, GL_FLOAT, GL_FALSE, stride, records + 4*stride);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 2 * numSamples_);
+    RenderStats::add(RenderStats::TrianglesSubmitted, 2 * numSamples_ - 2);
+    glDisableVertexAttribArray(SAMPLE_LOCATION);
+    glDisableVertexAttribArray(PREVIOUS_SAMPLE_LOCATION);
+    glDisableVertexAttribArray(NEXT_SAMPLE_LOCATION);
+    glUseProgram(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    caps_.draw();
+    return true;
+}
+
+}
@@ -0,0 +1,83 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+
+#ifndef VAC_STROKE_BUFFER_H
+#define VAC_STROKE_BUFFER_H
+
+// StrokeBuffer: a variable-width stroke expanded into triangles on the GPU.
+//
+// Instead of the triangles of the stroke (see EdgeGeometry::triangulate()),
+// only its centerline samples (x, y, width) are uploaded, and a vertex shader
+// computes the offset points on each side of each sample, drawing the whole
+// stroke as a single triangle strip. Offset points are computed the same way
+// as on the CPU: half the width away along the normal of the bisector of
+// the two adjacent segments. The round caps of open strokes are small, and
+// are still triangulated on the CPU.
+//
+// The samples are only kept in CPU memory until they are uploaded. Like
+// retained Triangles, the GPU buffer is only valid in the share group of the
+// OpenGL context it has been created in, which all GLWidgets share. If shaders
+// are not supported, or when drawn in a context of another group, draw()
+// returns false without drawing anything, and the caller is expected to draw
+// the stroke from its triangles instead.
+
+#include "EdgeSample.h"
+#include "Triangles.h"
+#include "../OpenGL.h"
+
+#include <vector>
+
+class QOpenGLContextGroup;
+
+namespace VectorAnimationComplex
+{
+
+class StrokeBuffer
+{
+public:
+    // Build an empty stroke
+    StrokeBuffer();
+
+    // Destructor. Releases the GPU buffer, if any
+    ~StrokeBuffer();
+
+    // Set the samples of the stroke, repeating the first sample at the end
+    // if closed (e.g., EdgeGeometry::strokeSampling())
+    void setSamples(const EdgeSampleVector & samples, bool closed);
+
+    // Draw the stroke with the current color. Returns false if it could not
+    // be drawn this way (see above)
+    bool draw() const;
+
+    // Whether the current OpenGL implementation supports GPU strokes
+    static bool isSupported();
+
+private:
+    // Non-copyable: the samples are not kept once uploaded
+    StrokeBuffer(const StrokeBuffer &);
+    StrokeBuffer & operator=(const StrokeBuffer &);
+
+    // Two records (x, y, offset) per sample, with offset = +/- half its
+    // width, plus one sample before the first and one after the last, giving
+    // the directions at the ends of the stroke. Cleared once uploaded
+    mutable std::vector<GLfloat> records_;
+    int numSamples_;
+
+    // Round caps of open strokes
+    Triangles caps_;
+
+    // GPU buffer
+    mutable GLuint gpuBuffer_;
+    mutable QOpenGLContextGroup * gpuBufferGroup_;
+    bool bindGpuBuffer_() const;
+};
+
+}
+
+#endif // VAC_STROKE_BUFFER_H
@@ -0,0 +1,348 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#include "Symbols.h"
+
+#include "VAC.h"
+#include "Cell.h"
+#include "BoundingBox.h"
+#include "DrawList.h"
+#include "ZOrderedCells.h"
+#include "../GLUtils.h"
+#include "../OpenGL.h"
+#include "../ViewSettings.h"
+#include "../XmlStreamReader.h"
+#include "../XmlStreamWriter.h"
+
+#include <QStringList>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+namespace VectorAnimationComplex
+{
+
+namespace
+{
+
+// Keeps exact frames exact, unlike Time::operator+()
+Time offsetTime(Time time, int offset)
+{
+    switch(time.type())
+    {
+    case Time::ExactFrame:
+        return Time(time.frame() + offset);
+    case Time::JustBeforeFrame:
+        return Time(time.frame() + offset, false);
+    case Time::JustAfterFrame:
+        return Time(time.frame() + offset, true);
+    default:
+        return Time(time.floatTime() + offset);
+    }
+}
+
+bool isFinite(const ViewSettings & viewSettings)
+{
+    return std::isfinite(viewSettings.visibleXMin()) && std::isfinite(viewSettings.visibleXMax()) &&
+           std::isfinite(viewSettings.visibleYMin()) && std::isfinite(viewSettings.visibleYMax());
+}
+
+// Number of (group, time) pairs whose vertex buffers are kept by the draw
+// lists of a symbol, i.e., of distinct time offsets drawn without rebuilding
+const int MAX_NUM_FRAMES = 16;
+
+}
+
+Symbols::DrawCache::DrawCache() :
+    zOrdering(new ZOrderedCells()),
+    drawList(new DrawList(MAX_NUM_FRAMES)),
+    topologyDrawList(new DrawList(MAX_NUM_FRAMES, DrawList::Topology))
+{
+}
+
+Symbols::DrawCache::~DrawCache()
+{
+    delete zOrdering;
+    delete drawList;
+    delete topologyDrawList;
+}
+
+Symbols::Symbols() :
+    version_(0)
+{
+    updateVersion_();
+}
+
+Symbols::~Symbols()
+{
+    clearDrawCaches_();
+}
+
+void Symbols::copyFrom(const Symbols & other)
+{
+    clearDrawCaches_();
+    symbols_ = other.symbols_;
+    version_ = other.version_;
+}
+
+void Symbols::clear()
+{
+    clearDrawCaches_();
+    symbols_.clear();
+    updateVersion_();
+}
+
+void Symbols::updateVersion_()
+{
+    // Atomic, since documents may be read in a worker thread
+    static std::atomic<unsigned int> lastVersion(0);
+    version_ = ++lastVersion;
+}
+
+void Symbols::clearDrawCaches_()
+{
+    foreach(DrawCache * cache, drawCaches_)
+        delete cache;
+    drawCaches_.clear();
+}
+
+int Symbols::numSymbols() const
+{
+    return symbols_.size();
+}
+
+int Symbols::addSymbol(const std::vector<int> & cellIds)
+{
+    Symbol symbol;
+    symbol.cellIds = cellIds;
+    std::sort(symbol.cellIds.begin(), symbol.cellIds.end());
+    symbols_.push_back(symbol);
+    updateVersion_();
+    return symbols_.size() - 1;
+}
+
+const std::vector<int> & Symbols::cellIds(int symbol) const
+{
+    return symbols_[symbol].cellIds;
+}
+
+int Symbols::findSymbol(Cell * cell) const
+{
+    for(int i=0; i<numSymbols(); ++i)
+    {
+        const std::vector<int> & ids = symbols_[i].cellIds;
+        if(std::binary_search(ids.begin(), ids.end(), cell->id()))
+            return i;
+    }
+    return -1;
+}
+
+int Symbols::numInstances(int symbol) const
+{
+    return symbols_[symbol].instances.size();
+}
+
+const SymbolInstance & Symbols::instance(int symbol, int i) const
+{
+    return symbols_[symbol].instances[i];
+}
+
+void Symbols::addInstance(int symbol, const SymbolInstance & instance)
+{
+    symbols_[symbol].instances.push_back(instance);
+    updateVersion_();
+}
+
+void Symbols::clearInstances(int symbol)
+{
+    symbols_[symbol].instances.clear();
+    updateVersion_();
+}
+
+bool Symbols::hasInstances() const
+{
+    for(const Symbol & symbol: symbols_)
+        if(!symbol.instances.empty())
+            return true;
+    return false;
+}
+
+Symbols::DrawCache * Symbols::drawCache_(VAC * vac, int symbol)
+{
+    DrawCache *& cache = drawCaches_[symbol];
+    if(!cache)
+        cache = new DrawCache();
+
+    // Cells of the master, in z-order. Looking them up costs as much as
+    // drawing them once, whatever the number of instances.
+    std::vector<Cell*> cells;
+    cells.reserve(symbols_[symbol].cellIds.size());
+    for(int id: symbols_[symbol].cellIds)
+    {
+        Cell * cell = vac->getCell(id);
+        if(cell)
+            cells.push_back(cell);
+    }
+    const ZOrderedCells & zOrdering = vac->zOrdering();
+    std::sort(cells.begin(), cells.end(), [&zOrdering](Cell * c1, Cell * c2) {
+        return zOrdering.isBelow(c1, c2);
+    });
+
+    // Same cells in the same order: the runs of the draw lists are reused
+    if(cells != cache->cells)
+    {
+        cache->cells = cells;
+        cache->zOrdering->clear();
+        cache->zOrdering->reserve(cells.size());
+        for(Cell * cell: cells)
+            cache->zOrdering->insertLast(cell);
+    }
+
+    return cache;
+}
+
+void Symbols::draw(VAC * vac, Time time, ViewSettings & viewSettings, bool topology)
+{
+    const double xMin = viewSettings.visibleXMin();
+    const double xMax = viewSettings.visibleXMax();
+    const double yMin = viewSettings.visibleYMin();
+    const double yMax = viewSettings.visibleYMax();
+    const bool isCulling = isFinite(viewSettings);
+
+    for(int i=0; i<numSymbols(); ++i)
+    {
+        const std::vector<SymbolInstance> & instances = symbols_[i].instances;
+        if(instances.empty())
+            continue;
+
+        DrawCache * cache = drawCache_(vac, i);
+        DrawList * drawList = topology ? cache->topologyDrawList : cache->drawList;
+        for(const SymbolInstance & instance: instances)
+        {
+            // Visible rect in the coordinates of the master
+            if(isCulling)
+            {
+                Eigen::Affine2d inverse = instance.transform.inverse();
+                BoundingBox rect;
+                const double xs[4] = {xMin, xMax, xMax, xMin};
+                const double ys[4] = {yMin, yMin, yMax, yMax};
+                for(int j=0; j<4; ++j)
+                {
+                    Eigen::Vector2d p = inverse * Eigen::Vector2d(xs[j], ys[j]);
+                    rect.unite(BoundingBox(p[0], p[1]));
+                }
+                viewSettings.setVisibleRect(rect.xMin(), rect.xMax(), rect.yMin(), rect.yMax());
+            }
+
+            glPushMatrix();
+            GLUtils::multMatrix(instance.transform);
+            drawList->draw(*cache->zOrdering, offsetTime(time, instance.timeOffset), viewSettings);
+            glPopMatrix();
+        }
+    }
+
+    if(isCulling)
+        viewSettings.setVisibleRect(xMin, xMax, yMin, yMax);
+}
+
+unsigned int Symbols::drawingVersion(VAC * vac, Time time) const
+{
+    unsigned int res = 2166136261u;
+    auto hash = [&res](unsigned int x) { res = (res ^ x) * 16777619u; };
+    for(const Symbol & symbol: symbols_)
+    {
+        hash(symbol.instances.size());
+        std::vector<int> offsets;
+        for(const SymbolInstance & instance: symbol.instances)
+        {
+            const double * m = instance.transform.data();
+            for(int j=0; j<9; ++j)
+            {
+                quint64 bits;
+                std::memcpy(&bits, &m[j], sizeof(bits));
+                hash(bits ^ (bits >> 32));
+            }
+            hash(instance.timeOffset);
+            if(instance.timeOffset != 0)
+                offsets.push_back(instance.timeOffset);
+        }
+        std::sort(offsets.begin(), offsets.end());
+        offsets.erase(std::unique(offsets.begin(), offsets.end()), offsets.end());
+        for(int offset: offsets)
+        {
+            Time t = offsetTime(time, offset);
+            for(int id: symbol.cellIds)
+            {
+                Cell * c = vac->getCell(id);
+                if(c && c->exists(t))
+                {
+                    hash(c->id());
+                    hash(c->stateVersion());
+                    hash(c->geometryVersion());
+                }
+            }
+        }
+    }
+    return res;
+}
+
+void Symbols::write(XmlStreamWriter & xml) const
+{
+    for(const Symbol & symbol: symbols_)
+    {
+        QStringList ids;
+        for(int id: symbol.cellIds)
+            ids << QString().setNum(id);
+
+        xml.writeStartElement("symbol");
+        xml.writeAttribute("cells", ids.join(" "));
+        for(const SymbolInstance & instance: symbol.instances)
+        {
+            const Eigen::Matrix2d m = instance.transform.linear();
+            const Eigen::Vector2d t = instance.transform.translation();
+            xml.writeStartElement("instance");
+            xml.writeAttribute("transform", QString("%1 %2 %3 %4 %5 %6")
+                               .arg(m(0,0)).arg(m(1,0)).arg(m(0,1)).arg(m(1,1)).arg(t[0]).arg(t[1]));
+            xml.writeAttribute("timeoffset", QString().setNum(instance.timeOffset));
+            xml.writeEndElement();
+        }
+        xml.writeEndElement();
+    }
+}
+
+void Symbols::read(XmlStreamReader & xml)
+{
+    std::vector<int> cellIds;
+    QStringList ids = xml.attributes().value("cells").toString().split(" ", QString::SkipEmptyParts);
+    for(const QString & id: ids)
+        cellIds.push_back(id.toInt());
+    int symbol = addSymbol(cellIds);
+
+    while(xml.readNextStartElement())
+    {
+        if(xml.name() == "instance")
+        {
+            SymbolInstance instance;
+            QStringList list = xml.attributes().value("transform").toString().split(" ", QString::SkipEmptyParts);
+            if(list.size() == 6)
+            {
+                Eigen::Matrix2d m;
+                m << list[0].toDouble(), list[2].toDouble(),
+                     list[1].toDouble(), list[3].toDouble();
+                instance.transform.linear() = m;
+                instance.transform.translation() = Eigen::Vector2d(list[4].toDouble(), list[5].toDouble());
+            }
+            instance.timeOffset = xml.attributes().value("timeoffset").toInt();
+            addInstance(symbol, instance);
+        }
+        xml.skipCurrentElement();
+    }
+}
+
+}
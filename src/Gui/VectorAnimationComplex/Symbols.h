@@ -0,0 +1,134 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#ifndef VAC_SYMBOLS_H
+#define VAC_SYMBOLS_H
+
+// Symbols: sets of cells of a VAC, called masters, drawn again elsewhere as
+// instances, each with its own affine transformation and time offset. An
+// instance is only a transformation and an offset: it has no cells of its
+// own, so that a prop repeated hundreds of times costs the memory, file size
+// and triangulation of one. Editing the cells of a master updates all its
+// instances.
+//
+// The cells of a master are referred to by ID, so that symbols survive
+// copies of the VAC (e.g. the undo history, see History). Deleted cells are
+// ignored.
+//
+// All instances of a symbol are drawn from a single DrawList, i.e. from the
+// same vertex buffers, which are built once per time and drawn once per
+// instance under its transformation. Instances are drawn below all cells,
+// are not pickable, and are not drawn in the 3D view.
+//
+// Saved as children of the objects element, after the cells, which older
+// versions ignore:
+//
+//     <symbol cells="12 13 14">
+//       <instance transform="1 0 0 1 250 0" timeoffset="0"/>
+//       <instance transform="0.5 0 0 0.5 400 80" timeoffset="12"/>
+//     </symbol>
+//
+// where transform is the 2x3 matrix "a b c d e f" of x' = a*x + c*y + e,
+// y' = b*x + d*y + f, as in SVG.
+
+#include "../TimeDef.h"
+#include "CellList.h"
+#include "Eigen.h"
+
+#include <QHash>
+#include <vector>
+
+class ViewSettings;
+class XmlStreamReader;
+class XmlStreamWriter;
+
+namespace VectorAnimationComplex
+{
+
+class VAC;
+class Cell;
+class DrawList;
+class ZOrderedCells;
+
+struct SymbolInstance
+{
+    SymbolInstance() : transform(Eigen::Affine2d::Identity()), timeOffset(0) {}
+    Eigen::Affine2d transform;
+    int timeOffset; // in frames, added to the time at which the master is drawn
+};
+
+class Symbols
+{
+public:
+    Symbols();
+    ~Symbols();
+
+    // Copies symbols and instances, but not what is cached to draw them
+    void copyFrom(const Symbols & other);
+    void clear();
+
+    // Stamp which changes each time symbols or instances are added, removed,
+    // or read. Stamps are unique across all instances of Symbols, except
+    // that copyFrom() also copies the stamp
+    unsigned int version() const { return version_; }
+
+    // Symbols. The cells of the master are given by ID.
+    int numSymbols() const;
+    int addSymbol(const std::vector<int> & cellIds); // returns its index
+    const std::vector<int> & cellIds(int symbol) const;
+    int findSymbol(Cell * cell) const; // first symbol whose master contains the cell, or -1
+
+    // Instances
+    int numInstances(int symbol) const;
+    const SymbolInstance & instance(int symbol, int i) const;
+    void addInstance(int symbol, const SymbolInstance & instance);
+    void clearInstances(int symbol);
+    bool hasInstances() const;
+
+    // Draws all instances, as in illustration or outline mode
+    void draw(VAC * vac, Time time, ViewSettings & viewSettings, bool topology);
+
+    // Hash of the instances and, for those with a time offset, of the cells
+    // of their master existing at the offset time (see VAC::drawingVersion())
+    unsigned int drawingVersion(VAC * vac, Time time) const;
+
+    // Save and load
+    void write(XmlStreamWriter & xml) const;
+    void read(XmlStreamReader & xml); // reader at a symbol start element
+
+private:
+    Q_DISABLE_COPY(Symbols)
+
+    struct Symbol
+    {
+        std::vector<int> cellIds;
+        std::vector<SymbolInstance> instances;
+    };
+    std::vector<Symbol> symbols_;
+    unsigned int version_;
+    void updateVersion_();
+
+    // Cells of a master in z-order, rebuilt when they are created, deleted
+    // or reordered, and the draw lists of its instances
+    struct DrawCache
+    {
+        DrawCache();
+        ~DrawCache();
+        std::vector<Cell*> cells;
+        ZOrderedCells * zOrdering;
+        DrawList * drawList;
+        DrawList * topologyDrawList;
+    };
+    QHash<int, DrawCache*> drawCaches_;
+    DrawCache * drawCache_(VAC * vac, int symbol);
+    void clearDrawCaches_();
+};
+
+}
+
+#endif // VAC_SYMBOLS_H
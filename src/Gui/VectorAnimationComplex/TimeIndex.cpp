@@ -0,0 +1,80 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+
+#include "TimeIndex.h"
+
+#include "Cell.h"
+#include "KeyCell.h"
+#include "InbetweenCell.h"
+
+namespace VectorAnimationComplex
+{
+
+TimeIndex::TimeIndex() :
+    isBuilt_(false),
+    topologyVersion_(0),
+    zOrderingVersion_(0)
+{
+}
+
+void TimeIndex::clear()
+{
+    frames_.clear();
+    isBuilt_ = false;
+}
+
+const std::vector<Cell*> & TimeIndex::cells(const CellTable & cells,
+                                            const ZOrderedCells & zOrdering, Time time)
+{
+    // Rebuild all buckets if anything changed
+    if (!isBuilt_ ||
+        topologyVersion_ != Cell::topologyVersion() ||
+        zOrderingVersion_ != zOrdering.version())
+    {
+        build_(cells);
+        topologyVersion_ = Cell::topologyVersion();
+        zOrderingVersion_ = zOrdering.version();
+        isBuilt_ = true;
+    }
+
+    // Get bucket. Note: for float times, frame() is truncated towards
+    // negative infinity, which is the bucket of inbetween cells spanning it.
+    auto it = frames_.constFind(time.frame());
+    if (it != frames_.constEnd())
+        return *it;
+    else
+        return noCells_;
+}
+
+void TimeIndex::build_(const CellTable & cells)
+{
+    frames_.clear();
+    for (Cell * c: cells)
+    {
+        int firstFrame, lastFrame;
+        if (KeyCell * kc = c->toKeyCell())
+        {
+            firstFrame = lastFrame = kc->time().frame();
+        }
+        else if (InbetweenCell * ic = c->toInbetweenCell())
+        {
+            firstFrame = ic->beforeTime().frame();
+            lastFrame = ic->afterTime().frame();
+        }
+        else
+        {
+            continue;
+        }
+
+        for (int f = firstFrame; f <= lastFrame; ++f)
+            frames_[f].push_back(c);
+    }
+}
+
+}
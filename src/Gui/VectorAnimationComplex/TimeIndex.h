@@ -0,0 +1,59 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+
+#ifndef VAC_TIME_INDEX_H
+#define VAC_TIME_INDEX_H
+
+// TimeIndex: finds the cells existing at a given time, without testing all
+// cells. Each cell is stored in one bucket per frame of its lifespan: key
+// cells in the bucket of their frame, and inbetween cells in the buckets
+// of all frames from their before time to their after time, included. The
+// buckets are built lazily, and are all rebuilt as soon as cells are
+// inserted, removed, or reordered (see ZOrderedCells::version()), or the star
+// of any cell or the time of any key cell changes (see Cell::topologyVersion()).
+
+#include "../TimeDef.h"
+#include "ZOrderedCells.h"
+#include "CellTable.h"
+
+#include <QHash>
+#include <vector>
+
+namespace VectorAnimationComplex
+{
+
+class Cell;
+
+class TimeIndex
+{
+public:
+    TimeIndex();
+
+    // Release all buckets
+    void clear();
+
+    // Get the cells possibly existing at the given time, sorted by ID. This
+    // is a superset of the cells existing at that time: callers must still
+    // test Cell::exists(time).
+    const std::vector<Cell*> & cells(const CellTable & cells,
+                                     const ZOrderedCells & zOrdering, Time time);
+
+private:
+    QHash<int, std::vector<Cell*> > frames_;
+    std::vector<Cell*> noCells_;
+    bool isBuilt_;
+    unsigned int topologyVersion_;
+    unsigned int zOrderingVersion_;
+
+    void build_(const CellTable & cells);
+};
+
+}
+
+#endif // VAC_TIME_INDEX_H
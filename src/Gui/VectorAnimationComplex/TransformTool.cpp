@@ -16,9 +16,12 @@
 #include "EdgeGeometry.h"
 #include "VAC.h"
 #include "Algorithms.h"
+#include "Triangles.h"
 #include "Global.h"
+#include "DevSettings.h"
 
 #include <cmath>
+#include <limits>
 #include <vector>
 
 typedef Eigen::Vector2d Vec2;
@@ -383,6 +386,52 @@ void glFillPivot_(const Vec2 & pos, double size)
     glEnd();
 }
 
+// Same shapes as glFillRect_(), glFillArrow_(), and glFillPivot_(), as
+// triangles, for picking on CPU
+Triangles rectTriangles_(const Vec2 & pos, double size)
+{
+    Triangles res;
+    res.append(pos[0] - size, pos[1] - size,
+               pos[0] + size, pos[1] - size,
+               pos[0] + size, pos[1] + size);
+    res.append(pos[0] - size, pos[1] - size,
+               pos[0] + size, pos[1] + size,
+               pos[0] - size, pos[1] + size);
+    return res;
+}
+
+Triangles arrowTriangles_(const Vec2Vector & arrow)
+{
+    const int & n = rotateWidgetNumSamples;
+    Triangles res;
+
+    // Arrow body (triangle strip)
+    int minBodyIndex = 3;
+    int maxBodyIndex = 2*n+5;
+    for (int i=0; i<n-1; ++i)
+    {
+        res << Triangle(arrow[minBodyIndex], arrow[maxBodyIndex], arrow[minBodyIndex+1]);
+        res << Triangle(arrow[maxBodyIndex], arrow[minBodyIndex+1], arrow[maxBodyIndex-1]);
+        ++minBodyIndex;
+        --maxBodyIndex;
+    }
+
+    // Arrow heads
+    res << Triangle(arrow[0], arrow[1], arrow[2]);
+    res << Triangle(arrow[n+3], arrow[n+4], arrow[n+5]);
+
+    return res;
+}
+
+Triangles pivotTriangles_(const Vec2 & pos, double size)
+{
+    const int & n = pivotWidgetNumSamples;
+    Triangles res;
+    for (int i=0; i<n; ++i)
+        res << Triangle(pos, p_(pos, size, 2*i*PI/n), p_(pos, size, 2*(i+1)*PI/n));
+    return res;
+}
+
 }
 
 TransformTool::TransformTool(QObject * parent) :
@@ -395,14 +444,53 @@ TransformTool::TransformTool(QObject * parent) :
     draggingManualPivot_(false),
     dragAndDropping_(false),
     transforming_(false),
-    rotating_(false)
+    rotating_(false),
+    isPreviewing_(false),
+    previewedCells_(),
+    previewXf_(Eigen::Affine2d::Identity()),
+    previewVersion_(0),
+    cellsVersion_(0)
 {
+    boundingBoxesCache_.cells = 0;
     connect(global(), SIGNAL(keyboardModifiersChanged()), this, SLOT(onKeyboardModifiersChanged()));
 }
 
+void TransformTool::boundingBoxes_(const CellSet & cells, Time time,
+                                   BoundingBox & bb, BoundingBox & obb) const
+{
+    bb = BoundingBox();
+    obb = BoundingBox();
+    if (cells.isEmpty())
+        return;
+
+    const VAC * vac = (*cells.begin())->vac();
+    BoundingBoxesCache & cache = boundingBoxesCache_;
+    if (!vac || cache.cells != &cells || cache.cellsVersion != cellsVersion_ ||
+        cache.geometryVersion != vac->geometryVersion() ||
+        cache.topologyVersion != vac->topologyVersion() ||
+        cache.time != time)
+    {
+        cache.bb = BoundingBox();
+        cache.obb = BoundingBox();
+        for (CellSet::ConstIterator it = cells.begin(); it != cells.end(); ++it)
+        {
+            cache.bb.unite((*it)->boundingBox(time));
+            cache.obb.unite((*it)->outlineBoundingBox(time));
+        }
+        cache.cells = &cells;
+        cache.cellsVersion = cellsVersion_;
+        cache.geometryVersion = vac ? vac->geometryVersion() : 0;
+        cache.topologyVersion = vac ? vac->topologyVersion() : 0;
+        cache.time = time;
+    }
+    bb = cache.bb;
+    obb = cache.obb;
+}
+
 void TransformTool::setCells(const CellSet & cells)
 {
     cells_ = cells;
+    ++cellsVersion_;
 
     if (!transforming_ && !dragAndDropping_)
     {
@@ -657,6 +745,31 @@ void TransformTool::drawPickPivot_(const BoundingBox & bb, ViewSettings & viewSe
     glFillPivot_(pos, size);
 }
 
+namespace
+{
+
+// Bounding box of the transformed corners of the given bounding box
+BoundingBox transformed_(const BoundingBox & bb, const Eigen::Affine2d & xf)
+{
+    if (!bb.isProper())
+        return bb;
+
+    BoundingBox res;
+    const double xs[] = {bb.xMin(), bb.xMax()};
+    const double ys[] = {bb.yMin(), bb.yMax()};
+    for (int i=0; i<2; ++i)
+    {
+        for (int j=0; j<2; ++j)
+        {
+            const Vec2 p = xf * Vec2(xs[i], ys[j]);
+            res.unite(BoundingBox(p[0], p[1]));
+        }
+    }
+    return res;
+}
+
+}
+
 void TransformTool::draw(const CellSet & cells, Time time, ViewSettings & viewSettings) const
 {
     // Compute bounding boxes at current time
@@ -667,13 +780,15 @@ void TransformTool::draw(const CellSet & cells, Time time, ViewSettings & viewSe
         bb = bb0_;
         obb = obb0_;
     }
+    else if (isPreviewing_)
+    {
+        // Cells are not transformed yet. Scaling keeps boxes axis-aligned
+        bb = transformed_(bb0_, previewXf_);
+        obb = transformed_(obb0_, previewXf_);
+    }
     else
     {
-        for (CellSet::ConstIterator it = cells.begin(); it != cells.end(); ++it)
-        {
-            bb.unite((*it)->boundingBox(time));
-            obb.unite((*it)->outlineBoundingBox(time));
-        }
+        boundingBoxes_(cells, time, bb, obb);
     }
 
     // Push transformation matrix in case of rotation
@@ -731,19 +846,10 @@ void TransformTool::draw(const CellSet & cells, Time time, ViewSettings & viewSe
 
 void TransformTool::drawPick(const CellSet & cells, Time time, ViewSettings & viewSettings) const
 {
-    // Compute selection bounding box at current time
+    // Compute selection bounding box and outline bounding box at current time
     BoundingBox bb;
-    for (CellSet::ConstIterator it = cells.begin(); it != cells.end(); ++it)
-    {
-        bb.unite((*it)->boundingBox(time));
-    }
-
-    // Compute outline bounding box at current time
     BoundingBox obb;
-    for (CellSet::ConstIterator it = cells.begin(); it != cells.end(); ++it)
-    {
-        obb.unite((*it)->outlineBoundingBox(time));
-    }
+    boundingBoxes_(cells, time, bb, obb);
 
     // Draw transform widgets
     if (bb.isProper())
@@ -768,6 +874,61 @@ void TransformTool::drawPick(const CellSet & cells, Time time, ViewSettings & vi
     }
 }
 
+int TransformTool::pick(const CellSet & cells, Time time, double x, double y,
+                        double tolerance, ViewSettings & viewSettings, double & distance) const
+{
+    distance = std::numeric_limits<double>::infinity();
+
+    // Compute selection bounding box and outline bounding box at current time
+    BoundingBox bb;
+    BoundingBox obb;
+    boundingBoxes_(cells, time, bb, obb);
+    if (!bb.isProper())
+        return -1;
+
+    // Same widgets as drawPick(), in the same order
+    const double zoom = viewSettings.zoom();
+    std::vector<WidgetId> ids;
+    std::vector<Triangles> triangles;
+    WidgetId scaleCornerIds[] = {TopLeftScale, TopRightScale, BottomRightScale, BottomLeftScale};
+    for (int i=0; i<4; ++i)
+    {
+        ids.push_back(scaleCornerIds[i]);
+        triangles.push_back(rectTriangles_(widgetPos_(scaleCornerIds[i], bb), scaleWidgetCornerSize / zoom));
+    }
+    WidgetId scaleEdgeIds[] = {TopScale, RightScale, BottomScale, LeftScale};
+    for (int i=0; i<4; ++i)
+    {
+        ids.push_back(scaleEdgeIds[i]);
+        triangles.push_back(rectTriangles_(widgetPos_(scaleEdgeIds[i], bb), scaleWidgetEdgeSize / zoom));
+    }
+    WidgetId rotateIds[] = {TopLeftRotate, TopRightRotate, BottomRightRotate, BottomLeftRotate};
+    for (int i=0; i<4; ++i)
+    {
+        ids.push_back(rotateIds[i]);
+        triangles.push_back(arrowTriangles_(computeArrow_(rotateIds[i], bb, viewSettings)));
+    }
+    ids.push_back(Pivot);
+    triangles.push_back(pivotTriangles_(noTransformPivotPosition_(obb), pivotWidgetSize / zoom));
+
+    // Find closest widget, from top to bottom
+    const Vec2 p(x, y);
+    WidgetId res = None;
+    for (int i=ids.size()-1; i>=0; --i)
+    {
+        const double d = triangles[i].distance(p);
+        if (d <= tolerance && d < distance)
+        {
+            distance = d;
+            res = ids[i];
+            if (d == 0)
+                break;
+        }
+    }
+
+    return (res == None) ? -1 : idOffset_ + res - MIN_WIDGET_ID;
+}
+
 void TransformTool::setHoveredObject(int id)
 {
     int widgetId = id - idOffset_ + MIN_WIDGET_ID;
@@ -802,6 +963,9 @@ void TransformTool::beginTransform(double x0, double y0, Time time)
     // Clear cached values
     draggedVertices_.clear();
     draggedEdges_.clear();
+    isPreviewing_ = false;
+    previewedCells_.clear();
+    previewXf_ = Eigen::Affine2d::Identity();
 
     // Return in trivial cases
     if (hovered() == None || cells_.isEmpty())
@@ -843,44 +1007,51 @@ void TransformTool::beginTransform(double x0, double y0, Time time)
         // Inform that we are currently transforming the selection
         transforming_ = true;
 
-        // Keyframe inbetween cells
-        CellSet cellsNotToKeyframe;
+        // Inbetween cells existing at transform time must be keyframed
         CellSet cellsToKeyframe;
         foreach(Cell * c, cells_)
         {
             InbetweenCell * sc = c->toInbetweenCell();
-            if(sc)
-            {
-                if(sc->exists(time))
-                {
-                    cellsToKeyframe << sc;
-                }
-                else
-                {
-                    cellsNotToKeyframe << sc;
-                }
-            }
-            else
-            {
-                cellsNotToKeyframe << c;
-            }
+            if(sc && sc->exists(time))
+                cellsToKeyframe << sc;
         }
-        VAC * vac = (*cells_.begin())->vac();
-        KeyCellSet keyframedCells = vac->keyframe_(cellsToKeyframe,time);
-        // Note: the above causes the selection to change (new key cells are
-        // selected instead of old inbetween cells, and therefore setCells()
-        // is called)
-
-        // Determine which cells to transform
-        CellSet cellsToTransform = cellsNotToKeyframe;
-        foreach(KeyCell * c, keyframedCells)
-            cellsToTransform << c;
-        cellsToTransform = Algorithms::closure(cellsToTransform);
-
-        // Cache key vertices and edges
+
+        // Determine which cells to transform, and cache key vertices and edges
         // XXX add the non-loop edges whose end vertices are dragged?
-        draggedVertices_ = KeyVertexSet(cellsToTransform);
-        draggedEdges_ = KeyEdgeSet(cellsToTransform);
+        VAC * vac = (*cells_.begin())->vac();
+        CellSet cellsToTransform;
+        if (cellsToKeyframe.isEmpty())
+        {
+            // Common case: the closure of the selection is already known
+            cellsToTransform = vac->selectionClosure_.cells(vac->selectedCells_);
+            draggedVertices_ = vac->selectionClosure_.keyVertices(vac->selectedCells_);
+            draggedEdges_ = vac->selectionClosure_.keyEdges(vac->selectedCells_);
+        }
+        else
+        {
+            CellSet cellsNotToKeyframe = cells_;
+            cellsNotToKeyframe.subtract(cellsToKeyframe);
+            KeyCellSet keyframedCells = vac->keyframe_(cellsToKeyframe,time);
+            // Note: the above causes the selection to change (new key cells are
+            // selected instead of old inbetween cells, and therefore setCells()
+            // is called)
+
+            cellsToTransform = cellsNotToKeyframe;
+            foreach(KeyCell * c, keyframedCells)
+                cellsToTransform << c;
+            cellsToTransform = Algorithms::closure(cellsToTransform);
+            draggedVertices_ = KeyVertexSet(cellsToTransform);
+            draggedEdges_ = KeyEdgeSet(cellsToTransform);
+        }
+
+        // Defer the transform if no other cell is deformed by it
+        isPreviewing_ = DevSettings::getBool("deferred transform") &&
+                        Algorithms::fullstar(cellsToTransform).size() == cellsToTransform.size();
+        if (isPreviewing_)
+        {
+            previewedCells_ = cellsToTransform;
+            ++previewVersion_;
+        }
 
         // prepare for affine transform
         foreach(KeyEdge * e, draggedEdges_)
@@ -1041,15 +1212,16 @@ void TransformTool::continueTransform(double x, double y)
         Eigen::Translation2d pivot(xPivot, yPivot);
         xf = pivot * xf * pivot.inverse();
 
-        // Apply affine transformation
-        foreach(KeyEdge * e, draggedEdges_)
-            e->performAffineTransform(xf);
-
-        foreach(KeyVertex * v, draggedVertices_)
-            v->performAffineTransform(xf);
-
-        foreach(KeyVertex * v, draggedVertices_)
-            v->correctEdgesGeometry();
+        // Apply affine transformation, or only preview it
+        if (isPreviewing_)
+        {
+            previewXf_ = xf;
+            ++previewVersion_;
+        }
+        else
+        {
+            applyTransform_(xf);
+        }
 
         // Apply transformation to manual pivot point
         if (manualPivot_)
@@ -1061,8 +1233,51 @@ void TransformTool::continueTransform(double x, double y)
     }
 }
 
+void TransformTool::applyTransform_(const Eigen::Affine2d & xf)
+{
+    foreach(KeyEdge * e, draggedEdges_)
+        e->performAffineTransform(xf);
+
+    foreach(KeyVertex * v, draggedVertices_)
+        v->performAffineTransform(xf);
+
+    foreach(KeyVertex * v, draggedVertices_)
+        v->correctEdgesGeometry();
+}
+
+bool TransformTool::isPreviewing() const
+{
+    return isPreviewing_;
+}
+
+const CellSet & TransformTool::previewedCells() const
+{
+    return previewedCells_;
+}
+
+const Eigen::Affine2d & TransformTool::previewTransform() const
+{
+    return previewXf_;
+}
+
+unsigned int TransformTool::previewVersion() const
+{
+    return previewVersion_;
+}
+
 void TransformTool::endTransform()
 {
+    // Apply deferred transform
+    if (isPreviewing_)
+    {
+        if (!previewXf_.matrix().isIdentity())
+            applyTransform_(previewXf_);
+        isPreviewing_ = false;
+        previewedCells_.clear();
+        previewXf_ = Eigen::Affine2d::Identity();
+        ++previewVersion_;
+    }
+
     draggingManualPivot_ = false;
     transforming_ = false;
     rotating_ = false;
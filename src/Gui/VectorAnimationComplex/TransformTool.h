@@ -73,6 +73,11 @@ public:
     // Picking
     void drawPick(const CellSet & cells, Time time, ViewSettings & viewSettings) const;
     void setHoveredObject(int id);
+
+    // Picking on CPU. Returns the picking ID of the widget closest to (x,y),
+    // within tolerance, and its distance to (x,y). Returns -1 if none.
+    int pick(const CellSet & cells, Time time, double x, double y,
+             double tolerance, ViewSettings & viewSettings, double & distance) const;
     void setNoHoveredObject();
 
     // Transform selection
@@ -80,6 +85,17 @@ public:
     void continueTransform(double x, double y);
     void endTransform();
 
+    // Deferred transform: when the transformed cells form a closed
+    // subcomplex (no other cell is incident to them), their geometry is left
+    // untouched while dragging, and they are drawn under the current
+    // transformation instead, using their cached triangles. The
+    // transformation is applied to their geometry once, by endTransform().
+    // The preview version changes whenever the previewed transformation does
+    bool isPreviewing() const;
+    const CellSet & previewedCells() const;
+    const Eigen::Affine2d & previewTransform() const;
+    unsigned int previewVersion() const;
+
     // Drag and drop transform tool
     void prepareDragAndDrop();
     void performDragAndDrop(double dx, double dy);
@@ -110,6 +126,23 @@ private:
     void drawPivot_(const BoundingBox & bb, ViewSettings & viewSettings) const;
     void drawPickPivot_(const BoundingBox & bb, ViewSettings & viewSettings) const;
 
+    // Bounding box and outline bounding box at the given time of the cells,
+    // which must be the ones given to setCells(). Cached until the
+    // geometry or topology of their VAC changes (see VAC::geometryVersion())
+    void boundingBoxes_(const CellSet & cells, Time time,
+                        BoundingBox & bb, BoundingBox & obb) const;
+    struct BoundingBoxesCache
+    {
+        const CellSet * cells;
+        unsigned int cellsVersion;
+        unsigned int geometryVersion;
+        unsigned int topologyVersion;
+        Time time;
+        BoundingBox bb, obb;
+    };
+    mutable BoundingBoxesCache boundingBoxesCache_;
+    unsigned int cellsVersion_; // changes in setCells()
+
     // Pivot
     bool useAltTransform_() const;
     bool isPivotCached_  () const;
@@ -146,6 +179,13 @@ private:
     double x0_, y0_, dx_, dy_, x_, y_;
     BoundingBox bb0_, obb0_;
     double dTheta_;
+
+    // Deferred transform
+    void applyTransform_(const Eigen::Affine2d & xf);
+    bool isPreviewing_;
+    CellSet previewedCells_;
+    Eigen::Affine2d previewXf_;
+    unsigned int previewVersion_;
 };
 
 }
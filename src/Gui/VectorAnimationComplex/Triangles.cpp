@@ -8,20 +8,358 @@
 
 #include "Triangles.h"
 
+#include "../DevSettings.h"
 #include "../OpenGL.h"
+#include "../GLUtils.h"
+#include "../GLRenderer.h"
+#include "../RenderStats.h"
 #include "../View3DSettings.h"
+#include <QOpenGLContext>
+#include <algorithm>
+#include <cmath>
 #include <limits>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 namespace VectorAnimationComplex
 {
 
+namespace
+{
+
+// Minimum number of triangles for intersection queries to use a bounding
+// volume hierarchy. Below, all triangles are tested
+const int MIN_TREE_SIZE = 32;
+
+}
+
 Triangles::Triangles() :
-    triangles_()
+    vertices_(),
+    indices_(),
+    isIndexed_(false),
+    boundingBox_(),
+    isBoundingBoxDirty_(false),
+    tree_(),
+    isTreeDirty_(true),
+    isRetained_(false),
+    isGpuBufferDirty_(true),
+    gpuBuffer_(0),
+    gpuIndexBuffer_(0),
+    gpuBufferGroup_(0)
+{
+}
+
+Triangles::Triangles(const Triangles & other) :
+    vertices_(other.vertices_),
+    indices_(other.indices_),
+    isIndexed_(other.isIndexed_),
+    boundingBox_(other.boundingBox_),
+    isBoundingBoxDirty_(other.isBoundingBoxDirty_),
+    tree_(),
+    isTreeDirty_(true),
+    isRetained_(other.isRetained_),
+    isGpuBufferDirty_(true),
+    gpuBuffer_(0),
+    gpuIndexBuffer_(0),
+    gpuBufferGroup_(0)
+{
+}
+
+Triangles & Triangles::operator=(const Triangles & other)
+{
+    if (this != &other)
+    {
+        vertices_ = other.vertices_;
+        indices_ = other.indices_;
+        isIndexed_ = other.isIndexed_;
+        boundingBox_ = other.boundingBox_;
+        isBoundingBoxDirty_ = other.isBoundingBoxDirty_;
+        tree_.clear();
+        isTreeDirty_ = true;
+        isRetained_ = other.isRetained_;
+        isGpuBufferDirty_ = true; // keep gpuBuffer_ for re-upload
+    }
+    return *this;
+}
+
+Triangles::~Triangles()
+{
+    releaseGpuBuffer_();
+}
+
+void Triangles::clear()
+{
+    vertices_.clear();
+    indices_.clear();
+    isIndexed_ = false;
+    boundingBox_ = BoundingBox();
+    isBoundingBoxDirty_ = false;
+    setDirty_();
+}
+
+void Triangles::setDirty_()
+{
+    isGpuBufferDirty_ = true;
+    isTreeDirty_ = true;
+}
+
+void Triangles::addToBoundingBox_(const Triangle::Point & v)
 {
+    if (!isBoundingBoxDirty_)
+        boundingBox_.unite(BoundingBox(v[0], v[1]));
+}
+
+Triangles & Triangles::operator<<(const Triangle & t)
+{
+    if (isIndexed_)
+    {
+        const unsigned int i = vertices_.size();
+        indices_.push_back(i);
+        indices_.push_back(i+1);
+        indices_.push_back(i+2);
+    }
+    vertices_.push_back(t.a);
+    vertices_.push_back(t.b);
+    vertices_.push_back(t.c);
+    addToBoundingBox_(t.a);
+    addToBoundingBox_(t.b);
+    addToBoundingBox_(t.c);
+    setDirty_();
+    return *this;
+}
+
+void Triangles::append(double ax, double ay,
+                       double bx, double by,
+                       double cx, double cy)
+{
+    *this << Triangle(Eigen::Vector2d(ax, ay),
+                      Eigen::Vector2d(bx, by),
+                      Eigen::Vector2d(cx, cy));
+}
+
+// Vertices added with addVertex() may be used by any triangle, so the
+// implicit indices of the triangles appended so far must be made explicit
+void Triangles::makeIndexed_()
+{
+    if (!isIndexed_)
+    {
+        indices_.resize(vertices_.size());
+        for (unsigned int i = 0; i < indices_.size(); ++i)
+            indices_[i] = i;
+        isIndexed_ = true;
+    }
+}
+
+int Triangles::addVertex(double x, double y)
+{
+    makeIndexed_();
+    vertices_.push_back(Triangle::Point(x, y));
+    addToBoundingBox_(vertices_.back());
+    setDirty_();
+    return vertices_.size() - 1;
+}
+
+void Triangles::setVertex(int i, double x, double y)
+{
+    // The bounding box may shrink, so it is recomputed on demand
+    vertices_[i] = Triangle::Point(x, y);
+    isBoundingBoxDirty_ = true;
+    setDirty_();
+}
+
+void Triangles::translate(double dx, double dy)
+{
+    const Triangle::Point d(static_cast<TriangleScalar>(dx), static_cast<TriangleScalar>(dy));
+    for (Triangle::Point & v: vertices_)
+        v += d;
+    if (!isBoundingBoxDirty_)
+        boundingBox_.translate(dx, dy);
+    setDirty_();
+}
+
+void Triangles::addTriangle(int i, int j, int k)
+{
+    makeIndexed_();
+    indices_.push_back(i);
+    indices_.push_back(j);
+    indices_.push_back(k);
+    setDirty_();
+}
+
+bool Triangles::interpolate(const Triangles & a, const Triangles & b, double u)
+{
+    if (a.isIndexed_ != b.isIndexed_ ||
+        a.vertices_.size() != b.vertices_.size() ||
+        a.indices_ != b.indices_)
+    {
+        return false;
+    }
+
+    const TriangleScalar v = static_cast<TriangleScalar>(u);
+    vertices_.resize(a.vertices_.size());
+    for (std::size_t i = 0; i < vertices_.size(); ++i)
+        vertices_[i] = a.vertices_[i] + v * (b.vertices_[i] - a.vertices_[i]);
+    indices_ = a.indices_;
+    isIndexed_ = a.isIndexed_;
+    isBoundingBoxDirty_ = true;
+    setDirty_();
+    return true;
+}
+
+Triangle Triangles::operator[](int i) const
+{
+    Triangle res;
+    if (isIndexed_)
+    {
+        res.a = vertices_[indices_[3*i]];
+        res.b = vertices_[indices_[3*i+1]];
+        res.c = vertices_[indices_[3*i+2]];
+    }
+    else
+    {
+        res.a = vertices_[3*i];
+        res.b = vertices_[3*i+1];
+        res.c = vertices_[3*i+2];
+    }
+    return res;
+}
+
+void Triangles::releaseGpuBuffer_()
+{
+    if (gpuBuffer_)
+        GLUtils::deleteBuffer(gpuBuffer_, gpuBufferGroup_);
+    if (gpuIndexBuffer_)
+        GLUtils::deleteBuffer(gpuIndexBuffer_, gpuBufferGroup_);
+    gpuBuffer_ = 0;
+    gpuIndexBuffer_ = 0;
+    gpuBufferGroup_ = 0;
+}
+
+// Binds the GPU buffers, creating or updating them if necessary. Returns false
+// if the triangles should be drawn from client memory instead. In which case,
+// no buffer is bound.
+bool Triangles::bindGpuBuffer_() const
+{
+    if (!isRetained_ || !GLEW_VERSION_1_5)
+        return false;
+
+    QOpenGLContextGroup * group = QOpenGLContextGroup::currentContextGroup();
+    if (!group)
+        return false;
+
+    GLUtils::deleteOrphanedBuffers();
+
+    if (!gpuBuffer_)
+    {
+        glGenBuffers(1, &gpuBuffer_);
+        gpuBufferGroup_ = group;
+        isGpuBufferDirty_ = true;
+    }
+    else if (gpuBufferGroup_ != group)
+    {
+        return false;
+    }
+    if (isIndexed_ && !gpuIndexBuffer_)
+    {
+        glGenBuffers(1, &gpuIndexBuffer_);
+        isGpuBufferDirty_ = true;
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, gpuBuffer_);
+    if (isIndexed_)
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gpuIndexBuffer_);
+    if (isGpuBufferDirty_)
+    {
+        const int n = 2 * vertices_.size();
+        if (sizeof(TriangleScalar) == sizeof(GLfloat))
+        {
+            glBufferData(GL_ARRAY_BUFFER, n * sizeof(GLfloat), vertexData(), GL_STATIC_DRAW);
+        }
+        else
+        {
+            std::vector<GLfloat> floats(vertexData(), vertexData() + n);
+            glBufferData(GL_ARRAY_BUFFER, n * sizeof(GLfloat), floats.data(), GL_STATIC_DRAW);
+        }
+        if (isIndexed_)
+        {
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices_.size() * sizeof(GLuint),
+                         indices_.data(), GL_STATIC_DRAW);
+        }
+        isGpuBufferDirty_ = false;
+    }
+
+    return true;
+}
+
+void Triangles::drawArrays_() const
+{
+    if (vertices_.empty())
+        return;
+
+    RenderStats::add(RenderStats::TrianglesSubmitted, size());
+    if (GLRenderer::beginFlat())
+    {
+        // Shader backend: vertices are either in our GPU buffers, or
+        // streamed, converted to single precision if needed
+        const GLuint location = GLRenderer::POSITION_LOCATION;
+        if (bindGpuBuffer_())
+        {
+            glVertexAttribPointer(location, 2, GL_FLOAT, GL_FALSE, 0, 0);
+        }
+        else
+        {
+            if (sizeof(TriangleScalar) == sizeof(GLfloat))
+            {
+                GLRenderer::streamBuffer(GL_ARRAY_BUFFER, vertexData(), vertices_.size() * 2 * sizeof(GLfloat));
+            }
+            else
+            {
+                std::vector<GLfloat> data(vertexData(), vertexData() + 2 * vertices_.size());
+                GLRenderer::streamBuffer(GL_ARRAY_BUFFER, data.data(), data.size() * sizeof(GLfloat));
+            }
+            glVertexAttribPointer(location, 2, GL_FLOAT, GL_FALSE, 0, 0);
+            if (isIndexed_)
+                GLRenderer::streamBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_.data(), indices_.size() * sizeof(unsigned int));
+        }
+        if (isIndexed_)
+            glDrawElements(GL_TRIANGLES, indices_.size(), GL_UNSIGNED_INT, 0);
+        else
+            glDrawArrays(GL_TRIANGLES, 0, vertices_.size());
+        GLRenderer::endFlat();
+        return;
+    }
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    if (bindGpuBuffer_())
+    {
+        glVertexPointer(2, GL_FLOAT, 0, 0);
+        if (isIndexed_)
+            glDrawElements(GL_TRIANGLES, indices_.size(), GL_UNSIGNED_INT, 0);
+        else
+            glDrawArrays(GL_TRIANGLES, 0, vertices_.size());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    }
+    else
+    {
+        glVertexPointer(2, sizeof(TriangleScalar) == sizeof(GLfloat) ? GL_FLOAT : GL_DOUBLE, 0, vertexData());
+        if (isIndexed_)
+            glDrawElements(GL_TRIANGLES, indices_.size(), GL_UNSIGNED_INT, indices_.data());
+        else
+            glDrawArrays(GL_TRIANGLES, 0, vertices_.size());
+    }
+    glDisableClientState(GL_VERTEX_ARRAY);
 }
 
 bool Triangle::intersects(const Eigen::Vector2d & p) const
 {
+    const Eigen::Vector2d a = this->a.cast<double>();
+    const Eigen::Vector2d b = this->b.cast<double>();
+    const Eigen::Vector2d c = this->c.cast<double>();
+
     double a1 = cross(b-a,p-a);
     double a2 = cross(c-b,p-b);
     double a3 = cross(a-c,p-c);
@@ -105,6 +443,11 @@ bool Triangle::intersects(const BoundingBox & bb) const
     // Triangle-Rectangle intersection test.
     // It is implemented using the Separation Axis Theorem (SAT).
 
+    // Get double precision vertices
+    const Eigen::Vector2d a = this->a.cast<double>();
+    const Eigen::Vector2d b = this->b.cast<double>();
+    const Eigen::Vector2d c = this->c.cast<double>();
+
     // Get aliases for bounding box boundaries
     const double & r_xMin = bb.xMin();
     const double & r_xMax = bb.xMax();
@@ -135,22 +478,299 @@ bool Triangle::intersects(const BoundingBox & bb) const
     return true;
 }
 
-bool Triangles::intersects(const Eigen::Vector2d & p) const
+namespace
+{
+
+// Four triangles, in double precision, with one array per coordinate, as
+// tested at once by intersects4(). Unused lanes of the last batch of a query
+// repeat its last triangle, so that they don't change the result
+struct Triangle4
+{
+    double ax[4], ay[4];
+    double bx[4], by[4];
+    double cx[4], cy[4];
+
+    void set(int k, const Triangle & t)
+    {
+        ax[k] = t.a[0]; ay[k] = t.a[1];
+        bx[k] = t.b[0]; by[k] = t.b[1];
+        cx[k] = t.c[0]; cy[k] = t.c[1];
+    }
+
+    void fillFrom(int k)
+    {
+        for(int l=k+1; l<4; ++l)
+        {
+            ax[l] = ax[k]; ay[l] = ay[k];
+            bx[l] = bx[k]; by[l] = by[k];
+            cx[l] = cx[k]; cy[l] = cy[k];
+        }
+    }
+
+    Triangle get(int k) const
+    {
+        return Triangle(Eigen::Vector2d(ax[k], ay[k]),
+                        Eigen::Vector2d(bx[k], by[k]),
+                        Eigen::Vector2d(cx[k], cy[k]));
+    }
+};
+
+// Same as Triangle::intersects(p) for four triangles at once, with exactly
+// the same arithmetic. Returns a bitmask of the intersected triangles.
+// Vectorized with SSE2 when available
+int intersects4(const Triangle4 & t, const Eigen::Vector2d & p)
+{
+#ifdef __SSE2__
+    const __m128d px = _mm_set1_pd(p[0]);
+    const __m128d py = _mm_set1_pd(p[1]);
+    const __m128d zero = _mm_setzero_pd();
+    int res = 0;
+    for(int h=0; h<4; h+=2)
+    {
+        __m128d Ax = _mm_loadu_pd(t.ax+h), Ay = _mm_loadu_pd(t.ay+h);
+        __m128d Bx = _mm_loadu_pd(t.bx+h), By = _mm_loadu_pd(t.by+h);
+        __m128d Cx = _mm_loadu_pd(t.cx+h), Cy = _mm_loadu_pd(t.cy+h);
+
+        // cross(b-a,p-a), cross(c-b,p-b), cross(a-c,p-c)
+        __m128d a1 = _mm_sub_pd(_mm_mul_pd(_mm_sub_pd(Bx,Ax), _mm_sub_pd(py,Ay)),
+                                _mm_mul_pd(_mm_sub_pd(By,Ay), _mm_sub_pd(px,Ax)));
+        __m128d a2 = _mm_sub_pd(_mm_mul_pd(_mm_sub_pd(Cx,Bx), _mm_sub_pd(py,By)),
+                                _mm_mul_pd(_mm_sub_pd(Cy,By), _mm_sub_pd(px,Bx)));
+        __m128d a3 = _mm_sub_pd(_mm_mul_pd(_mm_sub_pd(Ax,Cx), _mm_sub_pd(py,Cy)),
+                                _mm_mul_pd(_mm_sub_pd(Ay,Cy), _mm_sub_pd(px,Cx)));
+
+        __m128d positive = _mm_and_pd(_mm_and_pd(_mm_cmpge_pd(a1,zero), _mm_cmpge_pd(a2,zero)),
+                                      _mm_cmpge_pd(a3,zero));
+        __m128d negative = _mm_and_pd(_mm_and_pd(_mm_cmple_pd(a1,zero), _mm_cmple_pd(a2,zero)),
+                                      _mm_cmple_pd(a3,zero));
+        res |= _mm_movemask_pd(_mm_or_pd(positive, negative)) << h;
+    }
+    return res;
+#else
+    int res = 0;
+    for(int k=0; k<4; ++k)
+        if(t.get(k).intersects(p))
+            res |= 1 << k;
+    return res;
+#endif
+}
+
+#ifdef __SSE2__
+// Vectorized projectionIntersects(), for two triangles, returning a mask of
+// the pairs for which the projections intersect
+__m128d projectionIntersects2(__m128d ux, __m128d uy,
+                              __m128d r_xMin, __m128d r_xMax, __m128d r_yMin, __m128d r_yMax,
+                              __m128d tx, __m128d ty)
+{
+    // Non-normalized projections of the corners of the rectangle, and of t
+    const __m128d a = _mm_add_pd(_mm_mul_pd(ux,r_xMin), _mm_mul_pd(uy,r_yMin));
+    const __m128d b = _mm_add_pd(_mm_mul_pd(ux,r_xMin), _mm_mul_pd(uy,r_yMax));
+    const __m128d c = _mm_add_pd(_mm_mul_pd(ux,r_xMax), _mm_mul_pd(uy,r_yMax));
+    const __m128d d = _mm_add_pd(_mm_mul_pd(ux,r_xMax), _mm_mul_pd(uy,r_yMin));
+    const __m128d t = _mm_add_pd(_mm_mul_pd(ux,tx), _mm_mul_pd(uy,ty));
+
+    const __m128d zero = _mm_setzero_pd();
+    const __m128d minT = _mm_min_pd(t, zero);
+    const __m128d maxT = _mm_max_pd(t, zero);
+    const __m128d minR = _mm_min_pd(_mm_min_pd(a,b), _mm_min_pd(c,d));
+    const __m128d maxR = _mm_max_pd(_mm_max_pd(a,b), _mm_max_pd(c,d));
+
+    return _mm_and_pd(_mm_cmple_pd(minR,maxT), _mm_cmpge_pd(maxR,minT));
+}
+#endif
+
+// Same as Triangle::intersects(bb) for four triangles at once. Returns a
+// bitmask of the intersected triangles. Vectorized with SSE2 when available
+int intersects4(const Triangle4 & t, const BoundingBox & bb)
 {
-    for (const Triangle & t : triangles_)
-        if (t.intersects(p))
-            return true;
+#ifdef __SSE2__
+    const __m128d r_xMin = _mm_set1_pd(bb.xMin());
+    const __m128d r_xMax = _mm_set1_pd(bb.xMax());
+    const __m128d r_yMin = _mm_set1_pd(bb.yMin());
+    const __m128d r_yMax = _mm_set1_pd(bb.yMax());
+    int res = 0;
+    for(int h=0; h<4; h+=2)
+    {
+        __m128d Ax = _mm_loadu_pd(t.ax+h), Ay = _mm_loadu_pd(t.ay+h);
+        __m128d Bx = _mm_loadu_pd(t.bx+h), By = _mm_loadu_pd(t.by+h);
+        __m128d Cx = _mm_loadu_pd(t.cx+h), Cy = _mm_loadu_pd(t.cy+h);
+
+        // Test against rectangle axes
+        __m128d t_xMin = _mm_min_pd(_mm_min_pd(Ax,Bx), Cx);
+        __m128d t_xMax = _mm_max_pd(_mm_max_pd(Ax,Bx), Cx);
+        __m128d t_yMin = _mm_min_pd(_mm_min_pd(Ay,By), Cy);
+        __m128d t_yMax = _mm_max_pd(_mm_max_pd(Ay,By), Cy);
+        __m128d mask = _mm_and_pd(
+                    _mm_and_pd(_mm_cmple_pd(t_xMin,r_xMax), _mm_cmpge_pd(t_xMax,r_xMin)),
+                    _mm_and_pd(_mm_cmple_pd(t_yMin,r_yMax), _mm_cmpge_pd(t_yMax,r_yMin)));
+        if(_mm_movemask_pd(mask) == 0)
+            continue;
 
+        // Test against triangle axes
+        mask = _mm_and_pd(mask, projectionIntersects2(
+                              _mm_sub_pd(Ay,By), _mm_sub_pd(Bx,Ax),
+                              _mm_sub_pd(r_xMin,Ax), _mm_sub_pd(r_xMax,Ax),
+                              _mm_sub_pd(r_yMin,Ay), _mm_sub_pd(r_yMax,Ay),
+                              _mm_sub_pd(Cx,Ax), _mm_sub_pd(Cy,Ay)));
+        mask = _mm_and_pd(mask, projectionIntersects2(
+                              _mm_sub_pd(By,Cy), _mm_sub_pd(Cx,Bx),
+                              _mm_sub_pd(r_xMin,Bx), _mm_sub_pd(r_xMax,Bx),
+                              _mm_sub_pd(r_yMin,By), _mm_sub_pd(r_yMax,By),
+                              _mm_sub_pd(Ax,Bx), _mm_sub_pd(Ay,By)));
+        mask = _mm_and_pd(mask, projectionIntersects2(
+                              _mm_sub_pd(Cy,Ay), _mm_sub_pd(Ax,Cx),
+                              _mm_sub_pd(r_xMin,Cx), _mm_sub_pd(r_xMax,Cx),
+                              _mm_sub_pd(r_yMin,Cy), _mm_sub_pd(r_yMax,Cy),
+                              _mm_sub_pd(Bx,Cx), _mm_sub_pd(By,Cy)));
+        res |= _mm_movemask_pd(mask) << h;
+    }
+    return res;
+#else
+    int res = 0;
+    for(int k=0; k<4; ++k)
+        if(t.get(k).intersects(bb))
+            res |= 1 << k;
+    return res;
+#endif
+}
+
+// Returns whether the shape (point or rectangle) intersects at least one of
+// the n triangles triangles[index(j)], testing them by batches of four, and
+// returning as soon as a batch has a hit
+template <typename Shape, typename Index>
+bool intersectsAny(const Triangles & triangles, int n, Index index, const Shape & shape)
+{
+    static const DevSettings::Bool batchedTests("batched triangle tests");
+    if(!batchedTests)
+    {
+        for(int j=0; j<n; ++j)
+            if(triangles[index(j)].intersects(shape))
+                return true;
+        return false;
+    }
+
+    Triangle4 batch;
+    int k = 0;
+    for(int j=0; j<n; ++j)
+    {
+        batch.set(k++, triangles[index(j)]);
+        if(k == 4)
+        {
+            if(intersects4(batch, shape))
+                return true;
+            k = 0;
+        }
+    }
+    if(k > 0)
+    {
+        batch.fillFrom(k-1);
+        return intersects4(batch, shape) != 0;
+    }
     return false;
 }
 
+}
+
+// Returns whether intersection queries should use tree_, building it if
+// necessary
+bool Triangles::useTree_() const
+{
+    const int n = size();
+    if (n < MIN_TREE_SIZE)
+        return false;
+
+    if (isTreeDirty_)
+    {
+        std::vector<BoundingBox> boxes;
+        boxes.reserve(n);
+        for (int i = 0; i < n; ++i)
+            boxes.push_back((*this)[i].boundingBox());
+        tree_.build(boxes);
+        isTreeDirty_ = false;
+    }
+    return true;
+}
+
+bool Triangles::intersects(const Eigen::Vector2d & p) const
+{
+    const BoundingBox pointBox(p[0], p[1]);
+    if (!boundingBox().intersects(pointBox))
+        return false;
+
+    if (useTree_())
+    {
+        std::vector<int> candidates;
+        tree_.query(pointBox, candidates);
+        return intersectsAny(*this, candidates.size(), [&](int j) { return candidates[j]; }, p);
+    }
+    else
+    {
+        return intersectsAny(*this, size(), [](int j) { return j; }, p);
+    }
+}
+
 bool Triangles::intersects(const BoundingBox & bb) const
 {
-    for (const Triangle & t : triangles_)
-        if (t.intersects(bb))
-            return true;
+    if (!boundingBox().intersects(bb))
+        return false;
 
-    return false;
+    if (useTree_())
+    {
+        std::vector<int> candidates;
+        tree_.query(bb, candidates);
+        return intersectsAny(*this, candidates.size(), [&](int j) { return candidates[j]; }, bb);
+    }
+    else
+    {
+        return intersectsAny(*this, size(), [](int j) { return j; }, bb);
+    }
+}
+
+namespace
+{
+
+double segmentSquaredDistance(const Eigen::Vector2d & p,
+                              const Eigen::Vector2d & a,
+                              const Eigen::Vector2d & b)
+{
+    const Eigen::Vector2d ab = b - a;
+    const double l2 = ab.squaredNorm();
+    double t = (l2 > 0) ? (p-a).dot(ab) / l2 : 0;
+    t = std::max(0.0, std::min(1.0, t));
+    return (a + t*ab - p).squaredNorm();
+}
+
+}
+
+double Triangle::distance(const Eigen::Vector2d & p) const
+{
+    if (intersects(p))
+        return 0;
+
+    const Eigen::Vector2d a = this->a.cast<double>();
+    const Eigen::Vector2d b = this->b.cast<double>();
+    const Eigen::Vector2d c = this->c.cast<double>();
+    const double d2 = std::min(segmentSquaredDistance(p, a, b),
+                      std::min(segmentSquaredDistance(p, b, c),
+                               segmentSquaredDistance(p, c, a)));
+    return std::sqrt(d2);
+}
+
+double Triangles::distance(const Eigen::Vector2d & p) const
+{
+    double res = std::numeric_limits<double>::infinity();
+    const int n = size();
+    for (int i = 0; i < n; ++i)
+    {
+        const double d = (*this)[i].distance(p);
+        if (d < res)
+        {
+            res = d;
+            if (res == 0)
+                break;
+        }
+    }
+    return res;
 }
 
 BoundingBox Triangle::boundingBox() const
@@ -163,36 +783,47 @@ BoundingBox Triangle::boundingBox() const
 
 BoundingBox Triangles::boundingBox() const
 {
-    BoundingBox bb;
-    for (const Triangle & t : triangles_)
-        bb.unite(t.boundingBox());
-    return bb;
+    if (isBoundingBoxDirty_)
+    {
+        boundingBox_ = computeBoundingBox_();
+        isBoundingBoxDirty_ = false;
+    }
+    return boundingBox_;
 }
 
-void Triangles::draw() const
+BoundingBox Triangles::computeBoundingBox_() const
 {
-    glBegin(GL_TRIANGLES);
-    for (unsigned int i=0; i<triangles_.size(); ++i)
+    if (vertices_.empty())
+        return BoundingBox();
+
+    double xMin = vertices_[0][0], xMax = xMin;
+    double yMin = vertices_[0][1], yMax = yMin;
+    for (const Triangle::Point & v : vertices_)
     {
-        glVertex2d(triangles_[i].a[0], triangles_[i].a[1]);
-        glVertex2d(triangles_[i].b[0], triangles_[i].b[1]);
-        glVertex2d(triangles_[i].c[0], triangles_[i].c[1]);
+        xMin = std::min(xMin, (double) v[0]);
+        xMax = std::max(xMax, (double) v[0]);
+        yMin = std::min(yMin, (double) v[1]);
+        yMax = std::max(yMax, (double) v[1]);
     }
-    glEnd();
+    return BoundingBox(xMin, xMax, yMin, yMax);
+}
+
+void Triangles::draw() const
+{
+    drawArrays_();
 }
 
 void Triangles::draw3D(Time t, View3DSettings & viewSettings) const
 {
+    // Note: this assumes that xFromX2D() and yFromY2D() are the linear
+    // maps x -> x and y -> -y, so that the 2D vertex buffer can be reused
     const double z = viewSettings.zFromT(t);
 
-    glBegin (GL_TRIANGLES);
-    for (unsigned int i=0; i<triangles_.size(); ++i)
-    {
-        glVertex3d(viewSettings.xFromX2D(triangles_[i].a[0]), viewSettings.yFromY2D(triangles_[i].a[1]), z);
-        glVertex3d(viewSettings.xFromX2D(triangles_[i].b[0]), viewSettings.yFromY2D(triangles_[i].b[1]), z);
-        glVertex3d(viewSettings.xFromX2D(triangles_[i].c[0]), viewSettings.yFromY2D(triangles_[i].c[1]), z);
-    }
-    glEnd();
+    glPushMatrix();
+    glTranslated(0, 0, z);
+    glScaled(1, -1, 1);
+    drawArrays_();
+    glPopMatrix();
 }
 
 }
@@ -12,9 +12,11 @@
 #include "../TimeDef.h"
 #include "Eigen.h"
 #include "BoundingBox.h"
+#include "BoundingBoxTree.h"
 #include <vector>
 
 class View3DSettings;
+class QOpenGLContextGroup;
 
 namespace VectorAnimationComplex
 {
@@ -26,17 +28,32 @@ inline double cross(const Eigen::Vector2d & p, const Eigen::Vector2d & q)
     return p[0]*q[1] - p[1]*q[0];
 }
 
+// Scalar type used to store triangles. Triangles are only caches derived from
+// the geometry of cells, which is always stored in double precision, so they
+// can be stored in single precision to halve their memory usage, by building
+// with "CONFIG += float_triangles" (see Gui.pro). Computations on triangles
+// are performed in double precision in either case.
+#ifdef VPAINT_FLOAT_TRIANGLES
+typedef float TriangleScalar;
+#else
+typedef double TriangleScalar;
+#endif
+
 struct Triangle {
+    typedef Eigen::Matrix<TriangleScalar, 2, 1> Point;
+
     Triangle() {}
 
     Triangle(const Eigen::Vector2d & a_,
              const Eigen::Vector2d & b_,
              const Eigen::Vector2d & c_) :
-        a(a_), b(b_), c(c_)
+        a(a_.cast<TriangleScalar>()),
+        b(b_.cast<TriangleScalar>()),
+        c(c_.cast<TriangleScalar>())
     {
     }
 
-    Eigen::Vector2d a, b, c;
+    Point a, b, c;
 
     // Check whether a point p is inside the triangle
     bool intersects(const Eigen::Vector2d & p) const;
@@ -44,47 +61,92 @@ struct Triangle {
     // Check whether a rectangle intersects the triangle
     bool intersects(const BoundingBox & bb) const;
 
+    // Distance between a point p and the triangle (zero if p is inside)
+    double distance(const Eigen::Vector2d & p) const;
+
     // Compute bounding box
     BoundingBox boundingBox() const;
 
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 };
 
+// Triangles: a triangle mesh, made of a vertex array and, optionally, of an
+// index array giving the three vertices of each triangle.
+//
+// Triangles can either be appended one by one, with operator<<() or append(),
+// in which case each triangle has its own three vertices ("triangle soup"),
+// or by adding vertices with addVertex() then triangles referring to them with
+// addTriangle(), in which case vertices can be shared between triangles. The
+// latter is much more compact for strips of triangles, e.g., the quads of
+// strokes, where each vertex is shared by up to six triangles. Both can be
+// mixed in the same instance.
 class Triangles
 {
 public:
     // Build an empty vector of triangles
     Triangles();
 
-    // Clear
-    inline void clear() {triangles_.clear();}
+    // Copy and assignment. Only the CPU-side data is copied: GPU buffers are
+    // never shared between two instances of Triangles
+    Triangles(const Triangles & other);
+    Triangles & operator=(const Triangles & other);
 
-    // Append a triangle
-    inline Triangles & operator<< (const Triangle & t)
-    {
-        triangles_.push_back(t);
-        return *this;
-    }
-    inline void append(double ax, double ay,
-                       double bx, double by,
-                       double cx, double cy)
-    {
-        Triangle t;
-        t.a[0] = ax;
-        t.a[1] = ay;
-        t.b[0] = bx;
-        t.b[1] = by;
-        t.c[0] = cx;
-        t.c[1] = cy;
-        triangles_.push_back(t);
-    }
-
-    // Access and modify content
-    inline int size() const {return triangles_.size();}
-    inline Triangle & operator[] (int i) {return triangles_[i];}
+    // Destructor. Releases the GPU buffers, if any
+    ~Triangles();
 
-    // Access raw data
-    inline double * data() {return reinterpret_cast<double*>(triangles_.data());}
+    // Clear
+    void clear();
+
+    // Append a triangle with its own three vertices
+    Triangles & operator<< (const Triangle & t);
+    void append(double ax, double ay,
+                double bx, double by,
+                double cx, double cy);
+
+    // Add a vertex, and return its index
+    int addVertex(double x, double y);
+
+    // Move an existing vertex, and thus all triangles using it
+    void setVertex(int i, double x, double y);
+
+    // Move all vertices, and thus all triangles, by (dx, dy)
+    void translate(double dx, double dy);
+
+    // Append a triangle made of three existing vertices
+    void addTriangle(int i, int j, int k);
+
+    // Set to the linear interpolation between a (u = 0) and b (u = 1), if
+    // they have the same triangles, only with vertices at different
+    // positions. Returns false, leaving this unchanged, otherwise
+    bool interpolate(const Triangles & a, const Triangles & b, double u);
+
+    // Number of triangles and vertices
+    inline int size() const {return isIndexed_ ? indices_.size() / 3 : vertices_.size() / 3;}
+    inline int numVertices() const {return vertices_.size();}
+
+    // Get the i-th triangle
+    Triangle operator[] (int i) const;
+
+    // Access raw data: x and y coordinates of each vertex and, if isIndexed(),
+    // three vertex indices per triangle. Otherwise, triangle i is made of
+    // vertices 3*i, 3*i+1, and 3*i+2, and indexData() returns null.
+    inline const TriangleScalar * vertexData() const {return reinterpret_cast<const TriangleScalar*>(vertices_.data());}
+    inline bool isIndexed() const {return isIndexed_;}
+    inline const unsigned int * indexData() const {return isIndexed_ ? indices_.data() : 0;}
+
+    // Retained triangles are uploaded to GPU buffers the first time they are
+    // drawn, and these buffers are reused by subsequent draws until the
+    // triangles are modified or destroyed. This is meant for triangles that
+    // are cached and drawn many times (e.g., Cell::triangles(Time)). Non
+    // retained triangles are drawn directly from client memory. The GPU
+    // buffer is always in single precision, which is what OpenGL uses anyway.
+    inline void setRetained(bool b) {isRetained_ = b;}
+    inline bool isRetained() const {return isRetained_;}
+
+    // Intersection queries first test the bounding box, then, for large
+    // meshes (e.g., faces), only the triangles found by a bounding volume
+    // hierarchy over the triangles, built lazily by the first query after
+    // any change.
 
     // Check whether a point p is included is at least one triangle
     bool intersects(const Eigen::Vector2d & p) const;
@@ -92,7 +154,13 @@ public:
     // Check whether a rectangle intersects at least one triangle
     bool intersects(const BoundingBox & bb) const;
 
-    // Compute bounding box
+    // Distance between a point p and the closest triangle (zero if p is
+    // inside a triangle, infinity if there is no triangle)
+    double distance(const Eigen::Vector2d & p) const;
+
+    // Bounding box. It is cached, and updated incrementally as triangles are
+    // appended. Note: all vertices are assumed to be used by at least one
+    // triangle
     BoundingBox boundingBox() const;
 
     // Draw
@@ -102,7 +170,32 @@ public:
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
 private:
-    std::vector<Triangle, Eigen::aligned_allocator<Triangle>> triangles_;
+    std::vector<Triangle::Point, Eigen::aligned_allocator<Triangle::Point>> vertices_;
+    std::vector<unsigned int> indices_; // empty unless isIndexed_
+    bool isIndexed_;
+    void makeIndexed_();
+
+    // Cached bounding box and bounding volume hierarchy
+    mutable BoundingBox boundingBox_;
+    mutable bool isBoundingBoxDirty_;
+    mutable BoundingBoxTree tree_;
+    mutable bool isTreeDirty_;
+    void addToBoundingBox_(const Triangle::Point & v);
+    BoundingBox computeBoundingBox_() const;
+    void setDirty_();
+    bool useTree_() const;
+
+    // GPU vertex and index buffers. They are only valid in the share group of
+    // the OpenGL context they have been created in, which all GLWidgets share.
+    // When drawn in a context of another group, we fall back to client memory
+    bool isRetained_;
+    mutable bool isGpuBufferDirty_;
+    mutable unsigned int gpuBuffer_;
+    mutable unsigned int gpuIndexBuffer_;
+    mutable QOpenGLContextGroup * gpuBufferGroup_;
+    bool bindGpuBuffer_() const;
+    void releaseGpuBuffer_();
+    void drawArrays_() const;
 };
 
 }
@@ -0,0 +1,660 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#include "../OpenGL.h"
+
+#include "Triangulation.h"
+
+#include "../DevSettings.h"
+
+#include <QMutex>
+#include <QMutexLocker>
+#include <QtDebug>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+namespace
+{
+
+using namespace VectorAnimationComplex;
+using namespace VectorAnimationComplex::Triangulation;
+
+// Safeguard against NaN and other oddities
+bool isValidVertex(const std::array<double, 3> & v)
+{
+    const double MAX_VALUE = 10000;
+    const double MIN_VALUE = -10000;
+    return v[0] > MIN_VALUE &&
+           v[0] < MAX_VALUE &&
+           v[1] > MIN_VALUE &&
+           v[1] < MAX_VALUE &&
+           v[2] > MIN_VALUE &&
+           v[2] < MAX_VALUE;
+}
+
+// ---------------------------- Native triangulator ----------------------------
+
+// Non-horizontal edge, oriented upward (y0 < y1)
+struct SweepEdge
+{
+    double x0, y0, x1, y1;
+    double dxdy;
+
+    double x(double y) const { return x0 + (y - y0) * dxdy; }
+};
+
+void appendTrapezoid(const SweepEdge & left, const SweepEdge & right,
+                     double ya, double yb, Triangles & out)
+{
+    if (!(yb > ya))
+        return;
+
+    double xla = left.x(ya);
+    double xra = right.x(ya);
+    double xlb = left.x(yb);
+    double xrb = right.x(yb);
+
+    if (xra > xla)
+        out.append(xla, ya, xra, ya, xrb, yb);
+    if (xrb > xlb)
+        out.append(xla, ya, xrb, yb, xlb, yb);
+}
+
+// ------------------------------ GLU triangulator -----------------------------
+
+// The GLU tesselators are not reentrant. They are only used by worker threads
+// to compute connectivities, see triangulateCoherent()
+QMutex gluMutex;
+
+// Active tesselator
+GLUtesselator * tobj = 0;
+
+// Offline tesselator: outputs the triangulation as offlineTessTriangles
+GLUtesselator * tobjOffline = 0;
+Triangles offlineTessTriangles;
+GLenum offlineTessWhich;
+int offlineTessIter;
+double offlineTessAX, offlineTessAY;
+double offlineTessBX, offlineTessBY;
+double offlineTessCX, offlineTessCY;
+
+#ifdef _WIN32
+#define CALLBACK __stdcall
+#else
+#define CALLBACK
+#endif
+
+void CALLBACK offlineTessBegin(GLenum which)
+{
+    offlineTessWhich = which;
+    offlineTessIter = 0;
+}
+
+void CALLBACK offlineTessEnd(void)
+{
+}
+
+void CALLBACK offlineTessError(GLenum errorCode)
+{
+   const GLubyte *estring;
+   estring = gluErrorString(errorCode);
+
+   qDebug() << "Tessellation Error:" << estring;
+}
+
+void CALLBACK offlineTessVertex(GLvoid *vertex)
+{
+    const GLdouble *pointer = (GLdouble *) vertex;
+
+    if(offlineTessWhich == GL_TRIANGLES)
+    {
+        if(offlineTessIter == 0)
+        {
+            offlineTessAX = pointer[0];
+            offlineTessAY = pointer[1];
+            offlineTessIter = 1;
+        }
+        else if(offlineTessIter == 1)
+        {
+            offlineTessBX = pointer[0];
+            offlineTessBY = pointer[1];
+            offlineTessIter = 2;
+        }
+        else
+        {
+            offlineTessCX = pointer[0];
+            offlineTessCY = pointer[1];
+            offlineTessIter = 0;
+
+            offlineTessTriangles.append(offlineTessAX, offlineTessAY,
+                                        offlineTessBX, offlineTessBY,
+                                        offlineTessCX, offlineTessCY);
+        }
+    }
+    else if(offlineTessWhich == GL_TRIANGLE_FAN)
+    {
+        if(offlineTessIter == 0)
+        {
+            offlineTessAX = pointer[0];
+            offlineTessAY = pointer[1];
+            offlineTessIter = 1;
+        }
+        else if(offlineTessIter == 1)
+        {
+            offlineTessBX = pointer[0];
+            offlineTessBY = pointer[1];
+            offlineTessIter = 2;
+        }
+        else
+        {
+            offlineTessCX = pointer[0];
+            offlineTessCY = pointer[1];
+
+            offlineTessTriangles.append(offlineTessAX, offlineTessAY,
+                                        offlineTessBX, offlineTessBY,
+                                        offlineTessCX, offlineTessCY);
+
+            offlineTessBX = offlineTessCX;
+            offlineTessBY = offlineTessCY;
+        }
+    }
+    else if(offlineTessWhich == GL_TRIANGLE_STRIP)
+    {
+        if(offlineTessIter == 0)
+        {
+            offlineTessAX = pointer[0];
+            offlineTessAY = pointer[1];
+            offlineTessIter = 1;
+        }
+        else if(offlineTessIter == 1)
+        {
+            offlineTessBX = pointer[0];
+            offlineTessBY = pointer[1];
+            offlineTessIter = 2;
+        }
+        else if(offlineTessIter == 2)
+        {
+            offlineTessCX = pointer[0];
+            offlineTessCY = pointer[1];
+
+            offlineTessTriangles.append(offlineTessAX, offlineTessAY,
+                                        offlineTessBX, offlineTessBY,
+                                        offlineTessCX, offlineTessCY);
+
+            offlineTessAX = offlineTessCX;
+            offlineTessAY = offlineTessCY;
+            offlineTessIter = 3;
+        }
+        else
+        {
+            offlineTessCX = pointer[0];
+            offlineTessCY = pointer[1];
+
+            offlineTessTriangles.append(offlineTessAX, offlineTessAY,
+                                        offlineTessBX, offlineTessBY,
+                                        offlineTessCX, offlineTessCY);
+
+            offlineTessBX = offlineTessCX;
+            offlineTessBY = offlineTessCY;
+            offlineTessIter = 2;
+        }
+    }
+    else if(offlineTessWhich == GL_LINE_LOOP)
+    {
+    }
+}
+
+void CALLBACK offlineTessCombine(GLdouble coords[3],
+                        GLdouble * /*vertex_data*/ [4],
+                        GLfloat /*weight*/ [4], GLdouble **dataOut )
+{
+   GLdouble * vertex = (GLdouble *) malloc(6 * sizeof(GLdouble));
+   vertex[0] = coords[0];
+   vertex[1] = coords[1];
+   vertex[2] = coords[2];
+
+   *dataOut = vertex;
+}
+
+
+// Connectivity tesselator: outputs the indices of the vertices of each
+// triangle as connectivityIndices. The edge flag callback guarantees that
+// only independent triangles are output, rather than fans or strips
+GLUtesselator * tobjConnectivity = 0;
+std::vector<unsigned int> * connectivityIndices = 0;
+bool connectivityFailed = false;
+
+void CALLBACK connectivityVertex(GLvoid * vertex)
+{
+    connectivityIndices->push_back(*static_cast<unsigned int *>(vertex));
+}
+
+void CALLBACK connectivityEdgeFlag(GLboolean /*flag*/)
+{
+}
+
+void CALLBACK connectivityError(GLenum /*errorCode*/)
+{
+    connectivityFailed = true;
+}
+
+// Vertices created by the tesselator, at intersections, have no index
+void CALLBACK connectivityCombine(GLdouble /*coords*/ [3],
+                                  void * /*vertex_data*/ [4],
+                                  GLfloat /*weight*/ [4], void ** dataOut )
+{
+    static unsigned int invalidIndex = 0;
+    connectivityFailed = true;
+    *dataOut = &invalidIndex;
+}
+
+// Cross product of (b-a) and (c-a), compared to tolerance
+int orientation(const std::array<double, 3> & a,
+                const std::array<double, 3> & b,
+                const std::array<double, 3> & c,
+                double tolerance)
+{
+    double d = (b[0]-a[0]) * (c[1]-a[1]) - (b[1]-a[1]) * (c[0]-a[0]);
+    return d > tolerance ? 1 : (d < -tolerance ? -1 : 0);
+}
+
+// Orientation tolerance, relative to the size of the polygon
+double orientationTolerance(const std::vector<const std::array<double, 3> *> & vertices)
+{
+    if(vertices.empty())
+        return 0;
+
+    double xMin = (*vertices[0])[0], xMax = xMin;
+    double yMin = (*vertices[0])[1], yMax = yMin;
+    for(const std::array<double, 3> * v: vertices)
+    {
+        xMin = std::min(xMin, (*v)[0]);
+        xMax = std::max(xMax, (*v)[0]);
+        yMin = std::min(yMin, (*v)[1]);
+        yMax = std::max(yMax, (*v)[1]);
+    }
+    double w = xMax - xMin;
+    double h = yMax - yMin;
+    return 1e-10 * (w*w + h*h);
+}
+
+// Compute the connectivity of the given polygon with the GLU tesselator.
+// Returns false if the triangulation requires new vertices
+bool computeConnectivity(const std::vector<const std::array<double, 3> *> & vertices,
+                         const std::vector<int> & contourSizes,
+                         Connectivity & connectivity)
+{
+    QMutexLocker locker(&gluMutex);
+
+    if(!tobjConnectivity)
+    {
+        tobjConnectivity = gluNewTess();
+        gluTessCallback(tobjConnectivity, GLU_TESS_VERTEX,
+                        (GLvoid (CALLBACK*) ()) &connectivityVertex);
+        gluTessCallback(tobjConnectivity, GLU_TESS_EDGE_FLAG,
+                        (GLvoid (CALLBACK*) ()) &connectivityEdgeFlag);
+        gluTessCallback(tobjConnectivity, GLU_TESS_ERROR,
+                        (GLvoid (CALLBACK*) ()) &connectivityError);
+        gluTessCallback(tobjConnectivity, GLU_TESS_COMBINE,
+                        (GLvoid (CALLBACK*) ()) &connectivityCombine);
+        gluTessProperty(tobjConnectivity, GLU_TESS_WINDING_RULE, GLU_TESS_WINDING_ODD);
+    }
+
+    // GLU requires non-const vertex data, which must outlive the polygon
+    const int n = vertices.size();
+    std::vector< std::array<double, 3> > coords(n);
+    std::vector<unsigned int> ids(n);
+    for(int i=0; i<n; ++i)
+    {
+        coords[i] = *vertices[i];
+        ids[i] = i;
+    }
+
+    connectivity.indices.clear();
+    connectivityIndices = &connectivity.indices;
+    connectivityFailed = false;
+    gluTessBeginPolygon(tobjConnectivity, NULL);
+    {
+        int i = 0;
+        for(int size: contourSizes) // for each cycle
+        {
+            gluTessBeginContour(tobjConnectivity);
+            for(int j=0; j<size; ++j, ++i) // for each vertex in cycle
+                gluTessVertex(tobjConnectivity, coords[i].data(), &ids[i]);
+            gluTessEndContour(tobjConnectivity);
+        }
+    }
+    gluTessEndPolygon(tobjConnectivity);
+    connectivityIndices = 0;
+
+    if(connectivityFailed || connectivity.indices.size() % 3 != 0)
+    {
+        connectivity.indices.clear();
+        connectivity.orientations.clear();
+        return false;
+    }
+
+    // Remember the orientation of each triangle
+    const double tolerance = orientationTolerance(vertices);
+    const int numTriangles = connectivity.indices.size() / 3;
+    connectivity.orientations.resize(numTriangles);
+    for(int i=0; i<numTriangles; ++i)
+    {
+        const unsigned int * t = &connectivity.indices[3*i];
+        connectivity.orientations[i] = orientation(*vertices[t[0]], *vertices[t[1]], *vertices[t[2]], tolerance);
+    }
+
+    return true;
+}
+
+// Check that no triangle changed orientation with the new vertex positions
+bool isConnectivityValid(const std::vector<const std::array<double, 3> *> & vertices,
+                         const Connectivity & connectivity)
+{
+    const double tolerance = orientationTolerance(vertices);
+    const int numTriangles = connectivity.orientations.size();
+    for(int i=0; i<numTriangles; ++i)
+    {
+        const unsigned int * t = &connectivity.indices[3*i];
+        if(orientation(*vertices[t[0]], *vertices[t[1]], *vertices[t[2]], tolerance) != connectivity.orientations[i])
+            return false;
+    }
+    return true;
+}
+
+void triangulateWithConnectivity(const std::vector<const std::array<double, 3> *> & vertices,
+                                 const Connectivity & connectivity,
+                                 Triangles & out)
+{
+    out.clear();
+    for(const std::array<double, 3> * v: vertices)
+        out.addVertex((*v)[0], (*v)[1]);
+    const int numTriangles = connectivity.orientations.size();
+    for(int i=0; i<numTriangles; ++i)
+    {
+        const unsigned int * t = &connectivity.indices[3*i];
+        out.addTriangle(t[0], t[1], t[2]);
+    }
+}
+
+}
+
+namespace VectorAnimationComplex
+{
+
+namespace Triangulation
+{
+
+void triangulate(const PolygonData & polygon, Triangles & out)
+{
+    static const DevSettings::Bool nativeTriangulation("native triangulation");
+    if(nativeTriangulation)
+        triangulateNative(polygon, out);
+    else
+        triangulateGlu(polygon, out);
+}
+
+void triangulateNative(const PolygonData & polygon, Triangles & out)
+{
+    out.clear();
+
+    // Collect non-horizontal edges. Horizontal edges never change the
+    // parity of a horizontal line crossing, so they can be ignored.
+    std::vector<SweepEdge> edges;
+    std::vector< std::array<double, 3> > contour;
+    for(auto & vec: polygon) // for each cycle
+    {
+        contour.clear();
+        for(auto & v: vec) // for each vertex in cycle
+        {
+            if(isValidVertex(v))
+                contour.push_back(v);
+            else
+                qDebug() << "ignored vertex" << v[0]  << v[1]  << v[2] << "for tesselation";
+        }
+
+        int n = contour.size();
+        if(n < 3)
+            continue;
+
+        for(int i=0; i<n; ++i)
+        {
+            const std::array<double, 3> & a = contour[i];
+            const std::array<double, 3> & b = contour[(i+1)%n];
+            if(a[1] == b[1])
+                continue;
+
+            SweepEdge e;
+            if(a[1] < b[1]) { e.x0 = a[0]; e.y0 = a[1]; e.x1 = b[0]; e.y1 = b[1]; }
+            else            { e.x0 = b[0]; e.y0 = b[1]; e.x1 = a[0]; e.y1 = a[1]; }
+            e.dxdy = (e.x1 - e.x0) / (e.y1 - e.y0);
+            edges.push_back(e);
+        }
+    }
+    if(edges.size() < 2)
+        return;
+
+    // Events: the y-coordinates of all vertices
+    std::sort(edges.begin(), edges.end(),
+              [](const SweepEdge & a, const SweepEdge & b) { return a.y0 < b.y0; });
+    std::vector<double> events;
+    events.reserve(2*edges.size());
+    for(const SweepEdge & e: edges)
+    {
+        events.push_back(e.y0);
+        events.push_back(e.y1);
+    }
+    std::sort(events.begin(), events.end());
+    events.erase(std::unique(events.begin(), events.end()), events.end());
+
+    // Open trapezoids, indexed by their left edge
+    const int numEdges = edges.size();
+    std::vector<int> openRight(numEdges, -1);
+    std::vector<double> openStart(numEdges, 0.0);
+    std::vector<int> openSlab(numEdges, -1);
+    std::vector<int> openLefts;
+    std::vector<int> nextOpenLefts;
+
+    // Guard against infinite splitting due to floating point inaccuracies.
+    // Past this many slabs, crossings are ignored, possibly producing a few
+    // overlapping triangles rather than hanging.
+    const double minGap = 1e-9 * (std::abs(events.front()) + std::abs(events.back()) + 1.0);
+    const int maxNumSlabs = events.size() + 64 * numEdges;
+    int numSlabs = 0;
+
+    std::vector<int> active;
+    int nextEdge = 0;
+    for(unsigned int i=0; i+1<events.size(); ++i)
+    {
+        const double y0 = events[i];
+        const double y1 = events[i+1];
+
+        // Update active edges
+        active.erase(std::remove_if(active.begin(), active.end(),
+                                    [&](int k) { return edges[k].y1 <= y0; }),
+                     active.end());
+        while(nextEdge < numEdges && edges[nextEdge].y0 <= y0)
+            active.push_back(nextEdge++);
+
+        // Process the band [y0, y1], split at edge intersections
+        double ya = y0;
+        while(ya < y1)
+        {
+            // Sort active edges left to right within the slab
+            std::sort(active.begin(), active.end(), [&](int a, int b) {
+                double xa = edges[a].x(ya), xb = edges[b].x(ya);
+                if(xa != xb)
+                    return xa < xb;
+                return edges[a].x(y1) < edges[b].x(y1);
+            });
+
+            // Find the lowest intersection between consecutive edges
+            double yb = y1;
+            if(numSlabs < maxNumSlabs)
+            {
+                for(unsigned int k=0; k+1<active.size(); ++k)
+                {
+                    const SweepEdge & a = edges[active[k]];
+                    const SweepEdge & b = edges[active[k+1]];
+                    double d1 = b.x(y1) - a.x(y1);
+                    if(d1 < 0)
+                    {
+                        double d0 = b.x(ya) - a.x(ya);
+                        double yc = ya + (y1 - ya) * d0 / (d0 - d1);
+                        yb = std::min(yb, yc);
+                    }
+                }
+                if(yb < ya + minGap)
+                    yb = std::min(ya + minGap, y1);
+            }
+            ++numSlabs;
+
+            // Odd winding: inside intervals are between edges (0,1), (2,3), etc.
+            nextOpenLefts.clear();
+            for(unsigned int k=0; k+1<active.size(); k+=2)
+            {
+                int l = active[k];
+                int r = active[k+1];
+                if(openRight[l] != r)
+                {
+                    if(openRight[l] != -1)
+                        appendTrapezoid(edges[l], edges[openRight[l]], openStart[l], ya, out);
+                    openRight[l] = r;
+                    openStart[l] = ya;
+                }
+                openSlab[l] = numSlabs;
+                nextOpenLefts.push_back(l);
+            }
+            for(int l: openLefts)
+            {
+                if(openSlab[l] != numSlabs && openRight[l] != -1)
+                {
+                    appendTrapezoid(edges[l], edges[openRight[l]], openStart[l], ya, out);
+                    openRight[l] = -1;
+                }
+            }
+            std::swap(openLefts, nextOpenLefts);
+
+            ya = yb;
+        }
+    }
+
+    // Close remaining trapezoids
+    for(int l: openLefts)
+        if(openRight[l] != -1)
+            appendTrapezoid(edges[l], edges[openRight[l]], openStart[l], events.back(), out);
+}
+
+void triangulateGlu(const PolygonData & polygon, Triangles & out)
+{
+    QMutexLocker locker(&gluMutex);
+
+    // Creating the GLU tesselation object
+    if(!tobjOffline)
+    {
+        tobjOffline = gluNewTess();
+    }
+    if(tobj != tobjOffline)
+    {
+        tobj = tobjOffline;
+
+        gluTessCallback(tobj, GLU_TESS_VERTEX,
+                        (GLvoid (CALLBACK*) ()) &offlineTessVertex);
+        gluTessCallback(tobj, GLU_TESS_BEGIN,
+                        (GLvoid (CALLBACK*) ()) &offlineTessBegin);
+        gluTessCallback(tobj, GLU_TESS_END,
+                        (GLvoid (CALLBACK*) ()) &offlineTessEnd);
+        gluTessCallback(tobj, GLU_TESS_ERROR,
+                        (GLvoid (CALLBACK*) ()) &offlineTessError);
+        gluTessCallback(tobj, GLU_TESS_COMBINE,
+                        (GLvoid (CALLBACK*) ()) &offlineTessCombine);
+    }
+
+    // Using the tesselation object
+    gluTessProperty(tobj, GLU_TESS_WINDING_RULE, GLU_TESS_WINDING_ODD);
+
+    // GLU requires non-const vertex data
+    PolygonData vertices = polygon;
+
+    // Specifying data
+    offlineTessTriangles.clear();
+    gluTessBeginPolygon(tobj, NULL);
+    {
+        for(auto & vec: vertices) // for each cycle
+        {
+            gluTessBeginContour(tobj); // draw a contour
+            {
+                for(auto & v: vec) // for each vertex in cycle
+                {
+                    if(isValidVertex(v))
+                    {
+                        gluTessVertex(tobj, v.data(), v.data()); // send vertex
+                    }
+                    else
+                    {
+                        qDebug() << "ignored vertex" << v[0]  << v[1]  << v[2] << "for tesselation";
+                    }
+                }
+            }
+            gluTessEndContour(tobj);
+        }
+    }
+    gluTessEndPolygon(tobj);
+
+    // Tranfer to output
+    out = offlineTessTriangles;
+}
+
+void triangulateCoherent(const PolygonData & polygon, Connectivity & connectivity, Triangles & out)
+{
+    // Flatten polygon
+    std::vector<const std::array<double, 3> *> vertices;
+    std::vector<int> contourSizes;
+    bool isValid = true;
+    for(auto & vec: polygon) // for each cycle
+    {
+        contourSizes.push_back(vec.size());
+        for(auto & v: vec) // for each vertex in cycle
+        {
+            isValid = isValid && isValidVertex(v);
+            vertices.push_back(&v);
+        }
+    }
+
+    // Reuse connectivity if possible
+    bool isSameStructure = (contourSizes == connectivity.contourSizes);
+    if(isSameStructure && connectivity.isReusable && isValid &&
+       isConnectivityValid(vertices, connectivity))
+    {
+        triangulateWithConnectivity(vertices, connectivity, out);
+        return;
+    }
+
+    // Otherwise, compute new connectivity. If none could be found, e.g.
+    // because the polygon self-intersects, only try again after a while
+    // unless the structure changes
+    if(!isSameStructure || connectivity.isReusable || --connectivity.numTriesBeforeRetry <= 0)
+    {
+        connectivity.contourSizes = contourSizes;
+        connectivity.isReusable = isValid && computeConnectivity(vertices, contourSizes, connectivity);
+        if(connectivity.isReusable)
+        {
+            triangulateWithConnectivity(vertices, connectivity, out);
+            return;
+        }
+        connectivity.numTriesBeforeRetry = 60;
+    }
+
+    // Fallback
+    triangulate(polygon, out);
+}
+
+}
+
+}
@@ -0,0 +1,77 @@
+// Copyright (C) 2012-2016 The VPaint Developers.
+// See the COPYRIGHT file at the top-level directory of this distribution
+// and at https://github.com/dalboris/vpaint/blob/master/COPYRIGHT
+//
+// This file is part of VPaint, a vector graphics editor. It is subject to the
+// license terms and conditions in the LICENSE.MIT file found in the top-level
+// directory of this distribution and at http://opensource.org/licenses/MIT
+
+#ifndef VAC_TRIANGULATION_H
+#define VAC_TRIANGULATION_H
+
+// Triangulation of faces, i.e. of polygons made of several, possibly
+// self-intersecting, closed contours, using the odd winding rule.
+//
+// The native triangulator is a sweep-line trapezoidal decomposition: the
+// plane is cut into horizontal slabs at every vertex and every intersection
+// between edges, so that within a slab the edges are sorted left to right,
+// and every other interval between consecutive edges is inside. Consecutive
+// slabs bounded by the same two edges are merged into a single trapezoid.
+// It is self-contained, and does not require an OpenGL context.
+//
+// The GLU tesselator is kept for validation (see "native triangulation" in
+// DevSettings).
+//
+// Polygons moving smoothly over time, e.g. inbetween faces during playback,
+// can instead be triangulated coherently: the connectivity of a previous
+// triangulation is reused as long as it remains valid, and only the vertex
+// positions are updated (see "coherent triangulation" in DevSettings).
+
+#include "Triangles.h"
+
+#include <array>
+#include <vector>
+
+namespace VectorAnimationComplex
+{
+
+namespace Triangulation
+{
+
+// Polygon data: a list of contours, each contour being a list of (x,y,z)
+// positions. The z coordinates are ignored.
+typedef std::vector< std::vector< std::array<double, 3> > > PolygonData;
+
+// Triangulate with the triangulator selected in DevSettings
+void triangulate(const PolygonData & polygon, Triangles & out);
+
+// Triangulate with a specific triangulator
+void triangulateNative(const PolygonData & polygon, Triangles & out);
+void triangulateGlu(const PolygonData & polygon, Triangles & out);
+
+// Connectivity of a triangulation whose vertices are exactly the vertices of
+// a polygon, given as three indices per triangle into the concatenation of
+// its contours
+struct Connectivity
+{
+    Connectivity() : isReusable(false), numTriesBeforeRetry(0) {}
+
+    std::vector<int> contourSizes;
+    std::vector<unsigned int> indices;
+    std::vector<signed char> orientations; // of each triangle: 1, -1, or 0 if degenerate
+    bool isReusable; // false if no such triangulation was found, e.g., for self-intersecting polygons
+    int numTriesBeforeRetry; // when not reusable, until the next attempt with the same structure
+};
+
+// Triangulate, reusing the given connectivity if the polygon has the same
+// number of vertices per contour, and if no triangle flips, degenerates, or
+// unfolds with the new positions. Otherwise, the connectivity is recomputed
+// from scratch, and the polygon is triangulated with triangulate() if no
+// reusable connectivity exists.
+void triangulateCoherent(const PolygonData & polygon, Connectivity & connectivity, Triangles & out);
+
+}
+
+}
+
+#endif // VAC_TRIANGULATION_H
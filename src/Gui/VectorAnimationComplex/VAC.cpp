@@ -29,17 +29,25 @@
 
 #include "EdgeSample.h"
 #include "EdgeGeometry.h"
+#include "BezierSpline.h"
 #include "Intersection.h"
+#include "GeometryCache.h"
+#include "EvaluationContext.h"
+#include "ScratchArena.h"
 
 #include "../GLUtils.h"
 #include "../Timeline.h"
 #include "../SaveAndLoad.h"
 #include "../DevSettings.h"
+#include "../RenderStats.h"
+#include "../OperatorStats.h"
+#include "../Trace.h"
 #include "../Global.h"
 #include "../MainWindow.h"
 #include "../View.h"
 #include "../Color.h"
 #include "../Scene.h"
+#include "../RenderThread.h"
 
 #include "../XmlStreamWriter.h"
 #include "../XmlStreamReader.h"
@@ -51,6 +59,12 @@
 #include <QStatusBar>
 #include <QColorDialog>
 #include <QInputDialog>
+#include <QThread>
+#include <QTimer>
+#include <QtConcurrentMap>
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
 
 #define MYDEBUG 0
 
@@ -64,7 +78,40 @@ namespace
 
 const double PI = 3.14159;
 
-bool isCycleContainedInFace(const Cycle & cycle, const PreviewKeyFace & face)
+// Maximum number of frames whose vertex buffers are kept for the 3D view
+const int MAX_NUM_FRAMES_3D = 1024;
+
+// Minimum number of cells to triangulate for offloading to the worker pool
+const int MIN_PARALLEL_TRIANGULATIONS = 4;
+
+// Triangulation of a cell computed by a worker thread
+struct TriangulationTask
+{
+    const Cell * cell;
+    Triangles triangles;
+};
+
+// Minimum number of cells checked by each worker thread
+const int MIN_CELLS_PER_CHECK_SHARD = 1024;
+
+// Size of the grid cells where the boundary of the faces to cut is bucketed
+const double CUT_FACE_GRID_SIZE = 32.0;
+
+// Geometry of an edge created from a sketched curve: its samples, or cubic
+// Bezier segments fitted to them if "bezier edges" is on
+EdgeGeometry * sketchedGeometry(const SculptCurve::Curve<EdgeSample> & curve, bool loop = false)
+{
+    static const DevSettings::Bool bezierEdges("bezier edges");
+    if(bezierEdges)
+    {
+        BezierSpline * bezier = BezierSpline::fit(curve, DevSettings::getDouble("bezier tolerance"), loop);
+        if(bezier)
+            return bezier;
+    }
+    return new LinearSpline(curve, loop);
+}
+
+bool isCycleContainedInFace(const Cycle & cycle, const Triangles & faceTriangles)
 {
     // Get edges involved in cycle
     KeyEdgeSet cycleEdges = cycle.cells();
@@ -86,7 +133,7 @@ bool isCycleContainedInFace(const Cycle & cycle, const PreviewKeyFace & face)
         for(double s=0; s<L; s+=ds)
         {
             Eigen::Vector2d p = geometry->pos2d(s);
-            if(face.intersects(p[0],p[1]))
+            if(faceTriangles.intersects(p))
             {
                 nInside++;
             }
@@ -102,6 +149,11 @@ bool isCycleContainedInFace(const Cycle & cycle, const PreviewKeyFace & face)
         return false;
 }
 
+bool isCycleContainedInFace(const Cycle & cycle, const PreviewKeyFace & face)
+{
+    return isCycleContainedInFace(cycle, face.triangles());
+}
+
 // return invalid cycle if not found
 Cycle findClosestPlanarCycle(QSet<KeyEdge*> & potentialEdges,
                                     QMap<KeyEdge*,EdgeGeometry::ClosestVertexInfo> & distancesToEdges, double x, double y)
@@ -246,6 +298,43 @@ bool addHoleToPaintedFace(QSet<KeyEdge*> & potentialHoleEdges,
     return false;
 }
 
+// Viewport culling: the visible rect of the view settings, in the coordinates
+// of the cells. Cells whose bounding box does not intersect it are not drawn.
+BoundingBox visibleRect(const ViewSettings & viewSettings)
+{
+    return BoundingBox(viewSettings.visibleXMin(), viewSettings.visibleXMax(),
+                       viewSettings.visibleYMin(), viewSettings.visibleYMax());
+}
+
+// Width of the topology, which is not included in Cell::outlineBoundingBox(Time)
+double outlineMargin(const ViewSettings & viewSettings)
+{
+    double margin = 0.5 * std::max(viewSettings.vertexTopologySize(),
+                                   viewSettings.edgeTopologyWidth());
+    if(viewSettings.screenRelative())
+        margin /= viewSettings.zoom();
+    margin += 3.0; // minimum vertex radius, and pick width of edges
+    return margin;
+}
+
+// Same as above, but enlarged by the width of the topology
+BoundingBox visibleOutlineRect(const ViewSettings & viewSettings)
+{
+    double margin = outlineMargin(viewSettings);
+    return BoundingBox(viewSettings.visibleXMin() - margin, viewSettings.visibleXMax() + margin,
+                       viewSettings.visibleYMin() - margin, viewSettings.visibleYMax() + margin);
+}
+
+bool isVisible(Cell * c, Time time, const BoundingBox & rect)
+{
+    return c->exists(time) && c->boundingBox(time).intersects(rect);
+}
+
+bool isOutlineVisible(Cell * c, Time time, const BoundingBox & rect)
+{
+    return c->exists(time) && c->outlineBoundingBox(time).intersects(rect);
+}
+
 } // end of namespace
 
 
@@ -257,9 +346,12 @@ void VAC::initNonCopyable()
 {
     drawRectangleOfSelection_ = false;
     sketchedEdge_ = 0;
+    isSketchedEdgePending_ = false;
+    sketchPreviewNumVertices_ = 0;
     hoveredFaceOnMousePress_ = 0;
     hoveredFaceOnMouseRelease_ = 0;
     sculptedEdge_ = 0;
+    isDragRigid_ = false;
     toBePaintedFace_ = 0;
     hoveredCell_ = 0;
     transformTool_.setNoHoveredObject();
@@ -274,19 +366,42 @@ void VAC::initCopyable()
     ds_ = 5.0;
     cells_.clear();
     zOrdering_.clear();
+    drawList_.clear();
+    drawList3D_.clear();
+    topologyDrawList_.clear();
+    spatialIndex_.clear();
+    timeIndex_.clear();
+    keyTimeIndex_.clear();
+    planarArrangements_.clear();
+    symbols_.clear();
 }
 
 
 VAC::VAC() :
-    SceneObject()
+    SceneObject(),
+    drawList3D_(MAX_NUM_FRAMES_3D),
+    topologyDrawList_(8, DrawList::Topology),
+    renderMeshCounter_(0),
+    geometryVersion_(0),
+    topologyVersion_(0),
+    isFlushCellChangesScheduled_(false),
+    checkedStateVersion_(0)
 {
     initNonCopyable();
     initCopyable();
+
+    // Validate cells modified by each operation
+    connect(this, &SceneObject::checkpoint, this, [this] () {
+        static const DevSettings::Bool checkAfterOperations("check after operations");
+        if(checkAfterOperations)
+            checkModified();
+    });
 }
 
 VAC::~VAC()
 {
     deleteAllCells();
+    delete sketchedEdge_;
 }
 
 QString VAC::stringType()
@@ -296,6 +411,16 @@ QString VAC::stringType()
 
 
 VAC * VAC::clone()
+{
+    std::vector<Cell*> cells;
+    for(auto c: zOrdering_)
+        cells.push_back(c);
+    VAC * newVAC = clone_(cells);
+    newVAC->symbols_.copyFrom(symbols_);
+    return newVAC;
+}
+
+VAC * VAC::clone_(const std::vector<Cell*> & cells)
 {
     // Create new Graph
     VAC * newVAC = new VAC();
@@ -307,81 +432,90 @@ VAC * VAC::clone()
     newVAC->ds_ = ds_;
 
     // Copy cells
-    foreach(Cell * cell, cells_)
+    newVAC->cells_.reserve(maxID_);
+    newVAC->zOrdering_.reserve(cells.size());
+    for(Cell * cell: cells)
     {
         Cell * newCell = cell->clone();
-        newVAC->cells_[newCell->id()] = newCell;
+        newVAC->cells_.insert(newCell->id(), newCell);
         newCell->setSelected(false);
         newCell->setHovered(false);
     }
-    foreach(Cell * newCell, newVAC->cells_)
+    for(Cell * cell: cells)
+    {
+        Cell * newCell = newVAC->getCell(cell->id());
         newCell->remapPointers(newVAC);
-    for(auto c: zOrdering_)
-        newVAC->zOrdering_.insertLast(newVAC->getCell(c->id()));
+        newVAC->zOrdering_.insertLast(newCell);
+    }
 
     return newVAC;
 }
 
-// returns a map such as mp[oldID] = newID
-QMap<int,int> VAC::import(VAC * other, bool selectImportedCells)
+// returns a table such as res[oldID] = newID, or -1 if other has no cell with this ID
+std::vector<int> VAC::import(VAC * other, bool selectImportedCells)
 {
-    QMap<int,int> res;
-
-    // Create copy
+    // Create copy, and move its cells into this VAC
     VAC * copyOfOther = other->clone();
+    std::vector<int> idMap;
+    importCells_(copyOfOther, idMap, selectImportedCells);
+    delete copyOfOther;
+    return idMap;
+}
 
-    // Create copy of zOrdering, since removing cells
-    // from copyOfOther invalidate iteration on zOrdering
-    QList<Cell*> ordering;
-    for(auto c: copyOfOther->zOrdering_)
-    {
-        ordering << c;
-    }
+void VAC::importCells_(VAC * other, std::vector<int> & idMap, bool selectImportedCells)
+{
+    // Preallocate cell storage. New IDs are assigned in z-order
+    int numCells = other->cells_.size();
+    cells_.reserve(maxID_ + numCells);
+    zOrdering_.reserve(cells_.size() + numCells);
+    idMap.assign(other->maxID_ + 1, -1);
 
-    // Take ownership of all cells
-    foreach(Cell * c, ordering)
+    // Take ownership of all cells. They are then all removed from other at
+    // once, instead of one by one
+    for(auto c: other->zOrdering_)
     {
         int oldID = c->id();
-        copyOfOther->removeCell_(c);
         insertCellLast_(c);
         if(selectImportedCells)
             addToSelection(c,false);
-        res[oldID] = c->id();
+        idMap[oldID] = c->id();
     }
-
-    // Delete copy of vac
-    delete copyOfOther;
-
-    return res;
+    other->initCopyable();
 }
 
 VAC * VAC::subcomplex(const CellSet & subcomplexCells)
 {
-    // Get closure of cells
+    // Get closure of cells. Only these cells are copied, so the boundary
+    // of each of them must be included too
     CellSet cellsToKeep = Algorithms::closure(subcomplexCells);
-    CellSet cellsToDelete = cells();
-    cellsToDelete.subtract(cellsToKeep);
-    QList<int> idToDelete;
-    foreach(Cell * c, cellsToDelete)
-        idToDelete << c->id();
-
-    // Create new Graph
-    VAC * newVAC = clone();
-
-    // Delete all cells but the one to keep
-    foreach (double id, idToDelete)
+    int numCellsToKeep = 0;
+    while(numCellsToKeep != cellsToKeep.size())
     {
-        if(newVAC->cells_.contains(id))
-            newVAC->deleteCell(newVAC->getCell(id));
+        numCellsToKeep = cellsToKeep.size();
+        cellsToKeep = Algorithms::closure(cellsToKeep);
     }
 
-    // Return subcomplex
-    return newVAC;
+    // Sort them in z-order
+    std::vector<Cell*> cells(cellsToKeep.begin(), cellsToKeep.end());
+    std::sort(cells.begin(), cells.end(), [this](Cell * c1, Cell * c2) {
+        return zOrdering_.isBelow(c1, c2);
+    });
+
+    // Copy them, with the same IDs
+    return clone_(cells);
+}
+
+void VAC::reportMemory(MemoryStats::Report & report) const
+{
+    report.add(MemoryStats::Cells, cells_.numBytes());
+    for(Cell * c: cells_)
+        c->reportMemory(report);
+    report.add(MemoryStats::BoundingBoxCache, spatialIndex_.numBytes());
 }
 
 // ------------------------- Drawing ---------------------------
 
-void VAC::drawSketchedEdge(Time time, ViewSettings & /*viewSettings*/) const
+void VAC::drawSketchedEdge(Time time, ViewSettings & viewSettings) const
 {
     if(!sketchedEdge_)
         return;
@@ -405,31 +539,42 @@ void VAC::drawSketchedEdge(Time time, ViewSettings & /*viewSettings*/) const
         return Eigen::Vector2d(-v[1],v[0]);
     };
 
-    // draw quad strip
-    glBegin(GL_QUAD_STRIP);
-    Eigen::Vector2d u = getNormal((*sketchedEdge_)[0].x(), (*sketchedEdge_)[0].y(),
-            (*sketchedEdge_)[1].x(), (*sketchedEdge_)[1].y());
-    Eigen::Vector2d p( (*sketchedEdge_)[0].x(), (*sketchedEdge_)[0].y() );
-    Eigen::Vector2d A = p + (*sketchedEdge_)[0].width() * 0.5 * u;
-    Eigen::Vector2d B = p - (*sketchedEdge_)[0].width() * 0.5 * u;
-    glVertex2d(A[0], A[1]);
-    glVertex2d(B[0], B[1]);
-    p = Eigen::Vector2d( (*sketchedEdge_)[1].x(), (*sketchedEdge_)[1].y() );
-    A = p + (*sketchedEdge_)[1].width() * 0.5 * u;
-    B = p - (*sketchedEdge_)[1].width() * 0.5 * u;
-    glVertex2d(A[0], A[1]);
-    glVertex2d(B[0], B[1]);
-    for(int i=2; i<(*sketchedEdge_).size(); i++)
-    {
-        Eigen::Vector2d u = getNormal((*sketchedEdge_)[i-1].x(), (*sketchedEdge_)[i-1].y(),
-                (*sketchedEdge_)[i].x(), (*sketchedEdge_)[i].y());
-        p = Eigen::Vector2d( (*sketchedEdge_)[i].x(), (*sketchedEdge_)[i].y() );
-        A = p + (*sketchedEdge_)[i].width() * 0.5 * u;
-        B = p - (*sketchedEdge_)[i].width() * 0.5 * u;
+    // draw quad strip, from the sketch buffer if possible
+    static const DevSettings::Bool useSketchBuffer("sketch buffer");
+    bool isStripDrawn = false;
+    if(useSketchBuffer)
+    {
+        sketchBuffer_.update(sketchedEdge_->curve());
+        isStripDrawn = sketchBuffer_.drawStroke();
+    }
+    Eigen::Vector2d p, A, B;
+    if(!isStripDrawn)
+    {
+        glBegin(GL_QUAD_STRIP);
+        Eigen::Vector2d u = getNormal((*sketchedEdge_)[0].x(), (*sketchedEdge_)[0].y(),
+                (*sketchedEdge_)[1].x(), (*sketchedEdge_)[1].y());
+        p = Eigen::Vector2d( (*sketchedEdge_)[0].x(), (*sketchedEdge_)[0].y() );
+        A = p + (*sketchedEdge_)[0].width() * 0.5 * u;
+        B = p - (*sketchedEdge_)[0].width() * 0.5 * u;
+        glVertex2d(A[0], A[1]);
+        glVertex2d(B[0], B[1]);
+        p = Eigen::Vector2d( (*sketchedEdge_)[1].x(), (*sketchedEdge_)[1].y() );
+        A = p + (*sketchedEdge_)[1].width() * 0.5 * u;
+        B = p - (*sketchedEdge_)[1].width() * 0.5 * u;
         glVertex2d(A[0], A[1]);
         glVertex2d(B[0], B[1]);
+        for(int i=2; i<(*sketchedEdge_).size(); i++)
+        {
+            Eigen::Vector2d u = getNormal((*sketchedEdge_)[i-1].x(), (*sketchedEdge_)[i-1].y(),
+                    (*sketchedEdge_)[i].x(), (*sketchedEdge_)[i].y());
+            p = Eigen::Vector2d( (*sketchedEdge_)[i].x(), (*sketchedEdge_)[i].y() );
+            A = p + (*sketchedEdge_)[i].width() * 0.5 * u;
+            B = p - (*sketchedEdge_)[i].width() * 0.5 * u;
+            glVertex2d(A[0], A[1]);
+            glVertex2d(B[0], B[1]);
+        }
+        glEnd();
     }
-    glEnd();
 
     // Start cap
     int n = 50;
@@ -457,6 +602,22 @@ void VAC::drawSketchedEdge(Time time, ViewSettings & /*viewSettings*/) const
         }
     }
     glEnd();
+
+    // Preview of intersections with existing edges
+    glColor4d(1.0, 0.0, 0.0, 1.0);
+    r = 3.0 / viewSettings.zoom();
+    for(const Eigen::Vector2d & q: sketchPreviewIntersections_)
+    {
+        glBegin(GL_POLYGON);
+        {
+            for(int i=0; i<n; ++i)
+            {
+                double theta = 2 * (double) i * 3.14159 / (double) n ;
+                glVertex2d(q.x() + r*std::cos(theta),q.y()+ r*std::sin(theta));
+            }
+        }
+        glEnd();
+    }
 }
 
 void VAC::drawTopologySketchedEdge(Time time, ViewSettings & viewSettings) const
@@ -472,6 +633,13 @@ void VAC::drawTopologySketchedEdge(Time time, ViewSettings & viewSettings) const
 
     glColor4d(0.18,0.60,0.90,1);
     glLineWidth(viewSettings.edgeTopologyWidth());
+    static const DevSettings::Bool useSketchBuffer("sketch buffer");
+    if(useSketchBuffer)
+    {
+        sketchBuffer_.update(sketchedEdge_->curve());
+        if(sketchBuffer_.drawCenterline())
+            return;
+    }
     glBegin(GL_LINE_STRIP);
     for(int i=0; i<(*sketchedEdge_).size(); i++)
         glVertex2d((*sketchedEdge_)[i].x(), (*sketchedEdge_)[i].y());
@@ -584,20 +752,368 @@ void VAC::drawInbetweenCells3D(View3DSettings & viewSettings)
         glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 }
 
+// Draws the cells of one frame of the 3D view, which draws many frames at
+// once, with a different transform each: their vertex buffers are all kept,
+// so that only the transform changes when the camera moves
+void VAC::drawFrame3D(Time time, ViewSettings & view2DSettings)
+{
+    static const DevSettings::Bool batchDrawing("batch drawing");
+    triangulateCells_(time);
+    if(batchDrawing)
+    {
+        drawList3D_.draw(zOrdering_, time, view2DSettings);
+    }
+    else
+    {
+        for(auto c: zOrdering_)
+            c->draw(time, view2DSettings);
+    }
+}
+
 void VAC::drawPick3D(View3DSettings & /*viewSettings*/)
 {
 }
 
+void VAC::triangulateCells_(Time time)
+{
+    std::vector<Cell*> cells;
+    for(auto c: zOrdering_)
+        cells.push_back(c);
+    triangulateCells_(cells, time, MIN_PARALLEL_TRIANGULATIONS);
+}
+
+void VAC::triangulateCells_(const std::vector<Cell*> & cells, Time time, int minNumTriangulations)
+{
+    static const DevSettings::Bool parallelTriangulation("parallel triangulation");
+    static const DevSettings::Bool nativeTriangulation("native triangulation");
+    if(!parallelTriangulation)
+        return;
+
+    // Collect faces and inbetween edges existing at this time whose triangles
+    // are not cached yet. Only the native triangulator is reentrant. Faces
+    // filled by stencil are only triangulated if needed.
+    bool triangulateFaces = nativeTriangulation && !FaceCell::isStencilFilled();
+    std::vector<TriangulationTask> tasks;
+    CellSet cellsToTriangulate;
+    for(Cell * c: cells)
+    {
+        if(((triangulateFaces && c->toFaceCell()) || c->toInbetweenEdge()) &&
+           c->exists(time) && !c->hasCachedTriangles(time))
+        {
+            TriangulationTask task;
+            task.cell = c;
+            tasks.push_back(task);
+            cellsToTriangulate << c;
+        }
+    }
+    if((int) tasks.size() < minNumTriangulations)
+        return;
+
+    // Compute the sampling of all edges the cells depend on
+    EvaluationContext context = EvaluationContext::current();
+    prepareSampling_(cellsToTriangulate, context);
+
+    // Triangulate in parallel
+    QtConcurrent::blockingMap(tasks, [time, &context](TriangulationTask & task) {
+        task.cell->computeTriangles(time, context, task.triangles);
+    });
+
+    // Cache results. This must be done in the GUI thread, since the
+    // geometry cache is not thread-safe
+    for(const TriangulationTask & task: tasks)
+        task.cell->setCachedTriangles(time, task.triangles);
+}
+
+void VAC::prefetchGeometry(Time time)
+{
+    VPAINT_TRACE_ZONE("VAC::prefetchGeometry");
+    std::vector<Cell*> cells;
+    for(auto c: zOrdering_)
+        cells.push_back(c);
+    triangulateCells_(cells, time, 1);
+}
+
+int VAC::readDeferredGeometry(Time time, int maxNumEdges)
+{
+    VPAINT_TRACE_ZONE("VAC::readDeferredGeometry");
+
+    std::vector<KeyEdge*> edges;
+    for(int id: cells_.ids(KeyEdgeKind))
+    {
+        KeyEdge * kedge = cells_[id]->toKeyEdge();
+        if(!kedge->isGeometryRead())
+            edges.push_back(kedge);
+    }
+
+    // Closest edges first
+    int frame = time.frame();
+    auto isCloser = [frame](KeyEdge * a, KeyEdge * b) {
+        return std::abs(a->frame() - frame) < std::abs(b->frame() - frame);
+    };
+    int numRemaining = static_cast<int>(edges.size());
+    if(numRemaining > maxNumEdges)
+    {
+        std::nth_element(edges.begin(), edges.begin() + maxNumEdges, edges.end(), isCloser);
+        edges.resize(maxNumEdges);
+    }
+    numRemaining -= static_cast<int>(edges.size());
+
+    // Each edge only reads its own geometry
+    if(DevSettings::getBool("parallel loading"))
+    {
+        QtConcurrent::blockingMap(edges, [](KeyEdge * kedge) {
+            kedge->readLazyGeometry_();
+        });
+    }
+    else
+    {
+        for(KeyEdge * kedge: edges)
+            kedge->readLazyGeometry_();
+    }
+
+    return numRemaining;
+}
+
+void VAC::prepareSampling_(const CellSet & cells, const EvaluationContext & context)
+{
+    // The geometry of key edges is loaded lazily and their arclengths and
+    // sampling are computed lazily, which is not thread-safe. Compute them
+    // beforehand for all key edges the cells depend on, i.e., in the closure
+    // of the cells and of their inbetween edges, so that worker threads only
+    // read them.
+    CellSet boundary = Algorithms::closure(cells);
+    KeyEdgeSet keyEdges = Algorithms::closure(boundary);
+    foreach(KeyEdge * e, keyEdges)
+    {
+        e->geometry()->length();
+        e->geometry()->sampling();
+    }
+
+    // Then resample the key paths of inbetween edges in parallel, since each
+    // edge only writes its own cached samplings
+    InbetweenEdgeSet inbetweenEdges = boundary;
+    std::vector<InbetweenEdge*> edges(inbetweenEdges.begin(), inbetweenEdges.end());
+    QtConcurrent::blockingMap(edges, [&context](InbetweenEdge * e) {
+        e->prepareSampling(context);
+    });
+}
+
+void VAC::prepareInbetweenCells_(int firstId, Time time)
+{
+    static const DevSettings::Bool parallelTriangulation("parallel triangulation");
+    if(!parallelTriangulation)
+        return;
+
+    // Get new inbetween edges and faces
+    CellSet newCells;
+    for(int id = firstId; id <= maxID_; ++id)
+    {
+        Cell * c = cells_.value(id);
+        if(c && c->toInbetweenCell() && !c->toVertexCell())
+            newCells << c;
+    }
+    if(newCells.isEmpty())
+        return;
+
+    // Resample the key paths of new inbetween edges, and of the inbetween
+    // edges new faces depend on
+    prepareSampling_(newCells, EvaluationContext::current());
+
+    // Triangulate new cells existing at this time
+    std::vector<Cell*> cells(newCells.begin(), newCells.end());
+    triangulateCells_(cells, time, 1);
+}
+
+void VAC::drawCells_(Time time, ViewSettings & viewSettings)
+{
+    RenderStats::ScopedTimer timer(RenderStats::DrawCells);
+
+    symbols_.draw(this, time, viewSettings, false);
+
+    static const DevSettings::Bool batchDrawing("batch drawing");
+    if(batchDrawing)
+    {
+        if(transformTool_.isPreviewing())
+            drawList_.setTransformedCells(transformTool_.previewedCells(), transformTool_.previewTransform());
+        else
+            drawList_.clearTransformedCells();
+        drawList_.draw(zOrdering_, time, viewSettings);
+    }
+    else
+    {
+        BoundingBox rect = visibleRect(viewSettings);
+        for(auto c: zOrdering_)
+        {
+            if(isPreviewedTransformed_(c))
+            {
+                glPushMatrix();
+                GLUtils::multMatrix(transformTool_.previewTransform());
+                c->draw(time, viewSettings);
+                glPopMatrix();
+            }
+            else if(isVisible(c, time, rect))
+            {
+                c->draw(time, viewSettings);
+            }
+        }
+    }
+}
+
+void VAC::drawCellsTopology_(Time time, ViewSettings & viewSettings)
+{
+    RenderStats::ScopedTimer timer(RenderStats::DrawTopology);
+
+    symbols_.draw(this, time, viewSettings, true);
+
+    static const DevSettings::Bool batchDrawing("batch drawing");
+    if(batchDrawing)
+    {
+        if(transformTool_.isPreviewing())
+            topologyDrawList_.setTransformedCells(transformTool_.previewedCells(), transformTool_.previewTransform());
+        else
+            topologyDrawList_.clearTransformedCells();
+        topologyDrawList_.draw(zOrdering_, time, viewSettings);
+    }
+    else
+    {
+        BoundingBox rect = visibleOutlineRect(viewSettings);
+        for(auto c: zOrdering_)
+        {
+            if(isPreviewedTransformed_(c))
+            {
+                glPushMatrix();
+                GLUtils::multMatrix(transformTool_.previewTransform());
+                c->drawTopology(time, viewSettings);
+                glPopMatrix();
+            }
+            else if(isOutlineVisible(c, time, rect))
+            {
+                c->drawTopology(time, viewSettings);
+            }
+        }
+    }
+}
+
+bool VAC::buildRenderPacket(Time time, ViewSettings & viewSettings, RenderPacket & packet)
+{
+    // Cells drawn with a transformation don't fit in a packet, including
+    // instances of symbols
+    if(transformTool_.isPreviewing() || symbols_.hasInstances())
+        return false;
+
+    triangulateCells_(time);
+
+    // Passes drawn, in this order
+    ViewSettings::DisplayMode displayMode = viewSettings.displayMode();
+    bool isTopology[2];
+    int numPasses = 0;
+    if(displayMode != ViewSettings::OUTLINE)
+        isTopology[numPasses++] = false;
+    if(displayMode != ViewSettings::ILLUSTRATION)
+        isTopology[numPasses++] = true;
+
+    ++renderMeshCounter_;
+    BoundingBox rect = visibleRect(viewSettings);
+    BoundingBox outlineRect = visibleOutlineRect(viewSettings);
+    for(int pass=0; pass<numPasses; ++pass)
+    {
+        const bool topology = isTopology[pass];
+        QHash<int, RenderMeshEntry> & meshes = renderMeshes_[topology ? 1 : 0];
+        for(auto c: zOrdering_)
+        {
+            if(topology ? !isOutlineVisible(c, time, outlineRect) : !isVisible(c, time, rect))
+                continue;
+
+            // Cells with a custom drawing don't fit in a packet
+            if(!topology && !c->isBatchable(time))
+                return false;
+
+            // Copy triangles, unless unchanged since last packet
+            const Triangles & triangles = topology ? c->drawnTopologyTriangles(time, viewSettings)
+                                                   : c->drawnTriangles(time, viewSettings);
+            RenderMeshEntry & entry = meshes[c->id()];
+            if(!entry.mesh ||
+               entry.geometryVersion != c->geometryVersion() ||
+               entry.triangles != &triangles ||
+               entry.numTriangles != triangles.size())
+            {
+                std::shared_ptr<RenderMesh> mesh = std::make_shared<RenderMesh>();
+                const TriangleScalar * data = triangles.vertexData();
+                mesh->vertices.assign(data, data + 2 * triangles.numVertices());
+                if(triangles.isIndexed())
+                    mesh->indices.assign(triangles.indexData(), triangles.indexData() + 3 * triangles.size());
+                entry.mesh = mesh;
+                entry.geometryVersion = c->geometryVersion();
+                entry.triangles = &triangles;
+                entry.numTriangles = triangles.size();
+            }
+            entry.lastUsed = renderMeshCounter_;
+            if(entry.mesh->vertices.empty())
+                continue;
+
+            QColor color = topology ? c->topologyColor() : c->drawColor(time, viewSettings);
+            RenderPacket::Item item;
+            item.mesh = entry.mesh;
+            item.color[0] = color.redF();
+            item.color[1] = color.greenF();
+            item.color[2] = color.blueF();
+            item.color[3] = color.alphaF();
+            packet.items.push_back(item);
+        }
+    }
+
+    // Release copies of cells not drawn recently, e.g. deleted cells
+    const unsigned int MAX_UNUSED_PACKETS = 8;
+    for(int i=0; i<2; ++i)
+    {
+        QHash<int, RenderMeshEntry> & meshes = renderMeshes_[i];
+        for(auto it = meshes.begin(); it != meshes.end(); )
+        {
+            if(renderMeshCounter_ - it->lastUsed > MAX_UNUSED_PACKETS)
+                it = meshes.erase(it);
+            else
+                ++it;
+        }
+    }
+
+    return true;
+}
+
+bool VAC::isPreviewedTransformed_(Cell * c) const
+{
+    return transformTool_.isPreviewing() && transformTool_.previewedCells().contains(c);
+}
+
 void VAC::draw(Time time, ViewSettings & viewSettings)
 {
+    VPAINT_TRACE_ZONE("VAC::draw");
+    RenderStats::ScopedTimer timer(RenderStats::VACDraw);
+
+    // Evict least recently used cached geometry if above memory budget.
+    // This is safe here since no reference to cached geometry is held.
+    GeometryCache::setMaxBytes(std::size_t(DevSettings::getInt("geometry cache (MB)")) * 1024 * 1024);
+    GeometryCache::trim();
+
+    // Quantize time coarsely while playing back subframes, interpolating in
+    // between, rather than triangulating inbetween cells up to 60 times per
+    // frame. Otherwise, the finest quantum is used, which makes no
+    // difference for exact frames.
+    Timeline * timeline = global()->timeline();
+    bool isPlayingSubframes = timeline && timeline->isPlaying() && timeline->subframeInbetweening();
+    GeometryCache::setTimeQuantum(isPlayingSubframes ? DevSettings::getInt("subframe time quantum") :
+                                                       GeometryCache::MAX_TIME_QUANTUM);
+    GeometryCache::setInterpolation(isPlayingSubframes && DevSettings::getBool("subframe interpolation"));
+
+    // Triangulate faces and inbetween edges not cached yet using all cores
+    triangulateCells_(time);
+
     ViewSettings::DisplayMode displayMode = viewSettings.displayMode();
 
     // Illustration mode
     if( (displayMode == ViewSettings::ILLUSTRATION))
     {
         // Draw all cells
-        for(auto c: zOrdering_)
-            c->draw(time, viewSettings);
+        drawCells_(time, viewSettings);
 
         // Draw sketched edge
         if(sketchedEdge_)
@@ -608,8 +1124,7 @@ void VAC::draw(Time time, ViewSettings & viewSettings)
     else if( (displayMode == ViewSettings::OUTLINE) )
     {
         // Draw all cells
-        for(auto c: zOrdering_)
-            c->drawTopology(time, viewSettings);
+        drawCellsTopology_(time, viewSettings);
 
         // Draw sketched edge
         if(sketchedEdge_)
@@ -620,18 +1135,49 @@ void VAC::draw(Time time, ViewSettings & viewSettings)
     else if( (displayMode == ViewSettings::ILLUSTRATION_OUTLINE) )
     {
         // First pass
-        for(auto c: zOrdering_)
-            c->draw(time, viewSettings);
+        drawCells_(time, viewSettings);
         if(sketchedEdge_)
             drawSketchedEdge(time, viewSettings);
 
         // Second pass
-        for(auto c: zOrdering_)
-            c->drawTopology(time, viewSettings);
+        drawCellsTopology_(time, viewSettings);
         if(sketchedEdge_)
             drawTopologySketchedEdge(time, viewSettings);
     }
 
+    // Draw tools and cursors
+    drawTools_(time, viewSettings);
+}
+
+void VAC::drawCells(Time time, ViewSettings & viewSettings)
+{
+    triangulateCells_(time);
+    ViewSettings::DisplayMode displayMode = viewSettings.displayMode();
+    if(displayMode != ViewSettings::OUTLINE)
+        drawCells_(time, viewSettings);
+    if(displayMode != ViewSettings::ILLUSTRATION)
+        drawCellsTopology_(time, viewSettings);
+}
+
+void VAC::drawOverlays(Time time, ViewSettings & viewSettings)
+{
+    ViewSettings::DisplayMode displayMode = viewSettings.displayMode();
+    if(sketchedEdge_)
+    {
+        if(displayMode != ViewSettings::OUTLINE)
+            drawSketchedEdge(time, viewSettings);
+        if(displayMode != ViewSettings::ILLUSTRATION)
+            drawTopologySketchedEdge(time, viewSettings);
+    }
+    drawTools_(time, viewSettings);
+}
+
+void VAC::drawTools_(Time time, ViewSettings & viewSettings)
+{
+    RenderStats::ScopedTimer timer(RenderStats::Overlays);
+
+    ViewSettings::DisplayMode displayMode = viewSettings.displayMode();
+
     // Draw to be painted face
     if( (global()->toolMode() == Global::PAINT) &&
             toBePaintedFace_)
@@ -791,7 +1337,8 @@ void VAC::draw(Time time, ViewSettings & viewSettings)
     }
 
     // Draw edge orientation
-    if(DevSettings::getBool("draw edge orientation"))
+    static const DevSettings::Bool drawEdgeOrientation("draw edge orientation");
+    if(drawEdgeOrientation)
     {
         KeyEdgeSet edges = cells();
         foreach(KeyEdge * e, edges)
@@ -809,7 +1356,7 @@ void VAC::draw(Time time, ViewSettings & viewSettings)
         {
             if(se->exists(time))
             {
-                QList<EdgeSample> samples = se->getSampling(time);
+                EdgeSampleVector samples = se->getSampling(time);
                 LinearSpline ls(samples);
                 double l = ls.length();
                 Eigen::Vector2d p = ls.pos2d(0.5*l);
@@ -823,13 +1370,16 @@ void VAC::draw(Time time, ViewSettings & viewSettings)
 void VAC::drawPick(Time time, ViewSettings & viewSettings)
 {
     ViewSettings::DisplayMode displayMode = viewSettings.displayMode();
+    BoundingBox rect = visibleRect(viewSettings);
+    BoundingBox outlineRect = visibleOutlineRect(viewSettings);
 
     if( (displayMode == ViewSettings::ILLUSTRATION) )
     {
         // Draw all cells
         for(auto c: zOrdering_)
         {
-            c->drawPick(time, viewSettings);
+            if(isVisible(c, time, rect))
+                c->drawPick(time, viewSettings);
         }
     }
 
@@ -838,7 +1388,8 @@ void VAC::drawPick(Time time, ViewSettings & viewSettings)
         // Draw all cells
         for(auto c: zOrdering_)
         {
-            c->drawPickTopology(time, viewSettings);
+            if(isOutlineVisible(c, time, outlineRect))
+                c->drawPickTopology(time, viewSettings);
         }
     }
 
@@ -847,7 +1398,7 @@ void VAC::drawPick(Time time, ViewSettings & viewSettings)
         // first pass: pick faces normally
         for(auto c: zOrdering_)
         {
-            if(c->toFaceCell())
+            if(c->toFaceCell() && isVisible(c, time, rect))
                 c->drawPick(time, viewSettings);
         }
 
@@ -855,7 +1406,7 @@ void VAC::drawPick(Time time, ViewSettings & viewSettings)
         // second pass: pick vertices and edges as outline
         for(auto c: zOrdering_)
         {
-            if(!c->toFaceCell())
+            if(!c->toFaceCell() && isOutlineVisible(c, time, outlineRect))
                 c->drawPickTopology(time, viewSettings);
         }
     }
@@ -867,6 +1418,73 @@ void VAC::drawPick(Time time, ViewSettings & viewSettings)
     }
 }
 
+// Same as drawPick(), but on CPU: finds the closest cell to (x,y) among what
+// drawPick() would draw, using the spatial index to only test nearby cells.
+// Priority is given to objects drawn on top, as long as (x,y) is inside them
+int VAC::pick(Time time, double x, double y, double tolerance,
+              ViewSettings & viewSettings, double & distance)
+{
+    ScratchArena::Scope scratchScope;
+    ViewSettings::DisplayMode displayMode = viewSettings.displayMode();
+    BoundingBox rect(x - tolerance, x + tolerance, y - tolerance, y + tolerance);
+    double margin = outlineMargin(viewSettings);
+    BoundingBox outlineRect(x - tolerance - margin, x + tolerance + margin,
+                            y - tolerance - margin, y + tolerance + margin);
+
+    // Transform tool, drawn on top of everything. It wins ties.
+    int res = -1;
+    distance = std::numeric_limits<double>::infinity();
+    if(global()->toolMode() == Global::SELECT && viewSettings.isMainDrawing())
+    {
+        res = transformTool_.pick(selectedCells_, time, x, y, tolerance, viewSettings, distance);
+        if(res != -1 && distance == 0)
+            return res;
+    }
+
+    // Cells
+    ScratchVector<Cell*> cells;
+    auto pickCells = [&](bool topology, bool faces, bool edgesAndVertices)
+    {
+        cells.clear();
+        if(topology)
+            spatialIndex_.outlineCells(zOrdering_, time, outlineRect, cells);
+        else
+            spatialIndex_.cells(zOrdering_, time, rect, cells);
+        for(Cell * c: cells)
+        {
+            bool isFace = c->toFaceCell();
+            if((isFace && !faces) || (!isFace && !edgesAndVertices))
+                continue;
+            double d = topology ? c->pickTopologyDistance(x, y, time, viewSettings) :
+                                  c->pickDistance(x, y, time, viewSettings);
+            if(d <= tolerance && d < distance)
+            {
+                distance = d;
+                res = c->id();
+                if(d == 0)
+                    return true;
+            }
+        }
+        return false;
+    };
+
+    if( (displayMode == ViewSettings::ILLUSTRATION) )
+    {
+        pickCells(false, true, true);
+    }
+    else if( (displayMode == ViewSettings::OUTLINE) )
+    {
+        pickCells(true, true, true);
+    }
+    else if( (displayMode == ViewSettings::ILLUSTRATION_OUTLINE) )
+    {
+        // vertices and edges are picked as outline, on top of faces
+        if(!pickCells(true, false, true))
+            pickCells(false, true, false);
+    }
+
+    return res;
+}
 
 void VAC::emitSelectionChanged_()
 {
@@ -903,6 +1521,7 @@ void VAC::endAggregateSignals_()
             transformTool_.setCells(selectedCells());
             emit selectionChanged();
         }
+        flushCellChanges();
     }
 }
 
@@ -934,46 +1553,89 @@ void VAC::deselect(Time /*time*/, int id)
     removeFromSelection(getCell(id),false);
 }
 
-void VAC::toggle(Time /*time*/, int id)
+void VAC::toggle(Time /*time*/, int id)
+{
+    toggleSelection(getCell(id),false);
+}
+
+void VAC::deselectAll(Time time)
+{
+    CellSet cellsToDeselect;
+    foreach(Cell * cell, selectedCells())
+        if(cell->exists(time))
+            cellsToDeselect << cell;
+    removeFromSelection(cellsToDeselect,false);
+}
+
+void VAC::deselectAll()
+{
+    if(numSelectedCells() != 0)
+        setSelectedCells(CellSet(),false);
+}
+
+void VAC::invertSelection()
+{
+    if(!isBulkSelectionChange_(cells_.size()))
+    {
+        QSet<Cell *> newSelectedCells = cells();
+        newSelectedCells.subtract(selectedCells());
+        setSelectedCells(newSelectedCells);
+        return;
+    }
+
+    // One pass flipping the flags, the closure and summary being rebuilt
+    // on next access
+    CellSet newSelectedCells;
+    newSelectedCells.reserve(cells_.size() - selectedCells_.size());
+    for(Cell * cell: cells_)
+    {
+        cell->setSelected(!cell->isSelected());
+        if(cell->isSelected())
+            newSelectedCells << cell;
+    }
+    selectedCells_.swap(newSelectedCells);
+    processSelectionReset_();
+    emit changed();
+}
+
+Cell * VAC::hoveredCell() const
+{
+    return hoveredCell_;
+}
+
+const CellSet & VAC::selectedCells() const
 {
-    toggleSelection(getCell(id),false);
+    return selectedCells_;
 }
 
-void VAC::deselectAll(Time time)
+int VAC::numSelectedCells() const
 {
-    CellSet cellsToDeselect;
-    foreach(Cell * cell, selectedCells())
-        if(cell->exists(time))
-            cellsToDeselect << cell;
-    removeFromSelection(cellsToDeselect,false);
+    return selectedCells_.size();
 }
 
-void VAC::deselectAll()
+int VAC::numSelectedCells(SelectionSummary::CellType type)
 {
-    if(numSelectedCells() != 0)
-        setSelectedCells(CellSet(),false);
+    return selectionSummary_.numCells(type, selectedCells_);
 }
 
-void VAC::invertSelection()
+QVector<double> VAC::keyTimes(double t1, double t2)
 {
-    QSet<Cell *> newSelectedCells = cells();
-    newSelectedCells.subtract(selectedCells());
-    setSelectedCells(newSelectedCells);
+    return keyTimeIndex_.keyTimes(t1, t2, cells_, zOrdering_);
 }
 
-Cell * VAC::hoveredCell() const
+QVector< QPair<double, double> > VAC::inbetweenLifespans(double t1, double t2)
 {
-    return hoveredCell_;
+    return keyTimeIndex_.inbetweenLifespans(t1, t2, cells_, zOrdering_);
 }
 
-const CellSet & VAC::selectedCells() const
+QVector<double> VAC::selectedKeyTimes()
 {
-    return selectedCells_;
+    return selectionSummary_.keyTimes(selectedCells_);
 }
 
-int VAC::numSelectedCells() const
+QVector< QPair<double, double> > VAC::selectedInbetweenLifespans()
 {
-    return selectedCells_.size();
+    return selectionSummary_.inbetweenLifespans(selectedCells_);
 }
 
 int VAC::hoveredTransformWidgetId() const
@@ -987,6 +1649,7 @@ void VAC::write(XmlStreamWriter & xml)
 {
     for(Cell * cell: zOrdering_)
         cell->write(xml);
+    symbols_.write(xml);
 }
 
 void VAC::clear()
@@ -1000,10 +1663,14 @@ void VAC::read(XmlStreamReader & xml)
 {
     clear();
 
+    int numElements = 0;
     while (xml.readNextStartElement())
     {
         Cell * cell = 0;
 
+        if(++numElements % 1024 == 0)
+            xml.checkProgress();
+
         if(xml.name() == "vertex")
             cell = new KeyVertex(this, xml);
         else if(xml.name() == "edge")
@@ -1016,6 +1683,11 @@ void VAC::read(XmlStreamReader & xml)
             cell = new InbetweenEdge(this, xml);
         else if(xml.name() == "inbetweenface")
             cell = new InbetweenFace(this, xml);
+        else if(xml.name() == "symbol")
+        {
+            symbols_.read(xml);
+            continue;
+        }
 
         xml.skipCurrentElement(); // XXX this should be in "Cell(this, xml)"
 
@@ -1029,17 +1701,58 @@ void VAC::read(XmlStreamReader & xml)
         }
     }
 
+    // Cells may refer to cells which were not read
+    if(xml.isCanceled())
+        return;
+
+    // In lazy loading mode, the geometry of edges outside the playback range
+    // is only read when first needed, so that opening a long animation takes
+    // time proportional to the frames being edited. The reader may also
+    // give the range itself, e.g. to read the current frame first.
+    Timeline * timeline = global()->timeline();
+    bool lazy = DevSettings::getBool("lazy loading") && timeline;
+    int firstFrame = timeline ? timeline->firstFrame() : 0;
+    int lastFrame = timeline ? timeline->lastFrame() : 0;
+    if(xml.hasEagerFrames())
+    {
+        lazy = true;
+        firstFrame = xml.firstEagerFrame();
+        lastFrame = xml.lastEagerFrame();
+    }
+
+    // Parse edge geometries, which is most of the reading time. Each edge
+    // only parses its own data, so this can be done in parallel.
+    std::vector<KeyEdge*> edges;
+    for(int id: cells_.ids(KeyEdgeKind))
+    {
+        KeyEdge * edge = cells_[id]->toKeyEdge();
+        const bool isInRange = firstFrame <= edge->frame() && edge->frame() <= lastFrame;
+        if(!(lazy && !isInRange && edge->deferGeometry_()))
+            edges.push_back(edge);
+    }
+    if(DevSettings::getBool("parallel loading"))
+    {
+        QtConcurrent::blockingMap(edges, [](KeyEdge * edge) {
+            edge->readGeometry_();
+        });
+    }
+    else
+    {
+        for(KeyEdge * edge: edges)
+            edge->readGeometry_();
+    }
+
     read2ndPass_();
 }
 
 void VAC::read2ndPass_()
 {
     // Convert temp IDs (int) to pointers (Cell*)
-    foreach(Cell * cell, cells_)
+    for(Cell * cell: cells_)
         cell->read2ndPass();
 
     // Create star from boundary
-    foreach(Cell * cell, cells_)
+    for(Cell * cell: cells_)
     {
         CellSet spatialBoundary = cell->spatialBoundary();
         foreach(Cell * bcell, spatialBoundary)
@@ -1054,15 +1767,33 @@ void VAC::read2ndPass_()
             cell->addMeToTemporalStarBeforeOf_(bcell);
     }
 
-    // Clean geometry
-    foreach(Cell * cell, cells_)
+    // Clean geometry. Resampling edges only modifies their own geometry,
+    // so it can be done in parallel, but notifying the cells that depend on
+    // them must be done serially.
+    std::vector<KeyEdge*> edges;
+    for(int id: cells_.ids(KeyEdgeKind))
     {
-        KeyEdge * kedge = cell->toKeyEdge();
-        if(kedge)
-        {
-            kedge->correctGeometry();
-        }
+        KeyEdge * kedge = cells_[id]->toKeyEdge();
+        if(kedge->isGeometryRead() && kedge->geometry())
+            edges.push_back(kedge);
+    }
+    if(DevSettings::getBool("parallel loading"))
+    {
+        QtConcurrent::blockingMap(edges, [](KeyEdge * kedge) {
+            kedge->correctGeometryShape_();
+        });
     }
+    else
+    {
+        for(KeyEdge * kedge: edges)
+            kedge->correctGeometryShape_();
+    }
+    for(KeyEdge * kedge: edges)
+        kedge->processGeometryChanged_();
+
+    // Report corrupted documents now rather than when they crash
+    if(DevSettings::getBool("check on load"))
+        check();
 }
 
 void VAC::save_(QTextStream & out)
@@ -1081,7 +1812,21 @@ void VAC::save_(QTextStream & out)
     out << "\n" << Save::indent() << "]";
 }
 
-void VAC::exportSVG_(Time t, QTextStream & out)
+void VAC::prepareExportSVG()
+{
+    // The geometry of key edges, when lazy loading is on, and the sampling of
+    // inbetween edges are computed lazily, which is not thread-safe. Compute
+    // them beforehand, so that frames can then be exported concurrently.
+    for(Cell * c: zOrdering_)
+    {
+        if(KeyEdge * e = c->toKeyEdge())
+            e->geometry();
+        else if(InbetweenEdge * e = c->toInbetweenEdge())
+            e->prepareSampling();
+    }
+}
+
+void VAC::exportSVG_(Time t, SvgStreamWriter & out)
 {
     // list of objects
     for(Cell * c: zOrdering_)
@@ -1092,7 +1837,13 @@ void VAC::exportSVG_(Time t, QTextStream & out)
 }
 
 VAC::VAC(QTextStream & in) :
-    SceneObject()
+    SceneObject(),
+    drawList3D_(MAX_NUM_FRAMES_3D),
+    topologyDrawList_(8, DrawList::Topology),
+    renderMeshCounter_(0),
+    geometryVersion_(0),
+    topologyVersion_(0),
+    isFlushCellChangesScheduled_(false)
 {
     clear();
 
@@ -1123,10 +1874,12 @@ VAC::VAC(QTextStream & in) :
 
 Cell * VAC::getCell(int id)
 {
-    if(cells_.contains(id))
-        return cells_[id];
-    else
-        return 0;
+    return cells_.value(id);
+}
+
+int VAC::numCells(int kind) const
+{
+    return int(cells_.ids(kind).size());
 }
 
 KeyVertex * VAC::getKeyVertex(int id)
@@ -1172,53 +1925,195 @@ const ZOrderedCells & VAC::zOrdering() const
     return zOrdering_;
 }
 
+unsigned int VAC::drawingVersion(Time time, bool includeHovered) const
+{
+    // Hash the stamps of all cells existing at this time, in drawing order
+    unsigned int res = 2166136261u;
+    if(!includeHovered)
+        res = (res ^ transformTool_.hovered()) * 16777619u;
+    res = (res ^ transformTool_.previewVersion()) * 16777619u;
+    for(auto it = zOrdering_.cbegin(); it != zOrdering_.cend(); ++it)
+    {
+        const Cell * c = *it;
+        if(c->exists(time))
+        {
+            unsigned int flags = (c->isSelected() ? 1 : 0) | (includeHovered && c->isHovered() ? 2 : 0);
+            res = (res ^ c->id()) * 16777619u;
+            res = (res ^ c->stateVersion()) * 16777619u;
+            res = (res ^ c->geometryVersion()) * 16777619u;
+            res = (res ^ flags) * 16777619u;
+        }
+    }
+    if(symbols_.hasInstances())
+        res = (res ^ symbols_.drawingVersion(const_cast<VAC*>(this), time)) * 16777619u;
+    return res;
+}
+
+const Symbols & VAC::symbols() const
+{
+    return symbols_;
+}
+
+void VAC::processCellGeometryChanged_(Cell * cell)
+{
+    ++geometryVersion_;
+    spatialIndex_.processGeometryChanged(cell);
+    processCellModified_(cell);
+}
+
+void VAC::processCellTopologyChanged_(Cell * cell)
+{
+    ++topologyVersion_;
+    processCellModified_(cell);
+}
+
+void VAC::addObserver(CellObserver * observer)
+{
+    observers_.insert(observer);
+}
+
+void VAC::removeObserver(CellObserver * observer)
+{
+    observers_.remove(observer);
+    if(observers_.isEmpty())
+        cellChanges_.clear();
+}
+
+void VAC::processCellCreated_(Cell * cell)
+{
+    if(observers_.isEmpty())
+        return;
+
+    cellChanges_.created.insert(cell->id());
+    scheduleFlushCellChanges_();
+}
+
+void VAC::processCellDeleted_(Cell * cell)
+{
+    if(observers_.isEmpty())
+        return;
+
+    const int id = cell->id();
+    cellChanges_.modified.remove(id);
+    if(!cellChanges_.created.remove(id))
+        cellChanges_.deleted.insert(id);
+    scheduleFlushCellChanges_();
+}
+
+// Cells are modified before being given an ID while they are built: they are
+// then reported as created only
+void VAC::processCellModified_(Cell * cell)
+{
+    if(observers_.isEmpty())
+        return;
+
+    const int id = cell->id();
+    if(id < 0 || cellChanges_.created.contains(id))
+        return;
+
+    cellChanges_.modified.insert(id);
+    scheduleFlushCellChanges_();
+}
+
+void VAC::scheduleFlushCellChanges_()
+{
+    // Flushed by endAggregateSignals_() if a transaction is open, but also
+    // scheduled in case it isn't, or the changes happen after it ended
+    if(!isFlushCellChangesScheduled_)
+    {
+        isFlushCellChangesScheduled_ = true;
+        QTimer::singleShot(0, this, [this]() { flushCellChanges(); });
+    }
+}
+
+void VAC::flushCellChanges()
+{
+    isFlushCellChangesScheduled_ = false;
+    if(cellChanges_.isEmpty())
+        return;
+
+    // Observers may change the VAC, starting a new transaction
+    CellChanges changes;
+    std::swap(changes, cellChanges_);
+    IncidenceList<CellObserver> observers = observers_;
+    for(CellObserver * observer: observers)
+        if(observers_.contains(observer))
+            observer->observedCellsChanged(this, changes);
+}
+
+void VAC::cells(Time time, const BoundingBox & rect, ScratchVector<Cell*> & out)
+{
+    spatialIndex_.cells(zOrdering_, time, rect, out);
+}
+
+BoundingBox VAC::boundingBox(Time time)
+{
+    return spatialIndex_.boundingBox(zOrdering_, time);
+}
+
+BoundingBox VAC::selectionBoundingBox(Time time) const
+{
+    BoundingBox res;
+    for(Cell * c: selectedCells_)
+        if(c->exists(time))
+            res.unite(c->boundingBox(time));
+    return res;
+}
+
 CellSet VAC::cells()
 {
     CellSet res;
-    foreach(Cell * obj, cells_)
+    for(Cell * obj: cells_)
         res << obj;
     return res;
 }
 
+namespace
+{
+// IDs of the cells of both kinds, in increasing order
+std::vector<int> mergedIds(const CellTable & cells, int kind1, int kind2)
+{
+    const std::vector<int> & ids1 = cells.ids(kind1);
+    const std::vector<int> & ids2 = cells.ids(kind2);
+    std::vector<int> res(ids1.size() + ids2.size());
+    std::merge(ids1.begin(), ids1.end(), ids2.begin(), ids2.end(), res.begin());
+    return res;
+}
+}
+
 VertexCellList VAC::vertices()
 {
     VertexCellList res;
-    foreach(Cell * o, cells_)
-    {
-        VertexCell *node = o->toVertexCell();
-        if(node)
-            res << node;
-    }
+    std::vector<int> ids = mergedIds(cells_, KeyVertexKind, InbetweenVertexKind);
+    res.reserve(ids.size());
+    for(int id: ids)
+        res << cells_[id]->toVertexCell();
     return res;
 }
 KeyVertexList VAC::instantVertices()
 {
     KeyVertexList res;
-    foreach(Cell * o, cells_)
-    {
-        KeyVertex *node = o->toKeyVertex();
-        if(node)
-            res << node;
-    }
+    const std::vector<int> & ids = cells_.ids(KeyVertexKind);
+    res.reserve(ids.size());
+    for(int id: ids)
+        res << cells_[id]->toKeyVertex();
     return res;
 }
 
 EdgeCellList VAC::edges()
 {
     EdgeCellList res;
-    foreach(Cell * o, cells_)
-    {
-        EdgeCell *edge = o->toEdgeCell();
-        if(edge)
-            res << edge;
-    }
+    std::vector<int> ids = mergedIds(cells_, KeyEdgeKind, InbetweenEdgeKind);
+    res.reserve(ids.size());
+    for(int id: ids)
+        res << cells_[id]->toEdgeCell();
     return res;
 }
 
 EdgeCellList VAC::edges(Time time)
 {
     EdgeCellList res;
-    foreach(Cell * o, cells_)
+    for(Cell * o: timeIndex_.cells(cells_, zOrdering_, time))
     {
         EdgeCell *edge = o->toEdgeCell();
         if(edge && edge->exists(time))
@@ -1230,12 +2125,10 @@ EdgeCellList VAC::edges(Time time)
 FaceCellList VAC::faces()
 {
     FaceCellList res;
-    foreach(Cell * o, cells_)
-    {
-        FaceCell *face = o->toFaceCell();
-        if(face)
-            res << face;
-    }
+    std::vector<int> ids = mergedIds(cells_, KeyFaceKind, InbetweenFaceKind);
+    res.reserve(ids.size());
+    for(int id: ids)
+        res << cells_[id]->toFaceCell();
     return res;
 }
 
@@ -1243,19 +2136,17 @@ FaceCellList VAC::faces()
 KeyEdgeList VAC::instantEdges()
 {
     KeyEdgeList res;
-    foreach(Cell * o, cells_)
-    {
-        KeyEdge * iedge = o->toKeyEdge();
-        if(iedge)
-            res << iedge;
-    }
+    const std::vector<int> & ids = cells_.ids(KeyEdgeKind);
+    res.reserve(ids.size());
+    for(int id: ids)
+        res << cells_[id]->toKeyEdge();
     return res;
 }
 
 KeyVertexList VAC::instantVertices(Time time)
 {
     KeyVertexList res;
-    foreach(Cell * o, cells_)
+    for(Cell * o: timeIndex_.cells(cells_, zOrdering_, time))
     {
         KeyVertex *node = o->toKeyVertex();
         if(node && node->exists(time))
@@ -1267,7 +2158,7 @@ KeyVertexList VAC::instantVertices(Time time)
 KeyEdgeList VAC::instantEdges(Time time)
 {
     KeyEdgeList res;
-    foreach(Cell * o, cells_)
+    for(Cell * o: timeIndex_.cells(cells_, zOrdering_, time))
     {
         KeyEdge * iedge = o->toKeyEdge();
         if(iedge && iedge->exists(time))
@@ -1290,7 +2181,10 @@ void VAC::insertCell_(Cell * cell)
     cell->id_ = id;
     cell->vac_ = this;
     cells_.insert(id, cell);
+    processCellCreated_(cell);
+    const unsigned int zOrderingVersion = zOrdering_.version();
     zOrdering_.insertCell(cell);
+    keyTimeIndex_.insertCell(cell, zOrderingVersion, zOrdering_.version());
 }
 
 void VAC::insertCellLast_(Cell * cell)
@@ -1299,7 +2193,19 @@ void VAC::insertCellLast_(Cell * cell)
     cell->id_ = id;
     cell->vac_ = this;
     cells_.insert(id, cell);
+    processCellCreated_(cell);
+    const unsigned int zOrderingVersion = zOrdering_.version();
     zOrdering_.insertLast(cell);
+    keyTimeIndex_.insertCell(cell, zOrderingVersion, zOrdering_.version());
+}
+
+void VAC::registerCell_(Cell * cell)
+{
+    int id = getAvailableID();
+    cell->id_ = id;
+    cell->vac_ = this;
+    cells_.insert(id, cell);
+    processCellCreated_(cell);
 }
 
 void VAC::removeCell_(Cell * cell)
@@ -1307,7 +2213,9 @@ void VAC::removeCell_(Cell * cell)
     if(cell)
     {
         cells_.remove(cell->id());
+        const unsigned int zOrderingVersion = zOrdering_.version();
         zOrdering_.removeCell(cell);
+        keyTimeIndex_.removeCell(cell, zOrderingVersion, zOrdering_.version());
         removeFromSelection(cell,false);
         if(cell->isSelected())
         {
@@ -1333,6 +2241,8 @@ void VAC::removeCell_(Cell * cell)
 
 void VAC::smartDelete_(const CellSet & cellsToDelete)
 {
+    OperatorStats::ScopedTimer operatorTimer(OperatorStats::SmartDelete);
+
     // Note: we know that deleting or simplifying a cell of dimension N
     // leave untouched any cell of dimension <= N.
 
@@ -1354,6 +2264,11 @@ void VAC::smartDelete_(const CellSet & cellsToDelete)
     KeyEdgeSet edgesToDelete= cellsToDelete;
     KeyVertexSet verticesToDelete = cellsToDelete;
 
+    // Cells may be simplified several times, or modified and then deleted.
+    // Only clear their cached geometry and emit selection changes at the end
+    beginAggregateSignals_();
+    Cell::beginDeferGeometryChanges_();
+
     foreach(KeyFace * iface, facesToDelete)
         smartDeleteCell(iface);
 
@@ -1362,6 +2277,9 @@ void VAC::smartDelete_(const CellSet & cellsToDelete)
 
     foreach(KeyVertex * ivertex, verticesToDelete)
         smartDeleteCell(ivertex);
+
+    Cell::endDeferGeometryChanges_();
+    endAggregateSignals_();
 }
 
 void VAC::smartDelete()
@@ -1449,12 +2367,17 @@ void VAC::deleteCells(const CellSet & cells)
 
 void VAC::deleteCell(Cell * cell)
 {
+    // Cells depending on the deferred geometry change of this cell, if any,
+    // can't be found anymore once its star is destroyed
+    cell->processDeferredGeometryChange_();
+
     // Recusrively delete star cells first (complex remains valid upon return)
     cell->destroyStar();
 
     // Inform observers of the upcoming deletion
     foreach(CellObserver * observer, cell->observers_)
         observer->observedCellDeleted(cell);
+    processCellDeleted_(cell);
 
     // Remove the cell from the star of its boundary
     cell->informBoundaryImGettingDestroyed();
@@ -1558,6 +2481,15 @@ void VAC::setMaxID_(int maxID)
     transformTool_.setIdOffset(maxID_+1);
 }
 
+// Straight invisible edge
+EdgeGeometry * VAC::straightGeometry_(KeyVertex * left, KeyVertex * right, double width)
+{
+    EdgeSample startSample(left->pos()[0], left->pos()[1], width);
+    EdgeSample endSample(right->pos()[0], right->pos()[1], width);
+    SculptCurve::Curve<EdgeSample> curve(startSample, endSample);
+    return new LinearSpline(curve);
+}
+
 KeyVertex* VAC::newKeyVertex(Time time, const Eigen::Vector2d & pos)
 {
     KeyVertex * node = new KeyVertex(this, time, pos);
@@ -1571,13 +2503,7 @@ KeyEdge * VAC::newKeyEdge(Time time,
                           EdgeGeometry * geometry, double width)
 {
     if(geometry == 0)
-    {
-        // Create straight invisible edge
-        EdgeSample startSample(left->pos()[0], left->pos()[1], width);
-        EdgeSample endSample(right->pos()[0], right->pos()[1], width);
-        SculptCurve::Curve<EdgeSample> curve(startSample, endSample);
-        geometry = new LinearSpline(curve);
-    }
+        geometry = straightGeometry_(left, right, width);
 
     KeyEdge * edge = new KeyEdge(this, time, left, right, geometry);
     insertCell_(edge);
@@ -1668,6 +2594,8 @@ void VAC::beginRectangleOfSelection(double x, double y, Time time)
 
 void VAC::continueRectangleOfSelection(double x, double y)
 {
+    ScratchArena::Scope scratchScope;
+
     // Set raw data
     rectangleOfSelectionEndX_ = x;
     rectangleOfSelectionEndY_ = y;
@@ -1676,9 +2604,12 @@ void VAC::continueRectangleOfSelection(double x, double y)
     const BoundingBox bb(rectangleOfSelectionStartX_, rectangleOfSelectionEndX_,
                          rectangleOfSelectionStartY_, rectangleOfSelectionEndY_);
 
-    // Compute which cells intersect with bounding box
+    // Compute which cells intersect with bounding box. Only the cells whose
+    // bounding box intersects it, given by the spatial index, are tested
     cellsInRectangleOfSelection_.clear();
-    for(Cell * c: zOrdering_)
+    ScratchVector<Cell*> candidates;
+    spatialIndex_.cells(zOrdering_, timeInteractivity_, bb, candidates);
+    for(Cell * c: candidates)
     {
         if (c->isPickable(timeInteractivity_) &&
             c->intersects(timeInteractivity_, bb))
@@ -1740,9 +2671,14 @@ void VAC::endRectangleOfSelection()
 
 void VAC::beginSketchEdge(double x, double y, double w, Time time)
 {
+    finishSketchEdge();
+
     timeInteractivity_ = time;
     sketchedEdge_ = new LinearSpline(ds_);
+    sketchBuffer_.clear();
     sketchedEdge_->beginSketch(EdgeSample(x,y,w));
+    sketchPreviewNumVertices_ = 0;
+    sketchPreviewIntersections_.clear();
     hoveredFaceOnMousePress_ = 0;
     hoveredFaceOnMouseRelease_ = 0;
     hoveredFacesOnMouseMove_.clear();
@@ -1760,6 +2696,7 @@ void VAC::continueSketchEdge(double x, double y, double w)
     if(sketchedEdge_)
     {
         sketchedEdge_->continueSketch(EdgeSample(x,y,w));
+        updateSketchPreview_();
         if(hoveredCell_)
         {
             InbetweenFace * sface = hoveredCell_->toInbetweenFace();
@@ -1775,9 +2712,59 @@ void VAC::continueSketchEdge(double x, double y, double w)
     }
 }
 
+void VAC::updateSketchPreview_()
+{
+    if(!global()->planarMapMode())
+        return;
+
+    // Only segments between final vertices are tested, each once: the last
+    // few vertices are refitted at each new input sample, and are not part
+    // of the curve yet. The segment ending at the first new final vertex
+    // starts at the last one already tested.
+    int n = sketchedEdge_->curve().numFinalVertices();
+    int first = std::max(0, sketchPreviewNumVertices_ - 1);
+    if(n - first < 2)
+        return;
+    sketchPreviewNumVertices_ = n;
+
+    ScratchArena::Scope scratchScope;
+    double tolerance = EvaluationContext::current().sketchTolerance();
+    ScratchVector<Cell*> nearbyCells;
+    double u, v;
+    for(int i=first; i<n-1; ++i)
+    {
+        EdgeSample a = (*sketchedEdge_)[i];
+        EdgeSample b = (*sketchedEdge_)[i+1];
+        BoundingBox bb(std::min(a.x(), b.x()) - tolerance, std::max(a.x(), b.x()) + tolerance,
+                       std::min(a.y(), b.y()) - tolerance, std::max(a.y(), b.y()) + tolerance);
+
+        nearbyCells.clear();
+        spatialIndex_.cells(zOrdering_, timeInteractivity_, bb, nearbyCells);
+        for(Cell * c: nearbyCells)
+        {
+            KeyEdge * e = c->toKeyEdge();
+            if(!e || !e->exists(timeInteractivity_))
+                continue;
+
+            const Vector2dVector & sampling = e->geometry()->sampling();
+            for(int j=0; j+1<sampling.size(); ++j)
+            {
+                const Eigen::Vector2d & c1 = sampling[j];
+                const Eigen::Vector2d & d1 = sampling[j+1];
+                if(SculptCurve::Curve<EdgeSample>::intersects(a.x(), a.y(), b.x(), b.y(),
+                                                              c1[0], c1[1], d1[0], d1[1], u, v))
+                {
+                    sketchPreviewIntersections_ << Eigen::Vector2d(a.x() + u * (b.x() - a.x()),
+                                                                   a.y() + u * (b.y() - a.y()));
+                }
+            }
+        }
+    }
+}
+
 void VAC::endSketchEdge()
 {
-    if(sketchedEdge_)
+    if(sketchedEdge_ && !isSketchedEdgePending_)
     {
         InbetweenFace * sface = hoveredCell_->toInbetweenFace();
         if(sface && global()->planarMapMode())
@@ -1796,19 +2783,55 @@ void VAC::endSketchEdge()
             facesToConsiderForCutting_.insert(hoveredFaceOnMousePress_);
         if(hoveredFaceOnMouseRelease_)
             facesToConsiderForCutting_.insert(hoveredFaceOnMouseRelease_);
-        insertSketchedEdgeInVAC();
-
-        delete sketchedEdge_;
-        sketchedEdge_ = 0;
 
+        // In planar map mode, inserting the edge (intersecting, cutting,
+        // gluing, cutting faces) can take a while. It is then deferred to the
+        // next iteration of the event loop, after the pending repaints, so
+        // that the stroke ends without delay. Meanwhile, the sketched edge is
+        // drawn as is. Any other interaction finishes the insertion first.
+        static const DevSettings::Bool deferredSketchInsertion("deferred sketch insertion");
+        if(deferredSketchInsertion && global()->planarMapMode())
+        {
+            isSketchedEdgePending_ = true;
+            QTimer::singleShot(0, this, [this]() { finishSketchEdge(); });
+        }
+        else
+        {
+            insertSketchedEdge_();
 
-        //emit changed();
-        emit checkpoint();
+            //emit changed();
+            emit checkpoint();
+        }
     }
 }
 
+void VAC::finishSketchEdge()
+{
+    if(!isSketchedEdgePending_)
+        return;
+
+    insertSketchedEdge_();
+
+    // Only the inserted edge is checkpointed, not the pending one
+    emit needUpdatePicking();
+    emit changed();
+    emit checkpoint();
+}
+
+void VAC::insertSketchedEdge_()
+{
+    insertSketchedEdgeInVAC();
+
+    delete sketchedEdge_;
+    sketchedEdge_ = 0;
+    isSketchedEdgePending_ = false;
+    sketchPreviewIntersections_.clear();
+}
+
 void VAC::beginCutFace(double x, double y, double w, KeyVertex * startVertex)
 {
+    finishSketchEdge();
+
     cut_startVertex_ = startVertex;
 
     if(cut_startVertex_)
@@ -1819,7 +2842,11 @@ void VAC::beginCutFace(double x, double y, double w, KeyVertex * startVertex)
             w = 3.0;
 
         sketchedEdge_ = new LinearSpline(ds_);
+        sketchBuffer_.clear();
         sketchedEdge_->beginSketch(EdgeSample(x,y,w));
+        sketchPreviewNumVertices_ = 0;
+        sketchPreviewIntersections_.clear();
+        prepareCutFacePreview_();
 
         //emit changed();
     }
@@ -1835,6 +2862,7 @@ void VAC::continueCutFace(double x, double y, double w)
             w = 3.0;
 
         sketchedEdge_->continueSketch(EdgeSample(x,y,w));
+        updateCutFacePreview_();
         //emit changed();
     }
 }
@@ -1859,40 +2887,161 @@ void VAC::endCutFace(KeyVertex * endVertex)
             KeyFaceSet faces = startFaces;
             faces.intersect(endFaces);
 
-            if(!faces.isEmpty())
-            {
-                // For now, just use the first face
-                KeyFace * face = *faces.begin();
+            if(!faces.isEmpty())
+            {
+                // Prefer a face whose boundary the stroke doesn't cross
+                KeyFace * face = cutFacePreviewFace_(faces, endVertex);
+
+                // Create the new edge
+                EdgeGeometry * geometry = new LinearSpline(sketchedEdge_->curve());
+                KeyEdge * iedge = newKeyEdge(timeInteractivity_, startVertex, endVertex, geometry);
+                const bool invisibleCut = true;
+                if(invisibleCut)
+                    iedge->setWidth(0);
+
+                // Cut the face by the new edge
+                hasBeenCut = cutFace_(face,iedge);
+
+                if(!hasBeenCut)
+                    deleteCell(iedge);
+            }
+
+        }
+
+        delete sketchedEdge_;
+        sketchedEdge_ = 0;
+        clearCutFacePreview_();
+
+        if(hasBeenCut)
+        {
+            //emit changed();
+            emit checkpoint();
+        }
+    }
+}
+
+void VAC::prepareCutFacePreview_()
+{
+    clearCutFacePreview_();
+    static const DevSettings::Bool cutFacePreview("cut face preview");
+    if(!cutFacePreview)
+        return;
+
+    KeyFaceSet faces = cut_startVertex_->spatialStar();
+    for(KeyFace * face: faces)
+    {
+        QList<Vector2dVector> sampling = face->getSampling(timeInteractivity_);
+        for(const Vector2dVector & polygon: sampling)
+        {
+            const int n = polygon.size();
+            for(int j=0; j<n; ++j)
+            {
+                const Eigen::Vector2d & a = polygon[j];
+                const Eigen::Vector2d & b = polygon[(j+1) % n];
+                const int index = cutFaceSegments_.size();
+                cutFaceSegments_.push_back({face, a[0], a[1], b[0], b[1], -1});
+
+                const int iMin = (int) std::floor(std::min(a[0], b[0]) / CUT_FACE_GRID_SIZE);
+                const int iMax = (int) std::floor(std::max(a[0], b[0]) / CUT_FACE_GRID_SIZE);
+                const int jMin = (int) std::floor(std::min(a[1], b[1]) / CUT_FACE_GRID_SIZE);
+                const int jMax = (int) std::floor(std::max(a[1], b[1]) / CUT_FACE_GRID_SIZE);
+                for(int gi=iMin; gi<=iMax; ++gi)
+                    for(int gj=jMin; gj<=jMax; ++gj)
+                        cutFaceGrid_[qMakePair(gi, gj)].push_back(index);
+            }
+        }
+    }
+}
+
+void VAC::updateCutFacePreview_()
+{
+    if(cutFaceSegments_.empty())
+        return;
+
+    // Only segments between final vertices are tested, each once, as in
+    // updateSketchPreview_()
+    int n = sketchedEdge_->curve().numFinalVertices();
+    int first = std::max(0, sketchPreviewNumVertices_ - 1);
+    if(n - first < 2)
+        return;
+    sketchPreviewNumVertices_ = n;
 
-                // Create the new edge
-                EdgeGeometry * geometry = new LinearSpline(sketchedEdge_->curve());
-                KeyEdge * iedge = newKeyEdge(timeInteractivity_, startVertex, endVertex, geometry);
-                const bool invisibleCut = true;
-                if(invisibleCut)
-                    iedge->setWidth(0);
+    // The stroke starts on the boundary: crossings there don't count
+    const double tolerance = EvaluationContext::current().sketchTolerance();
+    const Eigen::Vector2d startPos = cut_startVertex_->pos();
 
-                // Cut the face by the new edge
-                hasBeenCut = cutFace_(face,iedge);
+    double u, v;
+    for(int i=first; i<n-1; ++i)
+    {
+        EdgeSample a = (*sketchedEdge_)[i];
+        EdgeSample b = (*sketchedEdge_)[i+1];
+        const int iMin = (int) std::floor(std::min(a.x(), b.x()) / CUT_FACE_GRID_SIZE);
+        const int iMax = (int) std::floor(std::max(a.x(), b.x()) / CUT_FACE_GRID_SIZE);
+        const int jMin = (int) std::floor(std::min(a.y(), b.y()) / CUT_FACE_GRID_SIZE);
+        const int jMax = (int) std::floor(std::max(a.y(), b.y()) / CUT_FACE_GRID_SIZE);
+        for(int gi=iMin; gi<=iMax; ++gi)
+        {
+            for(int gj=jMin; gj<=jMax; ++gj)
+            {
+                auto it = cutFaceGrid_.constFind(qMakePair(gi, gj));
+                if(it == cutFaceGrid_.constEnd())
+                    continue;
 
-                if(!hasBeenCut)
-                    deleteCell(iedge);
-            }
+                for(int index: it.value())
+                {
+                    CutFaceSegment & segment = cutFaceSegments_[index];
+                    if(segment.lastTestedStrokeSegment == i)
+                        continue;
+                    segment.lastTestedStrokeSegment = i;
 
+                    if(SculptCurve::Curve<EdgeSample>::intersects(a.x(), a.y(), b.x(), b.y(),
+                                                                  segment.x1, segment.y1, segment.x2, segment.y2, u, v))
+                    {
+                        Eigen::Vector2d q(a.x() + u * (b.x() - a.x()), a.y() + u * (b.y() - a.y()));
+                        if((q - startPos).norm() > tolerance)
+                        {
+                            cutFaceCrossings_.push_back({segment.face, q[0], q[1]});
+                            sketchPreviewIntersections_ << q;
+                        }
+                    }
+                }
+            }
         }
+    }
+}
 
-        delete sketchedEdge_;
-        sketchedEdge_ = 0;
+void VAC::clearCutFacePreview_()
+{
+    cutFaceSegments_.clear();
+    cutFaceGrid_.clear();
+    cutFaceCrossings_.clear();
+    sketchPreviewIntersections_.clear();
+}
 
-        if(hasBeenCut)
-        {
-            //emit changed();
-            emit checkpoint();
-        }
+KeyFace * VAC::cutFacePreviewFace_(const KeyFaceSet & faces, KeyVertex * endVertex) const
+{
+    // The stroke ends on the boundary too: crossings there don't count
+    const double tolerance = EvaluationContext::current().sketchTolerance();
+    const Eigen::Vector2d endPos = endVertex->pos();
+    KeyFaceSet crossedFaces;
+    for(const CutFaceCrossing & crossing: cutFaceCrossings_)
+    {
+        if((Eigen::Vector2d(crossing.x, crossing.y) - endPos).norm() > tolerance)
+            crossedFaces.insert(crossing.face);
+    }
+
+    for(KeyFace * face: faces)
+    {
+        if(!crossedFaces.contains(face))
+            return face;
     }
+    return *faces.begin();
 }
 
 bool VAC::cutFace_(KeyFace * face, KeyEdge * edge, CutFaceFeedback * feedback)
 {
+    OperatorStats::ScopedTimer operatorTimer(OperatorStats::CutFace);
+
     // assumes edge is not a loop
     // assumes edge->start() and edge->end() belong to face boundary
 
@@ -2049,6 +3198,33 @@ bool VAC::cutFace_(KeyFace * face, KeyEdge * edge, CutFaceFeedback * feedback)
             // Cycle 2 <- [ Cycle2 | (e,false) ]
             newCycle2.halfedges_ << KeyHalfedge(edge, false);
 
+            // Triangulate the new faces. Those of f1 are needed anyway to
+            // transfer the other cycles. If "cut face preview" is on, those
+            // of f2 are computed in parallel, and both are kept as the cached
+            // triangles of the new faces, unless they get other cycles, so
+            // that the next redraw doesn't triangulate them again
+            static const DevSettings::Bool cutFacePreview("cut face preview");
+            Triangles triangles1;
+            Triangles triangles2;
+            if(cutFacePreview)
+            {
+                // Sampling is computed lazily: do it before sharing the edges
+                for(const Cycle * cycle: {&newCycle1, &newCycle2})
+                    for(int j=0; j<cycle->size(); ++j)
+                        (*cycle)[j].edge->geometry()->sampling();
+
+                std::vector< std::pair<const Cycle*, Triangles*> > tasks;
+                tasks.push_back(std::make_pair(&newCycle1, &triangles1));
+                tasks.push_back(std::make_pair(&newCycle2, &triangles2));
+                QtConcurrent::blockingMap(tasks, [](std::pair<const Cycle*, Triangles*> & task) {
+                    *task.second = PreviewKeyFace(*task.first).triangles();
+                });
+            }
+            else
+            {
+                triangles1 = PreviewKeyFace(newCycle1).triangles();
+            }
+
             // Create the new faces
             KeyFace * f1 = newKeyFace(newCycle1);
             KeyFace * f2 = newKeyFace(newCycle2);
@@ -2058,15 +3234,22 @@ bool VAC::cutFace_(KeyFace * face, KeyEdge * edge, CutFaceFeedback * feedback)
                 feedback->newFaces.insert(f2);
             }
             // Transfer other cycles to either f1 or f2 using a heuristic
-            PreviewKeyFace f1Preview(newCycle1);
+            bool hasOtherCycles1 = false;
+            bool hasOtherCycles2 = false;
             for(int k=0; k<face->cycles_.size(); ++k)
             {
                 if(k != i)
                 {
-                    if(isCycleContainedInFace(face->cycles_[k],f1Preview))
+                    if(isCycleContainedInFace(face->cycles_[k],triangles1))
+                    {
                         f1->addCycle(face->cycles_[k]);
+                        hasOtherCycles1 = true;
+                    }
                     else
+                    {
                         f2->addCycle(face->cycles_[k]);
+                        hasOtherCycles2 = true;
+                    }
                 }
             }
 
@@ -2101,6 +3284,15 @@ bool VAC::cutFace_(KeyFace * face, KeyEdge * edge, CutFaceFeedback * feedback)
             {
                 feedback->deletedFaces.insert(face);
             }
+
+            // Cache the triangles computed above
+            if(cutFacePreview)
+            {
+                if(!hasOtherCycles1)
+                    f1->setCachedTriangles(f1->time(), triangles1);
+                if(!hasOtherCycles2)
+                    f2->setCachedTriangles(f2->time(), triangles2);
+            }
         }
     }
     // case where they belong to different cycles
@@ -2220,7 +3412,7 @@ VAC::SplitInfo VAC::cutEdgeAtVertices_(KeyEdge * edgeToSplit, const std::vector<
     res.oldEdge = edgeToSplit;
 
     // Split the curve
-    std::vector<SketchedEdge,Eigen::aligned_allocator<SketchedEdge> > split = static_cast<LinearSpline *>(edgeToSplit->geometry())->curve().split(splitValues);
+    std::vector<SketchedEdge,Eigen::aligned_allocator<SketchedEdge> > split = edgeToSplit->editLinearSpline()->curve().split(splitValues);
 
     // Get start node or create it in case of loop
     KeyVertex * startVertex;
@@ -2250,8 +3442,9 @@ VAC::SplitInfo VAC::cutEdgeAtVertices_(KeyEdge * edgeToSplit, const std::vector<
         newVertex->setPos(Eigen::Vector2d(v.x(), v.y()));
         res.newVertices << newVertex;
 
-        // Create geometry out of it
-        EdgeGeometry * geometry = new LinearSpline(split[j]);
+        // Create geometry out of it. The sub-curves are not used
+        // afterwards, so their vertices are moved rather than copied
+        EdgeGeometry * geometry = new LinearSpline(std::move(split[j]));
         KeyEdge * iedge = newKeyEdge(time, startVertex, newVertex, geometry);
         iedge->setColor(color);
         res.newEdges << iedge;
@@ -2261,7 +3454,7 @@ VAC::SplitInfo VAC::cutEdgeAtVertices_(KeyEdge * edgeToSplit, const std::vector<
     }
 
     // Create geometry of last out of it
-    EdgeGeometry * geometry = new LinearSpline(split.back());
+    EdgeGeometry * geometry = new LinearSpline(std::move(split.back()));
     KeyVertex * endVertex;
     if(!edgeToSplit->isClosed())
         endVertex = edgeToSplit->endVertex();
@@ -2344,6 +3537,8 @@ VAC::SplitInfo VAC::cutEdgeAtVertices_(KeyEdge * edgeToSplit, const std::vector<
 
 void VAC::glue_(KeyVertex * v1, KeyVertex * v2)
 {
+    OperatorStats::ScopedTimer operatorTimer(OperatorStats::Glue);
+
     // make sure they have same time
     if(v1->time() != v2->time())
     {
@@ -2423,6 +3618,8 @@ bool haveSameOrientation(KeyEdge * e1, KeyEdge * e2)
 
 void VAC::glue_(KeyEdge * e1, KeyEdge * e2)
 {
+    OperatorStats::ScopedTimer operatorTimer(OperatorStats::Glue);
+
     // make sure they have same time
     if(e1->time() != e2->time())
     {
@@ -2446,6 +3643,8 @@ void VAC::glue_(KeyEdge * e1, KeyEdge * e2)
 // assume h1 and h2 have same topology
 void VAC::glue_(const KeyHalfedge &h1, const KeyHalfedge &h2)
 {
+    OperatorStats::ScopedTimer operatorTimer(OperatorStats::Glue);
+
     // glue end vertices
     if(!h1.isClosed())
     {
@@ -2460,8 +3659,8 @@ void VAC::glue_(const KeyHalfedge &h1, const KeyHalfedge &h2)
     KeyEdge * e2 = h2.edge;
 
     // compute new geometry
-    SculptCurve::Curve<EdgeSample> & g1 = static_cast<LinearSpline*>(h1.edge->geometry())->curve();
-    SculptCurve::Curve<EdgeSample> & g2 = static_cast<LinearSpline*>(h2.edge->geometry())->curve();
+    SculptCurve::Curve<EdgeSample> & g1 = h1.edge->editLinearSpline()->curve();
+    SculptCurve::Curve<EdgeSample> & g2 = h2.edge->editLinearSpline()->curve();
     double l1 = h1.edge->geometry()->length();
     double l2 = h2.edge->geometry()->length();
     std::vector<EdgeSample,Eigen::aligned_allocator<EdgeSample> > g3Vertices;
@@ -2540,61 +3739,12 @@ void VAC::glue_(const KeyHalfedge &h1, const KeyHalfedge &h2)
 
 int VAC::nUses_(KeyVertex * v)
 {
-    int res = 0;
-
-    KeyFaceSet incidentFaces = v->spatialStar();
-    KeyEdgeSet incidentEdges = v->spatialStar();
-
-    foreach(KeyFace * f, incidentFaces)
-    {
-        // count how many times f uses v
-        for(int i=0; i<f->cycles_.size(); ++i)
-        {
-            if(f->cycles_[i].vertex_ == v) // Steiner vertex
-                res++;
-
-            for(int j=0; j<f->cycles_[i].size(); ++j)
-            {
-                if(f->cycles_[i][j].startVertex() == v)
-                    res++;
-            }
-        }
-    }
-
-    foreach(KeyEdge * e, incidentEdges)
-    {
-        KeyFaceSet fs = e->spatialStar();
-        if(fs.size() == 0) // otherwise, will be counted as a use by the face
-        {
-            if(e->startVertex() == v)
-                res++;
-            if(e->endVertex() == v)
-                res++;
-        }
-    }
-
-    return res;
+    return v->nUses();
 }
 
 int VAC::nUses_(KeyEdge * e)
 {
-    int res = 0;
-
-    KeyFaceSet incidentFaces = e->spatialStar();
-    foreach(KeyFace * f, incidentFaces)
-    {
-        // count how many times f uses e
-        for(int i=0; i<f->cycles_.size(); ++i)
-        {
-            for(int j=0; j<f->cycles_[i].size(); ++j)
-            {
-                if(f->cycles_[i][j].edge == e)
-                    res++;
-            }
-        }
-    }
-
-    return res;
+    return e->nUses();
 }
 
 void VAC::unglue_(KeyVertex * v)
@@ -2617,7 +3767,7 @@ void VAC::unglue_(KeyVertex * v)
             unglue_(edge);
 
         // Creates one duplicate vertex for each use
-        KeyFaceSet incidentFaces = v->spatialStar();
+        KeyFaceSet incidentFaces = v->incidentFaces();
         KeyEdgeSet incidentEdges = v->spatialStar();
 
         foreach(KeyFace * f, incidentFaces)
@@ -2694,8 +3844,7 @@ void VAC::unglue_(KeyVertex * v)
 
         foreach(KeyEdge * e, incidentEdges)
         {
-            KeyFaceSet fs = e->spatialStar();
-            if(fs.size() == 0) // otherwise, will be counted as a use by the face
+            if(e->incidentFaces().isEmpty()) // otherwise, will be counted as a use by the face
             {
                 if(e->startVertex() == v)
                 {
@@ -2743,7 +3892,7 @@ void VAC::unglue_(KeyEdge * e)
         deleteCells(inbetweenCells);
 
         // Create one duplicate edge for each use
-        KeyFaceSet incidentFaces = e->spatialStar();
+        KeyFaceSet incidentFaces = e->incidentFaces();
         foreach(KeyFace * f, incidentFaces)
         {
             for(int i=0; i<f->cycles_.size(); ++i)
@@ -2782,6 +3931,8 @@ void VAC::unglue_(KeyEdge * e)
 
 bool VAC::uncut_(KeyVertex * v)
 {
+    OperatorStats::ScopedTimer operatorTimer(OperatorStats::Uncut);
+
     // compute edge n usage, check it's not more than 2
     bool isSplittedLoop = false;
     KeyEdge * e1 = 0;
@@ -2790,7 +3941,7 @@ bool VAC::uncut_(KeyVertex * v)
     if(incidentEdges.size() == 0)
     {
         // Then can be uncut if it is a steiner vertex of one face, and one face only
-        KeyFaceSet incidentFaces = v->spatialStar();
+        KeyFaceSet incidentFaces = v->incidentFaces();
         bool found = false;
         KeyFace * foundFace = 0;
         int foundI = -1;
@@ -2872,8 +4023,15 @@ bool VAC::uncut_(KeyVertex * v)
     // hence, the following only concerns the case where the vertex has at least
     // one incident edge
 
+    // When merging two linear splines, the new edge is their concatenation,
+    // so the boundary of incident faces doesn't move and they don't need
+    // to be triangulated again
+    static const DevSettings::Bool spliceUncut("splice uncut");
+    const bool isSplice = spliceUncut && !isSplittedLoop &&
+            e1->geometry()->toLinearSpline() && e2->geometry()->toLinearSpline();
+
     // check that removing this vertex is compatible with incident faces
-    KeyFaceSet incidentFaces = v->spatialStar();
+    KeyFaceSet incidentFaces = v->incidentFaces();
     foreach(KeyFace * f, incidentFaces)
     {
         // check that it can be removed
@@ -2922,7 +4080,8 @@ bool VAC::uncut_(KeyVertex * v)
         }
 
         // Recompute geometry
-        f->processGeometryChanged_();
+        if(!isSplice)
+            f->processGeometryChanged_();
     }
 
     // We're OK now, just do it :-)
@@ -2933,7 +4092,7 @@ bool VAC::uncut_(KeyVertex * v)
         e1->startVertex_ = 0;
         e1->endVertex_ = 0;
         e1->removeMeFromSpatialStarOf_(v);
-        e1->geometry()->makeLoop();
+        e1->editGeometry()->makeLoop();
 
         // update incident faces
         foreach(KeyFace * f, incidentFaces)
@@ -2966,33 +4125,41 @@ bool VAC::uncut_(KeyVertex * v)
         // [... ; h = (e,true) ; ...]  <=>  [...;h1;h2;...]
 
         // compute new geometry
-        SculptCurve::Curve<EdgeSample> & g1 = static_cast<LinearSpline*>(e1->geometry())->curve();
-        SculptCurve::Curve<EdgeSample> & g2 = static_cast<LinearSpline*>(e2->geometry())->curve();
-        std::vector<EdgeSample,Eigen::aligned_allocator<EdgeSample> > g3Vertices;
-        int n1 = g1.size();
-        int n2 = g2.size();
-        if(h1.side)
-        {
-            for(int i=0; i<n1; ++i)
-                g3Vertices << g1[i];
-        }
-        else
-        {
-            for(int i=n1-1; i>=0; --i)
-                g3Vertices << g1[i];
-        }
-        if(h2.side)
+        SculptCurve::Curve<EdgeSample> g3;
+        if(isSplice)
         {
-            for(int i=1; i<n2; ++i)
-                g3Vertices << g2[i];
+            g3.setSplicedVertices(e1->geometry()->toLinearSpline()->curve(), !h1.side,
+                                  e2->geometry()->toLinearSpline()->curve(), !h2.side);
         }
         else
         {
-            for(int i=n2-2; i>=0; --i)
-                g3Vertices << g2[i];
+            SculptCurve::Curve<EdgeSample> & g1 = e1->editLinearSpline()->curve();
+            SculptCurve::Curve<EdgeSample> & g2 = e2->editLinearSpline()->curve();
+            std::vector<EdgeSample,Eigen::aligned_allocator<EdgeSample> > g3Vertices;
+            int n1 = g1.size();
+            int n2 = g2.size();
+            if(h1.side)
+            {
+                for(int i=0; i<n1; ++i)
+                    g3Vertices << g1[i];
+            }
+            else
+            {
+                for(int i=n1-1; i>=0; --i)
+                    g3Vertices << g1[i];
+            }
+            if(h2.side)
+            {
+                for(int i=1; i<n2; ++i)
+                    g3Vertices << g2[i];
+            }
+            else
+            {
+                for(int i=n2-2; i>=0; --i)
+                    g3Vertices << g2[i];
+            }
+            g3.setVertices(g3Vertices);
         }
-        SculptCurve::Curve<EdgeSample> g3;
-        g3.setVertices(g3Vertices);
         LinearSpline * ls3 = new LinearSpline(g3, false);
 
         // create new edge
@@ -3044,7 +4211,8 @@ bool VAC::uncut_(KeyVertex * v)
             }
 
             // Recompute geometry
-            f->processGeometryChanged_();
+            if(!isSplice)
+                f->processGeometryChanged_();
         }
 
         // delete vertex
@@ -3056,6 +4224,8 @@ bool VAC::uncut_(KeyVertex * v)
 
 bool VAC::uncut_(KeyEdge * e)
 {
+    OperatorStats::ScopedTimer operatorTimer(OperatorStats::Uncut);
+
     // Compute number of uses
     int nUses = nUses_(e);
     if(nUses < 2)
@@ -3073,7 +4243,7 @@ bool VAC::uncut_(KeyEdge * e)
     if(e->isClosed())
     {
         // get incident faces
-        KeyFaceSet incidentFaces = e->spatialStar();
+        KeyFaceSet incidentFaces = e->incidentFaces();
 
         // two cases: either the two usages are from the same face, or from two different faces
         if(incidentFaces.size() == 1)
@@ -3158,7 +4328,7 @@ bool VAC::uncut_(KeyEdge * e)
         Cycle cycle2;
 
         // Get incident faces
-        KeyFaceSet incidentFaces = e->spatialStar();
+        KeyFaceSet incidentFaces = e->incidentFaces();
         if(incidentFaces.size() == 1)
         {
             // Either One face One cycle
@@ -3430,21 +4600,28 @@ bool VAC::uncut_(KeyEdge * e)
 
 void VAC::insertSketchedEdgeInVAC()
 {
-    double tolerance = global()->snapThreshold();
-    double toleranceEpsilon = 1e-2;
-    if( (tolerance < toleranceEpsilon) || !(global()->snapMode()) )
-        tolerance = 1e-2;
-    insertSketchedEdgeInVAC(tolerance);
+    EvaluationContext context = EvaluationContext::current();
+    insertSketchedEdgeInVAC(context, context.sketchTolerance());
 }
 
 void VAC::insertSketchedEdgeInVAC(double tolerance, bool useFaceToConsiderForCutting)
 {
+    insertSketchedEdgeInVAC(EvaluationContext::current(), tolerance, useFaceToConsiderForCutting);
+}
+
+void VAC::insertSketchedEdgeInVAC(const EvaluationContext & context, double tolerance, bool useFaceToConsiderForCutting)
+{
+    OperatorStats::ScopedTimer operatorTimer(OperatorStats::InsertSketchedEdge);
+
+    VPAINT_TRACE_ZONE("VAC::insertSketchedEdgeInVAC");
+    ScratchArena::Scope scratchScope;
+
     // --------------------------------------------------------------------
     // ---------------------- Input Variables -----------------------------
     // --------------------------------------------------------------------
 
-    bool intersectWithSelf = global()->planarMapMode();
-    bool intersectWithOthers = global()->planarMapMode();
+    bool intersectWithSelf = context.planarMapMode;
+    bool intersectWithOthers = context.planarMapMode;
 
     // --------------------------------------------------------------------
     // ----------------- Compute dirty intersections ----------------------
@@ -3456,15 +4633,30 @@ void VAC::insertSketchedEdgeInVAC(double tolerance, bool useFaceToConsiderForCut
 
     // Lengths of the sketched edge and existing ("others") edges
     double lSelf = sketchedEdge_->length(); // compute it now
-    std::vector<double> lOthers;            // will be computed inside the loop
+    ScratchVector<double> lOthers;          // will be computed inside the loop
 
-    // Store geometry of existing edges as a "SketchedEdge"
-    std::vector< SculptCurve::Curve<EdgeSample>,Eigen::aligned_allocator<SculptCurve::Curve<EdgeSample> >  > sketchedEdges; // sketchedEdges.size() == nEdges.
+    // Geometry of existing edges as a "SketchedEdge". Linear splines are
+    // queried in place, other geometries are converted and stored in
+    // convertedEdges. Edges far from the sketched edge are null.
+    ScratchVector<const SketchedEdge *> sketchedEdges; // sketchedEdges.size() == nEdges.
+    std::vector<SketchedEdge,Eigen::aligned_allocator<SketchedEdge> > convertedEdges;
 
     // Compute intersections with self
     if(intersectWithSelf)
         selfIntersections = sketchedEdge_->curve().selfIntersections(tolerance);
 
+    // Grid of the segments of the sketched edge, shared by all intersection
+    // tests below so that only nearby segments are tested against each other
+    SketchedEdge::SegmentGrid sketchedEdgeGrid;
+    if(intersectWithOthers)
+        sketchedEdgeGrid.build(sketchedEdge_->curve());
+
+    // Intersection tests with existing edges are independent from each
+    // other, so they are run in parallel. The sketched edge is only read by
+    // worker threads: its arclengths have been computed above by length().
+    // Topology is only modified by the GUI thread, afterwards.
+    static const DevSettings::Bool parallelSketchInsertion("parallel sketch insertion");
+
     // Keyframe existing inbetween edge that intersect with sketched edge
     if(intersectWithOthers)
     {
@@ -3475,27 +4667,43 @@ void VAC::insertSketchedEdgeInVAC(double tolerance, bool useFaceToConsiderForCut
             if(sedge && sedge->exists(timeInteractivity_))
                 inbetweenEdges << sedge;
         }
+
+        // Compute intersections
+        struct InbetweenEdgeTask
+        {
+            InbetweenEdge * sedge;
+            bool intersects;
+        };
+        ScratchVector<InbetweenEdgeTask> tasks;
+        tasks.reserve(inbetweenEdges.size());
         foreach(InbetweenEdge * sedge, inbetweenEdges)
+            tasks.push_back({sedge, false});
+        auto computeIntersections = [&](InbetweenEdgeTask & task)
         {
-            // Get sampling as a QList of EdgeSamples
-            QList<EdgeSample> sampling = sedge->getSampling(timeInteractivity_);
-
-            // Convert sampling to a std::vector of EdgeSamples
-            std::vector<EdgeSample,Eigen::aligned_allocator<EdgeSample> > stdSampling;
-            for(int i=0; i<sampling.size(); ++i)
-                stdSampling << sampling[i];
-
-            // Convert sampling to a SculptCurve::Curve<EdgeSample>
+            // Get sampling, and move it to a SculptCurve::Curve<EdgeSample>
+            InbetweenEdge::EdgeSampleVector sampling;
+            task.sedge->getSampling(timeInteractivity_, context, sampling);
             SculptCurve::Curve<EdgeSample> sketchedEdge;
-            sketchedEdge.setVertices(stdSampling);
+            sketchedEdge.setVertices(std::move(sampling));
 
             // Compute intersections
-            std::vector<SculptCurve::Intersection> intersections = sketchedEdge_->curve().intersections(sketchedEdge, tolerance);
-
-            // Keyframe edge if there are some intersections
-            if(intersections.size() > 0)
-                keyframe_(sedge, timeInteractivity_);
+            task.intersects = !sketchedEdge_->curve().intersections(sketchedEdge, tolerance, sketchedEdgeGrid).empty();
+        };
+        if(parallelSketchInsertion)
+        {
+            prepareSampling_(inbetweenEdges, context);
+            QtConcurrent::blockingMap(tasks, computeIntersections);
+        }
+        else
+        {
+            for(InbetweenEdgeTask & task: tasks)
+                computeIntersections(task);
         }
+
+        // Keyframe edge if there are some intersections
+        for(const InbetweenEdgeTask & task: tasks)
+            if(task.intersects)
+                keyframe_(task.sedge, timeInteractivity_);
     }
 
     // Compute intersections with others
@@ -3507,31 +4715,103 @@ void VAC::insertSketchedEdgeInVAC(double tolerance, bool useFaceToConsiderForCut
         iedgesBefore = instantEdges(timeInteractivity_);
         nEdges = iedgesBefore.size();
 
-        // For each of them, compute intersections with sketched edge
-        foreach (KeyEdge * iedge, iedgesBefore)
+        // Bounding box of the sketched edge, expanded by tolerance to account
+        // for virtual intersections at the ends of either of the edges
+        BoundingBox sketchedEdgeBoundingBox;
+        const SketchedEdge & sketchedCurve = sketchedEdge_->curve();
+        for(int i=0; i<sketchedCurve.size(); ++i)
+            sketchedEdgeBoundingBox.unite(BoundingBox(sketchedCurve[i].x(), sketchedCurve[i].y()));
+        if(!sketchedEdgeBoundingBox.isEmpty())
+            sketchedEdgeBoundingBox = BoundingBox(sketchedEdgeBoundingBox.xMin() - tolerance,
+                                                  sketchedEdgeBoundingBox.xMax() + tolerance,
+                                                  sketchedEdgeBoundingBox.yMin() - tolerance,
+                                                  sketchedEdgeBoundingBox.yMax() + tolerance);
+
+        // All vectors below are indexed as iedgesBefore. Edges far from the
+        // sketched edge have no curve, no intersections, and zero length
+        sketchedEdges.resize(nEdges, 0);
+        othersIntersections.resize(nEdges);
+        lOthers.resize(nEdges, 0.0);
+
+        // Gather the geometry of nearby edges. This is done in the GUI thread
+        // since geometries are loaded and sampled lazily
+        struct KeyEdgeTask
+        {
+            int i;
+            const Vector2dVector * sampling; // null for linear splines
+            SketchedEdge * converted;                // conversion of sampling
+        };
+        ScratchVector<KeyEdgeTask> tasks;
+        {
+            int i = 0;
+            foreach (KeyEdge * iedge, iedgesBefore)
+            {
+                const BoundingBox & bb = iedge->boundingBox(timeInteractivity_);
+                if(bb.isEmpty() || bb.intersects(sketchedEdgeBoundingBox))
+                {
+                    EdgeGeometry * geometry = iedge->geometry();
+                    LinearSpline * linearSpline = geometry->toLinearSpline();
+                    if(linearSpline)
+                    {
+                        linearSpline->curve().precompute();
+                        sketchedEdges[i] = &linearSpline->curve();
+                        tasks.push_back({i, 0, 0});
+                    }
+                    else
+                    {
+                        tasks.push_back({i, &geometry->sampling(ds_), 0});
+                    }
+                }
+                ++i;
+            }
+        }
+
+        // Converted geometries. Their addresses must not change anymore
+        int numConverted = 0;
+        for(const KeyEdgeTask & task: tasks)
+            if(task.sampling)
+                ++numConverted;
+        convertedEdges.resize(numConverted);
+        numConverted = 0;
+        for(KeyEdgeTask & task: tasks)
         {
-            // Convert geometry of instant edge to a SketchedEdge
-            EdgeGeometry * geometry = iedge->geometry();
-            LinearSpline * linearSpline = dynamic_cast<LinearSpline *>(geometry);
-            if(linearSpline)
+            if(task.sampling)
             {
-                sketchedEdges << linearSpline->curve() ;
+                task.converted = &convertedEdges[numConverted++];
+                sketchedEdges[task.i] = task.converted;
             }
-            else
+        }
+
+        // For each of them, compute intersections with sketched edge
+        auto computeIntersections = [&](const KeyEdgeTask & task)
+        {
+            // Convert geometry of instant edge to a SketchedEdge, if not a
+            // linear spline already
+            if(task.converted)
             {
-                QList<Eigen::Vector2d> eigenSampling = geometry->sampling(ds_);
+                const Vector2dVector & eigenSampling = *task.sampling;
                 std::vector<EdgeSample,Eigen::aligned_allocator<EdgeSample> > vertices;
+                vertices.reserve(eigenSampling.size());
                 for(int i=0; i<eigenSampling.size(); ++i)
                     vertices << EdgeSample(eigenSampling[i][0], eigenSampling[i][1], 10); // todo: get actual width
-                sketchedEdges << SculptCurve::Curve<EdgeSample>();
-                sketchedEdges.back().setVertices(vertices);
+                task.converted->setVertices(std::move(vertices));
             }
+            const SketchedEdge & sketchedEdge = *sketchedEdges[task.i];
 
             // Compute intersections
-            othersIntersections << sketchedEdge_->curve().intersections(sketchedEdges.back(), tolerance);
+            othersIntersections[task.i] = sketchedEdge_->curve().intersections(sketchedEdge, tolerance, sketchedEdgeGrid);
 
             // Store length
-            lOthers << sketchedEdges.back().length();
+            lOthers[task.i] = sketchedEdge.length();
+        };
+        if(parallelSketchInsertion)
+        {
+            QtConcurrent::blockingMap(tasks, computeIntersections);
+        }
+        else
+        {
+            for(const KeyEdgeTask & task: tasks)
+                computeIntersections(task);
         }
     }
 
@@ -3720,7 +5000,7 @@ void VAC::insertSketchedEdgeInVAC(double tolerance, bool useFaceToConsiderForCut
         std::cout << "    [ ";
         for(double s : splitValues)
             std::cout << s << " ";
-        std::cout << "] -- length = " << sketchedEdges[i1].length() << std::endl;
+        std::cout << "] -- length = " << lOthers[i1] << std::endl;
         i1++;
     }
     std::cout << std::endl;
@@ -3768,22 +5048,41 @@ void VAC::insertSketchedEdgeInVAC(double tolerance, bool useFaceToConsiderForCut
             if(othersSplitValues[i].size() > 0 && !iedge->isClosed())
             {
                 // todo: be careful!! Potentially add several times the same node here!!!
-                splitNodes.existing << sketchedEdges[i].start();
+                splitNodes.existing << sketchedEdges[i]->start();
                 splitNodes.existingNodes << iedge->startVertex();
 
-                splitNodes.existing << sketchedEdges[i].end();
+                splitNodes.existing << sketchedEdges[i]->end();
                 splitNodes.existingNodes << iedge->endVertex();
             }
             i++;
         }
     }
 
-    // Existing nodes, close to end nodes.
+    // Existing nodes, close to end nodes. Only the vertices whose position
+    // is within the rects of size tolerance around the end nodes, given by
+    // the spatial index, are tested. They are tested in z-order, from bottom
+    // to top, like instantVertices(timeInteractivity_) would list them.
     {
         EdgeSample startVertex = sketchedEdge_->curve().start();
         EdgeSample endVertex = sketchedEdge_->curve().end();
-        foreach(KeyVertex * v, instantVertices(timeInteractivity_))
-        {
+        ScratchVector<Cell*> nearbyCells;
+        spatialIndex_.outlineCells(zOrdering_, timeInteractivity_,
+                                   BoundingBox(startVertex.x() - tolerance, startVertex.x() + tolerance,
+                                               startVertex.y() - tolerance, startVertex.y() + tolerance),
+                                   nearbyCells);
+        spatialIndex_.outlineCells(zOrdering_, timeInteractivity_,
+                                   BoundingBox(endVertex.x() - tolerance, endVertex.x() + tolerance,
+                                               endVertex.y() - tolerance, endVertex.y() + tolerance),
+                                   nearbyCells);
+        std::sort(nearbyCells.begin(), nearbyCells.end(),
+                  [this](Cell * c1, Cell * c2) { return zOrdering_.isBelow(c1, c2); });
+        nearbyCells.erase(std::unique(nearbyCells.begin(), nearbyCells.end()), nearbyCells.end());
+        for(Cell * c: nearbyCells)
+        {
+            KeyVertex * v = c->toKeyVertex();
+            if(!v || !v->exists(timeInteractivity_))
+                continue;
+
             // todo: be careful!! Potentially add several times the same node here!!!
             EdgeSample sv = startVertex;
             sv.setX(v->pos()[0]);
@@ -4074,11 +5373,11 @@ void VAC::insertSketchedEdgeInVAC(double tolerance, bool useFaceToConsiderForCut
         sketchedEdge_->curve().setEndPoints(vStart, vEnd);
 
         // Create geometry out of it
-        EdgeGeometry * geometry = new LinearSpline(sketchedEdge_->curve(), true);
+        EdgeGeometry * geometry = sketchedGeometry(sketchedEdge_->curve(), true);
         KeyEdge * iedge = newKeyEdge(timeInteractivity_, geometry);
 
         // if planar map mode, the loop can "cut" a face
-        if(global()->planarMapMode())
+        if(context.planarMapMode)
         {
             if(hoveredFaceOnMousePress_)
             {
@@ -4102,7 +5401,7 @@ void VAC::insertSketchedEdgeInVAC(double tolerance, bool useFaceToConsiderForCut
     {
         // if planar map mode, the first and last vertices can "cut" faces
         // by being added as Steiner cycles
-        if(global()->planarMapMode() && nSelf>0)
+        if(context.planarMapMode && nSelf>0)
         {
             KeyVertex * firstVertex = selfNodes[0];
             KeyVertex * lastVertex = selfNodes[nSelf-1];
@@ -4140,13 +5439,13 @@ void VAC::insertSketchedEdgeInVAC(double tolerance, bool useFaceToConsiderForCut
             curves[i].setEndPoints(vStart, vEnd);
 
             // Create geometry out of it
-            EdgeGeometry * geometry = new LinearSpline(curves[i]);
+            EdgeGeometry * geometry = sketchedGeometry(curves[i]);
             KeyEdge * iedge = 0;
             if(geometry->length() > tolerance)
                 iedge = newKeyEdge(timeInteractivity_, startNode, endNode, geometry);
 
             // if planar map mode, cut a potential face underneath
-            if(iedge && global()->planarMapMode())
+            if(iedge && context.planarMapMode)
             {
                 // find a face to cut
                 KeyFaceSet startFaces = startNode->spatialStar();
@@ -4181,13 +5480,25 @@ void VAC::insertSketchedEdgeInVAC(double tolerance, bool useFaceToConsiderForCut
 
 void VAC::updateSculpt(double x, double y, Time time)
 {
+    ScratchArena::Scope scratchScope;
     double radius = global()->sculptRadius();
     timeInteractivity_ = time;
-    KeyEdgeList iedges = instantEdges(timeInteractivity_);
+
+    // Only edges whose bounding box is within radius may have a sample
+    // within radius
+    ScratchVector<Cell*> nearbyCells;
+    spatialIndex_.cells(zOrdering_, timeInteractivity_,
+                        BoundingBox(x - radius, x + radius, y - radius, y + radius),
+                        nearbyCells);
+
     double minD = std::numeric_limits<double>::max();
     sculptedEdge_ = 0;
-    foreach(KeyEdge * iedge, iedges)
+    for(Cell * c: nearbyCells)
     {
+        KeyEdge * iedge = c->toKeyEdge();
+        if(!iedge || !iedge->exists(timeInteractivity_))
+            continue;
+
         double d = iedge->updateSculpt(x, y, radius);
         if(d<radius && d<minD)
         {
@@ -4417,6 +5728,8 @@ InbetweenEdge * VAC::inbetweenEdges_(KeyEdge * e1, KeyEdge * e2)
 
 void VAC::inbetweenSelection()
 {
+    OperatorStats::ScopedTimer operatorTimer(OperatorStats::InbetweenSelection);
+
     // ---- get selected key cells ----
 
     KeyCellList list = selectedCells();
@@ -4474,6 +5787,10 @@ void VAC::inbetweenSelection()
     KeyFaceList faces1 = list1;
     KeyFaceList faces2 = list2;
 
+    // Cells created below have an ID at least firstId. Their geometry is
+    // computed at the end, all at once
+    int firstId = maxID_ + 1;
+
 
     // ---------------- connect two key vertices --------------------
 
@@ -4694,6 +6011,9 @@ void VAC::inbetweenSelection()
         }
     }
 
+    // Compute the geometry of the new cells
+    prepareInbetweenCells_(firstId, global()->activeTime());
+
     deselectAll();
     emit needUpdatePicking();
     emit changed();
@@ -4710,6 +6030,20 @@ void VAC::keyframeSelection()
     emit checkpoint();
 }
 
+void VAC::keyframeSelection(int firstFrame, int lastFrame)
+{
+    QList<Time> times;
+    for(int frame = firstFrame; frame <= lastFrame; ++frame)
+        times << Time(frame);
+    keyframe_(selectedCells(), times);
+    deselectAll();
+
+    // Single undo checkpoint for the whole range
+    emit needUpdatePicking();
+    emit changed();
+    emit checkpoint();
+}
+
 class KeyframeHelper
 {
 public:
@@ -4741,6 +6075,8 @@ private:
 
 KeyCellSet VAC::keyframe_(const CellSet & cells, Time time)
 {
+    OperatorStats::ScopedTimer operatorTimer(OperatorStats::Keyframe);
+
     KeyCellSet keyframedCells;
 
     InbetweenCellSet inbetweenCells = cells;
@@ -4776,13 +6112,154 @@ KeyCellSet VAC::keyframe_(const CellSet & cells, Time time)
     return keyframedCells;
 }
 
+namespace
+{
+
+// Geometry of the keyframe of an inbetween edge, computed by a worker thread
+struct KeyframeTask
+{
+    const InbetweenEdge * edge;
+    Time time;
+    EdgeGeometry * geometry;
+};
+
+// Returns the inbetween cell created just after the given keyframe by
+// keyframe_(), i.e., the remaining part of the cell that was keyframed
+InbetweenCell * cellAfterKeyframe(KeyCell * keyframe)
+{
+    foreach(Cell * c, keyframe->temporalStarAfter())
+    {
+        if((keyframe->toVertexCell() && c->toVertexCell()) ||
+           (keyframe->toEdgeCell() && c->toEdgeCell()) ||
+           (keyframe->toFaceCell() && c->toFaceCell()))
+        {
+            return c->toInbetweenCell();
+        }
+    }
+    return 0;
+}
+
+}
+
+KeyCellSet VAC::keyframe_(const CellSet & cells, const QList<Time> & times)
+{
+    OperatorStats::ScopedTimer operatorTimer(OperatorStats::Keyframe);
+
+    KeyCellSet keyframedCells;
+
+    // Keyframing a cell also keyframes its boundary. Include the boundary in
+    // the cells to keyframe instead, so that all keyframes can be computed
+    // beforehand, from the cells as they are now
+    InbetweenCellSet inbetweenCells = Algorithms::closure(cells);
+    InbetweenVertexList inbetweenVertices = inbetweenCells;
+    InbetweenEdgeList inbetweenEdges = inbetweenCells;
+    InbetweenFaceList inbetweenFaces = inbetweenCells;
+
+    // Compute positions of keyframes of vertices
+    QMap<QPair<InbetweenVertex*,int>, Eigen::Vector2d> positions;
+    foreach(InbetweenVertex * svertex, inbetweenVertices)
+        for(int i=0; i<times.size(); ++i)
+            if(svertex->exists(times[i]))
+                positions[qMakePair(svertex,i)] = svertex->pos(times[i]);
+
+    // Compute geometries of keyframes of edges in parallel
+    EvaluationContext context = EvaluationContext::current();
+    prepareSampling_(inbetweenCells, context);
+    std::vector<KeyframeTask> tasks;
+    foreach(InbetweenEdge * sedge, inbetweenEdges)
+    {
+        for(int i=0; i<times.size(); ++i)
+        {
+            if(sedge->exists(times[i]))
+            {
+                KeyframeTask task;
+                task.edge = sedge;
+                task.time = times[i];
+                task.geometry = 0;
+                tasks.push_back(task);
+            }
+        }
+    }
+    QtConcurrent::blockingMap(tasks, [&context](KeyframeTask & task) {
+        InbetweenEdge::EdgeSampleVector sampling;
+        task.edge->getSampling(task.time, context, sampling);
+        task.geometry = new LinearSpline(sampling);
+        task.geometry->length();
+    });
+    QMap<QPair<InbetweenEdge*,int>, EdgeGeometry*> geometries;
+    int numTask = 0;
+    foreach(InbetweenEdge * sedge, inbetweenEdges)
+        for(int i=0; i<times.size(); ++i)
+            if(sedge->exists(times[i]))
+                geometries[qMakePair(sedge,i)] = tasks[numTask++].geometry;
+
+    // Split the topology one time after the other. Each cell is replaced by
+    // its part after the last keyframe, tracked in pieces, which exists at
+    // the next time if and only if the cell itself does
+    QMap<InbetweenCell*, InbetweenCell*> pieces;
+    foreach(InbetweenCell * scell, inbetweenCells)
+        pieces[scell] = scell;
+    for(int i=0; i<times.size(); ++i)
+    {
+        Time time = times[i];
+
+        // Vertices first, then edges, then faces, so that the boundary of a
+        // cell is always keyframed before the cell itself
+        foreach(InbetweenVertex * svertex, inbetweenVertices)
+        {
+            InbetweenCell * piece = pieces[svertex];
+            if(piece && piece->exists(time))
+            {
+                KeyVertex * keyVertex = keyframe_(piece->toInbetweenVertex(), time,
+                                                  positions[qMakePair(svertex,i)]);
+                keyframedCells << keyVertex;
+                pieces[svertex] = cellAfterKeyframe(keyVertex);
+            }
+        }
+        foreach(InbetweenEdge * sedge, inbetweenEdges)
+        {
+            InbetweenCell * piece = pieces[sedge];
+            if(piece && piece->exists(time))
+            {
+                KeyEdge * keyEdge = keyframe_(piece->toInbetweenEdge(), time,
+                                              geometries.take(qMakePair(sedge,i)));
+                keyframedCells << keyEdge;
+                pieces[sedge] = cellAfterKeyframe(keyEdge);
+            }
+        }
+        foreach(InbetweenFace * sface, inbetweenFaces)
+        {
+            InbetweenCell * piece = pieces[sface];
+            if(piece && piece->exists(time))
+            {
+                KeyFace * keyFace = keyframe_(piece->toInbetweenFace(), time);
+                keyframedCells << keyFace;
+                pieces[sface] = cellAfterKeyframe(keyFace);
+            }
+        }
+    }
+
+    // Delete unused geometries, if any
+    foreach(EdgeGeometry * geometry, geometries)
+        delete geometry;
+
+    return keyframedCells;
+}
+
 KeyVertex * VAC::keyframe_(InbetweenVertex * svertex, Time time)
 {
+    return keyframe_(svertex, time, svertex->pos(time));
+}
+
+KeyVertex * VAC::keyframe_(InbetweenVertex * svertex, Time time, const Eigen::Vector2d & pos)
+{
+    OperatorStats::ScopedTimer operatorTimer(OperatorStats::Keyframe);
+
     // Preprocess
     KeyframeHelper keyframHelper(svertex,this);
 
     // Create new cells
-    KeyVertex * keyVertex = newKeyVertex(time, svertex->pos(time));
+    KeyVertex * keyVertex = newKeyVertex(time, pos);
     InbetweenVertex * inbetweenVertexBefore = newInbetweenVertex(svertex->beforeVertex(),keyVertex);
     InbetweenVertex * inbetweenVertexAfter = newInbetweenVertex(keyVertex,svertex->afterVertex());
 
@@ -4839,6 +6316,13 @@ KeyVertex * VAC::keyframe_(InbetweenVertex * svertex, Time time)
 
 KeyEdge * VAC::keyframe_(InbetweenEdge * sedge, Time time)
 {
+    return keyframe_(sedge, time, new LinearSpline(sedge->getSampling(time)));
+}
+
+KeyEdge * VAC::keyframe_(InbetweenEdge * sedge, Time time, EdgeGeometry * geo)
+{
+    OperatorStats::ScopedTimer operatorTimer(OperatorStats::Keyframe);
+
     // Preprocess
     KeyframeHelper keyframHelper(sedge,this);
 
@@ -4877,7 +6361,6 @@ KeyEdge * VAC::keyframe_(InbetweenEdge * sedge, Time time)
     }
 
     // Create new cells
-    EdgeGeometry * geo = new LinearSpline(sedge->getSampling(time));
     KeyEdge * keyEdge = 0;
     InbetweenEdge * inbetweenEdgeBefore = 0;
     InbetweenEdge * inbetweenEdgeAfter = 0;
@@ -4978,6 +6461,8 @@ KeyEdge * VAC::keyframe_(InbetweenEdge * sedge, Time time)
 
 KeyFace * VAC::keyframe_(InbetweenFace * sface, Time time)
 {
+    OperatorStats::ScopedTimer operatorTimer(OperatorStats::Keyframe);
+
     // Preprocess
     KeyframeHelper keyframHelper(sface,this);
 
@@ -5145,81 +6630,45 @@ QList<Cycle> VAC::createFace_computeCycles()
     // Create all cycles
     QList<Cycle> cycles;
 
-    // Edges to use as non-Steiner cycles
+    // Edges to use as non-Steiner cycles. Each connected component is
+    // chained only once: cycles are built from the halfedges of its
+    // loop, path, or path-loop decomposition, rather than from its edges
     KeyEdgeSet edgeSet = selectedCells();
     SmartKeyEdgeSet smartKeyEdgeSet(edgeSet);
     for(int i=0; i<smartKeyEdgeSet.numConnectedComponents(); ++i)
     {
-        SmartConnectedKeyEdgeSet & potentialCycle = smartKeyEdgeSet[i];
-        if(potentialCycle.type() == SmartConnectedKeyEdgeSet::GENERAL )
-        {
-            global()->mainWindow()->statusBar()->showMessage(tr("Some selected edges were ambiguous and have been ignored"));
-        }
-        else if(potentialCycle.type() == SmartConnectedKeyEdgeSet::CLOSED_EDGE )
-        {
-            Cycle cycle(potentialCycle.edgeSet());
-            if(cycle.isValid())
-                cycles << cycle;
-            else
-            {
-                //qDebug() << "Warning: invalid cycle while it is apparently a closed edge";
-            }
-        }
-        else if(potentialCycle.type() == SmartConnectedKeyEdgeSet::OPEN_EDGE_LOOP )
-        {
-            Cycle cycle(potentialCycle.edgeSet());
-            if(cycle.isValid())
-                cycles << cycle;
-            else
-            {
-                //qDebug() << "Warning: invalid cycle while it is apparently a looping open edge";
-            }
-        }
-        else if(potentialCycle.type() == SmartConnectedKeyEdgeSet::SIMPLE_LOOP )
+        SmartConnectedKeyEdgeSet & potentialCycle = smartKeyEdgeSet[i];
+        if(potentialCycle.type() == SmartConnectedKeyEdgeSet::GENERAL )
         {
-            Cycle cycle(potentialCycle.edgeSet());
-            if(cycle.isValid())
-                cycles << cycle;
-            else
-            {
-                //qDebug() << "Warning: invalid cycle while it is apparently a simple loop";
-            }
+            global()->mainWindow()->statusBar()->showMessage(tr("Some selected edges were ambiguous and have been ignored"));
         }
-        else if(potentialCycle.type() == SmartConnectedKeyEdgeSet::OPEN_EDGE_PATH )
+        else if(potentialCycle.type() == SmartConnectedKeyEdgeSet::CLOSED_EDGE ||
+                potentialCycle.type() == SmartConnectedKeyEdgeSet::OPEN_EDGE_LOOP ||
+                potentialCycle.type() == SmartConnectedKeyEdgeSet::SIMPLE_LOOP )
         {
-            // Get edge
-            KeyEdge * edge = potentialCycle.edge();
-
-            // Create invisible edge
-            KeyEdge * newEdge = newKeyEdge(edge->time(), edge->startVertex(), edge->endVertex());
-
-            // Add it to cycle
-            KeyEdgeSet newEdgeSet = potentialCycle.edgeSet();
-            newEdgeSet << newEdge;
-            Cycle cycle(newEdgeSet);
+            Cycle cycle(potentialCycle.loop());
             if(cycle.isValid())
-            {
                 cycles << cycle;
-            }
             else
             {
-                deleteCell(newEdge);
-                //qDebug() << "Warning: invalid cycle while it is apparently a "
-                //            "non-looping open edge to which we added an invisible edge";
+                //qDebug() << "Warning: invalid cycle while it is apparently a simple loop";
             }
         }
-        else if(potentialCycle.type() == SmartConnectedKeyEdgeSet::SIMPLE_PATH )
+        else if(potentialCycle.type() == SmartConnectedKeyEdgeSet::OPEN_EDGE_PATH ||
+                potentialCycle.type() == SmartConnectedKeyEdgeSet::SIMPLE_PATH )
         {
-            // Get edge
+            // Get path
             ProperPath path = potentialCycle.path();
 
             // Create invisible edge
             KeyEdge * newEdge = newKeyEdge(path.time(), path[0].startVertex(), path[path.size()-1].endVertex());
 
-            // Add it to cycle
-            KeyEdgeSet newEdgeSet = potentialCycle.edgeSet();
-            newEdgeSet << newEdge;
-            Cycle cycle(newEdgeSet);
+            // Close the path with it
+            QList<KeyHalfedge> halfedges;
+            for(int j=0; j<path.size(); ++j)
+                halfedges << path[j];
+            halfedges << KeyHalfedge(newEdge, false);
+            Cycle cycle(halfedges);
             if(cycle.isValid())
             {
                 cycles << cycle;
@@ -5228,7 +6677,7 @@ QList<Cycle> VAC::createFace_computeCycles()
             {
                 deleteCell(newEdge);
                 //qDebug() << "Warning: invalid cycle while it is apparently a "
-                //            "non-looping open edge to which we added an invisible edge";
+                //            "simple path to which we added an invisible edge";
             }
         }
         else if(potentialCycle.type() == SmartConnectedKeyEdgeSet::PATH_LOOP_DECOMPOSITION )
@@ -5241,13 +6690,7 @@ QList<Cycle> VAC::createFace_computeCycles()
             // Create one cycle per loop
             for(int j=0; j<hole.nLoops(); ++j)
             {
-                ProperCycle loop = hole.loop(j);
-                KeyEdgeSet newEdgeSet;
-                for(int k=0; k<loop.size(); ++k)
-                    newEdgeSet << loop[k].edge;
-
-                // Add it to cycle
-                Cycle cycle(newEdgeSet);
+                Cycle cycle(hole.loop(j));
                 if(cycle.isValid())
                 {
                     cycles << cycle;
@@ -5278,6 +6721,8 @@ QList<Cycle> VAC::createFace_computeCycles()
 
 void VAC::createFace()
 {
+    OperatorStats::ScopedTimer operatorTimer(OperatorStats::CreateFace);
+
     // Compute cycles
     QList<Cycle> cycles = createFace_computeCycles();
 
@@ -5297,6 +6742,28 @@ void VAC::createFace()
     }
 }
 
+void VAC::createFaces()
+{
+    // Compute cycles, all in one pass
+    QList<Cycle> cycles = createFace_computeCycles();
+
+    // Create one face per cycle
+    if(cycles.size() == 0)
+    {
+        QMessageBox::information(0, QObject::tr("operation aborted"),
+                                 QObject::tr("Could not create a valid face from the selection"));
+    }
+    else
+    {
+        foreach(const Cycle & cycle, cycles)
+            newKeyFace(cycle);
+
+        emit needUpdatePicking();
+        emit changed();
+        emit checkpoint();
+    }
+}
+
 void VAC::addCyclesToFace()
 {
     // Compute cycles
@@ -5581,6 +7048,79 @@ void VAC::uncut()
     }
 }
 
+int VAC::selectedSymbol_()
+{
+    for(Cell * c: selectedCells())
+    {
+        int symbol = symbols_.findSymbol(c);
+        if(symbol != -1)
+            return symbol;
+    }
+    return -1;
+}
+
+void VAC::createSymbol()
+{
+    if(selectedCells().isEmpty())
+    {
+        QMessageBox::information(0, QObject::tr("Create symbol: operation aborted"),
+                                 QObject::tr("Please select the cells of the symbol prior to trigger this action."));
+        return;
+    }
+
+    // Instances are drawn from the master alone, so the boundary of its
+    // cells must be included too
+    CellSet cells = Algorithms::closure(selectedCells());
+    std::vector<int> ids;
+    ids.reserve(cells.size());
+    for(Cell * c: cells)
+        ids.push_back(c->id());
+    symbols_.addSymbol(ids);
+
+    emit changed();
+    emit checkpoint();
+}
+
+void VAC::addSymbolInstance()
+{
+    int symbol = selectedSymbol_();
+    if(symbol == -1)
+    {
+        QMessageBox::information(0, QObject::tr("Add symbol instance: operation aborted"),
+                                 QObject::tr("Please select a cell of a symbol prior to trigger this action."));
+        return;
+    }
+
+    // Place it to the right of the master and of the previous instances
+    Time time = global()->activeTime();
+    BoundingBox bb;
+    for(int id: symbols_.cellIds(symbol))
+    {
+        Cell * c = getCell(id);
+        if(c && c->exists(time))
+            bb.unite(c->boundingBox(time));
+    }
+    double dx = bb.isEmpty() ? 0 : bb.width() + 10;
+    SymbolInstance instance;
+    instance.transform = Eigen::Translation2d((symbols_.numInstances(symbol) + 1) * dx, 0);
+    symbols_.addInstance(symbol, instance);
+
+    emit changed();
+    emit checkpoint();
+}
+
+void VAC::removeSymbolInstances()
+{
+    int symbol = selectedSymbol_();
+    if(symbol == -1 || symbols_.numInstances(symbol) == 0)
+        return;
+
+    symbols_.clearInstances(symbol);
+
+    emit changed();
+    emit checkpoint();
+}
+
 void VAC::cut(VAC* & clipboard)
 {
     timeCopy_ = global()->activeTime();
@@ -5612,8 +7152,20 @@ void VAC::copy(VAC* & clipboard)
     clipboard = subcomplex(selectedCells());
 }
 
+Time VAC::copyTime() const
+{
+    return timeCopy_;
+}
+
+void VAC::setCopyTime(Time time)
+{
+    timeCopy_ = time;
+}
+
 void VAC::paste(VAC *& clipboard)
 {
+    OperatorStats::ScopedTimer operatorTimer(OperatorStats::Paste);
+
     if(!clipboard) return;
 
     // Get different between current time and copy time
@@ -5626,12 +7178,14 @@ void VAC::paste(VAC *& clipboard)
     {
         kc->time_ = kc->time_ + deltaTime;
     }
+    Cell::processTopologyChanged_();
 
-    // Import into this VAC and set as selection
+    // Move into this VAC and set as selection
     removeFromSelection(selectedCells());
-    import(cloneOfClipboard, true);
+    std::vector<int> idMap;
+    importCells_(cloneOfClipboard, idMap, true);
 
-    // Delete clone
+    // Delete clone, now empty
     delete cloneOfClipboard;
 
     emit needUpdatePicking();
@@ -5641,6 +7195,8 @@ void VAC::paste(VAC *& clipboard)
 
 void VAC::motionPaste(VAC* & clipboard)
 {
+    OperatorStats::ScopedTimer operatorTimer(OperatorStats::MotionPaste);
+
     if(!clipboard) return;
 
     // Check that it is possible to motion paste
@@ -5672,22 +7228,26 @@ void VAC::motionPaste(VAC* & clipboard)
     {
         kc->time_ = kc->time_ + deltaTime;
     }
+    Cell::processTopologyChanged_();
 
-    // Import into this VAC and set as selection
+    // Move into this VAC and set as selection. The IDs of cells in the
+    // clipboard are the IDs of the copied cells
     removeFromSelection(selectedCells());
-    QMap<int,int> idMap = import(cloneOfClipboard, true);
+    std::vector<int> idMap;
+    importCells_(cloneOfClipboard, idMap, true);
 
     // Separate vertices/edges/faces into different maps
     QMap<KeyVertex *, KeyVertex * > v1ToV2;
     QMap<KeyEdge *, KeyEdge * > e1ToE2;
     QMap<KeyFace *, KeyFace * > f1ToF2;
-    QMapIterator<int, int> i(idMap);
-    while (i.hasNext())
+    for(int oldID = 0; oldID < (int) idMap.size(); ++oldID)
     {
-        i.next();
+        int newID = idMap[oldID];
+        if(newID == -1)
+            continue;
 
-        int copyID =  (deltaTime.frame() > 0) ? i.key()   : i.value();
-        int pasteID = (deltaTime.frame() > 0) ? i.value() : i.key();
+        int copyID =  (deltaTime.frame() > 0) ? oldID : newID;
+        int pasteID = (deltaTime.frame() > 0) ? newID : oldID;
         Cell * copyCell = getCell(copyID);
         Cell * pasteCell = getCell(pasteID);
         KeyVertex * v1 = copyCell  ? copyCell->toKeyVertex()  : 0;
@@ -5816,7 +7376,8 @@ void VAC::motionPaste(VAC* & clipboard)
         stf->setColor(f1->color());
     }
 
-    // Delete clone
+    // Delete clone, now empty. The geometry of the new cells is computed
+    // lazily, when first drawn
     delete cloneOfClipboard;
 
     informTimelineOfSelection();
@@ -5871,61 +7432,41 @@ void VAC::setNoHoveredCell()
 
 void VAC::informTimelineOfSelection()
 {
-    int selectionType = 0;
-    double t = 0;
-    double t1 = 0;
-    double t2 = 0;
+    SelectionSummary::TimelineInfo info = selectionSummary_.timelineInfo(selectedCells_);
 
-    foreach(Cell * cell, selectedCells_)
-    {
-        KeyCell * keyCell = cell->toKeyCell();
-        InbetweenCell * inbetweenCell = cell->toInbetweenCell();
-        if(keyCell)
-        {
-            if(selectionType != 1)
-            {
-                selectionType = 1;
-                t = keyCell->time().floatTime();
-                t1 = std::numeric_limits<double>::lowest(); // = -max
-                t2 = std::numeric_limits<double>::max();
-            }
+    Timeline * timeline = global()->timeline();
+    timeline->setSelectionType(info.selectionType);
+    timeline->setT(info.t);
+    timeline->setT1(info.t1);
+    timeline->setT2(info.t2);
+}
 
-            InbetweenCellSet beforeCells = keyCell->temporalStarBefore();
-            foreach(InbetweenCell * scell, beforeCells)
-            {
-                double tbefore = scell->beforeTime().floatTime();
-                t1 = std::max(tbefore,t1);
-            }
+void VAC::processSelectedCellAdded_(Cell * cell)
+{
+    selectionClosure_.addSelectedCell(cell);
+    selectionSummary_.addSelectedCell(cell);
+}
 
-            InbetweenCellSet afterCells = keyCell->temporalStarAfter();
-            foreach(InbetweenCell * scell, afterCells)
-            {
-                double tafter = scell->afterTime().floatTime();
-                t2 = std::min(tafter,t2);
-            }
-        }
-        else if(inbetweenCell && (selectionType!=1) )
-        {
-            selectionType = 2;
-            t1 = inbetweenCell->beforeTime().floatTime();
-            t2 = inbetweenCell->afterTime().floatTime();
-            break; // i.e., ignore further cells
-        }
-    }
+void VAC::processSelectedCellRemoved_(Cell * cell)
+{
+    selectionClosure_.removeSelectedCell(cell);
+    selectionSummary_.removeSelectedCell(cell);
+}
 
-    if(selectionType == 1)
-    {
-        if(t1 == std::numeric_limits<double>::lowest())
-            t1 = t;
-        if(t2 == std::numeric_limits<double>::max())
-            t2 = t;
-    }
+// Above this many cells added to or removed from the selection at once,
+// the selection closure and summary are rebuilt on next access rather than
+// updated cell by cell
+bool VAC::isBulkSelectionChange_(int numCells) const
+{
+    static const DevSettings::Bool bulkSelection("bulk selection");
+    return bulkSelection && numCells > 64;
+}
 
-    Timeline * timeline = global()->timeline();
-    timeline->setSelectionType(selectionType);
-    timeline->setT(t);
-    timeline->setT1(t1);
-    timeline->setT2(t2);
+void VAC::processSelectionReset_()
+{
+    selectionClosure_.clear();
+    selectionSummary_.clear();
+    emitSelectionChanged_();
 }
 
 void VAC::addToSelection(Cell * cell, bool emitSignal)
@@ -5933,6 +7474,7 @@ void VAC::addToSelection(Cell * cell, bool emitSignal)
     if(cell && !cell->isSelected())
     {
         selectedCells_ << cell;
+        processSelectedCellAdded_(cell);
         cell->setSelected(true);
         emitSelectionChanged_();
         if(emitSignal)
@@ -5947,6 +7489,7 @@ void VAC::removeFromSelection(Cell * cell, bool emitSignal)
     if(cell && cell->isSelected())
     {
         selectedCells_.remove(cell);
+        processSelectedCellRemoved_(cell);
         cell->setSelected(false);
         emitSelectionChanged_();
         if(emitSignal)
@@ -5969,10 +7512,28 @@ void VAC::toggleSelection(Cell * cell, bool emitSignal)
 
 void VAC::addToSelection(const CellSet & cells, bool emitSignal)
 {
-    beginAggregateSignals_();
-    foreach(Cell * c, cells)
-        addToSelection(c, false);
-    endAggregateSignals_();
+    if(isBulkSelectionChange_(cells.size()))
+    {
+        bool changing = false;
+        for(Cell * c: cells)
+        {
+            if(c && !c->isSelected())
+            {
+                selectedCells_ << c;
+                c->setSelected(true);
+                changing = true;
+            }
+        }
+        if(changing)
+            processSelectionReset_();
+    }
+    else
+    {
+        beginAggregateSignals_();
+        foreach(Cell * c, cells)
+            addToSelection(c, false);
+        endAggregateSignals_();
+    }
 
     if(emitSignal)
     {
@@ -5982,10 +7543,28 @@ void VAC::addToSelection(const CellSet & cells, bool emitSignal)
 
 void VAC::removeFromSelection(const CellSet & cells, bool emitSignal)
 {
-    beginAggregateSignals_();
-    foreach(Cell * c, cells)
-        removeFromSelection(c, false);
-    endAggregateSignals_();
+    if(isBulkSelectionChange_(cells.size()))
+    {
+        bool changing = false;
+        for(Cell * c: cells)
+        {
+            if(c && c->isSelected())
+            {
+                selectedCells_.remove(c);
+                c->setSelected(false);
+                changing = true;
+            }
+        }
+        if(changing)
+            processSelectionReset_();
+    }
+    else
+    {
+        beginAggregateSignals_();
+        foreach(Cell * c, cells)
+            removeFromSelection(c, false);
+        endAggregateSignals_();
+    }
 
     if(emitSignal)
     {
@@ -6051,6 +7630,24 @@ void VAC::setSelectedCells(const CellSet & cells, bool emitSignal)
     // Set new cells as selected
     foreach(Cell * cell, cells)
         cell->setSelected(true);
+    const bool isBulk = isBulkSelectionChange_(cells.size() + selectedCells_.size());
+    if(isBulk)
+    {
+        if(changing)
+        {
+            selectionClosure_.clear();
+            selectionSummary_.clear();
+        }
+    }
+    else
+    {
+        foreach(Cell * cell, selectedCells_)
+            if(!cells.contains(cell))
+                processSelectedCellRemoved_(cell);
+        foreach(Cell * cell, cells)
+            if(!selectedCells_.contains(cell))
+                processSelectedCellAdded_(cell);
+    }
     selectedCells_ = cells;
 
     if (changing)
@@ -6065,7 +7662,33 @@ void VAC::setSelectedCells(const CellSet & cells, bool emitSignal)
 
 void VAC::selectAll(bool emitSignal)
 {
-    addToSelection(cells(), emitSignal);
+    if(!isBulkSelectionChange_(cells_.size()))
+    {
+        addToSelection(cells(), emitSignal);
+        return;
+    }
+
+    // Flags are set in one pass, and the selection copied from the cells
+    // only if it changes
+    bool changing = false;
+    for(Cell * c: cells_)
+    {
+        if(!c->isSelected())
+        {
+            c->setSelected(true);
+            changing = true;
+        }
+    }
+    if(changing)
+    {
+        selectedCells_ = cells();
+        processSelectionReset_();
+    }
+
+    if(emitSignal)
+    {
+        emit changed();
+    }
 }
 
 void VAC::selectConnected(bool emitSignal)
@@ -6142,6 +7765,7 @@ void VAC::prepareDragAndDrop(double x0, double y0, Time time)
 {
     draggedVertices_.clear();
     draggedEdges_.clear();
+    isDragRigid_ = false;
 
     // do nothing if the highlighted object is not a node object
     if(!hoveredCell_)
@@ -6156,57 +7780,131 @@ void VAC::prepareDragAndDrop(double x0, double y0, Time time)
 
     // get which cells must be dragged
     CellSet cellsToDrag;
-    if(hoveredCell_->isSelected() && global()->toolMode() == Global::SELECT)
+    const bool isSelectionDragged =
+            hoveredCell_->isSelected() && global()->toolMode() == Global::SELECT;
+    if(isSelectionDragged)
         cellsToDrag = selectedCells();
     else
         cellsToDrag << hoveredCell_;
 
-    // Partition into three sets of cells
-    CellSet cellsNotToKeyframe;
+    // Inbetween cells existing at drag time must be keyframed
     CellSet cellsToKeyframe;
     foreach(Cell * c, cellsToDrag)
     {
         InbetweenCell * sc = c->toInbetweenCell();
-        if(sc)
-        {
-            if(sc->exists(time))
-            {
-                cellsToKeyframe << sc;
-            }
-            else
-            {
-                cellsNotToKeyframe << sc;
-            }
-        }
-        else
-        {
-            cellsNotToKeyframe << c;
-        }
+        if(sc && sc->exists(time))
+            cellsToKeyframe << sc;
     }
 
-    // Keyframe cells
-    KeyCellSet keyframedCells = keyframe_(cellsToKeyframe,time);
-
-    // Update which cells to drag
-    cellsToDrag = cellsNotToKeyframe;
-    foreach(KeyCell * c, keyframedCells)
-        cellsToDrag << c;
-    cellsToDrag = Algorithms::closure(cellsToDrag);
-
     // todo: add the non-loop edges whose end vertices are dragged
-    draggedVertices_ = KeyVertexSet(cellsToDrag);
-    draggedEdges_ = KeyEdgeSet(cellsToDrag);
+    if(isSelectionDragged && cellsToKeyframe.isEmpty())
+    {
+        // Common case: the closure of the selection is already known
+        draggedVertices_ = selectionClosure_.keyVertices(selectedCells_);
+        draggedEdges_ = selectionClosure_.keyEdges(selectedCells_);
+    }
+    else
+    {
+        // Keyframe cells
+        CellSet cellsNotToKeyframe = cellsToDrag;
+        cellsNotToKeyframe.subtract(cellsToKeyframe);
+        KeyCellSet keyframedCells = keyframe_(cellsToKeyframe,time);
+
+        // Update which cells to drag
+        cellsToDrag = cellsNotToKeyframe;
+        foreach(KeyCell * c, keyframedCells)
+            cellsToDrag << c;
+        cellsToDrag = Algorithms::closure(cellsToDrag);
+        draggedVertices_ = KeyVertexSet(cellsToDrag);
+        draggedEdges_ = KeyEdgeSet(cellsToDrag);
+    }
 
     // prepare drag and drop
     foreach(KeyEdge * iedge, draggedEdges_)
-        iedge->geometry()->prepareDragAndDrop();
+        iedge->editGeometry()->prepareDragAndDrop();
     foreach(KeyVertex * v, draggedVertices_)
         v->prepareDragAndDrop();
 
+    if(DevSettings::getBool("rigid drag and drop"))
+        prepareRigidDragAndDrop_();
+
     x0_ = x0;
     y0_ = y0;
 }
 
+void VAC::prepareRigidDragAndDrop_()
+{
+    isDragRigid_ = true;
+    dragLastDx_ = 0;
+    dragLastDy_ = 0;
+
+    // All cells whose geometry depends on the dragged cells
+    CellSet dependentCells;
+    foreach(KeyVertex * v, draggedVertices_)
+        dependentCells.unite(v->geometryDependentCells_());
+    foreach(KeyEdge * e, draggedEdges_)
+        dependentCells.unite(e->geometryDependentCells_());
+
+    // Cells moving rigidly: dragged cells (whose boundary is dragged too,
+    // since the closure is dragged), and key faces whose whole boundary is
+    // dragged. Inbetween cells are always recomputed, since their geometry
+    // also depends on cells that are not dragged
+    CellSet draggedCells;
+    foreach(KeyVertex * v, draggedVertices_)
+        draggedCells << v;
+    foreach(KeyEdge * e, draggedEdges_)
+        draggedCells << e;
+
+    dragTranslatedCells_ = draggedCells;
+    dragClearedCells_.clear();
+    foreach(Cell * c, dependentCells)
+    {
+        if(draggedCells.contains(c))
+            continue;
+
+        KeyFace * f = c->toKeyFace();
+        if(f && draggedCells.contains(f->boundary()))
+            dragTranslatedCells_ << f;
+        else
+            dragClearedCells_ << c;
+    }
+
+    // Edges deformed by the drag: those with only some of their end
+    // vertices dragged, or with both end vertices dragged but not themselves
+    dragDeformedEdges_.clear();
+    foreach(KeyVertex * v, draggedVertices_)
+    {
+        foreach(Cell * c, v->spatialStar())
+        {
+            KeyEdge * e = c->toKeyEdge();
+            if(e && !draggedEdges_.contains(e))
+                dragDeformedEdges_ << e;
+        }
+    }
+}
+
+void VAC::performRigidDragAndDrop_(double dx, double dy)
+{
+    foreach(KeyEdge * iedge, draggedEdges_)
+        iedge->editGeometry()->performDragAndDrop(dx, dy);
+
+    foreach(KeyVertex * v, draggedVertices_)
+        v->pos_ = v->posBack_ + Eigen::Vector2d(dx,dy);
+
+    // Dragged edges already match their end vertices, only deformed edges
+    // need to be corrected
+    foreach(KeyEdge * iedge, dragDeformedEdges_)
+        iedge->correctGeometryShape_();
+
+    foreach(Cell * c, dragTranslatedCells_)
+        c->translateCachedGeometry_(dx-dragLastDx_, dy-dragLastDy_);
+    foreach(Cell * c, dragClearedCells_)
+        c->clearCachedGeometry_();
+
+    dragLastDx_ = dx;
+    dragLastDy_ = dy;
+}
+
 void VAC::performDragAndDrop(double x, double y)
 {
     double dx = x-x0_;
@@ -6228,18 +7926,24 @@ void VAC::performDragAndDrop(double x, double y)
         else if (std::abs(theta + 3*PI/4) <   PI/8) { dx = -d; dy = -d; }
     }
 
-    foreach(KeyEdge * iedge, draggedEdges_)
+    if(isDragRigid_)
     {
-        iedge->geometry()->performDragAndDrop(dx, dy);
-        iedge->processGeometryChanged_();
+        performRigidDragAndDrop_(dx, dy);
     }
+    else
+    {
+        foreach(KeyEdge * iedge, draggedEdges_)
+        {
+            iedge->editGeometry()->performDragAndDrop(dx, dy);
+            iedge->processGeometryChanged_();
+        }
 
-    foreach(KeyVertex * v, draggedVertices_)
-        v->performDragAndDrop(dx, dy);
-
+        foreach(KeyVertex * v, draggedVertices_)
+            v->performDragAndDrop(dx, dy);
 
-    foreach(KeyVertex * v, draggedVertices_)
-        v->correctEdgesGeometry();
+        foreach(KeyVertex * v, draggedVertices_)
+            v->correctEdgesGeometry();
+    }
 
     transformTool_.performDragAndDrop(dx, dy);
 
@@ -6248,6 +7952,11 @@ void VAC::performDragAndDrop(double x, double y)
 
 void VAC::completeDragAndDrop()
 {
+    isDragRigid_ = false;
+    dragTranslatedCells_.clear();
+    dragClearedCells_.clear();
+    dragDeformedEdges_.clear();
+
     transformTool_.endDragAndDrop();
     global()->setDragAndDropping(false);
 
@@ -6304,7 +8013,10 @@ void VAC::performTemporalDragAndDrop(Time t)
         return;
 
     foreach(KeyCell * keyCell, draggedKeyCells_)
+    {
         keyCell->setTime(draggedKeyCellTime_[keyCell] + deltaTime);
+        keyTimeIndex_.updateKeyCellTime(keyCell, zOrdering_);
+    }
 
     emit changed();
 }
@@ -6408,6 +8120,7 @@ KeyVertex * VAC::split(double x, double y, Time time, bool interactive)
                 // Begin
                 timeInteractivity_ = time;
                 sketchedEdge_ = new LinearSpline(ds_);
+                sketchBuffer_.clear();
                 sketchedEdge_->beginSketch(EdgeSample(selectedVertex->pos()[0],selectedVertex->pos()[1],global()->edgeWidth()));
                 hoveredFaceOnMouseRelease_ = 0;
                 hoveredFaceOnMousePress_ = 0;
@@ -6448,10 +8161,64 @@ KeyVertex * VAC::split(double x, double y, Time time, bool interactive)
 
 bool VAC::check() const
 {
-    foreach(Cell * c, cells_)
-        if(!(c->check()))
-            return false;
-    return true;
+    std::vector<Cell*> cells;
+    cells.reserve(cells_.size());
+    for(Cell * c: cells_)
+        cells.push_back(c);
+    return checkCells_(cells);
+}
+
+bool VAC::checkModified() const
+{
+    std::vector<Cell*> cells;
+    for(Cell * c: cells_)
+        if(c->stateVersion() > checkedStateVersion_)
+            cells.push_back(c);
+    return checkCells_(cells);
+}
+
+bool VAC::checkCells_(const std::vector<Cell*> & cells) const
+{
+    checkedStateVersion_ = Cell::lastStateVersion();
+
+    // Checking one cell is too cheap to be a task of its own, so cells are
+    // split into one contiguous shard per thread. Cells are only read.
+    struct CheckShard
+    {
+        int begin;
+        int end;
+        std::vector<int> invalidIds;
+    };
+    const int numCells = cells.size();
+    int numShards = 1;
+    if(DevSettings::getBool("parallel check"))
+        numShards = std::max(1, std::min(QThread::idealThreadCount(), numCells / MIN_CELLS_PER_CHECK_SHARD));
+    std::vector<CheckShard> shards(numShards);
+    for(int i=0; i<numShards; ++i)
+    {
+        shards[i].begin = (i * numCells) / numShards;
+        shards[i].end = ((i+1) * numCells) / numShards;
+    }
+    auto checkShard = [&cells](CheckShard & shard) {
+        for(int i=shard.begin; i<shard.end; ++i)
+            if(!cells[i]->check())
+                shard.invalidIds.push_back(cells[i]->id());
+    };
+    if(numShards > 1)
+        QtConcurrent::blockingMap(shards, checkShard);
+    else
+        checkShard(shards[0]);
+
+    bool res = true;
+    for(const CheckShard & shard: shards)
+    {
+        for(int id: shard.invalidIds)
+        {
+            qDebug() << "Cell(" << id << ") is not valid.";
+            res = false;
+        }
+    }
+    return res;
 }
 
 bool VAC::checkContains(const Cell * c) const
@@ -6480,9 +8247,19 @@ void VAC::updateToBePaintedFace(double x, double y, Time time)
     // From here, we try to find a list of cycles such that
     // the corresponding face would intersect with the cursor
 
-    // Compute distances to all edges
+    // Query the faces of the planar map, computed once per frame
+    if(DevSettings::getBool("cached paint bucket"))
+    {
+        const PlanarArrangement & arrangement = planarArrangements_.arrangement(instantEdges(time), time);
+        int i = arrangement.faceAt(x, y);
+        if(i >= 0)
+            *toBePaintedFace_ = arrangement.face(i);
+        return;
+    }
+
+    // Compute distances to all edges existing at this time
     QMap<KeyEdge*,EdgeGeometry::ClosestVertexInfo> distancesToEdges;
-    foreach(KeyEdge * e, instantEdges())
+    foreach(KeyEdge * e, instantEdges(time))
         distancesToEdges[e] = e->geometry()->closestPoint(x,y);
 
     // First, we try to create such a face assuming that the
@@ -6694,6 +8471,44 @@ Cell * VAC::paint(double /*x*/, double /*y*/, Time /*time*/)
     return res;
 }
 
+void VAC::fillAllEnclosedRegions()
+{
+    // Find, in a single pass, the faces of the planar map which are not
+    // already covered by a face
+    Time time = global()->activeTime();
+    const PlanarArrangement & arrangement = planarArrangements_.arrangement(instantEdges(time), time);
+    QList< QList<Cycle> > newFaces;
+    ScratchArena::Scope scratchScope;
+    ScratchVector<Cell*> cells;
+    for(int i=0; i<arrangement.numFaces(); ++i)
+    {
+        Eigen::Vector2d p = arrangement.interiorPoint(i);
+        cells.clear();
+        spatialIndex_.cells(zOrdering_, time, BoundingBox(p[0], p[1]), cells);
+        bool isFilled = false;
+        for(Cell * c: cells)
+        {
+            if(c->toFaceCell() && c->triangles(time).intersects(p))
+            {
+                isFilled = true;
+                break;
+            }
+        }
+        if(!isFilled)
+            newFaces << arrangement.faceCycles(i);
+    }
+
+    // Create them
+    if(newFaces.isEmpty())
+        return;
+    foreach(const QList<Cycle> & cycles, newFaces)
+        newKeyFace(cycles);
+
+    emit needUpdatePicking();
+    emit changed();
+    emit checkpoint();
+}
+
 void VAC::test()
 {
     // This function is for debug purposes
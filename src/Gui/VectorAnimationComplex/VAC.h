@@ -12,6 +12,8 @@
 #include <QSet>
 #include <QMap>
 #include <QColor>
+#include <QHash>
+#include <memory>
 
 #include "../SceneObject.h"
 
@@ -19,12 +21,26 @@
 #include "CellList.h"
 #include "Cell.h"
 #include "ZOrderedCells.h"
+#include "DrawList.h"
+#include "SpatialIndex.h"
+#include "TimeIndex.h"
+#include "KeyTimeIndex.h"
+#include "SelectionClosure.h"
+#include "SelectionSummary.h"
+#include "PlanarArrangement.h"
+#include "CellTable.h"
 #include "Eigen.h"
 #include "TransformTool.h"
+#include "Symbols.h"
+#include "SketchBuffer.h"
+#include "CellObserver.h"
+#include "IncidenceList.h"
 
 #include "../View3DSettings.h"
 
 class Scene;
+struct RenderMesh;
+struct RenderPacket;
 class XmlStreamWriter;
 class XmlStreamReader;
 
@@ -66,14 +82,45 @@ public:
     void initCopyable();
 
     // VAC extraction and insertion
-    QMap<int, int> import(VAC * other, bool selectImportedCells = false); // insert a copy of other inside this
+    std::vector<int> import(VAC * other, bool selectImportedCells = false); // insert a copy of other inside this, returns res[oldID] = newID (or -1)
     VAC * subcomplex(const CellSet & subcomplexCells); // Create a new VAC whose cells are cells
 
+    // Memory used by cells and their caches, see MemoryStats
+    void reportMemory(MemoryStats::Report & report) const;
+
     // Drawing
     void draw(Time time, ViewSettings & viewSettings);
     void drawPick(Time time, ViewSettings & viewSettings);
+    int pick(Time time, double x, double y, double tolerance,
+             ViewSettings & viewSettings, double & distance);
     void drawInbetweenCells3D(View3DSettings & viewSettings);
+    void drawFrame3D(Time time, ViewSettings & view2DSettings); // same as draw(), but cells only
+    void drawCells(Time time, ViewSettings & viewSettings); // same as draw(), but cells only, in all passes of the display mode
     void drawOneFrame3D(Time time, View3DSettings & viewSettings, ViewSettings & view2DSettings, bool drawAsTopo = false);
+
+    // Same as draw(), split between what a RenderThread draws and what is
+    // drawn over it. buildRenderPacket() appends the cells to draw to the
+    // items of packet, and returns false if some cells can't be drawn this
+    // way, in which case draw() must be used instead.
+    bool buildRenderPacket(Time time, ViewSettings & viewSettings, RenderPacket & packet);
+    void drawOverlays(Time time, ViewSettings & viewSettings);
+
+    // Triangulates in parallel, and caches, the faces and inbetween edges
+    // existing at the given time whose triangles are not cached yet, as
+    // draw() would. Used to compute the geometry of upcoming frames ahead of
+    // time during playback (see Timeline), and of each exported frame before
+    // it is drawn (see MainWindow). Returns once all cells are triangulated.
+    // Does nothing if the "parallel triangulation" setting is off.
+    void prefetchGeometry(Time time);
+
+    // Reads the deferred geometry of at most maxNumEdges key edges, the
+    // closest to the given time first (see read()), in parallel if the
+    // "parallel loading" setting is on. Returns the number of key edges
+    // whose geometry is still deferred.
+    int readDeferredGeometry(Time time, int maxNumEdges);
+
+    // SVG export
+    void prepareExportSVG();
     void drawAllFrames3D(View3DSettings & viewSettings, ViewSettings & view2DSettings);
     void drawKeyCells3D(View3DSettings & viewSettings, ViewSettings & view2DSettings);
     void drawPick3D(View3DSettings & viewSettings);
@@ -92,6 +139,15 @@ public:
     Cell * hoveredCell() const;
     const CellSet & selectedCells() const;
     int numSelectedCells() const;
+    int numSelectedCells(SelectionSummary::CellType type);
+
+    // Times where key cells exist, and lifespans of inbetween cells, within
+    // or intersecting [t1, t2], sorted, without duplicates. Used to paint
+    // the timeline
+    QVector<double> keyTimes(double t1, double t2);
+    QVector< QPair<double, double> > inbetweenLifespans(double t1, double t2);
+    QVector<double> selectedKeyTimes();
+    QVector< QPair<double, double> > selectedInbetweenLifespans();
 
     // Get hovered transform widget id
     int hoveredTransformWidgetId() const;
@@ -118,6 +174,20 @@ public:
     InbetweenEdge * getInbetweenEdge(int id);
     InbetweenFace * getInbetweenFace(int id);
 
+    // Stamps which increase each time the geometry (resp. the topology: the
+    // star of any cell or the time of any key cell) of any cell of this VAC
+    // changes, or cells are inserted, removed or reordered. Caches depending
+    // on many cells compare them to the stamps they were computed at
+    unsigned int geometryVersion() const { return geometryVersion_ + zOrdering_.version(); }
+    unsigned int topologyVersion() const { return topologyVersion_ + zOrdering_.version(); }
+
+    // Spatial queries on the cells existing at a given time (see
+    // SpatialIndex): cells whose bounding box intersects rect, from top to
+    // bottom, and bounding box of all cells, or of the selected ones
+    void cells(Time time, const BoundingBox & rect, ScratchVector<Cell*> & out);
+    BoundingBox boundingBox(Time time);
+    BoundingBox selectionBoundingBox(Time time) const;
+
     // Get all cells of a given type
     CellSet cells();
     VertexCellList vertices();
@@ -126,6 +196,9 @@ public:
     KeyEdgeList instantEdges();
     KeyVertexList instantVertices();
 
+    // Number of cells of the given concrete kind, e.g. KeyEdgeKind
+    int numCells(int kind) const;
+
     // Get all cells of a given type existing at a given time
     EdgeCellList edges(Time time);
     KeyEdgeList instantEdges(Time time);
@@ -134,6 +207,18 @@ public:
     // Get all cells, ordered
     const ZOrderedCells & zOrdering() const;
 
+    // Stamp which changes each time a cell existing at the given time is
+    // created, deleted, reordered, modified, selected, or hovered, i.e.,
+    // whenever draw(time) may draw something different. Used to invalidate
+    // frames cached for playback independently from each other. If
+    // includeHovered is false, which cell is hovered is ignored, but which
+    // transform tool widget is hovered is not: views use this to only redraw
+    // the previously and newly hovered cells when nothing else changed
+    unsigned int drawingVersion(Time time, bool includeHovered = true) const;
+
+    // Symbols whose masters are cells of this VAC, and their instances
+    const Symbols & symbols() const;
+
     // Populate MainWindow toolbar (called once, when launching application)
     static void populateToolBar(QToolBar * toolBar, Scene * scene);
 
@@ -166,6 +251,7 @@ public:
     void beginSketchEdge(double x, double y, double w, Time time);
     void continueSketchEdge(double x, double y, double w);
     void endSketchEdge();
+    void finishSketchEdge(); // inserts the edge deferred by endSketchEdge(), if any
 
     // -- Sculpt --
     void updateSculpt(double x, double y, Time time);
@@ -224,6 +310,8 @@ public slots:
     void deleteSelectedCells();
     void smartDelete();
     void createFace();
+    void createFaces();
+    void fillAllEnclosedRegions();
     void addCyclesToFace();
     void removeCyclesFromFace();
     void changeColor();
@@ -239,14 +327,20 @@ public slots:
     void glue();
     void unglue();
     void uncut();
+    void createSymbol(); // from the closure of the selection
+    void addSymbolInstance(); // of the symbol of the selected cells
+    void removeSymbolInstances();
     void cut(VAC* & clipboard);
     void copy(VAC* & clipboard);
     void paste(VAC* & clipboard);
+    Time copyTime() const; // time of the last cut or copy, cells are pasted relative to it
+    void setCopyTime(Time time); // e.g., of cells copied by another process (see Clipboard)
     void resetCellsToConsiderForCutting();
     void updateCellsToConsiderForCutting();
     // -- animation --
     void inbetweenSelection();
     void keyframeSelection();
+    void keyframeSelection(int firstFrame, int lastFrame); // at every frame of the range
     void motionPaste(VAC* & clipboard);
 
 public:
@@ -293,15 +387,26 @@ public:
     bool atomicSimplifyAtCell(Cell * cell);
     bool simplifyAtCell(Cell * cell);
 
-    // Check the invariants of the VAC
+    // Check the invariants of the VAC (see Cell::check()), printing the
+    // invalid cells. check() validates all cells, sharded across worker
+    // threads. checkModified() only validates the cells whose state changed
+    // since the last validation (see Cell::stateVersion()), which is cheap
+    // enough to run after every operation
     bool check() const;
+    bool checkModified() const;
     bool checkContains(const Cell * c) const;
 
+    // Observers of all cells, informed of their changes once per transaction
+    // (see CellObserver). flushCellChanges() ends the current transaction.
+    void addObserver(CellObserver * observer);
+    void removeObserver(CellObserver * observer);
+    void flushCellChanges();
+
 
 protected:
     // Save & Load
     void save_(QTextStream & out);
-    virtual void exportSVG_(Time t, QTextStream & out);
+    virtual void exportSVG_(Time t, SvgStreamWriter & out);
     void read2ndPass_();
 
 signals:
@@ -311,12 +416,35 @@ private:
     // Trusting operators
     friend class Operator;
 
+    // Undo history, accessing cells and depth ordering
+    friend class History;
+
     // All cells in vac, accessible by ID
-    QMap<int, Cell*> cells_;
+    CellTable cells_;
+
+    // See check()
+    bool checkCells_(const std::vector<Cell*> & cells) const;
+    mutable unsigned int checkedStateVersion_; // Cell::lastStateVersion() when last checked
     void removeCell_(Cell * cell);
     void insertCell_(Cell * cell);
     void insertCellLast_(Cell * cell);
 
+    // Cells created by a CellBuilder are given an ID and added to cells_
+    // right away, but only inserted in the z-ordering when it commits
+    friend class CellBuilder;
+    void registerCell_(Cell * cell);
+    static EdgeGeometry * straightGeometry_(KeyVertex * left, KeyVertex * right, double width);
+
+    // Same as import(), but moves the cells of other into this VAC instead of
+    // copying them, leaving other empty. Other is typically a clone, whose
+    // cells are neither selected nor hovered. On output, idMap[oldID] = newID,
+    // or -1 if other has no cell with this ID
+    void importCells_(VAC * other, std::vector<int> & idMap, bool selectImportedCells);
+
+    // Create a new VAC containing a copy of the given cells, with the same
+    // IDs, in this z-order. Their boundary must be included
+    VAC * clone_(const std::vector<Cell*> & cells);
+
     // Managing IDs
     int getAvailableID();
     void deleteAllCells();
@@ -338,14 +466,26 @@ private:
     // Drawing a new stroke
     void insertSketchedEdgeInVAC();
     void insertSketchedEdgeInVAC(double tolerance, bool useFaceToConsiderForCutting = true);
+    void insertSketchedEdgeInVAC(const EvaluationContext & context, double tolerance, bool useFaceToConsiderForCutting = true);
     void drawSketchedEdge(Time time, ViewSettings & viewSettings) const;
     void drawTopologySketchedEdge(Time time, ViewSettings & viewSettings) const;
     LinearSpline * sketchedEdge_;
+    mutable SketchBuffer sketchBuffer_; // vertices of sketchedEdge_
+    bool isSketchedEdgePending_; // drawn as is, but not inserted yet
+    void insertSketchedEdge_();
     double ds_;
     KeyFace * hoveredFaceOnMousePress_;
     KeyFace * hoveredFaceOnMouseRelease_;
     KeyFaceSet hoveredFacesOnMouseMove_;
     KeyFaceSet facesToConsiderForCutting_;
+
+    // Live preview of the intersections of the stroke being drawn with
+    // existing edges. Only the segments between vertices which became final
+    // since the last update are tested, against the edges found near them
+    // via the spatial index.
+    void updateSketchPreview_();
+    int sketchPreviewNumVertices_; // number of final vertices already tested
+    QList<Eigen::Vector2d> sketchPreviewIntersections_;
     KeyEdgeSet edgesToConsiderForCutting_;
 
     // Create a face, or inserting/removing cycles
@@ -389,16 +529,58 @@ private:
     };
     bool cutFace_(KeyFace * f, KeyEdge * edge, CutFaceFeedback * feedback = 0);
 
+    // Live preview of the face cut. The boundary of the faces incident to the
+    // start vertex is sampled once by beginCutFace(), into segments bucketed
+    // in a grid. Then, only the segments of the stroke added since the last
+    // update are tested for crossings, which are drawn as the intersections
+    // of a sketched edge, and used by endCutFace() to choose the face to cut.
+    struct CutFaceSegment
+    {
+        KeyFace * face;
+        double x1, y1, x2, y2;
+        int lastTestedStrokeSegment; // avoids testing it once per grid cell
+    };
+    struct CutFaceCrossing
+    {
+        KeyFace * face;
+        double x, y;
+    };
+    void prepareCutFacePreview_();
+    void updateCutFacePreview_();
+    void clearCutFacePreview_();
+    KeyFace * cutFacePreviewFace_(const KeyFaceSet & faces, KeyVertex * endVertex) const;
+    std::vector<CutFaceSegment> cutFaceSegments_;
+    QHash<QPair<int,int>, std::vector<int> > cutFaceGrid_;
+    std::vector<CutFaceCrossing> cutFaceCrossings_;
+
     // Inbetweening
     InbetweenVertex * inbetweenVertices_(KeyVertex * v1, KeyVertex * v2);
     InbetweenEdge * inbetweenEdges_(KeyEdge * e1, KeyEdge * e2);
 
+    // Inbetween cells are created in two phases: first their topology, one
+    // cell after the other, then their geometry, which is computed for all
+    // of them at once by this function, in parallel. It is called on the
+    // cells whose ID is at least firstId, i.e., the ones created since
+    // firstId = maxID_+1, and the geometry cached at the given time
+    void prepareInbetweenCells_(int firstId, Time time);
+
     // Keyframing
     KeyCellSet keyframe_(const CellSet & cells, Time time);
     KeyVertex * keyframe_(InbetweenVertex * svertex, Time time);
     KeyEdge * keyframe_(InbetweenEdge * sedge, Time time);
     KeyFace * keyframe_(InbetweenFace * sface, Time time);
 
+    // Same, with the position or geometry of the keyframe given. The VAC
+    // takes ownership of the geometry
+    KeyVertex * keyframe_(InbetweenVertex * svertex, Time time, const Eigen::Vector2d & pos);
+    KeyEdge * keyframe_(InbetweenEdge * sedge, Time time, EdgeGeometry * geometry);
+
+    // Keyframe cells at several times, sorted in increasing order. The
+    // topology is split one time after the other, but the positions and
+    // geometries of all keyframes are computed beforehand from the initial
+    // inbetween cells, in parallel
+    KeyCellSet keyframe_(const CellSet & cells, const QList<Time> & times);
+
     // Sculpting
     KeyEdge * sculptedEdge_;
 
@@ -407,6 +589,18 @@ private:
     KeyEdgeSet draggedEdges_;
     double x0_, y0_;
 
+    // Drag and drop of closed subcomplexes: the cached geometry of cells
+    // whose whole boundary is dragged is translated rather than recomputed.
+    // Only the edges deformed by the drag, and the cells depending on them,
+    // have their geometry recomputed
+    bool isDragRigid_;
+    double dragLastDx_, dragLastDy_;
+    CellSet dragTranslatedCells_;
+    CellSet dragClearedCells_;
+    KeyEdgeSet dragDeformedEdges_;
+    void prepareRigidDragAndDrop_();
+    void performRigidDragAndDrop_(double dx, double dy);
+
     // Temporal drag and drop
     KeyCellSet draggedKeyCells_;
     QMap<KeyCell*, Time> draggedKeyCellTime_;
@@ -424,10 +618,66 @@ private:
     int hoveredTransformWidgetId_;
     Cell * hoveredCell_;
     CellSet selectedCells_;
+    SelectionClosure selectionClosure_;
+    SelectionSummary selectionSummary_;
+    void processSelectedCellAdded_(Cell * cell);
+    void processSelectedCellRemoved_(Cell * cell);
+    bool isBulkSelectionChange_(int numCells) const;
+    void processSelectionReset_();
 
     // Z-layering
     ZOrderedCells zOrdering_;
 
+    // Batched drawing of all cells
+    void drawCells_(Time time, ViewSettings & viewSettings);
+    void drawCellsTopology_(Time time, ViewSettings & viewSettings);
+    void drawTools_(Time time, ViewSettings & viewSettings); // sculpt cursor, transform tool, etc.
+    bool isPreviewedTransformed_(Cell * c) const;
+    void triangulateCells_(Time time);
+    void triangulateCells_(const std::vector<Cell*> & cells, Time time, int minNumTriangulations);
+    void prepareSampling_(const CellSet & cells, const EvaluationContext & context); // of edges the cells depend on, see Cell::computeTriangles()
+    DrawList drawList_;
+    DrawList drawList3D_; // keeps vertex buffers of all frames drawn by the 3D view
+    DrawList topologyDrawList_;
+
+    // Copies of the triangles of cells in render packets, by cell ID, for
+    // illustration [0] and topology [1], reused while the triangles of the
+    // cell are unchanged (see DrawList::CellStamp)
+    struct RenderMeshEntry
+    {
+        std::shared_ptr<const RenderMesh> mesh;
+        unsigned int geometryVersion;
+        const Triangles * triangles;
+        int numTriangles;
+        unsigned int lastUsed;
+    };
+    QHash<int, RenderMeshEntry> renderMeshes_[2];
+    unsigned int renderMeshCounter_;
+
+    // Spatial queries and version stamps, which cells keep up to date
+    friend class Cell;
+    SpatialIndex spatialIndex_;
+    unsigned int geometryVersion_;
+    unsigned int topologyVersion_;
+    void processCellGeometryChanged_(Cell * cell);
+    void processCellTopologyChanged_(Cell * cell);
+
+    // Changes of the current transaction, only recorded if observed
+    IncidenceList<CellObserver> observers_;
+    CellChanges cellChanges_;
+    bool isFlushCellChangesScheduled_;
+    void processCellCreated_(Cell * cell);
+    void processCellDeleted_(Cell * cell);
+    void processCellModified_(Cell * cell);
+    void scheduleFlushCellChanges_();
+
+    // Cells by frame, for queries of the cells existing at a given time
+    TimeIndex timeIndex_;
+    KeyTimeIndex keyTimeIndex_;
+
+    // Faces of the planar map of key edges by frame, for the paint bucket
+    PlanarArrangementCache planarArrangements_;
+
     // Smart aggregation of signals
     void emitSelectionChanged_();
     void beginAggregateSignals_();
@@ -438,6 +688,10 @@ private:
     // Transform tool
     TransformTool transformTool_;
     friend class TransformTool;
+
+    // Symbols and their instances, drawn below all cells
+    Symbols symbols_;
+    int selectedSymbol_(); // first symbol containing a selected cell, or -1
 };
 
 }
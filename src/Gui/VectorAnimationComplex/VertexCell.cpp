@@ -18,8 +18,11 @@
 #include "../SaveAndLoad.h"
 #include "../Global.h"
 #include "CellList.h"
+#include "GeometryCache.h"
 
 #include <limits>
+#include <algorithm>
+#include <cmath>
 
 #include <QtDebug>
 
@@ -29,6 +32,7 @@ namespace VectorAnimationComplex
 VertexCell::VertexCell(VAC * vac) :
     Cell(vac)
 {
+    addKindBit_(VertexCellBit);
     colorSelected_[0] = 0.7;
     colorSelected_[1] = 0;
     colorSelected_[2] = 0;
@@ -42,6 +46,7 @@ VertexCell::~VertexCell()
 VertexCell::VertexCell(VAC * vac, QTextStream & in) :
     Cell(vac, in)
 {
+    addKindBit_(VertexCellBit);
     colorSelected_[0] = 0.7;
     colorSelected_[1] = 0;
     colorSelected_[2] = 0;
@@ -51,6 +56,7 @@ VertexCell::VertexCell(VAC * vac, QTextStream & in) :
 VertexCell::VertexCell(VAC * vac, XmlStreamReader & xml) :
     Cell(vac, xml)
 {
+    addKindBit_(VertexCellBit);
     colorSelected_[0] = 0.7;
     colorSelected_[1] = 0;
     colorSelected_[2] = 0;
@@ -91,6 +97,38 @@ void VertexCell::drawPickCustom(Time time, ViewSettings & /*viewSettings*/)
     glEnd();
 }
 
+double VertexCell::pickDistanceCustom(double x, double y, Time time, ViewSettings & /*viewSettings*/)
+{
+    if(!exists(time))
+        return std::numeric_limits<double>::infinity();
+
+    double r = 0.5 * size(time);
+    double d = (Eigen::Vector2d(x,y) - pos(time)).norm() - r;
+    return std::max(0.0, d);
+}
+
+double VertexCell::topologyRadius(ViewSettings & viewSettings)
+{
+    double r = 0.5 * viewSettings.vertexTopologySize();
+    if(viewSettings.screenRelative())
+    {
+        r /= viewSettings.zoom();
+    }
+    else
+    {
+        if(r == 0) r = 3;
+        else if (r<1) r = 1;
+    }
+    return r;
+}
+
+double VertexCell::pickTopologyDistanceCustom(double x, double y, Time time, ViewSettings & viewSettings)
+{
+    double r = topologyRadius(viewSettings);
+    double d = (Eigen::Vector2d(x,y) - pos(time)).norm() - r;
+    return std::max(0.0, d);
+}
+
 void VertexCell::drawRaw(Time time, ViewSettings & viewSettings)
 {
     if(isHighlighted() || isSelected())
@@ -99,43 +137,61 @@ void VertexCell::drawRaw(Time time, ViewSettings & viewSettings)
     }
 }
 
+const Triangles & VertexCell::drawnTriangles(Time time, ViewSettings & /*viewSettings*/) const
+{
+    static const Triangles emptyTriangles;
+    if(isHighlighted() || isSelected())
+        return triangles(time);
+    else
+        return emptyTriangles;
+}
+
 void VertexCell::drawRawTopology(Time time, ViewSettings & viewSettings)
 {
-    bool screenRelative = viewSettings.screenRelative();
-    if(screenRelative)
+    drawnTopologyTriangles(time, viewSettings).draw();
+}
+
+const Triangles & VertexCell::drawnTopologyTriangles(Time time, ViewSettings & viewSettings) const
+{
+    // Get cache key
+    double r = topologyRadius(viewSettings);
+    QPair<int,double> key = qMakePair(GeometryCache::timeKey(time), r);
+
+    // Compute disk if not yet cached
+    if(!trianglesTopo_.contains(key))
     {
-        int n = 50;
-        Eigen::Vector2d p = pos(time);
-        glBegin(GL_POLYGON);
+        Triangles & triangles = trianglesTopo_[key];
+        if(exists(time))
         {
-            double r = 0.5 * viewSettings.vertexTopologySize() / viewSettings.zoom();
-            //if(r == 0) r = 3;
-            //else if (r<1) r = 1;
+            int n = 50;
+            Eigen::Vector2d p = pos(time);
+            int center = triangles.addVertex(p.x(), p.y());
             for(int i=0; i<n; ++i)
             {
                 double theta = 2 * (double) i * 3.14159 / (double) n ;
-                glVertex2d(p.x() + r*std::cos(theta),p.y()+ r*std::sin(theta));
+                triangles.addVertex(p.x() + r*std::cos(theta),p.y()+ r*std::sin(theta));
             }
-        }
-        glEnd();
-    }
-    else
-    {
-        int n = 50;
-        Eigen::Vector2d p = pos(time);
-        glBegin(GL_POLYGON);
-        {
-            double r = 0.5 * viewSettings.vertexTopologySize();
-            if(r == 0) r = 3;
-            else if (r<1) r = 1;
             for(int i=0; i<n; ++i)
-            {
-                double theta = 2 * (double) i * 3.14159 / (double) n ;
-                glVertex2d(p.x() + r*std::cos(theta),p.y()+ r*std::sin(theta));
-            }
+                triangles.addTriangle(center, center+1+i, center+1+(i+1)%n);
         }
-        glEnd();
+        triangles.setRetained(true);
     }
+
+    // Return cached disk
+    return trianglesTopo_[key];
+}
+
+void VertexCell::clearCachedGeometry_()
+{
+    Cell::clearCachedGeometry_();
+    trianglesTopo_.clear();
+}
+
+void VertexCell::translateCachedGeometry_(double dx, double dy)
+{
+    Cell::translateCachedGeometry_(dx, dy);
+    for(auto it = trianglesTopo_.begin(); it != trianglesTopo_.end(); ++it)
+        it.value().translate(dx, dy);
 }
 
 double VertexCell::size(Time time) const
@@ -180,6 +236,7 @@ void VertexCell::write_(XmlStreamWriter & /*xml*/) const
 VertexCell::VertexCell(VertexCell * other) :
     Cell(other)
 {
+    addKindBit_(VertexCellBit);
     colorSelected_[0] = 0.7;
     colorSelected_[1] = 0;
     colorSelected_[2] = 0;
@@ -241,7 +298,7 @@ Eigen::Vector2d circle_(const Eigen::Vector2d & center, double r, double theta)
 
 }
 
-void VertexCell::triangulate_(Time time, Triangles & out) const
+void VertexCell::triangulate_(Time time, const EvaluationContext & /*context*/, Triangles & out) const
 {
     out.clear();
     if (exists(time))
@@ -13,6 +13,7 @@
 #include "Cell.h"
 #include "Halfedge.h"
 #include <QPair>
+#include <QMap>
 
 namespace VectorAnimationComplex
 {
@@ -33,6 +34,11 @@ public:
     //void draw(Time time, ViewSettings & viewSettings);
     void drawRaw(Time time, ViewSettings & viewSettings);
     void drawRawTopology(Time time, ViewSettings & viewSettings);
+    const Triangles & drawnTriangles(Time time, ViewSettings & viewSettings) const;
+    const Triangles & drawnTopologyTriangles(Time time, ViewSettings & viewSettings) const;
+
+    // Radius of vertices in topology mode, in scene units
+    static double topologyRadius(ViewSettings & viewSettings);
 
     // Topology
     CellSet spatialBoundary() const;
@@ -43,6 +49,11 @@ public:
 protected:
     virtual ~VertexCell()=0;
 
+    // Disks drawn in topology mode (int=time, double=radius)
+    mutable QMap< QPair<int,double>, Triangles> trianglesTopo_;
+    virtual void clearCachedGeometry_();
+    virtual void translateCachedGeometry_(double dx, double dy);
+
 private:
 
     // Trusting operators
@@ -51,9 +62,11 @@ private:
 
     void drawPickCustom(Time time, ViewSettings & viewSettings);
     bool isPickableCustom(Time time) const;
+    double pickDistanceCustom(double x, double y, Time time, ViewSettings & viewSettings);
+    double pickTopologyDistanceCustom(double x, double y, Time time, ViewSettings & viewSettings);
 
     // Implementation of triangulate for both KeyVertex and InbetweenVertex
-    void triangulate_(Time time, Triangles & out) const;
+    void triangulate_(Time time, const EvaluationContext & context, Triangles & out) const;
 
     // Implementation of outline bounding box for both KeyVertex and InbetweenVertex
     void computeOutlineBoundingBox_(Time t, BoundingBox & out) const;
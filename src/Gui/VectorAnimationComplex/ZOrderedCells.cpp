@@ -11,20 +11,120 @@
 #include "Cell.h"
 #include "Algorithms.h"
 
+#include <atomic>
 #include <iostream>
+#include <vector>
 #include <QDebug>
 
 namespace VectorAnimationComplex
 {
 
+namespace
+{
+// Gap between the keys of consecutive cells when keys are renumbered.
+// Up to 32 cells can be inserted at the same position before renumbering.
+const quint64 KEY_GAP = Q_UINT64_C(1) << 32;
+}
+
 ZOrderedCells::ZOrderedCells() :
-    list_()
+    list_(),
+    version_(0),
+    entries_()
+{
+    updateVersion_();
+}
+
+void ZOrderedCells::updateVersion_()
 {
+    // Atomic, since cells may be ordered in a worker thread, e.g. when
+    // opening a file
+    static std::atomic<unsigned int> lastVersion(0);
+    version_ = ++lastVersion;
 }
 
 void ZOrderedCells::clear()
 {
+    updateVersion_();
     list_.clear();
+    entries_.clear();
+}
+
+void ZOrderedCells::reserve(int numCells)
+{
+    entries_.reserve(numCells);
+}
+
+quint64 ZOrderedCells::key_(Cell * cell) const
+{
+    auto it = entries_.constFind(cell);
+    return (it == entries_.constEnd()) ? 0 : it->key;
+}
+
+void ZOrderedCells::updateKeys_(Iterator first, Iterator last)
+{
+    quint64 n = 0;
+    for(Iterator it = first; it != last; ++it)
+        ++n;
+    if(n == 0)
+        return;
+
+    // Keys must be strictly between the keys of the cells around the range
+    quint64 lo = 0;
+    if(first != begin())
+    {
+        Iterator prev = first;
+        --prev;
+        lo = key_(*prev);
+    }
+    quint64 hi;
+    if(last != end())
+        hi = key_(*last);
+    else if(lo < ~quint64(0) - (n+1) * KEY_GAP)
+        hi = lo + (n+1) * KEY_GAP;
+    else
+        hi = lo;
+
+    // Renumber all cells if there isn't enough room
+    if(hi <= lo || hi - lo < n + 1)
+    {
+        renumberKeys_();
+        return;
+    }
+
+    quint64 step = (hi - lo) / (n + 1);
+    quint64 key = lo;
+    for(Iterator it = first; it != last; ++it)
+    {
+        key += step;
+        entries_[*it].key = key;
+    }
+}
+
+void ZOrderedCells::renumberKeys_()
+{
+    quint64 key = 0;
+    for(Iterator it = begin(); it != end(); ++it)
+    {
+        key += KEY_GAP;
+        Entry & entry = entries_[*it];
+        entry.it = it;
+        entry.key = key;
+    }
+}
+
+void ZOrderedCells::splice_(Iterator pos, CellLinkedList & other)
+{
+    if(other.begin() == other.end())
+        return;
+
+    Iterator first = other.begin();
+    list_.splice(pos, other);
+    updateKeys_(first, pos);
+}
+
+void ZOrderedCells::splice_(ReverseIterator pos, CellLinkedList & other)
+{
+    splice_(pos.base(), other);
 }
 
 ZOrderedCells::Iterator ZOrderedCells::begin()
@@ -69,12 +169,38 @@ ZOrderedCells::ConstReverseIterator ZOrderedCells::crend() const
 
 void ZOrderedCells::insertLast(Cell * cell)
 {
+    updateVersion_();
     list_.append(cell);
+    Iterator it = end();
+    --it;
+    entries_[cell].it = it;
+    updateKeys_(it, end());
+}
+
+// Same as inserting them one by one, but keys are assigned once
+void ZOrderedCells::insertLast(const std::vector<Cell*> & cells)
+{
+    if(cells.empty())
+        return;
+
+    updateVersion_();
+    Iterator first = end();
+    for(Cell * cell: cells)
+    {
+        list_.append(cell);
+        Iterator it = end();
+        --it;
+        entries_[cell].it = it;
+        if(first == end())
+            first = it;
+    }
+    updateKeys_(first, end());
 }
 
 // Insert the new cell just below the lowest boundary cell
 void ZOrderedCells::insertCell(Cell * cell)
 {
+    updateVersion_();
     // Get boundary cells
     CellSet boundary = cell->boundary();
 
@@ -87,43 +213,76 @@ void ZOrderedCells::insertCell(Cell * cell)
     else
     {
         // Insert before boundary
-        Iterator it = begin();
-        while(it!=end() && !boundary.contains(*it))
-            ++it;
-        list_.insert(it,cell);
+        Iterator it = findFirst(boundary);
+        Iterator inserted = list_.insert(it,cell);
+        entries_[cell].it = inserted;
+        updateKeys_(inserted, it);
     }
 }
 
 void ZOrderedCells::removeCell(Cell * cell)
 {
-    list_.remove(cell);
+    updateVersion_();
+    auto entry = entries_.find(cell);
+    if(entry != entries_.end())
+    {
+        list_.erase(entry->it);
+        entries_.erase(entry);
+    }
 }
 
+// Note: removing cells does not change the relative order of the other
+// cells, so their keys are still valid.
+
 ZOrderedCells::Iterator ZOrderedCells::find(Cell * cell)
 {
-    Iterator it = begin();
-    for(; it != end(); ++it)
-        if(*it == cell)
-            break;
-    return it;
+    auto entry = entries_.constFind(cell);
+    return (entry == entries_.constEnd()) ? end() : entry->it;
 }
 
 ZOrderedCells::Iterator ZOrderedCells::findFirst(const CellSet & cells)
 {
-    Iterator it = begin();
-    for(; it != end(); ++it)
-        if(cells.contains(*it))
-            break;
-    return it;
+    Iterator res = end();
+    quint64 resKey = 0;
+    for(Cell * cell: cells)
+    {
+        auto entry = entries_.constFind(cell);
+        if(entry != entries_.constEnd() && (res == end() || entry->key < resKey))
+        {
+            res = entry->it;
+            resKey = entry->key;
+        }
+    }
+    return res;
 }
 
 ZOrderedCells::ReverseIterator ZOrderedCells::findLast(const CellSet & cells)
 {
-    ReverseIterator it = rbegin();
-    for(; it != rend(); ++it)
-        if(cells.contains(*it))
-            break;
-    return it;
+    Iterator res = end();
+    quint64 resKey = 0;
+    for(Cell * cell: cells)
+    {
+        auto entry = entries_.constFind(cell);
+        if(entry != entries_.constEnd() && (res == end() || entry->key > resKey))
+        {
+            res = entry->it;
+            resKey = entry->key;
+        }
+    }
+    if(res == end())
+        return rend();
+    else
+        return ReverseIterator(++res);
+}
+
+bool ZOrderedCells::contains(Cell * cell) const
+{
+    return entries_.contains(cell);
+}
+
+bool ZOrderedCells::isBelow(Cell * c1, Cell * c2) const
+{
+    return key_(c1) < key_(c2);
 }
 
 void ZOrderedCells::raise(Cell * cell) { raise(CellSet() << cell); }
@@ -139,18 +298,42 @@ void ZOrderedCells::altLowerToBottom(Cell * cell) { altLowerToBottom(CellSet() <
 namespace // local free function
 {
 
-bool intersect(Cell * c, const CellSet & cells)
+// Bounding boxes of the cells to raise or lower, computed once instead of
+// once per cell they are tested against
+class Bounds
 {
-    foreach(Cell * c2, cells)
-        if(c->boundingBox().intersects(c2->boundingBox()))
-            return true;
-    return false;
-}
+public:
+    Bounds(const CellSet & cells)
+    {
+        boxes_.reserve(cells.size());
+        for(Cell * c: cells)
+        {
+            boxes_.push_back(c->boundingBox());
+            united_.unite(boxes_.back());
+        }
+    }
+
+    bool intersects(Cell * c) const
+    {
+        BoundingBox box = c->boundingBox();
+        if(!box.intersects(united_))
+            return false;
+        for(const BoundingBox & box2: boxes_)
+            if(box.intersects(box2))
+                return true;
+        return false;
+    }
+
+private:
+    std::vector<BoundingBox> boxes_;
+    BoundingBox united_;
+};
 
 }
 
 void ZOrderedCells::raise(CellSet cellsToRaise)
 {
+    updateVersion_();
     int n = cellsToRaise.size();
     int nFound = 0;
     if(n == 0) return;
@@ -167,6 +350,9 @@ void ZOrderedCells::raise(CellSet cellsToRaise)
     // Get cells closure
     CellSet closure = Algorithms::closure(cellsToRaise);
 
+    // Bounding boxes of the cells to raise
+    Bounds bounds(cellsToRaise);
+
     // First loop: advance it until we find c1 such that:
     //   - c1 is after every of the cells to raise (i.e., nFound == n)
     //   - c1 is not in the closure of the cells to raise
@@ -183,7 +369,7 @@ void ZOrderedCells::raise(CellSet cellsToRaise)
         {
             it = list_.extractTo(it,raisedCells);
         }
-        else if( (nFound == n) && (intersect(*it,cellsToRaise)) )
+        else if( (nFound == n) && (bounds.intersects(*it)) )
         {
             c1 = *it;
             break;
@@ -193,7 +379,7 @@ void ZOrderedCells::raise(CellSet cellsToRaise)
     }
     if(!c1) // not found, raise to top.
     {
-        list_.splice(it,raisedCells);
+        splice_(it,raisedCells);
         return;
     }
 
@@ -221,11 +407,12 @@ void ZOrderedCells::raise(CellSet cellsToRaise)
 
     // Move raised cells above it2
     ++it2;
-    list_.splice(it2,raisedCells);
+    splice_(it2,raisedCells);
 }
 
 void ZOrderedCells::lower(CellSet cellsToLower)
 {
+    updateVersion_();
     int n = cellsToLower.size();
     int nFound = 0;
     if(n == 0) return;
@@ -242,6 +429,9 @@ void ZOrderedCells::lower(CellSet cellsToLower)
     // Get cells "fullstar" (i.e., star union itself)
     CellSet fullstar = Algorithms::fullstar(cellsToLower);
 
+    // Bounding boxes of the cells to lower
+    Bounds bounds(cellsToLower);
+
     // First loop: advance it until we find c1 such that:
     //   - c1 is before every of the cells to lower (i.e., nFound == n)
     //   - c1 is not in the fullstar of the cells to lower
@@ -258,7 +448,7 @@ void ZOrderedCells::lower(CellSet cellsToLower)
         {
             it = list_.extractTo(it,loweredCells);
         }
-        else if( (nFound == n) && (intersect(*it,cellsToLower)) )
+        else if( (nFound == n) && (bounds.intersects(*it)) )
         {
             c1 = *it;
             break;
@@ -268,7 +458,7 @@ void ZOrderedCells::lower(CellSet cellsToLower)
     }
     if(!c1) // not found, raise to top.
     {
-        list_.splice(it,loweredCells);
+        splice_(it,loweredCells);
         return;
     }
 
@@ -286,7 +476,10 @@ void ZOrderedCells::lower(CellSet cellsToLower)
     }
 
     // Third loop: finish to find cells to lower (i.e., fullstar of c down to it2)
-    while(it != it2)
+    // Note: it2 is compared by cell, since the node just above it, which
+    // it2 refers to, may be extracted
+    Cell * c2 = *it2;
+    while(*it != c2)
     {
         if(fullstar.contains(*it))
             it = list_.extractTo(it,loweredCells);
@@ -295,12 +488,12 @@ void ZOrderedCells::lower(CellSet cellsToLower)
     }
 
     // Move lowered cells below it2
-    ++it2;
-    list_.splice(it2,loweredCells);
+    splice_(find(c2),loweredCells);
 }
 
 void ZOrderedCells::raiseToTop(CellSet cellsToRaise)
 {
+    updateVersion_();
     // Return in trivial case
     int n = cellsToRaise.size();
     if(n == 0) return;
@@ -322,11 +515,12 @@ void ZOrderedCells::raiseToTop(CellSet cellsToRaise)
     }
 
     // Move raised cells to top
-    list_.splice(it,raisedCells);
+    splice_(it,raisedCells);
 }
 
 void ZOrderedCells::lowerToBottom(CellSet cellsToLower)
 {
+    updateVersion_();
     // Return in trivial case
     int n = cellsToLower.size();
     if(n == 0) return;
@@ -348,11 +542,12 @@ void ZOrderedCells::lowerToBottom(CellSet cellsToLower)
     }
 
     // Move lowered cells to bottom
-    list_.splice(it,loweredCells);
+    splice_(it,loweredCells);
 }
 
 void ZOrderedCells::altRaise(CellSet cellsToRaise)
 {
+    updateVersion_();
     int n = cellsToRaise.size();
     int nFound = 0;
     if(n == 0) return;
@@ -366,6 +561,9 @@ void ZOrderedCells::altRaise(CellSet cellsToRaise)
     it = list_.extractTo(it,raisedCells);
     nFound++;
 
+    // Bounding boxes of the cells to raise
+    Bounds bounds(cellsToRaise);
+
     // First loop: advance it until we find c1 such that:
     //   - c1 is after every of the cells to raise (i.e., nFound == n)
     //   - c1 intersects at least one cell to raise
@@ -377,7 +575,7 @@ void ZOrderedCells::altRaise(CellSet cellsToRaise)
             it = list_.extractTo(it,raisedCells);
             nFound++;
         }
-        else if( (nFound == n) && (intersect(*it,cellsToRaise)) )
+        else if( (nFound == n) && (bounds.intersects(*it)) )
         {
             c1 = *it;
             break;
@@ -387,17 +585,18 @@ void ZOrderedCells::altRaise(CellSet cellsToRaise)
     }
     if(!c1) // not found, raise to top.
     {
-        list_.splice(it,raisedCells);
+        splice_(it,raisedCells);
         return;
     }
 
     // Move raised cells above it
     ++it;
-    list_.splice(it,raisedCells);
+    splice_(it,raisedCells);
 }
 
 void ZOrderedCells::altLower(CellSet cellsToLower)
 {
+    updateVersion_();
     int n = cellsToLower.size();
     int nFound = 0;
     if(n == 0) return;
@@ -411,6 +610,9 @@ void ZOrderedCells::altLower(CellSet cellsToLower)
     it = list_.extractTo(it,loweredCells);
     nFound++;
 
+    // Bounding boxes of the cells to lower
+    Bounds bounds(cellsToLower);
+
     // First loop: advance it until we find c1 such that:
     //   - c1 is before every of the cells to lower (i.e., nFound == n)
     //   - c1 intersects at least one cell to lower
@@ -422,7 +624,7 @@ void ZOrderedCells::altLower(CellSet cellsToLower)
             it = list_.extractTo(it,loweredCells);
             nFound++;
         }
-        else if( (nFound == n) && (intersect(*it,cellsToLower)) )
+        else if( (nFound == n) && (bounds.intersects(*it)) )
         {
             c1 = *it;
             break;
@@ -432,17 +634,18 @@ void ZOrderedCells::altLower(CellSet cellsToLower)
     }
     if(!c1) // not found, raise to top.
     {
-        list_.splice(it,loweredCells);
+        splice_(it,loweredCells);
         return;
     }
 
     // Move lowered cells below it
     ++it;
-    list_.splice(it,loweredCells);
+    splice_(it,loweredCells);
 }
 
 void ZOrderedCells::altRaiseToTop(CellSet cellsToRaise)
 {
+    updateVersion_();
     // Return in trivial case
     int n = cellsToRaise.size();
     if(n == 0) return;
@@ -461,11 +664,12 @@ void ZOrderedCells::altRaiseToTop(CellSet cellsToRaise)
     }
 
     // Move raised cells to top
-    list_.splice(it,raisedCells);
+    splice_(it,raisedCells);
 }
 
 void ZOrderedCells::altLowerToBottom(CellSet cellsToLower)
 {
+    updateVersion_();
     // Return in trivial case
     int n = cellsToLower.size();
     if(n == 0) return;
@@ -484,28 +688,34 @@ void ZOrderedCells::altLowerToBottom(CellSet cellsToLower)
     }
 
     // Move lowered cells to bottom
-    list_.splice(it,loweredCells);
+    splice_(it,loweredCells);
 }
 
 void ZOrderedCells::moveBelow(Cell * c1, Cell * c2)
 {
+    updateVersion_();
     Iterator it1 = find(c1);
-    list_.erase(it1);
-
     Iterator it2 = find(c2);
-    list_.insert(it2,c1);
+    if(it1 == end() || it2 == end() || it1 == it2)
+        return;
+
+    list_.splice(it2,list_,it1);
+    updateKeys_(it1,it2);
 }
 
 void ZOrderedCells::moveBelowBoundary(Cell * c)
 {
+    updateVersion_();
     CellSet boundary = c->boundary();
     if(!boundary.isEmpty())
     {
         Iterator it1 = find(c);
-        list_.erase(it1);
-
         Iterator it2 = findFirst(boundary);
-        list_.insert(it2,c);
+        if(it1 == end() || it1 == it2)
+            return;
+
+        list_.splice(it2,list_,it1);
+        updateKeys_(it1,it2);
     }
 }
 
@@ -10,10 +10,20 @@
 #define ZORDEREDCELLS_H
 
 // ZOrderedCells: A doubly linked list of cells with convenient methods
+//
+// In addition to the list, each cell is mapped to its node and to an order
+// key, increasing from bottom to top. This makes find(), findFirst(),
+// findLast(), and isBelow() independent of the number of cells in the list.
+// Keys are spread with large gaps, so that inserting cells only renumbers the
+// inserted cells, except in the rare case where there is no gap left.
 
 #include "CellList.h"
 #include "CellLinkedList.h"
 
+#include <QHash>
+#include <QtGlobal>
+#include <vector>
+
 namespace VectorAnimationComplex
 {
 
@@ -39,13 +49,19 @@ public:
 
     void insertCell(Cell * cell); // insert just below boundary
     void insertLast(Cell * cell); // insert on top
+    void insertLast(const std::vector<Cell*> & cells); // insert on top, in this order
     void removeCell(Cell * cell);
     void clear();
+    void reserve(int numCells); // preallocate storage for numCells cells
 
     Iterator find(Cell * cell);
     Iterator findFirst(const CellSet & cells);
     ReverseIterator findLast(const CellSet & cells);
 
+    // Whether c1 is drawn below c2. Both cells must be in the list.
+    bool contains(Cell * cell) const;
+    bool isBelow(Cell * c1, Cell * c2) const;
+
     // Raise or lower a single cell
 
     void raise(Cell * cell);
@@ -74,8 +90,29 @@ public:
     void moveBelow(Cell * c1, Cell * c2);
     void moveBelowBoundary(Cell * c);
 
+    // Stamp which changes each time cells are inserted, removed, or
+    // reordered. Stamps are unique across all instances of ZOrderedCells
+    unsigned int version() const { return version_; }
+
 private:
     CellLinkedList list_;
+    unsigned int version_;
+    void updateVersion_();
+
+    // Node and order key of each cell
+    struct Entry
+    {
+        Iterator it;
+        quint64 key;
+    };
+    QHash<Cell *, Entry> entries_;
+    quint64 key_(Cell * cell) const;
+    void updateKeys_(Iterator first, Iterator last); // assign keys to [first, last)
+    void renumberKeys_();
+
+    // Move all cells of other to just before pos, and assign their keys
+    void splice_(Iterator pos, CellLinkedList & other);
+    void splice_(ReverseIterator pos, CellLinkedList & other);
 
 };
 
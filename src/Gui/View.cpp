@@ -11,6 +11,9 @@
 #include "Scene.h"
 #include "Timeline.h"
 #include "DevSettings.h"
+#include "RenderStats.h"
+#include "OperatorStats.h"
+#include "Trace.h"
 #include "Global.h"
 #include "OpenGL.h"
 #include "Background/Background.h"
@@ -21,7 +24,15 @@
 #include <QtDebug>
 #include <QApplication>
 #include <QPushButton>
+#include <QTimer>
+#include <QStringList>
+#include <QScreen>
+#include <QGuiApplication>
+#include <Eigen/LU>
 #include <cmath>
+#include <algorithm>
+#include <cstring>
+#include <limits>
 
 // define mouse actions
 
@@ -47,24 +58,163 @@
 
 #define  PAINT_ACTION                                       400
 
+namespace
+{
+// Radius, in pixels, of the neighbourhood searched for an object around the cursor
+const int PICKING_RADIUS = 3;
+
+// Half-size, in pixels, of the region drawn around the cursor in region picking mode
+const int PICKING_REGION_RADIUS = 32;
+
+// Time, in milliseconds, input must be idle before an out-of-date picking
+// image of the view under the cursor is redrawn
+const int PICKING_IDLE_DELAY = 5;
+
+// Number of offscreen render targets of different sizes kept for reuse
+const int MAX_OFFSCREEN_TARGETS = 2;
+
+// Maximum size, in pixels, of the tiles drawn by drawToPng()
+const int EXPORT_TILE_SIZE = 1024;
+
+// Number of onion skins kept in cache in addition to the ones currently drawn,
+// so that going back and forth between a few frames doesn't re-render them
+const int MAX_UNUSED_ONION_SKINS = 8;
+
+// Fraction of the viewport above which a partial redraw is not worth it
+const double MAX_PARTIAL_REDRAW_AREA = 0.5;
+
+// Size, in pixels, of the tiles of the tile cache
+const int TILE_SIZE = 256;
+
+// Number of missing tiles rendered per frame while the camera moves, or per
+// step of idle rendering
+const int MAX_TILES_PER_FRAME = 4;
+
+// Number of tiles around the viewport rendered once the camera stops
+const int TILE_MARGIN = 1;
+
+// Number of coarser levels searched for a tile replacing a missing one
+const int MAX_COARSER_TILE_LEVELS = 3;
+
+// Time, in milliseconds, without camera change after which the camera is
+// considered stopped. Zooming with the wheel is a sequence of discrete changes.
+const int CAMERA_STOP_DELAY = 150;
+
+// Level of the tiles drawn at the given zoom, and size in scene units of
+// the tiles of the given level
+int tileLevel(double zoom)
+{
+    return static_cast<int>(std::floor(std::log2(zoom) + 0.5));
+}
+double tileSceneSize(int level)
+{
+    return std::ldexp(static_cast<double>(TILE_SIZE), -level);
+}
+
+// Floor of a / 2^k, also for negative a
+int floorDivPow2(int a, int k)
+{
+    return static_cast<int>(std::floor(std::ldexp(static_cast<double>(a), -k)));
+}
+
+// Bounding box of what a cell draws, in any display mode, enlarged by the
+// width of the topology and by a pixel for antialiasing. Empty if none
+VectorAnimationComplex::BoundingBox drawnBoundingBox(VectorAnimationComplex::Cell * c, Time t,
+                                                     const ViewSettings & viewSettings)
+{
+    using VectorAnimationComplex::BoundingBox;
+    if(!c || !c->exists(t))
+        return BoundingBox();
+
+    double margin = 0.5 * std::max(viewSettings.vertexTopologySize(),
+                                   viewSettings.edgeTopologyWidth());
+    if(viewSettings.screenRelative())
+        margin /= viewSettings.zoom();
+    margin += 3.0 + 1.0 / viewSettings.zoom(); // see outlineMargin() in VAC.cpp
+
+    BoundingBox bb = c->boundingBox(t).united(c->outlineBoundingBox(t));
+    if(bb.isEmpty())
+        return bb;
+    return BoundingBox(bb.xMin() - margin, bb.xMax() + margin,
+                       bb.yMin() - margin, bb.yMax() + margin);
+}
+}
+
 View::View(Scene * scene, QWidget * parent) :
     GLWidget(parent, true),
     scene_(scene),
-    pickingImg_(0),
+    lastTabletSampleX_(std::numeric_limits<double>::quiet_NaN()),
+    lastTabletSampleY_(std::numeric_limits<double>::quiet_NaN()),
+    tabletSampleTime_(-1),
+    playbackKey_(),
+    playbackFrames_(),
+    onionSkinKey_(),
+    onionSkins_(),
+    onionSkinCounter_(0),
+    frameKey_(),
+    frameHoveredCellId_(-1),
+    isFrameCacheValid_(false),
+    isFrameCacheDirty_(true),
+    frameFboId_(0),
+    frameTextureId_(0),
+    frameWidth_(0),
+    frameHeight_(0),
+    layerKey_(),
+    isLayerCacheValid_(false),
+    isDrawingFrozenLayer_(false),
+    renderThread_(0),
+    tileCounter_(0),
+    isCameraMoving_(false),
+    cameraStopTimer_(new QTimer(this)),
+    tileTimer_(new QTimer(this)),
     pickingIsEnabled_(true),
+    isPickingDirty_(false),
+    pickingIdleTimer_(new QTimer(this)),
+    isPickingRegion_(false),
+    isPickingRegionValid_(false),
+    isPickingKeyValid_(false),
+    refreshTimer_(new QTimer(this)),
+    isUpdatePending_(false),
+    isUpdatePickingPending_(false),
     currentAction_(0),
-    vac_(0)
+    vac_(0),
+    isDrawingToImage_(false),
+    isDrawingOffscreen_(false)
 {
     // Make renderers
     Background * bg = scene_->background();
-    backgroundRenderers_[bg] = new BackgroundRenderer(bg, context(), this);
+    backgroundRenderers_[bg] = BackgroundRenderer::shared(bg, sharedContext());
 
     // View settings widget
     viewSettingsWidget_ = new ViewSettingsWidget(viewSettings_, this);
+    connect(viewSettingsWidget_, SIGNAL(changed()), this, SLOT(clearPlaybackCache()));
     connect(viewSettingsWidget_, SIGNAL(changed()), this, SLOT(update()));
     connect(viewSettingsWidget_, SIGNAL(changed()), this, SIGNAL(settingsChanged()));
+
+    // Playback frames include the background
+    connect(bg, SIGNAL(changed()), this, SLOT(clearPlaybackCache()));
+
+    // Tile cache
+    cameraStopTimer_->setSingleShot(true);
+    cameraStopTimer_->setInterval(CAMERA_STOP_DELAY);
+    connect(cameraStopTimer_, SIGNAL(timeout()), this, SLOT(stopCameraMotion_()));
+    tileTimer_->setSingleShot(true);
+    tileTimer_->setInterval(0);
+    connect(tileTimer_, SIGNAL(timeout()), this, SLOT(renderTilesWhenIdle_()));
+
+    // Deferred picking
+    pickingIdleTimer_->setSingleShot(true);
+    connect(pickingIdleTimer_, SIGNAL(timeout()), this, SLOT(updatePickingWhenIdle_()));
+
+    // Motion compression
+    refreshTimer_->setSingleShot(true);
+    connect(refreshTimer_, SIGNAL(timeout()), this, SLOT(refresh_()));
     cameraTravellingIsEnabled_ = true;
 
+    connect(this, SIGNAL(viewIsGoingToChange(int, int)), this, SLOT(cameraChanged_()));
+    connect(this, SIGNAL(viewIsBeingChanged(int, int)), this, SLOT(cameraChanged_()));
+    connect(this, SIGNAL(viewChanged(int, int)), this, SLOT(cameraChanged_()));
+
     connect(this, SIGNAL(viewIsGoingToChange(int, int)), this, SLOT(updatePicking()));
     //connect(this, SIGNAL(viewIsGoingToChange(int, int)), this, SLOT(updateHighlightedObject(int, int)));
     connect(this, SIGNAL(viewIsGoingToChange(int, int)), this, SLOT(update()));
@@ -85,6 +235,11 @@ View::View(Scene * scene, QWidget * parent) :
 View::~View()
 {
     deletePicking();
+    deleteOffscreenTargets_();
+    deleteFrameCache_();
+    deleteRenderThread_();
+    clearTileCache_();
+    clearPlaybackCache();
 }
 
 void View::initCamera()
@@ -102,6 +257,29 @@ Scene * View::scene()
     return scene_;
 }
 
+void View::reportMemory(MemoryStats::Report & report) const
+{
+    // Render caches: color textures, and offscreen targets which also have
+    // a depth buffer, and multisample color and depth buffers if any
+    std::size_t numBytes = 0;
+    numBytes += std::size_t(4) * playbackKey_.width * playbackKey_.height * playbackFrames_.size();
+    numBytes += std::size_t(4) * onionSkinKey_.width * onionSkinKey_.height * onionSkins_.size();
+    numBytes += std::size_t(4) * frameWidth_ * frameHeight_;
+    if(renderThread_)
+        numBytes += renderThread_->numBytes();
+    numBytes += std::size_t(4) * TILE_SIZE * TILE_SIZE * tiles_.size();
+    foreach(const OffscreenTarget & target, offscreenTargets_)
+    {
+        std::size_t numSamples = target.samples > 1 ? 2 + 2 * target.samples : 2;
+        numBytes += std::size_t(4) * target.width * target.height * numSamples;
+    }
+    report.add(MemoryStats::ViewCaches, numBytes);
+
+    // Picking: render target, then either pixel buffers or a CPU copy
+    if(pickingBuffer_.isAllocated())
+        report.add(MemoryStats::PickingBuffers, pickingBuffer_.numBytes());
+}
+
 void View::resizeEvent(QResizeEvent * event)
 {
     if(autoCenterScene_)
@@ -157,6 +335,27 @@ MouseEvent View::mouseEvent() const
 
 void View::update()
 {
+    // Anything may have changed, not only the hovered cell
+    isFrameCacheDirty_ = true;
+    updateHighlight();
+}
+
+void View::updateHighlight()
+{
+    if(isCompressingMotion_())
+    {
+        isUpdatePending_ = true;
+        scheduleRefresh_();
+    }
+    else
+    {
+        update_();
+    }
+}
+
+void View::update_()
+{
+    isUpdatePending_ = false;
     GLWidget_Camera2D c = camera2D();
     c.setZoom(viewSettings_.zoom());
     setCamera2D(c);
@@ -395,6 +594,10 @@ void View::ClicEvent(int action, double x, double y)
 {
     // It is View's responsibility to call update() or updatePicking()
 
+    // Finish inserting the last sketched edge first, if deferred
+    if(vac_)
+        vac_->finishSketchEdge();
+
     if(action==SPLIT_ACTION)
     {
         if(!hoveredObject_.isNull() || global()->toolMode() == Global::SKETCH)
@@ -402,6 +605,7 @@ void View::ClicEvent(int action, double x, double y)
             vac_ = scene_->vectorAnimationComplex();
             if(vac_)
             {
+                recordEvent_(SessionRecorder::Split, x, y);
                 vac_->split(x, y, interactiveTime(), true);
 
                 emit allViewsNeedToUpdatePicking();
@@ -415,9 +619,11 @@ void View::ClicEvent(int action, double x, double y)
         vac_ = scene_->vectorAnimationComplex();
         if(vac_)
         {
+            recordEvent_(SessionRecorder::Paint, x, y);
             VectorAnimationComplex::Cell * paintedCell = vac_->paint(x, y, interactiveTime());
             if (!paintedCell)
             {
+                Scene::Transaction transaction(scene_);
                 scene_->background()->setColor(global()->faceColor());
                 scene_->emitChanged();
                 scene_->emitCheckpoint();
@@ -433,6 +639,8 @@ void View::ClicEvent(int action, double x, double y)
     {
         if(!hoveredObject_.isNull())
         {
+            recordEvent_(SessionRecorder::DeselectAll, x, y);
+            recordEvent_(SessionRecorder::Select, x, y);
             scene_->deselectAll();
             scene_->select(activeTime(),
                            hoveredObject_.index(),
@@ -444,6 +652,7 @@ void View::ClicEvent(int action, double x, double y)
     }
     else if(action==DESELECTALL_ACTION)
     {
+        recordEvent_(SessionRecorder::DeselectAll, x, y);
         scene_->deselectAll();
         emit allViewsNeedToUpdatePicking();
         updateHoveredObject(mouse_Event_X_, mouse_Event_Y_);
@@ -453,6 +662,7 @@ void View::ClicEvent(int action, double x, double y)
     {
         if(!hoveredObject_.isNull())
         {
+            recordEvent_(SessionRecorder::Select, x, y);
             scene_->select(activeTime(),
                            hoveredObject_.index(),
                            hoveredObject_.id());
@@ -465,6 +675,7 @@ void View::ClicEvent(int action, double x, double y)
     {
         if(!hoveredObject_.isNull())
         {
+            recordEvent_(SessionRecorder::Deselect, x, y);
             scene_->deselect(activeTime(),
                              hoveredObject_.index(),
                              hoveredObject_.id());
@@ -477,6 +688,7 @@ void View::ClicEvent(int action, double x, double y)
     {
         if(!hoveredObject_.isNull())
         {
+            recordEvent_(SessionRecorder::Toggle, x, y);
             scene_->toggle(activeTime(),
                            hoveredObject_.index(),
                            hoveredObject_.id());
@@ -499,12 +711,18 @@ void View::MoveEvent(double x, double y)
     // feedback to user on what is action would be must be given to user before
     // the action is undertaken
     bool mustRedraw = false;
+
+    // Whether only the highlighted object must be redrawn, see updateHighlight()
+    bool mustRedrawHighlight = false;
     global()->setSceneCursorPos(Eigen::Vector2d(x,y));
 
+    // The hover query below redraws the picking image if needed
+    pickingIdleTimer_->stop();
+
     // Update highlighted object
     bool hoveredObjectChanged = updateHoveredObject(mouse_Event_X_, mouse_Event_Y_);
     if(hoveredObjectChanged)
-        mustRedraw = true;
+        mustRedrawHighlight = true;
 
     // Update to-be-drawn straight line
     Qt::KeyboardModifiers keys = global()->keyboardModifiers();
@@ -527,6 +745,7 @@ void View::MoveEvent(double x, double y)
     if(global()->toolMode() == Global::SCULPT)
     {
         Time time = interactiveTime();
+        recordEvent_(SessionRecorder::UpdateSculpt, x, y, global()->sculptRadius());
         scene_->vectorAnimationComplex()->updateSculpt(x, y, time);
         mustRedraw = true;
     }
@@ -548,6 +767,10 @@ void View::MoveEvent(double x, double y)
         // I could add it as a user preference
         emit allViewsNeedToUpdate();
     }
+    else if(mustRedrawHighlight)
+    {
+        emit allViewsNeedToUpdateHighlight();
+    }
 }
 
 Time View::interactiveTime() const
@@ -555,11 +778,51 @@ Time View::interactiveTime() const
     return viewSettings_.time();
 }
 
+void View::recordEvent_(SessionRecorder::EventType type, double x, double y, double width)
+{
+    if(!SessionRecorder::isRecording())
+        return;
+
+    SessionRecorder::record(type, x, y, interactiveTime(), width,
+                            mouse_isTablet_ ? mouse_tabletPressure_ : 1,
+                            hoveredObject_.isNull() ? -1 : hoveredObject_.id());
+}
+
+
+// Continues the sketched edge through all tablet samples received since the
+// last call, in order, each with its own pressure, however long the frames
+// drawn meanwhile took
+void View::continueSketchWithTabletSamples_()
+{
+    TabletSampleQueue::Sample sample;
+    while(tabletSamples_.pop(sample))
+    {
+        if(sample.x == lastTabletSampleX_ && sample.y == lastTabletSampleY_)
+            continue;
+        lastTabletSampleX_ = sample.x;
+        lastTabletSampleY_ = sample.y;
+
+        Eigen::Vector3d p = camera2D_.viewMatrixInverse() * Eigen::Vector3d(sample.x, sample.y, 0);
+        double w = global()->settings().edgeWidth();
+        if(global()->useTabletPressure())
+            w *= 2 * sample.pressure; // 2 so that a half-pressure would get the default width
+        recordEvent_(SessionRecorder::ContinueSketch, p[0], p[1], w);
+        vac_->continueSketchEdge(p[0], p[1], w);
+
+        // Latency from the oldest sample not yet drawn, see drawScene()
+        if(tabletSampleTime_ < 0)
+            tabletSampleTime_ = sample.timestamp;
+    }
+}
 
 void View::PMRPressEvent(int action, double x, double y)
 {
     currentAction_ = action;
 
+    // Finish inserting the last sketched edge first, if deferred
+    if(vac_)
+        vac_->finishSketchEdge();
+
     // It is View's responsibility to call update() or updatePicking
     // for mouse PMR actions
     global()->setSceneCursorPos(Eigen::Vector2d(x,y));
@@ -590,6 +853,7 @@ void View::PMRPressEvent(int action, double x, double y)
 
 
         lastMousePos_ = QPoint(mouse_Event_X_,mouse_Event_Y_);
+        lastTabletSampleX_ = lastTabletSampleY_ = std::numeric_limits<double>::quiet_NaN();
 
         // pos = viewToScene(x,y); <- by now: the identity
         QPointF pos = QPointF(x,y);
@@ -603,6 +867,7 @@ void View::PMRPressEvent(int action, double x, double y)
             if(mouse_isTablet_ &&  global()->useTabletPressure())
                 w *= 2 * mouse_tabletPressure_; // 2 so that a half-pressure would get the default width
         }
+        recordEvent_(SessionRecorder::BeginSketch, xScene, yScene, w);
         vac_->beginSketchEdge(xScene,yScene, w, interactiveTime());
 
         //emit allViewsNeedToUpdatePicking();
@@ -611,14 +876,17 @@ void View::PMRPressEvent(int action, double x, double y)
     }
     else if(action==DRAG_AND_DROP_ACTION)
     {
+        recordEvent_(SessionRecorder::BeginDragAndDrop, mouse_PressEvent_XScene_, mouse_PressEvent_YScene_);
         vac_->prepareDragAndDrop(mouse_PressEvent_XScene_, mouse_PressEvent_YScene_, interactiveTime());
     }
     else if(action==TRANSFORM_SELECTION_ACTION)
     {
+        recordEvent_(SessionRecorder::BeginTransform, mouse_PressEvent_XScene_, mouse_PressEvent_YScene_);
         vac_->beginTransformSelection(mouse_PressEvent_XScene_, mouse_PressEvent_YScene_, interactiveTime());
     }
     else if(action==RECTANGLE_OF_SELECTION_ACTION)
     {
+        recordEvent_(SessionRecorder::BeginRectangleOfSelection, x, y);
         vac_->beginRectangleOfSelection(x,y,interactiveTime());
     }
     else if(action==SCULPT_CHANGE_RADIUS_ACTION)
@@ -675,6 +943,7 @@ void View::PMRPressEvent(int action, double x, double y)
         sculptStartRadius_ = global()->sculptRadius();
         sculptStartX_ = x;
         sculptStartY_ = y;
+        recordEvent_(SessionRecorder::BeginSculptDeform, x, y, global()->sculptRadius());
         vac_->beginSculptDeform(x,y);
 
         //emit allViewsNeedToUpdatePicking();
@@ -686,6 +955,7 @@ void View::PMRPressEvent(int action, double x, double y)
         sculptStartRadius_ = global()->sculptRadius();
         sculptStartX_ = x;
         sculptStartY_ = y;
+        recordEvent_(SessionRecorder::BeginSculptWidth, x, y, global()->sculptRadius());
         vac_->beginSculptEdgeWidth(x,y);
 
         //emit allViewsNeedToUpdatePicking();
@@ -697,6 +967,7 @@ void View::PMRPressEvent(int action, double x, double y)
         sculptStartRadius_ = global()->sculptRadius();
         sculptStartX_ = x;
         sculptStartY_ = y;
+        recordEvent_(SessionRecorder::BeginSculptSmooth, x, y, global()->sculptRadius());
         vac_->beginSculptSmooth(x,y);
 
         //emit allViewsNeedToUpdatePicking();
@@ -715,7 +986,12 @@ void View::PMRMoveEvent(int action, double x, double y)
     {
         QPoint mousePos = QPoint(mouse_Event_X_,mouse_Event_Y_);
 
-        if(lastMousePos_ != mousePos && vac_)
+        if(vac_ && !tabletSamples_.isEmpty())
+        {
+            lastMousePos_ = mousePos;
+            continueSketchWithTabletSamples_();
+        }
+        else if(lastMousePos_ != mousePos && vac_)
         {
             lastMousePos_ = mousePos;
 
@@ -726,6 +1002,7 @@ void View::PMRMoveEvent(int action, double x, double y)
                 if(mouse_isTablet_ &&  global()->useTabletPressure())
                     w *= 2 * mouse_tabletPressure_; // 2 so that a half-pressure would get the default width
             }
+            recordEvent_(SessionRecorder::ContinueSketch, x, y, w);
             vac_->continueSketchEdge(x,y, w); // Note: this call "changed", hence all views are updated
         }
 
@@ -735,6 +1012,7 @@ void View::PMRMoveEvent(int action, double x, double y)
     }
     else if(action==DRAG_AND_DROP_ACTION)
     {
+        recordEvent_(SessionRecorder::ContinueDragAndDrop, x, y);
         vac_->performDragAndDrop(x, y);
 
         //emit allViewsNeedToUpdatePicking();
@@ -744,11 +1022,13 @@ void View::PMRMoveEvent(int action, double x, double y)
     }
     else if(action==TRANSFORM_SELECTION_ACTION)
     {
+        recordEvent_(SessionRecorder::ContinueTransform, x, y);
         vac_->continueTransformSelection(x, y);
         emit allViewsNeedToUpdate();
     }
     else if(action==RECTANGLE_OF_SELECTION_ACTION)
     {
+        recordEvent_(SessionRecorder::ContinueRectangleOfSelection, x, y);
         vac_->continueRectangleOfSelection(x,y);
 
         emit allViewsNeedToUpdate();
@@ -849,6 +1129,7 @@ void View::PMRMoveEvent(int action, double x, double y)
     }
     else if(action==SCULPT_DEFORM_ACTION)
     {
+        recordEvent_(SessionRecorder::ContinueSculptDeform, x, y, global()->sculptRadius());
         vac_->continueSculptDeform(x,y);
 
         //emit allViewsNeedToUpdatePicking();
@@ -857,6 +1138,7 @@ void View::PMRMoveEvent(int action, double x, double y)
     }
     else if(action==SCULPT_CHANGE_WIDTH_ACTION)
     {
+        recordEvent_(SessionRecorder::ContinueSculptWidth, x, y, global()->sculptRadius());
         vac_->continueSculptEdgeWidth(x,y);
 
         //emit allViewsNeedToUpdatePicking();
@@ -865,6 +1147,7 @@ void View::PMRMoveEvent(int action, double x, double y)
     }
     else if(action==SCULPT_SMOOTH_ACTION)
     {
+        recordEvent_(SessionRecorder::ContinueSculptSmooth, x, y, global()->sculptRadius());
         vac_->continueSculptSmooth(x,y);
 
         //emit allViewsNeedToUpdatePicking();
@@ -882,6 +1165,8 @@ void View::PMRReleaseEvent(int action, double x, double y)
 
     if(action==SKETCH_ACTION)
     {
+        continueSketchWithTabletSamples_();
+        recordEvent_(SessionRecorder::EndSketch, x, y);
         vac_->endSketchEdge();
 
         emit allViewsNeedToUpdatePicking();
@@ -890,6 +1175,7 @@ void View::PMRReleaseEvent(int action, double x, double y)
     }
     else if(action==DRAG_AND_DROP_ACTION)
     {
+        recordEvent_(SessionRecorder::EndDragAndDrop, x, y);
         vac_->completeDragAndDrop();
 
         emit allViewsNeedToUpdatePicking();
@@ -898,6 +1184,7 @@ void View::PMRReleaseEvent(int action, double x, double y)
     }
     else if(action==TRANSFORM_SELECTION_ACTION)
     {
+        recordEvent_(SessionRecorder::EndTransform, x, y);
         vac_->endTransformSelection();
         emit allViewsNeedToUpdatePicking();
         updateHoveredObject(mouse_Event_X_, mouse_Event_Y_);
@@ -905,6 +1192,7 @@ void View::PMRReleaseEvent(int action, double x, double y)
     }
     else if(action==RECTANGLE_OF_SELECTION_ACTION)
     {
+        recordEvent_(SessionRecorder::EndRectangleOfSelection, x, y);
         vac_->endRectangleOfSelection();
 
         emit allViewsNeedToUpdatePicking();
@@ -913,6 +1201,7 @@ void View::PMRReleaseEvent(int action, double x, double y)
     }
     else if(action==SCULPT_CHANGE_RADIUS_ACTION)
     {
+        recordEvent_(SessionRecorder::UpdateSculpt, x, y, global()->sculptRadius());
         vac_->updateSculpt(x, y, interactiveTime());
 
         emit allViewsNeedToUpdatePicking();
@@ -927,6 +1216,7 @@ void View::PMRReleaseEvent(int action, double x, double y)
     }
     else if(action==SCULPT_DEFORM_ACTION)
     {
+        recordEvent_(SessionRecorder::EndSculptDeform, x, y, global()->sculptRadius());
         vac_->endSculptDeform();
         vac_->updateSculpt(x, y, interactiveTime());
 
@@ -936,6 +1226,7 @@ void View::PMRReleaseEvent(int action, double x, double y)
     }
     else if(action==SCULPT_CHANGE_WIDTH_ACTION)
     {
+        recordEvent_(SessionRecorder::EndSculptWidth, x, y, global()->sculptRadius());
         vac_->endSculptEdgeWidth();
         vac_->updateSculpt(x, y, interactiveTime());
 
@@ -945,6 +1236,7 @@ void View::PMRReleaseEvent(int action, double x, double y)
     }
     else if(action==SCULPT_SMOOTH_ACTION)
     {
+        recordEvent_(SessionRecorder::EndSculptSmooth, x, y, global()->sculptRadius());
         vac_->endSculptSmooth();
         vac_->updateSculpt(x, y, interactiveTime());
 
@@ -967,10 +1259,70 @@ void View::drawBackground_(Background * background, int frame)
                 frame,
                 global()->showCanvas(),
                 scene_->left(), scene_->top(), scene_->width(), scene_->height(),
-                xSceneMin(), xSceneMax(), ySceneMin(), ySceneMax());
+                xSceneMin(), xSceneMax(), ySceneMin(), ySceneMax(),
+                isDrawingToImage_ ? 0.0 : zoom());
 }
 
 void View::drawScene()
+{
+    RenderStats::beginFrame();
+    drawFrame_();
+    RenderStats::endFrame();
+
+    // End-to-end latency of sketching with a tablet, from receiving a sample
+    // to drawing it
+    if(tabletSampleTime_ >= 0)
+    {
+        OperatorStats::addTime(OperatorStats::SketchInput, TabletSampleQueue::now() - tabletSampleTime_);
+        tabletSampleTime_ = -1;
+    }
+
+    // Drawn last, so that it is never part of cached frames
+    if(RenderStats::isEnabled())
+        drawRenderStats_();
+}
+
+// Statistics of the last frame, over the top-left corner of the view
+void View::drawRenderStats_()
+{
+    QStringList lines = RenderStats::lastFrameText().split('\n');
+    const int lineHeight = 14;
+    const int w = 220;
+    const int h = lineHeight * lines.size() + 8;
+
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    glOrtho(0, viewportWidth_, viewportHeight_, 0, -1, 1);
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+
+    glPushAttrib(GL_ENABLE_BIT);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glColor4d(1.0, 1.0, 1.0, 0.8);
+    glBegin(GL_QUADS);
+    {
+        glVertex2d(0, 0);
+        glVertex2d(w, 0);
+        glVertex2d(w, h);
+        glVertex2d(0, h);
+    }
+    glEnd();
+    glPopAttrib();
+
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+
+    glColor4d(0.0, 0.0, 0.0, 1.0);
+    for(int i=0; i<lines.size(); ++i)
+        renderText(4, lineHeight * (i+1), lines[i]);
+}
+
+void View::drawFrame_()
 {
     if(!mouse_HideCursor_)
     {
@@ -994,6 +1346,18 @@ void View::drawScene()
         }
     }
 
+    // Draw pre-rendered frame during playback, if up to date
+    if(drawPlaybackFrame_())
+        return;
+
+    // Draw cached frame, only redrawing where the hovered cell changed
+    if(drawFrameFromCache_())
+        return;
+
+    // Draw cells from the frozen layer, and only overlays live
+    if(drawFrozenLayer_())
+        return;
+
     // Clear to white
     glClearColor(1.0,1.0,1.0,1.0);
     glClear(GL_COLOR_BUFFER_BIT);
@@ -1008,14 +1372,32 @@ void View::drawScene()
     // XXX Should be replaced by drawCanvas_(scene_->canvas());
     scene_->drawCanvas(viewSettings_);
 
+    // Cull cells outside of the viewport
+    viewSettings_.setVisibleRect(xSceneMin(), xSceneMax(), ySceneMin(), ySceneMax());
+
     // Draw scene
-    drawSceneDelegate_(activeTime());
+    drawSceneDelegate_(activeTime(), true);
+
+    // Keep frame for partial redraws
+    isFrameCacheValid_ = false;
+    isLayerCacheValid_ = false;
+    if(isFrameCacheable_() && cacheFrame_(0, 0, viewportWidth_, viewportHeight_))
+    {
+        VectorAnimationComplex::Cell * hoveredCell = scene_->vectorAnimationComplex()->hoveredCell();
+        frameKey_ = frameCacheKey_();
+        frameHoveredCellId_ = hoveredCell ? hoveredCell->id() : -1;
+        isFrameCacheValid_ = true;
+        isFrameCacheDirty_ = false;
+    }
 }
 
-void View::drawSceneDelegate_(Time t)
+void View::drawSceneDelegate_(Time t, bool isOnScreen)
 {
     // Draw background
-    drawBackground_(scene_->background(), t.frame()); // later: drawBackground_(layer_->background())
+    {
+        RenderStats::ScopedTimer timer(RenderStats::Background);
+        drawBackground_(scene_->background(), t.frame()); // later: drawBackground_(layer_->background())
+    }
 
     // Loop over all onion skins. Draw in this order:
     //   1. onion skins before
@@ -1027,138 +1409,631 @@ void View::drawSceneDelegate_(Time t)
 
     // Draw onion skins
     viewSettings_.setMainDrawing(false);
-    if(viewSettings_.onionSkinningIsEnabled())
     {
-        // Draw onion skins before
-        Time tOnion = t;
-        for(int i=0; i<viewSettings_.numOnionSkinsBefore(); ++i)
-        {
-            tOnion = tOnion - viewSettings_.onionSkinsTimeOffset();
-            glTranslated(-viewSettings_.onionSkinsXOffset(),-viewSettings_.onionSkinsYOffset(),0);
-        }
-        for(int i=0; i<viewSettings_.numOnionSkinsBefore(); ++i)
+        RenderStats::ScopedTimer timer(RenderStats::OnionSkins);
+        if(viewSettings_.onionSkinningIsEnabled() && !drawOnionSkinsFromCache_(t))
         {
-            scene_->draw(tOnion, viewSettings_); // XXX should be replaced by scene_->vectorAnimationComplex()->draw()
-            tOnion = tOnion + viewSettings_.onionSkinsTimeOffset();
-            glTranslated(viewSettings_.onionSkinsXOffset(),viewSettings_.onionSkinsYOffset(),0);
-        }
+            // Draw onion skins before
+            Time tOnion = t;
+            for(int i=0; i<viewSettings_.numOnionSkinsBefore(); ++i)
+            {
+                tOnion = tOnion - viewSettings_.onionSkinsTimeOffset();
+                translateOnionSkin_(-viewSettings_.onionSkinsXOffset(), -viewSettings_.onionSkinsYOffset());
+            }
+            for(int i=0; i<viewSettings_.numOnionSkinsBefore(); ++i)
+            {
+                scene_->draw(tOnion, viewSettings_); // XXX should be replaced by scene_->vectorAnimationComplex()->draw()
+                tOnion = tOnion + viewSettings_.onionSkinsTimeOffset();
+                translateOnionSkin_(viewSettings_.onionSkinsXOffset(), viewSettings_.onionSkinsYOffset());
+            }
 
-        // Draw onion skins after
-        tOnion = t;
-        for(int i=0; i<viewSettings_.numOnionSkinsAfter(); ++i)
-        {
-            glTranslated(viewSettings_.onionSkinsXOffset(),viewSettings_.onionSkinsYOffset(),0);
-            tOnion = tOnion + viewSettings_.onionSkinsTimeOffset();
-            scene_->draw(tOnion, viewSettings_);
-        }
-        for(int i=0; i<viewSettings_.numOnionSkinsAfter(); ++i)
-        {
-            glTranslated(-viewSettings_.onionSkinsXOffset(),-viewSettings_.onionSkinsYOffset(),0);
+            // Draw onion skins after
+            tOnion = t;
+            for(int i=0; i<viewSettings_.numOnionSkinsAfter(); ++i)
+            {
+                translateOnionSkin_(viewSettings_.onionSkinsXOffset(), viewSettings_.onionSkinsYOffset());
+                tOnion = tOnion + viewSettings_.onionSkinsTimeOffset();
+                scene_->draw(tOnion, viewSettings_);
+            }
+            for(int i=0; i<viewSettings_.numOnionSkinsAfter(); ++i)
+            {
+                translateOnionSkin_(-viewSettings_.onionSkinsXOffset(), -viewSettings_.onionSkinsYOffset());
+            }
         }
     }
 
-    // Draw current frame
+    // Draw current frame, without overlays if drawing the frozen layer
     viewSettings_.setMainDrawing(true);
-    scene_->draw(t, viewSettings_);
+    if(isDrawingFrozenLayer_)
+        scene_->vectorAnimationComplex()->drawCells(t, viewSettings_);
+    else if(!isOnScreen || (!drawCellsFromTiles_(t) && !drawCellsInRenderThread_(t)))
+        scene_->draw(t, viewSettings_);
 }
 
-void View::toggleOutline()
+// Draws the current frame using the render thread, which is created on first
+// use. Returns false if the render thread is disabled, or if the scene can't
+// be drawn by it, in which case nothing is drawn.
+bool View::drawCellsInRenderThread_(Time t)
 {
-    viewSettings_.toggleOutline();
-    viewSettingsWidget_->updateWidgetFromSettings();
-    update();
-}
+    static const DevSettings::Bool useRenderThread("render thread");
+    VectorAnimationComplex::VAC * vac = scene_->vectorAnimationComplex();
+    if(!useRenderThread || !vac || !GLEW_VERSION_3_2)
+    {
+        deleteRenderThread_();
+        return false;
+    }
 
-void View::toggleOutlineOnly()
-{
-    viewSettings_.toggleOutlineOnly();
-    viewSettingsWidget_->updateWidgetFromSettings();
-    update();
+    // Build packet, with the current matrices
+    std::shared_ptr<RenderPacket> packet = std::allocate_shared<RenderPacket>(Eigen::aligned_allocator<RenderPacket>());
+    packet->width = viewportWidth_;
+    packet->height = viewportHeight_;
+    Eigen::Matrix4f modelview, projection;
+    glGetFloatv(GL_MODELVIEW_MATRIX, modelview.data());
+    glGetFloatv(GL_PROJECTION_MATRIX, projection.data());
+    packet->matrix = projection * modelview;
+    if(!vac->buildRenderPacket(t, viewSettings_, *packet))
+    {
+        submittedPacket_.reset();
+        return false;
+    }
+
+    // Submit it if anything changed
+    if(!renderThread_)
+    {
+        renderThread_ = new RenderThread(sharedContext()->contextHandle(), this);
+        connect(renderThread_, SIGNAL(frameReady()), this, SLOT(updateHighlight()), Qt::QueuedConnection);
+    }
+    if(!submittedPacket_ || !submittedPacket_->isSameAs(*packet))
+    {
+        renderThread_->submit(packet);
+        submittedPacket_ = packet;
+    }
+
+    // Composite latest frame, if any yet, and draw tools over it
+    RenderThread::Frame frame;
+    if(renderThread_->acquireFrame(frame))
+    {
+        drawRenderFrame_(frame);
+        renderThread_->releaseFrame();
+    }
+    vac->drawOverlays(t, viewSettings_);
+    return true;
 }
 
-void View::setDisplayMode(ViewSettings::DisplayMode displayMode)
+// Draws the frame where the scene was when its packet was built, so that it
+// stays in place while the camera moves, until a frame with the new camera
+// is ready. Textures have premultiplied alpha, see RenderThread.
+void View::drawRenderFrame_(const RenderThread::Frame & frame)
 {
-    viewSettings_.setDisplayMode(displayMode);
-    viewSettingsWidget_->updateWidgetFromSettings();
-    update();
+    const Eigen::Matrix4f inverse = frame.packet->matrix.inverse();
+    const float corners[4][2] = {{-1, -1}, {1, -1}, {1, 1}, {-1, 1}};
+
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, frame.textureId);
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    glColor4d(1.0, 1.0, 1.0, 1.0);
+    glBegin(GL_QUADS);
+    {
+        for(int i=0; i<4; ++i)
+        {
+            Eigen::Vector4f p = inverse * Eigen::Vector4f(corners[i][0], corners[i][1], 0, 1);
+            glTexCoord2d(0.5 * (corners[i][0] + 1), 0.5 * (corners[i][1] + 1));
+            glVertex2d(p[0] / p[3], p[1] / p[3]);
+        }
+    }
+    glEnd();
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA,
+                        GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    glDisable(GL_TEXTURE_2D);
 }
 
-void View::setOnionSkinningEnabled(bool enabled)
+void View::deleteRenderThread_()
 {
-    viewSettings_.setOnionSkinningIsEnabled(enabled);
-    viewSettingsWidget_->updateWidgetFromSettings();
-    update();
+    delete renderThread_;
+    renderThread_ = 0;
+    submittedPacket_.reset();
 }
 
-void View::fitAllInWindow()
+bool View::TileId::operator<(const TileId & other) const
 {
-    // TODO
+    if(level != other.level)
+        return level < other.level;
+    if(i != other.i)
+        return i < other.i;
+    return j < other.j;
 }
 
-void View::fitSelectionInWindow()
+bool View::TileCacheKey::operator==(const TileCacheKey & other) const
 {
-    // TODO
+    return time == other.time && timeType == other.timeType &&
+           displayMode == other.displayMode;
 }
 
-double View::zoom() const
+void View::cameraChanged_()
 {
-    return camera2D().zoom();
+    isCameraMoving_ = true;
+    cameraStopTimer_->start();
 }
 
-// Note: In the future, when rotation of the viewport is allowed,
-//       then it should be replaced by:
-//           xSceneMin = min(x1, x2, x3, x4);
-//           xSceneMax = max(x1, x2, x3, x4);
-//           ySceneMin = min(y1, y2, y3, y4);
-//           ySceneMax = max(y1, y2, y3, y4);
-//       where the (xi,yi)'s are the four corners of the viewport in
-//       scene coordinate, which in general will not be axis-aligned
-
-double  View::xSceneMin() const
+void View::stopCameraMotion_()
 {
-    return - camera2D().x() / zoom();
+    isCameraMoving_ = false;
+    update(); // exactly
+    tileTimer_->start(); // around the viewport, for the next motion
 }
 
-double  View::ySceneMin() const
+// Draws the cells of the current frame from tiles while the camera moves.
+// Returns false, drawing nothing, otherwise.
+bool View::drawCellsFromTiles_(Time t)
 {
-    return - camera2D().y() / zoom();
+    static const DevSettings::Bool tileCache("tile cache");
+    VectorAnimationComplex::VAC * vac = scene_->vectorAnimationComplex();
+    if(!tileCache || !vac || !(GLEW_VERSION_3_0 || GLEW_ARB_framebuffer_object))
+    {
+        clearTileCache_();
+        return false;
+    }
+    if(!isCameraMoving_)
+        return false;
+
+    // Render a few missing tiles
+    updateTileCache_(t);
+    QList<TileId> ids;
+    visibleTiles_(tileLevel(viewSettings_.zoom()), 0, ids);
+    int numRendered = 0;
+    bool isComplete = true;
+    foreach(const TileId & id, ids)
+    {
+        if(tiles_.contains(id))
+            continue;
+        Tile tile = {0, 0};
+        if(numRendered < MAX_TILES_PER_FRAME && renderTile_(t, id, tile))
+            tiles_.insert(id, tile);
+        else
+            isComplete = false;
+        ++numRendered;
+    }
+
+    // Composite tiles, replacing missing ones by the closest coarser tile
+    // available, if any. Textures have premultiplied alpha.
+    ++tileCounter_;
+    glEnable(GL_TEXTURE_2D);
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    glColor4d(1.0, 1.0, 1.0, 1.0);
+    foreach(const TileId & id, ids)
+    {
+        for(int k=0; k<=MAX_COARSER_TILE_LEVELS; ++k)
+        {
+            TileId coarser = {id.level - k, floorDivPow2(id.i, k), floorDivPow2(id.j, k)};
+            QMap<TileId, Tile>::iterator it = tiles_.find(coarser);
+            if(it != tiles_.end())
+            {
+                it->lastUsed = tileCounter_;
+                drawTile_(coarser, *it, id);
+                break;
+            }
+        }
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA,
+                        GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    glDisable(GL_TEXTURE_2D);
+
+    // Render the others between frames
+    if(!isComplete)
+        tileTimer_->start();
+    trimTileCache_();
+
+    vac->drawOverlays(t, viewSettings_);
+    return true;
 }
 
-double  View::xSceneMax() const
+// Renders missing tiles of the viewport, and once the camera stops, around
+// it, a few at a time so that events keep being processed
+void View::renderTilesWhenIdle_()
 {
-    double x = xSceneMin();
-    double w = width();
-    double z = zoom();
+    static const DevSettings::Bool tileCache("tile cache");
+    if(!tileCache || !scene_->vectorAnimationComplex() || !isVisible() ||
+       !(GLEW_VERSION_3_0 || GLEW_ARB_framebuffer_object))
+    {
+        return;
+    }
 
-    return x+w/z;
+    makeCurrent();
+    Time t = activeTime();
+    updateTileCache_(t);
+    QList<TileId> ids;
+    visibleTiles_(tileLevel(viewSettings_.zoom()), isCameraMoving_ ? 0 : TILE_MARGIN, ids);
+    int numRendered = 0;
+    foreach(const TileId & id, ids)
+    {
+        if(tiles_.contains(id))
+            continue;
+        if(numRendered == MAX_TILES_PER_FRAME)
+        {
+            tileTimer_->start();
+            break;
+        }
+        Tile tile = {0, tileCounter_};
+        if(renderTile_(t, id, tile))
+            tiles_.insert(id, tile);
+        ++numRendered;
+    }
+    trimTileCache_();
+
+    if(isCameraMoving_ && numRendered > 0)
+        update();
 }
 
-double  View::ySceneMax() const
+// Invalidates tiles where cells changed since the last call, or all of them
+// if the time or the display mode changed, or if cells were reordered
+void View::updateTileCache_(Time t)
 {
-    double x = ySceneMin();
-    double w = height();
-    double z = zoom();
+    using VectorAnimationComplex::Cell;
+    TileCacheKey key;
+    key.time = t.floatTime();
+    key.timeType = t.type();
+    key.displayMode = viewSettings_.displayMode();
+    if(!(key == tileKey_))
+    {
+        clearTileCache_();
+        tileKey_ = key;
+    }
+
+    // Created and modified cells
+    QHash<int, TileCellStamp> stamps;
+    std::vector<int> order;
+    stamps.reserve(tileCellStamps_.size());
+    order.reserve(tileCellOrder_.size());
+    for(Cell * c: scene_->vectorAnimationComplex()->zOrdering())
+    {
+        if(!c->exists(t))
+            continue;
+
+        unsigned int flags = (c->isSelected() ? 1 : 0) | (c->isHovered() ? 2 : 0);
+        unsigned int stamp = 2166136261u;
+        stamp = (stamp ^ c->stateVersion()) * 16777619u;
+        stamp = (stamp ^ c->geometryVersion()) * 16777619u;
+        stamp = (stamp ^ flags) * 16777619u;
+
+        TileCellStamp & s = stamps[c->id()];
+        s.stamp = stamp;
+        QHash<int, TileCellStamp>::const_iterator old = tileCellStamps_.constFind(c->id());
+        if(old != tileCellStamps_.constEnd() && old->stamp == stamp)
+        {
+            s.boundingBox = old->boundingBox;
+        }
+        else
+        {
+            s.boundingBox = drawnBoundingBox(c, t, viewSettings_);
+            invalidateTiles_(s.boundingBox);
+            if(old != tileCellStamps_.constEnd())
+                invalidateTiles_(old->boundingBox);
+        }
+        order.push_back(c->id());
+    }
 
-    return x+w/z;
+    // Deleted cells
+    for(int id: tileCellOrder_)
+        if(!stamps.contains(id))
+            invalidateTiles_(tileCellStamps_.value(id).boundingBox);
+
+    // Cells existing before and after must be in the same order
+    std::size_t k = 0;
+    for(int id: tileCellOrder_)
+    {
+        if(!stamps.contains(id))
+            continue;
+        while(!tileCellStamps_.contains(order[k]))
+            ++k;
+        if(order[k] != id)
+        {
+            clearTileCache_();
+            break;
+        }
+        ++k;
+    }
+
+    tileCellStamps_.swap(stamps);
+    tileCellOrder_.swap(order);
 }
 
-ViewSettings View::viewSettings() const
+// Tiles of the given level covering the viewport, enlarged by margin tiles
+void View::visibleTiles_(int level, int margin, QList<TileId> & res) const
 {
-    return viewSettings_;
+    const double size = tileSceneSize(level);
+    const int iMin = static_cast<int>(std::floor(xSceneMin() / size)) - margin;
+    const int iMax = static_cast<int>(std::floor(xSceneMax() / size)) + margin;
+    const int jMin = static_cast<int>(std::floor(ySceneMin() / size)) - margin;
+    const int jMax = static_cast<int>(std::floor(ySceneMax() / size)) + margin;
+    for(int j=jMin; j<=jMax; ++j)
+    {
+        for(int i=iMin; i<=iMax; ++i)
+        {
+            TileId id = {level, i, j};
+            res << id;
+        }
+    }
 }
 
-ViewSettingsWidget * View::viewSettingsWidget() const
+// Renders the cells within the tile to its texture, creating it if null
+bool View::renderTile_(Time t, const TileId & id, Tile & tile)
 {
-    return viewSettingsWidget_;
-}
+    GLint samples;
+    glGetIntegerv(GL_MAX_SAMPLES, &samples);
+    OffscreenTarget target;
+    if(!getOffscreenTarget_(TILE_SIZE, TILE_SIZE, samples, target))
+        return false;
 
+    // Render cells to multisample FBO, over transparent
+    const double size = tileSceneSize(id.level);
+    const double x0 = id.i * size;
+    const double y0 = id.j * size;
+    glBindFramebuffer(GL_FRAMEBUFFER, target.msFboId);
+    glViewport(0, 0, TILE_SIZE, TILE_SIZE);
+    glClearColor(0.0, 0.0, 0.0, 0.0);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    glOrtho(x0, x0 + size, y0, y0 + size, -1, 1);
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+    viewSettings_.setVisibleRect(x0, x0 + size, y0, y0 + size);
+    scene_->vectorAnimationComplex()->drawCells(t, viewSettings_);
+    viewSettings_.setVisibleRect(xSceneMin(), xSceneMax(), ySceneMin(), ySceneMax());
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
 
-/***********************************************************
- *              PICKING
+    // Blit multisample FBO to standard FBO
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, target.msFboId);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target.fboId);
+    glBlitFramebuffer(0, 0, TILE_SIZE, TILE_SIZE, 0, 0, TILE_SIZE, TILE_SIZE, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+    // Copy it to the texture of the tile
+    if(tile.textureId)
+    {
+        glBindTexture(GL_TEXTURE_2D, tile.textureId);
+    }
+    else
+    {
+        glGenTextures(1, &tile.textureId);
+        glBindTexture(GL_TEXTURE_2D, tile.textureId);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, TILE_SIZE, TILE_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    }
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, target.fboId);
+    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, TILE_SIZE, TILE_SIZE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // Back to screen
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, viewportWidth_, viewportHeight_);
+    return true;
+}
+
+// Draws the part of the given tile covering the area of drawnId, which is
+// either the same tile or a tile of a finer level within it
+void View::drawTile_(const TileId & id, const Tile & tile, const TileId & drawnId)
+{
+    const double size = tileSceneSize(id.level);
+    const double tx = id.i * size;
+    const double ty = id.j * size;
+    const double drawnSize = tileSceneSize(drawnId.level);
+    const double x0 = drawnId.i * drawnSize;
+    const double y0 = drawnId.j * drawnSize;
+    const double x1 = x0 + drawnSize;
+    const double y1 = y0 + drawnSize;
+    const double u0 = (x0 - tx) / size;
+    const double v0 = (y0 - ty) / size;
+    const double u1 = (x1 - tx) / size;
+    const double v1 = (y1 - ty) / size;
+
+    glBindTexture(GL_TEXTURE_2D, tile.textureId);
+    glBegin(GL_QUADS);
+    {
+        glTexCoord2d(u0, v0); glVertex2d(x0, y0);
+        glTexCoord2d(u1, v0); glVertex2d(x1, y0);
+        glTexCoord2d(u1, v1); glVertex2d(x1, y1);
+        glTexCoord2d(u0, v1); glVertex2d(x0, y1);
+    }
+    glEnd();
+}
+
+void View::invalidateTiles_(const VectorAnimationComplex::BoundingBox & bb)
+{
+    using VectorAnimationComplex::BoundingBox;
+    if(bb.isEmpty() || tiles_.isEmpty())
+        return;
+
+    for(QMap<TileId, Tile>::iterator it = tiles_.begin(); it != tiles_.end(); )
+    {
+        const TileId & id = it.key();
+        const double size = tileSceneSize(id.level);
+        BoundingBox tileBB(id.i * size, (id.i + 1) * size, id.j * size, (id.j + 1) * size);
+        if(tileBB.intersects(bb))
+        {
+            glDeleteTextures(1, &it->textureId);
+            it = tiles_.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+// Releases least recently used tiles above the memory budget
+void View::trimTileCache_()
+{
+    const std::size_t tileBytes = std::size_t(4) * TILE_SIZE * TILE_SIZE;
+    const std::size_t maxBytes = std::size_t(DevSettings::getInt("tile cache (MB)")) * 1024 * 1024;
+    while(tiles_.size() * tileBytes > maxBytes)
+    {
+        QMap<TileId, Tile>::iterator lru = tiles_.begin();
+        for(QMap<TileId, Tile>::iterator it = tiles_.begin(); it != tiles_.end(); ++it)
+            if(it->lastUsed < lru->lastUsed)
+                lru = it;
+        glDeleteTextures(1, &lru->textureId);
+        tiles_.erase(lru);
+    }
+}
+
+void View::clearTileCache_()
+{
+    if(tiles_.isEmpty())
+        return;
+
+    makeCurrent();
+    foreach(const Tile & tile, tiles_)
+        glDeleteTextures(1, &tile.textureId);
+    tiles_.clear();
+}
+
+// Translates the scene by (dx, dy) when drawing onion skins. The visible rect
+// is translated accordingly, so that culling remains correct.
+void View::translateOnionSkin_(double dx, double dy)
+{
+    glTranslated(dx, dy, 0);
+    viewSettings_.translateVisibleRect(-dx, -dy);
+}
+
+void View::toggleOutline()
+{
+    clearPlaybackCache();
+    viewSettings_.toggleOutline();
+    viewSettingsWidget_->updateWidgetFromSettings();
+    update();
+}
+
+void View::toggleOutlineOnly()
+{
+    clearPlaybackCache();
+    viewSettings_.toggleOutlineOnly();
+    viewSettingsWidget_->updateWidgetFromSettings();
+    update();
+}
+
+void View::setDisplayMode(ViewSettings::DisplayMode displayMode)
+{
+    clearPlaybackCache();
+    viewSettings_.setDisplayMode(displayMode);
+    viewSettingsWidget_->updateWidgetFromSettings();
+    update();
+}
+
+void View::setOnionSkinningEnabled(bool enabled)
+{
+    clearPlaybackCache();
+    viewSettings_.setOnionSkinningIsEnabled(enabled);
+    viewSettingsWidget_->updateWidgetFromSettings();
+    update();
+}
+
+void View::fitAllInWindow()
+{
+    vac_ = scene_->vectorAnimationComplex();
+    if(vac_)
+        fitInWindow_(vac_->boundingBox(activeTime()));
+}
+
+void View::fitSelectionInWindow()
+{
+    vac_ = scene_->vectorAnimationComplex();
+    if(vac_)
+        fitInWindow_(vac_->selectionBoundingBox(activeTime()));
+}
+
+void View::fitInWindow_(const VectorAnimationComplex::BoundingBox & bb)
+{
+    if(bb.isEmpty() || bb.isInfinite())
+        return;
+
+    // Zoom so that the box fills 90% of the view, but at most 3200% for
+    // tiny or degenerate boxes
+    const double margin = 0.9;
+    double zoom = 32.0;
+    if(bb.width() > 0)
+        zoom = std::min(zoom, margin * width() / bb.width());
+    if(bb.height() > 0)
+        zoom = std::min(zoom, margin * height() / bb.height());
+
+    // Center the box
+    GLWidget_Camera2D camera = camera2D();
+    camera.setZoom(zoom);
+    camera.setX(0.5 * width() - zoom * bb.xMid());
+    camera.setY(0.5 * height() - zoom * bb.yMid());
+    setCamera2D(camera);
+    emit viewChanged(mouse_Event_X_, mouse_Event_Y_);
+}
+
+double View::zoom() const
+{
+    return camera2D().zoom();
+}
+
+// Note: In the future, when rotation of the viewport is allowed,
+//       then it should be replaced by:
+//           xSceneMin = min(x1, x2, x3, x4);
+//           xSceneMax = max(x1, x2, x3, x4);
+//           ySceneMin = min(y1, y2, y3, y4);
+//           ySceneMax = max(y1, y2, y3, y4);
+//       where the (xi,yi)'s are the four corners of the viewport in
+//       scene coordinate, which in general will not be axis-aligned
+
+double  View::xSceneMin() const
+{
+    return - camera2D().x() / zoom();
+}
+
+double  View::ySceneMin() const
+{
+    return - camera2D().y() / zoom();
+}
+
+double  View::xSceneMax() const
+{
+    double x = xSceneMin();
+    double w = width();
+    double z = zoom();
+
+    return x+w/z;
+}
+
+double  View::ySceneMax() const
+{
+    double x = ySceneMin();
+    double w = height();
+    double z = zoom();
+
+    return x+w/z;
+}
+
+ViewSettings View::viewSettings() const
+{
+    return viewSettings_;
+}
+
+ViewSettingsWidget * View::viewSettingsWidget() const
+{
+    return viewSettingsWidget_;
+}
+
+
+/***********************************************************
+ *              PICKING
  */
 
 void View::drawPick()
 {
+    RenderStats::ScopedTimer timer(RenderStats::DrawPick);
     Time t = activeTime();
     {
         if(viewSettings_.onionSkinningIsEnabled() && viewSettings_.areOnionSkinsPickable())
@@ -1167,25 +2042,25 @@ void View::drawPick()
             for(int i=0; i<viewSettings_.numOnionSkinsBefore(); ++i)
             {
                 tOnion = tOnion - viewSettings_.onionSkinsTimeOffset();
-                glTranslated(-viewSettings_.onionSkinsXOffset(),-viewSettings_.onionSkinsYOffset(),0);
+                translateOnionSkin_(-viewSettings_.onionSkinsXOffset(), -viewSettings_.onionSkinsYOffset());
             }
             for(int i=0; i<viewSettings_.numOnionSkinsBefore(); ++i)
             {
                 scene_->drawPick(tOnion, viewSettings_);
                 tOnion = tOnion + viewSettings_.onionSkinsTimeOffset();
-                glTranslated(viewSettings_.onionSkinsXOffset(),viewSettings_.onionSkinsYOffset(),0);
+                translateOnionSkin_(viewSettings_.onionSkinsXOffset(), viewSettings_.onionSkinsYOffset());
             }
 
             tOnion = t;
             for(int i=0; i<viewSettings_.numOnionSkinsAfter(); ++i)
             {
-                glTranslated(viewSettings_.onionSkinsXOffset(),viewSettings_.onionSkinsYOffset(),0);
+                translateOnionSkin_(viewSettings_.onionSkinsXOffset(), viewSettings_.onionSkinsYOffset());
                 tOnion = tOnion + viewSettings_.onionSkinsTimeOffset();
                 scene_->drawPick(tOnion, viewSettings_);
             }
             for(int i=0; i<viewSettings_.numOnionSkinsAfter(); ++i)
             {
-                glTranslated(-viewSettings_.onionSkinsXOffset(),-viewSettings_.onionSkinsYOffset(),0);
+                translateOnionSkin_(-viewSettings_.onionSkinsXOffset(), -viewSettings_.onionSkinsYOffset());
             }
         }
 
@@ -1201,19 +2076,38 @@ bool View::updateHoveredObject(int x, int y)
     if(!pickingIsEnabled_)
         return false;
 
-    // Don't do anything if no picking image
-    if(!pickingImg_)
-        return false;
-
     // Find object under the mouse
     Picking::Object old = hoveredObject_;
-    if(x<0 || (uint)x>=WINDOW_SIZE_X_ || y<0 || (uint)y>=WINDOW_SIZE_Y_)
+    if(isPickingOnCpu_())
     {
-        hoveredObject_ = Picking::Object();
+        if(x<0 || x>=width() || y<0 || y>=height())
+            hoveredObject_ = Picking::Object();
+        else
+            hoveredObject_ = pickOnCpu_(x, y);
     }
     else
     {
-        hoveredObject_ = getCloserObject(x, y);
+        // Redraw picking if it has been postponed
+        if(isPickingDirty_)
+            renderPicking_();
+
+        // Get latest available picking image
+        resolvePicking_();
+
+        // Don't do anything if no picking image
+        if(!pickingBuffer_.hasImage())
+            return false;
+
+        if(x<0 || x>=pickingBuffer_.width() || y<0 || y>=pickingBuffer_.height())
+        {
+            hoveredObject_ = Picking::Object();
+        }
+        else
+        {
+            if(isPickingRegion_)
+                renderPickingRegion_(x, y);
+            hoveredObject_ = getCloserObject(x, y);
+        }
     }
 
     // Check if it has changed
@@ -1240,164 +2134,155 @@ bool View::updateHoveredObject(int x, int y)
     return hasChanged;
 }
 
-uchar * View::pickingImg(int x, int y)
+bool View::isPickingOnCpu_() const
 {
-    int k = 4*( (WINDOW_SIZE_Y_ - y - 1)*WINDOW_SIZE_X_ + x);
-    return &pickingImg_[k];
+    return DevSettings::getBool("cpu picking");
 }
 
-// This method must be very fast. Assumes x and y in range
-Picking::Object View::getCloserObject(int x, int y)
+// Same as drawPick() followed by getCloserObject(), but on CPU
+Picking::Object View::pickOnCpu_(int x, int y)
 {
-    // First look directly whether there's an object right at mouse position
-    uchar * p = pickingImg(x,y);
-    uchar r=p[0], g=p[1], b=p[2];
-    if(r!=255 || g!=255 || b!=255)
-    {
-        return Picking::objectFromRGB(r,g,b);
-    }
-    else
-    {
-        // If not, look around in a radius of D pixels
-        int D = 3;
+    // Position under the center of the pixel, in scene coordinates
+    double z = zoom();
+    double xScene = xSceneMin() + (x + 0.5) / z;
+    double yScene = ySceneMin() + (y + 0.5) / z;
+    double tolerance = PICKING_RADIUS / z;
+
+    // Test frames in reverse drawing order, i.e., from top to bottom
+    Picking::Object res;
+    double distance = std::numeric_limits<double>::infinity();
+    auto pickFrame = [&](Time time, double dx, double dy)
+    {
+        double d;
+        Picking::Object object = scene_->pick(time, xScene - dx, yScene - dy, tolerance, viewSettings_, d);
+        if(!object.isNull() && d < distance)
+        {
+            res = object;
+            distance = d;
+        }
+        return distance == 0;
+    };
 
-        // Clipping
-        if(x<D)
-            D = x;
-        if(y<D)
-            D = y;
-        int rightBorderDist = WINDOW_SIZE_X_-1-x;
-        if(rightBorderDist<D)
-            D = rightBorderDist;
-        int bottomBorderDist = WINDOW_SIZE_Y_-1-y;
-        if(bottomBorderDist<D)
-            D = bottomBorderDist;
+    // Current frame
+    Time t = activeTime();
+    if(pickFrame(t, 0, 0))
+        return res;
 
+    // Onion skins
+    if(viewSettings_.onionSkinningIsEnabled() && viewSettings_.areOnionSkinsPickable())
+    {
+        const double xOffset = viewSettings_.onionSkinsXOffset();
+        const double yOffset = viewSettings_.onionSkinsYOffset();
+        const int numAfter = viewSettings_.numOnionSkinsAfter();
+        const int numBefore = viewSettings_.numOnionSkinsBefore();
 
-        for(int d=1; d<=D; d++)
+        for(int i=numAfter; i>=1; --i)
         {
-            // top row
-            for(int varX=x-d; varX<=x+d; varX++)
-            {
-                p = pickingImg(varX,y-d);
-                r=p[0], g=p[1], b=p[2];
-                if(r!=255 || g!=255 || b!=255)
-                    return Picking::objectFromRGB(r,g,b);
-            }
-            // bottom row
-            for(int varX=x-d; varX<=x+d; varX++)
-            {
-                p = pickingImg(varX,y+d);
-                r=p[0], g=p[1], b=p[2];
-                if(r!=255 || g!=255 || b!=255)
-                    return Picking::objectFromRGB(r,g,b);
-            }
-            // left column
-            for(int varY=y-d; varY<=y+d; varY++)
-            {
-                p = pickingImg(x-d,varY);
-                r=p[0], g=p[1], b=p[2];
-                if(r!=255 || g!=255 || b!=255)
-                    return Picking::objectFromRGB(r,g,b);
-            }
-            // right column
-            for(int varY=y-d; varY<=y+d; varY++)
-            {
-                p = pickingImg(x+d,varY);
-                r=p[0], g=p[1], b=p[2];
-                if(r!=255 || g!=255 || b!=255)
-                    return Picking::objectFromRGB(r,g,b);
-            }
+            Time tOnion = t;
+            for(int j=0; j<i; ++j)
+                tOnion = tOnion + viewSettings_.onionSkinsTimeOffset();
+            if(pickFrame(tOnion, i*xOffset, i*yOffset))
+                return res;
         }
 
-        // If still no object found, return a null object
-        return Picking::Object();
+        for(int i=1; i<=numBefore; ++i)
+        {
+            Time tOnion = t;
+            for(int j=0; j<i; ++j)
+                tOnion = tOnion - viewSettings_.onionSkinsTimeOffset();
+            if(pickFrame(tOnion, -i*xOffset, -i*yOffset))
+                return res;
+        }
     }
+
+    return res;
+}
+
+// This method must be very fast
+Picking::Object View::getCloserObject(int x, int y)
+{
+    return pickingBuffer_.closestObject(x, y, PICKING_RADIUS);
 }
 
 void View::deletePicking()
 {
-    if(pickingImg_)
+    if(pickingBuffer_.isAllocated())
     {
-        glDeleteFramebuffers(1, &fboId_);
-        glDeleteRenderbuffers(1, &rboId_);
-        glDeleteTextures(1, &textureId_);
+        makeCurrent();
+        pickingBuffer_.release();
         hoveredObject_ = Picking::Object();
-        delete[] pickingImg_;
-        pickingImg_ = 0;
-        WINDOW_SIZE_X_ = 0;
-        WINDOW_SIZE_Y_ = 0;
+        isPickingKeyValid_ = false;
     }
 }
 
-void View::newPicking()
+void View::newPicking(int width, int height)
 {
-    //  code adapted from http://www.songho.ca/opengl/gl_fbo.html
-
-    // create a texture object
-    glGenTextures(1, &textureId_);
-    glBindTexture(GL_TEXTURE_2D, textureId_);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_GENERATE_MIPMAP, GL_TRUE); // automatic mipmap
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, WINDOW_SIZE_X_, WINDOW_SIZE_Y_, 0,
-             GL_RGBA, GL_UNSIGNED_BYTE, 0);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    isPickingRegion_ = DevSettings::getBool("region picking");
+    isPickingRegionValid_ = false;
+    pickingBuffer_.allocate(width, height,
+                            !isPickingRegion_ && DevSettings::getBool("async picking"),
+                            DevSettings::getBool("integer picking"));
+}
 
-    // test availability of OpenGL version
-    if(GLEW_VERSION_2_0)
-    {
-        //qDebug("supported");
-    }
-    else
+void View::renderPickingRegion_(int x, int y)
+{
+    // Nothing to do if the neighbourhood searched by getCloserObject() is
+    // already in the region
+    if(isPickingRegionValid_ &&
+       x-PICKING_RADIUS >= pickingRegionXMin_ && x+PICKING_RADIUS <= pickingRegionXMax_ &&
+       y-PICKING_RADIUS >= pickingRegionYMin_ && y+PICKING_RADIUS <= pickingRegionYMax_)
     {
-        qDebug("not supported");
+        return;
     }
 
-    if(glewIsSupported("GL_ARB_framebuffer_object"))
-    {
-        //qDebug("fbo supported");
-    }
-    else
-    {
-        qDebug("fbo not supported");
-    }
+    // Compute new region, centered at mouse cursor
+    int w = pickingBuffer_.width();
+    int h = pickingBuffer_.height();
+    pickingRegionXMin_ = std::max(0, x - PICKING_REGION_RADIUS);
+    pickingRegionXMax_ = std::min(w-1, x + PICKING_REGION_RADIUS);
+    pickingRegionYMin_ = std::max(0, y - PICKING_REGION_RADIUS);
+    pickingRegionYMax_ = std::min(h-1, y + PICKING_REGION_RADIUS);
 
-    // create a renderbuffer object to store depth info
-    glGenRenderbuffers(1, &rboId_);
-    glBindRenderbuffer(GL_RENDERBUFFER, rboId_);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT,
-                    WINDOW_SIZE_X_, WINDOW_SIZE_Y_);
-    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    // Make this widget's rendering context the current OpenGL context
+    makeCurrent();
 
-    // create a framebuffer object
-    glGenFramebuffers(1, &fboId_);
-    glBindFramebuffer(GL_FRAMEBUFFER, fboId_);
+    renderPickingRect_(pickingRegionXMin_, pickingRegionYMin_,
+                       pickingRegionXMax_, pickingRegionYMax_);
+    isPickingRegionValid_ = true;
+}
 
-    // attach the texture to FBO color attachment point
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
-                     GL_TEXTURE_2D, textureId_, 0);
+// Draws the given rectangle of the picking image, in window coordinates
+// (inclusive), and reads it back directly at its place in the CPU copy
+void View::renderPickingRect_(int xMin, int yMin, int xMax, int yMax)
+{
+    // set rendering destination to FBO, restricted to the rectangle
+    pickingBuffer_.beginDraw(xMin, yMin, xMax, yMax);
 
-    // attach the renderbuffer to depth attachment point
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
-                      GL_RENDERBUFFER, rboId_);
+    // draw the picking, culling cells outside of the rectangle
+    setCameraPositionAndOrientation();
+    double z = zoom();
+    double x0 = xSceneMin();
+    double y0 = ySceneMin();
+    viewSettings_.setVisibleRect(x0 + xMin / z,
+                                 x0 + (xMax + 1) / z,
+                                 y0 + yMin / z,
+                                 y0 + (yMax + 1) / z);
+    drawPick();
+    pickingBuffer_.endDraw();
 
-    // check FBO status
-    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
-    if(status != GL_FRAMEBUFFER_COMPLETE)
-    {
-        qDebug() << "ERROR void View::newPicking()"
-               << "FBO status != GL_FRAMEBUFFER_COMPLETE";
-        return;
-    }
+    // read back the rectangle directly at its place in the picking image
+    pickingBuffer_.read(xMin, yMin, xMax, yMax);
+}
 
-    // switch back to window-system-provided framebuffer
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+// Makes the latest completed picking image available to hover queries. Only
+// blocks if there is no picking image at all yet.
+void View::resolvePicking_()
+{
+    if(!pickingBuffer_.hasPendingRead())
+        return;
 
-    // allocate memory for picking
-    pickingImg_ = new uchar[4 * WINDOW_SIZE_X_ * WINDOW_SIZE_Y_];
+    makeCurrent();
+    pickingBuffer_.resolve();
 }
 
 #include <QElapsedTimer>
@@ -1430,15 +2315,94 @@ QImage View::drawToImage(double x, double y, double w, double h, int imgW, int i
 }
 
 QImage View::drawToImage(Time t, double x, double y, double w, double h, int imgW, int imgH, bool useViewSettings)
+{
+    // Draw to RAM data
+    uchar * img = new uchar[4 * imgW * imgH];
+    if(!drawToBuffer_(t, x, y, w, h, imgW, imgH, useViewSettings, img))
+    {
+        delete[] img;
+        return QImage();
+    }
+
+    // Create cleanup info to delete[] img when appropriate
+    QImageCleanupFunction cleanupFunction = &imageCleanupHandler;
+    void * cleanupInfo = reinterpret_cast<void*>(img);
+
+    // Create QImage
+    QImage res(img, imgW, imgH, QImage::Format_RGBA8888, cleanupFunction, cleanupInfo);
+
+    // Return QImage
+    return res;
+}
+
+bool View::drawToPng(Time t, double x, double y, double w, double h, int imgW, int imgH, bool useViewSettings, const QString & filePath)
+{
+    // Open file
+    QFile file(filePath);
+    if(!file.open(QFile::WriteOnly)) {
+        qDebug() << "Error: cannot open file" << filePath;
+        return false;
+    }
+    PngStreamWriter png(&file);
+    if(!png.begin(imgW, imgH)) {
+        qDebug() << "Error: cannot write file" << filePath;
+        return false;
+    }
+
+    // Size of the tiles, in pixels. All tiles are drawn with this size, even
+    // at the right and bottom borders, so that the same offscreen target is
+    // reused for all of them.
+    makeCurrent();
+    GLint maxRenderbufferSize;
+    glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &maxRenderbufferSize);
+    const int tileSize = std::min((int) maxRenderbufferSize, EXPORT_TILE_SIZE);
+
+    // Size of a tile in scene coordinates
+    const double tileW = w * tileSize / imgW;
+    const double tileH = h * tileSize / imgH;
+
+    // Draw one row of tiles at a time, then write it to the PNG stream
+    uchar * tile = new uchar[4 * tileSize * tileSize];
+    uchar * tileRow = new uchar[4 * imgW * tileSize];
+    bool ok = true;
+    for(int tileY=0; ok && tileY<imgH; tileY+=tileSize)
+    {
+        const int numRows = std::min(tileSize, imgH - tileY);
+        for(int tileX=0; ok && tileX<imgW; tileX+=tileSize)
+        {
+            // Shift the scene rect drawn, which shifts the projection
+            ok = drawToBuffer_(t, x + w * tileX / imgW, y + h * tileY / imgH, tileW, tileH,
+                               tileSize, tileSize, useViewSettings, tile);
+
+            // Copy the part of the tile within the image
+            const int numCols = std::min(tileSize, imgW - tileX);
+            for(int i=0; ok && i<numRows; ++i)
+                std::memcpy(tileRow + 4 * (i * imgW + tileX), tile + 4 * i * tileSize, 4 * numCols);
+        }
+        for(int i=0; ok && i<numRows; ++i)
+            ok = png.writeRow(tileRow + 4 * i * imgW);
+    }
+    delete[] tile;
+    delete[] tileRow;
+
+    if(!ok || !png.end()) {
+        qDebug() << "Error: cannot write file" << filePath;
+        return false;
+    }
+    return true;
+}
+
+bool View::drawToOffscreenTarget_(Time t, double x, double y, double w, double h, int imgW, int imgH,
+                                  bool useViewSettings, bool drawCanvas, OffscreenTarget & target)
 {
     // Test availability of OpenGL functionality
     if(!GLEW_VERSION_2_0) {
         qDebug("Error: OpenGL 2.0 not supported");
-        return QImage();
+        return false;
     }
     if(!glewIsSupported("GL_ARB_framebuffer_object")) {
         qDebug("Error: GL_ARB_framebuffer_object not supported");
-        return QImage();
+        return false;
     }
 
     // Convenient alias
@@ -1449,71 +2413,17 @@ QImage View::drawToImage(Time t, double x, double y, double w, double h, int img
     makeCurrent();
 
 
-    // ------------ Create multisample FBO --------------------
-
-    GLuint ms_fboId;
-    GLuint ms_ColorBufferId;
-    GLuint ms_DepthBufferId;
-    GLint  ms_samples;
+    // ------------ Get multisample FBO and standard FBO --------------------
 
     // Maximum supported samples
+    GLint ms_samples;
     glGetIntegerv(GL_MAX_SAMPLES, &ms_samples);
-    // Create FBO
-    glGenFramebuffers(1, &ms_fboId);
-    glBindFramebuffer(GL_FRAMEBUFFER, ms_fboId);
-    // Create multisample color buffer
-    glGenRenderbuffers(1, &ms_ColorBufferId);
-    glBindRenderbuffer(GL_RENDERBUFFER, ms_ColorBufferId);
-    glRenderbufferStorageMultisample(GL_RENDERBUFFER, ms_samples, GL_RGBA8, IMG_SIZE_X, IMG_SIZE_Y);
-    // Create multisample depth buffer
-    glGenRenderbuffers(1, &ms_DepthBufferId);
-    glBindRenderbuffer(GL_RENDERBUFFER, ms_DepthBufferId);
-    glRenderbufferStorageMultisample(GL_RENDERBUFFER, ms_samples, GL_DEPTH_COMPONENT24, IMG_SIZE_X, IMG_SIZE_Y);
-    // Attach render buffers to FBO
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, ms_ColorBufferId);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, ms_DepthBufferId);
-    // Check FBO status
-    GLenum ms_status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
-    if(ms_status != GL_FRAMEBUFFER_COMPLETE) {
-        qDebug() << "Error: FBO ms_status != GL_FRAMEBUFFER_COMPLETE";
-        return QImage();
-    }
-
-
-    // ------------ Create standard FBO --------------------
 
-    GLuint fboId;
-    GLuint textureId;
-    GLuint rboId;
-
-    // Create FBO
-    glGenFramebuffers(1, &fboId);
-    glBindFramebuffer(GL_FRAMEBUFFER, fboId);
-    // Create color texture
-    glGenTextures(1, &textureId);
-    glBindTexture(GL_TEXTURE_2D, textureId);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_GENERATE_MIPMAP, GL_TRUE);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, IMG_SIZE_X, IMG_SIZE_Y, 0,
-                 GL_RGBA, GL_UNSIGNED_BYTE, 0);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    // Create depth buffer
-    glGenRenderbuffers(1, &rboId);
-    glBindRenderbuffer(GL_RENDERBUFFER, rboId);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, IMG_SIZE_X, IMG_SIZE_Y);
-    glBindRenderbuffer(GL_RENDERBUFFER, 0);
-    // Attach render buffers / textures to FBO
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textureId, 0);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rboId);
-    // Check FBO status
-    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
-    if(status != GL_FRAMEBUFFER_COMPLETE) {
-        qDebug() << "Error: FBO status != GL_FRAMEBUFFER_COMPLETE";
-        return QImage();
-    }
+    // Reused across calls, e.g. for all frames of a sequence
+    if(!getOffscreenTarget_(IMG_SIZE_X, IMG_SIZE_Y, ms_samples, target))
+        return false;
+    GLuint ms_fboId = target.msFboId;
+    GLuint fboId = target.fboId;
 
 
     // ------------ Render scene to multisample FBO --------------------
@@ -1528,9 +2438,12 @@ QImage View::drawToImage(Time t, double x, double y, double w, double h, int img
     viewportHeight_ = IMG_SIZE_Y;
     glViewport(0, 0, viewportWidth_, viewportHeight_);
 
-    // Clear FBO to fully transparent
-    glClearColor(0.0, 0.0, 0.0, 0.0);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    // Clear FBO to fully transparent, or to white as on screen
+    if (drawCanvas)
+        glClearColor(1.0, 1.0, 1.0, 1.0);
+    else
+        glClearColor(0.0, 0.0, 0.0, 0.0);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 
     // Set projection matrix
     // Note: (0,h) and not (h,0) since y-axis is down in VPaint, up in QImage
@@ -1546,7 +2459,15 @@ QImage View::drawToImage(Time t, double x, double y, double w, double h, int img
     camera2d.setZoom(1);
     glLoadMatrixd(camera2d.viewMatrixData());
 
+    // Cull cells outside of the image
+    viewSettings_.setVisibleRect(x, x+w, y, y+h);
+
+    // Draw canvas
+    if (drawCanvas)
+        scene_->drawCanvas(viewSettings_);
+
     // Draw scene
+    isDrawingOffscreen_ = true;
     if (useViewSettings)
     {
         drawSceneDelegate_(t);
@@ -1562,6 +2483,7 @@ QImage View::drawToImage(Time t, double x, double y, double w, double h, int img
         viewSettings_.setDrawCursor(true);
         viewSettings_.setDisplayMode(oldDM);
     }
+    isDrawingOffscreen_ = false;
 
     // Restore viewport size
     viewportWidth_ = oldViewportWidth;
@@ -1583,28 +2505,35 @@ QImage View::drawToImage(Time t, double x, double y, double w, double h, int img
     // Unbind FBO
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
+    return true;
+}
+
+bool View::drawToBuffer_(Time t, double x, double y, double w, double h, int imgW, int imgH, bool useViewSettings, uchar * img)
+{
+    // Draw scene, with full-resolution backgrounds
+    OffscreenTarget target;
+    isDrawingToImage_ = true;
+    bool ok = drawToOffscreenTarget_(t, x, y, w, h, imgW, imgH, useViewSettings, false, target);
+    isDrawingToImage_ = false;
+    if(!ok)
+        return false;
+
+    // Convenient alias
+    GLuint IMG_SIZE_X = imgW;
+    GLuint IMG_SIZE_Y = imgH;
+    GLuint textureId = target.textureId;
+
 
     // ------ Read standard FBO to RAM data ---------
 
     // Bind standard FBO for reading
     glBindTexture(GL_TEXTURE_2D, textureId);
     // Read
-    uchar * img = new uchar[4 * IMG_SIZE_X * IMG_SIZE_Y];
     glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE,  img);
     // Unbind FBO
     glBindTexture(GL_TEXTURE_2D, 0);
 
 
-    // ------ Release allocated GPU memory  ---------
-
-    glDeleteFramebuffers(1, &ms_fboId);
-    glDeleteRenderbuffers(1, &ms_ColorBufferId);
-    glDeleteRenderbuffers(1, &ms_DepthBufferId);
-    glDeleteFramebuffers(1, &fboId);
-    glDeleteRenderbuffers(1, &rboId);
-    glDeleteTextures(1, &textureId);
-
-
     // ------ un-premultiply alpha ---------
 
     // Once can notice that glBlendFuncSeparate(alpha, 1-alpha, 1, 1-alpha)
@@ -1633,28 +2562,894 @@ QImage View::drawToImage(Time t, double x, double y, double w, double h, int img
         }
     }
 
+    return true;
+}
 
-    // ------ Convert to Qimage ---------
+bool View::getOffscreenTarget_(int width, int height, int samples, OffscreenTarget & target)
+{
+    // Reuse existing target, if any
+    for(int i=0; i<offscreenTargets_.size(); ++i)
+    {
+        const OffscreenTarget & t = offscreenTargets_[i];
+        if(t.width == width && t.height == height && t.samples == samples)
+        {
+            target = t;
+            offscreenTargets_.move(i, 0); // most recently used first
+            return true;
+        }
+    }
 
-    // Create cleanup info to delete[] img when appropriate
-    QImageCleanupFunction cleanupFunction = &imageCleanupHandler;
-    void * cleanupInfo = reinterpret_cast<void*>(img);
+    // Create multisample FBO
+    target.width = width;
+    target.height = height;
+    target.samples = samples;
+    glGenFramebuffers(1, &target.msFboId);
+    glBindFramebuffer(GL_FRAMEBUFFER, target.msFboId);
+    // Create multisample color buffer
+    glGenRenderbuffers(1, &target.msColorBufferId);
+    glBindRenderbuffer(GL_RENDERBUFFER, target.msColorBufferId);
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_RGBA8, width, height);
+    // Create multisample depth and stencil buffer
+    glGenRenderbuffers(1, &target.msDepthBufferId);
+    glBindRenderbuffer(GL_RENDERBUFFER, target.msDepthBufferId);
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH24_STENCIL8, width, height);
+    // Attach render buffers to FBO
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, target.msColorBufferId);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, target.msDepthBufferId);
+    // Check FBO status
+    GLenum ms_status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
 
-    // Create QImage
-    QImage res(img, IMG_SIZE_X, IMG_SIZE_Y, QImage::Format_RGBA8888, cleanupFunction, cleanupInfo);
+    // Create standard FBO
+    glGenFramebuffers(1, &target.fboId);
+    glBindFramebuffer(GL_FRAMEBUFFER, target.fboId);
+    // Create color texture
+    glGenTextures(1, &target.textureId);
+    glBindTexture(GL_TEXTURE_2D, target.textureId);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_GENERATE_MIPMAP, GL_TRUE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0,
+                 GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    // Create depth buffer
+    glGenRenderbuffers(1, &target.rboId);
+    glBindRenderbuffer(GL_RENDERBUFFER, target.rboId);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    // Attach render buffers / textures to FBO
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target.textureId, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, target.rboId);
+    // Check FBO status
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-    // Return QImage
+    if(ms_status != GL_FRAMEBUFFER_COMPLETE) {
+        qDebug() << "Error: FBO ms_status != GL_FRAMEBUFFER_COMPLETE";
+        deleteOffscreenTarget_(target);
+        return false;
+    }
+    if(status != GL_FRAMEBUFFER_COMPLETE) {
+        qDebug() << "Error: FBO status != GL_FRAMEBUFFER_COMPLETE";
+        deleteOffscreenTarget_(target);
+        return false;
+    }
+
+    // Keep it, releasing the least recently used ones beyond the limit
+    offscreenTargets_.prepend(target);
+    while(offscreenTargets_.size() > MAX_OFFSCREEN_TARGETS)
+        deleteOffscreenTarget_(offscreenTargets_.takeLast());
+
+    return true;
+}
+
+void View::deleteOffscreenTarget_(const OffscreenTarget & target)
+{
+    glDeleteFramebuffers(1, &target.msFboId);
+    glDeleteRenderbuffers(1, &target.msColorBufferId);
+    glDeleteRenderbuffers(1, &target.msDepthBufferId);
+    glDeleteFramebuffers(1, &target.fboId);
+    glDeleteRenderbuffers(1, &target.rboId);
+    glDeleteTextures(1, &target.textureId);
+}
+
+void View::deleteOffscreenTargets_()
+{
+    if(offscreenTargets_.isEmpty())
+        return;
+
+    makeCurrent();
+    foreach(const OffscreenTarget & target, offscreenTargets_)
+        deleteOffscreenTarget_(target);
+    offscreenTargets_.clear();
+}
+
+bool View::PlaybackCacheKey::operator==(const PlaybackCacheKey & other) const
+{
+    return cameraX == other.cameraX && cameraY == other.cameraY && zoom == other.zoom &&
+           canvasLeft == other.canvasLeft && canvasTop == other.canvasTop &&
+           canvasWidth == other.canvasWidth && canvasHeight == other.canvasHeight &&
+           width == other.width && height == other.height &&
+           showCanvas == other.showCanvas;
+}
+
+View::PlaybackCacheKey View::playbackCacheKey_() const
+{
+    const double resolution = 0.01 * DevSettings::getInt("playback cache resolution (%)");
+
+    PlaybackCacheKey key;
+    key.cameraX = camera2D().x();
+    key.cameraY = camera2D().y();
+    key.zoom = camera2D().zoom();
+    key.canvasLeft = scene_->left();
+    key.canvasTop = scene_->top();
+    key.canvasWidth = scene_->width();
+    key.canvasHeight = scene_->height();
+    key.width = std::max(1, (int) std::floor(0.5 + resolution * viewportWidth_));
+    key.height = std::max(1, (int) std::floor(0.5 + resolution * viewportHeight_));
+    key.showCanvas = global()->showCanvas();
+    return key;
+}
+
+void View::updatePlaybackCacheKey_()
+{
+    PlaybackCacheKey key = playbackCacheKey_();
+    if(!(key == playbackKey_))
+    {
+        clearPlaybackCache();
+        playbackKey_ = key;
+    }
+}
+
+unsigned int View::playbackVersion_(int frame) const
+{
+    return sceneVersion_(Time(frame));
+}
+
+unsigned int View::sceneVersion_(Time t) const
+{
+    VectorAnimationComplex::VAC * vac = scene_->vectorAnimationComplex();
+    if(!vac)
+        return 0;
+
+    // Combine the versions of all drawn times, including onion skins
+    unsigned int res = vac->drawingVersion(t);
+    if(viewSettings_.onionSkinningIsEnabled())
+    {
+        Time tOnion = t;
+        for(int i=0; i<viewSettings_.numOnionSkinsBefore(); ++i)
+        {
+            tOnion = tOnion - viewSettings_.onionSkinsTimeOffset();
+            res = (res ^ vac->drawingVersion(tOnion)) * 16777619u;
+        }
+        tOnion = t;
+        for(int i=0; i<viewSettings_.numOnionSkinsAfter(); ++i)
+        {
+            tOnion = tOnion + viewSettings_.onionSkinsTimeOffset();
+            res = (res ^ vac->drawingVersion(tOnion)) * 16777619u;
+        }
+    }
     return res;
 }
 
+bool View::isPlaybackCacheFull() const
+{
+    const std::size_t maxBytes = std::size_t(DevSettings::getInt("playback cache (MB)")) * 1024 * 1024;
+    const std::size_t frameBytes = std::size_t(4) * playbackKey_.width * playbackKey_.height;
+    return frameBytes * (playbackFrames_.size() + 1) > maxBytes;
+}
+
+bool View::renderPlaybackFrame(int frame)
+{
+    if(!DevSettings::getBool("playback cache"))
+        return false;
+
+    // Skip frames which are up to date, or which don't fit
+    updatePlaybackCacheKey_();
+    unsigned int version = playbackVersion_(frame);
+    QMap<int, PlaybackFrame>::iterator it = playbackFrames_.find(frame);
+    if(it != playbackFrames_.end() && it->version == version)
+        return false;
+    if(it == playbackFrames_.end() && isPlaybackCacheFull())
+        return false;
+
+    // Draw frame as on screen
+    const int w = playbackKey_.width;
+    const int h = playbackKey_.height;
+    OffscreenTarget target;
+    if(!drawToOffscreenTarget_(Time(frame),
+                               xSceneMin(), ySceneMin(), xSceneMax() - xSceneMin(), ySceneMax() - ySceneMin(),
+                               w, h, true, true, target))
+        return false;
+
+    // Copy it to the texture of this frame
+    PlaybackFrame playbackFrame;
+    playbackFrame.version = version;
+    if(it != playbackFrames_.end())
+    {
+        playbackFrame.textureId = it->textureId;
+        glBindTexture(GL_TEXTURE_2D, playbackFrame.textureId);
+    }
+    else
+    {
+        glGenTextures(1, &playbackFrame.textureId);
+        glBindTexture(GL_TEXTURE_2D, playbackFrame.textureId);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    }
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, target.fboId);
+    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, w, h);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    playbackFrames_[frame] = playbackFrame;
+    return true;
+}
+
+bool View::drawPlaybackFrame_()
+{
+    // Only used for exact frames during playback, where the
+    // cursor, highlighting, and picking don't matter
+    Timeline * timeline = global()->timeline();
+    Time t = activeTime();
+    if(!timeline || !timeline->isPlaying() || t.type() != Time::ExactFrame ||
+       !DevSettings::getBool("playback cache"))
+    {
+        return false;
+    }
+
+    // Get up-to-date frame, if any
+    updatePlaybackCacheKey_();
+    QMap<int, PlaybackFrame>::iterator it = playbackFrames_.find(t.frame());
+    if(it == playbackFrames_.end() || it->version != playbackVersion_(t.frame()))
+        return false;
+
+    // Draw it covering the whole viewport. The texture is opaque, and
+    // its y-axis is up, see drawToOffscreenTarget_().
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, it->textureId);
+    glColor4d(1.0, 1.0, 1.0, 1.0);
+    glBegin(GL_QUADS);
+    {
+        glTexCoord2d(0.0, 1.0); glVertex2d(-1.0, -1.0);
+        glTexCoord2d(1.0, 1.0); glVertex2d(1.0, -1.0);
+        glTexCoord2d(1.0, 0.0); glVertex2d(1.0, 1.0);
+        glTexCoord2d(0.0, 0.0); glVertex2d(-1.0, 1.0);
+    }
+    glEnd();
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glDisable(GL_TEXTURE_2D);
+
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+
+    return true;
+}
+
+void View::trimPlaybackCache(int firstFrame, int lastFrame)
+{
+    makeCurrent();
+    QMap<int, PlaybackFrame>::iterator it = playbackFrames_.begin();
+    while(it != playbackFrames_.end())
+    {
+        if(it.key() < firstFrame || it.key() > lastFrame)
+        {
+            glDeleteTextures(1, &it->textureId);
+            it = playbackFrames_.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+void View::clearPlaybackCache()
+{
+    // Onion skins are drawn with the same view settings, and so are picking
+    // and the frozen layer
+    clearOnionSkinCache_();
+    isPickingKeyValid_ = false;
+    isLayerCacheValid_ = false;
+
+    if(playbackFrames_.isEmpty())
+        return;
+
+    makeCurrent();
+    foreach(const PlaybackFrame & playbackFrame, playbackFrames_)
+        glDeleteTextures(1, &playbackFrame.textureId);
+    playbackFrames_.clear();
+}
+
+bool View::OnionSkinCacheKey::operator==(const OnionSkinCacheKey & other) const
+{
+    return cameraX == other.cameraX && cameraY == other.cameraY && zoom == other.zoom &&
+           width == other.width && height == other.height;
+}
+
+View::OnionSkinCacheKey View::onionSkinCacheKey_() const
+{
+    OnionSkinCacheKey key;
+    key.cameraX = camera2D().x();
+    key.cameraY = camera2D().y();
+    key.zoom = camera2D().zoom();
+    key.width = (int) viewportWidth_;
+    key.height = (int) viewportHeight_;
+    return key;
+}
+
+bool View::drawOnionSkinsFromCache_(Time t)
+{
+    // Only used on screen, where the same onion skins are drawn again and
+    // again while the current frame is edited
+    VectorAnimationComplex::VAC * vac = scene_->vectorAnimationComplex();
+    static const DevSettings::Bool onionSkinCache("onion skin cache");
+    if(isDrawingOffscreen_ || !vac || !onionSkinCache ||
+       !GLEW_VERSION_2_0 || !glewIsSupported("GL_ARB_framebuffer_object"))
+    {
+        return false;
+    }
+
+    // Clear cache if the view changed
+    OnionSkinCacheKey key = onionSkinCacheKey_();
+    if(!(key == onionSkinKey_))
+    {
+        clearOnionSkinCache_();
+        onionSkinKey_ = key;
+    }
+    if(key.width <= 0 || key.height <= 0)
+        return false;
+
+    // Get onion skins in drawing order, rendering the ones which are missing
+    // or out of date: first the ones before, from the farthest to the
+    // nearest, then the ones after, from the nearest to the farthest.
+    QList< QPair<Time, int> > times;
+    Time tOnion = t;
+    for(int i=1; i<=viewSettings_.numOnionSkinsBefore(); ++i)
+    {
+        tOnion = tOnion - viewSettings_.onionSkinsTimeOffset();
+        times.prepend(qMakePair(tOnion, -i));
+    }
+    tOnion = t;
+    for(int i=1; i<=viewSettings_.numOnionSkinsAfter(); ++i)
+    {
+        tOnion = tOnion + viewSettings_.onionSkinsTimeOffset();
+        times.append(qMakePair(tOnion, i));
+    }
+    const bool isOffset = viewSettings_.onionSkinsXOffset() != 0 ||
+                          viewSettings_.onionSkinsYOffset() != 0;
+    ++onionSkinCounter_;
+    QList<GLuint> textureIds;
+    for(int i=0; i<times.size(); ++i)
+    {
+        const Time & time = times[i].first;
+        const int index = isOffset ? times[i].second : 0;
+        OnionSkinId id(time.floatTime(), index);
+        unsigned int version = vac->drawingVersion(time);
+        QMap<OnionSkinId, OnionSkin>::iterator it = onionSkins_.find(id);
+        if(it == onionSkins_.end() || it->version != version)
+        {
+            OnionSkin skin;
+            skin.textureId = (it != onionSkins_.end()) ? it->textureId : 0;
+            if(!renderOnionSkin_(time, index, skin))
+                return false;
+            skin.version = version;
+            it = onionSkins_.insert(id, skin);
+        }
+        it->lastUsed = onionSkinCounter_;
+        textureIds << it->textureId;
+    }
+
+    // Composite them covering the whole viewport. Textures have
+    // premultiplied alpha, see drawToBuffer_().
+    const double opacity = viewSettings_.onionSkinsTransparencyRatio();
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+
+    glEnable(GL_TEXTURE_2D);
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    glColor4d(opacity, opacity, opacity, opacity);
+    foreach(GLuint textureId, textureIds)
+    {
+        glBindTexture(GL_TEXTURE_2D, textureId);
+        glBegin(GL_QUADS);
+        {
+            glTexCoord2d(0.0, 0.0); glVertex2d(-1.0, -1.0);
+            glTexCoord2d(1.0, 0.0); glVertex2d(1.0, -1.0);
+            glTexCoord2d(1.0, 1.0); glVertex2d(1.0, 1.0);
+            glTexCoord2d(0.0, 1.0); glVertex2d(-1.0, 1.0);
+        }
+        glEnd();
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA,
+                        GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    glDisable(GL_TEXTURE_2D);
+
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+
+    // Release least recently used onion skins
+    while(onionSkins_.size() > textureIds.size() + MAX_UNUSED_ONION_SKINS)
+    {
+        QMap<OnionSkinId, OnionSkin>::iterator lru = onionSkins_.begin();
+        for(QMap<OnionSkinId, OnionSkin>::iterator it = onionSkins_.begin(); it != onionSkins_.end(); ++it)
+            if(it->lastUsed < lru->lastUsed)
+                lru = it;
+        glDeleteTextures(1, &lru->textureId);
+        onionSkins_.erase(lru);
+    }
+
+    return true;
+}
+
+// Renders the onion skin at time t and the given index relative to the
+// current frame to skin.textureId, creating the texture if it is null. This
+// is called while drawing on screen: the projection and view matrices are the
+// ones of the screen, and the viewport has the size of the texture.
+bool View::renderOnionSkin_(Time t, int index, OnionSkin & skin)
+{
+    // Get multisample FBO and standard FBO
+    const int w = onionSkinKey_.width;
+    const int h = onionSkinKey_.height;
+    GLint samples;
+    glGetIntegerv(GL_MAX_SAMPLES, &samples);
+    OffscreenTarget target;
+    if(!getOffscreenTarget_(w, h, samples, target))
+        return false;
+
+    // Render onion skin to multisample FBO, over transparent
+    glBindFramebuffer(GL_FRAMEBUFFER, target.msFboId);
+    glClearColor(0.0, 0.0, 0.0, 0.0);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    const double dx = index * viewSettings_.onionSkinsXOffset();
+    const double dy = index * viewSettings_.onionSkinsYOffset();
+    translateOnionSkin_(dx, dy);
+    scene_->draw(t, viewSettings_);
+    translateOnionSkin_(-dx, -dy);
+
+    // Blit multisample FBO to standard FBO
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, target.msFboId);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target.fboId);
+    glBlitFramebuffer(0, 0, w, h, 0, 0, w, h, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+    // Copy it to the texture of this onion skin
+    if(skin.textureId)
+    {
+        glBindTexture(GL_TEXTURE_2D, skin.textureId);
+    }
+    else
+    {
+        glGenTextures(1, &skin.textureId);
+        glBindTexture(GL_TEXTURE_2D, skin.textureId);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    }
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, target.fboId);
+    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, w, h);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // Back to screen
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    return true;
+}
+
+void View::clearOnionSkinCache_()
+{
+    if(onionSkins_.isEmpty())
+        return;
+
+    makeCurrent();
+    foreach(const OnionSkin & skin, onionSkins_)
+        glDeleteTextures(1, &skin.textureId);
+    onionSkins_.clear();
+}
+
+bool View::FrameCacheKey::operator==(const FrameCacheKey & other) const
+{
+    return cameraX == other.cameraX && cameraY == other.cameraY && zoom == other.zoom &&
+           width == other.width && height == other.height &&
+           time == other.time && timeType == other.timeType &&
+           displayMode == other.displayMode &&
+           keyboardModifiers == other.keyboardModifiers &&
+           version == other.version;
+}
+
+View::FrameCacheKey View::frameCacheKey_() const
+{
+    Time t = activeTime();
+    FrameCacheKey key;
+    key.cameraX = camera2D().x();
+    key.cameraY = camera2D().y();
+    key.zoom = camera2D().zoom();
+    key.width = viewportWidth_;
+    key.height = viewportHeight_;
+    key.time = t.floatTime();
+    key.timeType = t.type();
+    key.displayMode = viewSettings_.displayMode();
+    key.keyboardModifiers = global()->keyboardModifiers();
+    key.version = scene_->vectorAnimationComplex()->drawingVersion(t, false);
+    return key;
+}
+
+// Other tools draw cursors, and onion skins may draw the hovered cell at
+// other places
+bool View::isFrameCacheable_() const
+{
+    static const DevSettings::Bool partialRedraw("partial redraw");
+    return partialRedraw &&
+           !renderThread_ && // its frames may be behind the scene
+           !isCameraMoving_ && // cells may be drawn from tiles
+           (GLEW_VERSION_3_0 || GLEW_ARB_framebuffer_object) &&
+           scene_->vectorAnimationComplex() &&
+           global()->toolMode() == Global::SELECT &&
+           !isAnyPMRActionPerformed() &&
+           !viewSettings_.onionSkinningIsEnabled() &&
+           !isDrawingToImage_ && !isDrawingOffscreen_;
+}
+
+bool View::drawFrameFromCache_()
+{
+    if(!isFrameCacheValid_ || isFrameCacheDirty_ || !isFrameCacheable_() ||
+       !(frameCacheKey_() == frameKey_))
+    {
+        return false;
+    }
+
+    // Get damaged region, in scene coordinates
+    Time t = activeTime();
+    VectorAnimationComplex::VAC * vac = scene_->vectorAnimationComplex();
+    VectorAnimationComplex::Cell * hoveredCell = vac->hoveredCell();
+    int hoveredCellId = hoveredCell ? hoveredCell->id() : -1;
+    VectorAnimationComplex::BoundingBox damaged;
+    if(hoveredCellId != frameHoveredCellId_)
+    {
+        damaged.unite(drawnBoundingBox(vac->getCell(frameHoveredCellId_), t, viewSettings_));
+        damaged.unite(drawnBoundingBox(hoveredCell, t, viewSettings_));
+    }
+
+    // Convert to window coordinates, y-axis down
+    double sx = viewportWidth_ / (xSceneMax() - xSceneMin());
+    double sy = viewportHeight_ / (ySceneMax() - ySceneMin());
+    int x1 = 0, x2 = 0, y1 = 0, y2 = 0;
+    if(!damaged.isEmpty())
+    {
+        x1 = std::max(0, (int) std::floor((damaged.xMin() - xSceneMin()) * sx));
+        x2 = std::min(viewportWidth_, (int) std::ceil((damaged.xMax() - xSceneMin()) * sx));
+        y1 = std::max(0, (int) std::floor((damaged.yMin() - ySceneMin()) * sy));
+        y2 = std::min(viewportHeight_, (int) std::ceil((damaged.yMax() - ySceneMin()) * sy));
+    }
+    const int w = std::max(0, x2 - x1);
+    const int h = std::max(0, y2 - y1);
+    if(w * h > MAX_PARTIAL_REDRAW_AREA * viewportWidth_ * viewportHeight_)
+        return false;
+
+    // Draw cached frame covering the whole viewport, as is
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+
+    glPushAttrib(GL_ENABLE_BIT);
+    glDisable(GL_BLEND);
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, frameTextureId_);
+    glColor4d(1.0, 1.0, 1.0, 1.0);
+    glBegin(GL_QUADS);
+    {
+        glTexCoord2d(0.0, 0.0); glVertex2d(-1.0, -1.0);
+        glTexCoord2d(1.0, 0.0); glVertex2d(1.0, -1.0);
+        glTexCoord2d(1.0, 1.0); glVertex2d(1.0, 1.0);
+        glTexCoord2d(0.0, 1.0); glVertex2d(-1.0, 1.0);
+    }
+    glEnd();
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glPopAttrib();
+
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+
+    // Redraw everything in the damaged region, as drawScene() does
+    if(w > 0 && h > 0)
+    {
+        const int glY = viewportHeight_ - y2;
+        glEnable(GL_SCISSOR_TEST);
+        glScissor(x1, glY, w, h);
+        glClearColor(1.0,1.0,1.0,1.0);
+        glClear(GL_COLOR_BUFFER_BIT);
+        scene_->drawCanvas(viewSettings_);
+        viewSettings_.setVisibleRect(xSceneMin() + x1 / sx, xSceneMin() + x2 / sx,
+                                     ySceneMin() + y1 / sy, ySceneMin() + y2 / sy);
+        drawSceneDelegate_(t);
+        glDisable(GL_SCISSOR_TEST);
+
+        // Update cached frame
+        cacheFrame_(x1, glY, w, h);
+    }
+    frameHoveredCellId_ = hoveredCellId;
+
+    return true;
+}
+
+bool View::LayerCacheKey::operator==(const LayerCacheKey & other) const
+{
+    return cameraX == other.cameraX && cameraY == other.cameraY && zoom == other.zoom &&
+           width == other.width && height == other.height &&
+           time == other.time && timeType == other.timeType &&
+           displayMode == other.displayMode &&
+           keyboardModifiers == other.keyboardModifiers &&
+           canvasLeft == other.canvasLeft && canvasTop == other.canvasTop &&
+           canvasWidth == other.canvasWidth && canvasHeight == other.canvasHeight &&
+           showCanvas == other.showCanvas &&
+           backgroundVersion == other.backgroundVersion &&
+           version == other.version;
+}
+
+View::LayerCacheKey View::layerCacheKey_() const
+{
+    Time t = activeTime();
+    LayerCacheKey key;
+    key.cameraX = camera2D().x();
+    key.cameraY = camera2D().y();
+    key.zoom = camera2D().zoom();
+    key.width = viewportWidth_;
+    key.height = viewportHeight_;
+    key.time = t.floatTime();
+    key.timeType = t.type();
+    key.displayMode = viewSettings_.displayMode();
+    key.keyboardModifiers = global()->keyboardModifiers();
+    key.canvasLeft = scene_->left();
+    key.canvasTop = scene_->top();
+    key.canvasWidth = scene_->width();
+    key.canvasHeight = scene_->height();
+    key.showCanvas = global()->showCanvas();
+    key.backgroundVersion = backgroundRenderers_[scene_->background()]->version();
+    key.version = sceneVersion_(t);
+    return key;
+}
+
+// In select mode, the frame cache is used instead
+bool View::isLayerCacheable_() const
+{
+    static const DevSettings::Bool frozenLayer("frozen layer cache");
+    return frozenLayer &&
+           !renderThread_ && // its frames may be behind the scene
+           !isCameraMoving_ && // cells may be drawn from tiles
+           (GLEW_VERSION_3_0 || GLEW_ARB_framebuffer_object) &&
+           scene_->vectorAnimationComplex() &&
+           global()->toolMode() != Global::SELECT &&
+           !isDrawingToImage_ && !isDrawingOffscreen_;
+}
+
+bool View::drawFrozenLayer_()
+{
+    if(!isLayerCacheable_())
+    {
+        isLayerCacheValid_ = false;
+        return false;
+    }
+
+    LayerCacheKey key = layerCacheKey_();
+    if(isLayerCacheValid_ && key == layerKey_)
+    {
+        // Draw cached layer covering the whole viewport, as is
+        glMatrixMode(GL_PROJECTION);
+        glPushMatrix();
+        glLoadIdentity();
+        glMatrixMode(GL_MODELVIEW);
+        glPushMatrix();
+        glLoadIdentity();
+
+        glPushAttrib(GL_ENABLE_BIT);
+        glDisable(GL_BLEND);
+        glEnable(GL_TEXTURE_2D);
+        glBindTexture(GL_TEXTURE_2D, frameTextureId_);
+        glColor4d(1.0, 1.0, 1.0, 1.0);
+        glBegin(GL_QUADS);
+        {
+            glTexCoord2d(0.0, 0.0); glVertex2d(-1.0, -1.0);
+            glTexCoord2d(1.0, 0.0); glVertex2d(1.0, -1.0);
+            glTexCoord2d(1.0, 1.0); glVertex2d(1.0, 1.0);
+            glTexCoord2d(0.0, 1.0); glVertex2d(-1.0, 1.0);
+        }
+        glEnd();
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glPopAttrib();
+
+        glPopMatrix();
+        glMatrixMode(GL_PROJECTION);
+        glPopMatrix();
+        glMatrixMode(GL_MODELVIEW);
+
+        viewSettings_.setVisibleRect(xSceneMin(), xSceneMax(), ySceneMin(), ySceneMax());
+    }
+    else
+    {
+        // Draw everything but overlays, as drawFrame_() does, and keep it
+        glClearColor(1.0,1.0,1.0,1.0);
+        glClear(GL_COLOR_BUFFER_BIT);
+        scene_->drawCanvas(viewSettings_);
+        viewSettings_.setVisibleRect(xSceneMin(), xSceneMax(), ySceneMin(), ySceneMax());
+        isDrawingFrozenLayer_ = true;
+        drawSceneDelegate_(activeTime());
+        isDrawingFrozenLayer_ = false;
+
+        isFrameCacheValid_ = false;
+        isLayerCacheValid_ = cacheFrame_(0, 0, viewportWidth_, viewportHeight_);
+        layerKey_ = key;
+    }
+
+    // Draw overlays live
+    scene_->vectorAnimationComplex()->drawOverlays(activeTime(), viewSettings_);
+
+    return true;
+}
+
+// Copies the given region of the frame drawn on screen, in OpenGL window
+// coordinates, to the cached frame. The whole frame is copied if the texture
+// needs to be (re)created.
+bool View::cacheFrame_(int x, int y, int w, int h)
+{
+    if(!frameFboId_ || frameWidth_ != viewportWidth_ || frameHeight_ != viewportHeight_)
+    {
+        deleteFrameCache_();
+        frameWidth_ = viewportWidth_;
+        frameHeight_ = viewportHeight_;
+        x = 0;
+        y = 0;
+        w = frameWidth_;
+        h = frameHeight_;
+
+        glGenTextures(1, &frameTextureId_);
+        glBindTexture(GL_TEXTURE_2D, frameTextureId_);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, frameWidth_, frameHeight_, 0,
+                     GL_RGBA, GL_UNSIGNED_BYTE, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glGenFramebuffers(1, &frameFboId_);
+        glBindFramebuffer(GL_FRAMEBUFFER, frameFboId_);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, frameTextureId_, 0);
+        GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if(status != GL_FRAMEBUFFER_COMPLETE)
+        {
+            qDebug() << "Error: frame cache FBO status != GL_FRAMEBUFFER_COMPLETE";
+            deleteFrameCache_();
+            return false;
+        }
+    }
+
+    // Resolve the (multisample) window framebuffer into the texture
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, frameFboId_);
+    glBlitFramebuffer(x, y, x + w, y + h, x, y, x + w, y + h, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    return true;
+}
+
+void View::deleteFrameCache_()
+{
+    isFrameCacheValid_ = false;
+    if(!frameFboId_ && !frameTextureId_)
+        return;
+
+    makeCurrent();
+    glDeleteFramebuffers(1, &frameFboId_);
+    glDeleteTextures(1, &frameTextureId_);
+    frameFboId_ = 0;
+    frameTextureId_ = 0;
+    frameWidth_ = 0;
+    frameHeight_ = 0;
+}
+
 void View::updatePicking()
 {
+    VPAINT_TRACE_ZONE("View::updatePicking");
+
+    if(isCompressingMotion_())
+    {
+        isUpdatePickingPending_ = true;
+        scheduleRefresh_();
+    }
+    else
+    {
+        updatePicking_();
+    }
+}
+
+void View::updatePicking_()
+{
+    isUpdatePickingPending_ = false;
+
     // Remove previously highlighted object
     hoveredObject_ = Picking::Object();
 
     if(!pickingIsEnabled_)
         return;
 
+    // Postpone redrawing the picking image until it is actually needed,
+    // i.e., until the next hover query, or until input has been idle for a
+    // while if the mouse is over this view, so that the highlighted object
+    // is up to date (see updatePickingWhenIdle_())
+    isPickingDirty_ = true;
+    if(underMouse())
+        pickingIdleTimer_->start(PICKING_IDLE_DELAY);
+}
+
+void View::updatePickingWhenIdle_()
+{
+    // Hovering is suspended during mouse actions. The picking image is then
+    // redrawn by the first hover query after the action, if still needed
+    if(!isPickingDirty_ || !pickingIsEnabled_ || isBusy() || !underMouse())
+        return;
+
+    updateHoveredObject(mouse_Event_X_, mouse_Event_Y_);
+}
+
+bool View::isCompressingMotion_() const
+{
+    static const DevSettings::Bool motionCompression("motion compression");
+    return GLWidget::isAnyPMRActionPerformed() && motionCompression;
+}
+
+void View::scheduleRefresh_()
+{
+    if(refreshTimer_->isActive())
+        return;
+
+    // Samples received until the next display refresh will be drawn together
+    qreal refreshRate = QGuiApplication::primaryScreen() ?
+                        QGuiApplication::primaryScreen()->refreshRate() : 60;
+    if(refreshRate < 1)
+        refreshRate = 60;
+    refreshTimer_->start(qRound(1000 / refreshRate));
+}
+
+void View::refresh_()
+{
+    // Same order as MainWindow: picking first, then drawing
+    if(isUpdatePickingPending_)
+        updatePicking_();
+    if(isUpdatePending_)
+        update_();
+}
+
+void View::invalidatePicking()
+{
+    hoveredObject_ = Picking::Object();
+    isPickingDirty_ = true;
+}
+
+void View::renderPicking_()
+{
+    isPickingDirty_ = false;
+
     // Make this widget's rendering context the current OpenGL context
     makeCurrent();
 
@@ -1667,26 +3462,44 @@ void View::updatePicking()
         return;
     }
     else if(
-        pickingImg_
-        && (WINDOW_SIZE_X_ == (uint)m_viewport[2])
-        && (WINDOW_SIZE_Y_ == (uint)m_viewport[3]))
+        pickingBuffer_.isAllocated()
+        && (pickingBuffer_.width() == m_viewport[2])
+        && (pickingBuffer_.height() == m_viewport[3]))
     {
         // necessary objects already created: do nothing
     }
     else
     {
         deletePicking();
-        WINDOW_SIZE_X_ = m_viewport[2];
-        WINDOW_SIZE_Y_ = m_viewport[3];
-        newPicking();
+        newPicking(m_viewport[2], m_viewport[3]);
     }
 
-    // set rendering destination to FBO
-    glBindFramebuffer(GL_FRAMEBUFFER, fboId_);
+    // In region picking mode, the region is drawn on demand by the hover query
+    if(isPickingRegion_)
+    {
+        isPickingRegionValid_ = false;
+        return;
+    }
 
-    // clear buffers
-    glClearColor(1.0, 1.0, 1.0, 1.0);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    // Reuse the previous picking image if the camera was only translated by
+    // whole pixels since, only drawing the newly exposed borders
+    static const DevSettings::Bool pickingReuse("picking reuse");
+    bool hasKey = (scene_->vectorAnimationComplex() != 0);
+    PickingCacheKey key;
+    if(hasKey)
+    {
+        key = pickingCacheKey_();
+        if(pickingReuse && isPickingKeyValid_ && shiftPicking_(key))
+        {
+            pickingKey_ = key;
+            return;
+        }
+    }
+    pickingKey_ = key;
+    isPickingKeyValid_ = hasKey;
+
+    // set rendering destination to FBO, and clear it
+    pickingBuffer_.beginDraw();
 
     // Should we setup other things? (e.g., disabling antialiasing)
     // Seems to work as is. If issues, check GLWidget::initilizeGL()
@@ -1694,20 +3507,72 @@ void View::updatePicking()
     // Setup camera position and orientation
     setCameraPositionAndOrientation();
 
-    // draw the picking
+    // draw the picking, culling cells outside of the viewport
+    viewSettings_.setVisibleRect(xSceneMin(), xSceneMax(), ySceneMin(), ySceneMax());
     drawPick();
 
     // unbind FBO
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    pickingBuffer_.endDraw();
 
-    // extract the texture info from GPU to RAM: EXPENSIVE + MAY CAUSE OPENGL STALL
-    glBindTexture(GL_TEXTURE_2D, textureId_);
-    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, pickingImg_);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    // extract the picking image from GPU to RAM
+    pickingBuffer_.read();
+}
 
-    // Update highlighted object
-    if(underMouse())
+View::PickingCacheKey View::pickingCacheKey_() const
+{
+    Time t = activeTime();
+    PickingCacheKey key;
+    key.cameraX = camera2D().x();
+    key.cameraY = camera2D().y();
+    key.zoom = camera2D().zoom();
+    key.width = pickingBuffer_.width();
+    key.height = pickingBuffer_.height();
+    key.time = t.floatTime();
+    key.timeType = t.type();
+    key.displayMode = viewSettings_.displayMode();
+    key.version = scene_->vectorAnimationComplex()->drawingVersion(t, false);
+    return key;
+}
+
+// If key only differs from the key of the current picking image by a
+// translation of whole pixels, shifts the CPU copy of the image accordingly
+// and draws the exposed borders. Returns false, doing nothing, otherwise.
+bool View::shiftPicking_(const PickingCacheKey & key)
+{
+    const PickingCacheKey & old = pickingKey_;
+    if(key.zoom != old.zoom || key.width != old.width || key.height != old.height ||
+       key.time != old.time || key.timeType != old.timeType ||
+       key.displayMode != old.displayMode || key.version != old.version)
     {
-        updateHoveredObject(mouse_Event_X_, mouse_Event_Y_);
+        return false;
     }
+    const int dx = qRound(key.cameraX - old.cameraX);
+    const int dy = qRound(key.cameraY - old.cameraY);
+    if(std::abs(key.cameraX - old.cameraX - dx) > 1e-6 ||
+       std::abs(key.cameraY - old.cameraY - dy) > 1e-6)
+    {
+        return false;
+    }
+    const int w = pickingBuffer_.width();
+    const int h = pickingBuffer_.height();
+    const int exposedArea = std::abs(dx) * h + std::abs(dy) * w;
+    if(exposedArea > MAX_PARTIAL_REDRAW_AREA * w * h)
+        return false;
+
+    // Shift the CPU copy: the new pixel at (x, y) in window coordinates is
+    // the old one at (x-dx, y-dy)
+    if(!pickingBuffer_.shift(dx, dy))
+        return false;
+
+    // Draw exposed borders
+    if(dx > 0)
+        renderPickingRect_(0, 0, dx - 1, h - 1);
+    else if(dx < 0)
+        renderPickingRect_(w + dx, 0, w - 1, h - 1);
+    if(dy > 0)
+        renderPickingRect_(0, 0, w - 1, dy - 1);
+    else if(dy < 0)
+        renderPickingRect_(0, h + dy, w - 1, h - 1);
+
+    return true;
 }
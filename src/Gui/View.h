@@ -14,6 +14,7 @@
 #include <cmath>
 #include <iostream>
 #include "Picking.h"
+#include "PickingBuffer.h"
 #include "GLWidget.h"
 #include "GeometryUtils.h"
 #include <QList>
@@ -23,11 +24,18 @@
 
 #include <QImage>
 #include <QMap>
+#include <QHash>
+#include <QPair>
 
 #include "ViewSettings.h"
+#include "SessionRecorder.h"
+#include "MemoryStats.h"
+#include "RenderThread.h"
+#include "VectorAnimationComplex/BoundingBox.h"
 
 
 class Scene;
+class QTimer;
 namespace VectorAnimationComplex
 {
 class VAC;
@@ -49,7 +57,7 @@ struct MouseEvent
     bool alt, control, shift;
 };
 
-class View: public GLWidget
+class View: public GLWidget, public MemoryStats::Source
 {
     Q_OBJECT
     
@@ -57,6 +65,9 @@ public:
     View(Scene *scene, QWidget *parent);
     virtual ~View();
 
+    // GPU and CPU memory of the render caches and picking buffers
+    void reportMemory(MemoryStats::Report & report) const;
+
     void initCamera();
 
     Scene * scene();
@@ -116,9 +127,26 @@ public:
     QImage drawToImage(double x, double y, double w, double h, int imgW, int imgH, bool useViewSettings);
     QImage drawToImage(Time t, double x, double y, double w, double h, int imgW, int imgH, bool useViewSettings);
 
+    // Same as drawToImage(), but draws tiles that are streamed to a PNG file,
+    // for images larger than the OpenGL implementation or memory allow
+    bool drawToPng(Time t, double x, double y, double w, double h, int imgW, int imgH, bool useViewSettings, const QString & filePath);
+
+    // Playback cache. Frames are pre-rendered to textures while idle (see
+    // Timeline), then drawn instead of the scene during playback, as long as
+    // neither the view nor the cells existing at that frame changed.
+    //
+    // renderPlaybackFrame() returns true if the frame was rendered, and false
+    // if it was already up to date or doesn't fit in the "playback cache (MB)"
+    // budget, see isPlaybackCacheFull().
+    bool renderPlaybackFrame(int frame);
+    bool isPlaybackCacheFull() const;
+    void trimPlaybackCache(int firstFrame, int lastFrame); // forget frames outside range
+
 public slots:
     void update();        // update only this view (i.e., redraw the scene, leave other views unchanged)
-    void updatePicking(); // update picking for this view only (i.e., redraw the picking image of this view)
+    void updateHighlight(); // same as update(), knowing that only which cell is hovered may have changed
+    void updatePicking(); // update picking for this view only (i.e., redraw the picking image of this view, when needed)
+    void invalidatePicking(); // same as updatePicking(), but never redrawn before the next hover query
     bool updateHoveredObject(int x, int y);
     void handleNewKeyboardModifiers();
 
@@ -130,13 +158,23 @@ public slots:
 
     void updateZoomFromView();
 
-    void drawSceneDelegate_(Time t);
+    void drawSceneDelegate_(Time t, bool isOnScreen = false);
+
+    void clearPlaybackCache(); // also clears the onion skin cache
 
 protected:
     virtual void resizeEvent(QResizeEvent * event);
 
+private slots:
+    void updatePickingWhenIdle_();
+    void refresh_();
+    void cameraChanged_();
+    void stopCameraMotion_();
+    void renderTilesWhenIdle_();
+
 signals:
     void allViewsNeedToUpdate();        // update all views (including other 2D or 3D views)
+    void allViewsNeedToUpdateHighlight(); // same, knowing that only which cell is hovered may have changed
     void allViewsNeedToUpdatePicking(); // update picking of all views (including other 2D or 3D views)
 
     void settingsChanged();
@@ -155,19 +193,277 @@ private:
     MouseEvent mouseEvent() const;
     QPoint lastMousePos_;
 
-    // picking
-    void newPicking();
+    // See GLWidget::tabletSamples_
+    void continueSketchWithTabletSamples_();
+    double lastTabletSampleX_; // in widget coordinates, NaN before the first sample
+    double lastTabletSampleY_;
+    qint64 tabletSampleTime_;  // oldest sample consumed but not drawn yet, or -1
+
+    // Zoom and pan so that bb fills the view (see fitAllInWindow())
+    void fitInWindow_(const VectorAnimationComplex::BoundingBox & bb);
+
+    // Draws to img, which must have room for imgW*imgH RGBA pixels
+    bool drawToBuffer_(Time t, double x, double y, double w, double h, int imgW, int imgH, bool useViewSettings, uchar * img);
+
+
+    // Offscreen render targets of drawToImage(), kept for reuse, e.g., across
+    // all frames of an exported sequence: a multisample FBO where the scene
+    // is drawn, and a standard FBO where it is resolved
+    struct OffscreenTarget
+    {
+        int width, height, samples;
+        GLuint msFboId, msColorBufferId, msDepthBufferId;
+        GLuint fboId, textureId, rboId;
+    };
+    QList<OffscreenTarget> offscreenTargets_; // most recently used first
+    bool getOffscreenTarget_(int width, int height, int samples, OffscreenTarget & target);
+    void deleteOffscreenTarget_(const OffscreenTarget & target);
+    void deleteOffscreenTargets_();
+
+    // Draws to an offscreen target, where the image is left resolved in
+    // target.textureId, with premultiplied alpha and y-axis up. If drawCanvas
+    // is true, the canvas is drawn over opaque white as on screen, otherwise
+    // the image is transparent where the scene is empty.
+    bool drawToOffscreenTarget_(Time t, double x, double y, double w, double h, int imgW, int imgH,
+                                bool useViewSettings, bool drawCanvas, OffscreenTarget & target);
+
+    // Frames of the playback cache, all drawn with the same view, described
+    // by the key. The cache is cleared whenever the key changes.
+    struct PlaybackCacheKey
+    {
+        double cameraX, cameraY, zoom;
+        double canvasLeft, canvasTop, canvasWidth, canvasHeight;
+        int width, height; // size of the textures
+        bool showCanvas;
+        bool operator==(const PlaybackCacheKey & other) const;
+    };
+    struct PlaybackFrame
+    {
+        GLuint textureId;
+        unsigned int version; // see playbackVersion_()
+    };
+    PlaybackCacheKey playbackCacheKey_() const;
+    void updatePlaybackCacheKey_();
+    unsigned int playbackVersion_(int frame) const;
+    bool drawPlaybackFrame_();
+    PlaybackCacheKey playbackKey_;
+    QMap<int, PlaybackFrame> playbackFrames_;
+
+    // Onion skin cache. Each onion skin is rendered once to a transparent
+    // texture of the size of the viewport, then composited over the
+    // background with the onion skin transparency ratio, until the cells
+    // existing at its time change (see VAC::drawingVersion()). The cache is
+    // cleared whenever the view changes, and with the playback cache when
+    // view settings change. Onion skins are identified by their time and
+    // their index relative to the current frame, since the latter determines
+    // their offset (index is always 0 when onion skins are not offset).
+    struct OnionSkinCacheKey
+    {
+        double cameraX, cameraY, zoom;
+        int width, height; // size of the viewport
+        bool operator==(const OnionSkinCacheKey & other) const;
+    };
+    struct OnionSkin
+    {
+        GLuint textureId;
+        unsigned int version; // see VAC::drawingVersion()
+        unsigned int lastUsed;
+    };
+    typedef QPair<double, int> OnionSkinId;
+    OnionSkinCacheKey onionSkinCacheKey_() const;
+    bool drawOnionSkinsFromCache_(Time t);
+    bool renderOnionSkin_(Time t, int index, OnionSkin & skin);
+    void clearOnionSkinCache_();
+    OnionSkinCacheKey onionSkinKey_;
+    QMap<OnionSkinId, OnionSkin> onionSkins_;
+    unsigned int onionSkinCounter_;
+
+    // Frame cache for partial redraws. In select mode, each frame drawn on
+    // screen is also resolved to a texture. If only the hovered cell changed
+    // since, the next frame is drawn from this texture, and only the bounding
+    // boxes of the previously and newly hovered cells are redrawn over it,
+    // scissored. The cache is invalidated by update(), but not by
+    // updateHighlight(), and whenever the key changes.
+    struct FrameCacheKey
+    {
+        double cameraX, cameraY, zoom;
+        int width, height; // size of the viewport
+        double time;
+        int timeType;
+        int displayMode;
+        int keyboardModifiers; // affect which cells are highlighted
+        unsigned int version; // see VAC::drawingVersion(time, false)
+        bool operator==(const FrameCacheKey & other) const;
+    };
+    FrameCacheKey frameCacheKey_() const;
+    bool isFrameCacheable_() const;
+    bool drawFrameFromCache_();
+    bool cacheFrame_(int x, int y, int w, int h);
+    void deleteFrameCache_();
+    FrameCacheKey frameKey_;
+    int frameHoveredCellId_; // -1 if none
+    bool isFrameCacheValid_;
+    bool isFrameCacheDirty_;
+    GLuint frameFboId_;
+    GLuint frameTextureId_;
+    int frameWidth_;
+    int frameHeight_;
+
+    // Frozen layer cache. With tools whose overlays change at every mouse
+    // move, e.g., the edge being sketched, everything but the overlays is
+    // drawn once to a texture, shared with the frame cache, and composited
+    // until the cells drawn at this time or the view change. Only the
+    // overlays are drawn live (see VAC::drawOverlays()). The cache is also
+    // invalidated with the playback cache.
+    struct LayerCacheKey
+    {
+        double cameraX, cameraY, zoom;
+        int width, height; // size of the viewport
+        double time;
+        int timeType;
+        int displayMode;
+        int keyboardModifiers; // affect which cells are highlighted
+        double canvasLeft, canvasTop, canvasWidth, canvasHeight;
+        bool showCanvas;
+        unsigned int backgroundVersion; // textures are loaded asynchronously
+        unsigned int version; // see sceneVersion_()
+        bool operator==(const LayerCacheKey & other) const;
+    };
+    LayerCacheKey layerCacheKey_() const;
+    bool isLayerCacheable_() const;
+    bool drawFrozenLayer_();
+    unsigned int sceneVersion_(Time t) const;
+    LayerCacheKey layerKey_;
+    bool isLayerCacheValid_;
+    bool isDrawingFrozenLayer_;
+
+    // Cells drawn by a RenderThread, if enabled in the developer settings.
+    // The latest frame it has drawn is composited on screen, then tools and
+    // cursors are drawn over it by the GUI thread. Packets are only submitted
+    // when they differ from the previous one, so that the redraw triggered
+    // by a finished frame doesn't submit a new one.
+    bool drawCellsInRenderThread_(Time t);
+    void drawRenderFrame_(const RenderThread::Frame & frame);
+    void deleteRenderThread_();
+    RenderThread * renderThread_;
+    std::shared_ptr<const RenderPacket> submittedPacket_;
+
+    // Tile cache for camera motion. While the camera is panned or zoomed,
+    // cells are drawn from square tiles of a fixed size in pixels, rendered
+    // at the power-of-two zoom level closest to the zoom of the view, like
+    // map tiles. Tiles are kept across camera motions, and only the tiles
+    // intersecting the bounding boxes of cells which changed since they were
+    // rendered are invalidated. A few missing tiles are rendered per frame,
+    // the others are replaced by coarser tiles if any, and all of them are
+    // rendered progressively between frames, as well as the tiles around
+    // the viewport once the camera stops. Cells are then drawn exactly again.
+    struct TileId
+    {
+        int level; // tiles have a scale of 2^level pixels per scene unit
+        int i, j;  // position in the grid of tiles of this level
+        bool operator<(const TileId & other) const;
+    };
+    struct Tile
+    {
+        GLuint textureId;
+        unsigned int lastUsed;
+    };
+    struct TileCacheKey
+    {
+        double time;
+        int timeType;
+        int displayMode;
+        bool operator==(const TileCacheKey & other) const;
+    };
+    struct TileCellStamp
+    {
+        unsigned int stamp;
+        VectorAnimationComplex::BoundingBox boundingBox;
+    };
+    bool drawCellsFromTiles_(Time t);
+    void updateTileCache_(Time t);
+    bool renderTile_(Time t, const TileId & id, Tile & tile);
+    void drawTile_(const TileId & id, const Tile & tile, const TileId & drawnId);
+    void visibleTiles_(int level, int margin, QList<TileId> & res) const;
+    void invalidateTiles_(const VectorAnimationComplex::BoundingBox & bb);
+    void trimTileCache_();
+    void clearTileCache_();
+    QMap<TileId, Tile> tiles_;
+    TileCacheKey tileKey_;
+    QHash<int, TileCellStamp> tileCellStamps_; // cells when tiles were last updated
+    std::vector<int> tileCellOrder_;
+    unsigned int tileCounter_;
+    bool isCameraMoving_;
+    QTimer * cameraStopTimer_;
+    QTimer * tileTimer_;
+
+    // Records a tool event at the interactive time of this view, with the
+    // tablet pressure and hovered object of the current mouse event
+    void recordEvent_(SessionRecorder::EventType type, double x, double y, double width = 0);
+
+    // Draws the frame, and statistics about it if enabled (see RenderStats)
+    void drawFrame_();
+    void drawRenderStats_();
+
+    // picking: the picking image, and its readback, are managed by
+    // pickingBuffer_, which is asynchronous unless in region picking mode
+    void newPicking(int width, int height);
     void drawPick();
-    uchar * pickingImg(int x, int y);
-    GLuint WINDOW_SIZE_X_;
-    GLuint WINDOW_SIZE_Y_;
-    GLuint textureId_;
-    GLuint rboId_;
-    GLuint fboId_;
-    uchar *pickingImg_;
+    void resolvePicking_();
+    PickingBuffer pickingBuffer_;
     Picking::Object hoveredObject_;
     bool pickingIsEnabled_;
 
+    // Region picking: instead of the whole viewport, only a small region
+    // around the mouse cursor is drawn and read back, on demand. It is kept
+    // until the scene changes or the cursor gets out of it.
+    void renderPicking_();
+    void renderPickingRegion_(int x, int y);
+
+    // Picking on CPU: no picking image at all, the object under the cursor is
+    // directly computed from the geometry of the scene (see Scene::pick())
+    bool isPickingOnCpu_() const;
+    Picking::Object pickOnCpu_(int x, int y);
+    bool isPickingDirty_;
+    QTimer * pickingIdleTimer_; // see updatePicking()
+    bool isPickingRegion_;
+    bool isPickingRegionValid_;
+    int pickingRegionXMin_; // in window coordinates, inclusive
+    int pickingRegionXMax_;
+    int pickingRegionYMin_;
+    int pickingRegionYMax_;
+    void renderPickingRect_(int xMin, int yMin, int xMax, int yMax);
+
+    // Picking reuse: when the camera was only translated by whole pixels
+    // since the picking image was drawn, e.g. while panning, the image is
+    // shifted on the CPU instead, and only the exposed borders are drawn and
+    // read back. Not used with region picking, which is cheap anyway.
+    struct PickingCacheKey
+    {
+        double cameraX, cameraY, zoom;
+        int width, height; // size of the picking image
+        double time;
+        int timeType;
+        int displayMode;
+        unsigned int version; // see VAC::drawingVersion(time, false)
+    };
+    PickingCacheKey pickingCacheKey_() const;
+    bool shiftPicking_(const PickingCacheKey & key);
+    PickingCacheKey pickingKey_;
+    bool isPickingKeyValid_; // also false when view settings changed
+
+    // Motion compression: while a press-move-release action is performed in
+    // any view, e.g. sketching with a high-rate tablet, update() and
+    // updatePicking() only request a refresh, performed at most once per
+    // display refresh by refresh_(), instead of redrawing for each sample
+    bool isCompressingMotion_() const;
+    void scheduleRefresh_();
+    void update_();
+    void updatePicking_();
+    QTimer * refreshTimer_;
+    bool isUpdatePending_;
+    bool isUpdatePickingPending_;
+
     // PMR mouse event temp variables
     int currentAction_;
     double sculptStartRadius_;
@@ -184,6 +480,7 @@ private:
 
     // View Settings
     ViewSettings viewSettings_;
+    void translateOnionSkin_(double dx, double dy);
     ViewSettingsWidget * viewSettingsWidget_;
 
     // Draw background
@@ -191,6 +488,8 @@ private:
     // than one Background (i.e., one per layer)
     void drawBackground_(Background * background, int frame);
     QMap<Background *, BackgroundRenderer *> backgroundRenderers_;
+    bool isDrawingToImage_; // if true, backgrounds are drawn at full resolution
+    bool isDrawingOffscreen_; // if true, the onion skin cache is not used
 };
 
 #endif
@@ -12,6 +12,7 @@
 #include <QtDebug>
 #include "OpenGL.h"
 #include "Global.h"
+#include "DevSettings.h"
 #include "View.h"
 #include "Background/Background.h"
 #include "Background/BackgroundRenderer.h"
@@ -32,13 +33,12 @@ View3D::View3D(Scene *scene, QWidget *parent) :
     GLWidget(parent, false), // Difference from View here
     scene_(scene),
     displayedTimes_(),
-    pickingImg_(0),
     //frame_(0),
     vac_(0)
 {
     // Make renderers
     Background * bg = scene_->background();
-    backgroundRenderers_[bg] = new BackgroundRenderer(bg, context(), this);
+    backgroundRenderers_[bg] = BackgroundRenderer::shared(bg, sharedContext());
 
 
     viewSettingsWidget_ = new View3DSettingsWidget(viewSettings_);
@@ -401,6 +401,7 @@ void View3D::drawScene()
     // Set 2D settings from 3D settings
     ViewSettings view2DSettings = global()->activeView()->viewSettings();
     view2DSettings.setScreenRelative(false);
+    view2DSettings.setInfiniteVisibleRect();
     view2DSettings.setVertexTopologySize(viewSettings_.vertexTopologySize());
     view2DSettings.setEdgeTopologyWidth(viewSettings_.edgeTopologyWidth());
     view2DSettings.setDrawTopologyFaces(viewSettings_.drawTopologyFaces());
@@ -553,10 +554,7 @@ void View3D::drawScene()
                 }
                 else
                 {
-                    for(Iter it = cells.cbegin(); it != cells.cend(); ++it)
-                    {
-                        (*it)->draw(t, view2DSettings);
-                    }
+                    vac->drawFrame3D(t, view2DSettings);
                 }
             }
         }
@@ -589,11 +587,16 @@ void View3D::drawPick3D()
 
 bool View3D::updateHighlightedObject(int x, int y)
 {
-    if(!pickingImg_)
+    if(pickingBuffer_.hasPendingRead())
+    {
+        makeCurrent();
+        pickingBuffer_.resolve();
+    }
+    if(!pickingBuffer_.hasImage())
         return false; // otherwise the scene will keep updating
 
     Picking::Object old = highlightedObject_;
-    if(x<0 || (uint)x>=WINDOW_SIZE_X_ || y<0 || (uint)y>=WINDOW_SIZE_Y_)
+    if(x<0 || x>=pickingBuffer_.width() || y<0 || y>=pickingBuffer_.height())
     {
         highlightedObject_ = Picking::Object();
     }
@@ -604,153 +607,21 @@ bool View3D::updateHighlightedObject(int x, int y)
     return !(highlightedObject_ == old);
 }
 
-uchar * View3D::pickingImg(int x, int y)
-{
-    int k = 4*( (WINDOW_SIZE_Y_ - y - 1)*WINDOW_SIZE_X_ + x);
-    return &pickingImg_[k];
-}
-
-    
 Picking::Object View3D::getCloserObject(int x, int y)
 {
-    Picking::Object noObject;
-    
-    if(!pickingImg_)
-        return noObject; 
-
-    int leftBorderDist = x;
-    int rightBorderDist = WINDOW_SIZE_X_-1-x;
-    int topBorderDist = y;
-    int bottomBorderDist = WINDOW_SIZE_Y_-1-y;
-
-    int borderDist = qMin(qMin(leftBorderDist, rightBorderDist), 
-                    qMin(topBorderDist, bottomBorderDist));
-
-    if(borderDist<0)
-        return noObject;
-
-    int D = 10;
-    if(borderDist < D)
-        D = borderDist;
-    
-    for(int d=0; d<=D; d++)
-    {
-        if(d==0)
-        {
-            uchar * p = pickingImg(x,y);
-            uchar r=p[0], g=p[1], b=p[2];
-            if(r!=255 || g!=255 || b!=255)
-                return Picking::objectFromRGB(r,g,b);
-        }
-        else
-        {
-            // top row
-            for(int varX=x-d; varX<=x+d; varX++)
-            {
-                uchar * p = pickingImg(varX,y-d);
-                uchar r=p[0], g=p[1], b=p[2];
-                if(r!=255 || g!=255 || b!=255)
-                    return Picking::objectFromRGB(r,g,b);
-            }
-            // bottom row
-            for(int varX=x-d; varX<=x+d; varX++)
-            {
-                uchar * p = pickingImg(varX,y+d);
-                uchar r=p[0], g=p[1], b=p[2];
-                if(r!=255 || g!=255 || b!=255)
-                    return Picking::objectFromRGB(r,g,b);
-            }
-            // left column
-            for(int varY=y-d; varY<=y+d; varY++)
-            {
-                uchar * p = pickingImg(x-d,varY);
-                uchar r=p[0], g=p[1], b=p[2];
-                if(r!=255 || g!=255 || b!=255)
-                    return Picking::objectFromRGB(r,g,b);
-            }
-            // right column
-            for(int varY=y-d; varY<=y+d; varY++)
-            {
-                uchar * p = pickingImg(x+d,varY);
-                uchar r=p[0], g=p[1], b=p[2];
-                if(r!=255 || g!=255 || b!=255)
-                    return Picking::objectFromRGB(r,g,b);
-            }
-            
-        }
-    }
-
-    // no object within the range
-    return noObject;
+    return pickingBuffer_.closestObject(x, y, 10);
 }
 
 void View3D::deletePicking()
 {
-    if(pickingImg_)
+    if(pickingBuffer_.isAllocated())
     {
-        glDeleteFramebuffers(1, &fboId_);
-        glDeleteRenderbuffers(1, &rboId_);
-        glDeleteTextures(1, &textureId_);
+        makeCurrent();
+        pickingBuffer_.release();
         highlightedObject_ = Picking::Object();
-        delete[] pickingImg_;
-        pickingImg_ = 0;
-        WINDOW_SIZE_X_ = 0;
-        WINDOW_SIZE_Y_ = 0;
-    }
-}
-
-void View3D::newPicking()
-{
-    //  code adapted from http://www.songho.ca/opengl/gl_fbo.html
-
-    // create a texture object
-    glGenTextures(1, &textureId_);
-    glBindTexture(GL_TEXTURE_2D, textureId_);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_GENERATE_MIPMAP, GL_TRUE); // automatic mipmap
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, WINDOW_SIZE_X_, WINDOW_SIZE_Y_, 0,
-             GL_RGBA, GL_UNSIGNED_BYTE, 0);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    // create a renderbuffer object to store depth info
-    glGenRenderbuffers(1, &rboId_);
-    glBindRenderbuffer(GL_RENDERBUFFER, rboId_);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT,
-                    WINDOW_SIZE_X_, WINDOW_SIZE_Y_);
-    glBindRenderbuffer(GL_RENDERBUFFER, 0);
-
-    // create a framebuffer object
-    glGenFramebuffers(1, &fboId_);
-    glBindFramebuffer(GL_FRAMEBUFFER, fboId_);
-    
-    // attach the texture to FBO color attachment point
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
-                     GL_TEXTURE_2D, textureId_, 0);
-
-    // attach the renderbuffer to depth attachment point
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
-                      GL_RENDERBUFFER, rboId_);
-
-    // check FBO status
-    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
-    if(status != GL_FRAMEBUFFER_COMPLETE)
-    {
-        qDebug() << "ERROR void View3D::newPicking()"
-               << "FBO status != GL_FRAMEBUFFER_COMPLETE";
-        return;
     }
-
-    // switch back to window-system-provided framebuffer
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-    // allocate memory for picking
-    pickingImg_ = new uchar[4 * WINDOW_SIZE_X_ * WINDOW_SIZE_Y_];
 }
 
-
 void View3D::updatePicking()
 {
     // get the viewport size, allocate memory if necessary
@@ -762,34 +633,29 @@ void View3D::updatePicking()
         return;
     }
     else if(
-        pickingImg_
-        && (WINDOW_SIZE_X_ == (uint)m_viewport[2])
-        && (WINDOW_SIZE_Y_ == (uint)m_viewport[3]))
+        pickingBuffer_.isAllocated()
+        && (pickingBuffer_.width() == m_viewport[2])
+        && (pickingBuffer_.height() == m_viewport[3]))
     {
         // necessary objects already created: do nothing
     }
     else
     {
         deletePicking();
-        WINDOW_SIZE_X_ = m_viewport[2];
-        WINDOW_SIZE_Y_ = m_viewport[3];
-        newPicking();
+        pickingBuffer_.allocate(m_viewport[2], m_viewport[3],
+                                DevSettings::getBool("async picking"),
+                                DevSettings::getBool("integer picking"));
     }
     
-    // set rendering destination to FBO
-    glBindFramebuffer(GL_FRAMEBUFFER, fboId_);
-
-    // clear buffers
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    // set rendering destination to FBO, and clear it
+    pickingBuffer_.beginDraw();
 
     // draw the picking
     drawPick3D();
     
     // unbind FBO
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    pickingBuffer_.endDraw();
 
-    // extract the texture info from GPU to RAM
-    glBindTexture(GL_TEXTURE_2D, textureId_); 
-    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, pickingImg_);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    // extract the picking image from GPU to RAM
+    pickingBuffer_.read();
 }
@@ -14,6 +14,7 @@
 #include <cmath>
 #include <iostream>
 #include "Picking.h"
+#include "PickingBuffer.h"
 #include "GLWidget.h"
 #include "GeometryUtils.h"
 #include <QList>
@@ -104,15 +105,8 @@ struct MouseEvent
 
 
     // picking
-    void newPicking();
     void drawPick3D();
-    uchar * pickingImg(int x, int y);
-    GLuint WINDOW_SIZE_X_;
-    GLuint WINDOW_SIZE_Y_;
-    GLuint textureId_;
-    GLuint rboId_;
-    GLuint fboId_;
-    uchar *pickingImg_;
+    PickingBuffer pickingBuffer_;
     Picking::Object highlightedObject_;
 
     // Implementation details: Drawing Stroke
@@ -8,6 +8,8 @@
 
 #include "ViewSettings.h"
 
+#include <limits>
+
 ViewSettings::ViewSettings() :
     // Display
     zoom_(1.0),
@@ -22,6 +24,10 @@ ViewSettings::ViewSettings() :
     screenRelative_(true),
 
     time_(),
+    visibleXMin_(-std::numeric_limits<double>::infinity()),
+    visibleXMax_(std::numeric_limits<double>::infinity()),
+    visibleYMin_(-std::numeric_limits<double>::infinity()),
+    visibleYMax_(std::numeric_limits<double>::infinity()),
 
     // Onion skinning
     onionSkinningIsEnabled_(false),
@@ -50,6 +56,35 @@ void ViewSettings::setTime(const Time & t)
     time_ = t;
 }
 
+double ViewSettings::visibleXMin() const { return visibleXMin_; }
+double ViewSettings::visibleXMax() const { return visibleXMax_; }
+double ViewSettings::visibleYMin() const { return visibleYMin_; }
+double ViewSettings::visibleYMax() const { return visibleYMax_; }
+
+void ViewSettings::setVisibleRect(double xMin, double xMax, double yMin, double yMax)
+{
+    visibleXMin_ = xMin;
+    visibleXMax_ = xMax;
+    visibleYMin_ = yMin;
+    visibleYMax_ = yMax;
+}
+
+void ViewSettings::translateVisibleRect(double dx, double dy)
+{
+    visibleXMin_ += dx;
+    visibleXMax_ += dx;
+    visibleYMin_ += dy;
+    visibleYMax_ += dy;
+}
+
+void ViewSettings::setInfiniteVisibleRect()
+{
+    setVisibleRect(-std::numeric_limits<double>::infinity(),
+                   std::numeric_limits<double>::infinity(),
+                   -std::numeric_limits<double>::infinity(),
+                   std::numeric_limits<double>::infinity());
+}
+
 // Zoom level
 double ViewSettings::zoom() const
 {
@@ -61,6 +61,17 @@ public:
     Time time() const;
     void setTime(const Time & t);
 
+    // Part of the scene visible in the viewport, in scene coordinates. Cells
+    // entirely outside of it are not drawn. By default, the visible rect is
+    // infinite, i.e. no cells are culled.
+    double visibleXMin() const;
+    double visibleXMax() const;
+    double visibleYMin() const;
+    double visibleYMax() const;
+    void setVisibleRect(double xMin, double xMax, double yMin, double yMax);
+    void translateVisibleRect(double dx, double dy);
+    void setInfiniteVisibleRect();
+
     // Onion Skinning
 
     bool onionSkinningIsEnabled() const;
@@ -101,6 +112,10 @@ private:
     bool drawTopologyFaces_;
     bool screenRelative_;
     Time time_;
+    double visibleXMin_;
+    double visibleXMax_;
+    double visibleYMin_;
+    double visibleYMax_;
 
     // Onion skinning
     bool onionSkinningIsEnabled_;
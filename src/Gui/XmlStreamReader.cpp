@@ -8,8 +8,16 @@
 
 #include "XmlStreamReader.h"
 
+#include <QIODevice>
+
 XmlStreamReader::XmlStreamReader(QIODevice * device) :
-    QXmlStreamReader(device)
+    QXmlStreamReader(device),
+    binaryBlocks_(0),
+    progress_(0),
+    isCanceled_(0),
+    hasEagerFrames_(false),
+    firstEagerFrame_(0),
+    lastEagerFrame_(0)
 {
 
 }
@@ -19,3 +27,42 @@ XmlStreamReader::~XmlStreamReader()
 
 }
 
+void XmlStreamReader::setBinaryBlocks(const QByteArray * blocks)
+{
+    binaryBlocks_ = blocks;
+}
+
+const QByteArray * XmlStreamReader::binaryBlocks() const
+{
+    return binaryBlocks_;
+}
+
+void XmlStreamReader::setProgress(std::atomic<int> * permille, const std::atomic<bool> * isCanceled)
+{
+    progress_ = permille;
+    isCanceled_ = isCanceled;
+}
+
+void XmlStreamReader::checkProgress()
+{
+    if(progress_ && device() && !device()->isSequential() && device()->size() > 0)
+    {
+        int permille = static_cast<int>(1000 * device()->pos() / device()->size());
+        progress_->store(permille, std::memory_order_relaxed);
+    }
+    if(isCanceled() && !hasError())
+        raiseError("Canceled");
+}
+
+bool XmlStreamReader::isCanceled() const
+{
+    return isCanceled_ && isCanceled_->load(std::memory_order_relaxed);
+}
+
+void XmlStreamReader::setEagerFrames(int firstFrame, int lastFrame)
+{
+    hasEagerFrames_ = true;
+    firstEagerFrame_ = firstFrame;
+    lastEagerFrame_ = lastFrame;
+}
+
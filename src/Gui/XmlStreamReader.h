@@ -10,12 +10,44 @@
 #define XMLSTREAMREADER_H
 
 #include <QXmlStreamReader>
+#include <atomic>
 
 class XmlStreamReader: public QXmlStreamReader
 {
 public:
     XmlStreamReader(QIODevice * device);
     ~XmlStreamReader();
+
+    // Blocks of numeric data referenced from the XML, if read from a binary
+    // file (see IO/BinaryContainer.h). Null by default.
+    void setBinaryBlocks(const QByteArray * blocks);
+    const QByteArray * binaryBlocks() const;
+
+    // Reading in a worker thread (see MainWindow::openAsync_()). Readers of
+    // long lists of elements call checkProgress() regularly: it stores how
+    // far the device is read, in thousandths, and if isCanceled is set,
+    // raises an error so that all readers stop as if the document ended.
+    // Both are null by default.
+    void setProgress(std::atomic<int> * permille, const std::atomic<bool> * isCanceled);
+    void checkProgress();
+    bool isCanceled() const;
+
+    // Frames whose geometry must be read right away. Geometry at other
+    // frames may be deferred until first needed, as in lazy loading mode
+    // (see VAC::read()). By default, all frames are eager unless lazy
+    // loading is on, in which case they are the frames of the timeline.
+    void setEagerFrames(int firstFrame, int lastFrame);
+    bool hasEagerFrames() const { return hasEagerFrames_; }
+    int firstEagerFrame() const { return firstEagerFrame_; }
+    int lastEagerFrame() const { return lastEagerFrame_; }
+
+private:
+    const QByteArray * binaryBlocks_;
+    std::atomic<int> * progress_;
+    const std::atomic<bool> * isCanceled_;
+    bool hasEagerFrames_;
+    int firstEagerFrame_;
+    int lastEagerFrame_;
 };
 
 #endif // XMLSTREAMREADER_H
@@ -8,9 +8,359 @@
 
 #include "XmlStreamWriter.h"
 
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace
+{
+
+// Shortest decimal representation of doubles, using the Grisu2 algorithm
+// (F. Loitsch, "Printing Floating-Point Numbers Quickly and Accurately with
+// Integers", PLDI 2010). The output always reads back to the same double,
+// and is the shortest such representation in the vast majority of cases.
+
+struct DiyFp
+{
+    DiyFp() : f(0), e(0) {}
+    DiyFp(quint64 significand, int exponent) : f(significand), e(exponent) {}
+
+    explicit DiyFp(double d)
+    {
+        quint64 bits;
+        std::memcpy(&bits, &d, 8);
+        int biasedExponent = int((bits >> 52) & 0x7FF);
+        quint64 significand = bits & 0x000FFFFFFFFFFFFFULL;
+        if (biasedExponent != 0)
+        {
+            f = significand + 0x0010000000000000ULL;
+            e = biasedExponent - 1075;
+        }
+        else
+        {
+            f = significand;
+            e = -1074;
+        }
+    }
+
+    DiyFp operator-(const DiyFp & other) const
+    {
+        return DiyFp(f - other.f, e);
+    }
+
+    DiyFp operator*(const DiyFp & other) const
+    {
+        const quint64 M32 = 0xFFFFFFFFULL;
+        const quint64 a = f >> 32;
+        const quint64 b = f & M32;
+        const quint64 c = other.f >> 32;
+        const quint64 d = other.f & M32;
+        const quint64 ac = a * c;
+        const quint64 bc = b * c;
+        const quint64 ad = a * d;
+        const quint64 bd = b * d;
+        quint64 tmp = (bd >> 32) + (ad & M32) + (bc & M32);
+        tmp += 1ULL << 31; // round
+        return DiyFp(ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), e + other.e + 64);
+    }
+
+    DiyFp normalized() const
+    {
+        DiyFp res = *this;
+        while (!(res.f & 0x8000000000000000ULL))
+        {
+            res.f <<= 1;
+            res.e--;
+        }
+        return res;
+    }
+
+    // Boundaries m- and m+ of the interval of numbers that read back to this
+    // double, with the same exponent, m+ being normalized
+    void normalizedBoundaries(DiyFp & minus, DiyFp & plus) const
+    {
+        DiyFp pl((f << 1) + 1, e - 1);
+        while (!(pl.f & (0x0010000000000000ULL << 1)))
+        {
+            pl.f <<= 1;
+            pl.e--;
+        }
+        pl.f <<= 10;
+        pl.e -= 10;
+        DiyFp mi = (f == 0x0010000000000000ULL) ? DiyFp((f << 2) - 1, e - 2)
+                                                : DiyFp((f << 1) - 1, e - 1);
+        mi.f <<= mi.e - pl.e;
+        mi.e = pl.e;
+        minus = mi;
+        plus = pl;
+    }
+
+    quint64 f;
+    int e;
+};
+
+// Normalized 10^k for k = -348, -340, ..., 340
+const quint64 CACHED_POWERS_F[] = {
+    0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL,
+    0xcf42894a5dce35eaULL, 0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+    0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL, 0xbe5691ef416bd60cULL,
+    0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+    0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL,
+    0xc21094364dfb5637ULL, 0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+    0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL, 0xb23867fb2a35b28eULL,
+    0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+    0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL,
+    0xb5b5ada8aaff80b8ULL, 0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+    0x964e858c91ba2655ULL, 0xdff9772470297ebdULL, 0xa6dfbd9fb8e5b88fULL,
+    0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+    0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL,
+    0xaa242499697392d3ULL, 0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+    0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL, 0x9c40000000000000ULL,
+    0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+    0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL,
+    0x9f4f2726179a2245ULL, 0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+    0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL, 0x924d692ca61be758ULL,
+    0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+    0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL,
+    0x952ab45cfa97a0b3ULL, 0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+    0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL, 0x88fcf317f22241e2ULL,
+    0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+    0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL,
+    0x8bab8eefb6409c1aULL, 0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+    0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL, 0x80444b5e7aa7cf85ULL,
+    0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+    0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL,
+};
+const short CACHED_POWERS_E[] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+    -954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+    -688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+    -422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+    -157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+    109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+    375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+    641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+    907, 933, 960, 986, 1013, 1039, 1066,
+};
+
+// Cached power c = 10^-K such that the exponent of c*w is in [-60, -32]
+DiyFp cachedPower(int e, int & K)
+{
+    double dk = (-61 - e) * 0.30102999566398114 + 347; // dk must be positive
+    int k = int(dk);
+    if (dk - k > 0.0)
+        k++;
+    unsigned int index = unsigned(k >> 3) + 1;
+    K = -(-348 + int(index << 3));
+    return DiyFp(CACHED_POWERS_F[index], CACHED_POWERS_E[index]);
+}
+
+const quint64 POW10[] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+    100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL,
+    1000000000000ULL, 10000000000000ULL, 100000000000000ULL,
+    1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+    1000000000000000000ULL, 10000000000000000000ULL
+};
+
+void grisuRound(char * buffer, int length, quint64 delta, quint64 rest, quint64 tenKappa, quint64 wpw)
+{
+    while (rest < wpw && delta - rest >= tenKappa &&
+           (rest + tenKappa < wpw || wpw - rest > rest + tenKappa - wpw))
+    {
+        buffer[length - 1]--;
+        rest += tenKappa;
+    }
+}
+
+int numDecimalDigits(quint32 n)
+{
+    int res = 1;
+    while (res < 10 && n >= POW10[res])
+        ++res;
+    return res;
+}
+
+void digitGen(const DiyFp & W, const DiyFp & Mp, quint64 delta, char * buffer, int & length, int & K)
+{
+    const DiyFp one(1ULL << -Mp.e, Mp.e);
+    const DiyFp wpw = Mp - W;
+    quint32 p1 = quint32(Mp.f >> -one.e);
+    quint64 p2 = Mp.f & (one.f - 1);
+    int kappa = numDecimalDigits(p1);
+    length = 0;
+
+    while (kappa > 0)
+    {
+        const quint32 p = quint32(POW10[kappa - 1]);
+        const quint32 d = p1 / p;
+        p1 %= p;
+        if (d || length)
+            buffer[length++] = char('0' + d);
+        kappa--;
+        quint64 rest = (quint64(p1) << -one.e) + p2;
+        if (rest <= delta)
+        {
+            K += kappa;
+            grisuRound(buffer, length, delta, rest, POW10[kappa] << -one.e, wpw.f);
+            return;
+        }
+    }
+
+    for (;;)
+    {
+        p2 *= 10;
+        delta *= 10;
+        const char d = char(p2 >> -one.e);
+        if (d || length)
+            buffer[length++] = char('0' + d);
+        p2 &= one.f - 1;
+        kappa--;
+        if (p2 < delta)
+        {
+            K += kappa;
+            const int index = -kappa;
+            grisuRound(buffer, length, delta, p2, one.f, wpw.f * (index < 20 ? POW10[index] : 0));
+            return;
+        }
+    }
+}
+
+// Digits and decimal exponent K of a positive, finite, non-zero double
+void grisu2(double x, char * buffer, int & length, int & K)
+{
+    const DiyFp v(x);
+    DiyFp mMinus, mPlus;
+    v.normalizedBoundaries(mMinus, mPlus);
+
+    const DiyFp c = cachedPower(mPlus.e, K);
+    const DiyFp W = v.normalized() * c;
+    DiyFp Wp = mPlus * c;
+    DiyFp Wm = mMinus * c;
+    Wm.f++;
+    Wp.f--;
+    digitGen(W, Wp, Wp.f - Wm.f, buffer, length, K);
+}
+
+int writeExponent(int K, char * buffer)
+{
+    char * begin = buffer;
+    if (K < 0)
+    {
+        *buffer++ = '-';
+        K = -K;
+    }
+    if (K >= 100)
+    {
+        *buffer++ = char('0' + K / 100);
+        K %= 100;
+        *buffer++ = char('0' + K / 10);
+        *buffer++ = char('0' + K % 10);
+    }
+    else if (K >= 10)
+    {
+        *buffer++ = char('0' + K / 10);
+        *buffer++ = char('0' + K % 10);
+    }
+    else
+    {
+        *buffer++ = char('0' + K);
+    }
+    return int(buffer - begin);
+}
+
+// Formats digits*10^K in buffer, in plain or scientific notation. Returns
+// the resulting length.
+int prettify(char * buffer, int length, int K)
+{
+    const int kk = length + K; // 10^(kk-1) <= x < 10^kk
+
+    if (0 <= K && kk <= 21)
+    {
+        // 1234e7 -> 12340000000
+        for (int i = length; i < kk; i++)
+            buffer[i] = '0';
+        return kk;
+    }
+    else if (0 < kk && kk <= 21)
+    {
+        // 1234e-2 -> 12.34
+        std::memmove(&buffer[kk + 1], &buffer[kk], size_t(length - kk));
+        buffer[kk] = '.';
+        return length + 1;
+    }
+    else if (-6 < kk && kk <= 0)
+    {
+        // 1234e-6 -> 0.001234
+        const int offset = 2 - kk;
+        std::memmove(&buffer[offset], &buffer[0], size_t(length));
+        buffer[0] = '0';
+        buffer[1] = '.';
+        for (int i = 2; i < offset; i++)
+            buffer[i] = '0';
+        return length + offset;
+    }
+    else if (length == 1)
+    {
+        // 1e30
+        buffer[1] = 'e';
+        return 2 + writeExponent(kk - 1, &buffer[2]);
+    }
+    else
+    {
+        // 1234e30 -> 1.234e33
+        std::memmove(&buffer[2], &buffer[1], size_t(length - 1));
+        buffer[1] = '.';
+        buffer[length + 1] = 'e';
+        return length + 2 + writeExponent(kk - 1, &buffer[length + 2]);
+    }
+}
+
+// Writes the shortest representation of x that reads back to x. Buffer
+// must have room for 25 characters. Returns the resulting length.
+int formatDouble(double x, char * buffer)
+{
+    if (x != x)
+    {
+        std::memcpy(buffer, "nan", 3);
+        return 3;
+    }
+
+    int res = 0;
+    if (std::signbit(x))
+    {
+        buffer[res++] = '-';
+        x = -x;
+    }
+
+    if (x == 0)
+    {
+        buffer[res++] = '0';
+    }
+    else if (x > std::numeric_limits<double>::max())
+    {
+        std::memcpy(buffer + res, "inf", 3);
+        res += 3;
+    }
+    else
+    {
+        int length, K;
+        grisu2(x, buffer + res, length, K);
+        res += prettify(buffer + res, length, K);
+    }
+    return res;
+}
+
+// Size above which a streamed attribute value is written to device
+const int ATTRIBUTE_BUFFER_SIZE = 64 * 1024;
+
+}
+
 XmlStreamWriter::XmlStreamWriter(QIODevice * device) :
     QXmlStreamWriter(device),
-    indentLevel_(0)
+    indentLevel_(0),
+    binaryBlocks_(0),
+    attributeBuffer_()
 {
     setAutoFormatting(true);
     setAutoFormattingIndent(2);
@@ -21,6 +371,16 @@ XmlStreamWriter::~XmlStreamWriter()
 
 }
 
+void XmlStreamWriter::setBinaryBlocks(QByteArray * blocks)
+{
+    binaryBlocks_ = blocks;
+}
+
+QByteArray * XmlStreamWriter::binaryBlocks() const
+{
+    return binaryBlocks_;
+}
+
 void XmlStreamWriter::write(const QString & string) const
 {
     device()->write(string.toUtf8());
@@ -100,6 +460,53 @@ void XmlStreamWriter::writeAttribute(const QString & qualifiedName, const QStrin
     write("\"");
 }
 
+void XmlStreamWriter::writeAttributeName_(const QString & qualifiedName) const
+{
+    // Same indent as writeAttribute()
+    QString indent("\n");
+    indent += QString(indentLevel_*autoFormattingIndent(), QChar(' '));
+    write(indent);
+    write(qualifiedName);
+    write("=\"");
+}
+
+void XmlStreamWriter::flushAttributeBuffer_()
+{
+    device()->write(attributeBuffer_);
+
+    // Keeps the reserved capacity
+    attributeBuffer_.resize(0);
+}
+
+void XmlStreamWriter::writeStartAttribute(const QString & qualifiedName)
+{
+    writeAttributeName_(qualifiedName);
+    if (attributeBuffer_.capacity() < ATTRIBUTE_BUFFER_SIZE)
+        attributeBuffer_.reserve(ATTRIBUTE_BUFFER_SIZE + 64);
+}
+
+void XmlStreamWriter::writeAttributeChars(const char * chars)
+{
+    attributeBuffer_.append(chars);
+    if (attributeBuffer_.size() > ATTRIBUTE_BUFFER_SIZE)
+        flushAttributeBuffer_();
+}
+
+void XmlStreamWriter::writeAttributeDouble(double x)
+{
+    char chars[32];
+    const int n = formatDouble(x, chars);
+    attributeBuffer_.append(chars, n);
+    if (attributeBuffer_.size() > ATTRIBUTE_BUFFER_SIZE)
+        flushAttributeBuffer_();
+}
+
+void XmlStreamWriter::writeEndAttribute()
+{
+    attributeBuffer_.append('"');
+    flushAttributeBuffer_();
+}
+
 // Escape special characters
 QString XmlStreamWriter::escaped(const QString & s)
 {
@@ -63,8 +63,38 @@ public:
     void writeAttribute(const QXmlStreamAttribute & attribute);
     void writeAttributes(const QXmlStreamAttributes & attributes);
 
+    // Writes an attribute whose value is streamed in pieces, without building
+    // a QString. Meant for large numeric values, e.g.:
+    //
+    //   xml.writeStartAttribute("curve");
+    //   xml.writeAttributeChars("xywdense(");
+    //   xml.writeAttributeDouble(x);
+    //   xml.writeAttributeChars(")");
+    //   xml.writeEndAttribute();
+    //
+    // Chars are written as is: they must be ASCII and need no escaping.
+    // Doubles are written with the shortest representation that reads back
+    // to the same double, independently of the locale.
+    void writeStartAttribute(const QString & qualifiedName);
+    void writeAttributeChars(const char * chars);
+    void writeAttributeDouble(double x);
+    void writeEndAttribute();
+
+    // If non-null, large numeric data is appended to blocks rather than
+    // written as text (see IO/BinaryContainer.h). Null by default.
+    void setBinaryBlocks(QByteArray * blocks);
+    QByteArray * binaryBlocks() const;
+
 private:
     int indentLevel_;
+    QByteArray * binaryBlocks_;
+    QByteArray attributeBuffer_;
+
+    // Writes the indent and name of an attribute, up to the opening quote
+    void writeAttributeName_(const QString & qualifiedName) const;
+
+    // Writes attributeBuffer_ to device, and empties it
+    void flushAttributeBuffer_();
 
     // Raw-write to device, without escaping XML characters
     void write(const QString & string) const;
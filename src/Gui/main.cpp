@@ -10,12 +10,44 @@
 #include "MainWindow.h"
 #include "Global.h"
 #include "UpdateCheck.h"
+#include "IO/DocumentInfo.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <memory>
 
 int main(int argc, char *argv[])
 {
     Application app(argc, argv);
-    MainWindow mainWindow;
-    UpdateCheck update(&mainWindow);
+
+    // Batch mode: render, then exit without showing any window
+    if(app.isBatchMode())
+    {
+        MainWindow mainWindow(true);
+        return mainWindow.renderBatch(app.batchRenderOptions()) ? 0 : 1;
+    }
+
+    // Benchmark mode: run the benchmarks, then exit without showing any window
+    if(app.isBenchmarkMode())
+    {
+        MainWindow mainWindow(true);
+        if(app.benchmarkOptions().soakMinutes > 0)
+            return mainWindow.soakTest(app.benchmarkOptions()) ? 0 : 1;
+        if(!app.benchmarkOptions().replayPath.isEmpty())
+            return mainWindow.replaySession(app.benchmarkOptions()) ? 0 : 1;
+        return Benchmark::run(app.benchmarkOptions()) ? 0 : 1;
+    }
+
+    // Info mode: print the info of documents, then exit without showing any window
+    if(app.isInfoMode())
+        return DocumentInfo::print(app.infoPaths()) ? 0 : 1;
+
+    QElapsedTimer startupTimer;
+    startupTimer.start();
+    MainWindow mainWindow(false, app.logsStartupTimes());
+    if(app.logsStartupTimes())
+        qDebug().nospace() << "Startup: main window created in " << startupTimer.elapsed() << " ms";
 
     // About window
     if(global()->settings().showAboutDialogAtStartup())
@@ -23,12 +55,21 @@ int main(int argc, char *argv[])
         mainWindow.about();
     }
 
-    update.showWhenReady();
-
     // Main window
     QObject::connect(&app, SIGNAL(openFileRequested(QString)), &mainWindow, SLOT(open_(QString)));
     app.emitOpenFileRequest();
     mainWindow.show();
 
+    // Check for updates once the event loop runs, after the window has been
+    // shown, so that it doesn't delay startup
+    std::unique_ptr<UpdateCheck> update;
+    QTimer::singleShot(0, [&]()
+    {
+        if(app.logsStartupTimes())
+            qDebug().nospace() << "Startup: window shown after " << startupTimer.elapsed() << " ms";
+        update.reset(new UpdateCheck(&mainWindow));
+        update->showWhenReady();
+    });
+
     return app.exec();
 }